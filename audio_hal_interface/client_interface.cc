@@ -22,6 +22,7 @@
 #include <vendor/qti/hardware/bluetooth_audio/2.0/IBluetoothAudioProvidersFactory.h>
 #include <base/logging.h>
 #include <hidl/MQDescriptor.h>
+#include <algorithm>
 #include <future>
 
 #include "osi/include/log.h"
@@ -36,12 +37,17 @@ using ::android::hardware::Void;
 using vendor::qti::hardware::bluetooth_audio::V2_0::IBluetoothAudioPort;
 using vendor::qti::hardware::bluetooth_audio::V2_0::
     IBluetoothAudioProvidersFactory;
+using ::android::hardware::EventFlag;
 using DataMQ = ::android::hardware::MessageQueue<
     uint8_t, ::android::hardware::kSynchronizedReadWrite>;
 
 static constexpr int kDefaultDataReadTimeoutMs = 3;      // 3 ms
 static constexpr int kDefaultDataReadPollIntervalMs = 1;  // non-blocking poll
 
+// Event flag bits of the data fmq, as the MessageQueueFlagBits of audio HAL
+static constexpr uint32_t kDataMQNotEmpty = 1 << 0;
+static constexpr uint32_t kDataMQNotFull = 1 << 1;
+
 std::ostream& operator<<(std::ostream& os, const BluetoothAudioCtrlAck& ack) {
   switch (ack) {
     case BluetoothAudioCtrlAck::SUCCESS_FINISHED:
@@ -189,14 +195,19 @@ class BluetoothAudioDeathRecipient
 BluetoothAudioClientInterface::BluetoothAudioClientInterface(
     IBluetoothTransportInstance* sink,
     thread_t* message_loop, std::mutex* mutex)
-    : sink_(sink),
-      provider_(nullptr),
+    : provider_(nullptr),
+      sink_(sink),
       stack_if_(nullptr),
       session_started_(false),
       mDataMQ(nullptr),
+      mEventFlag(nullptr),
       external_mutex_(mutex),
       death_recipient_(new BluetoothAudioDeathRecipient(this, message_loop)) {}
 
+BluetoothAudioClientInterface::~BluetoothAudioClientInterface() {
+  DeleteEventFlag();
+}
+
 std::vector<AudioCapabilities>
 BluetoothAudioClientInterface::GetAudioCapabilities() const {
   return capabilities_;
@@ -336,7 +347,9 @@ int BluetoothAudioClientInterface::StartSession() {
   }
 
   if (tempDataMQ && tempDataMQ->isValid()) {
+    DeleteEventFlag();
     mDataMQ = std::move(tempDataMQ);
+    CreateEventFlag();
   } else if (sink_->GetSessionType() ==
                  SessionType::A2DP_HARDWARE_OFFLOAD_DATAPATH &&
              session_status == BluetoothAudioStatus::SUCCESS) {
@@ -410,6 +423,7 @@ int BluetoothAudioClientInterface::EndSession() {
     LOG(ERROR) << __func__ << ": BluetoothAudioHal nullptr";
     return -EINVAL;
   }
+  DeleteEventFlag();
   mDataMQ = nullptr;
   auto hidl_retval = provider_->endSession();
   if (!hidl_retval.isOk()) {
@@ -423,6 +437,52 @@ int BluetoothAudioClientInterface::EndSession() {
   return 0;
 }
 
+void BluetoothAudioClientInterface::CreateEventFlag() {
+  if (mDataMQ == nullptr || mDataMQ->getEventFlagWord() == nullptr) {
+    LOG(INFO) << __func__ << ": no event flag, polling for audio data";
+    return;
+  }
+  if (EventFlag::createEventFlag(mDataMQ->getEventFlagWord(), &mEventFlag) !=
+      ::android::OK) {
+    LOG(WARNING) << __func__ << ": failed, polling for audio data";
+    mEventFlag = nullptr;
+  }
+}
+
+void BluetoothAudioClientInterface::DeleteEventFlag() {
+  if (mEventFlag != nullptr) {
+    EventFlag::deleteEventFlag(&mEventFlag);
+    mEventFlag = nullptr;
+  }
+}
+
+// Blocks on the event flag when audio HAL configured one for the fmq, so the
+// wait ends as soon as it writes. The wait is still cut into poll intervals:
+// audio HAL not waking the event flag costs no more than polling did.
+size_t BluetoothAudioClientInterface::WaitForAudioData(
+    size_t len, std::chrono::steady_clock::time_point deadline) {
+  size_t avail_to_read = 0;
+  while (mDataMQ != nullptr && mDataMQ->isValid()) {
+    avail_to_read = mDataMQ->availableToRead();
+    if (avail_to_read >= len) break;
+
+    auto now = std::chrono::steady_clock::now();
+    if (now >= deadline) break;
+    std::chrono::nanoseconds wait_ns =
+        std::min<std::chrono::nanoseconds>(
+            deadline - now,
+            std::chrono::milliseconds(kDefaultDataReadPollIntervalMs));
+    if (mEventFlag != nullptr) {
+      uint32_t ef_state = 0;
+      mEventFlag->wait(kDataMQNotEmpty, &ef_state, wait_ns.count(),
+                       true /* retry */);
+    } else {
+      std::this_thread::sleep_for(wait_ns);
+    }
+  }
+  return avail_to_read;
+}
+
 size_t BluetoothAudioClientInterface::ReadAudioData(uint8_t* p_buf,
                                                     uint32_t len) {
   if (provider_ == nullptr) {
@@ -431,48 +491,91 @@ size_t BluetoothAudioClientInterface::ReadAudioData(uint8_t* p_buf,
   }
   if (p_buf == nullptr || len == 0) return 0;
 
+  auto start = std::chrono::steady_clock::now();
+  auto deadline = start + std::chrono::milliseconds(kDefaultDataReadTimeoutMs);
   size_t total_read = 0;
-  int timeout_ms = kDefaultDataReadTimeoutMs;
-  do {
-    if (mDataMQ == nullptr || !mDataMQ->isValid()) break;
-
-    size_t avail_to_read = mDataMQ->availableToRead();
-    if (avail_to_read) {
-      if (avail_to_read > len - total_read) {
-        avail_to_read = len - total_read;
-      }
-      if (mDataMQ->read(p_buf + total_read, avail_to_read) == 0) {
-        LOG(WARNING) << __func__ << ": len=" << len
-                     << " total_read=" << total_read << " failed";
-        break;
-      }
-      total_read += avail_to_read;
-    } else if (timeout_ms >= kDefaultDataReadPollIntervalMs) {
-      std::this_thread::sleep_for(
-          std::chrono::milliseconds(kDefaultDataReadPollIntervalMs));
-      timeout_ms -= kDefaultDataReadPollIntervalMs;
-      continue;
-    } else {
+  while (total_read < len) {
+    size_t avail_to_read = WaitForAudioData(1, deadline);
+    if (avail_to_read == 0) {
       LOG(WARNING) << __func__ << ": " << (len - total_read) << "/" << len
-                   << " no data " << (kDefaultDataReadTimeoutMs - timeout_ms)
-                   << " ms";
+                   << " no data " << kDefaultDataReadTimeoutMs << " ms";
+      break;
+    }
+    if (avail_to_read > len - total_read) {
+      avail_to_read = len - total_read;
+    }
+    if (!mDataMQ->read(p_buf + total_read, avail_to_read)) {
+      LOG(WARNING) << __func__ << ": len=" << len
+                   << " total_read=" << total_read << " failed";
       break;
     }
-  } while (total_read < len);
+    total_read += avail_to_read;
+    if (mEventFlag != nullptr) mEventFlag->wake(kDataMQNotFull);
+  }
 
-  if (timeout_ms <
-          (kDefaultDataReadTimeoutMs - kDefaultDataReadPollIntervalMs) &&
-      timeout_ms >= kDefaultDataReadPollIntervalMs) {
+  if (total_read < len) {
     VLOG(1) << __func__ << ": underflow " << len << " -> " << total_read
-            << " read " << (kDefaultDataReadTimeoutMs - timeout_ms) << " ms";
+            << " read";
   } else {
-    VLOG(2) << __func__ << ": " << len << " -> " << total_read << " read";
+    VLOG(2) << __func__ << ": " << len << " -> " << total_read << " read in "
+            << std::chrono::duration_cast<std::chrono::microseconds>(
+                   std::chrono::steady_clock::now() - start)
+                   .count()
+            << " us";
   }
 
   sink_->LogBytesRead(total_read);
   return total_read;
 }
 
+size_t BluetoothAudioClientInterface::BeginReadAudioData(
+    uint32_t len, AudioDataRegions* regions) {
+  *regions = {};
+  if (provider_ == nullptr) {
+    LOG(ERROR) << __func__ << ": BluetoothAudioHal nullptr";
+    return 0;
+  }
+  if (len == 0 || mDataMQ == nullptr || !mDataMQ->isValid()) return 0;
+
+  // Wait for no more than the fmq holds, audio HAL can't write more
+  size_t wait_len = std::min<size_t>(len, mDataMQ->getQuantumCount());
+  size_t avail_to_read = WaitForAudioData(
+      wait_len, std::chrono::steady_clock::now() +
+                    std::chrono::milliseconds(kDefaultDataReadTimeoutMs));
+  if (avail_to_read > len) avail_to_read = len;
+  if (avail_to_read == 0) {
+    LOG(WARNING) << __func__ << ": " << len << " no data "
+                 << kDefaultDataReadTimeoutMs << " ms";
+    return 0;
+  }
+
+  DataMQ::MemTransaction tx;
+  if (!mDataMQ->beginRead(avail_to_read, &tx)) {
+    LOG(WARNING) << __func__ << ": len=" << len
+                 << " avail_to_read=" << avail_to_read << " failed";
+    return 0;
+  }
+  regions->first = tx.getFirstRegion().getAddress();
+  regions->first_len = tx.getFirstRegion().getLength();
+  regions->second = tx.getSecondRegion().getAddress();
+  regions->second_len = tx.getSecondRegion().getLength();
+  if (avail_to_read < len) {
+    VLOG(1) << __func__ << ": underflow " << len << " -> " << avail_to_read;
+  }
+  return avail_to_read;
+}
+
+bool BluetoothAudioClientInterface::CommitReadAudioData(size_t len) {
+  if (mDataMQ == nullptr || !mDataMQ->isValid()) return false;
+  if (!mDataMQ->commitRead(len)) {
+    LOG(WARNING) << __func__ << ": len=" << len << " failed";
+    return false;
+  }
+  if (mEventFlag != nullptr) mEventFlag->wake(kDataMQNotFull);
+  sink_->LogBytesRead(len);
+  return true;
+}
+
 size_t BluetoothAudioClientInterface::WriteAudioData(uint8_t* p_buf,
                                                      uint32_t len) {
   // Not implemented!
@@ -17,10 +17,12 @@
 #pragma once
 
 #include <time.h>
+#include <chrono>
 #include <mutex>
 
 #include <vendor/qti/hardware/bluetooth_audio/2.0/IBluetoothAudioProvider.h>
 #include <vendor/qti/hardware/bluetooth_audio/2.0/types.h>
+#include <fmq/EventFlag.h>
 #include <fmq/MessageQueue.h>
 #include <hardware/audio.h>
 #include "osi/include/thread.h"
@@ -125,6 +127,15 @@ class IBluetoothTransportInstance {
   AudioConfiguration audio_config_;
 };
 
+// Audio data queued by the audio HAL in the FMQ, exposed in place: the second
+// region is only non-empty when the data wraps around the end of the FMQ.
+struct AudioDataRegions {
+  const uint8_t* first;
+  size_t first_len;
+  const uint8_t* second;
+  size_t second_len;
+};
+
 // common object is shared between different kind of SessionType
 class BluetoothAudioDeathRecipient;
 
@@ -140,7 +151,7 @@ class BluetoothAudioClientInterface {
       IBluetoothTransportInstance* sink,
        thread_t* message_loop, std::mutex* mutex);
 
-  ~BluetoothAudioClientInterface() = default;
+  virtual ~BluetoothAudioClientInterface();
 
   std::vector<AudioCapabilities> GetAudioCapabilities() const;
 
@@ -165,6 +176,15 @@ class BluetoothAudioClientInterface {
   // Read data from audio  HAL through fmq
   size_t ReadAudioData(uint8_t* p_buf, uint32_t len);
 
+  // Expose up to |len| bytes of data from audio HAL in place, without copying
+  // them out of the fmq, waiting for them as ReadAudioData does. Returns the
+  // bytes exposed, which stay queued until CommitReadAudioData. Both must be
+  // called under the same lock as EndSession, which unmaps the regions.
+  size_t BeginReadAudioData(uint32_t len, AudioDataRegions* regions);
+
+  // Consume |len| bytes exposed by BeginReadAudioData
+  bool CommitReadAudioData(size_t len);
+
   // Write data to audio HAL through fmq
   size_t WriteAudioData(uint8_t* p_buf, uint32_t len);
 
@@ -176,18 +196,29 @@ class BluetoothAudioClientInterface {
       .bitsPerSample = BitsPerSample::BITS_UNKNOWN,
       .channelMode = ChannelMode::UNKNOWN};
 
- private:
+ protected:
   // Helper function to connect to an IBluetoothAudioProvider
-  void fetch_audio_provider();
+  virtual void fetch_audio_provider();
 
-  IBluetoothTransportInstance* sink_;
   android::sp<IBluetoothAudioProvider> provider_;
+
+ private:
+  // Wait until |len| bytes are queued in the fmq or |deadline| passes
+  size_t WaitForAudioData(size_t len,
+                          std::chrono::steady_clock::time_point deadline);
+
+  // Map the event flag of the fmq, if audio HAL configured one
+  void CreateEventFlag();
+  void DeleteEventFlag();
+
+  IBluetoothTransportInstance* sink_;
   android::sp<IBluetoothAudioPort> stack_if_;
   std::vector<AudioCapabilities> capabilities_;
   bool session_started_;
   std::unique_ptr<::android::hardware::MessageQueue<
       uint8_t, ::android::hardware::kSynchronizedReadWrite>>
       mDataMQ;
+  ::android::hardware::EventFlag* mEventFlag;
   mutable std::mutex *external_mutex_;
   android::sp<BluetoothAudioDeathRecipient> death_recipient_;
 };
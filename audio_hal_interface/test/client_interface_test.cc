@@ -0,0 +1,322 @@
+/*
+ * Copyright 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "audio_hal_interface/client_interface.h"
+
+namespace {
+
+using ::android::sp;
+using ::android::hardware::EventFlag;
+using ::android::hardware::Return;
+using ::android::hardware::Void;
+using ::bluetooth::audio::AudioConfiguration;
+using ::bluetooth::audio::AudioDataRegions;
+using ::bluetooth::audio::BluetoothAudioClientInterface;
+using ::bluetooth::audio::BluetoothAudioCtrlAck;
+using ::bluetooth::audio::BluetoothAudioStatus;
+using ::bluetooth::audio::IBluetoothAudioPort;
+using ::bluetooth::audio::IBluetoothAudioProvider;
+using ::bluetooth::audio::IBluetoothTransportInstance;
+using ::bluetooth::audio::SessionParams;
+using ::bluetooth::audio::SessionType;
+using DataMQ = ::android::hardware::MessageQueue<
+    uint8_t, ::android::hardware::kSynchronizedReadWrite>;
+using Clock = std::chrono::steady_clock;
+
+// 4 ms ticks of 48 kHz 16 bit stereo PCM, and an FMQ holding 8 of them
+constexpr auto kTick = std::chrono::milliseconds(4);
+constexpr size_t kTickBytes = 48 * 4 * 4;
+constexpr size_t kQueueSize = 8 * kTickBytes;
+constexpr int kNumTicks = 500;
+
+// The read timeout of the client interface, and how far past it a read is
+// allowed to return on a loaded device
+constexpr auto kReadTimeout = std::chrono::milliseconds(3);
+constexpr auto kReadSlack = std::chrono::milliseconds(10);
+
+constexpr uint32_t kDataMQNotEmpty = 1 << 0;
+
+// The audio data stream, a pattern not lining up with the FMQ size so that
+// data read out of order or twice is caught
+uint8_t Pattern(size_t offset) { return offset % 251; }
+
+// The audio HAL end of the data FMQ
+class TestProvider : public IBluetoothAudioProvider {
+ public:
+  explicit TestProvider(bool event_flag)
+      : data_mq_(new DataMQ(kQueueSize, event_flag)), event_flag_(nullptr) {
+    if (event_flag) {
+      EventFlag::createEventFlag(data_mq_->getEventFlagWord(), &event_flag_);
+    }
+  }
+
+  ~TestProvider() {
+    if (event_flag_ != nullptr) EventFlag::deleteEventFlag(&event_flag_);
+  }
+
+  Return<void> startSession(const sp<IBluetoothAudioPort>& hostIf,
+                            const AudioConfiguration& audioConfig,
+                            startSession_cb _hidl_cb) override {
+    _hidl_cb(BluetoothAudioStatus::SUCCESS, *data_mq_->getDesc());
+    return Void();
+  }
+
+  Return<void> streamStarted(BluetoothAudioStatus status) override {
+    return Void();
+  }
+
+  Return<void> streamSuspended(BluetoothAudioStatus status) override {
+    return Void();
+  }
+
+  Return<void> endSession() override { return Void(); }
+
+  Return<void> updateSessionParams(
+      const SessionParams& sessionParams) override {
+    return Void();
+  }
+
+  // Write the next |len| bytes of the stream, as audio HAL does
+  bool Write(size_t len) {
+    std::vector<uint8_t> buf(len);
+    for (size_t i = 0; i < len; i++) buf[i] = Pattern(written_ + i);
+    if (!data_mq_->write(buf.data(), len)) return false;
+    written_ += len;
+    if (event_flag_ != nullptr) event_flag_->wake(kDataMQNotEmpty);
+    return true;
+  }
+
+  size_t Queued() { return data_mq_->availableToRead(); }
+
+  size_t Written() { return written_; }
+
+ private:
+  std::unique_ptr<DataMQ> data_mq_;
+  EventFlag* event_flag_;
+  size_t written_ = 0;
+};
+
+class TestTransport : public IBluetoothTransportInstance {
+ public:
+  TestTransport()
+      : IBluetoothTransportInstance(
+            SessionType::A2DP_SOFTWARE_ENCODING_DATAPATH,
+            AudioConfiguration()) {}
+
+  BluetoothAudioCtrlAck StartRequest() override {
+    return BluetoothAudioCtrlAck::SUCCESS_FINISHED;
+  }
+
+  BluetoothAudioCtrlAck SuspendRequest() override {
+    return BluetoothAudioCtrlAck::SUCCESS_FINISHED;
+  }
+
+  void StopRequest() override {}
+
+  bool GetPresentationPosition(uint64_t* remote_delay_report_ns,
+                               uint64_t* total_bytes_readed,
+                               timespec* data_position) override {
+    return false;
+  }
+
+  void ResetPresentationPosition() override { bytes_read_ = 0; }
+
+  void LogBytesRead(size_t bytes_readed) override {
+    bytes_read_ += bytes_readed;
+  }
+
+  size_t bytes_read_ = 0;
+};
+
+// The client interface, connected to the test provider
+class TestClientInterface : public BluetoothAudioClientInterface {
+ public:
+  TestClientInterface(IBluetoothTransportInstance* sink, std::mutex* mutex,
+                      const sp<IBluetoothAudioProvider>& provider)
+      : BluetoothAudioClientInterface(sink, nullptr, mutex),
+        test_provider_(provider) {}
+
+ protected:
+  void fetch_audio_provider() override { provider_ = test_provider_; }
+
+ private:
+  sp<IBluetoothAudioProvider> test_provider_;
+};
+
+class ClientInterfaceTest : public ::testing::Test {
+ protected:
+  void StartSession(bool event_flag) {
+    provider_ = new TestProvider(event_flag);
+    client_if_.reset(new TestClientInterface(&transport_, &mutex_, provider_));
+    ASSERT_EQ(0, client_if_->StartSession());
+  }
+
+  void TearDown() override {
+    if (client_if_ != nullptr) client_if_->EndSession();
+  }
+
+  // Check |len| bytes read are the stream from |offset| on
+  void CheckRead(const uint8_t* p_buf, size_t len, size_t offset) {
+    for (size_t i = 0; i < len; i++) {
+      ASSERT_EQ(Pattern(offset + i), p_buf[i]) << "at " << offset + i;
+    }
+  }
+
+  // Audio HAL writing each tick late by up to 2 ms, in two halves, while
+  // the media thread reads a tick on time: no data is lost, duplicated or
+  // reordered, and no read blocks past its timeout.
+  void RunJitterStress(bool event_flag) {
+    StartSession(event_flag);
+    Clock::time_point start = Clock::now() + kTick;
+
+    std::thread writer([this, start]() {
+      std::mt19937 rng(1);
+      std::uniform_int_distribution<int> jitter_us(0, 2000);
+      for (int tick = 0; tick < kNumTicks; tick++) {
+        std::this_thread::sleep_until(
+            start + tick * kTick + std::chrono::microseconds(jitter_us(rng)));
+        provider_->Write(kTickBytes / 2);
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+        provider_->Write(kTickBytes / 2);
+      }
+    });
+
+    uint8_t buf[kTickBytes];
+    size_t total_read = 0;
+    int underflows = 0;
+    Clock::duration max_read_time = Clock::duration::zero();
+    for (int tick = 0; tick < kNumTicks; tick++) {
+      std::this_thread::sleep_until(start + tick * kTick);
+      Clock::time_point read_start = Clock::now();
+      size_t bytes_read = client_if_->ReadAudioData(buf, sizeof(buf));
+      max_read_time = std::max(max_read_time, Clock::now() - read_start);
+      CheckRead(buf, bytes_read, total_read);
+      total_read += bytes_read;
+      if (bytes_read < sizeof(buf)) underflows++;
+    }
+    writer.join();
+
+    EXPECT_EQ(provider_->Written(), total_read + provider_->Queued());
+    EXPECT_EQ(total_read, transport_.bytes_read_);
+    EXPECT_LT(max_read_time, kReadTimeout + kReadSlack);
+    RecordProperty("underflows", underflows);
+    RecordProperty("max_read_us",
+                   static_cast<int>(
+                       std::chrono::duration_cast<std::chrono::microseconds>(
+                           max_read_time)
+                           .count()));
+  }
+
+  TestTransport transport_;
+  std::mutex mutex_;
+  sp<TestProvider> provider_;
+  std::unique_ptr<TestClientInterface> client_if_;
+};
+
+}  // namespace
+
+TEST_F(ClientInterfaceTest, test_read) {
+  StartSession(true);
+  uint8_t buf[kTickBytes];
+
+  ASSERT_TRUE(provider_->Write(kTickBytes));
+  EXPECT_EQ(kTickBytes, client_if_->ReadAudioData(buf, sizeof(buf)));
+  CheckRead(buf, kTickBytes, 0);
+  EXPECT_EQ(0u, provider_->Queued());
+  EXPECT_EQ(kTickBytes, transport_.bytes_read_);
+}
+
+// Data landing while the media thread waits for it is read by the same tick
+TEST_F(ClientInterfaceTest, test_read_wakes_on_write) {
+  StartSession(true);
+  uint8_t buf[kTickBytes];
+
+  std::thread writer([this]() {
+    std::this_thread::sleep_for(std::chrono::microseconds(500));
+    provider_->Write(kTickBytes);
+  });
+  EXPECT_EQ(kTickBytes, client_if_->ReadAudioData(buf, sizeof(buf)));
+  writer.join();
+  CheckRead(buf, kTickBytes, 0);
+}
+
+TEST_F(ClientInterfaceTest, test_underflow_bounded_by_timeout) {
+  StartSession(true);
+  uint8_t buf[kTickBytes];
+
+  ASSERT_TRUE(provider_->Write(kTickBytes / 4));
+  Clock::time_point start = Clock::now();
+  EXPECT_EQ(kTickBytes / 4, client_if_->ReadAudioData(buf, sizeof(buf)));
+  Clock::duration read_time = Clock::now() - start;
+  EXPECT_GE(read_time, kReadTimeout);
+  EXPECT_LT(read_time, kReadTimeout + kReadSlack);
+  CheckRead(buf, kTickBytes / 4, 0);
+}
+
+TEST_F(ClientInterfaceTest, test_jitter_stress) { RunJitterStress(true); }
+
+// Audio HAL not configuring an event flag: the data is polled for
+TEST_F(ClientInterfaceTest, test_jitter_stress_no_event_flag) {
+  RunJitterStress(false);
+}
+
+// Data wrapping around the end of the FMQ is exposed as two regions, and
+// stays queued until committed
+TEST_F(ClientInterfaceTest, test_zero_copy_read) {
+  StartSession(true);
+  uint8_t buf[kTickBytes];
+  for (size_t i = 0; i < kQueueSize / kTickBytes - 1; i++) {
+    ASSERT_TRUE(provider_->Write(kTickBytes));
+    ASSERT_EQ(kTickBytes, client_if_->ReadAudioData(buf, sizeof(buf)));
+  }
+  ASSERT_TRUE(provider_->Write(2 * kTickBytes));
+
+  AudioDataRegions regions;
+  ASSERT_EQ(2 * kTickBytes,
+            client_if_->BeginReadAudioData(2 * kTickBytes, &regions));
+  EXPECT_EQ(kTickBytes, regions.first_len);
+  EXPECT_EQ(kTickBytes, regions.second_len);
+  size_t offset = kQueueSize - kTickBytes;
+  CheckRead(regions.first, regions.first_len, offset);
+  CheckRead(regions.second, regions.second_len, offset + regions.first_len);
+  EXPECT_EQ(2 * kTickBytes, provider_->Queued());
+
+  EXPECT_TRUE(client_if_->CommitReadAudioData(2 * kTickBytes));
+  EXPECT_EQ(0u, provider_->Queued());
+  EXPECT_EQ(kQueueSize + kTickBytes, transport_.bytes_read_);
+}
+
+TEST_F(ClientInterfaceTest, test_zero_copy_read_underflow) {
+  StartSession(true);
+  AudioDataRegions regions;
+
+  EXPECT_EQ(0u, client_if_->BeginReadAudioData(kTickBytes, &regions));
+  EXPECT_EQ(0u, regions.first_len + regions.second_len);
+
+  ASSERT_TRUE(provider_->Write(kTickBytes / 2));
+  EXPECT_EQ(kTickBytes / 2,
+            client_if_->BeginReadAudioData(kTickBytes, &regions));
+  EXPECT_EQ(kTickBytes / 2, regions.first_len);
+  EXPECT_TRUE(client_if_->CommitReadAudioData(kTickBytes / 2));
+}
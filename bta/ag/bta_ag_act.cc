@@ -478,6 +478,8 @@ void bta_ag_rfc_close(tBTA_AG_SCB* p_scb, UNUSED_ATTR tBTA_AG_DATA* p_data) {
   /* Clear these flags upon SLC teardown */
   p_scb->codec_updated = false;
   p_scb->codec_fallback = false;
+  p_scb->agreed_codec = BTA_AG_CODEC_NONE;
+  bta_ag_sco_setup_reset(&p_scb->sco_setup);
   p_scb->codec_msbc_settings = BTA_AG_SCO_MSBC_SETTINGS_T2;
 #if (SWB_ENABLED == TRUE)
   p_scb->codec_swb_settings = BTA_AG_SCO_SWB_SETTINGS_Q0;
@@ -496,6 +498,14 @@ void bta_ag_rfc_close(tBTA_AG_SCB* p_scb, UNUSED_ATTR tBTA_AG_DATA* p_data) {
   alarm_cancel(p_scb->ring_timer);
   alarm_cancel(p_scb->codec_negotiation_timer);
   alarm_cancel(p_scb->xsco_conn_collision_timer);
+  alarm_cancel(p_scb->ind_coalesce_timer);
+
+  /* drop the results the channel closed before */
+  APPL_TRACE_IMP("%s: %u result codes sent in %u RFCOMM writes, %d dropped",
+                 __func__, p_scb->res_count, p_scb->res_write_count,
+                 p_scb->res_batch.num_results);
+  p_scb->res_batch.len = 0;
+  p_scb->res_batch.num_results = 0;
   p_scb->no_of_xsco_trials = 0;
   p_scb->no_of_xsco_retry = 0;
 
@@ -583,6 +593,10 @@ void bta_ag_rfc_open(tBTA_AG_SCB* p_scb, tBTA_AG_DATA* p_data) {
   p_scb->cmee_enabled = false;
   p_scb->inband_enabled =
       ((p_scb->features & BTA_AG_FEAT_INBAND) == BTA_AG_FEAT_INBAND);
+  p_scb->res_batch.len = 0;
+  p_scb->res_batch.num_results = 0;
+  p_scb->res_count = 0;
+  p_scb->res_write_count = 0;
   APPL_TRACE_DEBUG("%s: p_scb->inband_enabled: %d p_scb->conn_service: %d", __func__,
                         p_scb->inband_enabled, p_scb->conn_service);
   VLOG(1) << __func__ << " p_scb addr:" << p_scb->peer_addr;
@@ -1045,6 +1059,8 @@ void bta_ag_ci_rx_data(tBTA_AG_SCB* p_scb, tBTA_AG_DATA* p_data) {
   APPL_TRACE_DEBUG("bta_ag_ci_rx_data:");
   /* send to RFCOMM */
   bta_sys_busy(BTA_ID_AG, p_scb->app_id, p_scb->peer_addr);
+  /* after the indicators held back */
+  bta_ag_flush_results(p_scb);
   PORT_WriteData(p_scb->conn_handle, p_data_area, strlen(p_data_area), &len);
   if ((p_scb->sco_idx != BTM_INVALID_SCO_INDEX) && bta_ag_sco_is_open(p_scb)) {
     APPL_TRACE_IMP("bta_ag_rfc_data, change link policy for SCO");
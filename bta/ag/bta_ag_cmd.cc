@@ -60,6 +60,7 @@
 #include "bta_ag_api.h"
 #include "bta_ag_at.h"
 #include "bta_ag_int.h"
+#include "bta_ag_res.h"
 #include "bta_api.h"
 #include "bta_sys.h"
 #include "log/log.h"
@@ -175,13 +176,6 @@ typedef struct {
   uint8_t arg_type;          /* whether argument is int or string */
 } tBTA_AG_RESULT;
 
-/* AT result code argument types */
-enum {
-  BTA_AG_RES_FMT_NONE, /* no argument */
-  BTA_AG_RES_FMT_INT,  /* integer argument */
-  BTA_AG_RES_FMT_STR   /* string argument */
-};
-
 /* Local AT command result codes not defined in bta_ag_api.h */
 enum {
   BTA_AG_LOCAL_RES_FIRST = 0x0100,
@@ -229,10 +223,25 @@ const tBTA_AG_RESULT bta_ag_result_tbl[] = {
 #endif
     {"", BTA_AG_UNAT_RES, BTA_AG_RES_FMT_STR}};
 
-static const tBTA_AG_RESULT* bta_ag_result_by_code(size_t code) {
-  for (size_t i = 0;
-       i != sizeof(bta_ag_result_tbl) / sizeof(bta_ag_result_tbl[0]); ++i) {
-    if (code == bta_ag_result_tbl[i].result_id) return &bta_ag_result_tbl[i];
+#define BTA_AG_NUM_RESULTS \
+  (sizeof(bta_ag_result_tbl) / sizeof(bta_ag_result_tbl[0]))
+
+/* Templates precompiled from bta_ag_result_tbl, built on first use */
+static tBTA_AG_RES_TMPL bta_ag_res_tmpl_tbl[BTA_AG_NUM_RESULTS];
+static bool bta_ag_res_tmpl_tbl_built = false;
+
+static const tBTA_AG_RES_TMPL* bta_ag_res_tmpl_by_code(size_t code) {
+  if (!bta_ag_res_tmpl_tbl_built) {
+    for (size_t i = 0; i != BTA_AG_NUM_RESULTS; ++i) {
+      bta_ag_res_tmpl_init(&bta_ag_res_tmpl_tbl[i],
+                           bta_ag_result_tbl[i].result_string,
+                           bta_ag_result_tbl[i].arg_type);
+    }
+    bta_ag_res_tmpl_tbl_built = true;
+  }
+
+  for (size_t i = 0; i != BTA_AG_NUM_RESULTS; ++i) {
+    if (code == bta_ag_result_tbl[i].result_id) return &bta_ag_res_tmpl_tbl[i];
   }
   return 0;
 }
@@ -263,11 +272,57 @@ static size_t bta_ag_indicator_by_result_code(size_t code) {
   return BTA_AG_CALLSETUP_NONE;
 }
 
+/*******************************************************************************
+ *
+ * Function         bta_ag_flush_results
+ *
+ * Description      Write the result codes not yet written to the peer, in a
+ *                  single RFCOMM write.
+ *
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+void bta_ag_flush_results(tBTA_AG_SCB* p_scb) {
+  tBTA_AG_RES_BATCH* p_batch = &p_scb->res_batch;
+
+  alarm_cancel(p_scb->ind_coalesce_timer);
+  if (p_batch->len == 0) return;
+
+  /* send to RFCOMM */
+  uint16_t len = 0;
+  PORT_WriteData(p_scb->conn_handle, p_batch->data, p_batch->len, &len);
+  p_scb->res_write_count++;
+
+  p_batch->len = 0;
+  p_batch->num_results = 0;
+}
+
+/*******************************************************************************
+ *
+ * Function         bta_ag_ind_coalesce_timer_cback
+ *
+ * Description      Write the indicators held back to the peer.
+ *
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+static void bta_ag_ind_coalesce_timer_cback(void* data) {
+  tBTA_AG_SCB* p_scb = (tBTA_AG_SCB*)data;
+
+  if (p_scb->res_batch.num_results > 1)
+    APPL_TRACE_DEBUG("%s: %d results in one write", __func__,
+                     p_scb->res_batch.num_results);
+  bta_ag_flush_results(p_scb);
+}
+
 /*******************************************************************************
  *
  * Function         bta_ag_send_result
  *
- * Description      Send an AT result code.
+ * Description      Send an AT result code. It is written to the peer at
+ *                  once, with any indicators held back ahead of it.
  *
  *
  * Returns          void
@@ -275,57 +330,97 @@ static size_t bta_ag_indicator_by_result_code(size_t code) {
  ******************************************************************************/
 void bta_ag_send_result(tBTA_AG_SCB* p_scb, size_t code,
                                const char* p_arg, int16_t int_arg) {
-  const tBTA_AG_RESULT* result = bta_ag_result_by_code(code);
-  if (result == 0) {
+  const tBTA_AG_RES_TMPL* p_tmpl = bta_ag_res_tmpl_by_code(code);
+  if (p_tmpl == 0) {
     LOG_ERROR(LOG_TAG, "%s Unable to lookup result for code %zu", __func__,
               code);
     return;
   }
 
-  char buf[BTA_AG_AT_MAX_LEN + 16];
-  char* p = buf;
-  memset(buf, 0, sizeof(buf));
-
-  /* init with \r\n */
-  *p++ = '\r';
-  *p++ = '\n';
+  if (p_tmpl->arg_type == BTA_AG_RES_FMT_STR && p_arg == NULL)
+    APPL_TRACE_WARNING("%s: p_arg is NULL", __func__);
+
+  tBTA_AG_RES_BATCH* p_batch = &p_scb->res_batch;
+  char* p = &p_batch->data[p_batch->len];
+  uint16_t len = bta_ag_res_build(p, BTA_AG_RES_BATCH_SIZE - p_batch->len,
+                                  p_tmpl, p_arg, int_arg);
+  if (len == 0 && p_batch->len != 0) {
+    /* no room left after the indicators held back */
+    bta_ag_flush_results(p_scb);
+    p = p_batch->data;
+    len = bta_ag_res_build(p, BTA_AG_RES_BATCH_SIZE, p_tmpl, p_arg, int_arg);
+  }
 
-  /* copy result code string */
-  strlcpy(p, result->result_string, sizeof(buf) - 2);
+  /* a result longer than a batch, e.g. a long +CLCC, is written by itself */
+  char buf[BTA_AG_RES_TMPL_MAX_LEN + BTA_AG_AT_MAX_LEN + 4];
+  if (len == 0) {
+    p = buf;
+    len = bta_ag_res_build(p, sizeof(buf), p_tmpl, p_arg, int_arg);
+    if (len == 0) {
+      APPL_TRACE_ERROR("%s: result code %zu too long", __func__, code);
+      return;
+    }
+  }
 
   if (p_scb->conn_service == BTA_AG_HSP) {
     /* If HSP then ":"symbol should be changed as "=" for HSP compatibility */
     switch (code) {
       case BTA_AG_SPK_RES:
       case BTA_AG_MIC_RES:
-        if (*(p + COLON_IDX_4_VGSVGM) == ':') {
-          *(p + COLON_IDX_4_VGSVGM) = '=';
+        if (*(p + 2 + COLON_IDX_4_VGSVGM) == ':') {
+          *(p + 2 + COLON_IDX_4_VGSVGM) = '=';
         }
         break;
     }
   }
 
-  p += strlen(result->result_string);
+  p_scb->res_count++;
+  if (p == buf) {
+    /* send to RFCOMM */
+    uint16_t written = 0;
+    PORT_WriteData(p_scb->conn_handle, buf, len, &written);
+    p_scb->res_write_count++;
+    return;
+  }
 
-  /* copy argument if any */
-  if (result->arg_type == BTA_AG_RES_FMT_INT) {
-    p += utl_itoa((uint16_t)int_arg, p);
-  } else if (result->arg_type == BTA_AG_RES_FMT_STR) {
-    if (p_arg != NULL) {
-      strcpy(p, p_arg);
-      p += strlen(p_arg);
-    }
-    else
-      APPL_TRACE_WARNING("%s: p_arg is NULL", __func__);
+  p_batch->len += len;
+  p_batch->num_results++;
+  bta_ag_flush_results(p_scb);
+}
+
+/*******************************************************************************
+ *
+ * Function         bta_ag_send_ciev
+ *
+ * Description      Send a +CIEV result code. It is held back for
+ *                  BTA_AG_IND_COALESCE_MS, so that the indicators of a call
+ *                  state change reach the peer in a single RFCOMM write.
+ *
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+static void bta_ag_send_ciev(tBTA_AG_SCB* p_scb, uint16_t id,
+                             uint16_t value) {
+  tBTA_AG_RES_BATCH* p_batch = &p_scb->res_batch;
+  uint16_t len = bta_ag_res_build_ciev(&p_batch->data[p_batch->len],
+                                       BTA_AG_RES_BATCH_SIZE - p_batch->len,
+                                       id, value);
+  if (len == 0) {
+    bta_ag_flush_results(p_scb);
+    len = bta_ag_res_build_ciev(p_batch->data, BTA_AG_RES_BATCH_SIZE, id,
+                                value);
   }
 
-  /* finish with \r\n */
-  *p++ = '\r';
-  *p++ = '\n';
+  p_batch->len += len;
+  p_batch->num_results++;
+  p_scb->res_count++;
 
-  /* send to RFCOMM */
-  uint16_t len = 0;
-  PORT_WriteData(p_scb->conn_handle, buf, (uint16_t)(p - buf), &len);
+  /* held back from the first indicator, not extended by the next ones */
+  if (!alarm_is_scheduled(p_scb->ind_coalesce_timer)) {
+    alarm_set_on_mloop(p_scb->ind_coalesce_timer, BTA_AG_IND_COALESCE_MS,
+                       bta_ag_ind_coalesce_timer_cback, p_scb);
+  }
 }
 
 /*******************************************************************************
@@ -373,9 +468,6 @@ static void bta_ag_send_error(tBTA_AG_SCB* p_scb, int16_t errcode) {
  ******************************************************************************/
 static void bta_ag_send_ind(tBTA_AG_SCB* p_scb, uint16_t id, uint16_t value,
                             bool on_demand) {
-  char str[12];
-  char* p = str;
-
   /* If the indicator is masked out, just return */
   /* Mandatory indicators can not be masked out. */
   if ((p_scb->bia_masked_out & ((uint32_t)1 << id)) &&
@@ -425,12 +517,7 @@ static void bta_ag_send_ind(tBTA_AG_SCB* p_scb, uint16_t id, uint16_t value,
     p_scb->callheld_ind = (uint8_t)value;
   }
 
-  if (p_scb->cmer_enabled) {
-    p += utl_itoa(id, p);
-    *p++ = ',';
-    utl_itoa(value, p);
-    bta_ag_send_result(p_scb, BTA_AG_IND_RES, str, 0);
-  }
+  if (p_scb->cmer_enabled) bta_ag_send_ciev(p_scb, id, value);
 
   APPL_TRACE_IMP("%s: p_scb->call_ind %x, p_scb->callsetup_ind %x, p_scb->callheld_ind %x",
               __func__,  p_scb->call_ind, p_scb->callsetup_ind, p_scb->callheld_ind);
@@ -1433,6 +1520,8 @@ void bta_ag_at_hfp_cback(tBTA_AG_SCB* p_scb, uint16_t cmd, uint8_t arg_type,
           (p_scb->features & BTA_AG_FEAT_CODEC)) {
         p_scb->peer_codecs = bta_ag_parse_bac(p_scb, p_arg, p_end);
         p_scb->codec_updated = true;
+        /* The peer codecs changed, negotiate the codec again */
+        p_scb->agreed_codec = BTA_AG_CODEC_NONE;
 
 #if (SWB_ENABLED == TRUE)
         if (p_scb->is_swb_codec == false) {
@@ -1489,10 +1578,14 @@ void bta_ag_at_hfp_cback(tBTA_AG_SCB* p_scb, uint16_t cmd, uint8_t arg_type,
       else
         codec_sent = p_scb->sco_codec;
 
-      if (codec_type == codec_sent)
+      if (codec_type == codec_sent) {
+        /* Skip codec negotiation until the codec changes */
+        p_scb->agreed_codec = codec_sent;
         bta_ag_sco_codec_nego(p_scb, true);
-      else
+      } else {
+        p_scb->agreed_codec = BTA_AG_CODEC_NONE;
         bta_ag_sco_codec_nego(p_scb, false);
+      }
 
       /* send final codec info to callback */
       val.num = codec_sent;
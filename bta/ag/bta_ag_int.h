@@ -59,6 +59,8 @@
 
 #include "bta_ag_api.h"
 #include "bta_ag_at.h"
+#include "bta_ag_res.h"
+#include "bta_ag_sco_params.h"
 #include "bta_api.h"
 #include "bta_sys.h"
 
@@ -70,6 +72,11 @@
 #define BTA_AG_COLLISION_TIMEOUT_MS (2 * 1000) /* 2 seconds */
 #endif
 
+/* Time unsolicited indicators are held back, to go to the peer together */
+#ifndef BTA_AG_IND_COALESCE_MS
+#define BTA_AG_IND_COALESCE_MS 10
+#endif
+
 /* RFCOMM MTU SIZE */
 #define BTA_AG_MTU 256
 
@@ -329,12 +336,19 @@ struct tBTA_AG_SCB {
   alarm_t* ring_timer;
   alarm_t* codec_negotiation_timer;
   alarm_t* xsco_conn_collision_timer; /* try xSCO again if failed due to collision */
+  alarm_t* ind_coalesce_timer; /* write the indicators held back */
+  tBTA_AG_RES_BATCH res_batch; /* result codes not yet written */
+  uint32_t res_count;          /* result codes sent since RFCOMM opened */
+  uint32_t res_write_count;    /* RFCOMM writes they were sent in */
   tBTA_AG_PEER_CODEC peer_codecs; /* codecs for eSCO supported by the peer */
   tBTA_AG_PEER_CODEC sco_codec;   /* codec to be used for eSCO connection */
   tBTA_AG_PEER_CODEC
       inuse_codec;     /* codec being used for the current SCO connection */
   bool codec_updated;  /* set to true whenever the app updates codec type */
   bool codec_fallback; /* If sco nego fails for mSBC, fallback to CVSD */
+  tBTA_AG_PEER_CODEC agreed_codec; /* codec the peer confirmed with AT+BCS */
+  tBTA_AG_SCO_SETUP sco_setup;     /* call audio setup in progress */
+  uint8_t sco_setting;             /* eSCO parameter set last attempted */
 #if (TWS_AG_ENABLED == TRUE)
   bool rmt_sco_req;
 #endif
@@ -374,6 +388,8 @@ typedef struct {
   tBTA_AG_CBACK* p_cback;                  /* application callback */
   tBTA_AG_PARSE_MODE parse_mode;           /* parse/pass-through mode */
   uint8_t max_hf_clients;                 /* max hf clients can be connected */
+  tBTA_AG_SCO_PARAMS_CACHE sco_params_cache; /* eSCO sets peers accepted */
+  tBTA_AG_SCO_SETUP_STATS sco_setup_stats;   /* call audio setup latency */
 #if (TWS_AG_ENABLED == TRUE)
   tBTA_AG_SCO_CB twsp_sec_sco;      /*peer Sco detail*/
   tBTA_AG_SCB* main_sm_scb;         /*SCB attached with main sco sm for TWS+*/
@@ -499,6 +515,7 @@ extern bool bta_ag_create_sco(tBTA_AG_SCB* p_scb, bool is_orig);
 extern bool bta_ag_remove_sco(tBTA_AG_SCB* p_scb, bool only_active);
 extern void bta_ag_send_result(tBTA_AG_SCB* p_scb, size_t code,
                                const char* p_arg, int16_t int_arg);
+extern void bta_ag_flush_results(tBTA_AG_SCB* p_scb);
 extern void bta_ag_sco_event(tBTA_AG_SCB* p_scb, uint8_t event);
 extern const char* bta_ag_sco_evt_str(uint8_t event);
 extern const char* bta_ag_sco_state_str(uint8_t state);
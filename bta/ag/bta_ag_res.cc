@@ -0,0 +1,145 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  BTA AG AT result code builder.
+ *
+ ******************************************************************************/
+
+#include "bta_ag_res.h"
+
+#include <string.h>
+
+/* +CIEV result code, the indicator and its value patched in */
+static const char bta_ag_res_ciev[] = "\r\n+CIEV: 0,0\r\n";
+#define BTA_AG_RES_CIEV_LEN (sizeof(bta_ag_res_ciev) - 1)
+#define BTA_AG_RES_CIEV_ID_IDX 9
+#define BTA_AG_RES_CIEV_VALUE_IDX 11
+
+/* Writes the decimal digits of i at p, returns their number */
+static uint16_t bta_ag_res_itoa(uint16_t i, char* p) {
+  char digits[5];
+  uint16_t num = 0;
+
+  do {
+    digits[num++] = '0' + i % 10;
+    i /= 10;
+  } while (i != 0);
+
+  for (uint16_t j = 0; j < num; j++) p[j] = digits[num - 1 - j];
+  return num;
+}
+
+/*****************************************************************************
+ *
+ * Function         bta_ag_res_tmpl_init
+ *
+ * Description      Precompile the template of result string p_result, of
+ *                  argument type arg_type.
+ *
+ *
+ * Returns          void
+ *
+ ****************************************************************************/
+void bta_ag_res_tmpl_init(tBTA_AG_RES_TMPL* p_tmpl, const char* p_result,
+                          uint8_t arg_type) {
+  size_t len = strnlen(p_result, BTA_AG_RES_TMPL_MAX_LEN);
+
+  p_tmpl->str[0] = '\r';
+  p_tmpl->str[1] = '\n';
+  memcpy(&p_tmpl->str[2], p_result, len);
+  p_tmpl->len = (uint8_t)(len + 2);
+  p_tmpl->arg_type = arg_type;
+}
+
+/*****************************************************************************
+ *
+ * Function         bta_ag_res_build
+ *
+ * Description      Build the result code of template p_tmpl into the size
+ *                  octets at p_buf, with string argument p_arg or integer
+ *                  argument int_arg according to the template.
+ *
+ *
+ * Returns          Length of the result code, 0 if it does not fit.
+ *
+ ****************************************************************************/
+uint16_t bta_ag_res_build(char* p_buf, uint16_t size,
+                          const tBTA_AG_RES_TMPL* p_tmpl, const char* p_arg,
+                          int16_t int_arg) {
+  size_t arg_len = 0;
+
+  if (p_tmpl->arg_type == BTA_AG_RES_FMT_INT)
+    arg_len = 5; /* at most, for a uint16_t */
+  else if (p_tmpl->arg_type == BTA_AG_RES_FMT_STR && p_arg != NULL)
+    arg_len = strlen(p_arg);
+
+  if ((size_t)p_tmpl->len + arg_len + 2 > size) return 0;
+
+  char* p = p_buf;
+  memcpy(p, p_tmpl->str, p_tmpl->len);
+  p += p_tmpl->len;
+
+  if (p_tmpl->arg_type == BTA_AG_RES_FMT_INT) {
+    p += bta_ag_res_itoa((uint16_t)int_arg, p);
+  } else if (arg_len) {
+    memcpy(p, p_arg, arg_len);
+    p += arg_len;
+  }
+
+  *p++ = '\r';
+  *p++ = '\n';
+  return (uint16_t)(p - p_buf);
+}
+
+/*****************************************************************************
+ *
+ * Function         bta_ag_res_build_ciev
+ *
+ * Description      Build the +CIEV result code of indicator id, of value
+ *                  value, into the size octets at p_buf. Single digit
+ *                  indicators and values, all the ones HFP defines, are
+ *                  patched into a precompiled result.
+ *
+ *
+ * Returns          Length of the result code, 0 if it does not fit.
+ *
+ ****************************************************************************/
+uint16_t bta_ag_res_build_ciev(char* p_buf, uint16_t size, uint16_t id,
+                               uint16_t value) {
+  if (id < 10 && value < 10) {
+    if (size < BTA_AG_RES_CIEV_LEN) return 0;
+    memcpy(p_buf, bta_ag_res_ciev, BTA_AG_RES_CIEV_LEN);
+    p_buf[BTA_AG_RES_CIEV_ID_IDX] = '0' + id;
+    p_buf[BTA_AG_RES_CIEV_VALUE_IDX] = '0' + value;
+    return BTA_AG_RES_CIEV_LEN;
+  }
+
+  /* "+CIEV: " is 7 octets, the indicator and value at most 11 */
+  if (size < BTA_AG_RES_CIEV_LEN - 3 + 10) return 0;
+  char* p = p_buf;
+  memcpy(p, bta_ag_res_ciev, BTA_AG_RES_CIEV_ID_IDX);
+  p += BTA_AG_RES_CIEV_ID_IDX;
+  p += bta_ag_res_itoa(id, p);
+  *p++ = ',';
+  p += bta_ag_res_itoa(value, p);
+  *p++ = '\r';
+  *p++ = '\n';
+  return (uint16_t)(p - p_buf);
+}
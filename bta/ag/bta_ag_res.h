@@ -0,0 +1,118 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  Interface file for BTA AG AT result code builder. Each result code is
+ *  precompiled once into a template holding its framing, and a result is
+ *  built by copying the template and writing its argument after it. Results
+ *  are built into a batch, so that a burst of them goes to the peer in a
+ *  single RFCOMM write.
+ *
+ ******************************************************************************/
+#ifndef BTA_AG_RES_H
+#define BTA_AG_RES_H
+
+#include <stdint.h>
+
+/*****************************************************************************
+ *  Constants
+ ****************************************************************************/
+
+/* AT result code argument types */
+enum {
+  BTA_AG_RES_FMT_NONE, /* no argument */
+  BTA_AG_RES_FMT_INT,  /* integer argument */
+  BTA_AG_RES_FMT_STR   /* string argument */
+};
+
+/* Longest result string a template holds */
+#define BTA_AG_RES_TMPL_MAX_LEN 16
+
+/* Results coalesced into one write: one RFCOMM frame of BTA_AG_MTU */
+#define BTA_AG_RES_BATCH_SIZE 256
+
+/*****************************************************************************
+ *  Data types
+ ****************************************************************************/
+
+/* AT result code template: "\r\n" and the result string */
+typedef struct {
+  char str[BTA_AG_RES_TMPL_MAX_LEN + 2];
+  uint8_t len;
+  uint8_t arg_type;
+} tBTA_AG_RES_TMPL;
+
+/* AT result codes waiting to be written to the peer */
+typedef struct {
+  char data[BTA_AG_RES_BATCH_SIZE];
+  uint16_t len;
+  uint16_t num_results;
+} tBTA_AG_RES_BATCH;
+
+/*****************************************************************************
+ *  Function prototypes
+ ****************************************************************************/
+
+/*****************************************************************************
+ *
+ * Function         bta_ag_res_tmpl_init
+ *
+ * Description      Precompile the template of result string p_result, of
+ *                  argument type arg_type.
+ *
+ *
+ * Returns          void
+ *
+ ****************************************************************************/
+extern void bta_ag_res_tmpl_init(tBTA_AG_RES_TMPL* p_tmpl,
+                                 const char* p_result, uint8_t arg_type);
+
+/*****************************************************************************
+ *
+ * Function         bta_ag_res_build
+ *
+ * Description      Build the result code of template p_tmpl into the size
+ *                  octets at p_buf, with string argument p_arg or integer
+ *                  argument int_arg according to the template.
+ *
+ *
+ * Returns          Length of the result code, 0 if it does not fit.
+ *
+ ****************************************************************************/
+extern uint16_t bta_ag_res_build(char* p_buf, uint16_t size,
+                                 const tBTA_AG_RES_TMPL* p_tmpl,
+                                 const char* p_arg, int16_t int_arg);
+
+/*****************************************************************************
+ *
+ * Function         bta_ag_res_build_ciev
+ *
+ * Description      Build the +CIEV result code of indicator id, of value
+ *                  value, into the size octets at p_buf. Single digit
+ *                  indicators and values, all the ones HFP defines, are
+ *                  patched into a precompiled result.
+ *
+ *
+ * Returns          Length of the result code, 0 if it does not fit.
+ *
+ ****************************************************************************/
+extern uint16_t bta_ag_res_build_ciev(char* p_buf, uint16_t size, uint16_t id,
+                                      uint16_t value);
+
+#endif /* BTA_AG_RES_H */
@@ -64,10 +64,12 @@
 #if (BTM_SCO_HCI_INCLUDED == TRUE)
 #include "bta_dm_co.h"
 #endif
+#include "btif/include/btif_config.h"
 #include "btm_api.h"
 #include "device/include/controller.h"
 #include "device/include/esco_parameters.h"
 #include "osi/include/osi.h"
+#include "osi/include/time.h"
 #include "utl.h"
 #include "osi/include/properties.h"
 #include "device/include/interop.h"
@@ -569,6 +571,97 @@ static void bta_ag_esco_connreq_cback(tBTM_ESCO_EVT event,
   }
 }
 
+/*******************************************************************************
+ *
+ * Function         bta_ag_sco_apply_cached_params
+ *
+ * Description      At the start of a call audio setup, select the eSCO
+ *                  parameter set the peer last accepted if the preferred one
+ *                  for the codec falls back to it, rather than have the peer
+ *                  reject the preferred one again.
+ *
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+static void bta_ag_sco_apply_cached_params(tBTA_AG_SCB* p_scb) {
+  tBTA_AG_SCO_PARAMS_CACHE* p_cache = &bta_ag_cb.sco_params_cache;
+
+  if (p_scb->sco_setup.attempts != 0 || p_scb->codec_fallback) return;
+#if (SWB_ENABLED == TRUE)
+  if (p_scb->is_swb_codec) return;
+#endif
+#if (TWS_AG_ENABLED == TRUE)
+  /* No codec fallback for TWS+ devices */
+  if (is_twsp_device(p_scb->peer_addr)) return;
+#endif
+
+  uint8_t setting;
+  if (!bta_ag_sco_params_get(p_cache, p_scb->peer_addr, &setting)) {
+    int value;
+    if (!btif_config_get_int(p_scb->peer_addr.ToString().c_str(),
+                             HFP_ESCO_SETTING_CONFIG_KEY, &value))
+      return;
+    bta_ag_sco_params_put(p_cache, p_scb->peer_addr, (uint8_t)value);
+  }
+
+  uint8_t preferred = (p_scb->sco_codec == BTA_AG_CODEC_MSBC)
+                          ? ESCO_CODEC_MSBC_T2
+                          : ESCO_CODEC_CVSD;
+  uint8_t first = bta_ag_sco_params_first(p_cache, p_scb->peer_addr, preferred);
+  if (first == preferred) return;
+
+  APPL_TRACE_IMP("%s: device %s last accepted eSCO setting %d, not %d",
+                 __func__, p_scb->peer_addr.ToString().c_str(), first,
+                 preferred);
+  if (first == ESCO_CODEC_MSBC_T1)
+    p_scb->codec_msbc_settings = BTA_AG_SCO_MSBC_SETTINGS_T1;
+  else
+    p_scb->codec_fallback = true;
+}
+
+/*******************************************************************************
+ *
+ * Function         bta_ag_sco_setup_done
+ *
+ * Description      End the call audio setup of p_scb: on success, count its
+ *                  latency and cache the eSCO parameter set the peer
+ *                  accepted.
+ *
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+static void bta_ag_sco_setup_done(tBTA_AG_SCB* p_scb, bool success) {
+  tBTA_AG_SCO_SETUP_STATS* p_stats = &bta_ag_cb.sco_setup_stats;
+  tBTA_AG_SCO_SETUP setup = p_scb->sco_setup;
+  uint64_t now_ms = time_get_os_boottime_ms();
+
+  if (setup.start_ms == 0) return;
+
+  if (bta_ag_sco_setup_end(&p_scb->sco_setup, &bta_ag_cb.sco_params_cache,
+                           p_stats, p_scb->peer_addr, p_scb->sco_setting,
+                           success, now_ms)) {
+    btif_config_set_int(p_scb->peer_addr.ToString().c_str(),
+                        HFP_ESCO_SETTING_CONFIG_KEY, p_scb->sco_setting);
+    btif_config_save();
+  }
+
+  if (success && setup.attempts != 0) {
+    APPL_TRACE_IMP("%s: device %s eSCO setting %d after %d attempts, %u ms",
+                   __func__, p_scb->peer_addr.ToString().c_str(),
+                   p_scb->sco_setting, setup.attempts,
+                   (uint32_t)(now_ms - setup.start_ms));
+  }
+
+  APPL_TRACE_IMP(
+      "%s: setups %u failed %u, ms <100: %u <200: %u <400: %u <800: %u "
+      "<1600: %u more: %u, max %u",
+      __func__, p_stats->count, p_stats->fail_count, p_stats->bucket[0],
+      p_stats->bucket[1], p_stats->bucket[2], p_stats->bucket[3],
+      p_stats->bucket[4], p_stats->bucket[5], p_stats->max_ms);
+}
+
 /*******************************************************************************
  *
  * Function         bta_ag_cback_sco
@@ -613,6 +706,7 @@ bool bta_ag_create_sco(tBTA_AG_SCB* p_scb, bool is_orig) {
   if (!bta_ag_sco_is_active_device(p_scb->peer_addr)) {
     LOG(WARNING) << __func__ << ": device " << p_scb->peer_addr
                  << " is not active, active_device=" << active_device_addr;
+    bta_ag_sco_setup_reset(&p_scb->sco_setup);
     return false;
   }
 
@@ -620,6 +714,7 @@ bool bta_ag_create_sco(tBTA_AG_SCB* p_scb, bool is_orig) {
   if (p_scb->sco_idx != BTM_INVALID_SCO_INDEX) {
     APPL_TRACE_ERROR("%s: device %s, index 0x%04x already in use!", __func__,
                      p_scb->peer_addr.ToString().c_str(), p_scb->sco_idx);
+    bta_ag_sco_setup_reset(&p_scb->sco_setup);
     return false;
   }
 
@@ -690,6 +785,9 @@ bool bta_ag_create_sco(tBTA_AG_SCB* p_scb, bool is_orig) {
 #endif
   /* If initiating, setup parameters to start SCO/eSCO connection */
   if (is_orig) {
+    bta_ag_sco_setup_attempt(&p_scb->sco_setup, time_get_os_boottime_ms());
+    p_scb->sco_setting = codec_index;
+
      if (p_scb->no_of_xsco_retry == 1) {
       APPL_TRACE_DEBUG("%s: change retransmission effort to 0, retry %d",
            __func__ , p_scb->no_of_xsco_retry) ;
@@ -898,6 +996,7 @@ static void bta_ag_codec_negotiation_timer_cback(void* data) {
                                            &p_scb->peer_addr);
   /* Announce that codec negotiation failed. */
   bta_ag_sco_codec_nego(p_scb, false);
+  bta_ag_sco_setup_done(p_scb, false);
 #if (TWS_AG_ENABLED == TRUE)
   if (is_twsp_device(p_scb->peer_addr)) {
      APPL_TRACE_IMP("%s: tws device %s  codec negotiation fail.. skip blacklist",
@@ -930,6 +1029,26 @@ static void bta_ag_codec_negotiation_timer_cback(void* data) {
   bta_ag_cback_sco(p_scb, BTA_AG_AUDIO_CLOSE_EVT);
 }
 
+/*******************************************************************************
+ *
+ * Function         bta_ag_sco_codec_agreed
+ *
+ * Description      Whether the codec +BCS would select is the one the peer
+ *                  last confirmed, so that codec negotiation can be skipped.
+ *
+ *
+ * Returns          bool
+ *
+ ******************************************************************************/
+static bool bta_ag_sco_codec_agreed(tBTA_AG_SCB* p_scb) {
+#if (SWB_ENABLED == TRUE)
+  if (get_swb_codec_status() || p_scb->is_swb_codec) return false;
+#endif
+  return bta_ag_sco_params_codec_agreed(
+      (p_scb->peer_features & BTA_AG_PEER_FEAT_CODEC) != 0,
+      p_scb->codec_fallback, p_scb->sco_codec, p_scb->agreed_codec);
+}
+
 /*******************************************************************************
  *
  * Function         bta_ag_codec_negotiate
@@ -961,6 +1080,16 @@ void bta_ag_codec_negotiate(tBTA_AG_SCB* p_scb) {
   }
 #endif
 
+  bta_ag_sco_setup_start(&p_scb->sco_setup, time_get_os_boottime_ms());
+  bta_ag_sco_apply_cached_params(p_scb);
+
+  if (bta_ag_sco_codec_agreed(p_scb)) {
+    APPL_TRACE_DEBUG("%s: codec %d already agreed, skip codec negotiation",
+                     __func__, p_scb->agreed_codec);
+    bta_ag_sco_codec_nego(p_scb, true);
+    return;
+  }
+
   if (((p_scb->codec_updated || p_scb->codec_fallback) &&
       (p_scb->peer_features & BTA_AG_PEER_FEAT_CODEC))
 #if (SWB_ENABLED == TRUE)
@@ -2380,6 +2509,9 @@ void bta_ag_sco_codec_nego(tBTA_AG_SCB* p_scb, bool result) {
 void bta_ag_sco_shutdown(tBTA_AG_SCB* p_scb, UNUSED_ATTR tBTA_AG_DATA* p_data) {
   APPL_TRACE_DEBUG("%s: p_scb : %x", __func__, p_scb);
 
+  /* A setup cut short by the shutdown is not counted */
+  bta_ag_sco_setup_reset(&p_scb->sco_setup);
+
 #if (TWS_AG_ENABLED == TRUE)
   if (is_twsp_device(p_scb->peer_addr)) {
      if (p_scb == bta_ag_cb.main_sm_scb) {
@@ -2442,6 +2574,9 @@ void bta_ag_sco_conn_open(tBTA_AG_SCB* p_scb,
     /* call app callback */
     bta_ag_cback_sco(p_scb, BTA_AG_AUDIO_OPEN_EVT);
 
+    /* count the setup, unless initiated by the peer */
+    bta_ag_sco_setup_done(p_scb, true);
+
     /* reset collision trials and timer */
     p_scb->no_of_xsco_trials = 0;
     p_scb->no_of_xsco_retry = 0;
@@ -2510,6 +2645,7 @@ void bta_ag_sco_conn_close(tBTA_AG_SCB* p_scb,
         )) {
               bta_ag_sco_event(p_scb, BTA_AG_SCO_REOPEN_E);
        } else {
+           bta_ag_sco_setup_done(p_scb, false);
            bta_ag_sco_event(p_scb, BTA_AG_SCO_CONN_CLOSE_E);
        }
 #if (TWS_AG_ENABLED == TRUE)
@@ -0,0 +1,304 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  BTA AG cache of the eSCO parameter set each peer last accepted, and call
+ *  audio setup latency statistics.
+ *
+ ******************************************************************************/
+
+#include "bta_ag_sco_params.h"
+
+/* Upper bounds of the setup latency histogram buckets */
+static const uint32_t bta_ag_sco_setup_bucket_ms[BTA_AG_SCO_SETUP_NUM_BUCKETS] =
+    {100, 200, 400, 800, 1600, 0};
+
+/* Whether setting is tried after preferred is rejected */
+static bool bta_ag_sco_params_falls_back_to(uint8_t preferred,
+                                            uint8_t setting) {
+  for (uint8_t tried = preferred;; tried = bta_ag_sco_params_next(tried)) {
+    if (tried == setting) return true;
+    if (tried == ESCO_CODEC_CVSD) return false;
+  }
+}
+
+static tBTA_AG_SCO_PARAMS_ENTRY* bta_ag_sco_params_find(
+    const tBTA_AG_SCO_PARAMS_CACHE* p_cache, const RawAddress& peer_addr) {
+  for (int i = 0; i < BTA_AG_SCO_PARAMS_CACHE_SIZE; i++) {
+    const tBTA_AG_SCO_PARAMS_ENTRY* p_entry = &p_cache->entry[i];
+    if (p_entry->in_use && p_entry->peer_addr == peer_addr)
+      return (tBTA_AG_SCO_PARAMS_ENTRY*)p_entry;
+  }
+  return NULL;
+}
+
+/*****************************************************************************
+ *
+ * Function         bta_ag_sco_params_next
+ *
+ * Description      The eSCO parameter set tried after the peer rejects
+ *                  setting: mSBC T1 after T2, then CVSD.
+ *
+ *
+ * Returns          The eSCO parameter set, an esco_codec_t.
+ *
+ ****************************************************************************/
+uint8_t bta_ag_sco_params_next(uint8_t setting) {
+  return setting == ESCO_CODEC_MSBC_T2 ? ESCO_CODEC_MSBC_T1 : ESCO_CODEC_CVSD;
+}
+
+/*****************************************************************************
+ *
+ * Function         bta_ag_sco_params_get
+ *
+ * Description      Look up the eSCO parameter set peer_addr last accepted.
+ *
+ *
+ * Returns          true and the set in p_setting if cached, false otherwise.
+ *
+ ****************************************************************************/
+bool bta_ag_sco_params_get(const tBTA_AG_SCO_PARAMS_CACHE* p_cache,
+                           const RawAddress& peer_addr, uint8_t* p_setting) {
+  tBTA_AG_SCO_PARAMS_ENTRY* p_entry =
+      bta_ag_sco_params_find(p_cache, peer_addr);
+  if (p_entry == NULL) return false;
+
+  *p_setting = p_entry->setting;
+  return true;
+}
+
+/*****************************************************************************
+ *
+ * Function         bta_ag_sco_params_first
+ *
+ * Description      Select the eSCO parameter set to try first with
+ *                  peer_addr, whose preferred set is preferred: the one it
+ *                  last accepted if the preferred one falls back to it.
+ *
+ *
+ * Returns          The eSCO parameter set, an esco_codec_t.
+ *
+ ****************************************************************************/
+uint8_t bta_ag_sco_params_first(tBTA_AG_SCO_PARAMS_CACHE* p_cache,
+                                const RawAddress& peer_addr,
+                                uint8_t preferred) {
+  tBTA_AG_SCO_PARAMS_ENTRY* p_entry =
+      bta_ag_sco_params_find(p_cache, peer_addr);
+  if (p_entry == NULL || p_entry->setting == preferred ||
+      !bta_ag_sco_params_falls_back_to(preferred, p_entry->setting))
+    return preferred;
+
+  p_entry->last_used = ++p_cache->use_count;
+
+  /* Try the preferred set again once in a while, the peer may accept it */
+  if (p_entry->reuse_count >= BTA_AG_SCO_PARAMS_MAX_REUSE) {
+    p_entry->reuse_count = 0;
+    return preferred;
+  }
+
+  p_entry->reuse_count++;
+  return p_entry->setting;
+}
+
+/*****************************************************************************
+ *
+ * Function         bta_ag_sco_params_put
+ *
+ * Description      Cache the eSCO parameter set peer_addr accepted.
+ *
+ *
+ * Returns          true if it differs from the one cached.
+ *
+ ****************************************************************************/
+bool bta_ag_sco_params_put(tBTA_AG_SCO_PARAMS_CACHE* p_cache,
+                           const RawAddress& peer_addr, uint8_t setting) {
+  tBTA_AG_SCO_PARAMS_ENTRY* p_entry =
+      bta_ag_sco_params_find(p_cache, peer_addr);
+
+  if (p_entry == NULL) {
+    /* a free entry, or the least recently used one */
+    p_entry = &p_cache->entry[0];
+    for (int i = 0; i < BTA_AG_SCO_PARAMS_CACHE_SIZE; i++) {
+      tBTA_AG_SCO_PARAMS_ENTRY* p_cand = &p_cache->entry[i];
+      if (!p_cand->in_use) {
+        p_entry = p_cand;
+        break;
+      }
+      if (p_cand->last_used < p_entry->last_used) p_entry = p_cand;
+    }
+    p_entry->in_use = true;
+    p_entry->peer_addr = peer_addr;
+  } else if (p_entry->setting == setting) {
+    p_entry->last_used = ++p_cache->use_count;
+    return false;
+  }
+
+  p_entry->setting = setting;
+  p_entry->reuse_count = 0;
+  p_entry->last_used = ++p_cache->use_count;
+  return true;
+}
+
+/*****************************************************************************
+ *
+ * Function         bta_ag_sco_params_codec_agreed
+ *
+ * Description      Whether the codec +BCS would select, sco_codec or CVSD
+ *                  after a codec fallback, is agreed_codec, the one the peer
+ *                  last confirmed, so that codec negotiation can be skipped.
+ *
+ *
+ * Returns          bool
+ *
+ ****************************************************************************/
+bool bta_ag_sco_params_codec_agreed(bool codec_negotiation,
+                                    bool codec_fallback,
+                                    tBTA_AG_PEER_CODEC sco_codec,
+                                    tBTA_AG_PEER_CODEC agreed_codec) {
+  if (!codec_negotiation || agreed_codec == BTA_AG_CODEC_NONE) return false;
+
+  tBTA_AG_PEER_CODEC codec = codec_fallback ? BTA_AG_CODEC_CVSD : sco_codec;
+  return codec == agreed_codec;
+}
+
+/*****************************************************************************
+ *
+ * Function         bta_ag_sco_setup_start
+ *
+ * Description      Start a call audio setup at now_ms, unless one is in
+ *                  progress.
+ *
+ *
+ * Returns          void
+ *
+ ****************************************************************************/
+void bta_ag_sco_setup_start(tBTA_AG_SCO_SETUP* p_setup, uint64_t now_ms) {
+  if (p_setup->start_ms != 0) return;
+
+  p_setup->start_ms = now_ms;
+  p_setup->attempts = 0;
+}
+
+/*****************************************************************************
+ *
+ * Function         bta_ag_sco_setup_attempt
+ *
+ * Description      Count an eSCO connection attempted by the call audio
+ *                  setup, starting it if needed.
+ *
+ *
+ * Returns          void
+ *
+ ****************************************************************************/
+void bta_ag_sco_setup_attempt(tBTA_AG_SCO_SETUP* p_setup, uint64_t now_ms) {
+  bta_ag_sco_setup_start(p_setup, now_ms);
+  p_setup->attempts++;
+}
+
+/*****************************************************************************
+ *
+ * Function         bta_ag_sco_setup_reset
+ *
+ * Description      Abandon the call audio setup in progress, if any, without
+ *                  counting it.
+ *
+ *
+ * Returns          void
+ *
+ ****************************************************************************/
+void bta_ag_sco_setup_reset(tBTA_AG_SCO_SETUP* p_setup) {
+  p_setup->start_ms = 0;
+  p_setup->attempts = 0;
+}
+
+/*****************************************************************************
+ *
+ * Function         bta_ag_sco_setup_end
+ *
+ * Description      End the call audio setup in progress, if any. A failure
+ *                  is counted. A success of a setup the AG attempted is
+ *                  counted, and setting is cached as the one peer_addr
+ *                  accepted.
+ *
+ *
+ * Returns          true if the cached set changed and is to be persisted.
+ *
+ ****************************************************************************/
+bool bta_ag_sco_setup_end(tBTA_AG_SCO_SETUP* p_setup,
+                          tBTA_AG_SCO_PARAMS_CACHE* p_cache,
+                          tBTA_AG_SCO_SETUP_STATS* p_stats,
+                          const RawAddress& peer_addr, uint8_t setting,
+                          bool success, uint64_t now_ms) {
+  bool changed = false;
+
+  if (p_setup->start_ms == 0) return false;
+
+  if (!success) {
+    p_stats->fail_count++;
+  } else if (p_setup->attempts != 0) {
+    /* not counted when the peer set up the eSCO connection */
+    bta_ag_sco_setup_stats_add(p_stats,
+                               (uint32_t)(now_ms - p_setup->start_ms),
+                               p_setup->attempts);
+    changed = bta_ag_sco_params_put(p_cache, peer_addr, setting);
+  }
+
+  bta_ag_sco_setup_reset(p_setup);
+  return changed;
+}
+
+/*****************************************************************************
+ *
+ * Function         bta_ag_sco_setup_stats_add
+ *
+ * Description      Count a call audio setup of latency_ms, which took
+ *                  attempts eSCO connection attempts.
+ *
+ *
+ * Returns          void
+ *
+ ****************************************************************************/
+void bta_ag_sco_setup_stats_add(tBTA_AG_SCO_SETUP_STATS* p_stats,
+                                uint32_t latency_ms, uint8_t attempts) {
+  int bucket = 0;
+  while (bucket < BTA_AG_SCO_SETUP_NUM_BUCKETS - 1 &&
+         latency_ms >= bta_ag_sco_setup_bucket_ms[bucket])
+    bucket++;
+
+  p_stats->bucket[bucket]++;
+  p_stats->count++;
+  p_stats->attempts += attempts;
+  p_stats->total_ms += latency_ms;
+  if (latency_ms > p_stats->max_ms) p_stats->max_ms = latency_ms;
+}
+
+/*****************************************************************************
+ *
+ * Function         bta_ag_sco_setup_stats_bucket_ms
+ *
+ * Description      Upper bound of the latency histogram bucket.
+ *
+ *
+ * Returns          The bound in ms, 0 for the last, unbounded, bucket.
+ *
+ ****************************************************************************/
+uint32_t bta_ag_sco_setup_stats_bucket_ms(int bucket) {
+  if (bucket < 0 || bucket >= BTA_AG_SCO_SETUP_NUM_BUCKETS) return 0;
+  return bta_ag_sco_setup_bucket_ms[bucket];
+}
@@ -0,0 +1,254 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  Interface file for the BTA AG cache of the eSCO parameter set each peer
+ *  last accepted. A peer rejecting the preferred parameter set costs a
+ *  failed eSCO setup, and possibly a codec negotiation, on every call: the
+ *  set it last accepted is tried first instead, and the preferred one again
+ *  after BTA_AG_SCO_PARAMS_MAX_REUSE calls.
+ *
+ ******************************************************************************/
+#ifndef BTA_AG_SCO_PARAMS_H
+#define BTA_AG_SCO_PARAMS_H
+
+#include <stdint.h>
+
+#include "bta_ag_api.h"
+#include "device/include/esco_parameters.h"
+#include "types/raw_address.h"
+
+/*****************************************************************************
+ *  Constants
+ ****************************************************************************/
+
+/* Peers whose eSCO parameter set is cached */
+#ifndef BTA_AG_SCO_PARAMS_CACHE_SIZE
+#define BTA_AG_SCO_PARAMS_CACHE_SIZE 8
+#endif
+
+/* Calls set up with a cached parameter set below the preferred one before
+ * the preferred one is tried again */
+#ifndef BTA_AG_SCO_PARAMS_MAX_REUSE
+#define BTA_AG_SCO_PARAMS_MAX_REUSE 8
+#endif
+
+/* Call audio setup latency histogram buckets, the last one unbounded */
+#define BTA_AG_SCO_SETUP_NUM_BUCKETS 6
+
+/*****************************************************************************
+ *  Data types
+ ****************************************************************************/
+
+/* eSCO parameter set a peer last accepted */
+typedef struct {
+  RawAddress peer_addr;
+  uint8_t setting;     /* esco_codec_t */
+  uint8_t reuse_count; /* calls set up with it, when below the preferred */
+  uint32_t last_used;  /* for the least recently used entry to be replaced */
+  bool in_use;
+} tBTA_AG_SCO_PARAMS_ENTRY;
+
+typedef struct {
+  tBTA_AG_SCO_PARAMS_ENTRY entry[BTA_AG_SCO_PARAMS_CACHE_SIZE];
+  uint32_t use_count;
+} tBTA_AG_SCO_PARAMS_CACHE;
+
+/* Call audio setup latency, from the start of the setup to the eSCO
+ * connection being open */
+typedef struct {
+  uint32_t bucket[BTA_AG_SCO_SETUP_NUM_BUCKETS];
+  uint32_t count;       /* setups succeeded */
+  uint32_t fail_count;  /* setups given up */
+  uint32_t attempts;    /* eSCO connections attempted by the setups */
+  uint64_t total_ms;
+  uint32_t max_ms;
+} tBTA_AG_SCO_SETUP_STATS;
+
+/* Call audio setup in progress with a peer */
+typedef struct {
+  uint64_t start_ms; /* start of the setup, or 0 */
+  uint8_t attempts;  /* eSCO connections it attempted */
+} tBTA_AG_SCO_SETUP;
+
+/*****************************************************************************
+ *  Function prototypes
+ ****************************************************************************/
+
+/*****************************************************************************
+ *
+ * Function         bta_ag_sco_params_next
+ *
+ * Description      The eSCO parameter set tried after the peer rejects
+ *                  setting: mSBC T1 after T2, then CVSD.
+ *
+ *
+ * Returns          The eSCO parameter set, an esco_codec_t.
+ *
+ ****************************************************************************/
+extern uint8_t bta_ag_sco_params_next(uint8_t setting);
+
+/*****************************************************************************
+ *
+ * Function         bta_ag_sco_params_get
+ *
+ * Description      Look up the eSCO parameter set peer_addr last accepted.
+ *
+ *
+ * Returns          true and the set in p_setting if cached, false otherwise.
+ *
+ ****************************************************************************/
+extern bool bta_ag_sco_params_get(const tBTA_AG_SCO_PARAMS_CACHE* p_cache,
+                                  const RawAddress& peer_addr,
+                                  uint8_t* p_setting);
+
+/*****************************************************************************
+ *
+ * Function         bta_ag_sco_params_first
+ *
+ * Description      Select the eSCO parameter set to try first with
+ *                  peer_addr, whose preferred set is preferred: the one it
+ *                  last accepted if the preferred one falls back to it.
+ *
+ *
+ * Returns          The eSCO parameter set, an esco_codec_t.
+ *
+ ****************************************************************************/
+extern uint8_t bta_ag_sco_params_first(tBTA_AG_SCO_PARAMS_CACHE* p_cache,
+                                       const RawAddress& peer_addr,
+                                       uint8_t preferred);
+
+/*****************************************************************************
+ *
+ * Function         bta_ag_sco_params_put
+ *
+ * Description      Cache the eSCO parameter set peer_addr accepted.
+ *
+ *
+ * Returns          true if it differs from the one cached.
+ *
+ ****************************************************************************/
+extern bool bta_ag_sco_params_put(tBTA_AG_SCO_PARAMS_CACHE* p_cache,
+                                  const RawAddress& peer_addr,
+                                  uint8_t setting);
+
+/*****************************************************************************
+ *
+ * Function         bta_ag_sco_params_codec_agreed
+ *
+ * Description      Whether the codec +BCS would select, sco_codec or CVSD
+ *                  after a codec fallback, is agreed_codec, the one the peer
+ *                  last confirmed, so that codec negotiation can be skipped.
+ *
+ *
+ * Returns          bool
+ *
+ ****************************************************************************/
+extern bool bta_ag_sco_params_codec_agreed(bool codec_negotiation,
+                                           bool codec_fallback,
+                                           tBTA_AG_PEER_CODEC sco_codec,
+                                           tBTA_AG_PEER_CODEC agreed_codec);
+
+/*****************************************************************************
+ *
+ * Function         bta_ag_sco_setup_start
+ *
+ * Description      Start a call audio setup at now_ms, unless one is in
+ *                  progress.
+ *
+ *
+ * Returns          void
+ *
+ ****************************************************************************/
+extern void bta_ag_sco_setup_start(tBTA_AG_SCO_SETUP* p_setup,
+                                   uint64_t now_ms);
+
+/*****************************************************************************
+ *
+ * Function         bta_ag_sco_setup_attempt
+ *
+ * Description      Count an eSCO connection attempted by the call audio
+ *                  setup, starting it if needed.
+ *
+ *
+ * Returns          void
+ *
+ ****************************************************************************/
+extern void bta_ag_sco_setup_attempt(tBTA_AG_SCO_SETUP* p_setup,
+                                     uint64_t now_ms);
+
+/*****************************************************************************
+ *
+ * Function         bta_ag_sco_setup_reset
+ *
+ * Description      Abandon the call audio setup in progress, if any, without
+ *                  counting it.
+ *
+ *
+ * Returns          void
+ *
+ ****************************************************************************/
+extern void bta_ag_sco_setup_reset(tBTA_AG_SCO_SETUP* p_setup);
+
+/*****************************************************************************
+ *
+ * Function         bta_ag_sco_setup_end
+ *
+ * Description      End the call audio setup in progress, if any. A failure
+ *                  is counted. A success of a setup the AG attempted is
+ *                  counted, and setting is cached as the one peer_addr
+ *                  accepted.
+ *
+ *
+ * Returns          true if the cached set changed and is to be persisted.
+ *
+ ****************************************************************************/
+extern bool bta_ag_sco_setup_end(tBTA_AG_SCO_SETUP* p_setup,
+                                 tBTA_AG_SCO_PARAMS_CACHE* p_cache,
+                                 tBTA_AG_SCO_SETUP_STATS* p_stats,
+                                 const RawAddress& peer_addr, uint8_t setting,
+                                 bool success, uint64_t now_ms);
+
+/*****************************************************************************
+ *
+ * Function         bta_ag_sco_setup_stats_add
+ *
+ * Description      Count a call audio setup of latency_ms, which took
+ *                  attempts eSCO connection attempts.
+ *
+ *
+ * Returns          void
+ *
+ ****************************************************************************/
+extern void bta_ag_sco_setup_stats_add(tBTA_AG_SCO_SETUP_STATS* p_stats,
+                                       uint32_t latency_ms, uint8_t attempts);
+
+/*****************************************************************************
+ *
+ * Function         bta_ag_sco_setup_stats_bucket_ms
+ *
+ * Description      Upper bound of the latency histogram bucket.
+ *
+ *
+ * Returns          The bound in ms, 0 for the last, unbounded, bucket.
+ *
+ ****************************************************************************/
+extern uint32_t bta_ag_sco_setup_stats_bucket_ms(int bucket);
+
+#endif /* BTA_AG_SCO_PARAMS_H */
@@ -5063,6 +5063,52 @@ void bta_dm_add_ble_device(tBTA_DM_MSG* p_data) {
   }
 }
 
+/*******************************************************************************
+ *
+ * Function         bta_dm_add_bonded_devices
+ *
+ * Description      This function adds the bonded devices to the security
+ *                  database, with their link keys and LE keys.
+ *                  It is normally called during host startup to restore all
+ *                  required information stored in the NVRAM.
+ *
+ * Parameters:
+ *
+ ******************************************************************************/
+void bta_dm_add_bonded_devices(std::vector<tBTA_DM_BONDED_DEVICE> devices) {
+  uint32_t trusted_services_mask[BTM_SEC_SERVICE_ARRAY_SIZE];
+  BD_NAME bd_name;
+  uint8_t features[BTA_FEATURE_BYTES_PER_PAGE * (BTA_EXT_FEATURES_PAGE_MAX + 1)];
+
+  memset(trusted_services_mask, 0, sizeof(trusted_services_mask));
+  memset(bd_name, 0, sizeof(bd_name));
+  memset(features, 0, sizeof(features));
+
+  for (tBTA_DM_BONDED_DEVICE& dev : devices) {
+    if (dev.link_key_known &&
+        !BTM_SecAddDevice(dev.bd_addr, dev.dc_known ? dev.dc : NULL, bd_name,
+                          features, trusted_services_mask, &dev.link_key,
+                          dev.key_type, 0, dev.pin_length)) {
+      LOG(ERROR) << "BTA_DM: Error adding device " << dev.bd_addr;
+    }
+
+    if (!dev.is_ble) continue;
+
+    if (!BTM_SecAddBleDevice(dev.bd_addr, NULL, BT_DEVICE_TYPE_BLE,
+                             dev.addr_type)) {
+      LOG(ERROR) << "BTA_DM: Error adding BLE Device for device "
+                 << dev.bd_addr;
+    }
+    for (auto& key : dev.ble_keys) {
+      if (!BTM_SecAddBleKey(dev.bd_addr, (tBTM_LE_KEY_VALUE*)&key.second,
+                            key.first)) {
+        LOG(ERROR) << "BTA_DM: Error adding BLE Key for device "
+                   << dev.bd_addr;
+      }
+    }
+  }
+}
+
 /*******************************************************************************
  *
  * Function         bta_dm_add_ble_device
@@ -752,6 +752,25 @@ void BTA_DmAddBleKey(const RawAddress& bd_addr, tBTA_LE_KEY_VALUE* p_le_key,
   bta_sys_sendmsg(p_msg);
 }
 
+/*******************************************************************************
+ *
+ * Function         BTA_DmAddBondedDevices
+ *
+ * Description      Add the security information of all the bonded devices at
+ *                  once.  This function will be normally called during host
+ *                  startup to restore all required information stored in the
+ *                  NVRAM.
+ *
+ * Parameters:      devices          - the bonded devices.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+void BTA_DmAddBondedDevices(std::vector<tBTA_DM_BONDED_DEVICE> devices) {
+  do_in_bta_thread(FROM_HERE, base::Bind(&bta_dm_add_bonded_devices,
+                                         base::Passed(std::move(devices))));
+}
+
 /*******************************************************************************
  *
  * Function         BTA_DmAddBleDevice
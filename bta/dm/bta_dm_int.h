@@ -907,6 +907,8 @@ extern void bta_dm_add_ampkey(tBTA_DM_MSG* p_data);
 
 extern void bta_dm_add_blekey(tBTA_DM_MSG* p_data);
 extern void bta_dm_add_ble_device(tBTA_DM_MSG* p_data);
+extern void bta_dm_add_bonded_devices(
+    std::vector<tBTA_DM_BONDED_DEVICE> devices);
 extern void bta_dm_ble_passkey_reply(tBTA_DM_MSG* p_data);
 extern void bta_dm_ble_confirm_reply(tBTA_DM_MSG* p_data);
 extern void bta_dm_security_grant(tBTA_DM_MSG* p_data);
@@ -35,8 +35,11 @@
 #include "bta_ag_int.h"
 #include "bta_sys.h"
 #include "btm_api.h"
+#include "btm_pm_policy.h"
 
 #include "device/include/interop.h"
+#include "osi/include/properties.h"
+#include "osi/include/time.h"
 
 extern fixed_queue_t* btu_bta_alarm_queue;
 
@@ -58,6 +61,12 @@ static void bta_dm_pm_set_sniff_policy(tBTA_DM_PEER_DEVICE* p_dev,
                                        bool bDisable);
 static void bta_dm_pm_stop_timer_by_index(tBTA_PM_TIMER* p_timer,
                                           uint8_t timer_idx);
+static period_ms_t bta_dm_pm_policy_timeout(const RawAddress& peer_addr,
+                                            period_ms_t timeout_ms);
+static void bta_dm_pm_policy_sniff(const RawAddress& peer_addr,
+                                   tBTM_PM_PWR_MD* p_md);
+static uint16_t bta_dm_pm_policy_ssr(const RawAddress& peer_addr,
+                                     uint16_t max_lat);
 
 #if (BTM_SSR_INCLUDED == TRUE)
 #if (BTA_HH_INCLUDED == TRUE)
@@ -73,6 +82,27 @@ tBTA_DM_CONNECTED_SRVCS bta_dm_conn_srvcs;
 static std::recursive_mutex pm_timer_schedule_mutex;
 static std::recursive_mutex pm_timer_state_mutex;
 
+/* Adjusts the idle timeouts and sniff parameters to the traffic of each
+ * link, see btm_pm_policy.h */
+#define BTA_DM_PM_ADAPTIVE_PROPERTY "persist.bluetooth.adaptivesniff"
+static bool bta_dm_pm_adaptive = false;
+
+/* Recent decisions of the traffic-aware policy, for dumpsys */
+#define BTA_DM_PM_POLICY_LOG_SIZE 32
+typedef struct {
+  uint32_t time_ms;
+  RawAddress peer_addr;
+  const char* what;
+  tBTM_PM_TRAFFIC_CLASS traffic_class;
+  tBTM_PM_TRAFFIC traffic;
+  uint32_t asked[2];  /* as asked for by the profiles */
+  uint32_t chosen[2]; /* as adjusted */
+} tBTA_DM_PM_POLICY_LOG;
+
+static std::mutex pm_policy_log_mutex;
+static tBTA_DM_PM_POLICY_LOG pm_policy_log[BTA_DM_PM_POLICY_LOG_SIZE];
+static size_t pm_policy_log_count = 0;
+
 /*******************************************************************************
  *
  * Function         bta_dm_init_pm
@@ -99,6 +129,12 @@ void bta_dm_init_pm(void) {
     for (int j = 0; j < BTA_DM_PM_MODE_TIMER_MAX; j++)
       bta_dm_cb.pm_timer[i].srvc_id[j] = BTA_ID_MAX;
   }
+
+  char adaptive[PROPERTY_VALUE_MAX] = "false";
+  osi_property_get(BTA_DM_PM_ADAPTIVE_PROPERTY, adaptive, "false");
+  bta_dm_pm_adaptive = !strcmp(adaptive, "true");
+  APPL_TRACE_DEBUG("%s: adaptive power mode policy %s", __func__,
+                   bta_dm_pm_adaptive ? "enabled" : "disabled");
 }
 
 /*******************************************************************************
@@ -656,6 +692,11 @@ static void bta_dm_pm_set_mode(const RawAddress& peer_addr,
       }
     }
   }
+  if (bta_dm_pm_adaptive && (pm_action & BTA_DM_PM_SNIFF) &&
+      (pm_req != BTA_DM_PM_EXECUTE) && (timeout_ms > 0)) {
+    timeout_ms = bta_dm_pm_policy_timeout(peer_addr, timeout_ms);
+  }
+
   /* if need to start a timer */
   if ((pm_req != BTA_DM_PM_EXECUTE) && (timeout_ms > 0)) {
     for (i = 0; i < BTA_DM_NUM_PM_TIMER; i++) {
@@ -794,6 +835,8 @@ static bool bta_dm_pm_sniff(tBTA_DM_PEER_DEVICE* p_peer_dev, uint8_t index) {
     /* if the current mode is not sniff, issue the sniff command.
      * If sniff, but SSR is not used in this link, still issue the command */
     memcpy(&pwr_md, &p_bta_dm_pm_md[index], sizeof(tBTM_PM_PWR_MD));
+    if (bta_dm_pm_adaptive)
+      bta_dm_pm_policy_sniff(p_peer_dev->peer_bdaddr, &pwr_md);
     if (p_peer_dev->info & BTA_DM_DI_INT_SNIFF) {
       pwr_md.mode |= BTM_PM_MD_FORCE;
     }
@@ -902,8 +945,11 @@ static void bta_dm_pm_ssr(const RawAddress& peer_addr) {
       }
     }
 
+    uint16_t max_lat = p_spec->max_lat;
+    if (bta_dm_pm_adaptive) max_lat = bta_dm_pm_policy_ssr(peer_addr, max_lat);
+
     /* set the SSR parameters. */
-    BTM_SetSsrParams(peer_addr, p_spec->max_lat, p_spec->min_rmt_to,
+    BTM_SetSsrParams(peer_addr, max_lat, p_spec->min_rmt_to,
                      p_spec->min_loc_to);
   }
 }
@@ -1305,3 +1351,156 @@ tBTA_DM_CONTRL_STATE bta_dm_pm_obtain_controller_state(void) {
   APPL_TRACE_DEBUG("bta_dm_pm_obtain_controller_state: %d", cur_state);
   return cur_state;
 }
+
+/*******************************************************************************
+ *
+ * Function         bta_dm_pm_policy_log
+ *
+ * Description      Records a decision of the traffic-aware policy for dumpsys
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+static void bta_dm_pm_policy_log(const RawAddress& peer_addr, const char* what,
+                                 tBTM_PM_TRAFFIC_CLASS traffic_class,
+                                 const tBTM_PM_TRAFFIC* p_traffic,
+                                 uint32_t now_ms, const uint32_t asked[2],
+                                 const uint32_t chosen[2]) {
+  std::lock_guard<std::mutex> lock(pm_policy_log_mutex);
+  tBTA_DM_PM_POLICY_LOG* p_log =
+      &pm_policy_log[pm_policy_log_count++ % BTA_DM_PM_POLICY_LOG_SIZE];
+
+  p_log->time_ms = now_ms;
+  p_log->peer_addr = peer_addr;
+  p_log->what = what;
+  p_log->traffic_class = traffic_class;
+  p_log->traffic = *p_traffic;
+  p_log->asked[0] = asked[0];
+  p_log->asked[1] = asked[1];
+  p_log->chosen[0] = chosen[0];
+  p_log->chosen[1] = chosen[1];
+}
+
+/*******************************************************************************
+ *
+ * Function         bta_dm_pm_policy_timeout
+ *
+ * Description      Adjusts the idle timeout before sniff mode to the traffic
+ *                  of a link
+ *
+ * Returns          the timeout to use
+ *
+ ******************************************************************************/
+static period_ms_t bta_dm_pm_policy_timeout(const RawAddress& peer_addr,
+                                            period_ms_t timeout_ms) {
+  tBTM_PM_TRAFFIC traffic;
+  if (BTM_ReadAclTraffic(peer_addr, &traffic) != BTM_SUCCESS) return timeout_ms;
+
+  uint32_t now_ms = time_get_os_boottime_ms();
+  tBTM_PM_TRAFFIC_CLASS traffic_class = btm_pm_policy_classify(&traffic, now_ms);
+  uint32_t asked[2] = {(uint32_t)timeout_ms, 0};
+  uint32_t chosen[2] = {
+      btm_pm_policy_timeout(traffic_class, &traffic, now_ms, asked[0]), 0};
+
+  bta_dm_pm_policy_log(peer_addr, "timeout", traffic_class, &traffic, now_ms,
+                       asked, chosen);
+  return chosen[0];
+}
+
+/*******************************************************************************
+ *
+ * Function         bta_dm_pm_policy_sniff
+ *
+ * Description      Adjusts the sniff intervals to the traffic of a link
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+static void bta_dm_pm_policy_sniff(const RawAddress& peer_addr,
+                                   tBTM_PM_PWR_MD* p_md) {
+  tBTM_PM_TRAFFIC traffic;
+  if (BTM_ReadAclTraffic(peer_addr, &traffic) != BTM_SUCCESS) return;
+
+  uint32_t now_ms = time_get_os_boottime_ms();
+  tBTM_PM_TRAFFIC_CLASS traffic_class = btm_pm_policy_classify(&traffic, now_ms);
+  uint32_t asked[2] = {p_md->min, p_md->max};
+  btm_pm_policy_sniff(traffic_class, &traffic, p_md);
+  uint32_t chosen[2] = {p_md->min, p_md->max};
+
+  bta_dm_pm_policy_log(peer_addr, "sniff", traffic_class, &traffic, now_ms,
+                       asked, chosen);
+}
+
+/*******************************************************************************
+ *
+ * Function         bta_dm_pm_policy_ssr
+ *
+ * Description      Adjusts the sniff subrating latency to the traffic of a
+ *                  link
+ *
+ * Returns          the maximum latency to use
+ *
+ ******************************************************************************/
+static uint16_t bta_dm_pm_policy_ssr(const RawAddress& peer_addr,
+                                     uint16_t max_lat) {
+  tBTM_PM_TRAFFIC traffic;
+  if (BTM_ReadAclTraffic(peer_addr, &traffic) != BTM_SUCCESS) return max_lat;
+
+  uint32_t now_ms = time_get_os_boottime_ms();
+  tBTM_PM_TRAFFIC_CLASS traffic_class = btm_pm_policy_classify(&traffic, now_ms);
+  uint32_t asked[2] = {max_lat, 0};
+  uint32_t chosen[2] = {
+      btm_pm_policy_ssr_max_lat(traffic_class, &traffic, max_lat), 0};
+
+  bta_dm_pm_policy_log(peer_addr, "ssr", traffic_class, &traffic, now_ms,
+                       asked, chosen);
+  return chosen[0];
+}
+
+/*******************************************************************************
+ *
+ * Function         bta_dm_pm_policy_dump
+ *
+ * Description      Dumps the recent decisions of the traffic-aware policy
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+void bta_dm_pm_policy_dump(int fd) {
+  std::lock_guard<std::mutex> lock(pm_policy_log_mutex);
+  uint32_t now_ms = time_get_os_boottime_ms();
+
+  dprintf(fd, "\nAdaptive power mode policy: %s\n",
+          bta_dm_pm_adaptive ? "enabled" : "disabled");
+  if (pm_policy_log_count == 0) return;
+
+  dprintf(fd, "  Recent decisions (newest last):\n");
+  size_t first = pm_policy_log_count > BTA_DM_PM_POLICY_LOG_SIZE
+                     ? pm_policy_log_count - BTA_DM_PM_POLICY_LOG_SIZE
+                     : 0;
+  for (size_t i = first; i < pm_policy_log_count; i++) {
+    const tBTA_DM_PM_POLICY_LOG* p_log =
+        &pm_policy_log[i % BTA_DM_PM_POLICY_LOG_SIZE];
+    const tBTM_PM_TRAFFIC* p_traffic = &p_log->traffic;
+
+    dprintf(fd, "    %6.1fs ago %s %-7s %s: ",
+            (now_ms - p_log->time_ms) / 1000.0,
+            p_log->peer_addr.ToString().c_str(), p_log->what,
+            btm_pm_traffic_class_text(p_log->traffic_class));
+    if (!strcmp(p_log->what, "timeout")) {
+      dprintf(fd, "%u ms -> %u ms", p_log->asked[0], p_log->chosen[0]);
+    } else if (!strcmp(p_log->what, "sniff")) {
+      dprintf(fd, "interval %u..%u -> %u..%u slots", p_log->asked[0],
+              p_log->asked[1], p_log->chosen[0], p_log->chosen[1]);
+    } else {
+      dprintf(fd, "max latency %u -> %u slots", p_log->asked[0],
+              p_log->chosen[0]);
+    }
+    dprintf(fd,
+            " (pkts tx %u rx %u, avg %u bytes, %u bursts, gap %u ms in "
+            "bursts %u ms between, last %u ms ago)\n",
+            p_traffic->tx_pkts, p_traffic->rx_pkts, p_traffic->pkt_len,
+            p_traffic->bursts, p_traffic->gap_ms, p_traffic->burst_gap_ms,
+            p_log->time_ms - p_traffic->last_pkt_ms);
+  }
+}
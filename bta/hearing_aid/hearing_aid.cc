@@ -25,7 +25,9 @@
 #include "embdrv/g722/g722_enc_dec.h"
 #include "gap_api.h"
 #include "gatt_api.h"
+#include "hearing_aid_scheduler.h"
 #include "osi/include/properties.h"
+#include "osi/include/time.h"
 
 #include <base/bind.h>
 #include <base/callback.h>
@@ -1000,6 +1002,7 @@ class HearingAidImpl : public HearingAid {
     if (encoder_state_left == nullptr) {
       encoder_state_init();
       seq_counter = 0;
+      scheduler.Reset();
 
       // use the best codec avaliable for this pair of devices.
       uint16_t codecs = hearingDevice.codecs;
@@ -1172,8 +1175,12 @@ class HearingAidImpl : public HearingAid {
       return;
     }
 
-    std::vector<uint16_t> chan_left;
-    std::vector<uint16_t> chan_right;
+    scheduler.OnTickStart(time_get_os_boottime_us());
+
+    // The channel and encoded data buffers are kept from one tick to the
+    // next, so that they are not reallocated 100 times a second
+    chan_left.clear();
+    chan_right.clear();
     if (left == nullptr || right == nullptr) {
       for (int i = 0; i < num_samples; i++) {
         const uint8_t* sample = data.data() + i * 4;
@@ -1204,10 +1211,8 @@ class HearingAidImpl : public HearingAid {
 
     // divide encoded data into packets, add header, send.
 
-    // TODO: make those buffers static and global to prevent constant
-    // reallocations
     // TODO: this should basically fit the encoded data, tune the size later
-    std::vector<uint8_t> encoded_data_left;
+    encoded_data_left.clear();
     if (left) {
       // TODO: instead of a magic number, we need to figure out the correct
       // buffer size
@@ -1220,22 +1225,9 @@ class HearingAidImpl : public HearingAid {
         LOG(ERROR) << "Error: No chan_left data to encode";
       }
       encoded_data_left.resize(encoded_size);
-
-      uint16_t cid = GAP_ConnGetL2CAPCid(left->gap_handle);
-      uint16_t packets_to_flush = L2CA_FlushChannel(cid, L2CAP_FLUSH_CHANS_GET);
-      if (packets_to_flush) {
-        VLOG(2) << left->address << " skipping " << packets_to_flush
-                << " packets";
-        left->audio_stats.packet_flush_count += packets_to_flush;
-        left->audio_stats.frame_flush_count++;
-        hearingDevices.StartRssiLog();
-      }
-      // flush all packets stuck in queue
-      L2CA_FlushChannel(cid, 0xffff);
-      check_and_do_rssi_read(left);
     }
 
-    std::vector<uint8_t> encoded_data_right;
+    encoded_data_right.clear();
     if (right) {
       // TODO: instead of a magic number, we need to figure out the correct
       // buffer size
@@ -1248,19 +1240,6 @@ class HearingAidImpl : public HearingAid {
         LOG(ERROR) << "Error: No chan_right data to encode";
       }
       encoded_data_right.resize(encoded_size);
-
-      uint16_t cid = GAP_ConnGetL2CAPCid(right->gap_handle);
-      uint16_t packets_to_flush = L2CA_FlushChannel(cid, L2CAP_FLUSH_CHANS_GET);
-      if (packets_to_flush) {
-        VLOG(2) << right->address << " skipping " << packets_to_flush
-                << " packets";
-        right->audio_stats.packet_flush_count += packets_to_flush;
-        right->audio_stats.frame_flush_count++;
-        hearingDevices.StartRssiLog();
-      }
-      // flush all packets stuck in queue
-      L2CA_FlushChannel(cid, 0xffff);
-      check_and_do_rssi_read(right);
     }
 
     size_t encoded_data_size =
@@ -1272,6 +1251,38 @@ class HearingAidImpl : public HearingAid {
     if (encoded_data_size != 0 && packet_size > encoded_data_size)
       packet_size = encoded_data_size;
     VLOG(2) << "packet_size : " << packet_size;
+
+    // Flush only the oldest frames still queued to either side, beyond the
+    // latency budget, or too far ahead of the other side
+    HearingDevice* sides[HA_SIDE_MAX] = {left, right};
+    bool active[HA_SIDE_MAX];
+    uint16_t cids[HA_SIDE_MAX], queued_packets[HA_SIDE_MAX];
+    uint16_t packets_to_flush[HA_SIDE_MAX];
+    for (int i = 0; i < HA_SIDE_MAX; i++) {
+      active[i] = sides[i] != nullptr;
+      cids[i] = 0;
+      queued_packets[i] = 0;
+      if (!sides[i]) continue;
+      cids[i] = GAP_ConnGetL2CAPCid(sides[i]->gap_handle);
+      queued_packets[i] = L2CA_FlushChannel(cids[i], L2CAP_FLUSH_CHANS_GET);
+    }
+    uint16_t packets_per_frame =
+        packet_size ? (encoded_data_size + packet_size - 1) / packet_size : 1;
+    scheduler.Schedule(active, queued_packets, packets_per_frame,
+                       packets_to_flush);
+    for (int i = 0; i < HA_SIDE_MAX; i++) {
+      if (!sides[i]) continue;
+      if (packets_to_flush[i]) {
+        VLOG(2) << sides[i]->address << " skipping " << packets_to_flush[i]
+                << " packets";
+        sides[i]->audio_stats.packet_flush_count += packets_to_flush[i];
+        sides[i]->audio_stats.frame_flush_count++;
+        hearingDevices.StartRssiLog();
+        L2CA_FlushChannel(cids[i], packets_to_flush[i]);
+      }
+      check_and_do_rssi_read(sides[i]);
+    }
+
     for (size_t i = 0; i < encoded_data_size; i += packet_size) {
       if (left) {
         left->audio_stats.packet_send_count++;
@@ -1285,6 +1296,17 @@ class HearingAidImpl : public HearingAid {
     }
     if (left) left->audio_stats.frame_send_count++;
     if (right) right->audio_stats.frame_send_count++;
+
+    scheduler.OnTickEnd(time_get_os_boottime_us(),
+                        GetConnectionIntervalUs(left ? left : right));
+  }
+
+  /* The connection interval negotiated with |hearingDevice|, or the audio
+   * data interval until it is */
+  uint32_t GetConnectionIntervalUs(const HearingDevice* hearingDevice) {
+    if (hearingDevice->connection_update_status == COMPLETED)
+      return hearingDevice->requested_connection_interval * 1250;
+    return default_data_interval_ms * 1000;
   }
 
   void SendAudio(uint8_t* encoded_data, uint16_t packet_size,
@@ -1463,6 +1485,7 @@ class HearingAidImpl : public HearingAid {
 
       DumpRssi(fd, device);
     }
+    scheduler.Dump(stream);
     dprintf(fd, "%s", stream.str().c_str());
   }
 
@@ -1592,6 +1615,12 @@ class HearingAidImpl : public HearingAid {
 
   HearingDevices hearingDevices;
 
+  HearingAidScheduler scheduler;
+  std::vector<uint16_t> chan_left;
+  std::vector<uint16_t> chan_right;
+  std::vector<uint8_t> encoded_data_left;
+  std::vector<uint8_t> encoded_data_right;
+
   void find_server_changed_ccc_handle(uint16_t conn_id,
                                       const gatt::Service* service) {
     HearingDevice* hearingDevice = hearingDevices.FindByConnId(conn_id);
@@ -41,6 +41,7 @@ int data_interval_ms = -1;
 alarm_t* audio_timer = nullptr;
 HearingAidAudioReceiver* localAudioReceiver = nullptr;
 int num_channels = 2;
+std::vector<uint8_t> pcm_data;
 
 struct AudioHalStats {
   size_t media_read_total_underflow_bytes;
@@ -66,7 +67,10 @@ void send_audio_data(void* audio_data) {
       (num_channels * sample_rate * data_interval_ms * (bit_rate / 8)) / 1000;
 
   uint16_t event;
-  uint8_t p_buf[bytes_per_tick];
+  // Read straight into the buffer handed to the receiver, kept from one tick
+  // to the next rather than copied into a new one each tick
+  pcm_data.resize(bytes_per_tick);
+  uint8_t* p_buf = pcm_data.data();
 
   uint32_t bytes_read;
   if (bluetooth::audio::hearing_aid::is_hal_2_0_enabled()) {
@@ -83,10 +87,10 @@ void send_audio_data(void* audio_data) {
     stats.media_read_last_underflow_us = time_get_os_boottime_us();
   }
 
-  std::vector<uint8_t> data(p_buf, p_buf + bytes_read);
+  pcm_data.resize(bytes_read);
 
   if (localAudioReceiver != nullptr) {
-    localAudioReceiver->OnAudioDataReady(data);
+    localAudioReceiver->OnAudioDataReady(pcm_data);
   }
 }
 
@@ -0,0 +1,140 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include "hearing_aid_scheduler.h"
+
+#include <algorithm>
+
+void HearingAidScheduler::Reset() {
+  for (Side& side : sides_) {
+    side.scheduled = false;
+    side.frames_ahead = 0;
+    side.stats.Reset();
+  }
+  tick_start_us_ = 0;
+  tick_count_ = 0;
+  overrun_count_ = 0;
+  tick_total_us_ = 0;
+  tick_max_us_ = 0;
+  skew_count_ = 0;
+  skew_total_us_ = 0;
+  skew_max_us_ = 0;
+}
+
+void HearingAidScheduler::OnTickStart(uint64_t now_us) {
+  tick_start_us_ = now_us;
+  for (Side& side : sides_) side.scheduled = false;
+}
+
+void HearingAidScheduler::Schedule(const bool active[HA_SIDE_MAX],
+                                   const uint16_t queued_packets[HA_SIDE_MAX],
+                                   uint16_t packets_per_frame,
+                                   uint16_t packets_to_flush[HA_SIDE_MAX]) {
+  if (packets_per_frame == 0) packets_per_frame = 1;
+
+  // Whole frames left queued to each side, within the latency budget. A
+  // frame partly sent counts as a frame.
+  uint16_t queued_frames[HA_SIDE_MAX];
+  uint16_t keep[HA_SIDE_MAX];
+  uint16_t min_keep = max_queued_frames_;
+  for (int i = 0; i < HA_SIDE_MAX; i++) {
+    queued_frames[i] =
+        (queued_packets[i] + packets_per_frame - 1) / packets_per_frame;
+    keep[i] = std::min<uint16_t>(queued_frames[i], max_queued_frames_ - 1);
+    if (active[i]) min_keep = std::min(min_keep, keep[i]);
+  }
+
+  for (int i = 0; i < HA_SIDE_MAX; i++) {
+    Side& side = sides_[i];
+    packets_to_flush[i] = 0;
+    side.scheduled = active[i];
+    if (!active[i]) continue;
+
+    // Not further ahead of the other side than the skew allows
+    keep[i] = std::min<uint16_t>(keep[i], min_keep + max_skew_frames_);
+    side.frames_ahead = keep[i];
+
+    // The packets beyond the ones of the newest frames kept are the oldest
+    uint32_t keep_packets = (uint32_t)keep[i] * packets_per_frame;
+    if (queued_packets[i] > keep_packets) {
+      packets_to_flush[i] = queued_packets[i] - keep_packets;
+      side.stats.packets_flushed += packets_to_flush[i];
+      side.stats.frames_flushed += queued_frames[i] - keep[i];
+    }
+  }
+}
+
+void HearingAidScheduler::OnTickEnd(uint64_t now_us,
+                                    uint32_t conn_interval_us) {
+  uint64_t tick_us = now_us > tick_start_us_ ? now_us - tick_start_us_ : 0;
+  tick_count_++;
+  tick_total_us_ += tick_us;
+  tick_max_us_ = std::max(tick_max_us_, tick_us);
+  if (conn_interval_us != 0 && tick_us > conn_interval_us) overrun_count_++;
+
+  uint64_t latency_us[HA_SIDE_MAX];
+  for (int i = 0; i < HA_SIDE_MAX; i++) {
+    Side& side = sides_[i];
+    if (!side.scheduled) continue;
+
+    latency_us[i] = tick_us + (uint64_t)side.frames_ahead * conn_interval_us;
+    side.stats.frames_queued++;
+    side.stats.latency_total_us += latency_us[i];
+    side.stats.latency_max_us =
+        std::max(side.stats.latency_max_us, latency_us[i]);
+    side.stats.latency_last_us = latency_us[i];
+  }
+
+  // The same frame, with the same sequence number, sent to both sides
+  if (sides_[HA_SIDE_LEFT].scheduled && sides_[HA_SIDE_RIGHT].scheduled) {
+    uint64_t left_us = latency_us[HA_SIDE_LEFT];
+    uint64_t right_us = latency_us[HA_SIDE_RIGHT];
+    uint64_t skew_us = left_us > right_us ? left_us - right_us
+                                          : right_us - left_us;
+    skew_count_++;
+    skew_total_us_ += skew_us;
+    skew_max_us_ = std::max(skew_max_us_, skew_us);
+  }
+}
+
+void HearingAidScheduler::Dump(std::stringstream& stream) const {
+  static const char* side_names[HA_SIDE_MAX] = {"Left", "Right"};
+
+  stream << "  Hearing Aid Scheduler:"
+         << "\n    Ticks (total/over connection interval)                  : "
+         << tick_count_ << " / " << overrun_count_
+         << "\n    Tick time in us (avg/max)                               : "
+         << (tick_count_ ? tick_total_us_ / tick_count_ : 0) << " / "
+         << tick_max_us_;
+  for (int i = 0; i < HA_SIDE_MAX; i++) {
+    const HearingAidSideStats& stats = sides_[i].stats;
+    stream << "\n    " << side_names[i]
+           << "\n      Frame counts (queued/flushed)                         : "
+           << stats.frames_queued << " / " << stats.frames_flushed
+           << "\n      Packets flushed                                       : "
+           << stats.packets_flushed
+           << "\n      Latency in us (avg/max/last)                          : "
+           << (stats.frames_queued
+                   ? stats.latency_total_us / stats.frames_queued
+                   : 0)
+           << " / " << stats.latency_max_us << " / " << stats.latency_last_us;
+  }
+  stream << "\n    Skew between sides in us (avg/max)                      : "
+         << (skew_count_ ? skew_total_us_ / skew_count_ : 0) << " / "
+         << skew_max_us_ << std::endl;
+}
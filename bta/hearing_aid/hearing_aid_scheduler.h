@@ -0,0 +1,131 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#pragma once
+
+#include <stdint.h>
+
+#include <sstream>
+
+// Side of a binaural pair of hearing aids
+enum HearingAidSide { HA_SIDE_LEFT = 0, HA_SIDE_RIGHT = 1, HA_SIDE_MAX = 2 };
+
+// Frames left queued to a side when a new one is queued, the new one
+// included. This matches the two buffers ADD_RENDER_DELAY_INTERVALS assumes.
+constexpr uint16_t HA_MAX_QUEUED_FRAMES = 2;
+// Frames queued to one side beyond the ones queued to the other side
+constexpr uint16_t HA_MAX_SKEW_FRAMES = 1;
+
+struct HearingAidSideStats {
+  size_t frames_queued;
+  size_t frames_flushed;
+  size_t packets_flushed;
+  // Estimated time from the start of a tick until the frame it queued is
+  // sent: the time spent encoding and queueing the frame, plus a connection
+  // interval for each frame queued ahead of it
+  uint64_t latency_total_us;
+  uint64_t latency_max_us;
+  uint64_t latency_last_us;
+
+  HearingAidSideStats() { Reset(); }
+
+  void Reset() {
+    frames_queued = 0;
+    frames_flushed = 0;
+    packets_flushed = 0;
+    latency_total_us = 0;
+    latency_max_us = 0;
+    latency_last_us = 0;
+  }
+};
+
+/**
+ * Schedules the audio frames sent to a pair of hearing aids, each tick of
+ * the audio data interval.
+ *
+ * Rather than flushing every packet still queued to a side when a new frame
+ * is ready, it flushes only the oldest frames beyond |max_queued_frames|,
+ * so that a frame delayed by a lost connection event may still go out in
+ * the next one. It keeps the frames queued to the two sides within
+ * |max_skew_frames| of each other, so that a frame, sent with the same
+ * sequence number to both sides, reaches them at most |max_skew_frames|
+ * connection events apart.
+ *
+ * Each tick is timed against the negotiated connection interval: a tick
+ * which takes longer to encode and queue the frames than the interval
+ * delays the next connection event's frame.
+ */
+class HearingAidScheduler {
+ public:
+  HearingAidScheduler(uint16_t max_queued_frames = HA_MAX_QUEUED_FRAMES,
+                      uint16_t max_skew_frames = HA_MAX_SKEW_FRAMES)
+      : max_queued_frames_(max_queued_frames ? max_queued_frames : 1),
+        max_skew_frames_(max_skew_frames) {
+    Reset();
+  }
+
+  // Resets the statistics, when the audio starts
+  void Reset();
+
+  // Starts a tick at |now_us|, when a frame is ready to be encoded
+  void OnTickStart(uint64_t now_us);
+
+  // Returns the number of the oldest packets to flush from each side, which
+  // has |queued_packets| packets still queued, before queueing the new
+  // frame of |packets_per_frame| packets. |active| tells which sides the
+  // frame is sent to.
+  void Schedule(const bool active[HA_SIDE_MAX],
+                const uint16_t queued_packets[HA_SIDE_MAX],
+                uint16_t packets_per_frame,
+                uint16_t packets_to_flush[HA_SIDE_MAX]);
+
+  // Ends the tick at |now_us|, once the frame is queued to the sides
+  // scheduled. |conn_interval_us| is the negotiated connection interval.
+  void OnTickEnd(uint64_t now_us, uint32_t conn_interval_us);
+
+  const HearingAidSideStats& side_stats(HearingAidSide side) const {
+    return sides_[side].stats;
+  }
+  size_t overrun_count() const { return overrun_count_; }
+  uint64_t skew_max_us() const { return skew_max_us_; }
+
+  void Dump(std::stringstream& stream) const;
+
+ private:
+  struct Side {
+    bool scheduled;
+    // Frames left queued ahead of the new frame
+    uint16_t frames_ahead;
+    HearingAidSideStats stats;
+  };
+
+  const uint16_t max_queued_frames_;
+  const uint16_t max_skew_frames_;
+
+  Side sides_[HA_SIDE_MAX];
+  uint64_t tick_start_us_;
+
+  size_t tick_count_;
+  size_t overrun_count_;
+  uint64_t tick_total_us_;
+  uint64_t tick_max_us_;
+
+  size_t skew_count_;
+  uint64_t skew_total_us_;
+  uint64_t skew_max_us_;
+};
@@ -27,6 +27,7 @@
 
 #include <hardware/bt_common_types.h>
 #include <memory>
+#include <vector>
 #include "bt_target.h"
 #include "bt_types.h"
 #include "btm_api.h"
@@ -1636,6 +1637,38 @@ extern void BTA_DmAddBleKey(const RawAddress& bd_addr,
                             tBTA_LE_KEY_VALUE* p_le_key,
                             tBTA_LE_KEY_TYPE key_type);
 
+/* Security information of a bonded device, restored from the NVRAM */
+typedef struct {
+  RawAddress bd_addr;
+  bool link_key_known;
+  LinkKey link_key;
+  uint8_t key_type;
+  uint8_t pin_length;
+  bool dc_known;
+  DEV_CLASS dc;
+  bool is_ble;
+  tBLE_ADDR_TYPE addr_type;
+  std::vector<std::pair<tBTA_LE_KEY_TYPE, tBTA_LE_KEY_VALUE>> ble_keys;
+} tBTA_DM_BONDED_DEVICE;
+
+/*******************************************************************************
+ *
+ * Function         BTA_DmAddBondedDevices
+ *
+ * Description      Add the security information of all the bonded devices at
+ *                  once. This is the same as calling BTA_DmAddDevice(),
+ *                  BTA_DmAddBleDevice() and BTA_DmAddBleKey() for each of
+ *                  them, in a single message to the BTA thread. It is called
+ *                  during host startup to restore the devices stored in the
+ *                  NVRAM.
+ *
+ * Parameters:      devices          - the bonded devices.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+extern void BTA_DmAddBondedDevices(std::vector<tBTA_DM_BONDED_DEVICE> devices);
+
 /*******************************************************************************
  *
  * Function         BTA_DmSetBlePrefConnParams
@@ -29,4 +29,7 @@
 // Brings connection to active mode
 void bta_dm_pm_active(const RawAddress& peer_addr);
 
+// Dumps the recent decisions of the traffic-aware power mode policy
+void bta_dm_pm_policy_dump(int fd);
+
 #endif /* BTA_DM_API_H */
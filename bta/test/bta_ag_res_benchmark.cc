@@ -0,0 +1,213 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <benchmark/benchmark.h>
+#include <string.h>
+
+#include <vector>
+
+#include "bta/ag/bta_ag_res.h"
+
+using ::benchmark::Counter;
+using ::benchmark::State;
+
+namespace {
+
+/* BTA_AG_AT_MAX_LEN */
+constexpr size_t kAtMaxLen = 256;
+/* RFCOMM UIH header and FCS, L2CAP and ACL headers of each write */
+constexpr size_t kHeadersLen = 4 + 1 + 4 + 4;
+
+enum ResultType { RES_CIEV, RES_INT, RES_STR, RES_IDLE };
+
+/* A result code sent to the hands-free, or the end of a burst of them,
+ * when the coalescing timer expires */
+struct Result {
+  ResultType type;
+  const char* result_string;
+  const char* str_arg;
+  uint16_t id;
+  uint16_t value;
+};
+
+/* An incoming call, answered by the hands-free: the indicators of each
+ * call state change, rings with the caller id and the network indicators
+ * changing meanwhile */
+const std::vector<Result> kCallSetupBurst = {
+    {RES_CIEV, "+CIEV: ", nullptr, 3, 1}, /* callsetup incoming */
+    {RES_CIEV, "+CIEV: ", nullptr, 5, 4}, /* signal */
+    {RES_IDLE},
+    {RES_STR, "RING", nullptr},
+    {RES_STR, "+CLIP: ", "\"5551234567\",129"},
+    {RES_CIEV, "+CIEV: ", nullptr, 7, 3}, /* battchg */
+    {RES_IDLE},
+    {RES_STR, "RING", nullptr},
+    {RES_STR, "+CLIP: ", "\"5551234567\",129"},
+    {RES_STR, "OK", nullptr},             /* ATA */
+    {RES_CIEV, "+CIEV: ", nullptr, 2, 1}, /* call active */
+    {RES_CIEV, "+CIEV: ", nullptr, 3, 0}, /* callsetup none */
+    {RES_CIEV, "+CIEV: ", nullptr, 5, 5}, /* signal */
+    {RES_CIEV, "+CIEV: ", nullptr, 1, 1}, /* service */
+    {RES_IDLE},
+    {RES_INT, "+VGS: ", nullptr, 0, 9},
+    {RES_INT, "+BCS: ", nullptr, 0, 2},
+    {RES_IDLE},
+};
+
+/* The RFCOMM writes of a burst */
+struct Writes {
+  size_t frames = 0;
+  size_t results = 0;
+  size_t air_bytes = 0;
+  char last[BTA_AG_RES_BATCH_SIZE];
+
+  void Write(const char* p_buf, uint16_t len) {
+    memcpy(last, p_buf, len);
+    benchmark::DoNotOptimize(last);
+    frames++;
+    air_bytes += len + kHeadersLen;
+  }
+};
+
+uint16_t Itoa(uint16_t i, char* p) {
+  char* p_start = p;
+  bool started = false;
+  for (uint16_t j = 10000; j > 0; j /= 10) {
+    uint16_t digit = i / j;
+    i %= j;
+    if (digit || started || j == 1) {
+      *p++ = '0' + digit;
+      started = true;
+    }
+  }
+  *p = 0;
+  return p - p_start;
+}
+
+/* The result built as before: the buffer cleared, the result string
+ * copied, the CIEV argument formatted as a string, then written */
+void SendBefore(Writes& writes, const Result& res) {
+  char buf[kAtMaxLen + 16];
+  char* p = buf;
+  memset(buf, 0, sizeof(buf));
+
+  *p++ = '\r';
+  *p++ = '\n';
+  strncpy(p, res.result_string, sizeof(buf) - 2);
+  p += strlen(res.result_string);
+
+  if (res.type == RES_CIEV) {
+    char str[12];
+    char* p_str = str;
+    p_str += Itoa(res.id, p_str);
+    *p_str++ = ',';
+    Itoa(res.value, p_str);
+    strcpy(p, str);
+    p += strlen(str);
+  } else if (res.type == RES_INT) {
+    p += Itoa(res.value, p);
+  } else if (res.str_arg) {
+    strcpy(p, res.str_arg);
+    p += strlen(res.str_arg);
+  }
+
+  *p++ = '\r';
+  *p++ = '\n';
+  writes.Write(buf, p - buf);
+  writes.results++;
+}
+
+void Flush(Writes& writes, tBTA_AG_RES_BATCH& batch) {
+  if (batch.len == 0) return;
+  writes.Write(batch.data, batch.len);
+  batch.len = 0;
+  batch.num_results = 0;
+}
+
+/* The result built from its template into the batch: the CIEVs held back
+ * until the burst ends, any other result written at once after them */
+void SendCoalesced(Writes& writes, tBTA_AG_RES_BATCH& batch,
+                   const tBTA_AG_RES_TMPL& tmpl, const Result& res) {
+  if (res.type == RES_IDLE) {
+    Flush(writes, batch);
+    return;
+  }
+
+  char* p = &batch.data[batch.len];
+  uint16_t size = BTA_AG_RES_BATCH_SIZE - batch.len;
+  uint16_t len =
+      res.type == RES_CIEV
+          ? bta_ag_res_build_ciev(p, size, res.id, res.value)
+          : bta_ag_res_build(p, size, &tmpl, res.str_arg, res.value);
+  batch.len += len;
+  batch.num_results++;
+  writes.results++;
+  if (res.type != RES_CIEV) Flush(writes, batch);
+}
+
+void ReportWrites(State& state, const Writes& writes) {
+  state.counters["results"] = writes.results;
+  state.counters["frames"] = writes.frames;
+  state.counters["frames/result"] = (double)writes.frames / writes.results;
+  state.counters["air_bytes"] = writes.air_bytes;
+  state.counters["bursts/s"] =
+      Counter((double)state.iterations(), Counter::kIsRate);
+}
+
+}  // namespace
+
+/* Each result built from scratch and written by itself, as before */
+static void BM_CallSetupBurstBefore(State& state) {
+  Writes writes;
+  while (state.KeepRunning()) {
+    writes = Writes();
+    for (const Result& res : kCallSetupBurst) {
+      if (res.type != RES_IDLE) SendBefore(writes, res);
+    }
+  }
+  ReportWrites(state, writes);
+}
+BENCHMARK(BM_CallSetupBurstBefore);
+
+/* Each result built from its precompiled template, the CIEVs of a burst
+ * coalesced into one write */
+static void BM_CallSetupBurstCoalesced(State& state) {
+  std::vector<tBTA_AG_RES_TMPL> tmpls(kCallSetupBurst.size());
+  for (size_t i = 0; i < kCallSetupBurst.size(); i++) {
+    const Result& res = kCallSetupBurst[i];
+    if (res.type == RES_IDLE) continue;
+    uint8_t arg_type = BTA_AG_RES_FMT_NONE;
+    if (res.type == RES_INT)
+      arg_type = BTA_AG_RES_FMT_INT;
+    else if (res.str_arg)
+      arg_type = BTA_AG_RES_FMT_STR;
+    bta_ag_res_tmpl_init(&tmpls[i], res.result_string, arg_type);
+  }
+
+  Writes writes;
+  tBTA_AG_RES_BATCH batch = {};
+  while (state.KeepRunning()) {
+    writes = Writes();
+    for (size_t i = 0; i < kCallSetupBurst.size(); i++)
+      SendCoalesced(writes, batch, tmpls[i], kCallSetupBurst[i]);
+  }
+  ReportWrites(state, writes);
+}
+BENCHMARK(BM_CallSetupBurstCoalesced);
+
+BENCHMARK_MAIN();
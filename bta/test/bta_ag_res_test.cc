@@ -0,0 +1,79 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "bta/ag/bta_ag_res.h"
+
+namespace {
+
+std::string Build(const char* result_string, uint8_t arg_type,
+                  const char* p_arg, int16_t int_arg) {
+  tBTA_AG_RES_TMPL tmpl;
+  bta_ag_res_tmpl_init(&tmpl, result_string, arg_type);
+  char buf[BTA_AG_RES_BATCH_SIZE];
+  uint16_t len = bta_ag_res_build(buf, sizeof(buf), &tmpl, p_arg, int_arg);
+  return std::string(buf, len);
+}
+
+std::string BuildCiev(uint16_t id, uint16_t value) {
+  char buf[BTA_AG_RES_BATCH_SIZE];
+  uint16_t len = bta_ag_res_build_ciev(buf, sizeof(buf), id, value);
+  return std::string(buf, len);
+}
+
+}  // namespace
+
+TEST(BtaAgResTest, test_build) {
+  EXPECT_EQ("\r\nOK\r\n", Build("OK", BTA_AG_RES_FMT_NONE, nullptr, 0));
+  EXPECT_EQ("\r\n+VGS: 0\r\n", Build("+VGS: ", BTA_AG_RES_FMT_INT, nullptr, 0));
+  EXPECT_EQ("\r\n+BRSF: 4095\r\n",
+            Build("+BRSF: ", BTA_AG_RES_FMT_INT, nullptr, 4095));
+  EXPECT_EQ("\r\n+CLIP: \"5551234\",129\r\n",
+            Build("+CLIP: ", BTA_AG_RES_FMT_STR, "\"5551234\",129", 0));
+  EXPECT_EQ("\r\n+CIND: \r\n",
+            Build("+CIND: ", BTA_AG_RES_FMT_STR, nullptr, 0));
+}
+
+TEST(BtaAgResTest, test_build_no_room) {
+  tBTA_AG_RES_TMPL tmpl;
+  bta_ag_res_tmpl_init(&tmpl, "+CLIP: ", BTA_AG_RES_FMT_STR);
+  char buf[16];
+  EXPECT_EQ(0, bta_ag_res_build(buf, sizeof(buf), &tmpl, "\"5551234\",129", 0));
+  EXPECT_EQ(0, bta_ag_res_build_ciev(buf, 13, 1, 1));
+}
+
+TEST(BtaAgResTest, test_build_ciev) {
+  EXPECT_EQ("\r\n+CIEV: 3,1\r\n", BuildCiev(3, 1));
+  EXPECT_EQ("\r\n+CIEV: 7,0\r\n", BuildCiev(7, 0));
+  EXPECT_EQ("\r\n+CIEV: 12,345\r\n", BuildCiev(12, 345));
+}
+
+TEST(BtaAgResTest, test_batch) {
+  tBTA_AG_RES_BATCH batch = {};
+  for (uint16_t id = 1; id <= 7; id++) {
+    batch.len += bta_ag_res_build_ciev(&batch.data[batch.len],
+                                       sizeof(batch.data) - batch.len, id, 1);
+    batch.num_results++;
+  }
+  EXPECT_EQ(7 * 14, batch.len);
+  EXPECT_EQ("\r\n+CIEV: 1,1\r\n\r\n+CIEV: 2,1\r\n",
+            std::string(batch.data, 28));
+}
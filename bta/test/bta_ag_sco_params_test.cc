@@ -0,0 +1,285 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <set>
+
+#include "bta/ag/bta_ag_sco_params.h"
+
+namespace {
+
+// A failed eSCO setup attempt, until the link supervision of the attempt
+// gives up, and an accepted one
+constexpr uint32_t kRejectedMs = 300;
+constexpr uint32_t kAcceptedMs = 60;
+
+const RawAddress kPeer1({0x00, 0x11, 0x22, 0x33, 0x44, 0x55});
+const RawAddress kPeer2({0x00, 0x11, 0x22, 0x33, 0x44, 0x66});
+
+// A headset rejecting some eSCO parameter sets
+struct Peer {
+  RawAddress addr;
+  std::set<uint8_t> rejected;
+};
+
+// Sets up call audio with |peer| as the AG does, returns the attempts it
+// took
+uint8_t SetUpCall(tBTA_AG_SCO_PARAMS_CACHE* cache,
+                  tBTA_AG_SCO_SETUP_STATS* stats, const Peer& peer,
+                  uint8_t preferred) {
+  tBTA_AG_SCO_SETUP setup = {};
+  uint64_t now_ms = 1000;
+
+  bta_ag_sco_setup_start(&setup, now_ms);
+  uint8_t setting = bta_ag_sco_params_first(cache, peer.addr, preferred);
+  bta_ag_sco_setup_attempt(&setup, now_ms);
+  while (peer.rejected.count(setting)) {
+    now_ms += kRejectedMs;
+    setting = bta_ag_sco_params_next(setting);
+    bta_ag_sco_setup_attempt(&setup, now_ms);
+  }
+  now_ms += kAcceptedMs;
+  uint8_t attempts = setup.attempts;
+  bta_ag_sco_setup_end(&setup, cache, stats, peer.addr, setting, true,
+                       now_ms);
+  EXPECT_EQ(0u, setup.start_ms);
+  return attempts;
+}
+
+}  // namespace
+
+TEST(BtaAgScoParamsTest, test_nothing_cached) {
+  tBTA_AG_SCO_PARAMS_CACHE cache = {};
+  uint8_t setting;
+
+  EXPECT_FALSE(bta_ag_sco_params_get(&cache, kPeer1, &setting));
+  EXPECT_EQ(ESCO_CODEC_MSBC_T2,
+            bta_ag_sco_params_first(&cache, kPeer1, ESCO_CODEC_MSBC_T2));
+}
+
+TEST(BtaAgScoParamsTest, test_put) {
+  tBTA_AG_SCO_PARAMS_CACHE cache = {};
+  uint8_t setting;
+
+  EXPECT_TRUE(bta_ag_sco_params_put(&cache, kPeer1, ESCO_CODEC_MSBC_T1));
+  EXPECT_FALSE(bta_ag_sco_params_put(&cache, kPeer1, ESCO_CODEC_MSBC_T1));
+  EXPECT_TRUE(bta_ag_sco_params_get(&cache, kPeer1, &setting));
+  EXPECT_EQ(ESCO_CODEC_MSBC_T1, setting);
+  EXPECT_FALSE(bta_ag_sco_params_get(&cache, kPeer2, &setting));
+
+  EXPECT_TRUE(bta_ag_sco_params_put(&cache, kPeer1, ESCO_CODEC_CVSD));
+  EXPECT_TRUE(bta_ag_sco_params_get(&cache, kPeer1, &setting));
+  EXPECT_EQ(ESCO_CODEC_CVSD, setting);
+}
+
+TEST(BtaAgScoParamsTest, test_least_recently_used_replaced) {
+  tBTA_AG_SCO_PARAMS_CACHE cache = {};
+  uint8_t setting;
+
+  for (int i = 0; i < BTA_AG_SCO_PARAMS_CACHE_SIZE; i++) {
+    RawAddress addr = kPeer1;
+    addr.address[5] = i;
+    bta_ag_sco_params_put(&cache, addr, ESCO_CODEC_MSBC_T1);
+  }
+  // The first peer used again, the second one is the least recently used
+  RawAddress first = kPeer1;
+  first.address[5] = 0;
+  bta_ag_sco_params_first(&cache, first, ESCO_CODEC_MSBC_T2);
+  bta_ag_sco_params_put(&cache, kPeer2, ESCO_CODEC_CVSD);
+
+  RawAddress second = kPeer1;
+  second.address[5] = 1;
+  EXPECT_TRUE(bta_ag_sco_params_get(&cache, first, &setting));
+  EXPECT_FALSE(bta_ag_sco_params_get(&cache, second, &setting));
+  EXPECT_TRUE(bta_ag_sco_params_get(&cache, kPeer2, &setting));
+}
+
+TEST(BtaAgScoParamsTest, test_other_codec_not_used) {
+  tBTA_AG_SCO_PARAMS_CACHE cache = {};
+
+  // mSBC T1 accepted, but CVSD is preferred now: T1 is not on its fallback
+  bta_ag_sco_params_put(&cache, kPeer1, ESCO_CODEC_MSBC_T1);
+  EXPECT_EQ(ESCO_CODEC_CVSD,
+            bta_ag_sco_params_first(&cache, kPeer1, ESCO_CODEC_CVSD));
+}
+
+// A headset rejecting mSBC T2: without the cache each call costs a
+// rejected attempt, with it only the first call and the calls the
+// preferred set is tried again.
+TEST(BtaAgScoParamsTest, test_peer_rejecting_msbc_t2) {
+  const int kNumCalls = 100;
+  Peer peer = {kPeer1, {ESCO_CODEC_MSBC_T2}};
+  tBTA_AG_SCO_PARAMS_CACHE cache = {};
+  tBTA_AG_SCO_SETUP_STATS stats = {};
+
+  EXPECT_EQ(2, SetUpCall(&cache, &stats, peer, ESCO_CODEC_MSBC_T2));
+  int rejected = 0;
+  for (int call = 1; call < kNumCalls; call++)
+    rejected += SetUpCall(&cache, &stats, peer, ESCO_CODEC_MSBC_T2) - 1;
+
+  EXPECT_EQ((kNumCalls - 1) / (BTA_AG_SCO_PARAMS_MAX_REUSE + 1), rejected);
+  EXPECT_EQ((uint32_t)kNumCalls, stats.count);
+  EXPECT_EQ(kNumCalls + 1 + rejected, (int)stats.attempts);
+  EXPECT_EQ(kRejectedMs + kAcceptedMs, stats.max_ms);
+  // Most calls set up within 100 ms, the others within 400 ms
+  EXPECT_EQ(kNumCalls - 1 - rejected, (int)stats.bucket[0]);
+  EXPECT_EQ(1 + rejected, (int)stats.bucket[2]);
+  EXPECT_EQ(0u, stats.bucket[BTA_AG_SCO_SETUP_NUM_BUCKETS - 1]);
+}
+
+// A headset rejecting mSBC altogether, then updated to accept it: the
+// preferred set is tried again and cached once accepted.
+TEST(BtaAgScoParamsTest, test_peer_accepting_again) {
+  Peer peer = {kPeer1, {ESCO_CODEC_MSBC_T2, ESCO_CODEC_MSBC_T1}};
+  tBTA_AG_SCO_PARAMS_CACHE cache = {};
+  tBTA_AG_SCO_SETUP_STATS stats = {};
+  uint8_t setting;
+
+  EXPECT_EQ(3, SetUpCall(&cache, &stats, peer, ESCO_CODEC_MSBC_T2));
+  EXPECT_TRUE(bta_ag_sco_params_get(&cache, kPeer1, &setting));
+  EXPECT_EQ(ESCO_CODEC_CVSD, setting);
+  EXPECT_EQ(1, SetUpCall(&cache, &stats, peer, ESCO_CODEC_MSBC_T2));
+
+  peer.rejected.clear();
+  int calls = 0;
+  do {
+    SetUpCall(&cache, &stats, peer, ESCO_CODEC_MSBC_T2);
+    calls++;
+    EXPECT_TRUE(bta_ag_sco_params_get(&cache, kPeer1, &setting));
+  } while (setting != ESCO_CODEC_MSBC_T2 &&
+           calls <= BTA_AG_SCO_PARAMS_MAX_REUSE + 1);
+  EXPECT_EQ(ESCO_CODEC_MSBC_T2, setting);
+
+  // The other headset is not affected
+  Peer other = {kPeer2, {}};
+  EXPECT_EQ(1, SetUpCall(&cache, &stats, other, ESCO_CODEC_MSBC_T2));
+  EXPECT_TRUE(bta_ag_sco_params_get(&cache, kPeer2, &setting));
+  EXPECT_EQ(ESCO_CODEC_MSBC_T2, setting);
+}
+
+TEST(BtaAgScoParamsTest, test_fallback) {
+  EXPECT_EQ(ESCO_CODEC_MSBC_T1, bta_ag_sco_params_next(ESCO_CODEC_MSBC_T2));
+  EXPECT_EQ(ESCO_CODEC_CVSD, bta_ag_sco_params_next(ESCO_CODEC_MSBC_T1));
+  EXPECT_EQ(ESCO_CODEC_CVSD, bta_ag_sco_params_next(ESCO_CODEC_CVSD));
+}
+
+TEST(BtaAgScoParamsTest, test_setup_cached) {
+  tBTA_AG_SCO_PARAMS_CACHE cache = {};
+  tBTA_AG_SCO_SETUP_STATS stats = {};
+  tBTA_AG_SCO_SETUP setup = {};
+  uint8_t setting;
+
+  // Codec negotiation starts the setup, create_sco does not restart it
+  bta_ag_sco_setup_start(&setup, 1000);
+  bta_ag_sco_setup_attempt(&setup, 1050);
+  bta_ag_sco_setup_attempt(&setup, 1350);
+  EXPECT_EQ(1000u, setup.start_ms);
+  EXPECT_EQ(2, setup.attempts);
+
+  EXPECT_TRUE(bta_ag_sco_setup_end(&setup, &cache, &stats, kPeer1,
+                                   ESCO_CODEC_MSBC_T1, true, 1400));
+  EXPECT_EQ(0u, setup.start_ms);
+  EXPECT_EQ(0, setup.attempts);
+  EXPECT_EQ(1u, stats.count);
+  EXPECT_EQ(2u, stats.attempts);
+  EXPECT_EQ(400u, stats.max_ms);
+  EXPECT_TRUE(bta_ag_sco_params_get(&cache, kPeer1, &setting));
+  EXPECT_EQ(ESCO_CODEC_MSBC_T1, setting);
+
+  // The next call starts with the set accepted, nothing new to persist
+  EXPECT_EQ(ESCO_CODEC_MSBC_T1,
+            bta_ag_sco_params_first(&cache, kPeer1, ESCO_CODEC_MSBC_T2));
+  bta_ag_sco_setup_attempt(&setup, 2000);
+  EXPECT_FALSE(bta_ag_sco_setup_end(&setup, &cache, &stats, kPeer1,
+                                    ESCO_CODEC_MSBC_T1, true, 2050));
+  EXPECT_EQ(2u, stats.count);
+}
+
+TEST(BtaAgScoParamsTest, test_setup_not_cached) {
+  tBTA_AG_SCO_PARAMS_CACHE cache = {};
+  tBTA_AG_SCO_SETUP_STATS stats = {};
+  tBTA_AG_SCO_SETUP setup = {};
+  uint8_t setting;
+
+  // Failed: counted, not cached
+  bta_ag_sco_setup_attempt(&setup, 1000);
+  EXPECT_FALSE(bta_ag_sco_setup_end(&setup, &cache, &stats, kPeer1,
+                                    ESCO_CODEC_MSBC_T2, false, 1300));
+  EXPECT_EQ(1u, stats.fail_count);
+  EXPECT_EQ(0, setup.attempts);
+
+  // Set up by the peer: neither counted nor cached
+  bta_ag_sco_setup_start(&setup, 2000);
+  EXPECT_FALSE(bta_ag_sco_setup_end(&setup, &cache, &stats, kPeer1,
+                                    ESCO_CODEC_MSBC_T2, true, 2050));
+  EXPECT_EQ(0u, setup.start_ms);
+
+  // Reset by a shutdown or a connection not attempted: a later connection
+  // opening is not counted
+  bta_ag_sco_setup_attempt(&setup, 3000);
+  bta_ag_sco_setup_reset(&setup);
+  EXPECT_FALSE(bta_ag_sco_setup_end(&setup, &cache, &stats, kPeer1,
+                                    ESCO_CODEC_MSBC_T2, true, 3050));
+  EXPECT_FALSE(bta_ag_sco_setup_end(&setup, &cache, &stats, kPeer1,
+                                    ESCO_CODEC_MSBC_T2, false, 3050));
+
+  EXPECT_EQ(0u, stats.count);
+  EXPECT_EQ(1u, stats.fail_count);
+  EXPECT_FALSE(bta_ag_sco_params_get(&cache, kPeer1, &setting));
+}
+
+// +BCS is skipped only when the codec it would select is the one the peer
+// last confirmed
+TEST(BtaAgScoParamsTest, test_codec_agreed) {
+  EXPECT_TRUE(bta_ag_sco_params_codec_agreed(true, false, BTA_AG_CODEC_MSBC,
+                                             BTA_AG_CODEC_MSBC));
+  EXPECT_TRUE(bta_ag_sco_params_codec_agreed(true, false, BTA_AG_CODEC_CVSD,
+                                             BTA_AG_CODEC_CVSD));
+  EXPECT_FALSE(bta_ag_sco_params_codec_agreed(true, false, BTA_AG_CODEC_MSBC,
+                                              BTA_AG_CODEC_CVSD));
+
+  // No codec negotiation, or no codec confirmed yet
+  EXPECT_FALSE(bta_ag_sco_params_codec_agreed(false, false, BTA_AG_CODEC_MSBC,
+                                              BTA_AG_CODEC_MSBC));
+  EXPECT_FALSE(bta_ag_sco_params_codec_agreed(true, false, BTA_AG_CODEC_NONE,
+                                              BTA_AG_CODEC_NONE));
+
+  // After a codec fallback +BCS selects CVSD
+  EXPECT_TRUE(bta_ag_sco_params_codec_agreed(true, true, BTA_AG_CODEC_MSBC,
+                                             BTA_AG_CODEC_CVSD));
+  EXPECT_FALSE(bta_ag_sco_params_codec_agreed(true, true, BTA_AG_CODEC_MSBC,
+                                              BTA_AG_CODEC_MSBC));
+}
+
+TEST(BtaAgScoParamsTest, test_histogram_buckets) {
+  tBTA_AG_SCO_SETUP_STATS stats = {};
+
+  bta_ag_sco_setup_stats_add(&stats, 99, 1);
+  bta_ag_sco_setup_stats_add(&stats, 100, 1);
+  bta_ag_sco_setup_stats_add(&stats, 5000, 3);
+
+  EXPECT_EQ(1u, stats.bucket[0]);
+  EXPECT_EQ(1u, stats.bucket[1]);
+  EXPECT_EQ(1u, stats.bucket[BTA_AG_SCO_SETUP_NUM_BUCKETS - 1]);
+  EXPECT_EQ(5u, stats.attempts);
+  EXPECT_EQ(5000u, stats.max_ms);
+  EXPECT_EQ(100u, bta_ag_sco_setup_stats_bucket_ms(0));
+  EXPECT_EQ(0u, bta_ag_sco_setup_stats_bucket_ms(
+                    BTA_AG_SCO_SETUP_NUM_BUCKETS - 1));
+}
@@ -0,0 +1,256 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <deque>
+#include <map>
+#include <random>
+#include <string>
+
+#include "bta/hearing_aid/hearing_aid_scheduler.h"
+
+namespace {
+
+constexpr uint32_t kIntervalUs = 10000;
+
+// The link to one hearing aid: the packets queued to it, each with the
+// sequence number of its frame, sent at each connection event until one is
+// lost, or until the event is full. Losses come in bursts, as when the head
+// turns away.
+class Link {
+ public:
+  Link(uint32_t seed, uint32_t enter_burst_percent, uint32_t loss_percent,
+       uint16_t packets_per_event)
+      : rng_(seed),
+        packets_per_event_(packets_per_event),
+        enter_burst_percent_(enter_burst_percent),
+        loss_percent_(loss_percent) {}
+
+  uint16_t queued() const { return queue_.size(); }
+  void Flush(uint16_t num) {
+    for (; num && !queue_.empty(); num--) queue_.pop_front();
+  }
+  void Queue(uint32_t seq) { queue_.push_back(seq); }
+
+  // A connection event at |tick|
+  void ConnectionEvent(uint32_t tick) {
+    if (in_burst_)
+      in_burst_ = !Chance(30);
+    else
+      in_burst_ = Chance(enter_burst_percent_);
+
+    for (int i = 0; i < packets_per_event_ && !queue_.empty(); i++) {
+      if (Chance(in_burst_ ? 90 : loss_percent_)) break;
+      uint32_t seq = queue_.front();
+      queue_.pop_front();
+      // The frame is complete once its last packet is sent
+      if (queue_.empty() || queue_.front() != seq) received[seq] = tick;
+    }
+  }
+
+  // Tick at which each frame was received, by sequence number
+  std::map<uint32_t, uint32_t> received;
+
+ private:
+  // Returns true with a probability of |percent| percent
+  bool Chance(uint32_t percent) {
+    return std::uniform_int_distribution<uint32_t>(0, 99)(rng_) < percent;
+  }
+
+  std::mt19937 rng_;
+  uint16_t packets_per_event_;
+  uint32_t enter_burst_percent_;
+  uint32_t loss_percent_;
+  bool in_burst_ = false;
+  std::deque<uint32_t> queue_;
+};
+
+struct Result {
+  size_t received[HA_SIDE_MAX];
+  uint32_t latency_max_ticks[HA_SIDE_MAX];
+  uint32_t skew_max_ticks;
+  bool in_order;
+};
+
+// Streams |num_frames| frames of |packets_per_frame| packets to a left
+// side with bursts of losses and a right side with a few losses, each
+// connection event long enough for two frames. Flushes with |scheduler|,
+// or flushes every packet still queued as before when null.
+Result Simulate(HearingAidScheduler* scheduler, int num_frames,
+                uint16_t packets_per_frame) {
+  uint16_t packets_per_event = 2 * packets_per_frame;
+  Link links[HA_SIDE_MAX] = {Link(1, 5, 5, packets_per_event),
+                             Link(2, 0, 1, packets_per_event)};
+  const bool active[HA_SIDE_MAX] = {true, true};
+
+  for (int tick = 0; tick < num_frames; tick++) {
+    uint16_t queued[HA_SIDE_MAX], to_flush[HA_SIDE_MAX];
+    for (int i = 0; i < HA_SIDE_MAX; i++) queued[i] = links[i].queued();
+
+    uint64_t now_us = (uint64_t)tick * kIntervalUs;
+    if (scheduler) {
+      scheduler->OnTickStart(now_us);
+      scheduler->Schedule(active, queued, packets_per_frame, to_flush);
+    } else {
+      for (int i = 0; i < HA_SIDE_MAX; i++) to_flush[i] = queued[i];
+    }
+    for (int i = 0; i < HA_SIDE_MAX; i++) {
+      links[i].Flush(to_flush[i]);
+      for (uint16_t p = 0; p < packets_per_frame; p++) links[i].Queue(tick);
+    }
+    if (scheduler) scheduler->OnTickEnd(now_us + 500, kIntervalUs);
+
+    for (Link& link : links) link.ConnectionEvent(tick);
+  }
+
+  Result result = {};
+  result.in_order = true;
+  for (int i = 0; i < HA_SIDE_MAX; i++) {
+    result.received[i] = links[i].received.size();
+    uint32_t last_tick = 0;
+    for (const auto& frame : links[i].received) {
+      result.latency_max_ticks[i] =
+          std::max(result.latency_max_ticks[i], frame.second - frame.first);
+      if (frame.second < last_tick) result.in_order = false;
+      last_tick = frame.second;
+    }
+  }
+  for (const auto& frame : links[HA_SIDE_LEFT].received) {
+    auto right = links[HA_SIDE_RIGHT].received.find(frame.first);
+    if (right == links[HA_SIDE_RIGHT].received.end()) continue;
+    uint32_t skew = frame.second > right->second ? frame.second - right->second
+                                                 : right->second - frame.second;
+    result.skew_max_ticks = std::max(result.skew_max_ticks, skew);
+  }
+  return result;
+}
+
+}  // namespace
+
+TEST(HearingAidSchedulerTest, test_nothing_queued) {
+  HearingAidScheduler scheduler;
+  const bool active[HA_SIDE_MAX] = {true, true};
+  const uint16_t queued[HA_SIDE_MAX] = {0, 0};
+  uint16_t to_flush[HA_SIDE_MAX];
+
+  scheduler.OnTickStart(0);
+  scheduler.Schedule(active, queued, 1, to_flush);
+  scheduler.OnTickEnd(1000, kIntervalUs);
+
+  EXPECT_EQ(0, to_flush[HA_SIDE_LEFT]);
+  EXPECT_EQ(0, to_flush[HA_SIDE_RIGHT]);
+  EXPECT_EQ(1u, scheduler.side_stats(HA_SIDE_LEFT).frames_queued);
+  EXPECT_EQ(1000u, scheduler.side_stats(HA_SIDE_LEFT).latency_max_us);
+  EXPECT_EQ(0u, scheduler.skew_max_us());
+}
+
+TEST(HearingAidSchedulerTest, test_oldest_frames_flushed) {
+  HearingAidScheduler scheduler(3, 2);
+  const bool active[HA_SIDE_MAX] = {true, false};
+  // The oldest of the 7 packets belongs to a frame partly sent
+  const uint16_t queued[HA_SIDE_MAX] = {7, 0};
+  uint16_t to_flush[HA_SIDE_MAX];
+
+  scheduler.OnTickStart(0);
+  scheduler.Schedule(active, queued, 2, to_flush);
+  scheduler.OnTickEnd(0, kIntervalUs);
+
+  // The newest 2 frames are left queued
+  EXPECT_EQ(3, to_flush[HA_SIDE_LEFT]);
+  EXPECT_EQ(0, to_flush[HA_SIDE_RIGHT]);
+  EXPECT_EQ(2u, scheduler.side_stats(HA_SIDE_LEFT).frames_flushed);
+  EXPECT_EQ(3u, scheduler.side_stats(HA_SIDE_LEFT).packets_flushed);
+  EXPECT_EQ(2 * kIntervalUs, scheduler.side_stats(HA_SIDE_LEFT).latency_max_us);
+  EXPECT_EQ(0u, scheduler.side_stats(HA_SIDE_RIGHT).frames_queued);
+}
+
+TEST(HearingAidSchedulerTest, test_skew_bounded) {
+  HearingAidScheduler scheduler(4, 1);
+  const bool active[HA_SIDE_MAX] = {true, true};
+  const uint16_t queued[HA_SIDE_MAX] = {3, 0};
+  uint16_t to_flush[HA_SIDE_MAX];
+
+  scheduler.OnTickStart(0);
+  scheduler.Schedule(active, queued, 1, to_flush);
+  scheduler.OnTickEnd(0, kIntervalUs);
+
+  // Within the latency budget, but too far ahead of the right side
+  EXPECT_EQ(2, to_flush[HA_SIDE_LEFT]);
+  EXPECT_EQ(0, to_flush[HA_SIDE_RIGHT]);
+  EXPECT_EQ(kIntervalUs, scheduler.skew_max_us());
+}
+
+TEST(HearingAidSchedulerTest, test_overrun) {
+  HearingAidScheduler scheduler;
+  const bool active[HA_SIDE_MAX] = {true, true};
+  const uint16_t queued[HA_SIDE_MAX] = {0, 0};
+  uint16_t to_flush[HA_SIDE_MAX];
+
+  scheduler.OnTickStart(1000);
+  scheduler.Schedule(active, queued, 1, to_flush);
+  scheduler.OnTickEnd(1000 + kIntervalUs + 1, kIntervalUs);
+
+  EXPECT_EQ(1u, scheduler.overrun_count());
+
+  std::stringstream stream;
+  scheduler.Dump(stream);
+  EXPECT_NE(std::string::npos, stream.str().find("Skew between sides"));
+}
+
+// A left side losing bursts of connection events, a right side losing few:
+// flushing everything still queued loses every frame delayed by a lost
+// event. Flushing the oldest frames beyond the budget delivers them in the
+// next event, in order, within the budget and the skew allowed.
+TEST(HearingAidSchedulerTest, test_asymmetric_link_loss) {
+  const int kNumFrames = 20000;
+
+  for (uint16_t packets_per_frame : {1, 2}) {
+    Result flush_all = Simulate(nullptr, kNumFrames, packets_per_frame);
+    HearingAidScheduler scheduler;
+    Result scheduled = Simulate(&scheduler, kNumFrames, packets_per_frame);
+
+    std::string packets = std::to_string(packets_per_frame) + "_packets_";
+    RecordProperty(packets + "flush_all_received_left",
+                   flush_all.received[HA_SIDE_LEFT]);
+    RecordProperty(packets + "flush_all_received_right",
+                   flush_all.received[HA_SIDE_RIGHT]);
+    RecordProperty(packets + "scheduled_received_left",
+                   scheduled.received[HA_SIDE_LEFT]);
+    RecordProperty(packets + "scheduled_received_right",
+                   scheduled.received[HA_SIDE_RIGHT]);
+
+    EXPECT_GT(scheduled.received[HA_SIDE_LEFT],
+              flush_all.received[HA_SIDE_LEFT]);
+    EXPECT_GE(scheduled.received[HA_SIDE_RIGHT],
+              flush_all.received[HA_SIDE_RIGHT]);
+    // At most two thirds of the frames lost flushing everything are lost
+    EXPECT_LT(3 * (kNumFrames - scheduled.received[HA_SIDE_LEFT]),
+              2 * (kNumFrames - flush_all.received[HA_SIDE_LEFT]));
+
+    EXPECT_TRUE(scheduled.in_order);
+    for (int i = 0; i < HA_SIDE_MAX; i++)
+      EXPECT_LT(scheduled.latency_max_ticks[i], HA_MAX_QUEUED_FRAMES);
+    EXPECT_LE(scheduled.skew_max_ticks, HA_MAX_SKEW_FRAMES);
+
+    // The lossy side is the one flushed
+    EXPECT_GT(scheduler.side_stats(HA_SIDE_LEFT).frames_flushed,
+              5 * scheduler.side_stats(HA_SIDE_RIGHT).frames_flushed);
+    EXPECT_LE(scheduler.skew_max_us(), HA_MAX_SKEW_FRAMES * kIntervalUs);
+  }
+}
@@ -21,11 +21,17 @@
 #include <stdbool.h>
 #include <stddef.h>
 
+#include <string>
+#include <unordered_map>
+#include <vector>
+
 #include "bt_types.h"
+#include "osi/include/config.h"
 
 #define A2DP_VERSION_CONFIG_KEY "A2dpVersion"
 #define AVDTP_VERSION_CONFIG_KEY "AvdtpVersion"
 #define HFP_VERSION_CONFIG_KEY "HfpVersion"
+#define HFP_ESCO_SETTING_CONFIG_KEY "HfpEscoSetting"
 #define AV_REM_CTRL_VERSION_CONFIG_KEY "AvrcpCtVersion"
 #define AV_REM_CTRL_TG_VERSION_CONFIG_KEY "AvrcpTgVersion"
 #define AV_REM_CTRL_FEATURES_CONFIG_KEY "AvrcpFeatures"
@@ -67,6 +73,33 @@ const btif_config_section_iter_t* btif_config_section_next(
     const btif_config_section_iter_t* section);
 const char* btif_config_section_name(const btif_config_section_iter_t* section);
 
+// Copy of the keys of a remote device section.
+typedef struct {
+  RawAddress address;
+  std::unordered_map<std::string, std::string> entries;
+} btif_config_device_t;
+
+// Copies every section named after a device address, with all their keys, in
+// a single pass under the config lock. Lookups in the copies take no lock and
+// do not walk the sections, unlike btif_config_get_*(), which makes them the
+// way to read all the devices at once.
+std::vector<btif_config_device_t> btif_config_get_device_snapshot(void);
+
+// Same as btif_config_get_device_snapshot(), from |config|.
+std::vector<btif_config_device_t> btif_config_snapshot_devices(
+    const config_t* config);
+
+// Same as btif_config_get_int(), btif_config_get_str() and
+// btif_config_get_bin(), from a copy. Keys which are kept in the keystore are
+// read through btif_config_get_bin().
+bool btif_config_device_get_int(const btif_config_device_t& device,
+                                const char* key, int* value);
+const std::string* btif_config_device_get_str(
+    const btif_config_device_t& device, const char* key);
+bool btif_config_device_get_bin(const btif_config_device_t& device,
+                                const char* key, uint8_t* value,
+                                size_t* length);
+
 void btif_config_save(void);
 void btif_config_flush(void);
 bool btif_config_clear(void);
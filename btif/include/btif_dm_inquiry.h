@@ -0,0 +1,64 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/*******************************************************************************
+ *
+ *  Filename:      btif_dm_inquiry.h
+ *
+ *  Description:   Inquiry result parsing and duplicate suppression
+ *
+ ******************************************************************************/
+
+#ifndef BTIF_DM_INQUIRY_H
+#define BTIF_DM_INQUIRY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bt_types.h"
+#include "raw_address.h"
+
+/* Fields of the EIR of an inquiry result, parsed in a single pass */
+typedef struct {
+  BD_NAME name;        /* complete local name, else shortened local name */
+  uint8_t name_len;
+  bool name_found;     /* a local name field is present */
+  bool name_shortened; /* a shortened local name field is present */
+  uint32_t hash;       /* hash of the whole EIR */
+} btif_dm_eir_t;
+
+/* Parses |eir_len| bytes of EIR at |p_eir|, which may be NULL, into
+ * |p_eir_info|. */
+void btif_dm_parse_eir(const uint8_t* p_eir, size_t eir_len,
+                       btif_dm_eir_t* p_eir_info);
+
+/* Returns |hash| updated with the |len| bytes at |data|. Start from
+ * BTIF_DM_HASH_INIT. */
+#define BTIF_DM_HASH_INIT 2166136261u
+uint32_t btif_dm_hash(uint32_t hash, const void* data, size_t len);
+
+/* Forgets the inquiry results seen so far, when an inquiry ends. */
+void btif_dm_inq_filter_reset(void);
+
+/* Returns true if an identical result, with the same |hash|, was already
+ * reported for |bd_addr| during the current inquiry, with an RSSI close to
+ * |rssi|. The result is remembered otherwise. */
+bool btif_dm_inq_filter_is_duplicate(const RawAddress& bd_addr, uint32_t hash,
+                                     int8_t rssi);
+
+#endif
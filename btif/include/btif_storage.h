@@ -24,6 +24,7 @@
 
 #include "bt_target.h"
 #include "bt_types.h"
+#include "btif_config.h"
 
 /*******************************************************************************
  *  Constants & Macros
@@ -201,6 +202,17 @@ bt_status_t btif_storage_is_device_bonded(RawAddress *remote_bd_addr);
  ******************************************************************************/
 bt_status_t btif_storage_load_bonded_devices(void);
 
+/*******************************************************************************
+ *
+ * Function         btif_debug_storage_dump
+ *
+ * Description      Dumps the cost of the last bonded devices load
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+void btif_debug_storage_dump(int fd);
+
 /*******************************************************************************
  *
  * Function         btif_storage_add_hid_device_info
@@ -344,4 +356,10 @@ bool btif_storage_get_stored_remote_name(const RawAddress& bd_addr, char* name);
 size_t btif_split_uuids_string(const char* str, bluetooth::Uuid* p_uuid,
                                size_t max_uuids);
 
+// Reads the name, friendly name, class, type or UUIDs property of a remote
+// device from a copy of its section, the way
+// btif_storage_get_remote_device_property() reads it from the config.
+bool btif_storage_get_snapshot_property(const btif_config_device_t& device,
+                                        bt_property_t* prop);
+
 #endif /* BTIF_STORAGE_H */
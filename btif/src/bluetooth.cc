@@ -53,7 +53,9 @@
 #include <hardware/vendor_socket.h>
 #include <hardware/bt_ba.h>
 #include <hardware/bt_vendor_rc.h>
+#include "ble_advertiser.h"
 #include "bt_utils.h"
+#include "bta/include/bta_dm_api.h"
 #include "bta/include/bta_hearing_aid_api.h"
 #include "bta/include/bta_hf_client_api.h"
 #include "btif/include/btif_debug_btsnoop.h"
@@ -77,8 +79,10 @@
 #include "osi/include/log.h"
 #include "osi/include/metrics.h"
 #include "osi/include/osi.h"
+#include "osi/include/trace_ring.h"
 #include "osi/include/wakelock.h"
 #include "stack/gatt/connection_manager.h"
+#include "stack/include/l2c_api.h"
 #include "stack_manager.h"
 
 
@@ -356,15 +360,20 @@ static void dump(int fd, const char** arguments) {
   btif_debug_bond_event_dump(fd);
   btif_debug_a2dp_dump(fd);
   btif_debug_config_dump(fd);
+  btif_debug_storage_dump(fd);
 #if (BT_IOT_LOGGING_ENABLED == TRUE)
   device_debug_iot_config_dump(fd);
 #endif
   BTA_HfClientDumpStatistics(fd);
+  bta_dm_pm_policy_dump(fd);
   wakelock_debug_dump(fd);
   osi_allocator_debug_dump(fd);
   alarm_debug_dump(fd);
+  trace_ring_debug_dump(fd);
   HearingAid::DebugDump(fd);
   connection_manager::dump(fd);
+  L2CA_Dumpsys(fd);
+  BleAdvertisingManager::DebugDump(fd);
   bluetooth::bqr::DebugDump(fd);
 #if (BTSNOOP_MEM == TRUE)
   btif_debug_btsnoop_dump(fd);
@@ -113,13 +113,10 @@ void bta_scan_results_cb_impl(RawAddress bd_addr, tBT_DEVICE_TYPE device_type,
   bt_device_type_t dev_type;
   bt_property_t properties;
 
-  const uint8_t* p_eir_remote_name = AdvertiseDataParser::GetFieldByType(
-      value, BTM_EIR_COMPLETE_LOCAL_NAME_TYPE, &remote_name_len);
-
-  if (p_eir_remote_name == NULL) {
-    p_eir_remote_name = AdvertiseDataParser::GetFieldByType(
-        value, BT_EIR_SHORTENED_LOCAL_NAME_TYPE, &remote_name_len);
-  }
+  uint8_t remote_name_type;
+  const uint8_t* p_eir_remote_name = AdvertiseDataIndex(value).GetFieldByType(
+      BTM_EIR_COMPLETE_LOCAL_NAME_TYPE, BT_EIR_SHORTENED_LOCAL_NAME_TYPE,
+      &remote_name_len, &remote_name_type);
 
   if ((addr_type != BLE_ADDR_RANDOM) || (p_eir_remote_name)) {
     if (!btif_address_cache_find(bd_addr)) {
@@ -586,6 +586,91 @@ const char* btif_config_section_name(
   return config_section_name((const config_section_node_t*)section);
 }
 
+static bool btif_config_copy_entry(const char* key, const char* value,
+                                   void* context) {
+  btif_config_device_t* device = static_cast<btif_config_device_t*>(context);
+  device->entries.emplace(key, value);
+  return true;
+}
+
+std::vector<btif_config_device_t> btif_config_snapshot_devices(
+    const config_t* conf) {
+  CHECK(conf != NULL);
+
+  std::vector<btif_config_device_t> devices;
+  for (const config_section_node_t* snode = config_section_begin(conf);
+       snode != config_section_end(conf); snode = config_section_next(snode)) {
+    const char* section = config_section_name(snode);
+    if (!RawAddress::IsValidAddress(section)) continue;
+
+    devices.emplace_back();
+    btif_config_device_t& device = devices.back();
+    RawAddress::FromString(section, device.address);
+    config_section_foreach_entry(snode, btif_config_copy_entry, &device);
+  }
+  return devices;
+}
+
+std::vector<btif_config_device_t> btif_config_get_device_snapshot(void) {
+  CHECK(config != NULL);
+
+  std::unique_lock<std::recursive_mutex> lock(config_lock);
+  return btif_config_snapshot_devices(config);
+}
+
+bool btif_config_device_get_int(const btif_config_device_t& device,
+                                const char* key, int* value) {
+  CHECK(key != NULL);
+  CHECK(value != NULL);
+
+  const std::string* stored_value = btif_config_device_get_str(device, key);
+  if (!stored_value) return false;
+
+  // Same as config_get_int(): invalid values leave |value| untouched.
+  char* endptr;
+  int ret = strtol(stored_value->c_str(), &endptr, 0);
+  if (*endptr == '\0') *value = ret;
+  return true;
+}
+
+const std::string* btif_config_device_get_str(
+    const btif_config_device_t& device, const char* key) {
+  CHECK(key != NULL);
+
+  auto entry = device.entries.find(key);
+  return entry != device.entries.end() ? &entry->second : NULL;
+}
+
+bool btif_config_device_get_bin(const btif_config_device_t& device,
+                                const char* key, uint8_t* value,
+                                size_t* length) {
+  CHECK(key != NULL);
+  CHECK(value != NULL);
+  CHECK(length != NULL);
+
+  const std::string* stored_value = btif_config_device_get_str(device, key);
+  if (!stored_value) return false;
+
+  // Keys in the keystore, and keys moved there in NIAP mode, are not in the
+  // copy.
+  if (btif_in_encrypt_key_name_list(key) &&
+      (*stored_value == ENCRYPTED_STR || btif_is_niap_mode()))
+    return btif_config_get_bin(device.address.ToString().c_str(), key, value,
+                               length);
+
+  size_t value_len = stored_value->size();
+  if ((value_len % 2) != 0 || *length < (value_len / 2)) return false;
+
+  for (size_t i = 0; i < value_len; ++i)
+    if (!isxdigit((*stored_value)[i])) return false;
+
+  const char* cvalue_str = stored_value->c_str();
+  for (*length = 0; *cvalue_str; cvalue_str += 2, *length += 1) {
+    sscanf(cvalue_str, "%02hhx", &value[*length]);
+  }
+  return true;
+}
+
 bool btif_config_remove(const char* section, const char* key) {
   CHECK(config != NULL);
   CHECK(section != NULL);
@@ -73,6 +73,7 @@
 #include <time.h>
 #include <unistd.h>
 
+#include <map>
 #include <mutex>
 
 #include <bluetooth/uuid.h>
@@ -81,7 +82,6 @@
 #include <hardware/bluetooth.h>
 #include <hardware/bt_hearing_aid.h>
 
-#include "advertise_data_parser.h"
 #include "bt_common.h"
 #include "bta_closure_api.h"
 #include "bta_gatt_api.h"
@@ -89,6 +89,7 @@
 #include "btif_bqr.h"
 #include "btif_config.h"
 #include "btif_dm.h"
+#include "btif_dm_inquiry.h"
 #include "btif_av.h"
 #include "btif_hf.h"
 #include "btif_hd.h"
@@ -256,6 +257,22 @@ static bool btif_dm_inquiry_in_progress = false;
 
 bool twsplus_enabled = false;
 
+/* Inquiry result as passed from the BTA thread, with its EIR parsed once. The
+ * EIR itself follows only when it is still needed, for TWS+ */
+typedef struct {
+  tBTA_DM_SEARCH search;
+  btif_dm_eir_t eir;
+  tBTA_SERVICE_MASK services;
+} btif_dm_inq_res_t;
+
+/* Inquiry results stored during the current inquiry */
+typedef struct {
+  uint32_t hash;          /* hash of the stored properties */
+  bool timestamp_pending; /* seen again since, timestamp not updated */
+} btif_dm_inq_stored_t;
+
+static std::map<RawAddress, btif_dm_inq_stored_t> btif_dm_inq_stored;
+
 /*******************************************************************************
  *  Static variables
  ******************************************************************************/
@@ -443,78 +460,6 @@ bt_status_t btif_in_execute_service_request(tBTA_SERVICE_ID service_id,
   return BT_STATUS_SUCCESS;
 }
 
-/*******************************************************************************
-**
-** Function         check_eir_is_remote_name_short
-**
-** Description      Check if remote name is shortened
-**
-** Returns          TRUE if remote name found
-**                  else FALSE
-**
-*******************************************************************************/
-static bool check_eir_is_remote_name_short(tBTA_DM_SEARCH *p_search_data) {
-
-  const uint8_t* p_eir_remote_name = NULL;
-  uint8_t remote_name_len = 0;
-
-  /* Check EIR for remote name and services */
-  if (p_search_data->inq_res.p_eir) {
-
-    p_eir_remote_name = AdvertiseDataParser::GetFieldByType(
-          p_search_data->inq_res.p_eir, p_search_data->inq_res.eir_len,
-          BTM_EIR_SHORTENED_LOCAL_NAME_TYPE, &remote_name_len);
-
-    if (p_eir_remote_name) {
-      return TRUE;
-    }
-  }
-  return FALSE;
-}
-
-/*******************************************************************************
-**
- * Function         check_eir_remote_name
- *
- * Description      Check if remote name is in the EIR data
- *
- * Returns          true if remote name found
- *                  Populate p_remote_name, if provided and remote name found
- *
- ******************************************************************************/
-static bool check_eir_remote_name(tBTA_DM_SEARCH* p_search_data,
-                                  uint8_t* p_remote_name,
-                                  uint8_t* p_remote_name_len) {
-  const uint8_t* p_eir_remote_name = NULL;
-  uint8_t remote_name_len = 0;
-
-  /* Check EIR for remote name and services */
-  if (p_search_data->inq_res.p_eir) {
-    p_eir_remote_name = AdvertiseDataParser::GetFieldByType(
-        p_search_data->inq_res.p_eir, p_search_data->inq_res.eir_len,
-        BTM_EIR_COMPLETE_LOCAL_NAME_TYPE, &remote_name_len);
-    if (!p_eir_remote_name) {
-      p_eir_remote_name = AdvertiseDataParser::GetFieldByType(
-          p_search_data->inq_res.p_eir, p_search_data->inq_res.eir_len,
-          BTM_EIR_SHORTENED_LOCAL_NAME_TYPE, &remote_name_len);
-    }
-
-    if (p_eir_remote_name) {
-      if (remote_name_len > BD_NAME_LEN) remote_name_len = BD_NAME_LEN;
-
-      if (p_remote_name && p_remote_name_len) {
-        memcpy(p_remote_name, p_eir_remote_name, remote_name_len);
-        *(p_remote_name + remote_name_len) = 0;
-        *p_remote_name_len = remote_name_len;
-      }
-
-      return true;
-    }
-  }
-
-  return false;
-}
-
 /*******************************************************************************
  *
  * Function         check_cached_remote_name
@@ -976,16 +921,6 @@ static void search_devices_copy_cb(uint16_t event, char* p_dest, char* p_src) {
   BTIF_TRACE_DEBUG("%s: event=%s", __func__, dump_dm_search_event(event));
   maybe_non_aligned_memcpy(p_dest_data, p_src_data, sizeof(*p_src_data));
   switch (event) {
-    case BTA_DM_INQ_RES_EVT: {
-      if (p_src_data->inq_res.p_eir) {
-        p_dest_data->inq_res.p_eir =
-            (uint8_t*)(p_dest + sizeof(tBTA_DM_SEARCH));
-        memcpy(p_dest_data->inq_res.p_eir, p_src_data->inq_res.p_eir,
-               p_src_data->inq_res.eir_len);
-        p_dest_data->inq_res.eir_len = p_src_data->inq_res.eir_len;
-      }
-    } break;
-
     case BTA_DM_DISC_RES_EVT: {
       if (p_src_data->disc_res.raw_data_size &&
           p_src_data->disc_res.p_raw_data) {
@@ -999,6 +934,28 @@ static void search_devices_copy_cb(uint16_t event, char* p_dest, char* p_src) {
   }
 }
 
+/*******************************************************************************
+ *
+ * Function         search_inq_res_copy_cb
+ *
+ * Description      Deep copy callback for an inquiry result carrying its EIR
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+static void search_inq_res_copy_cb(uint16_t event, char* p_dest, char* p_src) {
+  btif_dm_inq_res_t* p_dest_data = (btif_dm_inq_res_t*)p_dest;
+  btif_dm_inq_res_t* p_src_data = (btif_dm_inq_res_t*)p_src;
+
+  if (!p_src) return;
+
+  memcpy(p_dest_data, p_src_data, sizeof(*p_src_data));
+  p_dest_data->search.inq_res.p_eir =
+      (uint8_t*)(p_dest + sizeof(btif_dm_inq_res_t));
+  memcpy(p_dest_data->search.inq_res.p_eir, p_src_data->search.inq_res.p_eir,
+         p_src_data->search.inq_res.eir_len);
+}
+
 static void search_services_copy_cb(uint16_t event, char* p_dest, char* p_src) {
   tBTA_DM_SEARCH* p_dest_data = (tBTA_DM_SEARCH*)p_dest;
   tBTA_DM_SEARCH* p_src_data = (tBTA_DM_SEARCH*)p_src;
@@ -1455,6 +1412,70 @@ static void btif_dm_auth_cmpl_evt(tBTA_DM_AUTH_CMPL* p_auth_cmpl) {
   }
 }
 
+/*******************************************************************************
+ *
+ * Function         btif_dm_inq_store_remote_device
+ *
+ * Description      Stores the properties of an inquiry result, unless they
+ *                  were already stored unchanged during this inquiry, in which
+ *                  case only the timestamp is updated, when the inquiry ends.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+static void btif_dm_inq_store_remote_device(const RawAddress& bdaddr,
+                                            uint32_t num_properties,
+                                            bt_property_t* properties,
+                                            int addr_type) {
+  uint32_t hash = btif_dm_hash(BTIF_DM_HASH_INIT, &addr_type, sizeof(addr_type));
+  for (uint32_t i = 0; i < num_properties; i++) {
+    /* The RSSI is not stored */
+    if (properties[i].type == BT_PROPERTY_REMOTE_RSSI) continue;
+    hash = btif_dm_hash(hash, &properties[i].type, sizeof(properties[i].type));
+    hash = btif_dm_hash(hash, &properties[i].len, sizeof(properties[i].len));
+    hash = btif_dm_hash(hash, properties[i].val, properties[i].len);
+  }
+
+  auto it = btif_dm_inq_stored.find(bdaddr);
+  if (it != btif_dm_inq_stored.end() && it->second.hash == hash) {
+    it->second.timestamp_pending = true;
+    return;
+  }
+  btif_dm_inq_stored[bdaddr] = {hash, false};
+
+  bt_status_t status = btif_storage_add_remote_device(
+      &bdaddr, num_properties, properties);
+  ASSERTC(status == BT_STATUS_SUCCESS,
+          "failed to save remote device (inquiry)", status);
+  status = btif_storage_set_remote_addr_type(&bdaddr, addr_type);
+  ASSERTC(status == BT_STATUS_SUCCESS,
+          "failed to save remote addr type (inquiry)", status);
+}
+
+/*******************************************************************************
+ *
+ * Function         btif_dm_inq_store_flush
+ *
+ * Description      Updates the timestamp of the devices seen again since they
+ *                  were stored, and forgets the devices of the inquiry.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+static void btif_dm_inq_store_flush(void) {
+  for (auto& it : btif_dm_inq_stored) {
+    if (!it.second.timestamp_pending) continue;
+
+    /* The address property stores the timestamp */
+    RawAddress bdaddr = it.first;
+    bt_property_t property;
+    BTIF_STORAGE_FILL_PROPERTY(&property, BT_PROPERTY_BDADDR, sizeof(bdaddr),
+                               &bdaddr);
+    btif_storage_add_remote_device(&bdaddr, 1, &property);
+  }
+  btif_dm_inq_stored.clear();
+}
+
 /******************************************************************************
  *
  * Function         btif_dm_search_devices_evt
@@ -1493,11 +1514,12 @@ static void btif_dm_search_devices_evt(uint16_t event, char* p_param) {
 
     case BTA_DM_INQ_RES_EVT: {
       /* inquiry result */
+      btif_dm_inq_res_t* p_inq_res = (btif_dm_inq_res_t*)p_param;
       bt_bdname_t bdname;
       uint8_t remote_name_len;
-      tBTA_SERVICE_MASK services = 0;
+      tBTA_SERVICE_MASK services = p_inq_res->services;
 
-      p_search_data = (tBTA_DM_SEARCH*)p_param;
+      p_search_data = &p_inq_res->search;
       RawAddress bdaddr = p_search_data->inq_res.bd_addr;
       RawAddress peer_eb_bdaddr = RawAddress::kEmpty;
       BTIF_TRACE_DEBUG("%s() %s device_type = 0x%x\n", __func__,
@@ -1505,18 +1527,18 @@ static void btif_dm_search_devices_evt(uint16_t event, char* p_param) {
                        p_search_data->inq_res.device_type);
       bdname.name[0] = 0;
 
-      if (!check_eir_remote_name(p_search_data, bdname.name, &remote_name_len))
+      if (p_inq_res->eir.name_found) {
+        memcpy(bdname.name, p_inq_res->eir.name, p_inq_res->eir.name_len + 1);
+        remote_name_len = p_inq_res->eir.name_len;
+      } else {
         check_cached_remote_name(p_search_data, bdname.name, &remote_name_len);
+      }
 
-      /* Check EIR for remote name and services */
-      if (p_search_data->inq_res.p_eir) {
-        BTA_GetEirService(p_search_data->inq_res.p_eir,
-                          p_search_data->inq_res.eir_len, &services);
+      /* TODO:  Get the service list and check to see which uuids we got and
+       * send it back to the client. */
+      if (services)
         BTIF_TRACE_DEBUG("%s()EIR BTA services = %08X", __func__,
                          (uint32_t)services);
-        /* TODO:  Get the service list and check to see which uuids we got and
-         * send it back to the client. */
-      }
 
       {
         bt_property_t properties[5];
@@ -1543,7 +1565,7 @@ static void btif_dm_search_devices_evt(uint16_t event, char* p_param) {
                                        strlen((char *)alias.name), &alias);
           num_properties++;
         } else if (bdname.name[0]) {
-          if((check_eir_is_remote_name_short(p_search_data) == TRUE) &&
+          if (p_inq_res->eir.name_shortened &&
                (btif_storage_is_device_bonded(&bdaddr) == BT_STATUS_SUCCESS)) {
             BTIF_TRACE_DEBUG("%s Don't update about the device name ", __FUNCTION__);
           } else {
@@ -1591,17 +1613,12 @@ static void btif_dm_search_devices_evt(uint16_t event, char* p_param) {
                                    &(p_search_data->inq_res.rssi));
         num_properties++;
 
-        status =
-            btif_storage_add_remote_device(&bdaddr, num_properties, properties);
-        ASSERTC(status == BT_STATUS_SUCCESS,
-                "failed to save remote device (inquiry)", status);
-        status = btif_storage_set_remote_addr_type(&bdaddr, addr_type);
-        ASSERTC(status == BT_STATUS_SUCCESS,
-                "failed to save remote addr type (inquiry)", status);
+        btif_dm_inq_store_remote_device(bdaddr, num_properties, properties,
+                                        addr_type);
         /* Callback to notify upper layer of device */
         HAL_CBACK(bt_hal_cbacks, device_found_cb, num_properties, properties);
 
-        if(twsplus_enabled == true) {
+        if (twsplus_enabled == true && p_search_data->inq_res.p_eir) {
           if( btif_tws_plus_process_eir( p_search_data, &peer_eb_bdaddr)) {
             BTIF_TRACE_DEBUG("%s() %s \n", __func__,
                      peer_eb_bdaddr.ToString().c_str());
@@ -1613,16 +1630,19 @@ static void btif_dm_search_devices_evt(uint16_t event, char* p_param) {
     } break;
 
     case BTA_DM_INQ_CMPL_EVT: {
+      btif_dm_inq_store_flush();
       do_in_bta_thread(
           FROM_HERE,
           base::Bind(&BTM_BleAdvFilterParamSetup, BTM_BLE_SCAN_COND_DELETE, 0,
                      nullptr, base::Bind(&bte_scan_filt_param_cfg_evt, 0)));
     } break;
     case BTA_DM_DISC_CMPL_EVT: {
+      btif_dm_inq_store_flush();
       HAL_CBACK(bt_hal_cbacks, discovery_state_changed_cb,
                 BT_DISCOVERY_STOPPED);
     } break;
     case BTA_DM_SEARCH_CANCEL_CMPL_EVT: {
+      btif_dm_inq_store_flush();
       /* if inquiry is not in progress and we get a cancel event, then
        * it means we are done with inquiry, but remote_name fetches are in
        * progress
@@ -2070,6 +2090,7 @@ static void btif_dm_upstreams_evt(uint16_t event, char* p_param) {
           HAL_CBACK(bt_hal_cbacks, discovery_state_changed_cb,
                     BT_DISCOVERY_STARTED);
           btif_dm_inquiry_in_progress = true;
+          btif_dm_inq_store_flush();
         } else if (p_data->busy_level.level_flags == BTM_BL_INQUIRY_CANCELLED) {
           HAL_CBACK(bt_hal_cbacks, discovery_state_changed_cb,
                     BT_DISCOVERY_STOPPED);
@@ -2499,6 +2520,56 @@ void bte_dm_evt(tBTA_DM_SEC_EVT event, tBTA_DM_SEC* p_data) {
   ASSERTC(status == BT_STATUS_SUCCESS, "context transfer failed", status);
 }
 
+/*******************************************************************************
+ *
+ * Function         bte_search_inq_res_evt
+ *
+ * Description      Parses the EIR of an inquiry result, and switches context
+ *                  from BTE to BTIF for it unless it is a duplicate of a result
+ *                  already reported during this inquiry
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+static void bte_search_inq_res_evt(tBTA_DM_SEARCH* p_data) {
+  btif_dm_inq_res_t inq_res;
+  uint16_t param_len = sizeof(inq_res);
+
+  btif_dm_parse_eir(p_data->inq_res.p_eir, p_data->inq_res.eir_len,
+                    &inq_res.eir);
+
+  /* if remote name is available in EIR, set the flag so that stack doesnt
+   * trigger RNR */
+  p_data->inq_res.remt_name_not_required = inq_res.eir.name_found;
+
+  uint32_t hash = btif_dm_hash(inq_res.eir.hash, p_data->inq_res.dev_class,
+                               sizeof(DEV_CLASS));
+  hash = btif_dm_hash(hash, &p_data->inq_res.device_type,
+                      sizeof(p_data->inq_res.device_type));
+  if (btif_dm_inq_filter_is_duplicate(p_data->inq_res.bd_addr, hash,
+                                      p_data->inq_res.rssi))
+    return;
+
+  inq_res.services = 0;
+  if (p_data->inq_res.p_eir)
+    BTA_GetEirService(p_data->inq_res.p_eir, p_data->inq_res.eir_len,
+                      &inq_res.services);
+
+  memcpy(&inq_res.search, p_data, sizeof(inq_res.search));
+  /* The EIR is only needed for TWS+ after parsing */
+  if (twsplus_enabled && p_data->inq_res.p_eir) {
+    param_len += p_data->inq_res.eir_len;
+  } else {
+    inq_res.search.inq_res.p_eir = NULL;
+    inq_res.search.inq_res.eir_len = 0;
+  }
+
+  btif_transfer_context(
+      btif_dm_search_devices_evt, BTA_DM_INQ_RES_EVT, (char*)&inq_res,
+      param_len,
+      (param_len > sizeof(inq_res)) ? search_inq_res_copy_cb : NULL);
+}
+
 /*******************************************************************************
  *
  * Function         bte_search_devices_evt
@@ -2512,14 +2583,25 @@ static void bte_search_devices_evt(tBTA_DM_SEARCH_EVT event,
                                    tBTA_DM_SEARCH* p_data) {
   uint16_t param_len = 0;
 
-  if (p_data) param_len += sizeof(tBTA_DM_SEARCH);
-  /* Allocate buffer to hold the pointers (deep copy). The pointers will point
-   * to the end of the tBTA_DM_SEARCH */
   switch (event) {
     case BTA_DM_INQ_RES_EVT: {
-      if (p_data && p_data->inq_res.p_eir) param_len += p_data->inq_res.eir_len;
+      if (p_data) {
+        bte_search_inq_res_evt(p_data);
+        return;
+      }
     } break;
 
+    case BTA_DM_INQ_CMPL_EVT:
+    case BTA_DM_DISC_CMPL_EVT:
+    case BTA_DM_SEARCH_CANCEL_CMPL_EVT:
+      btif_dm_inq_filter_reset();
+      break;
+  }
+
+  if (p_data) param_len += sizeof(tBTA_DM_SEARCH);
+  /* Allocate buffer to hold the pointers (deep copy). The pointers will point
+   * to the end of the tBTA_DM_SEARCH */
+  switch (event) {
     case BTA_DM_DISC_RES_EVT: {
       if (p_data && p_data->disc_res.raw_data_size && p_data->disc_res.p_raw_data)
         param_len += p_data->disc_res.raw_data_size;
@@ -2528,12 +2610,6 @@ static void bte_search_devices_evt(tBTA_DM_SEARCH_EVT event,
   BTIF_TRACE_DEBUG("%s event=%s param_len=%d", __func__,
                    dump_dm_search_event(event), param_len);
 
-  /* if remote name is available in EIR, set teh flag so that stack doesnt
-   * trigger RNR */
-  if (p_data && event == BTA_DM_INQ_RES_EVT)
-    p_data->inq_res.remt_name_not_required =
-        check_eir_remote_name(p_data, NULL, NULL);
-
   btif_transfer_context(
       btif_dm_search_devices_evt, (uint16_t)event, (char*)p_data, param_len,
       (param_len > sizeof(tBTA_DM_SEARCH)) ? search_devices_copy_cb : NULL);
@@ -2700,6 +2776,8 @@ bt_status_t btif_dm_start_discovery(void) {
 
   /* Will be enabled to true once inquiry busy level has been received */
   btif_dm_inquiry_in_progress = false;
+  /* report every device again, even if the previous inquiry did not end */
+  do_in_bta_thread(FROM_HERE, base::Bind(&btif_dm_inq_filter_reset));
   /* find nearby devices */
   BTA_DmSearch(&inq_params, services, bte_search_devices_evt);
 
@@ -0,0 +1,118 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/*******************************************************************************
+ *
+ *  Filename:      btif_dm_inquiry.cc
+ *
+ *  Description:   Inquiry result parsing and duplicate suppression. Called
+ *                 from the BTA thread only.
+ *
+ ******************************************************************************/
+
+#include "btif_dm_inquiry.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <unordered_map>
+
+#include "advertise_data_parser.h"
+#include "btm_api.h"
+
+/* An RSSI change of this many dB is reported even if nothing else changed */
+#define BTIF_DM_INQ_RSSI_DELTA 5
+
+/* Devices remembered per inquiry, later ones are not filtered */
+#define BTIF_DM_INQ_MAX_DEVICES 1024
+
+namespace {
+
+struct InqAddrHash {
+  std::size_t operator()(const RawAddress& x) const {
+    const uint8_t* a = x.address;
+    return a[0] ^ (a[1] << 8) ^ (a[2] << 16) ^ (a[3] << 24) ^ a[4] ^
+           (a[5] << 8);
+  }
+};
+
+typedef struct {
+  uint32_t hash;
+  int8_t rssi;
+} btif_dm_inq_seen_t;
+
+std::unordered_map<RawAddress, btif_dm_inq_seen_t, InqAddrHash> inq_seen;
+
+}  // namespace
+
+void btif_dm_parse_eir(const uint8_t* p_eir, size_t eir_len,
+                       btif_dm_eir_t* p_eir_info) {
+  AdvertiseDataIndex eir(p_eir, eir_len);
+  uint8_t name_len, shortened_len;
+  uint8_t name_type;
+  const uint8_t* p_name =
+      eir.GetFieldByType(BTM_EIR_COMPLETE_LOCAL_NAME_TYPE,
+                         BTM_EIR_SHORTENED_LOCAL_NAME_TYPE, &name_len,
+                         &name_type);
+
+  p_eir_info->name[0] = 0;
+  p_eir_info->name_len = 0;
+  p_eir_info->name_found = (p_name != NULL);
+  p_eir_info->name_shortened =
+      (eir.GetFieldByType(BTM_EIR_SHORTENED_LOCAL_NAME_TYPE,
+                          &shortened_len) != NULL);
+  if (p_name != NULL) {
+    if (name_len > BD_NAME_LEN) name_len = BD_NAME_LEN;
+    memcpy(p_eir_info->name, p_name, name_len);
+    p_eir_info->name[name_len] = 0;
+    p_eir_info->name_len = name_len;
+  }
+
+  /* Only the significant part, the rest is padding */
+  p_eir_info->hash =
+      btif_dm_hash(BTIF_DM_HASH_INIT, p_eir, eir.significant_len());
+}
+
+uint32_t btif_dm_hash(uint32_t hash, const void* data, size_t len) {
+  const uint8_t* p = (const uint8_t*)data;
+  for (size_t i = 0; i < len; i++) {
+    hash ^= p[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+void btif_dm_inq_filter_reset(void) { inq_seen.clear(); }
+
+bool btif_dm_inq_filter_is_duplicate(const RawAddress& bd_addr, uint32_t hash,
+                                     int8_t rssi) {
+  auto it = inq_seen.find(bd_addr);
+  if (it == inq_seen.end()) {
+    if (inq_seen.size() < BTIF_DM_INQ_MAX_DEVICES)
+      inq_seen[bd_addr] = {hash, rssi};
+    return false;
+  }
+
+  btif_dm_inq_seen_t& seen = it->second;
+  if (seen.hash == hash && abs(rssi - seen.rssi) < BTIF_DM_INQ_RSSI_DELTA)
+    return true;
+
+  seen.hash = hash;
+  seen.rssi = rssi;
+  return false;
+}
@@ -40,6 +40,11 @@
 #include <string.h>
 #include <time.h>
 
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <vector>
+
 #include "bt_common.h"
 #include "bta_closure_api.h"
 #include "bta_hd_api.h"
@@ -56,6 +61,8 @@
 #include "osi/include/config.h"
 #include "osi/include/log.h"
 #include "osi/include/osi.h"
+#include "osi/include/properties.h"
+#include "osi/include/time.h"
 #include <inttypes.h>
 
 using base::Bind;
@@ -175,6 +182,37 @@ static bt_status_t btif_in_fetch_bonded_device(const char* bdstr, int *dev_type)
 static bool btif_has_ble_keys(const char* bdstr);
 
 static bool prop_upd(const RawAddress* remote_bd_addr, bt_property_t *prop);
+
+/*******************************************************************************
+ *  Static variables
+ ******************************************************************************/
+
+// When set, btif_storage_load_bonded_devices() only reports the type and the
+// class of the bonded devices, and their other properties are read from the
+// copies below when they are asked for.
+#define BTIF_STORAGE_LAZY_PROPERTIES_PROPERTY \
+  "persist.bluetooth.lazybondproperties"
+
+// Properties of the bonded devices, copied from their sections when they were
+// loaded. A copy is dropped as soon as a property of its device is written.
+static std::mutex lazy_devices_lock;
+static std::map<RawAddress, btif_config_device_t> lazy_devices;
+
+// Cost of the last btif_storage_load_bonded_devices().
+static struct {
+  bool loaded;
+  bool lazy;
+  size_t sections;
+  size_t bonded_devices;
+  uint64_t snapshot_us;
+  uint64_t total_us;
+} load_stats;
+
+static void btif_storage_drop_lazy_device(const RawAddress& bd_addr) {
+  std::lock_guard<std::mutex> lock(lazy_devices_lock);
+  lazy_devices.erase(bd_addr);
+}
+
 /*******************************************************************************
  *  Static functions
  ******************************************************************************/
@@ -194,6 +232,7 @@ static bool prop_upd(const RawAddress* remote_bd_addr, bt_property_t *prop)
   if(remote_bd_addr) {
     addrstr = remote_bd_addr->ToString();
     bdstr = addrstr.c_str();
+    btif_storage_drop_lazy_device(*remote_bd_addr);
   }
 
   BTIF_TRACE_DEBUG("%s: in, bd addr:%s, prop type:%d, len:%d", __func__, bdstr, prop->type,
@@ -457,6 +496,74 @@ static int cfg2prop(const RawAddress* remote_bd_addr, bt_property_t* prop) {
   return ret;
 }
 
+/*******************************************************************************
+ *
+ * Function         btif_storage_get_snapshot_property
+ *
+ * Description      Same as cfg2prop() for the name, the friendly name, the
+ *                  class, the type and the UUIDs of a remote device, read from
+ *                  a copy of its section
+ *
+ * Returns          true if the property was found, false otherwise
+ *
+ ******************************************************************************/
+bool btif_storage_get_snapshot_property(const btif_config_device_t& device,
+                                        bt_property_t* prop) {
+  if (prop->len <= 0) {
+    BTIF_TRACE_ERROR("property type:%d, len:%d is invalid", prop->type,
+                     prop->len);
+    return false;
+  }
+  bool ret = false;
+  switch (prop->type) {
+    case BT_PROPERTY_BDNAME:
+    case BT_PROPERTY_REMOTE_FRIENDLY_NAME: {
+      const std::string* value = btif_config_device_get_str(
+          device, prop->type == BT_PROPERTY_BDNAME
+                      ? BTIF_STORAGE_PATH_REMOTE_NAME
+                      : BTIF_STORAGE_PATH_REMOTE_ALIASE);
+      if (value) {
+        strlcpy((char*)prop->val, value->c_str(), prop->len);
+        prop->len = strlen((char*)prop->val);
+        ret = true;
+      } else {
+        prop->len = 0;
+      }
+      break;
+    }
+    case BT_PROPERTY_CLASS_OF_DEVICE:
+      if (prop->len >= (int)sizeof(int))
+        ret = btif_config_device_get_int(
+            device, BTIF_STORAGE_PATH_REMOTE_DEVCLASS, (int*)prop->val);
+      break;
+    case BT_PROPERTY_TYPE_OF_DEVICE:
+      if (prop->len >= (int)sizeof(int))
+        ret = btif_config_device_get_int(
+            device, BTIF_STORAGE_PATH_REMOTE_DEVTYPE, (int*)prop->val);
+      break;
+    case BT_PROPERTY_UUIDS: {
+      const std::string* value =
+          btif_config_device_get_str(device, BTIF_STORAGE_PATH_REMOTE_SERVICE);
+      if (value) {
+        Uuid* p_uuid = reinterpret_cast<Uuid*>(prop->val);
+        size_t max_uuids = std::min((size_t)BT_MAX_NUM_UUIDS,
+                                    (size_t)prop->len / sizeof(Uuid));
+        size_t num_uuids =
+            btif_split_uuids_string(value->c_str(), p_uuid, max_uuids);
+        prop->len = num_uuids * sizeof(Uuid);
+        ret = true;
+      } else {
+        prop->val = NULL;
+        prop->len = 0;
+      }
+    } break;
+
+    default:
+      return false;
+  }
+  return ret;
+}
+
 /*******************************************************************************
  *
  * Function         btif_in_fetch_bonded_devices
@@ -495,67 +602,6 @@ static bt_status_t btif_in_fetch_bonded_device(const char* bdstr, int *p_dev_typ
   return BT_STATUS_SUCCESS;
 }
 
-/*******************************************************************************
- *
- * Function         btif_in_fetch_bonded_devices
- *
- * Description      Internal helper function to fetch the bonded devices
- *                  from NVRAM
- *
- * Returns          BT_STATUS_SUCCESS if successful, BT_STATUS_FAIL otherwise
- *
- ******************************************************************************/
-static bt_status_t btif_in_fetch_bonded_devices(
-    list_t** p_bonded_devices, int add) {
-
-  bool bt_linkkey_file_found = false;
-  int device_type;
-
-  for (const btif_config_section_iter_t* iter = btif_config_section_begin();
-       iter != btif_config_section_end();
-       iter = btif_config_section_next(iter)) {
-    const char* name = btif_config_section_name(iter);
-    if (!RawAddress::IsValidAddress(name)) continue;
-
-    BTIF_TRACE_DEBUG("Remote device:%s", name);
-    LinkKey link_key;
-    size_t size = sizeof(link_key);
-    if (btif_config_get_bin(name, "LinkKey", link_key.data(), &size)) {
-      int linkkey_type;
-      if (btif_config_get_int(name, "LinkKeyType", &linkkey_type)) {
-        RawAddress bd_addr;
-        RawAddress::FromString(name, bd_addr);
-        if (add) {
-          DEV_CLASS dev_class = {0, 0, 0};
-          int cod;
-          int pin_length = 0;
-          if (btif_config_get_int(name, "DevClass", &cod))
-            uint2devclass((uint32_t)cod, dev_class);
-          btif_config_get_int(name, "PinLength", &pin_length);
-          BTA_DmAddDevice(bd_addr, dev_class, link_key, 0, 0,
-                          (uint8_t)linkkey_type, 0, pin_length);
-
-          if (btif_config_get_int(name, "DevType", &device_type) &&
-              (device_type == BT_DEVICE_TYPE_DUMO)) {
-            btif_gatts_add_bonded_dev_from_nv(bd_addr);
-          }
-        }
-        bt_linkkey_file_found = true;
-        RawAddress *remote_addr =  (RawAddress *)osi_malloc(sizeof(RawAddress));
-        memcpy(remote_addr, &bd_addr, RawAddress::kLength);
-        list_append(*p_bonded_devices, remote_addr);
-      } else {
-        bt_linkkey_file_found = false;
-      }
-    }
-    if (!btif_in_fetch_bonded_ble_device(name, add, p_bonded_devices) &&
-        !bt_linkkey_file_found) {
-      BTIF_TRACE_DEBUG("Remote device:%s, no link key or ble key found", name);
-    }
-  }
-  return BT_STATUS_SUCCESS;
-}
-
 static void btif_read_le_key(const uint8_t key_type, const size_t key_len,
                              RawAddress bd_addr, const uint8_t addr_type,
                              const bool add_key, bool* device_added,
@@ -583,6 +629,152 @@ static void btif_read_le_key(const uint8_t key_type, const size_t key_len,
   }
 }
 
+/* LE keys of a bonded device, in the order they are added to the BTA */
+static const struct {
+  uint8_t key_type;
+  const char* name;
+  size_t length;
+} btif_storage_le_keys[] = {
+    {BTIF_DM_LE_KEY_PENC, "LE_KEY_PENC", sizeof(tBTM_LE_PENC_KEYS)},
+    {BTIF_DM_LE_KEY_PID, "LE_KEY_PID", sizeof(tBTM_LE_PID_KEYS)},
+    {BTIF_DM_LE_KEY_LID, "LE_KEY_LID", sizeof(tBTM_LE_PID_KEYS)},
+    {BTIF_DM_LE_KEY_PCSRK, "LE_KEY_PCSRK", sizeof(tBTM_LE_PCSRK_KEYS)},
+    {BTIF_DM_LE_KEY_LENC, "LE_KEY_LENC", sizeof(tBTM_LE_LENC_KEYS)},
+    {BTIF_DM_LE_KEY_LCSRK, "LE_KEY_LCSRK", sizeof(tBTM_LE_LCSRK_KEYS)},
+};
+
+/*******************************************************************************
+ *
+ * Function         btif_in_fetch_bonded_ble_device_from_snapshot
+ *
+ * Description      Internal helper function to fetch the LE keys of a bonded
+ *                  device from a copy of its section
+ *
+ * Returns          true if the device has LE keys, false otherwise
+ *
+ ******************************************************************************/
+static bool btif_in_fetch_bonded_ble_device_from_snapshot(
+    const btif_config_device_t& device, tBTA_DM_BONDED_DEVICE* p_bta_device) {
+  int device_type;
+  int addr_type;
+  bool key_found = false;
+
+  if (!btif_config_device_get_int(device, "DevType", &device_type))
+    return false;
+
+  if ((device_type & BT_DEVICE_TYPE_BLE) != BT_DEVICE_TYPE_BLE &&
+      !btif_config_device_get_str(device, "LE_KEY_PENC"))
+    return false;
+
+  BTIF_TRACE_DEBUG("%s Found a LE device: %s", __func__,
+                   device.address.ToString().c_str());
+
+  if (!btif_config_device_get_int(device, "AddrType", &addr_type)) {
+    /* Try to read address type from device info, if not present,
+    then it defaults to BLE_ADDR_PUBLIC */
+    uint8_t tmp_dev_type;
+    uint8_t tmp_addr_type;
+    BTM_ReadDevInfo(device.address, &tmp_dev_type, &tmp_addr_type);
+    addr_type = tmp_addr_type;
+
+    btif_storage_set_remote_addr_type(&device.address, addr_type);
+  }
+
+  for (const auto& le_key : btif_storage_le_keys) {
+    tBTA_LE_KEY_VALUE key;
+    memset(&key, 0, sizeof(key));
+
+    size_t length = le_key.length;
+    if (!btif_config_device_get_bin(device, le_key.name, (uint8_t*)&key,
+                                    &length))
+      continue;
+
+    key_found = true;
+    if (p_bta_device) {
+      BTIF_TRACE_DEBUG("%s() Adding key type %d for %s", __func__,
+                       le_key.key_type, device.address.ToString().c_str());
+      p_bta_device->ble_keys.emplace_back(le_key.key_type, key);
+    }
+  }
+
+  if (key_found && p_bta_device) {
+    p_bta_device->is_ble = true;
+    p_bta_device->addr_type = addr_type;
+  }
+  return key_found;
+}
+
+/*******************************************************************************
+ *
+ * Function         btif_in_fetch_bonded_devices
+ *
+ * Description      Internal helper function to fetch the bonded devices
+ *                  from a copy of the NVRAM, and add them to the BTA if |add|
+ *                  is set
+ *
+ * Returns          BT_STATUS_SUCCESS if successful, BT_STATUS_FAIL otherwise
+ *
+ ******************************************************************************/
+static bt_status_t btif_in_fetch_bonded_devices(
+    const std::vector<btif_config_device_t>& devices,
+    std::vector<const btif_config_device_t*>* p_bonded_devices, int add) {
+  std::vector<tBTA_DM_BONDED_DEVICE> bta_devices;
+  int device_type;
+
+  for (const btif_config_device_t& device : devices) {
+    bool bt_linkkey_file_found = false;
+    tBTA_DM_BONDED_DEVICE bta_device;
+    bta_device.bd_addr = device.address;
+    bta_device.link_key_known = false;
+    bta_device.dc_known = false;
+    bta_device.is_ble = false;
+
+    BTIF_TRACE_DEBUG("Remote device:%s", device.address.ToString().c_str());
+    size_t size = bta_device.link_key.size();
+    int linkkey_type;
+    if (btif_config_device_get_bin(device, "LinkKey",
+                                   bta_device.link_key.data(), &size) &&
+        btif_config_device_get_int(device, "LinkKeyType", &linkkey_type)) {
+      if (add) {
+        int cod;
+        int pin_length = 0;
+        memset(bta_device.dc, 0, sizeof(bta_device.dc));
+        if (btif_config_device_get_int(device, "DevClass", &cod))
+          uint2devclass((uint32_t)cod, bta_device.dc);
+        btif_config_device_get_int(device, "PinLength", &pin_length);
+        bta_device.link_key_known = true;
+        bta_device.key_type = (uint8_t)linkkey_type;
+        bta_device.pin_length = (uint8_t)pin_length;
+        bta_device.dc_known = true;
+
+        if (btif_config_device_get_int(device, "DevType", &device_type) &&
+            (device_type == BT_DEVICE_TYPE_DUMO)) {
+          btif_gatts_add_bonded_dev_from_nv(device.address);
+        }
+      }
+      bt_linkkey_file_found = true;
+      p_bonded_devices->push_back(&device);
+    }
+
+    if (btif_in_fetch_bonded_ble_device_from_snapshot(
+            device, add ? &bta_device : NULL)) {
+      if (add) {
+        p_bonded_devices->push_back(&device);
+        btif_gatts_add_bonded_dev_from_nv(device.address);
+      }
+    } else if (!bt_linkkey_file_found) {
+      BTIF_TRACE_DEBUG("Remote device:%s, no link key or ble key found",
+                       device.address.ToString().c_str());
+    }
+
+    if (bta_device.link_key_known || bta_device.is_ble)
+      bta_devices.push_back(std::move(bta_device));
+  }
+
+  if (!bta_devices.empty()) BTA_DmAddBondedDevices(std::move(bta_devices));
+  return BT_STATUS_SUCCESS;
+}
+
 /*******************************************************************************
  * Functions
  *
@@ -709,31 +901,27 @@ bt_status_t btif_storage_get_adapter_property(bt_property_t* property) {
     property->len = RawAddress::kLength;
     return BT_STATUS_SUCCESS;
   } else if (property->type == BT_PROPERTY_ADAPTER_BONDED_DEVICES) {
-    list_t *bonded_devices = list_new(osi_free);
-    int len = 0;
-    int i = 0;
+    std::vector<btif_config_device_t> devices =
+        btif_config_get_device_snapshot();
+    std::vector<const btif_config_device_t*> bonded_devices;
     property->len = 0;
 
-    btif_in_fetch_bonded_devices(&bonded_devices, 0);
+    btif_in_fetch_bonded_devices(devices, &bonded_devices, 0);
 
     BTIF_TRACE_DEBUG(
         "%s: Number of bonded devices: %zu "
         "Property:BT_PROPERTY_ADAPTER_BONDED_DEVICES",
-        __func__, list_length(bonded_devices));
+        __func__, bonded_devices.size());
 
-    if (list_length(bonded_devices)) {
-      property->len = list_length(bonded_devices) * RawAddress::kLength;
+    if (!bonded_devices.empty()) {
+      property->len = bonded_devices.size() * RawAddress::kLength;
       RawAddress* devices_list = (RawAddress*)osi_malloc(property->len);
       property->val = devices_list;
-      for (list_node_t* node = list_begin(bonded_devices);
-            node != list_end(bonded_devices); node = list_next(node), i++) {
-        memcpy(&devices_list[i], list_node(node), RawAddress::kLength);
-        len = len + RawAddress::kLength;
-      }
+      for (size_t i = 0; i < bonded_devices.size(); i++)
+        devices_list[i] = bonded_devices[i]->address;
     }
 
     /* if there are no bonded_devices, then length shall be 0 */
-    list_free(bonded_devices);
     return BT_STATUS_SUCCESS;
   } else if (property->type == BT_PROPERTY_UUIDS) {
     /* publish list of local supported services */
@@ -819,6 +1007,24 @@ bt_status_t btif_storage_set_adapter_property(bt_property_t* property) {
  ******************************************************************************/
 bt_status_t btif_storage_get_remote_device_property(
     const RawAddress* remote_bd_addr, bt_property_t* property) {
+  if (remote_bd_addr) {
+    std::lock_guard<std::mutex> lock(lazy_devices_lock);
+    auto device = lazy_devices.find(*remote_bd_addr);
+    if (device != lazy_devices.end()) {
+      switch (property->type) {
+        case BT_PROPERTY_BDNAME:
+        case BT_PROPERTY_REMOTE_FRIENDLY_NAME:
+        case BT_PROPERTY_CLASS_OF_DEVICE:
+        case BT_PROPERTY_UUIDS:
+          return btif_storage_get_snapshot_property(device->second, property)
+                     ? BT_STATUS_SUCCESS
+                     : BT_STATUS_FAIL;
+        default:
+          break;
+      }
+    }
+  }
+
   return cfg2prop(remote_bd_addr, property) ? BT_STATUS_SUCCESS
                                             : BT_STATUS_FAIL;
 }
@@ -941,6 +1147,7 @@ bt_status_t btif_storage_remove_bonded_device(
   const char* bdstr = addrstr.c_str();
   BTIF_TRACE_DEBUG("in bd addr:%s", bdstr);
 
+  btif_storage_drop_lazy_device(*remote_bd_addr);
   btif_storage_remove_ble_bonding_keys(remote_bd_addr);
 
   int ret = 1;
@@ -1000,27 +1207,18 @@ bt_status_t btif_storage_remove_bonded_device(
  * We still allow such devices to bond in order to give the user a chance to
  * update firmware.
  */
-static void remove_devices_with_sample_ltk() {
+static bool remove_devices_with_sample_ltk(
+    const std::vector<btif_config_device_t>& devices) {
   std::vector<RawAddress> bad_ltk;
-  for (const btif_config_section_iter_t* iter = btif_config_section_begin();
-       iter != btif_config_section_end();
-       iter = btif_config_section_next(iter)) {
-    const std::string name(btif_config_section_name(iter));
-    if (!RawAddress::IsValidAddress(name)) {
-      continue;
-    }
-
-    RawAddress bd_addr;
-    RawAddress::FromString(name, bd_addr);
-
+  for (const btif_config_device_t& device : devices) {
     tBTA_LE_KEY_VALUE key;
     memset(&key, 0, sizeof(key));
 
-    if (btif_storage_get_ble_bonding_key(
-            &bd_addr, BTIF_DM_LE_KEY_PENC, (uint8_t*)&key,
-            sizeof(tBTM_LE_PENC_KEYS)) == BT_STATUS_SUCCESS) {
+    size_t length = sizeof(tBTM_LE_PENC_KEYS);
+    if (btif_config_device_get_bin(device, "LE_KEY_PENC", (uint8_t*)&key,
+                                   &length)) {
       if (is_sample_ltk(key.penc_key.ltk)) {
-        bad_ltk.push_back(bd_addr);
+        bad_ltk.push_back(device.address);
       }
     }
   }
@@ -1032,6 +1230,7 @@ static void remove_devices_with_sample_ltk() {
 
     btif_storage_remove_bonded_device(&address);
   }
+  return !bad_ltk.empty();
 }
 
 /*******************************************************************************
@@ -1076,8 +1275,7 @@ bt_status_t btif_storage_is_device_bonded(RawAddress *remote_bd_addr) {
  *
  ******************************************************************************/
 bt_status_t btif_storage_load_bonded_devices(void) {
-  list_t *bonded_devices = list_new(osi_free);
-  uint32_t i = 0;
+  std::vector<const btif_config_device_t*> bonded_devices;
   bt_property_t adapter_props[6];
   uint32_t num_props = 0;
   bt_property_t remote_properties[8];
@@ -1088,10 +1286,22 @@ bt_status_t btif_storage_load_bonded_devices(void) {
   Uuid local_uuids[BT_MAX_NUM_UUIDS];
   Uuid remote_uuids[BT_MAX_NUM_UUIDS];
   bt_status_t status;
+  char lazy_prop[PROPERTY_VALUE_MAX] = "false";
+  uint64_t start_us = time_get_os_boottime_us();
+
+  /* All the sections are read once, and the devices are looked up in the
+   * copy rather than through btif_config_get_*(), which walks the sections
+   * on every call. */
+  std::vector<btif_config_device_t> devices =
+      btif_config_get_device_snapshot();
+  if (remove_devices_with_sample_ltk(devices))
+    devices = btif_config_get_device_snapshot();
+  uint64_t snapshot_us = time_get_os_boottime_us() - start_us;
 
-  remove_devices_with_sample_ltk();
+  btif_in_fetch_bonded_devices(devices, &bonded_devices, 1);
 
-  btif_in_fetch_bonded_devices(&bonded_devices, 1);
+  osi_property_get(BTIF_STORAGE_LAZY_PROPERTIES_PROPERTY, lazy_prop, "false");
+  bool lazy = !strcmp(lazy_prop, "true");
 
   /* Now send the adapter_properties_cb with all adapter_properties */
   {
@@ -1129,16 +1339,13 @@ bt_status_t btif_storage_load_bonded_devices(void) {
     num_props++;
 
     /* BONDED_DEVICES */
-    RawAddress* devices_list = (RawAddress*)osi_malloc(
-        sizeof(RawAddress) * list_length(bonded_devices));
+    RawAddress* devices_list =
+        (RawAddress*)osi_malloc(sizeof(RawAddress) * bonded_devices.size());
     adapter_props[num_props].type = BT_PROPERTY_ADAPTER_BONDED_DEVICES;
-    adapter_props[num_props].len =
-        list_length(bonded_devices) * sizeof(RawAddress);
+    adapter_props[num_props].len = bonded_devices.size() * sizeof(RawAddress);
     adapter_props[num_props].val = devices_list;
-    for (list_node_t* node = list_begin(bonded_devices);
-      node != list_end(bonded_devices); node = list_next(node), i++) {
-      memcpy(&devices_list[i], list_node(node), RawAddress::kLength);
-    }
+    for (size_t i = 0; i < bonded_devices.size(); i++)
+      devices_list[i] = bonded_devices[i]->address;
     num_props++;
 
     /* LOCAL UUIDs */
@@ -1153,12 +1360,30 @@ bt_status_t btif_storage_load_bonded_devices(void) {
   }
 
   BTIF_TRACE_EVENT("%s: %zu bonded devices found", __func__,
-                   list_length(bonded_devices));
+                   bonded_devices.size());
+
+  {
+    std::lock_guard<std::mutex> lock(lazy_devices_lock);
+    lazy_devices.clear();
+    if (lazy) {
+      /* Only the properties are kept, not the keys */
+      static const char* kLazyKeys[] = {
+          BTIF_STORAGE_PATH_REMOTE_NAME, BTIF_STORAGE_PATH_REMOTE_ALIASE,
+          BTIF_STORAGE_PATH_REMOTE_DEVCLASS, BTIF_STORAGE_PATH_REMOTE_SERVICE};
+      for (const btif_config_device_t* device : bonded_devices) {
+        btif_config_device_t& copy = lazy_devices[device->address];
+        copy.address = device->address;
+        for (const char* key : kLazyKeys) {
+          const std::string* value = btif_config_device_get_str(*device, key);
+          if (value) copy.entries[key] = *value;
+        }
+      }
+    }
+  }
 
   {
-    for (list_node_t* node = list_begin(bonded_devices);
-         node != list_end(bonded_devices); node = list_next(node)) {
-      RawAddress* p_remote_addr;
+    for (const btif_config_device_t* device : bonded_devices) {
+      RawAddress remote_addr = device->address;
 
       /*
        * TODO: improve handling of missing fields in NVRAM.
@@ -1167,37 +1392,62 @@ bt_status_t btif_storage_load_bonded_devices(void) {
       uint32_t devtype = 0;
 
       num_props = 0;
-      p_remote_addr = (RawAddress *)list_node(node);
       memset(remote_properties, 0, sizeof(remote_properties));
-      BTIF_STORAGE_GET_REMOTE_PROP(p_remote_addr, BT_PROPERTY_BDNAME, &name,
-                                   sizeof(name), remote_properties[num_props]);
-      num_props++;
-
-      BTIF_STORAGE_GET_REMOTE_PROP(p_remote_addr,
-                                   BT_PROPERTY_REMOTE_FRIENDLY_NAME, &alias,
-                                   sizeof(alias), remote_properties[num_props]);
-      num_props++;
+      if (!lazy) {
+        BTIF_STORAGE_FILL_PROPERTY(&remote_properties[num_props],
+                                   BT_PROPERTY_BDNAME, sizeof(name), &name);
+        btif_storage_get_snapshot_property(*device,
+                                           &remote_properties[num_props]);
+        num_props++;
+
+        BTIF_STORAGE_FILL_PROPERTY(&remote_properties[num_props],
+                                   BT_PROPERTY_REMOTE_FRIENDLY_NAME,
+                                   sizeof(alias), &alias);
+        btif_storage_get_snapshot_property(*device,
+                                           &remote_properties[num_props]);
+        num_props++;
+      }
 
-      BTIF_STORAGE_GET_REMOTE_PROP(p_remote_addr, BT_PROPERTY_CLASS_OF_DEVICE,
-                                   &cod, sizeof(cod),
-                                   remote_properties[num_props]);
+      BTIF_STORAGE_FILL_PROPERTY(&remote_properties[num_props],
+                                 BT_PROPERTY_CLASS_OF_DEVICE, sizeof(cod),
+                                 &cod);
+      btif_storage_get_snapshot_property(*device,
+                                         &remote_properties[num_props]);
       num_props++;
 
-      BTIF_STORAGE_GET_REMOTE_PROP(p_remote_addr, BT_PROPERTY_TYPE_OF_DEVICE,
-                                   &devtype, sizeof(devtype),
-                                   remote_properties[num_props]);
+      BTIF_STORAGE_FILL_PROPERTY(&remote_properties[num_props],
+                                 BT_PROPERTY_TYPE_OF_DEVICE, sizeof(devtype),
+                                 &devtype);
+      btif_storage_get_snapshot_property(*device,
+                                         &remote_properties[num_props]);
       num_props++;
 
-      BTIF_STORAGE_GET_REMOTE_PROP(p_remote_addr, BT_PROPERTY_UUIDS,
-                                   remote_uuids, sizeof(remote_uuids),
-                                   remote_properties[num_props]);
-      num_props++;
+      if (!lazy) {
+        BTIF_STORAGE_FILL_PROPERTY(&remote_properties[num_props],
+                                   BT_PROPERTY_UUIDS, sizeof(remote_uuids),
+                                   remote_uuids);
+        btif_storage_get_snapshot_property(*device,
+                                           &remote_properties[num_props]);
+        num_props++;
+      }
 
-      btif_remote_properties_evt(BT_STATUS_SUCCESS, p_remote_addr, num_props,
+      btif_remote_properties_evt(BT_STATUS_SUCCESS, &remote_addr, num_props,
                                  remote_properties);
     }
   }
-  list_free(bonded_devices);
+
+  load_stats.loaded = true;
+  load_stats.lazy = lazy;
+  load_stats.sections = devices.size();
+  load_stats.bonded_devices = bonded_devices.size();
+  load_stats.snapshot_us = snapshot_us;
+  load_stats.total_us = time_get_os_boottime_us() - start_us;
+  LOG_INFO(LOG_TAG,
+           "%s: %zu bonded devices out of %zu loaded in %" PRIu64
+           " ms (snapshot %" PRIu64 " ms)%s",
+           __func__, load_stats.bonded_devices, load_stats.sections,
+           load_stats.total_us / 1000, load_stats.snapshot_us / 1000,
+           lazy ? ", properties deferred" : "");
   return BT_STATUS_SUCCESS;
 }
 
@@ -1884,12 +2134,33 @@ bool btif_storage_is_restricted_device(const RawAddress* remote_bd_addr) {
 }
 
 int btif_storage_get_num_bonded_devices(void) {
-  uint32_t num_bonded_devices = 0;
-  list_t *bonded_devices = list_new(osi_free);
-  btif_in_fetch_bonded_devices(&bonded_devices, 0);
-  num_bonded_devices = list_length(bonded_devices);
-  list_free(bonded_devices);
-  return num_bonded_devices;
+  std::vector<btif_config_device_t> devices =
+      btif_config_get_device_snapshot();
+  std::vector<const btif_config_device_t*> bonded_devices;
+  btif_in_fetch_bonded_devices(devices, &bonded_devices, 0);
+  return bonded_devices.size();
+}
+
+/*******************************************************************************
+ *
+ * Function         btif_debug_storage_dump
+ *
+ * Description      Dumps the cost of the last bonded devices load
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+void btif_debug_storage_dump(int fd) {
+  dprintf(fd, "\nBonded Devices Load:\n");
+  if (!load_stats.loaded) {
+    dprintf(fd, "  Not loaded\n");
+    return;
+  }
+  dprintf(fd, "  Device sections: %zu\n", load_stats.sections);
+  dprintf(fd, "  Bonded devices: %zu\n", load_stats.bonded_devices);
+  dprintf(fd, "  Snapshot: %" PRIu64 " us\n", load_stats.snapshot_us);
+  dprintf(fd, "  Total: %" PRIu64 " us\n", load_stats.total_us);
+  dprintf(fd, "  Deferred properties: %s\n", load_stats.lazy ? "yes" : "no");
 }
 
 /*******************************************************************************
@@ -31,6 +31,7 @@
 #include "osi/include/osi.h"
 #include "osi/include/semaphore.h"
 #include "osi/include/thread.h"
+#include "osi/include/trace_ring.h"
 
 // Temp includes
 #include "bt_utils.h"
@@ -152,6 +153,8 @@ static void event_start_up_stack(UNUSED_ATTR void* context) {
 
   ensure_stack_is_initialized();
   init_vnd_Logger();
+  // Suppressed traces are only captured when there is a logger for them.
+  trace_ring_set_vendor_enabled(logger_interface != NULL);
 
   LOG_INFO(LOG_TAG, "%s is bringing up the stack", __func__);
   future_t* local_hack_future = future_new();
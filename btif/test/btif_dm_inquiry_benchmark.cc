@@ -0,0 +1,228 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <benchmark/benchmark.h>
+#include <string.h>
+
+#include <map>
+#include <random>
+#include <vector>
+
+#include "advertise_data_parser.h"
+#include "bta_api.h"
+#include "btif_dm_inquiry.h"
+#include "btm_api.h"
+#include "osi/include/allocator.h"
+#include "osi/include/config.h"
+
+using ::benchmark::State;
+
+void LogMsg(uint32_t trace_set_mask, const char* fmt_str, ...) {}
+void vnd_LogMsg(uint32_t trace_set_mask, const char* fmt_str, ...) {}
+
+namespace {
+
+/* A dense inquiry: every device of a crowded room answers many times, with
+ * the same EIR and a jittering RSSI. */
+constexpr int kDevices = 64;
+constexpr int kResultsPerDevice = 20;
+
+struct InqResult {
+  RawAddress bd_addr;
+  DEV_CLASS dev_class;
+  int8_t rssi;
+  std::vector<uint8_t> eir;
+  tBTA_DM_SEARCH search;
+};
+
+std::vector<InqResult> MakeInquiry() {
+  std::vector<InqResult> results;
+  std::mt19937 rng(1);
+  for (int r = 0; r < kResultsPerDevice; r++) {
+    for (int d = 0; d < kDevices; d++) {
+      InqResult res;
+      for (int i = 0; i < 6; i++) res.bd_addr.address[i] = 0x10 * i + d;
+      res.dev_class[0] = 0x24;
+      res.dev_class[1] = 0x04;
+      res.dev_class[2] = 0x04;
+      /* mostly small jitter, now and then a larger step */
+      uint32_t jitter = std::uniform_int_distribution<uint32_t>(0, 47)(rng);
+      res.rssi = -60 - d % 20 + (jitter % 16 == 0 ? 8 : jitter % 3);
+
+      /* flags, 16 bit UUIDs, TX power, manufacturer data and the name last,
+       * as many devices do, padded to the EIR length */
+      std::vector<uint8_t>& eir = res.eir;
+      eir = {2, BTM_EIR_FLAGS_TYPE, 0x1a};
+      eir.insert(eir.end(), {11, BTM_EIR_COMPLETE_16BITS_UUID_TYPE, 0x0b, 0x11,
+                             0x0c, 0x11, 0x0e, 0x11, 0x1e, 0x11, 0x08, 0x11});
+      eir.insert(eir.end(), {2, BTM_EIR_TX_POWER_LEVEL_TYPE, 0x04});
+      eir.push_back(27);
+      eir.push_back(BTM_EIR_MANUFACTURER_SPECIFIC_TYPE);
+      for (int i = 0; i < 26; i++) eir.push_back(d + i);
+      char name[32];
+      int len = snprintf(name, sizeof(name), "Headset %02d", d);
+      eir.push_back(len + 1);
+      eir.push_back(BTM_EIR_COMPLETE_LOCAL_NAME_TYPE);
+      eir.insert(eir.end(), name, name + len);
+      eir.resize(HCI_EXT_INQ_RESPONSE_LEN, 0);
+      results.push_back(res);
+    }
+  }
+  for (InqResult& res : results) {
+    memset(&res.search, 0, sizeof(res.search));
+    res.search.inq_res.bd_addr = res.bd_addr;
+    memcpy(res.search.inq_res.dev_class, res.dev_class, sizeof(DEV_CLASS));
+    res.search.inq_res.rssi = res.rssi;
+    res.search.inq_res.p_eir = res.eir.data();
+    res.search.inq_res.eir_len = res.eir.size();
+  }
+  return results;
+}
+
+/* Name lookups of the original pipeline */
+bool legacy_eir_remote_name(const uint8_t* p_eir, size_t eir_len,
+                            uint8_t* p_name) {
+  uint8_t len = 0;
+  const uint8_t* p = AdvertiseDataParser::GetFieldByType(
+      p_eir, eir_len, BTM_EIR_COMPLETE_LOCAL_NAME_TYPE, &len);
+  if (!p)
+    p = AdvertiseDataParser::GetFieldByType(
+        p_eir, eir_len, BTM_EIR_SHORTENED_LOCAL_NAME_TYPE, &len);
+  if (!p) return false;
+  if (len > BD_NAME_LEN) len = BD_NAME_LEN;
+  if (p_name) {
+    memcpy(p_name, p, len);
+    p_name[len] = 0;
+  }
+  return true;
+}
+
+bool legacy_eir_name_short(const uint8_t* p_eir, size_t eir_len) {
+  uint8_t len = 0;
+  return AdvertiseDataParser::GetFieldByType(
+             p_eir, eir_len, BTM_EIR_SHORTENED_LOCAL_NAME_TYPE, &len) != NULL;
+}
+
+/* The properties written by btif_storage_add_remote_device() */
+void store_remote_device(config_t* config, const InqResult& res,
+                         const uint8_t* name) {
+  std::string section = res.bd_addr.ToString();
+  config_set_int(config, section.c_str(), "Timestamp", 1);
+  config_set_string(config, section.c_str(), "Name", (const char*)name);
+  config_set_int(config, section.c_str(), "DevClass",
+                 (res.dev_class[0] << 16) | (res.dev_class[1] << 8) |
+                     res.dev_class[2]);
+  config_set_int(config, section.c_str(), "DevType", BT_DEVICE_TYPE_BREDR);
+  config_set_int(config, section.c_str(), "AddrType", 0);
+}
+
+class BM_InquiryResults : public ::benchmark::Fixture {
+ protected:
+  void SetUp(State& st) override {
+    ::benchmark::Fixture::SetUp(st);
+    results_ = MakeInquiry();
+    config_ = config_new_empty();
+  }
+
+  void TearDown(State& st) override {
+    config_free(config_);
+    ::benchmark::Fixture::TearDown(st);
+  }
+
+  /* Context switch of one result to the btif thread */
+  static uint8_t* Transfer(const void* p, size_t len) {
+    uint8_t* p_copy = (uint8_t*)osi_malloc(len);
+    memcpy(p_copy, p, len);
+    return p_copy;
+  }
+
+  std::vector<InqResult> results_;
+  config_t* config_;
+};
+
+}  // namespace
+
+/* Each result is parsed three times, deep copied with its EIR and stored */
+BENCHMARK_DEFINE_F(BM_InquiryResults, legacy)(State& state) {
+  while (state.KeepRunning()) {
+    for (const InqResult& res : results_) {
+      const uint8_t* p_eir = res.eir.data();
+      size_t eir_len = res.eir.size();
+
+      /* BTA thread */
+      bool name_found = legacy_eir_remote_name(p_eir, eir_len, NULL);
+      uint8_t buffer[sizeof(tBTA_DM_SEARCH) + HCI_EXT_INQ_RESPONSE_LEN];
+      memcpy(buffer, &res.search, sizeof(tBTA_DM_SEARCH));
+      memcpy(buffer + sizeof(tBTA_DM_SEARCH), p_eir, eir_len);
+      uint8_t* p_param = Transfer(buffer, sizeof(buffer));
+
+      /* btif thread */
+      BD_NAME name;
+      name[0] = 0;
+      legacy_eir_remote_name(p_param + sizeof(tBTA_DM_SEARCH), eir_len, name);
+      bool shortened =
+          legacy_eir_name_short(p_param + sizeof(tBTA_DM_SEARCH), eir_len);
+      benchmark::DoNotOptimize(name_found);
+      benchmark::DoNotOptimize(shortened);
+      store_remote_device(config_, res, name);
+      osi_free(p_param);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * results_.size());
+}
+
+/* Each result is parsed once, only new or changed results go to the btif
+ * thread, without their EIR, and only changed properties are stored */
+BENCHMARK_DEFINE_F(BM_InquiryResults, single_pass)(State& state) {
+  while (state.KeepRunning()) {
+    std::map<RawAddress, uint32_t> stored;
+    btif_dm_inq_filter_reset();
+    for (const InqResult& res : results_) {
+      /* BTA thread */
+      struct {
+        tBTA_DM_SEARCH search;
+        btif_dm_eir_t eir;
+      } inq_res;
+      btif_dm_parse_eir(res.eir.data(), res.eir.size(), &inq_res.eir);
+      uint32_t hash =
+          btif_dm_hash(inq_res.eir.hash, res.dev_class, sizeof(DEV_CLASS));
+      if (btif_dm_inq_filter_is_duplicate(res.bd_addr, hash, res.rssi))
+        continue;
+      memcpy(&inq_res.search, &res.search, sizeof(tBTA_DM_SEARCH));
+      uint8_t* p_param = Transfer(&inq_res, sizeof(inq_res));
+
+      /* btif thread */
+      const btif_dm_eir_t* p_eir = &((decltype(inq_res)*)p_param)->eir;
+      uint32_t content = btif_dm_hash(BTIF_DM_HASH_INIT, p_eir->name,
+                                      p_eir->name_len);
+      content = btif_dm_hash(content, res.dev_class, sizeof(DEV_CLASS));
+      auto it = stored.find(res.bd_addr);
+      if (it == stored.end() || it->second != content) {
+        stored[res.bd_addr] = content;
+        store_remote_device(config_, res, p_eir->name);
+      }
+      osi_free(p_param);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * results_.size());
+}
+
+BENCHMARK_REGISTER_F(BM_InquiryResults, legacy);
+BENCHMARK_REGISTER_F(BM_InquiryResults, single_pass);
+
+BENCHMARK_MAIN();
@@ -17,9 +17,16 @@
  ******************************************************************************/
 
 #include <gtest/gtest.h>
+#include <inttypes.h>
+#include <time.h>
 
+#include <string>
+#include <vector>
+
+#include "btif/include/btif_config.h"
 #include "btif/include/btif_storage.h"
 #include "btif/include/btif_util.h"
+#include "osi/include/config.h"
 
 using bluetooth::Uuid;
 
@@ -48,3 +55,206 @@ TEST(BtifStorageTest, test_uuid_split_partial) {
   size_t num_uuids = btif_split_uuids_string(s1, uuids, 1);
   EXPECT_EQ(num_uuids, 1u);
 }
+
+namespace {
+
+const char* kTestUuids =
+    "0000110a-0000-1000-8000-00805f9b34fb "
+    "0000111e-0000-1000-8000-00805f9b34fb ";
+
+const size_t kTestBondedDevices = 1000;
+
+std::string test_device_address(size_t i) {
+  char address[18];
+  snprintf(address, sizeof(address), "00:11:22:33:%02x:%02x",
+           (unsigned)((i >> 8) & 0xff), (unsigned)(i & 0xff));
+  return address;
+}
+
+// A config file with |kTestBondedDevices| bonded devices, along with the
+// sections which are not devices.
+config_t* new_bonded_devices_config() {
+  config_t* config = config_new_empty();
+  config_set_string(config, "Info", "FileSource", "Empty");
+  config_set_string(config, "Adapter", "Address", "01:02:03:04:05:06");
+  config_set_string(config, "Adapter", "Name", "Test Adapter");
+
+  for (size_t i = 0; i < kTestBondedDevices; i++) {
+    std::string address = test_device_address(i);
+    const char* section = address.c_str();
+    std::string name = "Device " + std::to_string(i);
+    char link_key[33];
+    for (size_t j = 0; j < 16; j++)
+      snprintf(&link_key[j * 2], 3, "%02x", (unsigned)((i + j) & 0xff));
+
+    config_set_string(config, section, "Name", name.c_str());
+    config_set_string(config, section, "DevClass", "2360340");
+    config_set_string(config, section, "DevType", "1");
+    config_set_string(config, section, "AddrType", "0");
+    config_set_string(config, section, "Service", kTestUuids);
+    config_set_string(config, section, "LinkKeyType", "4");
+    config_set_string(config, section, "PinLength", "0");
+    config_set_string(config, section, "LinkKey", link_key);
+  }
+  return config;
+}
+
+uint64_t now_us() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+}  // namespace
+
+TEST(BtifStorageTest, test_snapshot_bonded_devices) {
+  config_t* config = new_bonded_devices_config();
+
+  std::vector<btif_config_device_t> devices =
+      btif_config_snapshot_devices(config);
+  ASSERT_EQ(devices.size(), kTestBondedDevices);
+
+  for (size_t i = 0; i < kTestBondedDevices; i++) {
+    const btif_config_device_t& device = devices[i];
+    EXPECT_EQ(device.address.ToString(), test_device_address(i));
+    EXPECT_EQ(device.entries.size(), 8u);
+
+    const std::string* name = btif_config_device_get_str(device, "Name");
+    ASSERT_NE(name, nullptr);
+    EXPECT_EQ(*name, "Device " + std::to_string(i));
+
+    int link_key_type = 0;
+    EXPECT_TRUE(
+        btif_config_device_get_int(device, "LinkKeyType", &link_key_type));
+    EXPECT_EQ(link_key_type, 4);
+
+    LinkKey link_key;
+    size_t size = link_key.size();
+    EXPECT_TRUE(btif_config_device_get_bin(device, "LinkKey", link_key.data(),
+                                           &size));
+    EXPECT_EQ(size, link_key.size());
+    for (size_t j = 0; j < link_key.size(); j++)
+      EXPECT_EQ(link_key[j], (uint8_t)((i + j) & 0xff));
+  }
+
+  config_free(config);
+}
+
+TEST(BtifStorageTest, test_snapshot_missing_and_invalid_keys) {
+  config_t* config = config_new_empty();
+  config_set_string(config, "00:11:22:33:44:55", "DevClass", "not a number");
+  config_set_string(config, "00:11:22:33:44:55", "LinkKey", "abc");
+  config_set_string(config, "00:11:22:33:44:55", "LE_KEY_PID", "zz");
+
+  std::vector<btif_config_device_t> devices =
+      btif_config_snapshot_devices(config);
+  ASSERT_EQ(devices.size(), 1u);
+
+  // Same as btif_config_get_int(): the value is left untouched.
+  int value = 42;
+  EXPECT_TRUE(btif_config_device_get_int(devices[0], "DevClass", &value));
+  EXPECT_EQ(value, 42);
+  EXPECT_FALSE(btif_config_device_get_int(devices[0], "DevType", &value));
+  EXPECT_EQ(btif_config_device_get_str(devices[0], "Name"), nullptr);
+
+  uint8_t bin[16];
+  size_t size = sizeof(bin);
+  EXPECT_FALSE(btif_config_device_get_bin(devices[0], "LinkKey", bin, &size));
+  EXPECT_FALSE(
+      btif_config_device_get_bin(devices[0], "LE_KEY_PID", bin, &size));
+  EXPECT_FALSE(
+      btif_config_device_get_bin(devices[0], "LE_KEY_PENC", bin, &size));
+
+  config_free(config);
+}
+
+TEST(BtifStorageTest, test_snapshot_property) {
+  config_t* config = new_bonded_devices_config();
+  std::vector<btif_config_device_t> devices =
+      btif_config_snapshot_devices(config);
+  ASSERT_EQ(devices.size(), kTestBondedDevices);
+  const btif_config_device_t& device = devices[7];
+
+  bt_bdname_t name;
+  bt_property_t prop;
+  BTIF_STORAGE_FILL_PROPERTY(&prop, BT_PROPERTY_BDNAME, sizeof(name), &name);
+  EXPECT_TRUE(btif_storage_get_snapshot_property(device, &prop));
+  EXPECT_EQ(prop.len, 8);
+  EXPECT_STREQ((char*)name.name, "Device 7");
+
+  // The name is truncated to the buffer, like btif_config_get_str() does.
+  char short_name[4];
+  BTIF_STORAGE_FILL_PROPERTY(&prop, BT_PROPERTY_BDNAME, sizeof(short_name),
+                             short_name);
+  EXPECT_TRUE(btif_storage_get_snapshot_property(device, &prop));
+  EXPECT_EQ(prop.len, 3);
+  EXPECT_STREQ(short_name, "Dev");
+
+  BTIF_STORAGE_FILL_PROPERTY(&prop, BT_PROPERTY_REMOTE_FRIENDLY_NAME,
+                             sizeof(name), &name);
+  EXPECT_FALSE(btif_storage_get_snapshot_property(device, &prop));
+  EXPECT_EQ(prop.len, 0);
+
+  uint32_t cod = 0;
+  BTIF_STORAGE_FILL_PROPERTY(&prop, BT_PROPERTY_CLASS_OF_DEVICE, sizeof(cod),
+                             &cod);
+  EXPECT_TRUE(btif_storage_get_snapshot_property(device, &prop));
+  EXPECT_EQ(cod, 2360340u);
+
+  uint32_t devtype = 0;
+  BTIF_STORAGE_FILL_PROPERTY(&prop, BT_PROPERTY_TYPE_OF_DEVICE,
+                             sizeof(devtype), &devtype);
+  EXPECT_TRUE(btif_storage_get_snapshot_property(device, &prop));
+  EXPECT_EQ(devtype, 1u);
+
+  Uuid uuids[BT_MAX_NUM_UUIDS];
+  BTIF_STORAGE_FILL_PROPERTY(&prop, BT_PROPERTY_UUIDS, sizeof(uuids), uuids);
+  EXPECT_TRUE(btif_storage_get_snapshot_property(device, &prop));
+  EXPECT_EQ(prop.len, (int)(2 * sizeof(Uuid)));
+  EXPECT_EQ(uuids[0], Uuid::From16Bit(0x110a));
+  EXPECT_EQ(uuids[1], Uuid::From16Bit(0x111e));
+
+  BTIF_STORAGE_FILL_PROPERTY(&prop, BT_PROPERTY_REMOTE_VERSION_INFO,
+                             sizeof(uuids), uuids);
+  EXPECT_FALSE(btif_storage_get_snapshot_property(device, &prop));
+
+  config_free(config);
+}
+
+// Reading the bonded devices from a snapshot does not walk the sections for
+// every key, unlike the config lookups it replaces.
+TEST(BtifStorageTest, test_snapshot_faster_than_config_lookups) {
+  static const char* kKeys[] = {"LinkKey", "LinkKeyType", "DevClass",
+                                "PinLength", "DevType",   "Name",
+                                "Service"};
+  config_t* config = new_bonded_devices_config();
+
+  uint64_t start_us = now_us();
+  size_t found = 0;
+  for (const config_section_node_t* snode = config_section_begin(config);
+       snode != config_section_end(config); snode = config_section_next(snode)) {
+    const char* section = config_section_name(snode);
+    if (!RawAddress::IsValidAddress(section)) continue;
+    for (const char* key : kKeys)
+      if (config_get_string(config, section, key, NULL)) found++;
+  }
+  uint64_t lookup_us = now_us() - start_us;
+  EXPECT_EQ(found, kTestBondedDevices * 7);
+
+  start_us = now_us();
+  found = 0;
+  std::vector<btif_config_device_t> devices =
+      btif_config_snapshot_devices(config);
+  for (const btif_config_device_t& device : devices)
+    for (const char* key : kKeys)
+      if (btif_config_device_get_str(device, key)) found++;
+  uint64_t snapshot_us = now_us() - start_us;
+  EXPECT_EQ(found, kTestBondedDevices * 7);
+
+  printf("%zu bonded devices: config lookups %" PRIu64 " us, snapshot %" PRIu64
+         " us\n",
+         kTestBondedDevices, lookup_us, snapshot_us);
+  EXPECT_LT(snapshot_us, lookup_us);
+
+  config_free(config);
+}
@@ -0,0 +1,139 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <functional>
+#include <vector>
+
+#include "btsnoop_reader.h"
+
+// Sidecar index of a btsnoop log, written by btsnoop.cc next to the log as
+// "<log>.idx" and rotated together with it. The log is cut in blocks of
+// |interval| packets and the index holds one entry per block, so that tools
+// can seek straight to a time range and skip the blocks which do not carry a
+// given connection handle or L2CAP channel.
+//
+// The index starts with a 16 byte header: the "btsnpidx" magic, then the
+// version and the interval as little endian uint32. It is followed by
+// entries of BTSNOOP_INDEX_ENTRY_SIZE bytes, little endian as well. A block
+// still being written when the stack died has no entry, readers scan the log
+// from the end of the last indexed block instead.
+
+#define BTSNOOP_INDEX_VERSION 1
+#define BTSNOOP_INDEX_HEADER_SIZE 16
+#define BTSNOOP_INDEX_ENTRY_SIZE 72
+
+typedef struct {
+  // Log offsets of the first record of the block and past its last record.
+  uint64_t offset;
+  uint64_t end_offset;
+  // Capture time of the first and last records, as in |btsnoop_record_t|.
+  uint64_t first_timestamp_us;
+  uint64_t last_timestamp_us;
+  // Bloom masks of the ACL and SCO handles, and of the L2CAP channels, which
+  // have packets in the block, see |btsnoop_index_bit|. The channel of every
+  // ACL fragment counts, as well as the channels of the PDUs which are still
+  // being reassembled when the block starts, also in |pending_cid_mask|.
+  uint64_t handle_mask;
+  uint64_t cid_mask;
+  uint64_t pending_cid_mask;
+  uint32_t packet_count;
+  // First packet of the block.
+  uint16_t handle;
+  uint16_t cid;
+  uint16_t opcode;
+  uint8_t type;
+  bool is_received;
+} btsnoop_index_entry_t;
+
+// What the index knows about a single packet.
+typedef struct {
+  // Connection handle of ACL and SCO packets.
+  uint16_t handle;
+  // L2CAP channel of the first fragment of an ACL PDU, 0 for continuation
+  // fragments.
+  uint16_t cid;
+  // Opcode of commands, event code of events.
+  uint16_t opcode;
+  bool is_pdu_start;
+  // ACL data length of the fragment, and for the first fragment the length
+  // of the whole PDU, L2CAP header included.
+  uint16_t acl_length;
+  uint32_t pdu_length;
+} btsnoop_index_key_t;
+
+// Extracts the index key of an HCI packet of |type|, without the H4 type
+// byte. |length| may be the truncated length of a filtered log.
+void btsnoop_index_parse(btsnoop_packet_type_t type, const uint8_t* data,
+                         size_t length, btsnoop_index_key_t* key);
+
+// Returns the bit of |value| in the handle and channel masks.
+uint64_t btsnoop_index_bit(uint16_t value);
+
+typedef struct btsnoop_index_writer_t btsnoop_index_writer_t;
+
+// Creates the index at |path|, with an entry every |interval| packets.
+// Returns NULL if the index can not be written.
+btsnoop_index_writer_t* btsnoop_index_writer_open(const char* path,
+                                                  uint32_t interval);
+
+// Writes the entry of the last, partial block and closes |writer|, which may
+// be NULL.
+void btsnoop_index_writer_close(btsnoop_index_writer_t* writer);
+
+// Adds the record of |record_size| bytes written at |offset| of the log.
+// |data| is the HCI packet of the record, without the H4 type byte.
+void btsnoop_index_writer_add(btsnoop_index_writer_t* writer,
+                              btsnoop_packet_type_t type, bool is_received,
+                              uint64_t timestamp_us, uint64_t offset,
+                              uint32_t record_size, const uint8_t* data,
+                              size_t length);
+
+// Reads the index at |path| into |entries|, in log order. Returns false if it
+// is not a btsnoop index. A truncated last entry is dropped.
+bool btsnoop_index_load(const char* path, uint32_t* interval,
+                        std::vector<btsnoop_index_entry_t>* entries);
+
+typedef struct {
+  // Capture time range, inclusive.
+  uint64_t start_us;
+  uint64_t end_us;
+  // Connection handle and L2CAP channel of the packets to keep, -1 for any.
+  // Only ACL and SCO packets have a handle, and only ACL ones a channel.
+  int handle;
+  int cid;
+} btsnoop_index_query_t;
+
+// Called for each record of a query, with the key of the record. The channel
+// of the key is the one of the PDU for continuation fragments as well.
+typedef std::function<void(const btsnoop_record_t& record,
+                           const btsnoop_index_key_t& key)>
+    btsnoop_index_query_cb;
+
+// Calls |callback| for the records of |reader| matching |query|, reading only
+// the blocks of |entries| which may hold some. |entries| may be empty to scan
+// the whole log. Returns the number of records read.
+size_t btsnoop_index_query(btsnoop_reader_t* reader,
+                           const std::vector<btsnoop_index_entry_t>& entries,
+                           const btsnoop_index_query_t& query,
+                           const btsnoop_index_query_cb& callback);
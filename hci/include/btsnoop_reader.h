@@ -0,0 +1,73 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Reads the btsnoop logs written by btsnoop.cc (datalink H4, 1002) as well as
+// unencapsulated HCI logs (datalink 1001) from other tools.
+
+// Packet types, as used by H4 and by the btsnoop writer.
+typedef enum {
+  BTSNOOP_PACKET_COMMAND = 1,
+  BTSNOOP_PACKET_ACL = 2,
+  BTSNOOP_PACKET_SCO = 3,
+  BTSNOOP_PACKET_EVENT = 4,
+} btsnoop_packet_type_t;
+
+typedef struct {
+  btsnoop_packet_type_t type;
+  // True for controller to host packets.
+  bool is_received;
+  // Capture time in microseconds since the unix epoch.
+  uint64_t timestamp_us;
+  // Length of the HCI packet, not including the H4 type byte.
+  uint32_t length;
+  // Number of bytes at |data|, smaller than |length| if the packet was
+  // truncated by a filtered snoop log.
+  uint32_t captured_length;
+  // HCI packet, without the H4 type byte. Only valid until the next call to
+  // |btsnoop_reader_next| or |btsnoop_reader_seek|.
+  const uint8_t* data;
+  // Offset of the record in the file, for |btsnoop_reader_seek|.
+  uint64_t offset;
+} btsnoop_record_t;
+
+typedef struct btsnoop_reader_t btsnoop_reader_t;
+
+// Opens the btsnoop log at |path|. Returns NULL if the file can not be read or
+// is not a supported btsnoop log.
+btsnoop_reader_t* btsnoop_reader_open(const char* path);
+
+// Closes |reader|, which may be NULL.
+void btsnoop_reader_close(btsnoop_reader_t* reader);
+
+// Reads the next record into |record|. Returns false at the end of the log,
+// or on a truncated or malformed record.
+bool btsnoop_reader_next(btsnoop_reader_t* reader, btsnoop_record_t* record);
+
+// Moves |reader| to the record at |offset|, as returned in
+// |btsnoop_record_t.offset|. Returns false if |offset| is out of the log.
+bool btsnoop_reader_seek(btsnoop_reader_t* reader, uint64_t offset);
+
+// Returns true if the last |btsnoop_reader_next| stopped on a malformed
+// record rather than at the end of the log.
+bool btsnoop_reader_has_error(const btsnoop_reader_t* reader);
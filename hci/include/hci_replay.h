@@ -0,0 +1,60 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Fake HCI HAL replaying a btsnoop log, linked in place of the HIDL HAL
+// (hci_layer_android.cc) by libbt-hci-replay_qti.
+//
+// Controller to host events, ACL and SCO packets of the log are delivered to
+// the host stack with their original timing, scaled by |speed|. The host to
+// controller packets of the log are what the host is expected to send back:
+// a controller packet is not delivered before the host sent the commands
+// that precede it in the log, so responses never overtake their command.
+// Commands are matched by opcode, data packets by handle and length.
+
+typedef struct {
+  // The btsnoop log to replay.
+  const char* trace_path;
+  // Replay speed relative to the log, 0 replays as fast as the host keeps up.
+  float speed;
+  // How long to wait for a command the log expects from the host before
+  // counting it missing and going on.
+  uint32_t sync_timeout_ms;
+  // How many pending expected commands a command sent by the host may skip
+  // to find its match, to tolerate reordering.
+  size_t match_window;
+  // Answer the commands that are not in the log with a successful Command
+  // Complete, so the host does not stall on them.
+  bool auto_respond;
+} hci_replay_config_t;
+
+// Sets the replay configuration. Must be called before the HCI module starts.
+void hci_replay_set_config(const hci_replay_config_t* config);
+
+// Waits until every controller packet of the log was delivered. Returns false
+// on timeout or if the replay did not start.
+bool hci_replay_wait_for_completion(uint64_t timeout_ms);
+
+// Writes the per-packet delivery cost, host response latency compared to the
+// log, stalls and verification results to |fd|.
+void hci_replay_dump(int fd);
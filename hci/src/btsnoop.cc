@@ -41,6 +41,7 @@
 
 #include "bt_types.h"
 #include "hci/include/btsnoop.h"
+#include "hci/include/btsnoop_index.h"
 #include "hci/include/btsnoop_mem.h"
 #include "hci_layer.h"
 #include "internal_include/bt_trace.h"
@@ -85,6 +86,10 @@
   #define DEFAULT_BTSNOOP_PATH "btsnoop_hci.log"
 #endif  //OFF_TARGET_TEST_ENABLED
 #define BTSNOOP_MAX_PACKETS_PROPERTY "persist.bluetooth.btsnoopsize"
+// Packets per entry of the sidecar index, see btsnoop_index.h. 0 disables
+// the index.
+#define BTSNOOP_INDEX_INTERVAL_PROPERTY "persist.bluetooth.btsnoopindexinterval"
+#define DEFAULT_BTSNOOP_INDEX_INTERVAL 0
 
 typedef enum {
   kCommandPacket = 1,
@@ -120,6 +125,12 @@ static std::mutex btSnoopFd_mutex;
 
 static int32_t packets_per_file;
 static int32_t packet_counter;
+
+// Sidecar index of the log file being written, and where the next record of
+// that file starts.
+static btsnoop_index_writer_t* index_writer = NULL;
+static uint32_t index_interval;
+static uint64_t logfile_offset;
 static bool sock_snoop_active = false;
 
 extern bt_logger_interface_t *logger_interface;
@@ -368,6 +379,7 @@ static bool is_avdt_media_packet(const uint8_t *p, bool is_local_cid);
 static void delete_btsnoop_files(bool filtered);
 static std::string get_btsnoop_log_path(bool filtered);
 static std::string get_btsnoop_last_log_path(std::string log_path);
+static std::string get_btsnoop_index_path(std::string log_path);
 static void open_next_snoop_file();
 static void btsnoop_write_packet(packet_type_t type, uint8_t* packet,
                                  bool is_received, uint64_t timestamp_us);
@@ -487,6 +499,9 @@ static future_t* start_up() {
   }
 
   if (is_btsnoop_enabled || is_vndbtsnoop_enabled) {
+    int32_t interval = osi_property_get_int32(BTSNOOP_INDEX_INTERVAL_PROPERTY,
+                                              DEFAULT_BTSNOOP_INDEX_INTERVAL);
+    index_interval = interval > 0 ? interval : 0;
     open_next_snoop_file();
     packets_per_file = (//osi_property_get_int32(BTSNOOP_MAX_PACKETS_PROPERTY,
                                               DEFAULT_BTSNOOP_SIZE);
@@ -515,6 +530,8 @@ static future_t* shut_down(void) {
 
   if (logfile_fd != INVALID_FD) close(logfile_fd);
   logfile_fd = INVALID_FD;
+  btsnoop_index_writer_close(index_writer);
+  index_writer = NULL;
 
   if(is_vndbtsnoop_enabled) STOP_SNOOP_LOGGING();
   if (is_btsnoop_enabled) btsnoop_net_close();
@@ -895,8 +912,11 @@ static void delete_btsnoop_files(bool filtered) {
   LOG(INFO) << __func__
             << ": Deleting snoop logs if they exist. filtered = " << filtered;
   auto log_path = get_btsnoop_log_path(filtered);
+  auto last_log_path = get_btsnoop_last_log_path(log_path);
   remove(log_path.c_str());
-  remove(get_btsnoop_last_log_path(log_path).c_str());
+  remove(last_log_path.c_str());
+  remove(get_btsnoop_index_path(log_path).c_str());
+  remove(get_btsnoop_index_path(last_log_path).c_str());
 }
 
 std::string get_btsnoop_log_path(bool filtered) {
@@ -912,6 +932,10 @@ std::string get_btsnoop_last_log_path(std::string btsnoop_path) {
   return btsnoop_path.append(".last");
 }
 
+std::string get_btsnoop_index_path(std::string btsnoop_path) {
+  return btsnoop_path.append(".idx");
+}
+
 static void open_next_snoop_file() {
   packet_counter = 0;
 
@@ -923,14 +947,23 @@ static void open_next_snoop_file() {
     close(logfile_fd);
     logfile_fd = INVALID_FD;
   }
+  btsnoop_index_writer_close(index_writer);
+  index_writer = NULL;
 
   auto log_path = get_btsnoop_log_path(is_btsnoop_filtered);
   auto last_log_path = get_btsnoop_last_log_path(log_path);
+  auto index_path = get_btsnoop_index_path(log_path);
+  auto last_index_path = get_btsnoop_index_path(last_log_path);
 
   if (rename(log_path.c_str(), last_log_path.c_str()) != 0 && errno != ENOENT)
     LOG(ERROR) << __func__ << ": unable to rename '" << log_path << "' to '"
                << last_log_path << "' : " << strerror(errno);
 
+  // The index follows its log, a stale one would point into the wrong file.
+  if (rename(index_path.c_str(), last_index_path.c_str()) != 0 &&
+      errno == ENOENT)
+    remove(last_index_path.c_str());
+
   mode_t prevmask = umask(0);
   logfile_fd = open(log_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC,
                     S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH);
@@ -942,6 +975,11 @@ static void open_next_snoop_file() {
   }
 
   write(logfile_fd, "btsnoop\0\0\0\0\1\0\0\x3\xea", 16);
+  logfile_offset = 16;
+
+  if (index_interval > 0)
+    index_writer =
+        btsnoop_index_writer_open(index_path.c_str(), index_interval);
 }
 
 typedef struct {
@@ -1093,7 +1131,14 @@ static void btsnoop_write_packet(packet_type_t type, uint8_t* packet,
 
     status = poll(&fds, 1, 0);
     if(status > 0 && fds.revents & POLLOUT) {
-      TEMP_FAILURE_RETRY(writev(logfile_fd, iov, 2));
+      ssize_t written = TEMP_FAILURE_RETRY(writev(logfile_fd, iov, 2));
+      if (written > 0 && !sock_snoop_active) {
+        if (index_writer != NULL)
+          btsnoop_index_writer_add(index_writer, (btsnoop_packet_type_t)type,
+                                   flags & 1, timestamp_us, logfile_offset,
+                                   written, packet, length_he - 1);
+        logfile_offset += written;
+      }
     } else if (status == 0) {
       LOG_WARN(LOG_TAG, "%s poll() timeout", __func__);
     } else if (status == -1) {
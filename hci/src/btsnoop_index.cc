@@ -0,0 +1,406 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#define LOG_TAG "bt_snoop_index"
+
+#include "btsnoop_index.h"
+
+#include <base/logging.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <unordered_map>
+
+#include "osi/include/log.h"
+#include "osi/include/osi.h"
+
+static const char INDEX_MAGIC[] = "btsnpidx";
+
+// Where the first record of a btsnoop log starts.
+static const uint64_t LOG_HEADER_SIZE = 16;
+
+// Blocks read before the start of a time range to find the channel of the
+// continuation fragments at its start. PDUs spanning more blocks than this
+// lose the continuation fragments at the start of the range.
+static const long MAX_WARM_UP_BLOCKS = 8;
+
+static const uint16_t HANDLE_MASK = 0x0fff;
+static const uint8_t CONTINUATION_PACKET_BOUNDARY = 1;
+
+typedef struct {
+  uint16_t cid;
+  // Bytes still to come in continuation fragments.
+  uint32_t remaining;
+} pending_pdu_t;
+
+struct btsnoop_index_writer_t {
+  int fd;
+  uint32_t interval;
+  // Block being filled, written out once |interval| packets are in.
+  btsnoop_index_entry_t block;
+  // PDU being reassembled on each ACL handle.
+  std::unordered_map<uint16_t, pending_pdu_t> pending_pdus;
+};
+
+static void write_le16(uint8_t* p, uint16_t value) {
+  p[0] = value;
+  p[1] = value >> 8;
+}
+
+static void write_le32(uint8_t* p, uint32_t value) {
+  write_le16(p, value);
+  write_le16(p + 2, value >> 16);
+}
+
+static void write_le64(uint8_t* p, uint64_t value) {
+  write_le32(p, value);
+  write_le32(p + 4, value >> 32);
+}
+
+static uint16_t read_le16(const uint8_t* p) { return p[0] | (p[1] << 8); }
+
+static uint32_t read_le32(const uint8_t* p) {
+  return read_le16(p) | ((uint32_t)read_le16(p + 2) << 16);
+}
+
+static uint64_t read_le64(const uint8_t* p) {
+  return read_le32(p) | ((uint64_t)read_le32(p + 4) << 32);
+}
+
+static void encode_entry(const btsnoop_index_entry_t& entry, uint8_t* p) {
+  memset(p, 0, BTSNOOP_INDEX_ENTRY_SIZE);
+  write_le64(p, entry.offset);
+  write_le64(p + 8, entry.end_offset);
+  write_le64(p + 16, entry.first_timestamp_us);
+  write_le64(p + 24, entry.last_timestamp_us);
+  write_le64(p + 32, entry.handle_mask);
+  write_le64(p + 40, entry.cid_mask);
+  write_le64(p + 48, entry.pending_cid_mask);
+  write_le32(p + 56, entry.packet_count);
+  write_le16(p + 60, entry.handle);
+  write_le16(p + 62, entry.cid);
+  write_le16(p + 64, entry.opcode);
+  p[66] = entry.type;
+  p[67] = entry.is_received;
+}
+
+static void decode_entry(const uint8_t* p, btsnoop_index_entry_t* entry) {
+  entry->offset = read_le64(p);
+  entry->end_offset = read_le64(p + 8);
+  entry->first_timestamp_us = read_le64(p + 16);
+  entry->last_timestamp_us = read_le64(p + 24);
+  entry->handle_mask = read_le64(p + 32);
+  entry->cid_mask = read_le64(p + 40);
+  entry->pending_cid_mask = read_le64(p + 48);
+  entry->packet_count = read_le32(p + 56);
+  entry->handle = read_le16(p + 60);
+  entry->cid = read_le16(p + 62);
+  entry->opcode = read_le16(p + 64);
+  entry->type = p[66];
+  entry->is_received = p[67] != 0;
+}
+
+void btsnoop_index_parse(btsnoop_packet_type_t type, const uint8_t* data,
+                         size_t length, btsnoop_index_key_t* key) {
+  CHECK(key != NULL);
+
+  memset(key, 0, sizeof(*key));
+  switch (type) {
+    case BTSNOOP_PACKET_COMMAND:
+      if (length >= 2) key->opcode = read_le16(data);
+      break;
+    case BTSNOOP_PACKET_EVENT:
+      if (length >= 1) key->opcode = data[0];
+      break;
+    case BTSNOOP_PACKET_ACL:
+      if (length < 2) break;
+      key->handle = read_le16(data) & HANDLE_MASK;
+      key->is_pdu_start =
+          ((data[1] >> 4) & 0x03) != CONTINUATION_PACKET_BOUNDARY;
+      if (length >= 4) key->acl_length = read_le16(data + 2);
+      // HCI header, then L2CAP length and channel.
+      if (key->is_pdu_start && length >= 8) {
+        key->pdu_length = read_le16(data + 4) + 4;
+        key->cid = read_le16(data + 6);
+      }
+      break;
+    case BTSNOOP_PACKET_SCO:
+      if (length >= 2) key->handle = read_le16(data) & HANDLE_MASK;
+      break;
+  }
+}
+
+uint64_t btsnoop_index_bit(uint16_t value) {
+  // Multiplicative hash, so that the consecutive handles and dynamic channels
+  // allocated by the controller and the stack land on different bits.
+  return 1ULL << (((uint32_t)value * 2654435761u) >> 26);
+}
+
+static void write_block(btsnoop_index_writer_t* writer) {
+  if (writer->block.packet_count == 0) return;
+
+  uint8_t buffer[BTSNOOP_INDEX_ENTRY_SIZE];
+  encode_entry(writer->block, buffer);
+  ssize_t ret;
+  OSI_NO_INTR(ret = write(writer->fd, buffer, sizeof(buffer)));
+  if (ret != (ssize_t)sizeof(buffer)) {
+    LOG_ERROR(LOG_TAG, "%s unable to write index entry: %s", __func__,
+              strerror(errno));
+  }
+  writer->block.packet_count = 0;
+}
+
+btsnoop_index_writer_t* btsnoop_index_writer_open(const char* path,
+                                                  uint32_t interval) {
+  CHECK(path != NULL);
+  CHECK(interval > 0);
+
+  mode_t prevmask = umask(0);
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC,
+                S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH);
+  umask(prevmask);
+  if (fd == INVALID_FD) {
+    LOG_ERROR(LOG_TAG, "%s unable to open '%s': %s", __func__, path,
+              strerror(errno));
+    return NULL;
+  }
+
+  uint8_t header[BTSNOOP_INDEX_HEADER_SIZE];
+  memcpy(header, INDEX_MAGIC, 8);
+  write_le32(header + 8, BTSNOOP_INDEX_VERSION);
+  write_le32(header + 12, interval);
+  ssize_t ret;
+  OSI_NO_INTR(ret = write(fd, header, sizeof(header)));
+  if (ret != (ssize_t)sizeof(header)) {
+    LOG_ERROR(LOG_TAG, "%s unable to write '%s': %s", __func__, path,
+              strerror(errno));
+    close(fd);
+    return NULL;
+  }
+
+  btsnoop_index_writer_t* writer = new btsnoop_index_writer_t();
+  writer->fd = fd;
+  writer->interval = interval;
+  return writer;
+}
+
+void btsnoop_index_writer_close(btsnoop_index_writer_t* writer) {
+  if (writer == NULL) return;
+
+  write_block(writer);
+  close(writer->fd);
+  delete writer;
+}
+
+void btsnoop_index_writer_add(btsnoop_index_writer_t* writer,
+                              btsnoop_packet_type_t type, bool is_received,
+                              uint64_t timestamp_us, uint64_t offset,
+                              uint32_t record_size, const uint8_t* data,
+                              size_t length) {
+  CHECK(writer != NULL);
+
+  btsnoop_index_key_t key;
+  btsnoop_index_parse(type, data, length, &key);
+
+  btsnoop_index_entry_t& block = writer->block;
+  if (block.packet_count == 0) {
+    memset(&block, 0, sizeof(block));
+    block.offset = offset;
+    block.first_timestamp_us = timestamp_us;
+    block.handle = key.handle;
+    block.cid = key.cid;
+    block.opcode = key.opcode;
+    block.type = type;
+    block.is_received = is_received;
+    // The continuation fragments at the start of the block belong to these.
+    for (const auto& pdu : writer->pending_pdus)
+      block.pending_cid_mask |= btsnoop_index_bit(pdu.second.cid);
+    block.cid_mask = block.pending_cid_mask;
+  }
+
+  if (type == BTSNOOP_PACKET_ACL) {
+    if (key.is_pdu_start) {
+      if (key.pdu_length > key.acl_length)
+        writer->pending_pdus[key.handle] = {key.cid,
+                                            key.pdu_length - key.acl_length};
+      else
+        writer->pending_pdus.erase(key.handle);
+    } else {
+      auto pdu = writer->pending_pdus.find(key.handle);
+      if (pdu != writer->pending_pdus.end()) {
+        key.cid = pdu->second.cid;
+        if (pdu->second.remaining > key.acl_length)
+          pdu->second.remaining -= key.acl_length;
+        else
+          writer->pending_pdus.erase(pdu);
+      }
+    }
+    block.handle_mask |= btsnoop_index_bit(key.handle);
+    if (key.cid != 0) block.cid_mask |= btsnoop_index_bit(key.cid);
+  } else if (type == BTSNOOP_PACKET_SCO) {
+    block.handle_mask |= btsnoop_index_bit(key.handle);
+  }
+
+  block.end_offset = offset + record_size;
+  block.last_timestamp_us = timestamp_us;
+  if (++block.packet_count == writer->interval) write_block(writer);
+}
+
+bool btsnoop_index_load(const char* path, uint32_t* interval,
+                        std::vector<btsnoop_index_entry_t>* entries) {
+  CHECK(path != NULL);
+  CHECK(entries != NULL);
+
+  FILE* file = fopen(path, "rb");
+  if (file == NULL) return false;
+
+  uint8_t header[BTSNOOP_INDEX_HEADER_SIZE];
+  if (fread(header, 1, sizeof(header), file) != sizeof(header) ||
+      memcmp(header, INDEX_MAGIC, 8) != 0 ||
+      read_le32(header + 8) != BTSNOOP_INDEX_VERSION ||
+      read_le32(header + 12) == 0) {
+    LOG_ERROR(LOG_TAG, "%s '%s' is not a btsnoop index", __func__, path);
+    fclose(file);
+    return false;
+  }
+  if (interval != NULL) *interval = read_le32(header + 12);
+
+  entries->clear();
+  uint8_t buffer[BTSNOOP_INDEX_ENTRY_SIZE];
+  while (fread(buffer, 1, sizeof(buffer), file) == sizeof(buffer)) {
+    btsnoop_index_entry_t entry;
+    decode_entry(buffer, &entry);
+    entries->push_back(entry);
+  }
+  fclose(file);
+  return true;
+}
+
+static bool block_may_match(const btsnoop_index_entry_t& entry,
+                            const btsnoop_index_query_t& query) {
+  if (entry.last_timestamp_us < query.start_us) return false;
+  if (query.handle >= 0 &&
+      !(entry.handle_mask & btsnoop_index_bit(query.handle)))
+    return false;
+  if (query.cid >= 0 && !(entry.cid_mask & btsnoop_index_bit(query.cid)))
+    return false;
+  return true;
+}
+
+
+// Reads the records of |reader| before |end_offset| and reports the matching
+// ones if |report|. |pdu_cids| tracks the channel of the PDU reassembled on
+// each handle.
+static size_t scan(btsnoop_reader_t* reader, uint64_t end_offset,
+                   const btsnoop_index_query_t& query,
+                   std::unordered_map<uint16_t, uint16_t>* pdu_cids,
+                   bool report, const btsnoop_index_query_cb& callback) {
+  size_t count = 0;
+  btsnoop_record_t record;
+  while (btsnoop_reader_next(reader, &record)) {
+    if (record.offset >= end_offset) {
+      // Leave it to the next block.
+      btsnoop_reader_seek(reader, record.offset);
+      break;
+    }
+    count++;
+
+    btsnoop_index_key_t key;
+    btsnoop_index_parse(record.type, record.data, record.captured_length,
+                        &key);
+    if (record.type == BTSNOOP_PACKET_ACL) {
+      if (key.is_pdu_start) {
+        (*pdu_cids)[key.handle] = key.cid;
+      } else {
+        auto pdu = pdu_cids->find(key.handle);
+        if (pdu != pdu_cids->end()) key.cid = pdu->second;
+      }
+    }
+
+    if (!report || record.timestamp_us < query.start_us ||
+        record.timestamp_us > query.end_us)
+      continue;
+    bool has_handle = record.type == BTSNOOP_PACKET_ACL ||
+                      record.type == BTSNOOP_PACKET_SCO;
+    if (query.handle >= 0 && (!has_handle || key.handle != query.handle))
+      continue;
+    if (query.cid >= 0 &&
+        (record.type != BTSNOOP_PACKET_ACL || key.cid != query.cid))
+      continue;
+    callback(record, key);
+  }
+  return count;
+}
+
+size_t btsnoop_index_query(btsnoop_reader_t* reader,
+                           const std::vector<btsnoop_index_entry_t>& entries,
+                           const btsnoop_index_query_t& query,
+                           const btsnoop_index_query_cb& callback) {
+  CHECK(reader != NULL);
+
+  std::unordered_map<uint16_t, uint16_t> pdu_cids;
+  size_t count = 0;
+  // Whether |reader| is at the start of the next block.
+  bool in_sequence = false;
+
+  // Blocks are in capture order, skip the ones ending before the range.
+  auto block = std::lower_bound(
+      entries.begin(), entries.end(), query.start_us,
+      [](const btsnoop_index_entry_t& entry, uint64_t start_us) {
+        return entry.last_timestamp_us < start_us;
+      });
+  for (; block != entries.end(); ++block) {
+    if (block->first_timestamp_us > query.end_us) return count;
+    if (!block_may_match(*block, query)) {
+      // No fragment of the channel in the block means that no PDU of it is
+      // being reassembled at the start of the next one either.
+      pdu_cids.clear();
+      in_sequence = false;
+      continue;
+    }
+    if (!in_sequence) {
+      // When jumping to the start of the time range, learn the channels of
+      // the PDUs being reassembled from the blocks where they started.
+      uint64_t cid_bit = query.cid >= 0 ? btsnoop_index_bit(query.cid) : 0;
+      auto warm_up = block;
+      while ((warm_up->pending_cid_mask & cid_bit) &&
+             warm_up != entries.begin() &&
+             block - warm_up < MAX_WARM_UP_BLOCKS)
+        --warm_up;
+      if (warm_up != block && btsnoop_reader_seek(reader, warm_up->offset)) {
+        count +=
+            scan(reader, block->offset, query, &pdu_cids, false, callback);
+      }
+      if (!btsnoop_reader_seek(reader, block->offset)) return count;
+    }
+    count += scan(reader, block->end_offset, query, &pdu_cids, true, callback);
+    // Seek to the next block rather than resynchronize on a broken record.
+    in_sequence = !btsnoop_reader_has_error(reader);
+  }
+
+  // Records past the last indexed block, or the whole log without an index.
+  uint64_t tail = entries.empty() ? LOG_HEADER_SIZE : entries.back().end_offset;
+  if (!in_sequence && !btsnoop_reader_seek(reader, tail)) return count;
+  count += scan(reader, UINT64_MAX, query, &pdu_cids, true, callback);
+  return count;
+}
@@ -0,0 +1,177 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#define LOG_TAG "bt_snoop_reader"
+
+#include "btsnoop_reader.h"
+
+#include <base/logging.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+#include "osi/include/log.h"
+
+// Same values as in btsnoop.cc
+static const uint64_t BTSNOOP_EPOCH_DELTA = 0x00dcddb30f2f8000ULL;
+static const uint32_t DATALINK_HCI_UNENCAPSULATED = 1001;
+static const uint32_t DATALINK_HCI_UART = 1002;
+
+static const size_t FILE_HEADER_SIZE = 16;
+static const size_t RECORD_HEADER_SIZE = 24;
+
+// Bits of the record flags.
+static const uint32_t FLAG_RECEIVED = 0x01;
+static const uint32_t FLAG_COMMAND_OR_EVENT = 0x02;
+
+// Larger than any HCI packet, guards against reading garbage lengths.
+static const uint32_t MAX_RECORD_SIZE = 0x10000 + 5;
+
+struct btsnoop_reader_t {
+  FILE* file;
+  uint32_t datalink;
+  uint64_t size;
+  bool error;
+  std::vector<uint8_t> buffer;
+};
+
+static uint32_t read_be32(const uint8_t* p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+         ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint64_t read_be64(const uint8_t* p) {
+  return ((uint64_t)read_be32(p) << 32) | read_be32(p + 4);
+}
+
+btsnoop_reader_t* btsnoop_reader_open(const char* path) {
+  FILE* file = fopen(path, "rb");
+  if (file == NULL) {
+    LOG_ERROR(LOG_TAG, "%s unable to open '%s': %s", __func__, path,
+              strerror(errno));
+    return NULL;
+  }
+
+  uint8_t header[FILE_HEADER_SIZE];
+  if (fread(header, 1, sizeof(header), file) != sizeof(header) ||
+      memcmp(header, "btsnoop\0", 8) != 0 || read_be32(header + 8) != 1) {
+    LOG_ERROR(LOG_TAG, "%s '%s' is not a btsnoop log", __func__, path);
+    fclose(file);
+    return NULL;
+  }
+
+  uint32_t datalink = read_be32(header + 12);
+  if (datalink != DATALINK_HCI_UART &&
+      datalink != DATALINK_HCI_UNENCAPSULATED) {
+    LOG_ERROR(LOG_TAG, "%s '%s' has unsupported datalink %u", __func__, path,
+              datalink);
+    fclose(file);
+    return NULL;
+  }
+
+  btsnoop_reader_t* reader = new btsnoop_reader_t();
+  reader->file = file;
+  reader->datalink = datalink;
+  reader->error = false;
+  fseeko(file, 0, SEEK_END);
+  reader->size = ftello(file);
+  fseeko(file, FILE_HEADER_SIZE, SEEK_SET);
+  return reader;
+}
+
+void btsnoop_reader_close(btsnoop_reader_t* reader) {
+  if (reader == NULL) return;
+
+  fclose(reader->file);
+  delete reader;
+}
+
+bool btsnoop_reader_next(btsnoop_reader_t* reader, btsnoop_record_t* record) {
+  CHECK(reader != NULL);
+  CHECK(record != NULL);
+
+  uint64_t offset = ftello(reader->file);
+  uint8_t header[RECORD_HEADER_SIZE];
+  size_t read = fread(header, 1, sizeof(header), reader->file);
+  if (read == 0) return false;
+
+  uint32_t length_original = read_be32(header);
+  uint32_t length_captured = read_be32(header + 4);
+  uint32_t flags = read_be32(header + 8);
+  uint64_t timestamp = read_be64(header + 16);
+  if (read != sizeof(header) || length_captured == 0 ||
+      length_captured > MAX_RECORD_SIZE ||
+      length_captured > length_original) {
+    LOG_ERROR(LOG_TAG, "%s malformed record at offset %llu", __func__,
+              (unsigned long long)offset);
+    reader->error = true;
+    return false;
+  }
+
+  reader->buffer.resize(length_captured);
+  if (fread(reader->buffer.data(), 1, length_captured, reader->file) !=
+      length_captured) {
+    LOG_ERROR(LOG_TAG, "%s truncated record at offset %llu", __func__,
+              (unsigned long long)offset);
+    reader->error = true;
+    return false;
+  }
+
+  const uint8_t* data = reader->buffer.data();
+  if (reader->datalink == DATALINK_HCI_UART) {
+    if (data[0] < BTSNOOP_PACKET_COMMAND || data[0] > BTSNOOP_PACKET_EVENT) {
+      LOG_ERROR(LOG_TAG, "%s unknown packet type %u at offset %llu", __func__,
+                data[0], (unsigned long long)offset);
+      reader->error = true;
+      return false;
+    }
+    record->type = (btsnoop_packet_type_t)data[0];
+    data++;
+    length_original--;
+    length_captured--;
+  } else if (flags & FLAG_COMMAND_OR_EVENT) {
+    record->type = (flags & FLAG_RECEIVED) ? BTSNOOP_PACKET_EVENT
+                                           : BTSNOOP_PACKET_COMMAND;
+  } else {
+    // SCO can not be told apart from ACL without the H4 type.
+    record->type = BTSNOOP_PACKET_ACL;
+  }
+
+  record->is_received = (flags & FLAG_RECEIVED) != 0;
+  record->timestamp_us = timestamp - BTSNOOP_EPOCH_DELTA;
+  record->length = length_original;
+  record->captured_length = length_captured;
+  record->data = data;
+  record->offset = offset;
+  return true;
+}
+
+bool btsnoop_reader_seek(btsnoop_reader_t* reader, uint64_t offset) {
+  CHECK(reader != NULL);
+
+  if (offset < FILE_HEADER_SIZE || offset >= reader->size) return false;
+
+  reader->error = false;
+  return fseeko(reader->file, offset, SEEK_SET) == 0;
+}
+
+bool btsnoop_reader_has_error(const btsnoop_reader_t* reader) {
+  return reader->error;
+}
@@ -0,0 +1,584 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#define LOG_TAG "bt_hci_replay"
+
+#include "hci_replay.h"
+
+#include <base/location.h>
+#include <base/logging.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "btsnoop_reader.h"
+#include "buffer_allocator.h"
+#include "hci_layer.h"
+#include "osi/include/log.h"
+#include "osi/include/osi.h"
+
+extern void initialization_complete();
+extern void hci_event_received(const base::Location& from_here,
+                               BT_HDR* packet);
+extern void acl_event_received(BT_HDR* packet);
+extern void sco_data_received(BT_HDR* packet);
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+static const uint8_t HCI_COMMAND_COMPLETE_EVT = 0x0e;
+static const uint8_t HCI_COMMAND_STATUS_EVT = 0x0f;
+static const uint8_t HCI_BLE_EVENT = 0x3e;
+
+struct ReplayRecord {
+  btsnoop_packet_type_t type;
+  bool is_received;
+  uint64_t timestamp_us;
+  uint32_t length;
+  std::vector<uint8_t> data;
+  // Controller record the host record answers, -1 for the start of the log.
+  int trigger;
+  // Host records only.
+  bool resolved;
+  bool matched;
+};
+
+struct LatencyStats {
+  std::vector<uint32_t> samples_us;
+  uint64_t total_us = 0;
+  uint64_t original_total_us = 0;
+
+  void Add(uint64_t us, uint64_t original_us) {
+    samples_us.push_back(us);
+    total_us += us;
+    original_total_us += original_us;
+  }
+};
+
+}  // namespace
+
+static hci_replay_config_t config = {NULL, 1.0f, 2000, 8, true};
+static const allocator_t* buffer_allocator;
+
+static std::mutex replay_mutex;
+static std::condition_variable replay_cv;
+static std::thread replay_thread;
+static bool replay_started;
+static bool replay_stopping;
+static bool replay_completed;
+
+static std::vector<ReplayRecord> records;
+// Indexes in |records| of the host commands and host data packets, and the
+// first one of each that may still be unresolved.
+static std::vector<size_t> host_commands;
+static std::vector<size_t> host_data;
+static size_t next_host_command;
+static size_t next_host_data;
+// Delivery time of each controller record.
+static std::vector<Clock::time_point> delivered_at;
+static Clock::time_point replay_start;
+// Command Complete events answering commands that are not in the log.
+static std::deque<std::vector<uint8_t>> synthetic_events;
+
+static std::map<std::string, LatencyStats> delivery_stats;
+static std::map<std::string, LatencyStats> response_stats;
+static std::map<uint16_t, size_t> unexpected_opcodes;
+static uint64_t stall_total_us;
+static uint64_t stall_max_us;
+static size_t truncated_skipped;
+static size_t parameter_mismatches;
+static size_t unexpected_data;
+
+static uint64_t elapsed_us(Clock::time_point from, Clock::time_point to) {
+  if (to <= from) return 0;
+  return std::chrono::duration_cast<std::chrono::microseconds>(to - from)
+      .count();
+}
+
+static uint16_t command_opcode(const std::vector<uint8_t>& data) {
+  return data.size() < 2 ? 0 : data[0] | (data[1] << 8);
+}
+
+static std::string record_label(const ReplayRecord& record) {
+  char label[32];
+  const std::vector<uint8_t>& data = record.data;
+  switch (record.type) {
+    case BTSNOOP_PACKET_EVENT:
+      if (data.size() >= 5 && data[0] == HCI_COMMAND_COMPLETE_EVT) {
+        snprintf(label, sizeof(label), "event 0x0e 0x%04x",
+                 data[3] | (data[4] << 8));
+      } else if (data.size() >= 6 && data[0] == HCI_COMMAND_STATUS_EVT) {
+        snprintf(label, sizeof(label), "event 0x0f 0x%04x",
+                 data[4] | (data[5] << 8));
+      } else if (data.size() >= 3 && data[0] == HCI_BLE_EVENT) {
+        snprintf(label, sizeof(label), "event 0x3e/0x%02x", data[2]);
+      } else {
+        snprintf(label, sizeof(label), "event 0x%02x",
+                 data.empty() ? 0 : data[0]);
+      }
+      break;
+    case BTSNOOP_PACKET_COMMAND:
+      snprintf(label, sizeof(label), "command 0x%04x", command_opcode(data));
+      break;
+    case BTSNOOP_PACKET_ACL:
+      snprintf(label, sizeof(label), "acl");
+      break;
+    case BTSNOOP_PACKET_SCO:
+      snprintf(label, sizeof(label), "sco");
+      break;
+  }
+  return label;
+}
+
+static void reset_results(void) {
+  records.clear();
+  host_commands.clear();
+  host_data.clear();
+  next_host_command = 0;
+  next_host_data = 0;
+  delivered_at.clear();
+  synthetic_events.clear();
+  delivery_stats.clear();
+  response_stats.clear();
+  unexpected_opcodes.clear();
+  stall_total_us = 0;
+  stall_max_us = 0;
+  truncated_skipped = 0;
+  parameter_mismatches = 0;
+  unexpected_data = 0;
+}
+
+static bool load_trace(const char* path) {
+  btsnoop_reader_t* reader = btsnoop_reader_open(path);
+  if (reader == NULL) return false;
+
+  int last_received = -1;
+  btsnoop_record_t snoop;
+  while (btsnoop_reader_next(reader, &snoop)) {
+    ReplayRecord record;
+    record.type = snoop.type;
+    record.is_received = snoop.is_received;
+    record.timestamp_us = snoop.timestamp_us;
+    record.length = snoop.length;
+    record.data.assign(snoop.data, snoop.data + snoop.captured_length);
+    record.trigger = last_received;
+    record.resolved = false;
+    record.matched = false;
+
+    if (record.is_received) {
+      last_received = records.size();
+    } else if (record.type == BTSNOOP_PACKET_COMMAND) {
+      host_commands.push_back(records.size());
+    } else {
+      host_data.push_back(records.size());
+    }
+    records.push_back(std::move(record));
+  }
+
+  bool error = btsnoop_reader_has_error(reader);
+  btsnoop_reader_close(reader);
+  if (error) {
+    LOG_ERROR(LOG_TAG, "%s '%s' is malformed", __func__, path);
+    return false;
+  }
+
+  delivered_at.resize(records.size());
+  LOG_INFO(LOG_TAG, "%s loaded %zu records (%zu commands) from '%s'",
+           __func__, records.size(), host_commands.size(), path);
+  return true;
+}
+
+static BT_HDR* make_packet(uint16_t event, const uint8_t* data, size_t len) {
+  BT_HDR* packet =
+      reinterpret_cast<BT_HDR*>(buffer_allocator->alloc(len + BT_HDR_SIZE));
+  packet->offset = 0;
+  packet->len = len;
+  packet->layer_specific = 0;
+  packet->event = event;
+  memcpy(packet->data, data, len);
+  return packet;
+}
+
+// Called without |replay_mutex| held, the host may transmit from the upcall.
+static void deliver(btsnoop_packet_type_t type,
+                    const std::vector<uint8_t>& data) {
+  switch (type) {
+    case BTSNOOP_PACKET_EVENT:
+      hci_event_received(FROM_HERE, make_packet(MSG_HC_TO_STACK_HCI_EVT,
+                                                data.data(), data.size()));
+      break;
+    case BTSNOOP_PACKET_ACL:
+      acl_event_received(
+          make_packet(MSG_HC_TO_STACK_HCI_ACL, data.data(), data.size()));
+      break;
+    case BTSNOOP_PACKET_SCO:
+      sco_data_received(
+          make_packet(MSG_HC_TO_STACK_HCI_SCO, data.data(), data.size()));
+      break;
+    default:
+      break;
+  }
+}
+
+static void deliver_synthetic_events(std::unique_lock<std::mutex>& lock) {
+  while (!synthetic_events.empty()) {
+    std::vector<uint8_t> event = std::move(synthetic_events.front());
+    synthetic_events.pop_front();
+    lock.unlock();
+    deliver(BTSNOOP_PACKET_EVENT, event);
+    lock.lock();
+  }
+}
+
+static void skip_resolved(const std::vector<size_t>& indexes, size_t* next) {
+  while (*next < indexes.size() && records[indexes[*next]].resolved) (*next)++;
+}
+
+static Clock::time_point sync_deadline(const ReplayRecord& record) {
+  Clock::time_point from =
+      record.trigger < 0 ? replay_start : delivered_at[record.trigger];
+  return from + std::chrono::milliseconds(config.sync_timeout_ms);
+}
+
+// Waits until the host sent every command that precedes record |index| in the
+// log, or until they timed out.
+static void wait_for_host(size_t index, std::unique_lock<std::mutex>& lock) {
+  while (!replay_stopping) {
+    deliver_synthetic_events(lock);
+    skip_resolved(host_commands, &next_host_command);
+    if (next_host_command == host_commands.size() ||
+        host_commands[next_host_command] > index)
+      return;
+
+    // The oldest pending command times out first.
+    ReplayRecord& pending = records[host_commands[next_host_command]];
+    Clock::time_point deadline = sync_deadline(pending);
+    if (Clock::now() >= deadline) {
+      LOG_WARN(LOG_TAG, "%s host never sent command 0x%04x", __func__,
+               command_opcode(pending.data));
+      pending.resolved = true;
+      continue;
+    }
+    replay_cv.wait_until(lock, deadline);
+  }
+}
+
+static void replay_run(void) {
+  std::unique_lock<std::mutex> lock(replay_mutex);
+  Clock::duration shift = Clock::duration::zero();
+  const uint64_t first_us = records.empty() ? 0 : records[0].timestamp_us;
+
+  for (size_t i = 0; i < records.size() && !replay_stopping; i++) {
+    ReplayRecord& record = records[i];
+    if (!record.is_received) continue;
+
+    Clock::time_point scheduled = Clock::now();
+    if (config.speed > 0) {
+      scheduled = replay_start + shift +
+                  std::chrono::microseconds((uint64_t)(
+                      (record.timestamp_us - first_us) / config.speed));
+    }
+
+    wait_for_host(i, lock);
+    Clock::time_point synced = Clock::now();
+    if (synced > scheduled) {
+      // The host is slower than in the log, keep the original spacing from
+      // here on and account the difference as a stall.
+      uint64_t stall_us = elapsed_us(scheduled, synced);
+      if (config.speed > 0) shift += synced - scheduled;
+      stall_total_us += stall_us;
+      stall_max_us = std::max(stall_max_us, stall_us);
+    }
+    while (!replay_stopping && Clock::now() < scheduled) {
+      replay_cv.wait_until(lock, scheduled);
+      deliver_synthetic_events(lock);
+    }
+    if (replay_stopping) break;
+
+    if (record.data.size() < record.length) {
+      // Filtered snoop logs truncate payloads, they can not be replayed.
+      truncated_skipped++;
+      delivered_at[i] = Clock::now();
+      continue;
+    }
+
+    std::string label = record_label(record);
+    delivered_at[i] = Clock::now();
+    lock.unlock();
+    deliver(record.type, record.data);
+    lock.lock();
+    delivery_stats[label].Add(elapsed_us(delivered_at[i], Clock::now()), 0);
+  }
+
+  replay_completed = !replay_stopping;
+  replay_cv.notify_all();
+  LOG_INFO(LOG_TAG, "%s replay %s", __func__,
+           replay_completed ? "completed" : "stopped");
+
+  // Keep answering the commands the host sends after the end of the log.
+  while (!replay_stopping) {
+    deliver_synthetic_events(lock);
+    replay_cv.wait(lock);
+  }
+}
+
+// Matches a packet sent by the host with the next pending host records of the
+// same kind, within the match window.
+static int match_host_packet(const std::vector<size_t>& indexes, size_t* next,
+                             btsnoop_packet_type_t type, const uint8_t* data,
+                             uint16_t len) {
+  skip_resolved(indexes, next);
+  size_t window = 0;
+  for (size_t i = *next; i < indexes.size() && window < config.match_window;
+       i++) {
+    ReplayRecord& record = records[indexes[i]];
+    if (record.resolved) continue;
+    window++;
+
+    if (record.type != type || record.length != len) continue;
+    if (type == BTSNOOP_PACKET_COMMAND) {
+      if (record.data.size() < 2 || memcmp(record.data.data(), data, 2) != 0)
+        continue;
+    } else if (record.data.size() < 2 || record.data[0] != data[0] ||
+               (record.data[1] & 0x0f) != (data[1] & 0x0f)) {
+      continue;
+    }
+    return indexes[i];
+  }
+  return -1;
+}
+
+static void on_host_command(const uint8_t* data, uint16_t len) {
+  int index =
+      match_host_packet(host_commands, &next_host_command,
+                        BTSNOOP_PACKET_COMMAND, data, len);
+  if (index < 0) {
+    // A command with other parameters still matches on its opcode.
+    for (size_t i = next_host_command; i < host_commands.size(); i++) {
+      ReplayRecord& record = records[host_commands[i]];
+      if (!record.resolved && record.data.size() >= 2 &&
+          memcmp(record.data.data(), data, 2) == 0) {
+        index = host_commands[i];
+        parameter_mismatches++;
+        break;
+      }
+      if (i - next_host_command >= config.match_window) break;
+    }
+  }
+
+  if (index < 0) {
+    uint16_t opcode = data[0] | (data[1] << 8);
+    unexpected_opcodes[opcode]++;
+    if (config.auto_respond) {
+      synthetic_events.push_back(
+          {HCI_COMMAND_COMPLETE_EVT, 4, 1, data[0], data[1], 0x00});
+    }
+    return;
+  }
+
+  ReplayRecord& record = records[index];
+  record.resolved = true;
+  record.matched = true;
+
+  Clock::time_point now = Clock::now();
+  Clock::time_point from = replay_start;
+  uint64_t original_us = record.timestamp_us;
+  if (record.trigger >= 0) {
+    // A host ahead of the log answers before the trigger is even delivered.
+    from = delivered_at[record.trigger];
+    if (from == Clock::time_point()) from = now;
+    original_us -= records[record.trigger].timestamp_us;
+  } else {
+    original_us -= records[0].timestamp_us;
+  }
+  response_stats[record_label(record)].Add(elapsed_us(from, now),
+                                           original_us);
+}
+
+static void on_host_data(btsnoop_packet_type_t type, const uint8_t* data,
+                         uint16_t len) {
+  int index = match_host_packet(host_data, &next_host_data, type, data, len);
+  if (index < 0) {
+    unexpected_data++;
+    return;
+  }
+  records[index].resolved = true;
+  records[index].matched = true;
+}
+
+EXPORT_SYMBOL void hci_replay_set_config(
+    const hci_replay_config_t* replay_config) {
+  CHECK(replay_config != NULL);
+
+  std::lock_guard<std::mutex> lock(replay_mutex);
+  config = *replay_config;
+}
+
+EXPORT_SYMBOL bool hci_replay_wait_for_completion(uint64_t timeout_ms) {
+  std::unique_lock<std::mutex> lock(replay_mutex);
+  replay_cv.wait_for(lock, std::chrono::milliseconds(timeout_ms), [] {
+    return replay_completed || !replay_started || replay_stopping;
+  });
+  return replay_completed;
+}
+
+static void dump_latency(int fd, const char* title,
+                         std::map<std::string, LatencyStats>& stats,
+                         bool with_original) {
+  dprintf(fd, "  %s\n", title);
+  for (auto& entry : stats) {
+    std::vector<uint32_t>& samples = entry.second.samples_us;
+    if (samples.empty()) continue;
+
+    std::sort(samples.begin(), samples.end());
+    size_t count = samples.size();
+    dprintf(fd,
+            "    %-20s count: %-7zu avg: %-7llu p50: %-7u p99: %-7u "
+            "max: %u",
+            entry.first.c_str(), count,
+            (unsigned long long)(entry.second.total_us / count),
+            samples[count / 2], samples[(count * 99) / 100],
+            samples[count - 1]);
+    if (with_original)
+      dprintf(fd, " trace avg: %llu",
+              (unsigned long long)(entry.second.original_total_us / count));
+    dprintf(fd, "\n");
+  }
+}
+
+EXPORT_SYMBOL void hci_replay_dump(int fd) {
+  std::lock_guard<std::mutex> lock(replay_mutex);
+
+  size_t matched_commands = 0;
+  size_t missing_commands = 0;
+  for (size_t index : host_commands) {
+    if (records[index].matched)
+      matched_commands++;
+    else if (records[index].resolved || replay_completed)
+      missing_commands++;
+  }
+  size_t matched_data = 0;
+  for (size_t index : host_data) {
+    if (records[index].matched) matched_data++;
+  }
+  size_t unexpected_commands = 0;
+  for (auto& entry : unexpected_opcodes) unexpected_commands += entry.second;
+
+  dprintf(fd, "\nHCI replay of %s:\n",
+          config.trace_path ? config.trace_path : "(none)");
+  dprintf(fd, "  state: %s, speed: %.2f, records: %zu\n",
+          replay_completed ? "completed"
+                           : (replay_started ? "running" : "not started"),
+          config.speed, records.size());
+  dprintf(fd, "  host stalls total: %llu ms, max: %llu ms\n",
+          (unsigned long long)(stall_total_us / 1000),
+          (unsigned long long)(stall_max_us / 1000));
+  dprintf(fd,
+          "  commands matched: %zu, parameter mismatches: %zu, missing: %zu, "
+          "unexpected: %zu\n",
+          matched_commands, parameter_mismatches, missing_commands,
+          unexpected_commands);
+  dprintf(fd, "  data matched: %zu/%zu, unexpected: %zu\n", matched_data,
+          host_data.size(), unexpected_data);
+  dprintf(fd, "  truncated controller packets skipped: %zu\n",
+          truncated_skipped);
+  for (auto& entry : unexpected_opcodes)
+    dprintf(fd, "    unexpected command 0x%04x x%zu\n", entry.first,
+            entry.second);
+
+  dump_latency(fd, "Delivery to the host (us):", delivery_stats, false);
+  dump_latency(fd, "Host response latency (us):", response_stats, true);
+}
+
+void hci_initialize() {
+  LOG_INFO(LOG_TAG, "%s", __func__);
+
+  buffer_allocator = buffer_allocator_get_interface();
+  {
+    std::lock_guard<std::mutex> lock(replay_mutex);
+    reset_results();
+    replay_stopping = false;
+    replay_completed = false;
+    if (config.trace_path == NULL || !load_trace(config.trace_path)) {
+      LOG_ERROR(LOG_TAG, "%s no trace to replay", __func__);
+      return;
+    }
+    replay_started = true;
+    replay_start = Clock::now();
+  }
+
+  initialization_complete();
+  replay_thread = std::thread(replay_run);
+}
+
+void hci_close() {
+  LOG_INFO(LOG_TAG, "%s", __func__);
+
+  {
+    std::lock_guard<std::mutex> lock(replay_mutex);
+    replay_stopping = true;
+    replay_cv.notify_all();
+  }
+  if (replay_thread.joinable()) replay_thread.join();
+
+  std::lock_guard<std::mutex> lock(replay_mutex);
+  replay_started = false;
+}
+
+hci_transmit_status_t hci_transmit(BT_HDR* packet) {
+  const uint8_t* data = packet->data + packet->offset;
+  uint16_t len = packet->len;
+
+  std::lock_guard<std::mutex> lock(replay_mutex);
+  if (!replay_started) return HCI_TRANSMIT_DAEMON_CLOSED;
+  if (len < 2) return HCI_TRANSMIT_INVALID_PKT;
+
+  switch (packet->event & MSG_EVT_MASK) {
+    case MSG_STACK_TO_HC_HCI_CMD:
+      on_host_command(data, len);
+      break;
+    case MSG_STACK_TO_HC_HCI_ACL:
+      on_host_data(BTSNOOP_PACKET_ACL, data, len);
+      break;
+    case MSG_STACK_TO_HC_HCI_SCO:
+      on_host_data(BTSNOOP_PACKET_SCO, data, len);
+      break;
+    default:
+      LOG_ERROR(LOG_TAG, "Unknown packet type (%d)", packet->event);
+      return HCI_TRANSMIT_INVALID_PKT;
+  }
+  replay_cv.notify_all();
+  return HCI_TRANSMIT_SUCCESS;
+}
+
+int hci_open_firmware_log_file() { return INVALID_FD; }
+
+void hci_close_firmware_log_file(UNUSED_ATTR int fd) {}
+
+void hci_log_firmware_debug_packet(UNUSED_ATTR int fd,
+                                   UNUSED_ATTR BT_HDR* packet) {}
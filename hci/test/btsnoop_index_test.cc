@@ -0,0 +1,248 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <stdint.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "btsnoop_index.h"
+#include "btsnoop_reader.h"
+#include "btsnoop_test_file.h"
+
+static const std::vector<uint8_t> reset_command = {0x03, 0x0c, 0x00};
+static const std::vector<uint8_t> reset_complete = {0x0e, 0x04, 0x01,
+                                                    0x03, 0x0c, 0x00};
+
+// First fragment of a PDU on |cid|, with a 2 byte payload, followed by an
+// |acl_continuation| of 2 more bytes if |fragmented|.
+static std::vector<uint8_t> acl_start(uint16_t handle, uint16_t cid,
+                                      bool fragmented = false) {
+  return {(uint8_t)handle,
+          (uint8_t)(0x20 | (handle >> 8)),
+          0x06,
+          0x00,
+          (uint8_t)(fragmented ? 0x04 : 0x02),
+          0x00,
+          (uint8_t)cid,
+          (uint8_t)(cid >> 8),
+          0xaa,
+          0xbb};
+}
+
+static std::vector<uint8_t> acl_continuation(uint16_t handle) {
+  return {(uint8_t)handle, (uint8_t)(0x10 | (handle >> 8)), 0x02, 0x00, 0xcc,
+          0xdd};
+}
+
+class BtsnoopIndexTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    char path[] = "/tmp/btsnoop_index_test_XXXXXX";
+    close(mkstemp(path));
+    index_path_ = path;
+  }
+
+  void TearDown() override { unlink(index_path_.c_str()); }
+
+  // Indexes |trace| the same way btsnoop.cc does while writing it.
+  void WriteIndex(BtsnoopTestFile& trace, uint32_t interval) {
+    btsnoop_reader_t* reader = btsnoop_reader_open(trace.Path());
+    ASSERT_NE(nullptr, reader);
+    btsnoop_index_writer_t* writer =
+        btsnoop_index_writer_open(index_path_.c_str(), interval);
+    ASSERT_NE(nullptr, writer);
+
+    btsnoop_record_t record;
+    while (btsnoop_reader_next(reader, &record)) {
+      // Record header, then the H4 type byte and the packet.
+      uint32_t record_size = 24 + 1 + record.captured_length;
+      btsnoop_index_writer_add(writer, record.type, record.is_received,
+                               record.timestamp_us, record.offset, record_size,
+                               record.data, record.captured_length);
+    }
+    btsnoop_index_writer_close(writer);
+    btsnoop_reader_close(reader);
+  }
+
+  // Runs |query| on |trace| and returns the timestamps of the matching
+  // records.
+  std::vector<uint64_t> Query(BtsnoopTestFile& trace,
+                              const btsnoop_index_query_t& query,
+                              bool use_index, size_t* read = nullptr) {
+    std::vector<btsnoop_index_entry_t> entries;
+    if (use_index) {
+      EXPECT_TRUE(btsnoop_index_load(index_path_.c_str(), nullptr, &entries));
+    }
+
+    std::vector<uint64_t> timestamps;
+    btsnoop_reader_t* reader = btsnoop_reader_open(trace.Path());
+    size_t count = btsnoop_index_query(
+        reader, entries, query,
+        [&timestamps](const btsnoop_record_t& record,
+                      const btsnoop_index_key_t& key) {
+          timestamps.push_back(record.timestamp_us);
+        });
+    btsnoop_reader_close(reader);
+    if (read != nullptr) *read = count;
+    return timestamps;
+  }
+
+  std::string index_path_;
+};
+
+TEST_F(BtsnoopIndexTest, test_parse) {
+  btsnoop_index_key_t key;
+
+  btsnoop_index_parse(BTSNOOP_PACKET_COMMAND, reset_command.data(),
+                      reset_command.size(), &key);
+  EXPECT_EQ(0x0c03, key.opcode);
+
+  btsnoop_index_parse(BTSNOOP_PACKET_EVENT, reset_complete.data(),
+                      reset_complete.size(), &key);
+  EXPECT_EQ(0x0e, key.opcode);
+
+  std::vector<uint8_t> start = acl_start(0x0123, 0x0041);
+  btsnoop_index_parse(BTSNOOP_PACKET_ACL, start.data(), start.size(), &key);
+  EXPECT_EQ(0x0123, key.handle);
+  EXPECT_EQ(0x0041, key.cid);
+  EXPECT_TRUE(key.is_pdu_start);
+  EXPECT_EQ(6, key.acl_length);
+  EXPECT_EQ(6u, key.pdu_length);
+
+  std::vector<uint8_t> continuation = acl_continuation(0x0123);
+  btsnoop_index_parse(BTSNOOP_PACKET_ACL, continuation.data(),
+                      continuation.size(), &key);
+  EXPECT_EQ(0x0123, key.handle);
+  EXPECT_EQ(0, key.cid);
+  EXPECT_FALSE(key.is_pdu_start);
+
+  // Filtered logs may cut the L2CAP header
+  btsnoop_index_parse(BTSNOOP_PACKET_ACL, start.data(), 4, &key);
+  EXPECT_EQ(0x0123, key.handle);
+  EXPECT_EQ(0, key.cid);
+}
+
+TEST_F(BtsnoopIndexTest, test_write_and_load) {
+  BtsnoopTestFile trace;
+  for (int i = 0; i < 10; i++) trace.Add(4, true, 1000 + i, reset_complete);
+  WriteIndex(trace, 4);
+
+  uint32_t interval = 0;
+  std::vector<btsnoop_index_entry_t> entries;
+  ASSERT_TRUE(btsnoop_index_load(index_path_.c_str(), &interval, &entries));
+  EXPECT_EQ(4u, interval);
+  // The last, partial block is written on close
+  ASSERT_EQ(3u, entries.size());
+
+  uint64_t record_size = 24 + 1 + reset_complete.size();
+  for (size_t i = 0; i < entries.size(); i++) {
+    EXPECT_EQ(16 + i * 4 * record_size, entries[i].offset);
+    EXPECT_EQ(1000 + i * 4, entries[i].first_timestamp_us);
+    EXPECT_EQ(BTSNOOP_PACKET_EVENT, entries[i].type);
+    EXPECT_EQ(0x0e, entries[i].opcode);
+  }
+  EXPECT_EQ(4u, entries[0].packet_count);
+  EXPECT_EQ(2u, entries[2].packet_count);
+  EXPECT_EQ(1009u, entries[2].last_timestamp_us);
+  EXPECT_EQ(entries[1].offset, entries[0].end_offset);
+  EXPECT_EQ(16 + 10 * record_size, entries[2].end_offset);
+
+  EXPECT_FALSE(btsnoop_index_load(trace.Path(), &interval, &entries));
+}
+
+TEST_F(BtsnoopIndexTest, test_query_skips_blocks) {
+  BtsnoopTestFile trace;
+  // Two connections, one after the other, among events.
+  uint64_t timestamp = 0;
+  for (int i = 0; i < 64; i++) {
+    trace.Add(4, true, timestamp++, reset_complete);
+    trace.Add(2, true, timestamp++, acl_start(0x0001, 0x0040));
+  }
+  for (int i = 0; i < 64; i++) {
+    trace.Add(4, true, timestamp++, reset_complete);
+    trace.Add(2, false, timestamp++, acl_start(0x0002, 0x0041));
+  }
+  WriteIndex(trace, 16);
+
+  btsnoop_index_query_t query = {0, UINT64_MAX, 0x0002, -1};
+  size_t indexed_read = 0;
+  std::vector<uint64_t> indexed = Query(trace, query, true, &indexed_read);
+  size_t full_read = 0;
+  std::vector<uint64_t> full = Query(trace, query, false, &full_read);
+
+  EXPECT_EQ(64u, indexed.size());
+  EXPECT_EQ(full, indexed);
+  EXPECT_EQ(256u, full_read);
+  EXPECT_EQ(128u, indexed_read);
+
+  // Time range in the middle of the second connection
+  query = {200, 219, -1, 0x0041};
+  std::vector<uint64_t> range = Query(trace, query, true, &indexed_read);
+  ASSERT_EQ(10u, range.size());
+  EXPECT_EQ(201u, range[0]);
+  EXPECT_EQ(32u, indexed_read);
+}
+
+TEST_F(BtsnoopIndexTest, test_query_channel_of_continuations) {
+  BtsnoopTestFile trace;
+  uint64_t timestamp = 0;
+  // A PDU on 0x0040 whose continuation ends up a few blocks later, with the
+  // blocks in between only carrying another connection.
+  trace.Add(2, true, timestamp++, acl_start(0x0001, 0x0040, true));
+  for (int i = 0; i < 16; i++)
+    trace.Add(2, true, timestamp++, acl_start(0x0002, 0x0050));
+  trace.Add(2, true, timestamp++, acl_continuation(0x0001));
+  // A PDU on another channel of the same connection, then events.
+  trace.Add(2, true, timestamp++, acl_start(0x0001, 0x0041, true));
+  trace.Add(2, true, timestamp++, acl_continuation(0x0001));
+  for (int i = 0; i < 16; i++) trace.Add(4, true, timestamp++, reset_complete);
+  WriteIndex(trace, 4);
+
+  btsnoop_index_query_t query = {0, UINT64_MAX, -1, 0x0040};
+  std::vector<uint64_t> expected = {0, 17};
+  EXPECT_EQ(expected, Query(trace, query, true));
+  EXPECT_EQ(expected, Query(trace, query, false));
+
+  query.cid = 0x0041;
+  expected = {18, 19};
+  EXPECT_EQ(expected, Query(trace, query, true));
+
+  // Starting the range on the continuation still finds its channel.
+  query = {17, UINT64_MAX, -1, 0x0040};
+  expected = {17};
+  EXPECT_EQ(expected, Query(trace, query, true));
+}
+
+TEST_F(BtsnoopIndexTest, test_query_past_index) {
+  BtsnoopTestFile trace;
+  for (int i = 0; i < 8; i++) trace.Add(4, true, i, reset_complete);
+  WriteIndex(trace, 4);
+  // Packets logged after the stack died, without index entries.
+  for (int i = 8; i < 12; i++)
+    trace.Add(2, true, i, acl_start(0x0003, 0x0040));
+
+  btsnoop_index_query_t query = {0, UINT64_MAX, 0x0003, -1};
+  size_t read = 0;
+  std::vector<uint64_t> timestamps = Query(trace, query, true, &read);
+  EXPECT_EQ(4u, timestamps.size());
+  EXPECT_EQ(4u, read);
+}
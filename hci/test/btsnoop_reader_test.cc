@@ -0,0 +1,114 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include "btsnoop_reader.h"
+#include "btsnoop_test_file.h"
+
+static const std::vector<uint8_t> reset_command = {0x03, 0x0c, 0x00};
+static const std::vector<uint8_t> reset_complete = {0x0e, 0x04, 0x01,
+                                                    0x03, 0x0c, 0x00};
+static const std::vector<uint8_t> acl_packet = {0x40, 0x20, 0x06, 0x00, 0x02,
+                                                0x00, 0x04, 0x00, 0x0a, 0x0b};
+
+TEST(BtsnoopReaderTest, test_read_records) {
+  BtsnoopTestFile trace;
+  trace.Add(1, false, 1000, reset_command);
+  trace.Add(4, true, 1500, reset_complete);
+  trace.Add(2, true, 2000, acl_packet);
+  trace.Add(2, false, 2500, acl_packet, 4);
+
+  btsnoop_reader_t* reader = btsnoop_reader_open(trace.Path());
+  ASSERT_NE(nullptr, reader);
+
+  btsnoop_record_t record;
+  ASSERT_TRUE(btsnoop_reader_next(reader, &record));
+  EXPECT_EQ(BTSNOOP_PACKET_COMMAND, record.type);
+  EXPECT_FALSE(record.is_received);
+  EXPECT_EQ(1000u, record.timestamp_us);
+  ASSERT_EQ(reset_command.size(), record.length);
+  EXPECT_EQ(0, memcmp(reset_command.data(), record.data, record.length));
+
+  ASSERT_TRUE(btsnoop_reader_next(reader, &record));
+  EXPECT_EQ(BTSNOOP_PACKET_EVENT, record.type);
+  EXPECT_TRUE(record.is_received);
+  EXPECT_EQ(reset_complete.size(), record.captured_length);
+
+  ASSERT_TRUE(btsnoop_reader_next(reader, &record));
+  EXPECT_EQ(BTSNOOP_PACKET_ACL, record.type);
+  EXPECT_TRUE(record.is_received);
+  EXPECT_EQ(2000u, record.timestamp_us);
+
+  // Filtered logs only keep the headers
+  ASSERT_TRUE(btsnoop_reader_next(reader, &record));
+  EXPECT_FALSE(record.is_received);
+  EXPECT_EQ(acl_packet.size(), record.length);
+  EXPECT_EQ(4u, record.captured_length);
+
+  EXPECT_FALSE(btsnoop_reader_next(reader, &record));
+  EXPECT_FALSE(btsnoop_reader_has_error(reader));
+  btsnoop_reader_close(reader);
+}
+
+TEST(BtsnoopReaderTest, test_seek) {
+  BtsnoopTestFile trace;
+  for (int i = 0; i < 10; i++) trace.Add(4, true, i * 100, reset_complete);
+
+  btsnoop_reader_t* reader = btsnoop_reader_open(trace.Path());
+  ASSERT_NE(nullptr, reader);
+
+  std::vector<uint64_t> offsets;
+  btsnoop_record_t record;
+  while (btsnoop_reader_next(reader, &record)) offsets.push_back(record.offset);
+  ASSERT_EQ(10u, offsets.size());
+
+  ASSERT_TRUE(btsnoop_reader_seek(reader, offsets[7]));
+  ASSERT_TRUE(btsnoop_reader_next(reader, &record));
+  EXPECT_EQ(700u, record.timestamp_us);
+
+  EXPECT_FALSE(btsnoop_reader_seek(reader, 0));
+  EXPECT_FALSE(btsnoop_reader_seek(reader, 1 << 20));
+  btsnoop_reader_close(reader);
+}
+
+TEST(BtsnoopReaderTest, test_truncated_log) {
+  BtsnoopTestFile trace;
+  trace.Add(4, true, 100, reset_complete);
+  trace.AddRaw({0x00, 0x00, 0x00, 0x10, 0x00, 0x00});
+
+  btsnoop_reader_t* reader = btsnoop_reader_open(trace.Path());
+  ASSERT_NE(nullptr, reader);
+
+  btsnoop_record_t record;
+  EXPECT_TRUE(btsnoop_reader_next(reader, &record));
+  EXPECT_FALSE(btsnoop_reader_next(reader, &record));
+  EXPECT_TRUE(btsnoop_reader_has_error(reader));
+  btsnoop_reader_close(reader);
+}
+
+TEST(BtsnoopReaderTest, test_not_a_btsnoop_log) {
+  char path[] = "/tmp/btsnoop_test_XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_EQ(16, write(fd, "snoopbt\0\0\0\0\1\0\0\x3\xea", 16));
+  close(fd);
+
+  EXPECT_EQ(nullptr, btsnoop_reader_open(path));
+  EXPECT_EQ(nullptr, btsnoop_reader_open("/nonexistent/btsnoop_hci.log"));
+  unlink(path);
+}
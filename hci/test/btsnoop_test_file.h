@@ -0,0 +1,87 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+// Writes a btsnoop log (datalink H4) to a temporary file, the same way
+// btsnoop.cc does.
+class BtsnoopTestFile {
+ public:
+  BtsnoopTestFile() {
+    char path[] = "/tmp/btsnoop_test_XXXXXX";
+    int fd = mkstemp(path);
+    path_ = path;
+    file_ = fdopen(fd, "wb");
+    fwrite("btsnoop\0\0\0\0\1\0\0\x3\xea", 1, 16, file_);
+  }
+
+  ~BtsnoopTestFile() {
+    if (file_ != NULL) fclose(file_);
+    unlink(path_.c_str());
+  }
+
+  // Adds a packet of H4 |type|, captured at |timestamp_us|. Only the first
+  // |captured| bytes are written if it is not 0.
+  void Add(uint8_t type, bool is_received, uint64_t timestamp_us,
+           const std::vector<uint8_t>& packet, uint32_t captured = 0) {
+    uint32_t length = packet.size() + 1;
+    if (captured == 0) captured = packet.size();
+    uint32_t flags = is_received ? 1 : 0;
+    if (type == 1 || type == 4) flags |= 2;
+    WriteBe32(length);
+    WriteBe32(captured + 1);
+    WriteBe32(flags);
+    WriteBe32(0);
+    WriteBe64(timestamp_us + 0x00dcddb30f2f8000ULL);
+    fputc(type, file_);
+    fwrite(packet.data(), 1, captured, file_);
+  }
+
+  // Appends raw bytes, to corrupt the log.
+  void AddRaw(const std::vector<uint8_t>& bytes) {
+    fwrite(bytes.data(), 1, bytes.size(), file_);
+  }
+
+  // Flushes the log and returns its path.
+  const char* Path() {
+    fflush(file_);
+    return path_.c_str();
+  }
+
+ private:
+  void WriteBe32(uint32_t value) {
+    uint8_t bytes[] = {(uint8_t)(value >> 24), (uint8_t)(value >> 16),
+                       (uint8_t)(value >> 8), (uint8_t)value};
+    fwrite(bytes, 1, sizeof(bytes), file_);
+  }
+
+  void WriteBe64(uint64_t value) {
+    WriteBe32(value >> 32);
+    WriteBe32(value & 0xffffffff);
+  }
+
+  std::string path_;
+  FILE* file_;
+};
@@ -0,0 +1,204 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "btsnoop_test_file.h"
+#include "hci_layer.h"
+#include "hci_replay.h"
+#include "osi/include/allocator.h"
+
+extern void hci_initialize();
+extern hci_transmit_status_t hci_transmit(BT_HDR* packet);
+extern void hci_close();
+
+static const std::vector<uint8_t> reset_command = {0x03, 0x0c, 0x00};
+static const std::vector<uint8_t> reset_complete = {0x0e, 0x04, 0x01,
+                                                    0x03, 0x0c, 0x00};
+static const std::vector<uint8_t> read_version_command = {0x01, 0x10, 0x00};
+static const std::vector<uint8_t> read_version_complete = {
+    0x0e, 0x0c, 0x01, 0x01, 0x10, 0x00, 0x09, 0x00,
+    0x00, 0x09, 0x1d, 0x00, 0x00, 0x00};
+static const std::vector<uint8_t> adv_report = {
+    0x3e, 0x0c, 0x02, 0x01, 0x00, 0x00, 0x01, 0x02,
+    0x03, 0x04, 0x05, 0x06, 0x00, 0xc0};
+static const std::vector<uint8_t> acl_packet = {0x40, 0x20, 0x02, 0x00,
+                                                0x0a, 0x0b};
+
+// What the fake host received, in order.
+static std::mutex received_mutex;
+static std::vector<std::vector<uint8_t>> received;
+static bool initialized;
+// Command sent by the fake host when it receives the Reset Command Complete.
+static std::vector<uint8_t> command_after_reset;
+
+static void transmit(uint16_t event, const std::vector<uint8_t>& data) {
+  BT_HDR* packet =
+      static_cast<BT_HDR*>(osi_malloc(BT_HDR_SIZE + data.size()));
+  packet->event = event;
+  packet->offset = 0;
+  packet->len = data.size();
+  memcpy(packet->data, data.data(), data.size());
+  EXPECT_EQ(HCI_TRANSMIT_SUCCESS, hci_transmit(packet));
+  osi_free(packet);
+}
+
+static void on_received(BT_HDR* packet) {
+  std::vector<uint8_t> data(packet->data + packet->offset,
+                            packet->data + packet->offset + packet->len);
+  osi_free(packet);
+  {
+    std::lock_guard<std::mutex> lock(received_mutex);
+    received.push_back(data);
+  }
+  if (data == reset_complete && !command_after_reset.empty())
+    transmit(MSG_STACK_TO_HC_HCI_CMD, command_after_reset);
+}
+
+void initialization_complete() { initialized = true; }
+
+void hci_event_received(const base::Location& from_here, BT_HDR* packet) {
+  on_received(packet);
+}
+
+void acl_event_received(BT_HDR* packet) { on_received(packet); }
+
+void sco_data_received(BT_HDR* packet) { on_received(packet); }
+
+class HciLayerReplayTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    received.clear();
+    initialized = false;
+    command_after_reset = read_version_command;
+  }
+
+  void TearDown() override { hci_close(); }
+
+  void StartReplay(float speed, uint32_t sync_timeout_ms) {
+    hci_replay_config_t config = {trace_.Path(), speed, sync_timeout_ms, 8,
+                                  true};
+    hci_replay_set_config(&config);
+    hci_initialize();
+    ASSERT_TRUE(initialized);
+  }
+
+  size_t ReceivedCount() {
+    std::lock_guard<std::mutex> lock(received_mutex);
+    return received.size();
+  }
+
+  std::string Dump() {
+    char path[] = "/tmp/hci_replay_dump_XXXXXX";
+    int fd = mkstemp(path);
+    hci_replay_dump(fd);
+    lseek(fd, 0, SEEK_SET);
+    std::string dump;
+    char buffer[256];
+    ssize_t len;
+    while ((len = read(fd, buffer, sizeof(buffer))) > 0)
+      dump.append(buffer, len);
+    close(fd);
+    unlink(path);
+    return dump;
+  }
+
+  // Startup exchange followed by controller traffic
+  void AddStartup() {
+    trace_.Add(1, false, 1000, reset_command);
+    trace_.Add(4, true, 1200, reset_complete);
+    trace_.Add(1, false, 1300, read_version_command);
+    trace_.Add(4, true, 1400, read_version_complete);
+  }
+
+  BtsnoopTestFile trace_;
+};
+
+TEST_F(HciLayerReplayTest, test_responses_wait_for_commands) {
+  AddStartup();
+  trace_.Add(4, true, 2000, adv_report);
+  trace_.Add(2, true, 2100, acl_packet);
+  StartReplay(0, 5000);
+
+  // Nothing is delivered before the host sends the Reset
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_EQ(0u, ReceivedCount());
+
+  transmit(MSG_STACK_TO_HC_HCI_CMD, reset_command);
+  ASSERT_TRUE(hci_replay_wait_for_completion(5000));
+
+  std::vector<std::vector<uint8_t>> expected = {
+      reset_complete, read_version_complete, adv_report, acl_packet};
+  EXPECT_EQ(expected, received);
+
+  std::string dump = Dump();
+  EXPECT_NE(std::string::npos, dump.find("commands matched: 2,"));
+  EXPECT_NE(std::string::npos, dump.find("missing: 0,"));
+  EXPECT_NE(std::string::npos, dump.find("command 0x1001"));
+  EXPECT_NE(std::string::npos, dump.find("event 0x3e/0x02"));
+}
+
+TEST_F(HciLayerReplayTest, test_missing_command_times_out) {
+  AddStartup();
+  command_after_reset.clear();
+  StartReplay(0, 50);
+
+  transmit(MSG_STACK_TO_HC_HCI_CMD, reset_command);
+  ASSERT_TRUE(hci_replay_wait_for_completion(5000));
+  EXPECT_EQ(2u, ReceivedCount());
+  EXPECT_NE(std::string::npos, Dump().find("missing: 1,"));
+}
+
+TEST_F(HciLayerReplayTest, test_unexpected_command_answered) {
+  AddStartup();
+  StartReplay(0, 5000);
+
+  // Write Scan Enable is not in the trace
+  transmit(MSG_STACK_TO_HC_HCI_CMD, {0x1a, 0x0c, 0x01, 0x03});
+  transmit(MSG_STACK_TO_HC_HCI_CMD, reset_command);
+  ASSERT_TRUE(hci_replay_wait_for_completion(5000));
+
+  std::vector<uint8_t> synthetic = {0x0e, 0x04, 0x01, 0x1a, 0x0c, 0x00};
+  ASSERT_EQ(3u, received.size());
+  EXPECT_EQ(synthetic, received[0]);
+  EXPECT_NE(std::string::npos, Dump().find("unexpected command 0x0c1a x1"));
+}
+
+TEST_F(HciLayerReplayTest, test_original_timing) {
+  AddStartup();
+  trace_.Add(4, true, 101400, adv_report);
+  trace_.Add(4, true, 201400, adv_report);
+  trace_.Add(4, true, 201400, adv_report, 4);
+  StartReplay(1.0f, 5000);
+
+  auto start = std::chrono::steady_clock::now();
+  transmit(MSG_STACK_TO_HC_HCI_CMD, reset_command);
+  ASSERT_TRUE(hci_replay_wait_for_completion(5000));
+  auto elapsed = std::chrono::steady_clock::now() - start;
+
+  EXPECT_GE(elapsed, std::chrono::milliseconds(190));
+  EXPECT_EQ(4u, ReceivedCount());
+  EXPECT_NE(std::string::npos,
+            Dump().find("truncated controller packets skipped: 1"));
+}
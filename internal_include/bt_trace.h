@@ -20,6 +20,10 @@
 
 #include <stdint.h>
 
+#ifdef __cplusplus
+#include "osi/include/trace_ring.h"
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -198,12 +202,45 @@ static const char BTE_LOGMSG_MODULE[] = "bte_logmsg_module";
 #define SMP_INITIAL_TRACE_LEVEL BT_TRACE_LEVEL_WARNING
 #endif
 
+#ifdef __cplusplus
+
+/* The traces go through the deferred binary backend (osi/include/trace_ring.h)
+ * when it is started: the call site, a static constant holding the format
+ * string, and the raw arguments are captured and formatted on the trace
+ * thread. Suppressed traces only evaluate their arguments when there is a
+ * vendor logger. RawAddress arguments may be passed as such to a %s
+ * conversion, and are captured as 6 bytes. The format must be a literal. */
+#define BT_TRACE_SITE(mask, vendor, log_fn, fmt, ...)                      \
+  do {                                                                     \
+    static const trace_ring_site_t bt_trace_site = {"" fmt, (mask)};       \
+    if (trace_ring_mode.load(std::memory_order_relaxed) &                  \
+        TRACE_RING_DEFERRED)                                               \
+      system_bt_osi::TraceRingLog(&bt_trace_site, (vendor), ##__VA_ARGS__); \
+    else                                                                   \
+      system_bt_osi::TraceLogSync((log_fn), (mask), (fmt), ##__VA_ARGS__); \
+  } while (0)
+
+#define BT_TRACE(l, t, ...)                                                \
+  BT_TRACE_SITE((TRACE_CTRL_GENERAL | (l) | TRACE_ORG_STACK | (t)), false, \
+                LogMsg, __VA_ARGS__)
+
+#define VND_TRACE(l, t, ...)                                                 \
+  do {                                                                       \
+    if (trace_ring_mode.load(std::memory_order_relaxed) & TRACE_RING_VENDOR) \
+      BT_TRACE_SITE((TRACE_CTRL_GENERAL | (l) | TRACE_ORG_STACK | (t)),      \
+                    true, vnd_LogMsg, __VA_ARGS__);                          \
+  } while (0)
+
+#else
+
 #define BT_TRACE(l, t, ...) \
   LogMsg((TRACE_CTRL_GENERAL | (l) | TRACE_ORG_STACK | (t)), ##__VA_ARGS__)
 
 #define VND_TRACE(l,t,...) \
   vnd_LogMsg((TRACE_CTRL_GENERAL | (l) | TRACE_ORG_STACK | (t)), ##__VA_ARGS__)
 
+#endif
+
 /* Define tracing for the HCI unit */
 #define HCI_TRACE_ERROR(...)                                      \
   {                                                               \
@@ -36,6 +36,8 @@
 #include "main_int.h"
 #include "osi/include/config.h"
 #include "osi/include/log.h"
+#include "osi/include/properties.h"
+#include "osi/include/trace_ring.h"
 #include "port_api.h"
 #include "sdp_api.h"
 #include "stack_config.h"
@@ -73,6 +75,9 @@
 
 #define MSG_BUFFER_OFFSET 0
 
+/* Formats the stack traces on the trace thread rather than on the caller */
+#define BTE_DEFERRED_TRACE_PROPERTY "persist.bluetooth.deferredtrace"
+
 /* LayerIDs for BTA, currently everything maps onto appl_trace_level */
 static const char* const bt_layer_tags[] = {
     "bt_btif",
@@ -189,16 +194,10 @@ static tBTTRC_FUNC_MAP bttrc_set_level_map[] = {
 
     {0, 0, NULL, NULL, DEFAULT_CONF_TRACE_LEVEL}};
 
-void LogMsg(uint32_t trace_set_mask, const char* fmt_str, ...) {
-  char buffer[BTE_LOG_BUF_SIZE];
+static void log_msg_buffer(uint32_t trace_set_mask, const char* buffer) {
   int trace_layer = TRACE_GET_LAYER(trace_set_mask);
   if (trace_layer >= TRACE_LAYER_MAX_NUM) trace_layer = 0;
 
-  va_list ap;
-  va_start(ap, fmt_str);
-  vsnprintf(&buffer[MSG_BUFFER_OFFSET], BTE_LOG_MAX_SIZE, fmt_str, ap);
-  va_end(ap);
-
   switch (TRACE_GET_TYPE(trace_set_mask)) {
     case TRACE_TYPE_ERROR:
       LOG_ERROR(bt_layer_tags[trace_layer], "%s", buffer);
@@ -221,6 +220,17 @@ void LogMsg(uint32_t trace_set_mask, const char* fmt_str, ...) {
   }
 }
 
+void LogMsg(uint32_t trace_set_mask, const char* fmt_str, ...) {
+  char buffer[BTE_LOG_BUF_SIZE];
+
+  va_list ap;
+  va_start(ap, fmt_str);
+  vsnprintf(&buffer[MSG_BUFFER_OFFSET], BTE_LOG_MAX_SIZE, fmt_str, ap);
+  va_end(ap);
+
+  log_msg_buffer(trace_set_mask, buffer);
+}
+
 __attribute__((no_sanitize("cfi"))) void vnd_LogMsg(uint32_t trace_set_mask, const char *fmt_str, ...) {
   int trace_layer = TRACE_GET_LAYER(trace_set_mask);
   const char *tag;
@@ -236,6 +246,28 @@ __attribute__((no_sanitize("cfi"))) void vnd_LogMsg(uint32_t trace_set_mask, con
   va_end(ap);
 }
 
+__attribute__((no_sanitize("cfi"))) static void vnd_send_log_msg(
+    const char* tag, const char* fmt_str, ...) {
+  va_list ap;
+  va_start(ap, fmt_str);
+  logger_interface->send_log_msg(tag, fmt_str, ap);
+  va_end(ap);
+}
+
+/* Receives the traces formatted on the trace thread */
+static void trace_ring_sink(uint32_t trace_set_mask, bool vendor,
+                            const char* message) {
+  if (!vendor) {
+    log_msg_buffer(trace_set_mask, message);
+    return;
+  }
+
+  int trace_layer = TRACE_GET_LAYER(trace_set_mask);
+  if (trace_layer >= TRACE_LAYER_MAX_NUM) trace_layer = 0;
+  if (logger_interface)
+    vnd_send_log_msg(bt_layer_tags[trace_layer], "%s", message);
+}
+
 /* this function should go into BTAPP_DM for example */
 static uint8_t BTAPP_SetTraceLevel(uint8_t new_level) {
   if (new_level != 0xFF) appl_trace_level = new_level;
@@ -277,6 +309,11 @@ static void load_levels_from_config(const config_t* config) {
 }
 
 static future_t* init(void) {
+  char value[PROPERTY_VALUE_MAX] = {0};
+  osi_property_get(BTE_DEFERRED_TRACE_PROPERTY, value, "false");
+  if (!strcmp(value, "true") && !trace_ring_start(trace_ring_sink))
+    LOG_ERROR(LOG_TAG, "unable to defer the traces");
+
   const stack_config_t* stack_config = stack_config_get_interface();
   if (!stack_config->get_trace_config_enabled()) {
     LOG_INFO(LOG_TAG, "using compile default trace settings");
@@ -289,10 +326,15 @@ static future_t* init(void) {
   return NULL;
 }
 
+static future_t* clean_up(void) {
+  trace_ring_stop();
+  return NULL;
+}
+
 EXPORT_SYMBOL extern const module_t bte_logmsg_module = {
     .name = BTE_LOGMSG_MODULE,
     .init = init,
     .start_up = NULL,
     .shut_down = NULL,
-    .clean_up = NULL,
+    .clean_up = clean_up,
     .dependencies = {STACK_CONFIG_MODULE, NULL}};
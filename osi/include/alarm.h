@@ -84,6 +84,18 @@ void alarm_set(alarm_t* alarm, period_ms_t interval_ms, alarm_callback_t cb,
 void alarm_set_on_mloop(alarm_t* alarm, period_ms_t interval_ms,
                         alarm_callback_t cb, void* data);
 
+// Same as |alarm_set| and |alarm_set_on_mloop|, except that the |cb| callback
+// may be delayed by up to |slack_ms| after |interval_ms|, so that it runs
+// together with other alarms instead of waking the device up on its own. This
+// is meant for timers which are not time critical. The slack of a periodic
+// |alarm| should be less than |interval_ms|.
+void alarm_set_with_slack(alarm_t* alarm, period_ms_t interval_ms,
+                          period_ms_t slack_ms, alarm_callback_t cb,
+                          void* data);
+void alarm_set_on_mloop_with_slack(alarm_t* alarm, period_ms_t interval_ms,
+                                   period_ms_t slack_ms, alarm_callback_t cb,
+                                   void* data);
+
 // This function cancels the |alarm| if it was previously set.
 // When this call returns, the caller has a guarantee that the
 // callback is not in progress and will not be called if it
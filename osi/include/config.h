@@ -168,6 +168,19 @@ const config_section_node_t* config_section_next(
 // NULL and must not equal the value returned by |config_section_end|.
 const char* config_section_name(const config_section_node_t* iter);
 
+typedef bool (*config_entry_iter_cb)(const char* key, const char* value,
+                                     void* context);
+
+// Iterates over the keys of the section referred to by |iter|, in order,
+// invoking |callback| with each key, its value and |context| until it returns
+// false. The strings are owned by the config module and are only valid until
+// the next config mutating operation. |iter| may not be NULL and must not
+// equal the value returned by |config_section_end|. |callback| may not be
+// NULL.
+void config_section_foreach_entry(const config_section_node_t* iter,
+                                  config_entry_iter_cb callback,
+                                  void* context);
+
 #if (BT_IOT_LOGGING_ENABLED == TRUE)
 // Sorts the entries in each section of config by entry key.
 void config_sections_sort_by_entry_key(config_t* config, compare_func comp);
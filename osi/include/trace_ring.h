@@ -0,0 +1,332 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <atomic>
+#include <string>
+#include <type_traits>
+
+class RawAddress;
+
+// Deferred binary backend of the stack trace macros (see bt_trace.h).
+//
+// A trace records a pointer to its call site, a static constant holding the
+// format string, followed by its arguments in binary form, into a lock-free
+// ring owned by the calling thread. Nothing is formatted on the calling
+// thread: the trace thread drains the rings, formats the records in time
+// order and hands them to the sink. Strings are copied, pointers are not
+// followed, and RawAddress arguments are captured as their 6 bytes and
+// printed as "xx:xx:xx:xx:xx:xx" by a %s conversion.
+
+// Call site of a trace, one static constant per site.
+typedef struct {
+  const char* fmt;
+  uint32_t trace_set_mask;
+} trace_ring_site_t;
+
+// Bits of |trace_ring_mode|.
+// Suppressed traces are passed to the vendor logger.
+#define TRACE_RING_VENDOR 0x1
+// Traces are captured into the rings rather than formatted synchronously.
+#define TRACE_RING_DEFERRED 0x2
+
+// Receives each trace on the trace thread, formatted, in time order. |vendor|
+// is true for the suppressed traces meant for the vendor logger.
+typedef void (*trace_ring_sink_t)(uint32_t trace_set_mask, bool vendor,
+                                  const char* message);
+
+// Current TRACE_RING_* bits, checked by the trace macros. Only
+// TRACE_RING_VENDOR is set initially.
+extern std::atomic<uint32_t> trace_ring_mode;
+
+// Sets whether the suppressed traces are passed to the vendor logger. There is
+// no point in capturing their arguments when there is no vendor logger.
+void trace_ring_set_vendor_enabled(bool enabled);
+
+// Starts capturing the traces, and delivering them to |sink| from the trace
+// thread. Returns false if the thread could not be started.
+bool trace_ring_start(trace_ring_sink_t sink);
+
+// Delivers the pending traces and stops the trace thread. The traces are
+// formatted synchronously again afterwards.
+void trace_ring_stop(void);
+
+// Formats and delivers the pending traces on the calling thread.
+void trace_ring_flush(void);
+
+// Dumps the statistics and the latest traces to |fd|. Pending traces are
+// formatted and delivered first.
+void trace_ring_debug_dump(int fd);
+
+// Formats the |len| bytes of arguments at |args|, as captured by
+// TraceRingLog(), according to |fmt|.
+std::string trace_ring_format(const char* fmt, const uint8_t* args,
+                              size_t len);
+
+// Returns which arguments of |fmt| are printed by a %s conversion: bit i is
+// set for the i-th argument. Arguments past the 64th are not reported.
+uint64_t trace_ring_string_args(const char* fmt);
+
+// Reserves a record of |args_len| bytes of arguments in the ring of the
+// calling thread, and returns where to write them. Returns NULL if the ring
+// is full, in which case the trace is dropped. The record must be committed
+// with trace_ring_commit() before reserving another one.
+uint8_t* trace_ring_reserve(const trace_ring_site_t* site, bool vendor,
+                            size_t args_len);
+void trace_ring_commit(void);
+
+namespace system_bt_osi {
+namespace trace_ring_internal {
+
+// Type tags of the captured arguments.
+enum : uint8_t {
+  kArgSigned = 'i',
+  kArgUnsigned = 'u',
+  kArgDouble = 'f',
+  kArgPointer = 'p',
+  kArgString = 's',
+  kArgNullString = 'n',
+  kArgAddress = 'a',
+};
+
+// Longest string captured, longer ones are truncated.
+constexpr size_t kMaxStringLength = 255;
+
+template <typename T, typename Enable = void>
+struct Arg;
+
+template <typename T>
+struct Arg<T, typename std::enable_if<std::is_integral<T>::value ||
+                                      std::is_enum<T>::value>::type> {
+  using Integer = typename std::conditional<
+      std::is_enum<T>::value, std::underlying_type<T>,
+      std::common_type<T>>::type::type;
+
+  static size_t Size(T) { return 1 + sizeof(uint64_t); }
+  static uint8_t* Write(uint8_t* p, T value) {
+    *p = std::is_signed<Integer>::value ? kArgSigned : kArgUnsigned;
+    uint64_t raw = std::is_signed<Integer>::value
+                       ? static_cast<uint64_t>(
+                             static_cast<int64_t>(static_cast<Integer>(value)))
+                       : static_cast<uint64_t>(static_cast<Integer>(value));
+    memcpy(p + 1, &raw, sizeof(raw));
+    return p + 1 + sizeof(raw);
+  }
+};
+
+template <typename T>
+struct Arg<T, typename std::enable_if<std::is_floating_point<T>::value>::type> {
+  static size_t Size(T) { return 1 + sizeof(double); }
+  static uint8_t* Write(uint8_t* p, T value) {
+    double raw = value;
+    *p = kArgDouble;
+    memcpy(p + 1, &raw, sizeof(raw));
+    return p + 1 + sizeof(raw);
+  }
+};
+
+// Char pointers are always read as strings.
+template <typename T>
+struct IsStringPointer
+    : std::integral_constant<
+          bool, std::is_pointer<T>::value &&
+                    std::is_same<typename std::remove_cv<typename std::
+                                     remove_pointer<T>::type>::type,
+                                 char>::value> {};
+
+// Byte pointers, such as a BD_NAME, are read as strings only when printed by
+// a %s conversion: byte buffers traced with %p need not be NUL terminated.
+template <typename T>
+struct IsBytePointer
+    : std::integral_constant<
+          bool, std::is_pointer<T>::value &&
+                    (std::is_same<typename std::remove_cv<typename std::
+                                      remove_pointer<T>::type>::type,
+                                  unsigned char>::value ||
+                     std::is_same<typename std::remove_cv<typename std::
+                                      remove_pointer<T>::type>::type,
+                                  signed char>::value)> {};
+
+template <typename... Args>
+struct HasBytePointer : std::false_type {};
+
+template <typename T, typename... Rest>
+struct HasBytePointer<T, Rest...>
+    : std::integral_constant<bool, IsBytePointer<T>::value ||
+                                       HasBytePointer<Rest...>::value> {};
+
+template <typename T>
+struct Arg<T, typename std::enable_if<IsStringPointer<T>::value>::type> {
+  static size_t Length(T value) {
+    return strnlen(reinterpret_cast<const char*>(value), kMaxStringLength);
+  }
+  static size_t Size(T value) { return value ? 2 + Length(value) : 1; }
+  static uint8_t* Write(uint8_t* p, T value) {
+    if (!value) {
+      *p = kArgNullString;
+      return p + 1;
+    }
+    size_t length = Length(value);
+    p[0] = kArgString;
+    p[1] = static_cast<uint8_t>(length);
+    memcpy(p + 2, value, length);
+    return p + 2 + length;
+  }
+};
+
+template <typename T>
+struct Arg<T, typename std::enable_if<(std::is_pointer<T>::value &&
+                                       !IsStringPointer<T>::value &&
+                                       !IsBytePointer<T>::value) ||
+                                      std::is_null_pointer<T>::value>::type> {
+  static size_t Size(T) { return 1 + sizeof(uint64_t); }
+  static uint8_t* Write(uint8_t* p, T value) {
+    uint64_t raw = reinterpret_cast<uintptr_t>(value);
+    *p = kArgPointer;
+    memcpy(p + 1, &raw, sizeof(raw));
+    return p + 1 + sizeof(raw);
+  }
+};
+
+template <typename T>
+struct Arg<T, typename std::enable_if<std::is_same<T, RawAddress>::value>::type> {
+  static size_t Size(const T&) { return 1 + sizeof(T::address); }
+  static uint8_t* Write(uint8_t* p, const T& value) {
+    *p = kArgAddress;
+    memcpy(p + 1, value.address, sizeof(value.address));
+    return p + 1 + sizeof(value.address);
+  }
+};
+
+template <typename T>
+struct Arg<T, typename std::enable_if<IsBytePointer<T>::value>::type> {
+  using String = Arg<const char*>;
+  using Pointer = Arg<const void*>;
+
+  static size_t Size(T value, bool as_string) {
+    return as_string ? String::Size(reinterpret_cast<const char*>(value))
+                     : Pointer::Size(value);
+  }
+  static uint8_t* Write(uint8_t* p, T value, bool as_string) {
+    return as_string ? String::Write(p, reinterpret_cast<const char*>(value))
+                     : Pointer::Write(p, value);
+  }
+};
+
+template <typename T>
+typename std::enable_if<!IsBytePointer<T>::value, size_t>::type ArgSize(
+    const T& value, bool) {
+  return Arg<T>::Size(value);
+}
+
+template <typename T>
+typename std::enable_if<IsBytePointer<T>::value, size_t>::type ArgSize(
+    const T& value, bool as_string) {
+  return Arg<T>::Size(value, as_string);
+}
+
+template <typename T>
+typename std::enable_if<!IsBytePointer<T>::value, uint8_t*>::type WriteArg(
+    uint8_t* p, const T& value, bool) {
+  return Arg<T>::Write(p, value);
+}
+
+template <typename T>
+typename std::enable_if<IsBytePointer<T>::value, uint8_t*>::type WriteArg(
+    uint8_t* p, const T& value, bool as_string) {
+  return Arg<T>::Write(p, value, as_string);
+}
+
+// |strings| is the trace_ring_string_args() of the format, shifted to the
+// first of the arguments.
+inline size_t ArgsSize(uint64_t) { return 0; }
+
+template <typename T, typename... Rest>
+size_t ArgsSize(uint64_t strings, const T& value, const Rest&... rest) {
+  return ArgSize(value, strings & 1) + ArgsSize(strings >> 1, rest...);
+}
+
+inline void WriteArgs(uint8_t*, uint64_t) {}
+
+template <typename T, typename... Rest>
+void WriteArgs(uint8_t* p, uint64_t strings, const T& value,
+               const Rest&... rest) {
+  WriteArgs(WriteArg(p, value, strings & 1), strings >> 1, rest...);
+}
+
+// Argument as passed to the printf-like loggers: RawAddress is turned into a
+// string which lives until the end of the full expression.
+template <typename T, typename Enable = void>
+struct PrintfArg {
+  T value;
+  T get() const { return value; }
+};
+
+template <typename T>
+struct PrintfArg<T, typename std::enable_if<std::is_same<T, RawAddress>::value>::type> {
+  char str[18];
+  const char* get() const { return str; }
+};
+
+template <typename T>
+PrintfArg<T> MakePrintfArg(const T& value,
+                           typename std::enable_if<!std::is_same<T, RawAddress>::value>::type* = nullptr) {
+  return {value};
+}
+
+template <typename T>
+PrintfArg<T> MakePrintfArg(const T& value,
+                           typename std::enable_if<std::is_same<T, RawAddress>::value>::type* = nullptr) {
+  PrintfArg<T> arg;
+  snprintf(arg.str, sizeof(arg.str), "%02x:%02x:%02x:%02x:%02x:%02x",
+           value.address[0], value.address[1], value.address[2],
+           value.address[3], value.address[4], value.address[5]);
+  return arg;
+}
+
+}  // namespace trace_ring_internal
+
+// Captures a trace of |site| into the ring of the calling thread.
+template <typename... Args>
+void TraceRingLog(const trace_ring_site_t* site, bool vendor, Args... args) {
+  // The format is only parsed for the few traces which need it.
+  uint64_t strings =
+      trace_ring_internal::HasBytePointer<Args...>::value
+          ? trace_ring_string_args(site->fmt)
+          : 0;
+  uint8_t* p = trace_ring_reserve(
+      site, vendor, trace_ring_internal::ArgsSize(strings, args...));
+  if (p == nullptr) return;
+  trace_ring_internal::WriteArgs(p, strings, args...);
+  trace_ring_commit();
+}
+
+// Passes a trace to a printf-like |log| function, such as LogMsg.
+template <typename... Args>
+void TraceLogSync(void (*log)(uint32_t, const char*, ...),
+                  uint32_t trace_set_mask, const char* fmt, Args... args) {
+  log(trace_set_mask, fmt, trace_ring_internal::MakePrintfArg(args).get()...);
+}
+
+}  // namespace system_bt_osi
@@ -0,0 +1,71 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "osi/include/time.h"
+
+// A process wide clock that only moves when it is told to, for running timing
+// dependent code deterministically and faster than real time.
+//
+// While the virtual clock is enabled, alarms (see alarm.h) and the
+// |time_get_os_boottime_*| functions follow it instead of CLOCK_BOOTTIME.
+// Other schedulers, such as the emulated controller of test_vendor_lib,
+// register themselves as sources of deadlines. Advancing the clock runs the
+// work of every source in deadline order, on the calling thread, so the
+// sources must not expect their callbacks to run on their own threads.
+
+// A scheduler driven by the virtual clock.
+typedef struct {
+  // Returns true and sets |deadline_ms| to the earliest pending deadline if
+  // the source has pending work.
+  bool (*next_deadline)(void* context, period_ms_t* deadline_ms);
+  // Runs the work that is due at the current virtual time.
+  void (*run_due)(void* context);
+  void* context;
+} virtual_clock_source_t;
+
+// Enables the virtual clock, starting at |start_ms|. Must be called before
+// any alarm is set.
+void virtual_clock_enable(period_ms_t start_ms);
+
+// Disables the virtual clock, time goes back to CLOCK_BOOTTIME.
+void virtual_clock_disable(void);
+
+bool virtual_clock_is_enabled(void);
+
+// Returns the current virtual time.
+period_ms_t virtual_clock_now_ms(void);
+uint64_t virtual_clock_now_us(void);
+
+// Registers |source|, which must stay valid until it is unregistered. A
+// source can not be (un)registered from its own callbacks.
+void virtual_clock_register_source(const virtual_clock_source_t* source);
+void virtual_clock_unregister_source(const virtual_clock_source_t* source);
+
+// Moves the virtual clock forward by |delta_ms|, jumping from deadline to
+// deadline and running all the work that becomes due on the way, including
+// work scheduled by that work.
+void virtual_clock_advance(period_ms_t delta_ms);
+
+// Runs the pending work until no source has any left, or until the virtual
+// time reaches |limit_ms|. Returns the virtual time afterwards.
+period_ms_t virtual_clock_run_until_idle(period_ms_t limit_ms);
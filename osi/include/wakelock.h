@@ -37,6 +37,12 @@ bool wakelock_acquire(void);
 // Return true on success, otherwise false.
 bool wakelock_release(void);
 
+// Charge the time the Bluetooth wakelock is held from now on to |name|, until
+// this function is called again or the wakelock is released. |name| may not
+// be NULL. The time held by each name is part of |wakelock_debug_dump|.
+// The function is thread safe.
+void wakelock_set_attribution(const char* name);
+
 // Cleanup the wakelock internal state.
 // This function should be called by the OSI module cleanup during
 // graceful shutdown.
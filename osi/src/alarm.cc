@@ -45,6 +45,7 @@
 #include "osi/include/osi.h"
 #include "osi/include/semaphore.h"
 #include "osi/include/thread.h"
+#include "osi/include/virtual_clock.h"
 #include "osi/include/wakelock.h"
 
 using base::Bind;
@@ -99,6 +100,7 @@ struct alarm_t {
   period_ms_t deadline;
   period_ms_t prev_deadline;  // Previous deadline - used for accounting of
                               // periodic timers
+  period_ms_t slack;  // How late after |deadline| the alarm may fire
   bool is_periodic;
   fixed_queue_t* queue;  // The processing queue to add this alarm to
   alarm_callback_t callback;
@@ -130,6 +132,8 @@ static list_t* alarms;
 static timer_t timer;
 static timer_t wakeup_timer;
 static bool timer_set;
+// When the timers are set to go off, UINT64_MAX if they are not.
+static period_ms_t root_wakeup_ms = UINT64_MAX;
 
 // All alarm callbacks are dispatched from |dispatcher_thread|
 static thread_t* dispatcher_thread;
@@ -144,16 +148,26 @@ static alarm_t* alarm_new_internal(const char* name, bool is_periodic);
 static bool lazy_initialize(void);
 static period_ms_t now(void);
 static void alarm_set_internal(alarm_t* alarm, period_ms_t period,
-                               alarm_callback_t cb, void* data,
-                               fixed_queue_t* queue, bool for_msg_loop);
+                               period_ms_t slack, alarm_callback_t cb,
+                               void* data, fixed_queue_t* queue,
+                               bool for_msg_loop);
 static void* alarm_cancel_internal(alarm_t* alarm);
 static void remove_pending_alarm(alarm_t* alarm);
 static void schedule_next_instance(alarm_t* alarm);
+static alarm_t* next_wakeup(period_ms_t just_now, period_ms_t* wakeup_ms);
 static void reschedule_root_alarm(void);
 static void alarm_queue_ready(fixed_queue_t* queue, void* context);
 static void timer_callback(void* data);
 static void callback_dispatch(void* context);
 static bool timer_create_internal(const clockid_t clock_id, timer_t* timer);
+static bool virtual_clock_next_deadline(void* context,
+                                        period_ms_t* deadline_ms);
+static void virtual_clock_run_due(void* context);
+
+// Lets a virtual clock drive the alarms instead of the posix timers
+static const virtual_clock_source_t virtual_clock_source = {
+    virtual_clock_next_deadline, virtual_clock_run_due, NULL};
+
 // Registers |queue| for processing alarm callbacks on |thread|.
 // |queue| may not be NULL. |thread| may not be NULL.
 static void alarm_register_processing_queue(fixed_queue_t* queue,
@@ -223,19 +237,33 @@ period_ms_t alarm_get_remaining_ms(const alarm_t* alarm) {
 
 void alarm_set(alarm_t* alarm, period_ms_t interval_ms, alarm_callback_t cb,
                void* data) {
-  alarm_set_internal(alarm, interval_ms, cb, data, default_callback_queue,
+  alarm_set_internal(alarm, interval_ms, 0, cb, data, default_callback_queue,
                      false);
 }
 
 void alarm_set_on_mloop(alarm_t* alarm, period_ms_t interval_ms,
                         alarm_callback_t cb, void* data) {
-  alarm_set_internal(alarm, interval_ms, cb, data, NULL, true);
+  alarm_set_internal(alarm, interval_ms, 0, cb, data, NULL, true);
+}
+
+void alarm_set_with_slack(alarm_t* alarm, period_ms_t interval_ms,
+                          period_ms_t slack_ms, alarm_callback_t cb,
+                          void* data) {
+  alarm_set_internal(alarm, interval_ms, slack_ms, cb, data,
+                     default_callback_queue, false);
+}
+
+void alarm_set_on_mloop_with_slack(alarm_t* alarm, period_ms_t interval_ms,
+                                   period_ms_t slack_ms, alarm_callback_t cb,
+                                   void* data) {
+  alarm_set_internal(alarm, interval_ms, slack_ms, cb, data, NULL, true);
 }
 
 // Runs in exclusion with alarm_cancel and timer_callback.
 static void alarm_set_internal(alarm_t* alarm, period_ms_t period,
-                               alarm_callback_t cb, void* data,
-                               fixed_queue_t* queue, bool for_msg_loop) {
+                               period_ms_t slack, alarm_callback_t cb,
+                               void* data, fixed_queue_t* queue,
+                               bool for_msg_loop) {
   CHECK(alarms != NULL);
   CHECK(alarm != NULL);
   CHECK(cb != NULL);
@@ -244,6 +272,7 @@ static void alarm_set_internal(alarm_t* alarm, period_ms_t period,
 
   alarm->creation_time = now();
   alarm->period = period;
+  alarm->slack = slack;
   alarm->queue = queue;
   alarm->callback = cb;
   alarm->data = data;
@@ -301,6 +330,8 @@ void alarm_cleanup(void) {
   // If lazy_initialize never ran there is nothing else to do
   if (!alarms) return;
 
+  virtual_clock_unregister_source(&virtual_clock_source);
+
   dispatcher_thread_active = false;
   semaphore_post(alarm_expired);
   thread_free(dispatcher_thread);
@@ -320,6 +351,7 @@ void alarm_cleanup(void) {
 
   list_free(alarms);
   alarms = NULL;
+  root_wakeup_ms = UINT64_MAX;
 }
 
 static bool lazy_initialize(void) {
@@ -375,6 +407,7 @@ static bool lazy_initialize(void) {
   }
   thread_set_rt_priority(dispatcher_thread, THREAD_RT_PRIORITY);
   thread_post(dispatcher_thread, callback_dispatch, NULL);
+  virtual_clock_register_source(&virtual_clock_source);
   return true;
 
 error:
@@ -404,6 +437,8 @@ error:
 static period_ms_t now(void) {
   CHECK(alarms != NULL);
 
+  if (virtual_clock_is_enabled()) return virtual_clock_now_ms();
+
   struct timespec ts;
   if (clock_gettime(CLOCK_ID, &ts) == -1) {
     LOG_ERROR(LOG_TAG, "%s unable to get current time: %s", __func__,
@@ -461,14 +496,42 @@ static void schedule_next_instance(alarm_t* alarm) {
     }
   }
 
-  // If the new alarm has the earliest deadline, we need to re-evaluate our
+  // If the new alarm has the earliest deadline, or has to fire before the
+  // timers go off because it has less slack, we need to re-evaluate our
   // schedule.
   if (needs_reschedule ||
-      (!list_is_empty(alarms) && list_front(alarms) == alarm)) {
+      (!list_is_empty(alarms) && list_front(alarms) == alarm) ||
+      alarm->deadline + alarm->slack < root_wakeup_ms) {
     reschedule_root_alarm();
   }
 }
 
+// Returns the alarm which has to fire first, and sets |wakeup_ms| to the time
+// it has to fire by. That is the earliest deadline plus slack of the alarms,
+// or the earliest deadline if it is already due. All the alarms which are due
+// by then fire together, which batches the alarms with slack.
+// Must be called with |alarms_mutex| held, |alarms| may not be empty.
+static alarm_t* next_wakeup(period_ms_t just_now, period_ms_t* wakeup_ms) {
+  alarm_t* next = static_cast<alarm_t*>(list_front(alarms));
+  *wakeup_ms = next->deadline + next->slack;
+  if (next->slack == 0 || next->deadline <= just_now) {
+    *wakeup_ms = next->deadline;
+    return next;
+  }
+
+  // Only the alarms due before the current candidate can fire earlier.
+  for (list_node_t* node = list_next(list_begin(alarms));
+       node != list_end(alarms); node = list_next(node)) {
+    alarm_t* alarm = static_cast<alarm_t*>(list_node(node));
+    if (alarm->deadline >= *wakeup_ms) break;
+    if (alarm->deadline + alarm->slack < *wakeup_ms) {
+      *wakeup_ms = alarm->deadline + alarm->slack;
+      next = alarm;
+    }
+  }
+  return next;
+}
+
 // NOTE: must be called with |alarms_mutex| held
 __attribute__((no_sanitize("integer")))
 static void reschedule_root_alarm(void) {
@@ -476,17 +539,24 @@ static void reschedule_root_alarm(void) {
 
   const bool timer_was_set = timer_set;
   alarm_t* next;
+  period_ms_t wakeup_ms;
   int64_t next_expiration;
 
   // If used in a zeroed state, disarms the timer.
   struct itimerspec timer_time;
   memset(&timer_time, 0, sizeof(timer_time));
 
-  if (list_is_empty(alarms)) goto done;
+  root_wakeup_ms = UINT64_MAX;
+
+  // The virtual clock runs the alarms itself, keep the timers disarmed.
+  if (list_is_empty(alarms) || virtual_clock_is_enabled()) goto done;
 
-  next = static_cast<alarm_t*>(list_front(alarms));
-  next_expiration = next->deadline - now();
+  next = next_wakeup(now(), &wakeup_ms);
+  root_wakeup_ms = wakeup_ms;
+  next_expiration = wakeup_ms - now();
   if (next_expiration < TIMER_INTERVAL_FOR_WAKELOCK_IN_MS) {
+    // Charge the time the device is kept awake to the alarm it waits for.
+    wakelock_set_attribution(next->stats.name);
     if (!timer_set) {
       if (!wakelock_acquire()) {
         LOG_ERROR(LOG_TAG, "%s unable to acquire wake lock", __func__);
@@ -494,8 +564,8 @@ static void reschedule_root_alarm(void) {
       }
     }
 
-    timer_time.it_value.tv_sec = (next->deadline / 1000);
-    timer_time.it_value.tv_nsec = (next->deadline % 1000) * 1000000LL;
+    timer_time.it_value.tv_sec = (wakeup_ms / 1000);
+    timer_time.it_value.tv_nsec = (wakeup_ms % 1000) * 1000000LL;
 
     // It is entirely unsafe to call timer_settime(2) with a zeroed timerspec
     // for timers with *_ALARM clock IDs. Although the man page states that the
@@ -520,8 +590,8 @@ static void reschedule_root_alarm(void) {
     struct itimerspec wakeup_time;
     memset(&wakeup_time, 0, sizeof(wakeup_time));
 
-    wakeup_time.it_value.tv_sec = (next->deadline / 1000);
-    wakeup_time.it_value.tv_nsec = (next->deadline % 1000) * 1000000LL;
+    wakeup_time.it_value.tv_sec = (wakeup_ms / 1000);
+    wakeup_time.it_value.tv_nsec = (wakeup_ms % 1000) * 1000000LL;
     if (timer_settime(wakeup_timer, TIMER_ABSTIME, &wakeup_time, NULL) == -1)
       LOG_ERROR(LOG_TAG, "%s unable to set wakeup timer: %s", __func__,
                 strerror(errno));
@@ -669,6 +739,35 @@ static void callback_dispatch(UNUSED_ATTR void* context) {
   LOG_DEBUG(LOG_TAG, "%s Callback thread exited", __func__);
 }
 
+static bool virtual_clock_next_deadline(UNUSED_ATTR void* context,
+                                        period_ms_t* deadline_ms) {
+  std::lock_guard<std::mutex> lock(alarms_mutex);
+  if (alarms == NULL || list_is_empty(alarms)) return false;
+
+  next_wakeup(now(), deadline_ms);
+  return true;
+}
+
+// Runs the expired alarms in deadline order on the thread advancing the
+// virtual clock, instead of dispatching them to their queue or message loop.
+static void virtual_clock_run_due(UNUSED_ATTR void* context) {
+  std::unique_lock<std::mutex> lock(alarms_mutex);
+  while (alarms != NULL && !list_is_empty(alarms)) {
+    alarm_t* alarm = static_cast<alarm_t*>(list_front(alarms));
+    if (alarm->deadline > now()) break;
+
+    list_remove(alarms, alarm);
+    if (alarm->is_periodic) {
+      alarm->prev_deadline = alarm->deadline;
+      schedule_next_instance(alarm);
+      alarm->stats.rescheduled_count++;
+    }
+
+    alarm_ready_generic(alarm, lock);
+    lock.lock();
+  }
+}
+
 static bool timer_create_internal(const clockid_t clock_id, timer_t* timer) {
   CHECK(timer != NULL);
 
@@ -772,6 +871,10 @@ void alarm_debug_dump(int fd) {
             (unsigned long long)alarm->period,
             (long long)(alarm->deadline - just_now));
 
+    if (alarm->slack != 0)
+      dprintf(fd, "%-51s: %llu\n", "    Slack in ms",
+              (unsigned long long)alarm->slack);
+
     dump_stat(fd, &stats->callback_execution,
               "    Callback execution time in ms (total/max/avg)");
 
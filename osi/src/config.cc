@@ -362,6 +362,21 @@ const char* config_section_name(const config_section_node_t* node) {
   return section->name;
 }
 
+void config_section_foreach_entry(const config_section_node_t* node,
+                                  config_entry_iter_cb callback,
+                                  void* context) {
+  CHECK(node != NULL);
+  CHECK(callback != NULL);
+
+  const section_t* section =
+      (const section_t*)list_node((const list_node_t*)node);
+  for (const list_node_t* enode = list_begin(section->entries);
+       enode != list_end(section->entries); enode = list_next(enode)) {
+    const entry_t* entry = (const entry_t*)list_node(enode);
+    if (!callback(entry->key, entry->value, context)) return;
+  }
+}
+
 #if (BT_IOT_LOGGING_ENABLED == TRUE)
 void config_sections_sort_by_entry_key(config_t* config, compare_func comp) {
   CHECK(config != NULL);
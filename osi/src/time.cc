@@ -22,12 +22,15 @@
 #include <time.h>
 
 #include "osi/include/time.h"
+#include "osi/include/virtual_clock.h"
 
 uint32_t time_get_os_boottime_ms(void) {
   return (uint32_t)(time_get_os_boottime_us() / 1000);
 }
 
 uint64_t time_get_os_boottime_us(void) {
+  if (virtual_clock_is_enabled()) return virtual_clock_now_us();
+
   struct timespec ts_now;
   clock_gettime(CLOCK_BOOTTIME, &ts_now);
 
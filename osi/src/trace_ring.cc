@@ -0,0 +1,590 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#define LOG_TAG "bt_osi_trace_ring"
+
+#include "osi/include/trace_ring.h"
+
+#include <base/logging.h>
+#include <ctype.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "osi/include/log.h"
+#include "osi/include/time.h"
+
+using namespace system_bt_osi::trace_ring_internal;
+
+std::atomic<uint32_t> trace_ring_mode(TRACE_RING_VENDOR);
+
+namespace {
+
+// Bytes of the ring of each thread, a power of two.
+constexpr size_t kRingSize = 64 * 1024;
+
+// How often the trace thread drains the rings. A ring filling up past half
+// wakes it up earlier.
+constexpr int kDrainIntervalMs = 100;
+
+// Formatted traces kept for the debug dump.
+constexpr size_t kHistorySize = 64;
+
+struct RecordHeader {
+  // Bytes of the record, header included, a multiple of 8.
+  uint32_t size;
+  uint32_t vendor;
+  // NULL for the padding at the end of the ring.
+  const trace_ring_site_t* site;
+  uint64_t timestamp_us;
+};
+
+constexpr size_t kMaxRecordSize = kRingSize / 4;
+
+// Single producer, single consumer ring. The owner thread writes at |head|,
+// the trace thread reads at |tail| with |drain_mutex| held.
+struct Ring {
+  uint8_t* buffer = new uint8_t[kRingSize];
+  std::atomic<uint64_t> head{0};
+  std::atomic<uint64_t> tail{0};
+  // Position of the record being written, owner thread only.
+  uint64_t reserved_end = 0;
+  bool wake_requested = false;
+  pid_t tid = syscall(SYS_gettid);
+  // The owner thread exited, the ring is freed once drained.
+  std::atomic<bool> orphaned{false};
+  std::atomic<uint64_t> written{0};
+  std::atomic<uint64_t> dropped{0};
+
+  ~Ring() { delete[] buffer; }
+};
+
+struct RingHolder {
+  Ring* ring = nullptr;
+  ~RingHolder() {
+    if (ring) ring->orphaned = true;
+  }
+};
+
+struct Trace {
+  uint64_t timestamp_us;
+  pid_t tid;
+  uint32_t trace_set_mask;
+  bool vendor;
+  std::string message;
+};
+
+std::mutex rings_mutex;
+std::vector<Ring*> rings;
+thread_local RingHolder ring_holder;
+
+// Serializes the readers of the rings.
+std::mutex drain_mutex;
+trace_ring_sink_t sink;
+std::deque<Trace> history;
+uint64_t delivered;
+uint64_t orphans_freed;
+
+// Control of the trace thread.
+std::mutex thread_mutex;
+std::thread trace_thread;
+std::mutex wake_mutex;
+std::condition_variable wake_cv;
+bool stopping;
+
+size_t AlignRecord(size_t size) { return (size + 7) & ~static_cast<size_t>(7); }
+
+Ring* GetRing() {
+  Ring* ring = ring_holder.ring;
+  if (ring) return ring;
+
+  ring = new Ring();
+  {
+    std::lock_guard<std::mutex> lock(rings_mutex);
+    rings.push_back(ring);
+  }
+  ring_holder.ring = ring;
+  return ring;
+}
+
+// Reads the captured arguments of a record in order.
+class ArgReader {
+ public:
+  ArgReader(const uint8_t* args, size_t len) : p_(args), end_(args + len) {}
+
+  // Returns the tag of the next argument, 0 if there is none.
+  uint8_t Next() {
+    if (p_ >= end_) return 0;
+    uint8_t tag = *p_++;
+    switch (tag) {
+      case kArgSigned:
+      case kArgUnsigned:
+      case kArgDouble:
+      case kArgPointer:
+        if (end_ - p_ < 8) return Exhaust();
+        memcpy(&raw_, p_, sizeof(raw_));
+        p_ += sizeof(raw_);
+        break;
+      case kArgString:
+        if (end_ - p_ < 1 || end_ - p_ - 1 < *p_) return Exhaust();
+        str_.assign(reinterpret_cast<const char*>(p_ + 1), *p_);
+        p_ += 1 + *p_;
+        break;
+      case kArgNullString:
+        str_ = "(null)";
+        break;
+      case kArgAddress:
+        if (end_ - p_ < 6) return Exhaust();
+        char address[18];
+        snprintf(address, sizeof(address), "%02x:%02x:%02x:%02x:%02x:%02x",
+                 p_[0], p_[1], p_[2], p_[3], p_[4], p_[5]);
+        str_ = address;
+        p_ += 6;
+        break;
+      default:
+        return Exhaust();
+    }
+    return tag;
+  }
+
+  // The integer value of the argument read last, whatever its type.
+  int64_t AsSigned(uint8_t tag) const {
+    if (tag == kArgDouble) return static_cast<int64_t>(AsDouble(tag));
+    return static_cast<int64_t>(raw_);
+  }
+  uint64_t AsUnsigned(uint8_t tag) const {
+    if (tag == kArgDouble) return static_cast<uint64_t>(AsDouble(tag));
+    return raw_;
+  }
+  double AsDouble(uint8_t tag) const {
+    if (tag == kArgSigned) return static_cast<int64_t>(raw_);
+    if (tag == kArgUnsigned) return raw_;
+    double value;
+    memcpy(&value, &raw_, sizeof(value));
+    return value;
+  }
+  const std::string& AsString() const { return str_; }
+
+ private:
+  uint8_t Exhaust() {
+    p_ = end_;
+    return 0;
+  }
+
+  const uint8_t* p_;
+  const uint8_t* end_;
+  uint64_t raw_ = 0;
+  std::string str_;
+};
+
+template <typename T>
+void AppendFormatted(std::string* out, const std::string& spec, T value) {
+  char buffer[128];
+  int len = snprintf(buffer, sizeof(buffer), spec.c_str(), value);
+  if (len < 0) return;
+  if (static_cast<size_t>(len) < sizeof(buffer)) {
+    out->append(buffer, len);
+    return;
+  }
+  std::vector<char> large(len + 1);
+  snprintf(large.data(), large.size(), spec.c_str(), value);
+  out->append(large.data(), len);
+}
+
+// Appends one conversion of |spec| (flags, width and precision) and |conv|,
+// taking the next argument from |reader|.
+void FormatConversion(std::string* out, std::string spec, char conv,
+                      ArgReader* reader) {
+  uint8_t tag = reader->Next();
+  if (tag == 0) {
+    out->append("<missing>");
+    return;
+  }
+
+  switch (conv) {
+    case 'd':
+    case 'i':
+      if (tag == kArgString || tag == kArgNullString || tag == kArgAddress)
+        break;
+      AppendFormatted(out, spec + "lld",
+                      static_cast<long long>(reader->AsSigned(tag)));
+      return;
+    case 'u':
+    case 'o':
+    case 'x':
+    case 'X':
+      if (tag == kArgString || tag == kArgNullString || tag == kArgAddress)
+        break;
+      AppendFormatted(out, spec + "ll" + conv,
+                      static_cast<unsigned long long>(reader->AsUnsigned(tag)));
+      return;
+    case 'c':
+      if (tag != kArgSigned && tag != kArgUnsigned) break;
+      AppendFormatted(out, spec + "c", static_cast<int>(reader->AsSigned(tag)));
+      return;
+    case 'e':
+    case 'E':
+    case 'f':
+    case 'F':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A':
+      if (tag != kArgDouble && tag != kArgSigned && tag != kArgUnsigned) break;
+      AppendFormatted(out, spec + conv, reader->AsDouble(tag));
+      return;
+    case 's':
+      if (tag != kArgString && tag != kArgNullString && tag != kArgAddress)
+        break;
+      AppendFormatted(out, spec + "s", reader->AsString().c_str());
+      return;
+    case 'p':
+      if (tag != kArgPointer) break;
+      AppendFormatted(out, spec + "p",
+                      reinterpret_cast<void*>(
+                          static_cast<uintptr_t>(reader->AsUnsigned(tag))));
+      return;
+    case 'n':
+      // Nothing is written back to the caller.
+      return;
+    default:
+      out->append(spec);
+      out->push_back(conv);
+      return;
+  }
+  out->append("<bad arg>");
+}
+
+// Reads the records of |ring| written so far into |traces|.
+void DrainRing(Ring* ring, std::vector<Trace>* traces) {
+  uint64_t head = ring->head.load(std::memory_order_acquire);
+  uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+
+  while (tail < head) {
+    size_t offset = tail & (kRingSize - 1);
+    if (kRingSize - offset < sizeof(RecordHeader)) {
+      tail += kRingSize - offset;
+      continue;
+    }
+
+    RecordHeader header;
+    memcpy(&header, ring->buffer + offset, sizeof(header));
+    if (header.site != nullptr) {
+      Trace trace;
+      trace.timestamp_us = header.timestamp_us;
+      trace.tid = ring->tid;
+      trace.trace_set_mask = header.site->trace_set_mask;
+      trace.vendor = header.vendor != 0;
+      trace.message = trace_ring_format(
+          header.site->fmt, ring->buffer + offset + sizeof(header),
+          header.size - sizeof(header));
+      traces->push_back(std::move(trace));
+    }
+    tail += header.size;
+  }
+
+  ring->tail.store(tail, std::memory_order_release);
+}
+
+// Drains all the rings and delivers their traces in time order. Must be
+// called with |drain_mutex| held.
+void DrainLocked() {
+  std::vector<Ring*> snapshot;
+  {
+    std::lock_guard<std::mutex> lock(rings_mutex);
+    snapshot = rings;
+  }
+
+  std::vector<Trace> traces;
+  std::vector<Ring*> drained_orphans;
+  for (Ring* ring : snapshot) {
+    // Read the flag first, so that nothing written before it is left over.
+    bool orphaned = ring->orphaned.load(std::memory_order_acquire);
+    DrainRing(ring, &traces);
+    if (orphaned) drained_orphans.push_back(ring);
+  }
+
+  std::stable_sort(traces.begin(), traces.end(),
+                   [](const Trace& a, const Trace& b) {
+                     return a.timestamp_us < b.timestamp_us;
+                   });
+  for (Trace& trace : traces) {
+    if (sink) sink(trace.trace_set_mask, trace.vendor, trace.message.c_str());
+    delivered++;
+    history.push_back(std::move(trace));
+    if (history.size() > kHistorySize) history.pop_front();
+  }
+
+  if (drained_orphans.empty()) return;
+
+  std::lock_guard<std::mutex> lock(rings_mutex);
+  for (Ring* ring : drained_orphans) {
+    rings.erase(std::remove(rings.begin(), rings.end(), ring), rings.end());
+    delete ring;
+    orphans_freed++;
+  }
+}
+
+void TraceThreadMain() {
+  std::unique_lock<std::mutex> lock(wake_mutex);
+  while (!stopping) {
+    wake_cv.wait_for(lock, std::chrono::milliseconds(kDrainIntervalMs));
+    lock.unlock();
+    {
+      std::lock_guard<std::mutex> drain_lock(drain_mutex);
+      DrainLocked();
+    }
+    lock.lock();
+  }
+}
+
+}  // namespace
+
+uint8_t* trace_ring_reserve(const trace_ring_site_t* site, bool vendor,
+                            size_t args_len) {
+  Ring* ring = GetRing();
+  size_t size = AlignRecord(sizeof(RecordHeader) + args_len);
+  uint64_t head = ring->head.load(std::memory_order_relaxed);
+  uint64_t tail = ring->tail.load(std::memory_order_acquire);
+
+  // Records do not wrap around, the end of the ring is skipped instead.
+  size_t offset = head & (kRingSize - 1);
+  size_t padding = kRingSize - offset < size ? kRingSize - offset : 0;
+  if (size > kMaxRecordSize || head + padding + size - tail > kRingSize) {
+    ring->dropped.fetch_add(1, std::memory_order_relaxed);
+    return nullptr;
+  }
+
+  if (padding >= sizeof(RecordHeader)) {
+    RecordHeader skip = {static_cast<uint32_t>(padding), 0, nullptr, 0};
+    memcpy(ring->buffer + offset, &skip, sizeof(skip));
+  }
+  head += padding;
+  offset = head & (kRingSize - 1);
+
+  RecordHeader header = {static_cast<uint32_t>(size), vendor, site,
+                         time_get_os_boottime_us()};
+  memcpy(ring->buffer + offset, &header, sizeof(header));
+  ring->reserved_end = head + size;
+
+  // Wake the trace thread up early rather than dropping traces.
+  if (ring->reserved_end - tail > kRingSize / 2 && !ring->wake_requested) {
+    ring->wake_requested = true;
+    wake_cv.notify_one();
+  } else if (ring->reserved_end - tail <= kRingSize / 4) {
+    ring->wake_requested = false;
+  }
+
+  return ring->buffer + offset + sizeof(header);
+}
+
+void trace_ring_commit(void) {
+  Ring* ring = ring_holder.ring;
+  ring->written.fetch_add(1, std::memory_order_relaxed);
+  ring->head.store(ring->reserved_end, std::memory_order_release);
+}
+
+void trace_ring_set_vendor_enabled(bool enabled) {
+  if (enabled)
+    trace_ring_mode.fetch_or(TRACE_RING_VENDOR);
+  else
+    trace_ring_mode.fetch_and(~TRACE_RING_VENDOR);
+}
+
+bool trace_ring_start(trace_ring_sink_t new_sink) {
+  CHECK(new_sink != NULL);
+
+  std::lock_guard<std::mutex> lock(thread_mutex);
+  {
+    std::lock_guard<std::mutex> drain_lock(drain_mutex);
+    sink = new_sink;
+  }
+  if (trace_thread.joinable()) return true;
+
+  stopping = false;
+  try {
+    trace_thread = std::thread(TraceThreadMain);
+  } catch (const std::system_error& e) {
+    LOG_ERROR(LOG_TAG, "%s unable to start the trace thread: %s", __func__,
+              e.what());
+    return false;
+  }
+
+  trace_ring_mode.fetch_or(TRACE_RING_DEFERRED);
+  return true;
+}
+
+void trace_ring_stop(void) {
+  std::lock_guard<std::mutex> lock(thread_mutex);
+  if (!trace_thread.joinable()) return;
+
+  trace_ring_mode.fetch_and(~TRACE_RING_DEFERRED);
+  {
+    std::lock_guard<std::mutex> wake_lock(wake_mutex);
+    stopping = true;
+  }
+  wake_cv.notify_one();
+  trace_thread.join();
+
+  // A trace racing with the mode change may still be captured after this.
+  trace_ring_flush();
+}
+
+void trace_ring_flush(void) {
+  std::lock_guard<std::mutex> lock(drain_mutex);
+  DrainLocked();
+}
+
+void trace_ring_debug_dump(int fd) {
+  std::lock_guard<std::mutex> lock(drain_mutex);
+  DrainLocked();
+
+  uint64_t written = 0;
+  uint64_t dropped = 0;
+  size_t ring_count;
+  {
+    std::lock_guard<std::mutex> rings_lock(rings_mutex);
+    ring_count = rings.size();
+    for (Ring* ring : rings) {
+      written += ring->written.load(std::memory_order_relaxed);
+      dropped += ring->dropped.load(std::memory_order_relaxed);
+    }
+  }
+
+  uint32_t mode = trace_ring_mode.load();
+  dprintf(fd, "\nBluetooth Trace Ring:\n");
+  dprintf(fd, "  Deferred/vendor                : %s / %s\n",
+          (mode & TRACE_RING_DEFERRED) ? "true" : "false",
+          (mode & TRACE_RING_VENDOR) ? "true" : "false");
+  dprintf(fd, "  Thread rings (live/freed)      : %zu / %llu\n", ring_count,
+          (unsigned long long)orphans_freed);
+  dprintf(fd, "  Delivered traces               : %llu\n",
+          (unsigned long long)delivered);
+  dprintf(fd, "  Written/dropped (live rings)   : %llu / %llu\n",
+          (unsigned long long)written, (unsigned long long)dropped);
+
+  if (history.empty()) return;
+
+  dprintf(fd, "  Latest traces:\n");
+  for (const Trace& trace : history) {
+    dprintf(fd, "    %llu.%06llu %5d %c %s\n",
+            (unsigned long long)(trace.timestamp_us / 1000000),
+            (unsigned long long)(trace.timestamp_us % 1000000), trace.tid,
+            trace.vendor ? 'V' : 'L', trace.message.c_str());
+  }
+}
+
+std::string trace_ring_format(const char* fmt, const uint8_t* args,
+                              size_t len) {
+  ArgReader reader(args, len);
+  std::string out;
+  const char* p = fmt;
+
+  while (*p) {
+    if (*p != '%') {
+      const char* next = strchr(p, '%');
+      size_t n = next ? static_cast<size_t>(next - p) : strlen(p);
+      out.append(p, n);
+      p += n;
+      continue;
+    }
+    if (p[1] == '%') {
+      out.push_back('%');
+      p += 2;
+      continue;
+    }
+
+    // The length modifier is dropped, the captured type decides it.
+    std::string spec = "%";
+    const char* q = p + 1;
+    while (*q && strchr("-+ #0", *q)) spec.push_back(*q++);
+    if (*q == '*') {
+      uint8_t tag = reader.Next();
+      if (tag) spec += std::to_string(reader.AsSigned(tag));
+      q++;
+    } else {
+      while (isdigit(*q)) spec.push_back(*q++);
+    }
+    if (*q == '.') {
+      q++;
+      if (*q == '*') {
+        uint8_t tag = reader.Next();
+        // A negative precision is taken as if it was omitted.
+        if (tag && reader.AsSigned(tag) >= 0)
+          spec += "." + std::to_string(reader.AsSigned(tag));
+        q++;
+      } else {
+        spec.push_back('.');
+        while (isdigit(*q)) spec.push_back(*q++);
+      }
+    }
+    while (*q && strchr("hlLqjzt", *q)) q++;
+    if (!*q) break;
+
+    FormatConversion(&out, spec, *q, &reader);
+    p = q + 1;
+  }
+  return out;
+}
+
+uint64_t trace_ring_string_args(const char* fmt) {
+  uint64_t strings = 0;
+  size_t arg = 0;
+  const char* p = fmt;
+
+  // Each '*' and each conversion but "%%" takes an argument, as in
+  // trace_ring_format().
+  while ((p = strchr(p, '%')) != nullptr) {
+    if (p[1] == '%') {
+      p += 2;
+      continue;
+    }
+    const char* q = p + 1;
+    while (*q && strchr("-+ #0", *q)) q++;
+    if (*q == '*') {
+      arg++;
+      q++;
+    } else {
+      while (isdigit(*q)) q++;
+    }
+    if (*q == '.') {
+      q++;
+      if (*q == '*') {
+        arg++;
+        q++;
+      } else {
+        while (isdigit(*q)) q++;
+      }
+    }
+    while (*q && strchr("hlLqjzt", *q)) q++;
+    if (!*q) break;
+
+    if (*q == 's' && arg < 64) strings |= uint64_t(1) << arg;
+    arg++;
+    p = q + 1;
+  }
+  return strings;
+}
@@ -0,0 +1,121 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#define LOG_TAG "bt_osi_virtual_clock"
+
+#include "osi/include/virtual_clock.h"
+
+#include <base/logging.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+static std::atomic<bool> enabled(false);
+static std::atomic<uint64_t> now_us(0);
+
+static std::mutex sources_mutex;
+static std::vector<const virtual_clock_source_t*> sources;
+
+// Serializes the threads advancing the clock.
+static std::mutex advance_mutex;
+
+void virtual_clock_enable(period_ms_t start_ms) {
+  now_us = start_ms * 1000;
+  enabled = true;
+}
+
+void virtual_clock_disable(void) { enabled = false; }
+
+bool virtual_clock_is_enabled(void) { return enabled; }
+
+period_ms_t virtual_clock_now_ms(void) { return now_us / 1000; }
+
+uint64_t virtual_clock_now_us(void) { return now_us; }
+
+void virtual_clock_register_source(const virtual_clock_source_t* source) {
+  CHECK(source != NULL);
+
+  std::lock_guard<std::mutex> lock(sources_mutex);
+  if (std::find(sources.begin(), sources.end(), source) == sources.end())
+    sources.push_back(source);
+}
+
+void virtual_clock_unregister_source(const virtual_clock_source_t* source) {
+  std::lock_guard<std::mutex> lock(sources_mutex);
+  sources.erase(std::remove(sources.begin(), sources.end(), source),
+                sources.end());
+}
+
+// Sources are called without |sources_mutex| held, their callbacks may
+// schedule more work on any source.
+static std::vector<const virtual_clock_source_t*> get_sources(void) {
+  std::lock_guard<std::mutex> lock(sources_mutex);
+  return sources;
+}
+
+// Finds the earliest deadline over all sources, returns false if there is
+// no pending work at all.
+static bool next_deadline(period_ms_t* deadline_ms) {
+  bool found = false;
+  for (const virtual_clock_source_t* source : get_sources()) {
+    period_ms_t deadline;
+    if (!source->next_deadline(source->context, &deadline)) continue;
+    if (!found || deadline < *deadline_ms) *deadline_ms = deadline;
+    found = true;
+  }
+  return found;
+}
+
+static void run_due(void) {
+  for (const virtual_clock_source_t* source : get_sources())
+    source->run_due(source->context);
+}
+
+// Runs all the work due up to |target_ms|, in deadline order. Returns false
+// if it stopped because there was no work left.
+static bool run_until(period_ms_t target_ms, bool stop_when_idle) {
+  CHECK(enabled);
+
+  std::lock_guard<std::mutex> lock(advance_mutex);
+  while (true) {
+    period_ms_t deadline_ms;
+    if (!next_deadline(&deadline_ms)) {
+      if (stop_when_idle) return false;
+      break;
+    }
+    if (deadline_ms > target_ms) break;
+
+    // Work already overdue runs at the current time, time never goes back.
+    if (deadline_ms * 1000 > now_us) now_us = deadline_ms * 1000;
+    run_due();
+  }
+
+  if (target_ms * 1000 > now_us) now_us = target_ms * 1000;
+  run_due();
+  return true;
+}
+
+void virtual_clock_advance(period_ms_t delta_ms) {
+  run_until(virtual_clock_now_ms() + delta_ms, false);
+}
+
+period_ms_t virtual_clock_run_until_idle(period_ms_t limit_ms) {
+  run_until(limit_ms, true);
+  return virtual_clock_now_ms();
+}
@@ -30,8 +30,12 @@
 #include <time.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <map>
 #include <mutex>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "base/logging.h"
 #include "osi/include/alarm.h"
@@ -78,6 +82,20 @@ typedef struct {
 
 static wakelock_stats_t wakelock_stats;
 
+// Wakelock time charged to each name set with wakelock_set_attribution()
+typedef struct {
+  size_t acquired_count;  // Acquired while this name was set
+  size_t handover_count;  // Already held when this name was set
+  period_ms_t total_acquired_interval_ms;
+} wakelock_attribution_t;
+
+// Maximum number of names in the debug dump.
+static const size_t MAX_DUMPED_ATTRIBUTIONS = 32;
+
+static std::map<std::string, wakelock_attribution_t> attributions;
+static std::string attribution_name;
+static period_ms_t attribution_timestamp_ms;
+
 // This mutex ensures that the functions that update and dump the statistics
 // are executed serially.
 static std::mutex stats_mutex;
@@ -91,6 +109,8 @@ static void wakelock_initialize_native(void);
 static void reset_wakelock_stats(void);
 static void update_wakelock_acquired_stats(bt_status_t acquired_status);
 static void update_wakelock_released_stats(bt_status_t released_status);
+static void charge_attribution(period_ms_t now_ms);
+static period_ms_t now(void);
 
 void wakelock_set_os_callouts(bt_os_callouts_t* callouts) {
   wakelock_os_callouts = callouts;
@@ -147,6 +167,25 @@ static bt_status_t wakelock_acquire_native(void) {
   return BT_STATUS_SUCCESS;
 }
 
+void wakelock_set_attribution(const char* name) {
+  CHECK(name != NULL);
+
+  pthread_once(&initialized, wakelock_initialize);
+
+  const period_ms_t now_ms = now();
+
+  std::lock_guard<std::mutex> lock(stats_mutex);
+
+  if (attribution_name == name) return;
+
+  if (wakelock_stats.is_acquired) {
+    charge_attribution(now_ms);
+    attributions[name].handover_count++;
+  }
+  attribution_name = name;
+  attribution_timestamp_ms = now_ms;
+}
+
 bool wakelock_release(void) {
   pthread_once(&initialized, wakelock_initialize);
 
@@ -258,6 +297,19 @@ static void reset_wakelock_stats(void) {
   wakelock_stats.last_acquired_timestamp_ms = 0;
   wakelock_stats.last_released_timestamp_ms = 0;
   wakelock_stats.last_reset_timestamp_ms = now();
+
+  attributions.clear();
+  attribution_name.clear();
+}
+
+// Charge the time since the last charge to the current attribution, if any.
+// Must be called with |stats_mutex| held, while the wakelock is acquired.
+static void charge_attribution(period_ms_t now_ms) {
+  if (!attribution_name.empty()) {
+    attributions[attribution_name].total_acquired_interval_ms +=
+        now_ms - attribution_timestamp_ms;
+  }
+  attribution_timestamp_ms = now_ms;
 }
 
 //
@@ -286,6 +338,10 @@ static void update_wakelock_acquired_stats(bt_status_t acquired_status) {
   wakelock_stats.acquired_count++;
   wakelock_stats.last_acquired_timestamp_ms = now_ms;
 
+  attribution_timestamp_ms = now_ms;
+  if (!attribution_name.empty())
+    attributions[attribution_name].acquired_count++;
+
   BluetoothMetricsLogger::GetInstance()->LogWakeEvent(
       system_bt_osi::WAKE_EVENT_ACQUIRED, "", "", now_ms);
 }
@@ -328,6 +384,10 @@ static void update_wakelock_released_stats(bt_status_t released_status) {
   wakelock_stats.last_acquired_interval_ms = delta_ms;
   wakelock_stats.total_acquired_interval_ms += delta_ms;
 
+  // The next acquisition is charged to whoever sets the attribution again.
+  charge_attribution(now_ms);
+  attribution_name.clear();
+
   BluetoothMetricsLogger::GetInstance()->LogWakeEvent(
       system_bt_osi::WAKE_EVENT_RELEASED, "", "", now_ms);
 }
@@ -376,4 +436,37 @@ void wakelock_debug_dump(int fd) {
   dprintf(
       fd, "  Total run time (ms)            : %llu\n",
       (unsigned long long)(now_ms - wakelock_stats.last_reset_timestamp_ms));
+
+  if (attributions.empty()) return;
+
+  // Include the time of the ongoing acquisition, and list the names which
+  // kept the device awake the longest first.
+  std::vector<std::pair<std::string, wakelock_attribution_t>> sorted(
+      attributions.begin(), attributions.end());
+  if (wakelock_stats.is_acquired && !attribution_name.empty()) {
+    for (auto& entry : sorted) {
+      if (entry.first != attribution_name) continue;
+      entry.second.total_acquired_interval_ms +=
+          now_ms - attribution_timestamp_ms;
+      break;
+    }
+  }
+  std::sort(sorted.begin(), sorted.end(),
+            [](const std::pair<std::string, wakelock_attribution_t>& a,
+               const std::pair<std::string, wakelock_attribution_t>& b) {
+              return a.second.total_acquired_interval_ms >
+                     b.second.total_acquired_interval_ms;
+            });
+
+  dprintf(fd, "  Acquired / handed over count / time (ms) by name:\n");
+  for (size_t i = 0; i < sorted.size() && i < MAX_DUMPED_ATTRIBUTIONS; i++) {
+    dprintf(fd, "    %-40s: %zu / %zu / %llu%s\n", sorted[i].first.c_str(),
+            sorted[i].second.acquired_count, sorted[i].second.handover_count,
+            (unsigned long long)sorted[i].second.total_acquired_interval_ms,
+            (wakelock_stats.is_acquired && sorted[i].first == attribution_name)
+                ? " (holding)"
+                : "");
+  }
+  if (sorted.size() > MAX_DUMPED_ATTRIBUTIONS)
+    dprintf(fd, "    ... %zu more\n", sorted.size() - MAX_DUMPED_ATTRIBUTIONS);
 }
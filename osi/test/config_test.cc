@@ -1,6 +1,9 @@
 #include <base/files/file_util.h>
 #include <gtest/gtest.h>
 
+#include <string>
+#include <vector>
+
 #include "AllocationTestHarness.h"
 
 #include "osi/include/config.h"
@@ -196,6 +199,27 @@ TEST_F(ConfigTest, config_section_end) {
   config_free(config);
 }
 
+static bool collect_entry(const char* key, const char* value, void* context) {
+  std::vector<std::string>* entries =
+      static_cast<std::vector<std::string>*>(context);
+  entries->push_back(std::string(key) + "=" + value);
+  return entries->size() < 2;
+}
+
+TEST_F(ConfigTest, config_section_foreach_entry) {
+  config_t* config = config_new(CONFIG_FILE);
+  const config_section_node_t* section = config_section_begin(config);
+  section = config_section_next(section);
+
+  // Stops once the callback returns false.
+  std::vector<std::string> entries;
+  config_section_foreach_entry(section, collect_entry, &entries);
+  ASSERT_EQ(2u, entries.size());
+  EXPECT_EQ("recordNumber=1", entries[0]);
+  EXPECT_EQ("primaryRecord=true", entries[1]);
+  config_free(config);
+}
+
 TEST_F(ConfigTest, config_save_basic) {
   config_t* config = config_new(CONFIG_FILE);
   EXPECT_TRUE(config_save(config, CONFIG_FILE));
@@ -0,0 +1,133 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <benchmark/benchmark.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "bt_trace.h"
+#include "bt_types.h"
+#include "osi/include/trace_ring.h"
+#include "types/raw_address.h"
+
+using ::benchmark::State;
+
+uint8_t btu_trace_level = BT_TRACE_LEVEL_WARNING;
+
+/* Formats like LogMsg, without the cost of the log device */
+static void format_msg(const char* fmt, va_list ap) {
+  char buffer[256];
+  vsnprintf(buffer, sizeof(buffer), fmt, ap);
+  benchmark::DoNotOptimize(buffer);
+}
+
+void LogMsg(uint32_t trace_set_mask, const char* fmt_str, ...) {
+  va_list ap;
+  va_start(ap, fmt_str);
+  format_msg(fmt_str, ap);
+  va_end(ap);
+}
+
+void vnd_LogMsg(uint32_t trace_set_mask, const char* fmt_str, ...) {
+  va_list ap;
+  va_start(ap, fmt_str);
+  format_msg(fmt_str, ap);
+  va_end(ap);
+}
+
+static void sink(uint32_t trace_set_mask, bool vendor, const char* message) {
+  benchmark::DoNotOptimize(message);
+}
+
+namespace {
+
+RawAddress TestAddress() {
+  static const uint8_t bytes[] = {0x00, 0x11, 0x22, 0xaa, 0xbb, 0xcc};
+  RawAddress address;
+  memcpy(address.address, bytes, sizeof(bytes));
+  return address;
+}
+
+/* A typical ACL trace, at debug level, below the default trace level */
+void trace_acl(const RawAddress& address, uint16_t handle) {
+  HCI_TRACE_DEBUG("%s: RemBdAddr: %s handle=0x%04x role=%d", __func__,
+                  address, handle, 1);
+}
+
+class BM_TraceRing : public ::benchmark::Fixture {
+ protected:
+  void SetUp(State& st) override {
+    ::benchmark::Fixture::SetUp(st);
+    address_ = TestAddress();
+  }
+
+  void TearDown(State& st) override {
+    trace_ring_stop();
+    trace_ring_set_vendor_enabled(true);
+    btu_trace_level = BT_TRACE_LEVEL_WARNING;
+    ::benchmark::Fixture::TearDown(st);
+  }
+
+  void TraceAcl(State& state) {
+    uint16_t handle = 0;
+    for (auto _ : state) trace_acl(address_, handle++);
+  }
+
+  RawAddress address_;
+};
+
+}  // namespace
+
+/* Suppressed trace, no vendor logger: nothing is evaluated */
+BENCHMARK_DEFINE_F(BM_TraceRing, suppressed_no_vendor)(State& state) {
+  trace_ring_set_vendor_enabled(false);
+  TraceAcl(state);
+}
+
+/* Suppressed trace formatted synchronously for the vendor logger */
+BENCHMARK_DEFINE_F(BM_TraceRing, suppressed_vendor_sync)(State& state) {
+  TraceAcl(state);
+}
+
+/* Suppressed trace captured for the vendor logger */
+BENCHMARK_DEFINE_F(BM_TraceRing, suppressed_vendor_deferred)(State& state) {
+  trace_ring_start(sink);
+  TraceAcl(state);
+}
+
+/* Enabled trace formatted synchronously, as before */
+BENCHMARK_DEFINE_F(BM_TraceRing, enabled_sync)(State& state) {
+  btu_trace_level = BT_TRACE_LEVEL_DEBUG;
+  TraceAcl(state);
+}
+
+/* Enabled trace captured, formatted on the trace thread */
+BENCHMARK_DEFINE_F(BM_TraceRing, enabled_deferred)(State& state) {
+  btu_trace_level = BT_TRACE_LEVEL_DEBUG;
+  trace_ring_start(sink);
+  TraceAcl(state);
+}
+
+BENCHMARK_REGISTER_F(BM_TraceRing, suppressed_no_vendor);
+BENCHMARK_REGISTER_F(BM_TraceRing, suppressed_vendor_sync);
+BENCHMARK_REGISTER_F(BM_TraceRing, suppressed_vendor_deferred);
+BENCHMARK_REGISTER_F(BM_TraceRing, enabled_sync);
+BENCHMARK_REGISTER_F(BM_TraceRing, enabled_deferred);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,247 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "osi/include/trace_ring.h"
+#include "types/raw_address.h"
+
+using system_bt_osi::TraceLogSync;
+using system_bt_osi::TraceRingLog;
+
+namespace {
+
+struct SunkTrace {
+  uint32_t trace_set_mask;
+  bool vendor;
+  std::string message;
+};
+
+std::mutex sunk_mutex;
+std::vector<SunkTrace> sunk;
+
+void test_sink(uint32_t trace_set_mask, bool vendor, const char* message) {
+  std::lock_guard<std::mutex> lock(sunk_mutex);
+  sunk.push_back({trace_set_mask, vendor, message});
+}
+
+// Captures one trace and formats it back.
+template <typename... Args>
+std::string CaptureAndFormat(const char* fmt, Args... args) {
+  uint64_t strings = trace_ring_string_args(fmt);
+  std::vector<uint8_t> buffer(
+      system_bt_osi::trace_ring_internal::ArgsSize(strings, args...));
+  system_bt_osi::trace_ring_internal::WriteArgs(buffer.data(), strings,
+                                                args...);
+  return trace_ring_format(fmt, buffer.data(), buffer.size());
+}
+
+// RawAddress(const uint8_t (&)[6]) is not part of libosi.
+RawAddress TestAddress() {
+  static const uint8_t bytes[] = {0x00, 0x11, 0x22, 0xaa, 0xbb, 0xcc};
+  RawAddress address;
+  memcpy(address.address, bytes, sizeof(bytes));
+  return address;
+}
+
+std::string sync_message;
+
+void sync_log(uint32_t trace_set_mask, const char* fmt, ...) {
+  char buffer[256];
+  va_list ap;
+  va_start(ap, fmt);
+  vsnprintf(buffer, sizeof(buffer), fmt, ap);
+  va_end(ap);
+  sync_message = buffer;
+}
+
+class TraceRingTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    sunk.clear();
+    ASSERT_TRUE(trace_ring_start(test_sink));
+  }
+
+  void TearDown() override { trace_ring_stop(); }
+};
+
+}  // namespace
+
+TEST(TraceRingFormatTest, test_integers) {
+  EXPECT_EQ("a=-5 b=7 c=ff d=0x0010 e=4294967295",
+            CaptureAndFormat("a=%d b=%lu c=%x d=0x%04X e=%u", -5, 7ul,
+                             (uint8_t)0xff, (uint16_t)0x10, 0xffffffffu));
+  EXPECT_EQ("z=123 ll=-9000000000 c=A",
+            CaptureAndFormat("z=%zu ll=%lld c=%c", (size_t)123,
+                             -9000000000ll, 'A'));
+  EXPECT_EQ("[  42] [42  ] [0042]",
+            CaptureAndFormat("[%4d] [%-4d] [%.4d]", 42, 42, 42));
+  EXPECT_EQ("[   7]", CaptureAndFormat("[%*d]", 4, 7));
+  EXPECT_EQ("1.50 true", CaptureAndFormat("%.2f %s", 1.5, "true"));
+}
+
+TEST(TraceRingFormatTest, test_strings_and_addresses) {
+  const char* null_string = nullptr;
+  char buffer[] = "buffer";
+  EXPECT_EQ("name=buffer (null) 100%",
+            CaptureAndFormat("name=%s %s 100%%", buffer, null_string));
+
+  RawAddress address = TestAddress();
+  EXPECT_EQ("BTM_IsAclConnectionUp: RemBdAddr: 00:11:22:aa:bb:cc",
+            CaptureAndFormat("%s: RemBdAddr: %s", "BTM_IsAclConnectionUp",
+                             address));
+
+  std::string long_string(1000, 'x');
+  EXPECT_EQ(std::string(255, 'x'), CaptureAndFormat("%s", long_string.c_str()));
+}
+
+TEST(TraceRingFormatTest, test_byte_pointers) {
+  // Not NUL terminated, it must not be read.
+  uint8_t bytes[] = {0x01, 0x02, 0x03};
+  uint8_t* p = bytes;
+  char expected[32];
+  snprintf(expected, sizeof(expected), "p=%p", p);
+  EXPECT_EQ(expected, CaptureAndFormat("p=%p", p));
+  EXPECT_EQ(1 + sizeof(uint64_t),
+            system_bt_osi::trace_ring_internal::ArgsSize(0, p));
+
+  const signed char* s = reinterpret_cast<const signed char*>(bytes);
+  snprintf(expected, sizeof(expected), "s=%p", s);
+  EXPECT_EQ(expected, CaptureAndFormat("s=%p", s));
+}
+
+TEST(TraceRingFormatTest, test_byte_strings) {
+  // A BD_NAME printed with %s, as the synchronous path would.
+  uint8_t bd_name[] = "Headset";
+  uint8_t bytes[] = {0x01, 0x02, 0x03};
+  char expected[64];
+  snprintf(expected, sizeof(expected), "name=<Headset> p=%p", bytes);
+  EXPECT_EQ(expected,
+            CaptureAndFormat("name=<%s> p=%p", bd_name, (uint8_t*)bytes));
+
+  const uint8_t* null_name = nullptr;
+  EXPECT_EQ("[  4] Headset (null)",
+            CaptureAndFormat("[%*d] %s %s", 3, 4, bd_name, null_name));
+}
+
+TEST(TraceRingFormatTest, test_string_args) {
+  EXPECT_EQ(0u, trace_ring_string_args("no conversions 100%%"));
+  EXPECT_EQ(0x5u, trace_ring_string_args("%s %d %-10s %p"));
+  // '*' width and precision take an argument each.
+  EXPECT_EQ(0x10u, trace_ring_string_args("%*.*d %.*s"));
+  EXPECT_EQ(0x2u, trace_ring_string_args("%lu %s %"));
+}
+
+TEST(TraceRingFormatTest, test_mismatched_arguments) {
+  EXPECT_EQ("a=1 b=<missing>", CaptureAndFormat("a=%d b=%d", 1));
+  EXPECT_EQ("s=<bad arg>", CaptureAndFormat("s=%s", 5));
+  EXPECT_EQ("unknown %y", CaptureAndFormat("unknown %y", 5));
+  EXPECT_EQ("trailing ", CaptureAndFormat("trailing %l", 5));
+}
+
+TEST(TraceRingFormatTest, test_sync_path_formats_addresses) {
+  RawAddress address = TestAddress();
+  TraceLogSync(sync_log, 0, "%s handle=0x%04x %s", address, 0x42, "up");
+  EXPECT_EQ("00:11:22:aa:bb:cc handle=0x0042 up", sync_message);
+}
+
+TEST_F(TraceRingTest, test_deferred_traces_are_delivered_in_order) {
+  static const trace_ring_site_t log_site = {"log %d %s", 0x1234};
+  static const trace_ring_site_t vendor_site = {"vendor %d", 0x5678};
+
+  EXPECT_TRUE(trace_ring_mode.load() & TRACE_RING_DEFERRED);
+  for (int i = 0; i < 10; i++) {
+    TraceRingLog(&log_site, false, i, "str");
+    TraceRingLog(&vendor_site, true, i);
+  }
+  trace_ring_flush();
+
+  std::lock_guard<std::mutex> lock(sunk_mutex);
+  ASSERT_EQ(20u, sunk.size());
+  for (int i = 0; i < 10; i++) {
+    EXPECT_EQ(0x1234u, sunk[2 * i].trace_set_mask);
+    EXPECT_FALSE(sunk[2 * i].vendor);
+    EXPECT_EQ("log " + std::to_string(i) + " str", sunk[2 * i].message);
+    EXPECT_EQ(0x5678u, sunk[2 * i + 1].trace_set_mask);
+    EXPECT_TRUE(sunk[2 * i + 1].vendor);
+    EXPECT_EQ("vendor " + std::to_string(i), sunk[2 * i + 1].message);
+  }
+}
+
+TEST_F(TraceRingTest, test_traces_of_exited_threads) {
+  static const trace_ring_site_t site = {"thread %d trace %d", 0};
+  const int kThreads = 4;
+  const int kTraces = 500;
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; t++) {
+    threads.emplace_back([t]() {
+      for (int i = 0; i < kTraces; i++) TraceRingLog(&site, false, t, i);
+    });
+  }
+  for (auto& thread : threads) thread.join();
+  trace_ring_flush();
+
+  std::lock_guard<std::mutex> lock(sunk_mutex);
+  ASSERT_EQ((size_t)(kThreads * kTraces), sunk.size());
+  std::vector<int> next(kThreads, 0);
+  for (const SunkTrace& trace : sunk) {
+    int t, i;
+    ASSERT_EQ(2, sscanf(trace.message.c_str(), "thread %d trace %d", &t, &i));
+    EXPECT_EQ(next[t]++, i);
+  }
+}
+
+TEST_F(TraceRingTest, test_debug_dump_formats_pending_traces) {
+  static const trace_ring_site_t site = {"pending %s", 0};
+  TraceRingLog(&site, false, "trace");
+
+  FILE* file = tmpfile();
+  ASSERT_TRUE(file != NULL);
+  trace_ring_debug_dump(fileno(file));
+  rewind(file);
+  std::string dump;
+  char buffer[256];
+  while (fgets(buffer, sizeof(buffer), file)) dump += buffer;
+  fclose(file);
+
+  EXPECT_NE(std::string::npos, dump.find("pending trace"));
+  std::lock_guard<std::mutex> lock(sunk_mutex);
+  ASSERT_EQ(1u, sunk.size());
+  EXPECT_EQ("pending trace", sunk[0].message);
+}
+
+TEST_F(TraceRingTest, test_stop_goes_back_to_sync) {
+  static const trace_ring_site_t site = {"before stop", 0};
+  TraceRingLog(&site, false);
+  trace_ring_stop();
+
+  EXPECT_FALSE(trace_ring_mode.load() & TRACE_RING_DEFERRED);
+  std::lock_guard<std::mutex> lock(sunk_mutex);
+  ASSERT_EQ(1u, sunk.size());
+  EXPECT_EQ("before stop", sunk[0].message);
+}
@@ -0,0 +1,222 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "AlarmTestHarness.h"
+
+#include "osi/include/alarm.h"
+#include "osi/include/osi.h"
+#include "osi/include/time.h"
+#include "osi/include/virtual_clock.h"
+
+static const period_ms_t START_MS = 1000;
+static const period_ms_t HOUR_MS = 60 * 60 * 1000;
+
+static std::vector<period_ms_t> fired_at;
+static std::vector<int> fired_id;
+
+static void record_cb(void* data) {
+  fired_at.push_back(virtual_clock_now_ms());
+  fired_id.push_back(PTR_TO_INT(data));
+}
+
+class VirtualClockTest : public AlarmTestHarness {
+ protected:
+  virtual void SetUp() {
+    AlarmTestHarness::SetUp();
+    virtual_clock_enable(START_MS);
+    fired_at.clear();
+    fired_id.clear();
+  }
+
+  virtual void TearDown() {
+    AlarmTestHarness::TearDown();
+    virtual_clock_disable();
+  }
+};
+
+TEST_F(VirtualClockTest, test_time_follows_virtual_clock) {
+  EXPECT_EQ(START_MS, virtual_clock_now_ms());
+  EXPECT_EQ(START_MS, (period_ms_t)time_get_os_boottime_ms());
+
+  virtual_clock_advance(HOUR_MS);
+  EXPECT_EQ(START_MS + HOUR_MS, virtual_clock_now_ms());
+  EXPECT_EQ((START_MS + HOUR_MS) * 1000, time_get_os_boottime_us());
+}
+
+TEST_F(VirtualClockTest, test_alarms_fire_in_deadline_order) {
+  alarm_t* alarms[3];
+  const period_ms_t delays[3] = {2 * HOUR_MS, HOUR_MS / 2, HOUR_MS};
+  for (int i = 0; i < 3; i++) {
+    alarms[i] = alarm_new("virtual_clock_test.order");
+    alarm_set(alarms[i], delays[i], record_cb, INT_TO_PTR(i));
+  }
+
+  virtual_clock_advance(HOUR_MS);
+  ASSERT_EQ(2u, fired_id.size());
+  EXPECT_EQ(1, fired_id[0]);
+  EXPECT_EQ(START_MS + HOUR_MS / 2, fired_at[0]);
+  EXPECT_EQ(2, fired_id[1]);
+  EXPECT_EQ(START_MS + HOUR_MS, fired_at[1]);
+  EXPECT_TRUE(alarm_is_scheduled(alarms[0]));
+  EXPECT_EQ(HOUR_MS, alarm_get_remaining_ms(alarms[0]));
+
+  EXPECT_EQ(START_MS + 2 * HOUR_MS, virtual_clock_run_until_idle(10 * HOUR_MS));
+  ASSERT_EQ(3u, fired_id.size());
+  EXPECT_EQ(0, fired_id[2]);
+
+  for (int i = 0; i < 3; i++) alarm_free(alarms[i]);
+}
+
+TEST_F(VirtualClockTest, test_periodic_alarm_simulates_hours) {
+  alarm_t* alarm = alarm_new_periodic("virtual_clock_test.periodic");
+  alarm_set(alarm, 100, record_cb, INT_TO_PTR(0));
+
+  virtual_clock_advance(HOUR_MS);
+  ASSERT_EQ(HOUR_MS / 100, fired_at.size());
+  for (size_t i = 0; i < fired_at.size(); i++)
+    EXPECT_EQ(START_MS + (i + 1) * 100, fired_at[i]);
+
+  alarm_free(alarm);
+}
+
+static alarm_t* chained_alarm;
+
+static void chained_cb(void* data) {
+  int remaining = PTR_TO_INT(data);
+  record_cb(data);
+  if (remaining > 0)
+    alarm_set(chained_alarm, 1000, chained_cb, INT_TO_PTR(remaining - 1));
+}
+
+TEST_F(VirtualClockTest, test_alarm_set_from_callback) {
+  chained_alarm = alarm_new("virtual_clock_test.chained");
+  alarm_set(chained_alarm, 1000, chained_cb, INT_TO_PTR(9));
+
+  EXPECT_EQ(START_MS + 10 * 1000, virtual_clock_run_until_idle(HOUR_MS));
+  EXPECT_EQ(10u, fired_at.size());
+
+  alarm_free(chained_alarm);
+}
+
+struct FakeSource {
+  std::vector<period_ms_t> deadlines;
+};
+
+static bool fake_next_deadline(void* context, period_ms_t* deadline_ms) {
+  FakeSource* source = static_cast<FakeSource*>(context);
+  if (source->deadlines.empty()) return false;
+  *deadline_ms = source->deadlines.front();
+  return true;
+}
+
+static void fake_run_due(void* context) {
+  FakeSource* source = static_cast<FakeSource*>(context);
+  while (!source->deadlines.empty() &&
+         source->deadlines.front() <= virtual_clock_now_ms()) {
+    source->deadlines.erase(source->deadlines.begin());
+    record_cb(INT_TO_PTR(100));
+  }
+}
+
+TEST_F(VirtualClockTest, test_sources_interleave_with_alarms) {
+  FakeSource fake;
+  fake.deadlines = {START_MS + 150, START_MS + 350};
+  virtual_clock_source_t source = {fake_next_deadline, fake_run_due, &fake};
+  virtual_clock_register_source(&source);
+
+  alarm_t* alarm = alarm_new_periodic("virtual_clock_test.interleave");
+  alarm_set(alarm, 100, record_cb, INT_TO_PTR(0));
+
+  virtual_clock_advance(400);
+  std::vector<int> expected_ids = {0, 100, 0, 0, 100, 0};
+  std::vector<period_ms_t> expected_at = {START_MS + 100, START_MS + 150,
+                                          START_MS + 200, START_MS + 300,
+                                          START_MS + 350, START_MS + 400};
+  EXPECT_EQ(expected_ids, fired_id);
+  EXPECT_EQ(expected_at, fired_at);
+
+  alarm_free(alarm);
+  virtual_clock_unregister_source(&source);
+}
+
+// Counts the distinct times at which the alarms of |periods| fire over an
+// hour, that is how many times the device wakes up for them, and checks that
+// each fires within its slack.
+static size_t simulate_wakeups(const std::vector<period_ms_t>& periods,
+                               period_ms_t slack_ms) {
+  const period_ms_t start_ms = virtual_clock_now_ms();
+  std::vector<alarm_t*> alarms;
+  for (size_t i = 0; i < periods.size(); i++) {
+    alarms.push_back(alarm_new_periodic("virtual_clock_test.slack"));
+    alarm_set_with_slack(alarms[i], periods[i], slack_ms, record_cb,
+                         INT_TO_PTR(i));
+  }
+
+  virtual_clock_advance(HOUR_MS);
+
+  std::vector<size_t> fired_count(periods.size(), 0);
+  size_t wakeups = 0;
+  for (size_t i = 0; i < fired_at.size(); i++) {
+    if (i == 0 || fired_at[i] != fired_at[i - 1]) wakeups++;
+
+    const int id = fired_id[i];
+    const period_ms_t deadline = start_ms + ++fired_count[id] * periods[id];
+    EXPECT_LE(deadline, fired_at[i]);
+    EXPECT_GE(deadline + slack_ms, fired_at[i]);
+  }
+  for (size_t i = 0; i < periods.size(); i++) {
+    EXPECT_GE(fired_count[i], (HOUR_MS - slack_ms) / periods[i]);
+    alarm_free(alarms[i]);
+  }
+  fired_at.clear();
+  fired_id.clear();
+  return wakeups;
+}
+
+TEST_F(VirtualClockTest, test_slack_reduces_wakeups) {
+  const std::vector<period_ms_t> periods = {1000, 1500, 2300, 3700};
+
+  size_t strict_wakeups = simulate_wakeups(periods, 0);
+  size_t batched_wakeups = simulate_wakeups(periods, 500);
+
+  // Without slack, the alarms only share the wakeups at common multiples of
+  // their periods. With it, most of the slower ones ride along the faster.
+  EXPECT_GT(strict_wakeups, HOUR_MS / 1000 * 3 / 2);
+  EXPECT_LT(batched_wakeups * 3, strict_wakeups * 2);
+}
+
+TEST_F(VirtualClockTest, test_alarm_without_slack_bounds_wakeup) {
+  alarm_t* lax = alarm_new("virtual_clock_test.lax");
+  alarm_t* strict = alarm_new("virtual_clock_test.strict");
+  alarm_set_with_slack(lax, 100, 1000, record_cb, INT_TO_PTR(0));
+  alarm_set(strict, 300, record_cb, INT_TO_PTR(1));
+
+  // The strict alarm sets the wakeup, and the lax one runs along with it.
+  virtual_clock_advance(1000);
+  std::vector<int> expected_ids = {0, 1};
+  std::vector<period_ms_t> expected_at = {START_MS + 300, START_MS + 300};
+  EXPECT_EQ(expected_ids, fired_id);
+  EXPECT_EQ(expected_at, fired_at);
+
+  alarm_free(lax);
+  alarm_free(strict);
+}
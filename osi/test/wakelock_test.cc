@@ -23,6 +23,9 @@
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <unistd.h>
+
+#include <string>
 
 #include "osi/include/wakelock.h"
 
@@ -155,3 +158,39 @@ TEST_F(WakelockTest, test_set_paths) {
     ASSERT_FALSE(IsFileWakeLockAcquired());
   }
 }
+
+TEST_F(WakelockTest, test_attribution_debug_dump) {
+  wakelock_set_os_callouts(&bt_wakelock_callouts);
+
+  wakelock_set_attribution("wakelock_test.first");
+  wakelock_acquire();
+  usleep(20 * 1000);
+  wakelock_set_attribution("wakelock_test.second");
+  wakelock_set_attribution("wakelock_test.second");
+  wakelock_release();
+
+  // Not held, so not charged.
+  wakelock_set_attribution("wakelock_test.idle");
+
+  FILE* file = tmpfile();
+  ASSERT_TRUE(file != NULL);
+  wakelock_debug_dump(fileno(file));
+  rewind(file);
+  std::string dump;
+  char buffer[256];
+  while (fgets(buffer, sizeof(buffer), file)) dump += buffer;
+  fclose(file);
+
+  size_t first = dump.find("wakelock_test.first");
+  size_t second = dump.find("wakelock_test.second");
+  ASSERT_NE(std::string::npos, first);
+  ASSERT_NE(std::string::npos, second);
+  // Sorted by the time held.
+  EXPECT_LT(first, second);
+  EXPECT_EQ(std::string::npos, dump.find("wakelock_test.idle"));
+  // One real acquisition, handed over once: setting the same name again
+  // while held counts neither.
+  EXPECT_NE(std::string::npos, dump.find(": 1 / 0 / ", first));
+  EXPECT_NE(std::string::npos, dump.find(": 0 / 1 / ", second));
+  EXPECT_EQ(std::string::npos, dump.find(": 1 / ", second));
+}
@@ -23,7 +23,7 @@
 
 #include "osi/include/socket_utils/sockets.h"
 #include "service/daemon.h"
-#include "service/ipc/linux_ipc_host.h"
+#include "service/ipc/linux_ipc_server.h"
 #include "service/settings.h"
 
 namespace ipc {
@@ -99,6 +99,14 @@ bool IPCHandlerLinux::Run() {
 
   CHECK(socket_.is_valid());
 
+  // Set up here so that Stop() can always reach the event loop.
+  server_.reset(new LinuxIPCServer(socket_.get(), adapter()));
+  if (!server_->Init()) {
+    LOG(ERROR) << "Failed to set up the IPC event loop";
+    server_.reset();
+    return false;
+  }
+
   running_ = true;  // Set this here before launching the thread.
 
   // Start an IO thread and post the listening task.
@@ -118,14 +126,15 @@ bool IPCHandlerLinux::Run() {
 void IPCHandlerLinux::Stop() {
   keep_running_ = false;
 
-  // At this moment the listening thread might be blocking on the accept
-  // syscall. Shutdown and close the server socket before joining the thread to
-  // interrupt accept so that the main thread doesn't keep blocking.
+  // Wake the event loop of the listening thread up so that it returns.
+  if (server_) server_->Stop();
   shutdown(socket_.get(), SHUT_RDWR);
-  socket_.reset();
 
-  // Join and clean up the thread.
+  // Join and clean up the thread, the event loop refers to the socket until
+  // then.
   thread_.Stop();
+  server_.reset();
+  socket_.reset();
 
   // Thread exited. Notify the delegate. Post this on the event loop so that the
   // callback isn't reentrant.
@@ -149,27 +158,9 @@ void IPCHandlerLinux::StartListeningOnThread() {
 
   NotifyStartedOnOriginThread();
 
-  // TODO(armansito): The code below can cause the daemon to run indefinitely if
-  // the thread is joined while it's in the middle of the EventLoop() call. The
-  // EventLoop() won't exit until a client terminates the connection, however
-  // this can be fixed by using the |thread_|'s MessageLoopForIO instead (since
-  // it gets stopped along with the thread).
-  // TODO(icoolidge): accept simultaneous clients
-  while (keep_running_.load()) {
-    int client_socket = accept4(socket_.get(), nullptr, nullptr, SOCK_NONBLOCK);
-    if (client_socket < 0) {
-      LOG(ERROR) << "Failed to accept client connection: " << strerror(errno);
-      continue;
-    }
-
-    LOG(INFO) << "Established client connection: fd=" << client_socket;
-
-    LinuxIPCHost ipc_host(client_socket, adapter());
-
-    // TODO(armansito): Use |thread_|'s MessageLoopForIO instead of using a
-    // custom event loop to poll from the socket.
-    ipc_host.EventLoop();
-  }
+  // Serves all the clients until Stop() is called.
+  if (keep_running_.load() && !server_->Run())
+    LOG(ERROR) << "IPC event loop failed";
 }
 
 void IPCHandlerLinux::ShutDownOnOriginThread() {
@@ -17,6 +17,7 @@
 #pragma once
 
 #include <atomic>
+#include <memory>
 
 #include <base/files/file_path.h>
 #include <base/files/scoped_file.h>
@@ -32,6 +33,8 @@ class SingleThreadTaskRunner;
 
 namespace ipc {
 
+class LinuxIPCServer;
+
 // Implements a Linux sequential packet domain-socket based IPCHandler
 class IPCHandlerLinux : public IPCHandler {
  public:
@@ -80,6 +83,9 @@ class IPCHandlerLinux : public IPCHandler {
   // Whether or not the listening thread should continue to run.
   std::atomic<bool> keep_running_;
 
+  // Event loop serving the clients on |thread_|.
+  std::unique_ptr<LinuxIPCServer> server_;
+
   // The origin thread's task runner.
   scoped_refptr<base::SingleThreadTaskRunner> origin_task_runner_;
 
@@ -0,0 +1,243 @@
+//
+//  Copyright (C) 2015 Google, Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at:
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#define LOG_TAG "bt_bluetooth_host"
+
+#include "service/ipc/linux_ipc_client.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "osi/include/log.h"
+#include "osi/include/osi.h"
+#include "service/common/bluetooth/low_energy_constants.h"
+#include "service/common/bluetooth/scan_result.h"
+
+namespace {
+
+// Messages handed to the socket per sendmmsg() call.
+const size_t kMaxSendBatch = 64;
+
+// Ring slots available for control messages on top of the scan results.
+const size_t kControlSlots = 16;
+
+}  // namespace
+
+namespace ipc {
+
+bool LinuxIPCSubscription::Matches(const bluetooth::ScanResult& result) const {
+  if (!scan_results || result.rssi() < min_rssi) return false;
+
+  if (!addresses.empty() &&
+      addresses.find(result.device_address()) == addresses.end())
+    return false;
+
+  if (manufacturer_ids.empty()) return true;
+
+  const std::vector<uint8_t>& record = result.scan_record();
+  for (size_t i = 0; i < record.size() && record[i] != 0;
+       i += record[i] + 1) {
+    size_t field_len = record[i];
+    if (i + field_len >= record.size()) break;
+    if (record[i + 1] != bluetooth::kEIRTypeManufacturerSpecificData ||
+        field_len < 3)
+      continue;
+    uint16_t company_id = record[i + 2] | (record[i + 3] << 8);
+    if (manufacturer_ids.find(company_id) != manufacturer_ids.end())
+      return true;
+  }
+  return false;
+}
+
+LinuxIPCClient::LinuxIPCClient(int fd, size_t scan_result_capacity)
+    : fd_(fd),
+      scan_result_capacity_(scan_result_capacity),
+      drop_policy_(DropPolicy::kDropOldest),
+      slots_(scan_result_capacity + kControlSlots),
+      head_(0),
+      size_(0),
+      scan_results_(0),
+      popped_(0) {}
+
+LinuxIPCClient::~LinuxIPCClient() { close(fd_); }
+
+bool LinuxIPCClient::Send(const std::string& message,
+                          MessageClass message_class, const std::string& key) {
+  stats_.queued++;
+
+  bool coalesce = message_class == MessageClass::kScanResult &&
+                  drop_policy_ == DropPolicy::kCoalesce && !key.empty();
+  if (coalesce) {
+    auto queued = coalesce_slots_.find(key);
+    if (queued != coalesce_slots_.end()) {
+      SlotAt(queued->second - popped_).message.assign(message);
+      stats_.coalesced++;
+      return true;
+    }
+  }
+
+  if (message_class == MessageClass::kScanResult &&
+      scan_results_ >= scan_result_capacity_) {
+    if (drop_policy_ == DropPolicy::kDropNewest || scan_results_ == 0) {
+      stats_.dropped++;
+      return false;
+    }
+    DropOldestScanResult();
+  }
+
+  Reserve();
+  // Reuse the buffers of the slot, so that a busy client does not allocate.
+  Slot& slot = SlotAt(size_);
+  slot.message.assign(message);
+  slot.key.clear();
+  slot.message_class = message_class;
+  slot.dropped = false;
+  if (coalesce) {
+    slot.key.assign(key);
+    coalesce_slots_[key] = popped_ + size_;
+  }
+  if (message_class == MessageClass::kScanResult) scan_results_++;
+  size_++;
+  return true;
+}
+
+bool LinuxIPCClient::Flush() {
+  struct mmsghdr messages[kMaxSendBatch];
+  struct iovec iovs[kMaxSendBatch];
+  size_t positions[kMaxSendBatch];
+
+  while (size_ > 0) {
+    size_t count = 0;
+    for (size_t i = 0; i < size_ && count < kMaxSendBatch; i++) {
+      Slot& slot = SlotAt(i);
+      if (slot.dropped) continue;
+
+      iovs[count].iov_base = &slot.message[0];
+      iovs[count].iov_len = slot.message.size();
+      memset(&messages[count], 0, sizeof(messages[count]));
+      messages[count].msg_hdr.msg_iov = &iovs[count];
+      messages[count].msg_hdr.msg_iovlen = 1;
+      positions[count] = i;
+      count++;
+    }
+    if (count == 0) {
+      // Only dropped slots are left.
+      SkipDropped();
+      break;
+    }
+
+    int sent;
+    OSI_NO_INTR(sent = sendmmsg(fd_, messages, count,
+                                MSG_DONTWAIT | MSG_NOSIGNAL));
+    if (sent < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) return true;
+      LOG_ERROR(LOG_TAG, "%s: unable to write to client fd=%d: %s", __func__,
+                fd_, strerror(errno));
+      return false;
+    }
+
+    stats_.send_calls++;
+    stats_.sent += sent;
+    // Free the sent slots, as well as the dropped ones in between.
+    size_t freed = sent > 0 ? positions[sent - 1] + 1 : 0;
+    for (size_t i = 0; i < freed; i++) {
+      Slot& slot = SlotAt(0);
+      if (!slot.dropped && slot.message_class == MessageClass::kScanResult)
+        scan_results_--;
+      if (!slot.key.empty()) {
+        auto queued = coalesce_slots_.find(slot.key);
+        if (queued != coalesce_slots_.end() && queued->second == popped_)
+          coalesce_slots_.erase(queued);
+      }
+      head_ = (head_ + 1) % slots_.size();
+      size_--;
+      popped_++;
+    }
+
+    // The socket is full, the caller waits for it to be writable again.
+    if ((size_t)sent < count) return true;
+  }
+  return true;
+}
+
+void LinuxIPCClient::Reserve() {
+  if (size_ < slots_.size()) return;
+
+  // Scan results dropped behind a control message the client has not read
+  // yet still take their slots, give them back first.
+  Compact();
+  if (size_ < slots_.size()) return;
+
+  // More control messages are queued than there are slots for them.
+  std::vector<Slot> slots(slots_.size() * 2);
+  for (size_t i = 0; i < size_; i++) slots[i] = std::move(SlotAt(i));
+  slots_.swap(slots);
+  head_ = 0;
+}
+
+void LinuxIPCClient::Compact() {
+  size_t kept = 0;
+  for (size_t i = 0; i < size_; i++) {
+    Slot& slot = SlotAt(i);
+    if (slot.dropped) continue;
+
+    if (!slot.key.empty()) {
+      auto queued = coalesce_slots_.find(slot.key);
+      if (queued != coalesce_slots_.end() && queued->second == popped_ + i)
+        queued->second = popped_ + kept;
+    }
+    // Swap rather than move, so that the buffers of the slots are kept.
+    if (kept != i) std::swap(SlotAt(kept), slot);
+    kept++;
+  }
+  size_ = kept;
+}
+
+void LinuxIPCClient::DropOldestScanResult() {
+  for (size_t i = 0; i < size_; i++) {
+    Slot& slot = SlotAt(i);
+    if (slot.dropped || slot.message_class != MessageClass::kScanResult)
+      continue;
+
+    if (!slot.key.empty()) {
+      auto queued = coalesce_slots_.find(slot.key);
+      if (queued != coalesce_slots_.end() && queued->second == popped_ + i)
+        coalesce_slots_.erase(queued);
+      slot.key.clear();
+    }
+    slot.message.clear();
+    slot.dropped = true;
+    scan_results_--;
+    stats_.dropped++;
+    break;
+  }
+  SkipDropped();
+}
+
+void LinuxIPCClient::SkipDropped() {
+  while (size_ > 0 && SlotAt(0).dropped) {
+    head_ = (head_ + 1) % slots_.size();
+    size_--;
+    popped_++;
+  }
+}
+
+}  // namespace ipc
@@ -0,0 +1,151 @@
+//
+//  Copyright (C) 2015 Google, Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at:
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <base/macros.h>
+
+namespace bluetooth {
+class ScanResult;
+}  // namespace bluetooth
+
+namespace ipc {
+
+// Events a Linux IPC client receives, as set with the "subscribe" command.
+struct LinuxIPCSubscription {
+  // Scan results are only sent to clients which subscribed to them.
+  bool scan_results = false;
+  int min_rssi = -128;
+  // Upper case BD_ADDR strings, empty for any device.
+  std::set<std::string> addresses;
+  // Company identifiers of the manufacturer specific data, empty for any.
+  std::set<uint16_t> manufacturer_ids;
+
+  // Returns true if |result| should be sent to the client.
+  bool Matches(const bluetooth::ScanResult& result) const;
+};
+
+// Outbound side of a Linux IPC client connection. Messages are queued in a
+// ring of reusable slots and flushed with a single sendmmsg() per batch, which
+// keeps the SOCK_SEQPACKET message boundaries. Control messages, such as
+// command replies, are never dropped. Scan results are bounded by
+// |scan_result_capacity| and dropped according to the DropPolicy when the
+// client does not keep up.
+class LinuxIPCClient {
+ public:
+  enum class DropPolicy {
+    // Drops the oldest queued scan result to make room.
+    kDropOldest,
+    // Drops the new scan result.
+    kDropNewest,
+    // Replaces the queued scan result of the same device in place, and drops
+    // the oldest queued one if there is none.
+    kCoalesce,
+  };
+
+  enum class MessageClass {
+    kControl,
+    kScanResult,
+  };
+
+  struct Stats {
+    uint64_t queued = 0;
+    uint64_t sent = 0;
+    uint64_t dropped = 0;
+    uint64_t coalesced = 0;
+    // Number of sendmmsg() calls which sent at least one message.
+    uint64_t send_calls = 0;
+  };
+
+  // LinuxIPCClient owns the passed non-blocking |fd|.
+  LinuxIPCClient(int fd, size_t scan_result_capacity);
+  ~LinuxIPCClient();
+
+  int fd() const { return fd_; }
+
+  void set_drop_policy(DropPolicy policy) { drop_policy_ = policy; }
+  DropPolicy drop_policy() const { return drop_policy_; }
+
+  // Queues |message|. |key| identifies the device of a scan result for
+  // DropPolicy::kCoalesce. Returns false if |message| was dropped.
+  bool Send(const std::string& message, MessageClass message_class,
+            const std::string& key = std::string());
+
+  // Writes out as many queued messages as the socket accepts. Returns false
+  // if the connection is broken.
+  bool Flush();
+
+  bool HasPending() const { return size_ > 0; }
+  size_t pending() const { return size_; }
+
+  const Stats& stats() const { return stats_; }
+
+ private:
+  struct Slot {
+    std::string message;
+    std::string key;
+    MessageClass message_class;
+    // Dropped scan results stay in the ring until they reach its head.
+    bool dropped;
+  };
+
+  Slot& SlotAt(size_t position) {
+    return slots_[(head_ + position) % slots_.size()];
+  }
+
+  // Makes room for one more slot, growing the ring if it is full of queued
+  // messages.
+  void Reserve();
+
+  // Frees the dropped slots, keeping the order of the queued messages.
+  void Compact();
+
+  // Drops the oldest queued scan result.
+  void DropOldestScanResult();
+
+  // Frees the slots at the head of the ring which were dropped.
+  void SkipDropped();
+
+  int fd_;
+  size_t scan_result_capacity_;
+  DropPolicy drop_policy_;
+
+  std::vector<Slot> slots_;
+  size_t head_;
+  // Slots in use, including the dropped ones.
+  size_t size_;
+  // Queued scan results, not including the dropped ones.
+  size_t scan_results_;
+  // Ring position, relative to |head_| when inserted, of the queued scan
+  // result of each device, for DropPolicy::kCoalesce.
+  std::unordered_map<std::string, uint64_t> coalesce_slots_;
+  // Number of slots ever freed at the head, to turn the positions above into
+  // current ones.
+  uint64_t popped_;
+
+  Stats stats_;
+
+  DISALLOW_COPY_AND_ASSIGN(LinuxIPCClient);
+};
+
+}  // namespace ipc
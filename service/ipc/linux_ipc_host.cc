@@ -32,10 +32,12 @@
 #include <base/base64.h>
 #include <base/strings/string_number_conversions.h>
 #include <base/strings/string_split.h>
+#include <base/strings/string_util.h>
 
 #include "osi/include/log.h"
 #include "osi/include/osi.h"
 #include "service/adapter.h"
+#include "service/ipc/linux_ipc_server.h"
 
 using bluetooth::Adapter;
 using bluetooth::Uuid;
@@ -56,15 +58,18 @@ const char kSetScanResponseCommand[] = "set-scan-response";
 const char kStartServiceCommand[] = "start-service";
 const char kStopServiceCommand[] = "stop-service";
 const char kWriteCharacteristicCommand[] = "write-characteristic";
+const char kSubscribeCommand[] = "subscribe";
+const char kStartScanCommand[] = "start-scan";
+const char kStopScanCommand[] = "stop-scan";
 
-// Useful values for indexing LinuxIPCHost::pfds_
-// Not super general considering that we should be able to support
-// many GATT FDs owned by one LinuxIPCHost.
-enum {
-  kFdIpc = 0,
-  kFdGatt = 1,
-  kPossibleFds = 2,
-};
+const char kScanEvent[] = "scan";
+const char kDropOldestPolicy[] = "drop-oldest";
+const char kDropNewestPolicy[] = "drop-newest";
+const char kCoalescePolicy[] = "coalesce";
+
+// Messages handled per wakeup, so that a chatty client does not starve the
+// others.
+const int kMaxMessagesPerWakeup = 16;
 
 bool TokenBool(const std::string& text) { return text == "true"; }
 
@@ -72,28 +77,19 @@ bool TokenBool(const std::string& text) { return text == "true"; }
 
 namespace ipc {
 
-LinuxIPCHost::LinuxIPCHost(int sockfd, Adapter* adapter)
-    : adapter_(adapter), pfds_(1, {sockfd, POLLIN, 0}) {}
+LinuxIPCHost::LinuxIPCHost(std::unique_ptr<LinuxIPCClient> client,
+                           Adapter* adapter, LinuxIPCServer* server)
+    : client_(std::move(client)),
+      adapter_(adapter),
+      server_(server),
+      gatt_fd_(INVALID_FD) {}
 
-LinuxIPCHost::~LinuxIPCHost() { close(pfds_[0].fd); }
+LinuxIPCHost::~LinuxIPCHost() {}
 
-bool LinuxIPCHost::EventLoop() {
-  while (true) {
-    int status =
-        TEMP_FAILURE_RETRY(ppoll(pfds_.data(), pfds_.size(), nullptr, nullptr));
-    if (status < 1) {
-      LOG_ERROR(LOG_TAG, "ppoll error");
-      return false;
-    }
-
-    if (pfds_[kFdIpc].revents && !OnMessage()) {
-      return false;
-    }
-
-    if (pfds_.size() == kPossibleFds && pfds_[kFdGatt].revents &&
-        !OnGattWrite()) {
-      return false;
-    }
+bool LinuxIPCHost::OnReadable() {
+  bool again = true;
+  for (int i = 0; again && i < kMaxMessagesPerWakeup; i++) {
+    if (!OnMessage(&again)) return false;
   }
   return true;
 }
@@ -114,15 +110,16 @@ bool LinuxIPCHost::OnCreateService(const std::string& service_uuid) {
     LOG_ERROR(LOG_TAG, "Failed to initialize bluetooth");
     return false;
   }
-  pfds_.resize(kPossibleFds);
-  pfds_[kFdGatt] = {gattfd, POLLIN, 0};
-  return true;
+  if (gatt_fd_ != INVALID_FD) server_->UnwatchGattFd(gatt_fd_);
+  gatt_fd_ = gattfd;
+  return server_->WatchGattFd(this, gatt_fd_);
 }
 
 bool LinuxIPCHost::OnDestroyService(const std::string& service_uuid) {
+  // The pipe is closed along with the server.
+  if (gatt_fd_ != INVALID_FD) server_->UnwatchGattFd(gatt_fd_);
+  gatt_fd_ = INVALID_FD;
   gatt_servers_.erase(service_uuid);
-  close(pfds_[1].fd);
-  pfds_.resize(1);
   return true;
 }
 
@@ -244,13 +241,78 @@ bool LinuxIPCHost::OnStopService(const std::string& service_uuid) {
   return gatt_servers_[service_uuid]->Stop();
 }
 
-bool LinuxIPCHost::OnMessage() {
+bool LinuxIPCHost::OnSubscribe(const std::string& events,
+                               const std::string& min_rssi,
+                               const std::string& addresses,
+                               const std::string& manufacturer_ids,
+                               const std::string& drop_policy) {
+  LinuxIPCSubscription subscription;
+
+  std::vector<std::string> event_tokens = base::SplitString(
+      events, ".", base::TRIM_WHITESPACE, base::SPLIT_WANT_NONEMPTY);
+  subscription.scan_results =
+      std::find(event_tokens.begin(), event_tokens.end(), kScanEvent) !=
+      event_tokens.end();
+
+  if (!min_rssi.empty() &&
+      !base::StringToInt(min_rssi, &subscription.min_rssi)) {
+    LOG_ERROR(LOG_TAG, "%s: invalid RSSI: %s", __func__, min_rssi.c_str());
+    return false;
+  }
+
+  for (const auto& address :
+       base::SplitString(addresses, ".", base::TRIM_WHITESPACE,
+                         base::SPLIT_WANT_NONEMPTY))
+    subscription.addresses.insert(base::ToUpperASCII(address));
+
+  for (const auto& id :
+       base::SplitString(manufacturer_ids, ".", base::TRIM_WHITESPACE,
+                         base::SPLIT_WANT_NONEMPTY)) {
+    uint32_t value;
+    if (!base::HexStringToUInt(id, &value) || value > 0xffff) {
+      LOG_ERROR(LOG_TAG, "%s: invalid manufacturer id: %s", __func__,
+                id.c_str());
+      return false;
+    }
+    subscription.manufacturer_ids.insert(value);
+  }
+
+  if (drop_policy == kDropOldestPolicy || drop_policy.empty()) {
+    client_->set_drop_policy(LinuxIPCClient::DropPolicy::kDropOldest);
+  } else if (drop_policy == kDropNewestPolicy) {
+    client_->set_drop_policy(LinuxIPCClient::DropPolicy::kDropNewest);
+  } else if (drop_policy == kCoalescePolicy) {
+    client_->set_drop_policy(LinuxIPCClient::DropPolicy::kCoalesce);
+  } else {
+    LOG_ERROR(LOG_TAG, "%s: invalid drop policy: %s", __func__,
+              drop_policy.c_str());
+    return false;
+  }
+
+  subscription_ = std::move(subscription);
+  return true;
+}
+
+bool LinuxIPCHost::OnStartScan() {
+  server_->StartScan(this);
+  return true;
+}
+
+bool LinuxIPCHost::OnStopScan() {
+  server_->StopScan(this);
+  return true;
+}
+
+bool LinuxIPCHost::OnMessage(bool* again) {
   std::string ipc_msg;
   ssize_t size;
 
-  OSI_NO_INTR(size =
-                  recv(pfds_[kFdIpc].fd, &ipc_msg[0], 0, MSG_PEEK | MSG_TRUNC));
-  if (-1 == size) {
+  *again = false;
+  OSI_NO_INTR(size = recv(client_->fd(), &ipc_msg[0], 0,
+                          MSG_PEEK | MSG_TRUNC | MSG_DONTWAIT));
+  if (-1 == size && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+    return true;
+  } else if (-1 == size) {
     LOG_ERROR(LOG_TAG, "Error reading datagram size: %s", strerror(errno));
     return false;
   } else if (0 == size) {
@@ -259,7 +321,7 @@ bool LinuxIPCHost::OnMessage() {
   }
 
   ipc_msg.resize(size);
-  OSI_NO_INTR(size = read(pfds_[kFdIpc].fd, &ipc_msg[0], ipc_msg.size()));
+  OSI_NO_INTR(size = read(client_->fd(), &ipc_msg[0], ipc_msg.size()));
   if (-1 == size) {
     LOG_ERROR(LOG_TAG, "Error reading IPC: %s", strerror(errno));
     return false;
@@ -268,9 +330,14 @@ bool LinuxIPCHost::OnMessage() {
     return false;
   }
 
+  *again = true;
   std::vector<std::string> tokens = base::SplitString(
       ipc_msg, "|", base::TRIM_WHITESPACE, base::SPLIT_WANT_ALL);
   switch (tokens.size()) {
+    case 1:
+      if (tokens[0] == kStartScanCommand) return OnStartScan();
+      if (tokens[0] == kStopScanCommand) return OnStopScan();
+      break;
     case 2:
       if (tokens[0] == kSetAdapterNameCommand)
         return OnSetAdapterName(tokens[1]);
@@ -295,6 +362,9 @@ bool LinuxIPCHost::OnMessage() {
       if (tokens[0] == kSetScanResponseCommand)
         return OnSetScanResponse(tokens[1], tokens[2], tokens[3], tokens[4],
                                  tokens[5]);
+      if (tokens[0] == kSubscribeCommand)
+        return OnSubscribe(tokens[1], tokens[2], tokens[3], tokens[4],
+                           tokens[5]);
       break;
     default:
       break;
@@ -308,7 +378,7 @@ bool LinuxIPCHost::OnGattWrite() {
   Uuid::UUID128Bit id;
   ssize_t r;
 
-  OSI_NO_INTR(r = read(pfds_[kFdGatt].fd, id.data(), id.size()));
+  OSI_NO_INTR(r = read(gatt_fd_, id.data(), id.size()));
   if (r != id.size()) {
     LOG_ERROR(LOG_TAG, "Error reading GATT attribute ID");
     return false;
@@ -327,12 +397,9 @@ bool LinuxIPCHost::OnGattWrite() {
   transmit += "|" + base::HexEncode(id.data(), id.size());
   transmit += "|" + encoded_value;
 
-  OSI_NO_INTR(r = write(pfds_[kFdIpc].fd, transmit.data(), transmit.size()));
-  if (-1 == r) {
-    LOG_ERROR(LOG_TAG, "Error replying to IPC: %s", strerror(errno));
-    return false;
-  }
-
+  // Sent along with the other queued messages once the event loop flushes
+  // the client.
+  client_->Send(transmit, LinuxIPCClient::MessageClass::kControl);
   return true;
 }
 
@@ -15,14 +15,13 @@
 //
 #pragma once
 
-#include <poll.h>
-
 #include <bluetooth/uuid.h>
 #include <memory>
 #include <string>
 #include <unordered_map>
 
 #include "service/gatt_server_old.h"
+#include "service/ipc/linux_ipc_client.h"
 
 namespace bluetooth {
 class Adapter;
@@ -30,28 +29,37 @@ class Adapter;
 
 namespace ipc {
 
-// This implements a single threaded event loop which dispatches
-// reads from a set of FDs (pfds_) to a set of handlers.
-// Reads from the GATT pipe read end will result in a write to
-// to the IPC socket, and vise versa.
+class LinuxIPCServer;
+
+// Handles the protocol of a single client connection. The LinuxIPCServer
+// event loop calls in when the client socket or the GATT pipe of the client
+// is readable. Reads from the GATT pipe read end will result in a write to
+// the IPC socket, and vise versa.
 class LinuxIPCHost {
  public:
-  // LinuxIPCHost owns the passed sockfd.
-  LinuxIPCHost(int sockfd, bluetooth::Adapter* adapter);
+  // LinuxIPCHost owns |client|. |server| must out-live this LinuxIPCHost.
+  LinuxIPCHost(std::unique_ptr<LinuxIPCClient> client,
+               bluetooth::Adapter* adapter, LinuxIPCServer* server);
   ~LinuxIPCHost();
 
-  // Synchronously handle all events on input FDs.
-  bool EventLoop();
+  int fd() const { return client_->fd(); }
+  LinuxIPCClient* client() const { return client_.get(); }
+  const LinuxIPCSubscription& subscription() const { return subscription_; }
 
- private:
-  // Handler for IPC message receives.
-  // Decodes protocol and dispatches to another handler.
-  bool OnMessage();
+  // Handles the messages waiting on the client socket. Returns false if the
+  // connection should be closed.
+  bool OnReadable();
 
   // Handler for GATT characteristic writes.
-  // Encodes to protocol and transmits IPC.
+  // Encodes to protocol and queues it on the client.
   bool OnGattWrite();
 
+ private:
+  // Handler for IPC message receives.
+  // Decodes protocol and dispatches to another handler. Sets |again| to false
+  // once the socket is drained.
+  bool OnMessage(bool* again);
+
   // Applies adapter name changes to stack.
   bool OnSetAdapterName(const std::string& name);
 
@@ -92,11 +100,27 @@ class LinuxIPCHost {
   // Stops service.
   bool OnStopService(const std::string& service_uuid);
 
-  // weak reference.
+  // Selects the events sent to the client, and what to do with the scan
+  // results it does not read in time.
+  bool OnSubscribe(const std::string& events, const std::string& min_rssi,
+                   const std::string& addresses,
+                   const std::string& manufacturer_ids,
+                   const std::string& drop_policy);
+
+  // Starts and stops sending scan results to the client.
+  bool OnStartScan();
+  bool OnStopScan();
+
+  std::unique_ptr<LinuxIPCClient> client_;
+
+  // weak references.
   bluetooth::Adapter* adapter_;
+  LinuxIPCServer* server_;
+
+  LinuxIPCSubscription subscription_;
 
-  // File descripters that we will block against.
-  std::vector<struct pollfd> pfds_;
+  // Read end of the GATT pipe, INVALID_FD if there is no service.
+  int gatt_fd_;
 
   // Container for multiple GATT servers. Currently only one is supported.
   // TODO(icoolidge): support many to one for real.
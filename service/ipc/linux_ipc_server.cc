@@ -0,0 +1,395 @@
+//
+//  Copyright (C) 2015 Google, Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at:
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#define LOG_TAG "bt_bluetooth_host"
+
+#include "service/ipc/linux_ipc_server.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include <base/base64.h>
+#include <base/logging.h>
+
+#include "osi/include/log.h"
+#include "osi/include/osi.h"
+#include "service/adapter.h"
+#include "service/common/bluetooth/scan_filter.h"
+#include "service/common/bluetooth/scan_settings.h"
+#include "service/ipc/linux_ipc_host.h"
+
+using bluetooth::BLEStatus;
+using bluetooth::BluetoothInstance;
+using bluetooth::LowEnergyScanner;
+using bluetooth::ScanResult;
+using bluetooth::Uuid;
+
+namespace {
+
+const char kScanResultEvent[] = "scan-result";
+
+// Events handled per epoll_wait() call.
+const int kMaxEvents = 32;
+
+// Connections accepted per wakeup, so that a burst of clients does not starve
+// the ones already connected.
+const int kMaxAcceptsPerWakeup = 16;
+
+}  // namespace
+
+namespace ipc {
+
+LinuxIPCServer::LinuxIPCServer(int listen_fd, bluetooth::Adapter* adapter)
+    : listen_fd_(listen_fd),
+      adapter_(adapter),
+      epoll_fd_(INVALID_FD),
+      wake_fd_(INVALID_FD),
+      stopping_(false),
+      pending_dropped_(0),
+      registration_failed_(false),
+      scanner_registering_(false),
+      scanner_started_(false) {}
+
+LinuxIPCServer::~LinuxIPCServer() {
+  // Unregisters from the stack before anything it calls into goes away.
+  scanner_.reset();
+  hosts_.clear();
+  if (wake_fd_ != INVALID_FD) close(wake_fd_);
+  if (epoll_fd_ != INVALID_FD) close(epoll_fd_);
+}
+
+bool LinuxIPCServer::Init() {
+  epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  if (epoll_fd_ == INVALID_FD) {
+    LOG_ERROR(LOG_TAG, "%s: unable to create epoll instance: %s", __func__,
+              strerror(errno));
+    return false;
+  }
+
+  wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (wake_fd_ == INVALID_FD) {
+    LOG_ERROR(LOG_TAG, "%s: unable to create eventfd: %s", __func__,
+              strerror(errno));
+    return false;
+  }
+
+  return AddWatch(Watch::kListen, nullptr, listen_fd_) &&
+         AddWatch(Watch::kWake, nullptr, wake_fd_);
+}
+
+bool LinuxIPCServer::Run() {
+  CHECK(epoll_fd_ != INVALID_FD);
+
+  struct epoll_event events[kMaxEvents];
+  while (!stopping_.load()) {
+    int count;
+    OSI_NO_INTR(count = epoll_wait(epoll_fd_, events, kMaxEvents, -1));
+    if (count < 0) {
+      LOG_ERROR(LOG_TAG, "%s: epoll_wait failed: %s", __func__,
+                strerror(errno));
+      return false;
+    }
+
+    for (int i = 0; i < count; i++) {
+      Watch* watch = static_cast<Watch*>(events[i].data.ptr);
+      switch (watch->type) {
+        case Watch::kListen:
+          AcceptClients();
+          break;
+        case Watch::kWake: {
+          eventfd_t value;
+          eventfd_read(wake_fd_, &value);
+          DispatchScanResults();
+          UpdateScan();
+          break;
+        }
+        case Watch::kClient:
+          HandleClientEvent(watch->host, events[i].events);
+          break;
+        case Watch::kGatt:
+          if (!watch->host->OnGattWrite()) CloseClient(watch->host);
+          dirty_.push_back(watch->host);
+          break;
+      }
+    }
+
+    // Everything queued while handling the events goes out together, and the
+    // clients are only destroyed once no event refers to them anymore.
+    FlushClients();
+    RemoveClosedClients();
+    retired_watches_.clear();
+  }
+  return true;
+}
+
+void LinuxIPCServer::Stop() {
+  stopping_ = true;
+  if (wake_fd_ != INVALID_FD) eventfd_write(wake_fd_, 1);
+}
+
+void LinuxIPCServer::OnScanResult(LowEnergyScanner* scanner,
+                                  const ScanResult& scan_result) {
+  std::lock_guard<std::mutex> lock(pending_lock_);
+  // A single wakeup is enough for the whole batch.
+  bool wake = pending_results_.empty();
+  if (pending_results_.size() >= kMaxPendingScanResults) {
+    pending_results_.pop_front();
+    pending_dropped_++;
+  }
+  pending_results_.push_back(scan_result);
+  if (wake) eventfd_write(wake_fd_, 1);
+}
+
+bool LinuxIPCServer::WatchGattFd(LinuxIPCHost* host, int fd) {
+  return AddWatch(Watch::kGatt, host, fd);
+}
+
+void LinuxIPCServer::UnwatchGattFd(int fd) {
+  auto watch = watches_.find(fd);
+  if (watch == watches_.end()) return;
+  epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+  // Events of the current batch may still point to it.
+  retired_watches_.push_back(std::move(watch->second));
+  watches_.erase(watch);
+}
+
+void LinuxIPCServer::StartScan(LinuxIPCHost* host) {
+  if (std::find(scanning_.begin(), scanning_.end(), host) == scanning_.end())
+    scanning_.push_back(host);
+  UpdateScan();
+}
+
+void LinuxIPCServer::StopScan(LinuxIPCHost* host) {
+  scanning_.erase(std::remove(scanning_.begin(), scanning_.end(), host),
+                  scanning_.end());
+  UpdateScan();
+}
+
+bool LinuxIPCServer::AddWatch(Watch::Type type, LinuxIPCHost* host, int fd) {
+  std::unique_ptr<Watch> watch(new Watch{type, host, fd});
+  struct epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN;
+  event.data.ptr = watch.get();
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) < 0) {
+    LOG_ERROR(LOG_TAG, "%s: unable to watch fd=%d: %s", __func__, fd,
+              strerror(errno));
+    return false;
+  }
+  std::unique_ptr<Watch>& slot = watches_[fd];
+  if (slot) retired_watches_.push_back(std::move(slot));
+  slot = std::move(watch);
+  return true;
+}
+
+void LinuxIPCServer::AcceptClients() {
+  for (int i = 0; i < kMaxAcceptsPerWakeup; i++) {
+    int client_fd;
+    OSI_NO_INTR(client_fd = accept4(listen_fd_, nullptr, nullptr,
+                                    SOCK_NONBLOCK | SOCK_CLOEXEC));
+    if (client_fd < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+        LOG_ERROR(LOG_TAG, "%s: failed to accept client connection: %s",
+                  __func__, strerror(errno));
+      return;
+    }
+
+    LOG_INFO(LOG_TAG, "%s: established client connection: fd=%d", __func__,
+             client_fd);
+    std::unique_ptr<LinuxIPCHost> host(new LinuxIPCHost(
+        std::unique_ptr<LinuxIPCClient>(
+            new LinuxIPCClient(client_fd, kClientScanResultCapacity)),
+        adapter_, this));
+    if (!AddWatch(Watch::kClient, host.get(), client_fd)) continue;
+    hosts_[host.get()] = std::move(host);
+  }
+}
+
+void LinuxIPCServer::HandleClientEvent(LinuxIPCHost* host, uint32_t events) {
+  if (events & EPOLLIN) {
+    // Messages still queued on the socket are read before the hang up.
+    if (!host->OnReadable()) {
+      CloseClient(host);
+      return;
+    }
+    dirty_.push_back(host);
+  } else if (events & (EPOLLHUP | EPOLLERR)) {
+    CloseClient(host);
+    return;
+  }
+
+  if (events & EPOLLOUT) dirty_.push_back(host);
+}
+
+void LinuxIPCServer::DispatchScanResults() {
+  {
+    std::lock_guard<std::mutex> lock(pending_lock_);
+    dispatched_results_.swap(pending_results_);
+    stats_.scan_results_dropped += pending_dropped_;
+    pending_dropped_ = 0;
+
+    if (registered_scanner_) {
+      scanner_.reset(
+          static_cast<LowEnergyScanner*>(registered_scanner_.release()));
+      scanner_->SetDelegate(this);
+      scanner_registering_ = false;
+    } else if (registration_failed_) {
+      // The clients have to start their scan again rather than the loop
+      // retrying forever.
+      registration_failed_ = false;
+      scanner_registering_ = false;
+      scanning_.clear();
+    }
+  }
+  if (dispatched_results_.empty()) return;
+
+  stats_.batches++;
+  stats_.scan_results += dispatched_results_.size();
+
+  std::string message;
+  std::string encoded_record;
+  for (const ScanResult& result : dispatched_results_) {
+    // Serialized once, for the first client which wants it.
+    message.clear();
+    for (LinuxIPCHost* host : scanning_) {
+      if (!host->subscription().Matches(result)) continue;
+
+      if (message.empty()) {
+        const std::vector<uint8_t>& record = result.scan_record();
+        base::Base64Encode(std::string(record.begin(), record.end()),
+                           &encoded_record);
+        message.append(kScanResultEvent);
+        message.append("|").append(result.device_address());
+        message.append("|").append(std::to_string(result.rssi()));
+        message.append("|").append(encoded_record);
+      }
+      host->client()->Send(message, LinuxIPCClient::MessageClass::kScanResult,
+                           result.device_address());
+      dirty_.push_back(host);
+    }
+  }
+  dispatched_results_.clear();
+}
+
+void LinuxIPCServer::FlushClients() {
+  std::sort(dirty_.begin(), dirty_.end());
+  dirty_.erase(std::unique(dirty_.begin(), dirty_.end()), dirty_.end());
+
+  for (LinuxIPCHost* host : dirty_) {
+    if (std::find(closed_.begin(), closed_.end(), host) != closed_.end())
+      continue;
+
+    LinuxIPCClient* client = host->client();
+    uint64_t sent = client->stats().sent;
+    uint64_t send_calls = client->stats().send_calls;
+    bool flushed = client->Flush();
+    stats_.messages_sent += client->stats().sent - sent;
+    stats_.send_calls += client->stats().send_calls - send_calls;
+    if (!flushed) {
+      CloseClient(host);
+      continue;
+    }
+
+    // Only wait for the socket to drain while there is something left, as a
+    // writable socket would otherwise wake the loop for nothing.
+    bool waiting = client->HasPending();
+    if (waiting == waiting_for_write_[host]) continue;
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = waiting ? EPOLLIN | EPOLLOUT : EPOLLIN;
+    event.data.ptr = watches_[client->fd()].get();
+    epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, client->fd(), &event);
+    waiting_for_write_[host] = waiting;
+  }
+  dirty_.clear();
+}
+
+void LinuxIPCServer::CloseClient(LinuxIPCHost* host) {
+  if (std::find(closed_.begin(), closed_.end(), host) == closed_.end())
+    closed_.push_back(host);
+}
+
+void LinuxIPCServer::RemoveClosedClients() {
+  if (closed_.empty()) return;
+
+  for (LinuxIPCHost* host : closed_) {
+    LOG_INFO(LOG_TAG, "%s: client connection closed: fd=%d", __func__,
+             host->fd());
+    for (auto it = watches_.begin(); it != watches_.end();) {
+      if (it->second->host == host) {
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, it->first, nullptr);
+        it = watches_.erase(it);
+      } else {
+        it++;
+      }
+    }
+    scanning_.erase(std::remove(scanning_.begin(), scanning_.end(), host),
+                    scanning_.end());
+    waiting_for_write_.erase(host);
+    hosts_.erase(host);
+  }
+  closed_.clear();
+  UpdateScan();
+}
+
+void LinuxIPCServer::UpdateScan() {
+  bool wanted = !scanning_.empty();
+
+  if (!scanner_) {
+    if (!wanted || scanner_registering_ || adapter_ == nullptr) return;
+
+    scanner_registering_ = true;
+    bool registered = adapter_->GetLeScannerFactory()->RegisterInstance(
+        Uuid::GetRandom(),
+        [this](BLEStatus status, const Uuid& app_uuid,
+               std::unique_ptr<BluetoothInstance> instance) {
+          // Called from the stack thread, the loop picks the scanner up.
+          std::lock_guard<std::mutex> lock(pending_lock_);
+          if (status == bluetooth::BLE_STATUS_SUCCESS && instance) {
+            registered_scanner_ = std::move(instance);
+          } else {
+            LOG_ERROR(LOG_TAG, "Failed to register the IPC scanner: %d",
+                      status);
+            registration_failed_ = true;
+          }
+          eventfd_write(wake_fd_, 1);
+        });
+    if (!registered) {
+      LOG_ERROR(LOG_TAG, "%s: unable to register a scanner", __func__);
+      scanner_registering_ = false;
+    }
+    return;
+  }
+
+  if (wanted == scanner_started_) return;
+
+  if (wanted) {
+    scanner_started_ =
+        scanner_->StartScan(bluetooth::ScanSettings(),
+                            std::vector<bluetooth::ScanFilter>());
+  } else {
+    scanner_->StopScan();
+    scanner_started_ = false;
+  }
+}
+
+}  // namespace ipc
@@ -0,0 +1,148 @@
+//
+//  Copyright (C) 2015 Google, Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at:
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <base/macros.h>
+
+#include "service/common/bluetooth/scan_result.h"
+#include "service/ipc/linux_ipc_client.h"
+#include "service/low_energy_scanner.h"
+
+namespace bluetooth {
+class Adapter;
+}  // namespace bluetooth
+
+namespace ipc {
+
+class LinuxIPCHost;
+
+// Serves the Linux IPC clients from a single thread: an epoll loop over the
+// listening socket, the client sockets and their GATT server pipes. Scan
+// results coming from the stack are queued and handed to the loop in batches;
+// each batch is fanned out to the subscribed clients and every client is then
+// flushed once, rather than writing each event to each client on its own.
+class LinuxIPCServer : public bluetooth::LowEnergyScanner::Delegate {
+ public:
+  struct Stats {
+    uint64_t scan_results = 0;
+    // Scan results dropped before reaching the loop.
+    uint64_t scan_results_dropped = 0;
+    uint64_t batches = 0;
+    // Messages written to the clients, and the sendmmsg() calls it took.
+    uint64_t messages_sent = 0;
+    uint64_t send_calls = 0;
+  };
+
+  // Scan results queued on each client before its DropPolicy applies.
+  static const size_t kClientScanResultCapacity = 256;
+
+  // Scan results waiting for the loop before the oldest are dropped.
+  static const size_t kMaxPendingScanResults = 4096;
+
+  // The server does not own |listen_fd|, a listening SOCK_SEQPACKET socket.
+  LinuxIPCServer(int listen_fd, bluetooth::Adapter* adapter);
+  ~LinuxIPCServer() override;
+
+  // Sets up the event loop. Returns false on failure.
+  bool Init();
+
+  // Serves the clients until Stop() is called. Returns false on an
+  // unrecoverable error.
+  bool Run();
+
+  // Makes Run() return. May be called from any thread.
+  void Stop();
+
+  // LowEnergyScanner::Delegate override. May be called from any thread.
+  void OnScanResult(bluetooth::LowEnergyScanner* scanner,
+                    const bluetooth::ScanResult& scan_result) override;
+
+  // Called by the hosts.
+  bool WatchGattFd(LinuxIPCHost* host, int fd);
+  void UnwatchGattFd(int fd);
+  void StartScan(LinuxIPCHost* host);
+  void StopScan(LinuxIPCHost* host);
+
+  // Only valid on the loop thread, or once Run() returned.
+  size_t client_count() const { return hosts_.size(); }
+  const Stats& stats() const { return stats_; }
+
+ private:
+  // What an epoll event is about.
+  struct Watch {
+    enum Type { kListen, kWake, kClient, kGatt } type;
+    LinuxIPCHost* host;
+    int fd;
+  };
+
+  bool AddWatch(Watch::Type type, LinuxIPCHost* host, int fd);
+  void AcceptClients();
+  void HandleClientEvent(LinuxIPCHost* host, uint32_t events);
+  void DispatchScanResults();
+  void FlushClients();
+  void CloseClient(LinuxIPCHost* host);
+  void RemoveClosedClients();
+
+  // Starts or stops the shared scanner to match the scanning clients.
+  void UpdateScan();
+
+  int listen_fd_;
+  bluetooth::Adapter* adapter_;
+
+  int epoll_fd_;
+  int wake_fd_;
+  std::atomic_bool stopping_;
+
+  std::unordered_map<LinuxIPCHost*, std::unique_ptr<LinuxIPCHost>> hosts_;
+  std::unordered_map<int, std::unique_ptr<Watch>> watches_;
+  // Watches removed while handling a batch of events, freed after it.
+  std::vector<std::unique_ptr<Watch>> retired_watches_;
+  // Clients with queued messages, and the ones waiting for EPOLLOUT.
+  std::vector<LinuxIPCHost*> dirty_;
+  std::unordered_map<LinuxIPCHost*, bool> waiting_for_write_;
+  std::vector<LinuxIPCHost*> closed_;
+  // Clients which started a scan.
+  std::vector<LinuxIPCHost*> scanning_;
+
+  // Scan results from the stack and the newly registered scanner, waiting
+  // for the loop.
+  std::mutex pending_lock_;
+  std::deque<bluetooth::ScanResult> pending_results_;
+  uint64_t pending_dropped_;
+  std::unique_ptr<bluetooth::BluetoothInstance> registered_scanner_;
+  bool registration_failed_;
+
+  // Batch of scan results being dispatched, swapped with |pending_results_|.
+  std::deque<bluetooth::ScanResult> dispatched_results_;
+
+  // Scanner shared by all the clients, registered on the first scan.
+  std::unique_ptr<bluetooth::LowEnergyScanner> scanner_;
+  bool scanner_registering_;
+  bool scanner_started_;
+
+  Stats stats_;
+
+  DISALLOW_COPY_AND_ASSIGN(LinuxIPCServer);
+};
+
+}  // namespace ipc
@@ -16,6 +16,8 @@
 
 #include "service/low_energy_scanner.h"
 
+#include <algorithm>
+
 #include <base/bind.h>
 #include <base/logging.h>
 
@@ -40,15 +42,15 @@ const size_t kScanRecordLength = 62;
 // Returns the length of the given scan record array. We have to calculate this
 // based on the maximum possible data length and the TLV data. See TODO above
 // |kScanRecordLength|.
-size_t GetScanRecordLength(std::vector<uint8_t> bytes) {
-  for (size_t i = 0, field_len = 0; i < kScanRecordLength;
-       i += (field_len + 1)) {
+size_t GetScanRecordLength(const std::vector<uint8_t>& bytes) {
+  size_t max_length = std::min(bytes.size(), kScanRecordLength);
+  for (size_t i = 0, field_len = 0; i < max_length; i += (field_len + 1)) {
     field_len = bytes[i];
 
     // Assert here that the data returned from the stack is correctly formatted
     // in TLV form and that the length of the current field won't exceed the
     // total data length.
-    CHECK(i + field_len < kScanRecordLength);
+    CHECK(i + field_len < max_length);
 
     // If the field length is zero and we haven't reached the maximum length,
     // then we have found the length, as the stack will pad the data with zeros
@@ -57,7 +59,7 @@ size_t GetScanRecordLength(std::vector<uint8_t> bytes) {
   }
 
   // We have reached the end.
-  return kScanRecordLength;
+  return max_length;
 }
 
 }  // namespace
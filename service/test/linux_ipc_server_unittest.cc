@@ -0,0 +1,488 @@
+//
+//  Copyright (C) 2015 Google, Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at:
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <base/macros.h>
+#include <gtest/gtest.h>
+
+#include "service/common/bluetooth/scan_result.h"
+#include "service/ipc/linux_ipc_client.h"
+#include "service/ipc/linux_ipc_server.h"
+
+namespace ipc {
+namespace {
+
+using bluetooth::ScanResult;
+using DropPolicy = LinuxIPCClient::DropPolicy;
+using MessageClass = LinuxIPCClient::MessageClass;
+
+const uint16_t kTestCompanyId = 0x00e0;
+const char kProbeAddress[] = "00:00:00:00:00:00";
+
+// Address of the |index|th synthetic advertiser.
+std::string TestAddress(int index) {
+  char address[18];
+  snprintf(address, sizeof(address), "00:11:22:33:%02X:%02X",
+           (index >> 8) & 0xff, index & 0xff);
+  return address;
+}
+
+// Flags, then manufacturer specific data of |company_id| if not zero.
+std::vector<uint8_t> TestRecord(uint16_t company_id) {
+  std::vector<uint8_t> record = {0x02, 0x01, 0x06};
+  if (company_id != 0) {
+    std::vector<uint8_t> data = {0x05, 0xff, (uint8_t)company_id,
+                                 (uint8_t)(company_id >> 8), 0x01, 0x02};
+    record.insert(record.end(), data.begin(), data.end());
+  }
+  return record;
+}
+
+// Returns the next message on |fd|, or an empty string after |timeout_ms|.
+std::string Receive(int fd, int timeout_ms = 5000) {
+  struct pollfd pfd = {fd, POLLIN, 0};
+  if (poll(&pfd, 1, timeout_ms) != 1) return std::string();
+  char buffer[1024];
+  ssize_t size = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+  return size > 0 ? std::string(buffer, size) : std::string();
+}
+
+// Returns the address of a "scan-result" message.
+std::string MessageAddress(const std::string& message) {
+  size_t start = message.find('|');
+  size_t end = message.find('|', start + 1);
+  if (start == std::string::npos || end == std::string::npos)
+    return std::string();
+  return message.substr(start + 1, end - start - 1);
+}
+
+class LinuxIPCClientTest : public ::testing::Test {
+ public:
+  LinuxIPCClientTest() = default;
+  ~LinuxIPCClientTest() override = default;
+
+  void SetUp() override {
+    int fds[2];
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK, 0, fds));
+    client_.reset(new LinuxIPCClient(fds[0], 4));
+    peer_fd_ = fds[1];
+  }
+
+  void TearDown() override {
+    client_.reset();
+    close(peer_fd_);
+  }
+
+ protected:
+  std::unique_ptr<LinuxIPCClient> client_;
+  int peer_fd_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(LinuxIPCClientTest);
+};
+
+TEST_F(LinuxIPCClientTest, FlushBatchesMessages) {
+  for (int i = 0; i < 4; i++)
+    client_->Send("result" + std::to_string(i), MessageClass::kScanResult);
+  client_->Send("reply", MessageClass::kControl);
+  EXPECT_EQ(5u, client_->pending());
+
+  EXPECT_TRUE(client_->Flush());
+  EXPECT_FALSE(client_->HasPending());
+  EXPECT_EQ(5u, client_->stats().sent);
+  EXPECT_EQ(1u, client_->stats().send_calls);
+
+  // Message boundaries are kept.
+  for (int i = 0; i < 4; i++)
+    EXPECT_EQ("result" + std::to_string(i), Receive(peer_fd_));
+  EXPECT_EQ("reply", Receive(peer_fd_));
+}
+
+TEST_F(LinuxIPCClientTest, DropOldest) {
+  client_->Send("reply", MessageClass::kControl);
+  for (int i = 0; i < 6; i++)
+    EXPECT_TRUE(client_->Send("result" + std::to_string(i),
+                              MessageClass::kScanResult));
+  EXPECT_EQ(2u, client_->stats().dropped);
+
+  EXPECT_TRUE(client_->Flush());
+  EXPECT_EQ("reply", Receive(peer_fd_));
+  for (int i = 2; i < 6; i++)
+    EXPECT_EQ("result" + std::to_string(i), Receive(peer_fd_));
+}
+
+TEST_F(LinuxIPCClientTest, DropNewest) {
+  client_->set_drop_policy(DropPolicy::kDropNewest);
+  for (int i = 0; i < 6; i++)
+    EXPECT_EQ(i < 4, client_->Send("result" + std::to_string(i),
+                                   MessageClass::kScanResult));
+  EXPECT_EQ(2u, client_->stats().dropped);
+
+  EXPECT_TRUE(client_->Flush());
+  for (int i = 0; i < 4; i++)
+    EXPECT_EQ("result" + std::to_string(i), Receive(peer_fd_));
+}
+
+TEST_F(LinuxIPCClientTest, Coalesce) {
+  client_->set_drop_policy(DropPolicy::kCoalesce);
+  client_->Send("a0", MessageClass::kScanResult, "a");
+  client_->Send("b0", MessageClass::kScanResult, "b");
+  client_->Send("a1", MessageClass::kScanResult, "a");
+  EXPECT_EQ(2u, client_->pending());
+  EXPECT_EQ(1u, client_->stats().coalesced);
+
+  EXPECT_TRUE(client_->Flush());
+  EXPECT_EQ("a1", Receive(peer_fd_));
+  EXPECT_EQ("b0", Receive(peer_fd_));
+
+  // Once sent, the next result of the device is queued again.
+  client_->Send("a2", MessageClass::kScanResult, "a");
+  EXPECT_EQ(1u, client_->pending());
+  EXPECT_TRUE(client_->Flush());
+  EXPECT_EQ("a2", Receive(peer_fd_));
+}
+
+TEST_F(LinuxIPCClientTest, ControlMessagesAreNeverDropped) {
+  // Fill the socket up, the client stops reading.
+  std::string result(512, 'r');
+  while (client_->stats().sent == client_->stats().queued) {
+    client_->Send(result, MessageClass::kScanResult);
+    EXPECT_TRUE(client_->Flush());
+  }
+
+  for (int i = 0; i < 100; i++) {
+    client_->Send("reply" + std::to_string(i), MessageClass::kControl);
+    client_->Send(result, MessageClass::kScanResult);
+  }
+  EXPECT_TRUE(client_->Flush());
+
+  // Drain the socket, then the ring.
+  std::vector<std::string> replies;
+  while (true) {
+    std::string message = Receive(peer_fd_, 100);
+    if (message.empty()) {
+      if (!client_->HasPending()) break;
+      EXPECT_TRUE(client_->Flush());
+      continue;
+    }
+    if (message != result) replies.push_back(message);
+  }
+  ASSERT_EQ(100u, replies.size());
+  for (int i = 0; i < 100; i++)
+    EXPECT_EQ("reply" + std::to_string(i), replies[i]);
+}
+
+TEST_F(LinuxIPCClientTest, DroppedSlotsAreReused) {
+  // Fill the socket up, then queue a reply the client does not read.
+  std::string result(512, 'r');
+  while (client_->stats().sent == client_->stats().queued) {
+    client_->Send(result, MessageClass::kScanResult);
+    EXPECT_TRUE(client_->Flush());
+  }
+  client_->Send("reply", MessageClass::kControl);
+
+  // The results queued behind the reply replace each other, rather than
+  // growing the ring: 4 results and at most 16 control messages.
+  for (int i = 0; i < 1000; i++) {
+    client_->Send("result" + std::to_string(i), MessageClass::kScanResult);
+    EXPECT_TRUE(client_->Flush());
+    EXPECT_LE(client_->pending(), 4u + 16u);
+  }
+
+  std::vector<std::string> messages;
+  while (true) {
+    std::string message = Receive(peer_fd_, 100);
+    if (message.empty()) {
+      if (!client_->HasPending()) break;
+      EXPECT_TRUE(client_->Flush());
+      continue;
+    }
+    if (message != result) messages.push_back(message);
+  }
+  ASSERT_EQ(5u, messages.size());
+  EXPECT_EQ("reply", messages[0]);
+  for (int i = 0; i < 4; i++)
+    EXPECT_EQ("result" + std::to_string(996 + i), messages[i + 1]);
+}
+
+TEST(LinuxIPCSubscriptionTest, Matches) {
+  ScanResult with_data(TestAddress(1), TestRecord(kTestCompanyId), -50);
+  ScanResult without_data(TestAddress(2), TestRecord(0), -80);
+
+  LinuxIPCSubscription subscription;
+  EXPECT_FALSE(subscription.Matches(with_data));
+
+  subscription.scan_results = true;
+  EXPECT_TRUE(subscription.Matches(with_data));
+  EXPECT_TRUE(subscription.Matches(without_data));
+
+  subscription.min_rssi = -60;
+  EXPECT_TRUE(subscription.Matches(with_data));
+  EXPECT_FALSE(subscription.Matches(without_data));
+
+  subscription.min_rssi = -128;
+  subscription.manufacturer_ids.insert(kTestCompanyId);
+  EXPECT_TRUE(subscription.Matches(with_data));
+  EXPECT_FALSE(subscription.Matches(without_data));
+
+  subscription.manufacturer_ids.clear();
+  subscription.addresses.insert(TestAddress(2));
+  EXPECT_FALSE(subscription.Matches(with_data));
+  EXPECT_TRUE(subscription.Matches(without_data));
+
+  // Truncated records do not match.
+  ScanResult truncated(TestAddress(3), {0x05, 0xff, 0xe0}, -50);
+  subscription.addresses.clear();
+  subscription.manufacturer_ids.insert(kTestCompanyId);
+  EXPECT_FALSE(subscription.Matches(truncated));
+}
+
+// Client of the server under test, which counts the scan results it reads.
+class TestClient {
+ public:
+  TestClient(const std::string& path, const std::string& subscribe)
+      : fd_(socket(AF_UNIX, SOCK_SEQPACKET, 0)),
+        probed_(false),
+        results_(0),
+        in_order_(true),
+        reading_(true) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    connected_ = connect(fd_, (struct sockaddr*)&address, sizeof(address)) == 0;
+    Send(subscribe);
+    Send("start-scan");
+  }
+
+  ~TestClient() {
+    reading_ = false;
+    if (reader_.joinable()) reader_.join();
+    close(fd_);
+  }
+
+  void Send(const std::string& message) {
+    EXPECT_EQ((ssize_t)message.size(),
+              send(fd_, message.data(), message.size(), MSG_NOSIGNAL));
+  }
+
+  // Reads until the server stops, or only until the first scan result when
+  // |slow|.
+  void StartReading(bool slow) {
+    reader_ = std::thread([this, slow]() {
+      while (reading_) {
+        std::string message = Receive(fd_, 100);
+        if (message.empty()) continue;
+        std::string address = MessageAddress(message);
+        if (address == kProbeAddress) {
+          probed_ = true;
+          if (slow) return;
+          continue;
+        }
+        if (!addresses_.empty() && address < addresses_.back())
+          in_order_ = false;
+        addresses_.push_back(address);
+        results_++;
+      }
+    });
+  }
+
+  // Reads what is left once the reader stopped.
+  void Drain() {
+    reading_ = false;
+    if (reader_.joinable()) reader_.join();
+    while (true) {
+      std::string message = Receive(fd_, 100);
+      if (message.empty()) break;
+      if (MessageAddress(message) == kProbeAddress) continue;
+      addresses_.push_back(MessageAddress(message));
+      results_++;
+    }
+  }
+
+  bool connected() const { return connected_; }
+  bool probed() const { return probed_; }
+  size_t results() const { return results_; }
+  bool in_order() const { return in_order_; }
+  const std::vector<std::string>& addresses() const { return addresses_; }
+
+ private:
+  int fd_;
+  bool connected_;
+  std::atomic_bool probed_;
+  std::atomic<size_t> results_;
+  std::atomic_bool in_order_;
+  std::atomic_bool reading_;
+  std::vector<std::string> addresses_;
+  std::thread reader_;
+
+  DISALLOW_COPY_AND_ASSIGN(TestClient);
+};
+
+class LinuxIPCServerTest : public ::testing::Test {
+ public:
+  LinuxIPCServerTest() = default;
+  ~LinuxIPCServerTest() override = default;
+
+  void SetUp() override {
+    path_ = "/tmp/linux_ipc_server_test_" + std::to_string(getpid());
+    unlink(path_.c_str());
+
+    listen_fd_ = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK, 0);
+    ASSERT_GE(listen_fd_, 0);
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path_.c_str(), sizeof(address.sun_path) - 1);
+    ASSERT_EQ(0, bind(listen_fd_, (struct sockaddr*)&address, sizeof(address)));
+    ASSERT_EQ(0, listen(listen_fd_, SOMAXCONN));
+
+    // Without an adapter, the scan results only come from the test.
+    server_.reset(new LinuxIPCServer(listen_fd_, nullptr));
+    ASSERT_TRUE(server_->Init());
+    loop_ = std::thread([this]() { EXPECT_TRUE(server_->Run()); });
+  }
+
+  void TearDown() override {
+    StopServer();
+    server_.reset();
+    close(listen_fd_);
+    unlink(path_.c_str());
+  }
+
+  void StopServer() {
+    server_->Stop();
+    if (loop_.joinable()) loop_.join();
+  }
+
+  // Injects probes until every client saw one, which means their commands
+  // were handled.
+  bool WaitForClients(const std::vector<TestClient*>& clients) {
+    ScanResult probe(kProbeAddress, TestRecord(kTestCompanyId), -10);
+    for (int i = 0; i < 500; i++) {
+      server_->OnScanResult(nullptr, probe);
+      usleep(10000);
+      bool probed = true;
+      for (TestClient* client : clients) probed &= client->probed();
+      if (probed) return true;
+    }
+    return false;
+  }
+
+ protected:
+  std::string path_;
+  int listen_fd_;
+  std::unique_ptr<LinuxIPCServer> server_;
+  std::thread loop_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(LinuxIPCServerTest);
+};
+
+TEST_F(LinuxIPCServerTest, StopWithClients) {
+  TestClient client(path_, "subscribe|scan||||drop-oldest");
+  ASSERT_TRUE(client.connected());
+  client.StartReading(false);
+  ASSERT_TRUE(WaitForClients({&client}));
+
+  // Run() returns even though the client is still connected.
+  StopServer();
+}
+
+TEST_F(LinuxIPCServerTest, ScanStorm) {
+  const int kAdvertisers = 500;
+  const int kBursts = 40;
+  const int kBurstSize = 200;
+  const int kTotal = kBursts * kBurstSize;
+
+  TestClient fast1(path_, "subscribe|scan||||drop-oldest");
+  TestClient fast2(path_, "subscribe|scan||||coalesce");
+  TestClient filtered(path_, "subscribe|scan|||00e0|drop-oldest");
+  TestClient slow(path_, "subscribe|scan||||drop-newest");
+  TestClient unsubscribed(path_, "subscribe|||||drop-oldest");
+  std::vector<TestClient*> clients = {&fast1, &fast2, &filtered, &slow};
+  for (TestClient* client : clients) {
+    ASSERT_TRUE(client->connected());
+    client->StartReading(client == &slow);
+  }
+  unsubscribed.StartReading(false);
+  ASSERT_TRUE(WaitForClients(clients));
+
+  // Every 10th advertiser carries the manufacturer data of the filter. Each
+  // burst comes from another thread, like the stack callbacks, and the
+  // readers catch up between bursts.
+  size_t expected_filtered = 0;
+  for (int burst = 0; burst < kBursts; burst++) {
+    std::thread stack([this, burst, kBurstSize]() {
+      for (int i = 0; i < kBurstSize; i++) {
+        int index = burst * kBurstSize + i;
+        int advertiser = index % kAdvertisers;
+        uint16_t company_id = advertiser % 10 == 0 ? kTestCompanyId : 0;
+        server_->OnScanResult(
+            nullptr, ScanResult(TestAddress(index), TestRecord(company_id),
+                                -40 - advertiser % 50));
+      }
+    });
+    stack.join();
+    for (int i = 0; i < kBurstSize; i++) {
+      if ((burst * kBurstSize + i) % kAdvertisers % 10 == 0)
+        expected_filtered++;
+    }
+
+    size_t expected = (burst + 1) * kBurstSize;
+    for (int i = 0; i < 500 && (fast1.results() < expected ||
+                                fast2.results() < expected ||
+                                filtered.results() < expected_filtered);
+         i++)
+      usleep(10000);
+  }
+
+  StopServer();
+  slow.Drain();
+
+  EXPECT_EQ((size_t)kTotal, fast1.results());
+  EXPECT_TRUE(fast1.in_order());
+  EXPECT_EQ((size_t)kTotal, fast2.results());
+  EXPECT_EQ(expected_filtered, filtered.results());
+  EXPECT_EQ(0u, unsubscribed.results());
+
+  // The client which stopped reading got the oldest results, and did not
+  // hold the other clients back.
+  EXPECT_LT(slow.results(), (size_t)kTotal);
+  ASSERT_GT(slow.results(), 0u);
+  EXPECT_EQ(TestAddress(0), slow.addresses()[0]);
+
+  // Results were handed to the loop and written to the clients in batches.
+  const LinuxIPCServer::Stats& stats = server_->stats();
+  EXPECT_EQ(0u, stats.scan_results_dropped);
+  EXPECT_LT(stats.batches, stats.scan_results / 4);
+  EXPECT_LT(stats.send_calls, stats.messages_sent / 4);
+}
+
+}  // namespace
+}  // namespace ipc
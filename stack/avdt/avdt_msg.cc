@@ -1525,7 +1525,7 @@ void avdt_msg_send_grej(tAVDT_CCB* p_ccb, uint8_t sig_id, tAVDT_MSG* p_params) {
   p_buf->event = sig_id;
   AVDT_BLD_LAYERSPEC(p_buf->layer_specific, AVDT_MSG_TYPE_GRJ,
                      p_params->hdr.label);
-  AVDT_TRACE_DEBUG(__func__);
+  AVDT_TRACE_DEBUG("%s", __func__);
 
   /* queue message and trigger ccb to send it */
   fixed_queue_enqueue(p_ccb->rsp_q, p_buf);
@@ -313,11 +313,35 @@ tBNEP_RESULT BNEP_Disconnect(uint16_t handle) {
   return (BNEP_SUCCESS);
 }
 
+/*******************************************************************************
+ *
+ * Function         BNEP_AllocBuf
+ *
+ * Description      This function allocates a buffer for BNEP_WriteBuf, with
+ *                  room for |len| octets of data, and the headroom for the
+ *                  BNEP and L2CAP headers in front of it.
+ *
+ * Returns          the buffer, its len set to |len|
+ *
+ ******************************************************************************/
+BT_HDR* BNEP_AllocBuf(uint16_t len) {
+  BT_HDR* p_buf =
+      (BT_HDR*)osi_malloc(sizeof(BT_HDR) + BNEP_MINIMUM_OFFSET + len);
+
+  p_buf->len = len;
+  p_buf->offset = BNEP_MINIMUM_OFFSET;
+  p_buf->layer_specific = 0;
+  return p_buf;
+}
+
 /*******************************************************************************
  *
  * Function         BNEP_WriteBuf
  *
- * Description      This function sends data in a GKI buffer on BNEP connection
+ * Description      This function sends data in a GKI buffer on BNEP connection.
+ *                  The headers are added in place when the buffer has at least
+ *                  BNEP_MINIMUM_OFFSET octets of headroom, as the ones from
+ *                  BNEP_AllocBuf do, without copying the data.
  *
  * Parameters:      handle       - handle of the connection to write
  *                  p_dest_addr  - BD_ADDR/Ethernet addr of the destination
@@ -395,6 +419,7 @@ tBNEP_RESULT BNEP_WriteBuf(uint16_t handle, const RawAddress& p_dest_addr,
         new_len += 4;
         if (new_len > org_len) {
           android_errorWriteLog(0x534e4554, "74947856");
+          osi_free(p_buf);
           return BNEP_IGNORE_CMD;
         }
         p_data[2] = 0;
@@ -413,6 +438,17 @@ tBNEP_RESULT BNEP_WriteBuf(uint16_t handle, const RawAddress& p_dest_addr,
     return (BNEP_Q_SIZE_EXCEEDED);
   }
 
+  /* The headers go in the headroom of the buffer. The payload of a buffer
+   * without enough of it, such as one received from a peer, is moved to a
+   * new buffer rather than shifted past the end of this one. */
+  if (p_buf->offset < BNEP_MINIMUM_OFFSET) {
+    BT_HDR* p_new_buf = BNEP_AllocBuf(p_buf->len);
+    memcpy((uint8_t*)(p_new_buf + 1) + p_new_buf->offset,
+           (uint8_t*)(p_buf + 1) + p_buf->offset, p_buf->len);
+    osi_free(p_buf);
+    p_buf = p_new_buf;
+  }
+
   /* Build the BNEP header */
   bnepu_build_bnep_hdr(p_bcb, p_buf, protocol, p_src_addr, &p_dest_addr,
                        fw_ext_present);
@@ -515,11 +551,8 @@ tBNEP_RESULT BNEP_Write(uint16_t handle, const RawAddress& p_dest_addr,
     return (BNEP_Q_SIZE_EXCEEDED);
 
   /* Get a buffer to copy the data into */
-  BT_HDR* p_buf = (BT_HDR*)osi_malloc(BNEP_BUF_SIZE);
-
-  p_buf->len = len;
-  p_buf->offset = BNEP_MINIMUM_OFFSET;
-  p = (uint8_t*)(p_buf + 1) + BNEP_MINIMUM_OFFSET;
+  BT_HDR* p_buf = BNEP_AllocBuf(len);
+  p = (uint8_t*)(p_buf + 1) + p_buf->offset;
 
   memcpy(p, p_data, len);
 
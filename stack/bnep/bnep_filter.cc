@@ -0,0 +1,96 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  This file contains the BNEP peer filters, see bnep_filter.h.
+ *
+ ******************************************************************************/
+
+#include "bnep_filter.h"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+namespace {
+
+uint64_t Key(uint16_t protocol) { return protocol; }
+
+/* An address as a 48 bit number, the first octet the most significant */
+uint64_t Key(const RawAddress& addr) {
+  uint64_t key = 0;
+  for (int i = 0; i < 6; i++) key = (key << 8) | addr.address[i];
+  return key;
+}
+
+template <typename T>
+uint16_t Compile(T* p_start, T* p_end, uint16_t num) {
+  std::vector<std::pair<T, T>> ranges;
+  for (uint16_t i = 0; i < num; i++) ranges.emplace_back(p_start[i], p_end[i]);
+  std::sort(ranges.begin(), ranges.end(),
+            [](const std::pair<T, T>& a, const std::pair<T, T>& b) {
+              return Key(a.first) < Key(b.first);
+            });
+
+  uint16_t merged = 0;
+  for (const std::pair<T, T>& range : ranges) {
+    if (merged > 0 && Key(range.first) <= Key(p_end[merged - 1]) + 1) {
+      if (Key(range.second) > Key(p_end[merged - 1]))
+        p_end[merged - 1] = range.second;
+      continue;
+    }
+    p_start[merged] = range.first;
+    p_end[merged] = range.second;
+    merged++;
+  }
+  return merged;
+}
+
+template <typename T>
+bool Match(const T* p_start, const T* p_end, uint16_t num, const T& value) {
+  /* the range after the last one starting at or before |value| */
+  const T* p = std::upper_bound(
+      p_start, p_start + num, value,
+      [](const T& v, const T& start) { return Key(v) < Key(start); });
+  if (p == p_start) return false;
+  return Key(value) <= Key(p_end[p - p_start - 1]);
+}
+
+}  // namespace
+
+uint16_t bnep_compile_prot_filters(uint16_t* p_start, uint16_t* p_end,
+                                   uint16_t num) {
+  return Compile(p_start, p_end, num);
+}
+
+uint16_t bnep_compile_mcast_filters(RawAddress* p_start, RawAddress* p_end,
+                                    uint16_t num) {
+  return Compile(p_start, p_end, num);
+}
+
+bool bnep_prot_filters_match(const uint16_t* p_start, const uint16_t* p_end,
+                             uint16_t num, uint16_t protocol) {
+  return Match(p_start, p_end, num, protocol);
+}
+
+bool bnep_mcast_filters_match(const RawAddress* p_start,
+                              const RawAddress* p_end, uint16_t num,
+                              const RawAddress& addr) {
+  return Match(p_start, p_end, num, addr);
+}
@@ -0,0 +1,51 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  The network protocol type and multicast address filters set by a BNEP
+ *  peer, applied to each frame sent to it. The ranges received are compiled
+ *  once, sorted and merged into disjoint ranges, so that a frame is checked
+ *  with a binary search.
+ *
+ ******************************************************************************/
+#ifndef BNEP_FILTER_H
+#define BNEP_FILTER_H
+
+#include <stdint.h>
+
+#include "types/raw_address.h"
+
+/* Sorts the |num| ranges [p_start[i], p_end[i]] and merges the ones which
+ * overlap or follow each other, in place. Returns the number of ranges
+ * left. */
+extern uint16_t bnep_compile_prot_filters(uint16_t* p_start, uint16_t* p_end,
+                                          uint16_t num);
+extern uint16_t bnep_compile_mcast_filters(RawAddress* p_start,
+                                           RawAddress* p_end, uint16_t num);
+
+/* Whether |protocol|, or |addr|, is in one of the |num| ranges compiled by
+ * the above. */
+extern bool bnep_prot_filters_match(const uint16_t* p_start,
+                                    const uint16_t* p_end, uint16_t num,
+                                    uint16_t protocol);
+extern bool bnep_mcast_filters_match(const RawAddress* p_start,
+                                     const RawAddress* p_end, uint16_t num,
+                                     const RawAddress& addr);
+
+#endif /* BNEP_FILTER_H */
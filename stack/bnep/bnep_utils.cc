@@ -26,6 +26,7 @@
 
 #include <stdio.h>
 #include <string.h>
+#include "bnep_filter.h"
 #include "bnep_int.h"
 #include "bt_common.h"
 #include "bt_types.h"
@@ -501,9 +502,7 @@ static uint8_t* bnepu_init_hdr(BT_HDR* p_buf, uint16_t hdr_len,
 
   /* See if we need to make space in the buffer */
   if (p_buf->offset < (hdr_len + L2CAP_MIN_OFFSET)) {
-    uint16_t xx, diff = BNEP_MINIMUM_OFFSET - p_buf->offset;
-    p = p + p_buf->len - 1;
-    for (xx = 0; xx < p_buf->len; xx++, p--) p[diff] = *p;
+    memmove(p + BNEP_MINIMUM_OFFSET - p_buf->offset, p, p_buf->len);
 
     p_buf->offset = BNEP_MINIMUM_OFFSET;
     p = (uint8_t*)(p_buf + 1) + p_buf->offset;
@@ -937,7 +936,6 @@ void bnepu_process_peer_filter_set(tBNEP_CONN* p_bcb, uint8_t* p_filters,
   if (bnep_cb.p_filter_ind_cb)
     (*bnep_cb.p_filter_ind_cb)(p_bcb->handle, true, 0, len, p_filters);
 
-  p_bcb->rcvd_num_filters = num_filters;
   for (xx = 0; xx < num_filters; xx++) {
     BE_STREAM_TO_UINT16(start, p_filters);
     BE_STREAM_TO_UINT16(end, p_filters);
@@ -945,6 +943,10 @@ void bnepu_process_peer_filter_set(tBNEP_CONN* p_bcb, uint8_t* p_filters,
     p_bcb->rcvd_prot_filter_start[xx] = start;
     p_bcb->rcvd_prot_filter_end[xx] = end;
   }
+  /* Sorted and merged, for bnep_is_packet_allowed */
+  p_bcb->rcvd_num_filters =
+      bnep_compile_prot_filters(p_bcb->rcvd_prot_filter_start,
+                                p_bcb->rcvd_prot_filter_end, num_filters);
 
   bnepu_send_peer_filter_rsp(p_bcb, resp_code);
 }
@@ -1107,6 +1109,12 @@ void bnepu_process_peer_multicast_filter_set(tBNEP_CONN* p_bcb,
     }
   }
 
+  /* Sorted and merged, for bnep_is_packet_allowed */
+  if (p_bcb->rcvd_mcast_filters != 0xFFFF)
+    p_bcb->rcvd_mcast_filters = bnep_compile_mcast_filters(
+        p_bcb->rcvd_mcast_filter_start, p_bcb->rcvd_mcast_filter_end,
+        num_filters);
+
   BNEP_TRACE_EVENT("BNEP multicast filters %d", p_bcb->rcvd_mcast_filters);
   bnepu_send_peer_multicast_filter_rsp(p_bcb, resp_code);
 
@@ -1249,11 +1257,12 @@ void bnep_sec_check_complete(UNUSED_ATTR const RawAddress* bd_addr,
  *
  * Function         bnep_is_packet_allowed
  *
- * Description      This function verifies whether the protocol passes through
- *                  the protocol filters set by the peer
+ * Description      This function verifies whether the protocol and the
+ *                  destination pass through the protocol and multicast
+ *                  address filters set by the peer
  *
- * Returns          BNEP_SUCCESS          - if the protocol is allowed
- *                  BNEP_IGNORE_CMD       - if the protocol is filtered out
+ * Returns          BNEP_SUCCESS          - if the packet is allowed
+ *                  BNEP_IGNORE_CMD       - if the packet is filtered out
  *
  ******************************************************************************/
 tBNEP_RESULT bnep_is_packet_allowed(tBNEP_CONN* p_bcb,
@@ -1261,7 +1270,7 @@ tBNEP_RESULT bnep_is_packet_allowed(tBNEP_CONN* p_bcb,
                                     uint16_t protocol, bool fw_ext_present,
                                     uint8_t* p_data, uint16_t org_len) {
   if (p_bcb->rcvd_num_filters) {
-    uint16_t i, proto;
+    uint16_t proto;
 
     /* Findout the actual protocol to check for the filtering */
     proto = protocol;
@@ -1290,46 +1299,28 @@ tBNEP_RESULT bnep_is_packet_allowed(tBNEP_CONN* p_bcb,
       BE_STREAM_TO_UINT16(proto, p_data);
     }
 
-    for (i = 0; i < p_bcb->rcvd_num_filters; i++) {
-      if ((p_bcb->rcvd_prot_filter_start[i] <= proto) &&
-          (proto <= p_bcb->rcvd_prot_filter_end[i]))
-        break;
-    }
-
-    if (i == p_bcb->rcvd_num_filters) {
+    if (!bnep_prot_filters_match(p_bcb->rcvd_prot_filter_start,
+                                 p_bcb->rcvd_prot_filter_end,
+                                 p_bcb->rcvd_num_filters, proto)) {
       BNEP_TRACE_DEBUG("Ignoring protocol 0x%x in BNEP data write", proto);
       return BNEP_IGNORE_CMD;
     }
   }
-#if 0
-  /* Ckeck for multicast address filtering */
-  if ((p_dest_addr.address[0] & 0x01) && p_bcb->rcvd_mcast_filters) {
-    uint16_t i;
-
-    /* Check if every multicast should be filtered */
-    if (p_bcb->rcvd_mcast_filters != 0xFFFF) {
-      /* Check if the address is mentioned in the filter range */
-      for (i = 0; i < p_bcb->rcvd_mcast_filters; i++) {
-        if ((memcmp(p_bcb->rcvd_mcast_filter_start[i],
-                    p_dest_addr, BD_ADDR_LEN) <= 0) &&
-            (memcmp(p_bcb->rcvd_mcast_filter_end[i],
-                    p_dest_addr, BD_ADDR_LEN) >= 0))
-          break;
-      }
-    }
 
-    /*
-    ** If every multicast should be filtered or the address is not in the filter
-    *range
-    ** drop the packet
-    */
-    if ((p_bcb->rcvd_mcast_filters == 0xFFFF) ||
-        (i == p_bcb->rcvd_mcast_filters)) {
+  /* Check for multicast address filtering. As other stacks do, broadcast
+   * is always let through: ARP and DHCP do not work without it. */
+  if ((p_dest_addr.address[0] & 0x01) && p_bcb->rcvd_mcast_filters &&
+      p_dest_addr != RawAddress::kAny) {
+    /* Check if every multicast should be filtered, or if the address is not
+     * mentioned in the filter ranges */
+    if (p_bcb->rcvd_mcast_filters == 0xFFFF ||
+        !bnep_mcast_filters_match(p_bcb->rcvd_mcast_filter_start,
+                                  p_bcb->rcvd_mcast_filter_end,
+                                  p_bcb->rcvd_mcast_filters, p_dest_addr)) {
       VLOG(1) << "Ignoring multicast address " << p_dest_addr
               << " in BNEP data write";
       return BNEP_IGNORE_CMD;
     }
   }
-#endif
   return BNEP_SUCCESS;
 }
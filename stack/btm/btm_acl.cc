@@ -86,6 +86,9 @@ void btm_acl_init(void) {
   /* Initialize nonzero defaults */
   btm_cb.btm_def_link_super_tout = HCI_DEFAULT_INACT_TOUT;
   btm_cb.acl_disc_reason = 0xff;
+
+  /* The ACL database was just cleared */
+  btm_acl_index_init();
 }
 
 /*******************************************************************************
@@ -132,43 +135,16 @@ uint8_t btm_get_bredr_acl_count(void) {
  *
  ******************************************************************************/
 tACL_CONN* btm_bda_to_acl(const RawAddress& bda, tBT_TRANSPORT transport) {
-  tACL_CONN* p = &btm_cb.acl_db[0];
-  uint16_t xx;
-  for (xx = 0; xx < MAX_L2CAP_LINKS; xx++, p++) {
-    if ((p->in_use) && p->remote_addr == bda && p->transport == transport) {
-      BTM_TRACE_DEBUG("btm_bda_to_acl found");
-      return (p);
-    }
+  uint8_t xx = btm_bda_to_acl_index(bda, transport);
+  if (xx < MAX_L2CAP_LINKS) {
+    BTM_TRACE_DEBUG("btm_bda_to_acl found");
+    return &btm_cb.acl_db[xx];
   }
 
   /* If here, no BD Addr found */
   return ((tACL_CONN*)NULL);
 }
 
-/*******************************************************************************
- *
- * Function         btm_handle_to_acl_index
- *
- * Description      This function returns the FIRST acl_db entry for the passed
- *                  hci_handle.
- *
- * Returns          index to the acl_db or MAX_L2CAP_LINKS.
- *
- ******************************************************************************/
-uint8_t btm_handle_to_acl_index(uint16_t hci_handle) {
-  tACL_CONN* p = &btm_cb.acl_db[0];
-  uint8_t xx;
-  BTM_TRACE_DEBUG("btm_handle_to_acl_index");
-  for (xx = 0; xx < MAX_L2CAP_LINKS; xx++, p++) {
-    if ((p->in_use) && (p->hci_handle == hci_handle)) {
-      break;
-    }
-  }
-
-  /* If here, no BD Addr found */
-  return (xx);
-}
-
 #if (BLE_PRIVACY_SPT == TRUE)
 /*******************************************************************************
  *
@@ -240,9 +216,10 @@ void btm_acl_created(const RawAddress& bda, DEV_CLASS dc, BD_NAME bdn,
   BTM_TRACE_WARNING("btm_acl_created hci_handle=%d link_role=%d  transport=%d",
                   hci_handle, link_role, transport);
   /* Ensure we don't have duplicates */
-  p = btm_bda_to_acl(bda, transport);
-  if (p != (tACL_CONN*)NULL) {
-    p->hci_handle = hci_handle;
+  xx = btm_bda_to_acl_index(bda, transport);
+  if (xx < MAX_L2CAP_LINKS) {
+    p = &btm_cb.acl_db[xx];
+    btm_acl_index_set_handle(xx, hci_handle);
     p->link_role = link_role;
     p->transport = transport;
     VLOG(1) << "Duplicate btm_acl_created: RemBdAddr: " << bda;
@@ -261,6 +238,7 @@ void btm_acl_created(const RawAddress& bda, DEV_CLASS dc, BD_NAME bdn,
       p->remote_addr = bda;
 
       p->transport = transport;
+      btm_acl_index_add(xx);
 #if (BLE_PRIVACY_SPT == TRUE)
       if (transport == BT_TRANSPORT_LE)
         btm_ble_refresh_local_resolvable_private_addr(
@@ -405,8 +383,10 @@ void btm_acl_removed(const RawAddress& bda, tBT_TRANSPORT transport) {
   tACL_CONN* p;
   tBTM_SEC_DEV_REC* p_dev_rec = NULL;
   BTM_TRACE_DEBUG("btm_acl_removed");
-  p = btm_bda_to_acl(bda, transport);
-  if (p != (tACL_CONN*)NULL) {
+  uint8_t xx = btm_bda_to_acl_index(bda, transport);
+  if (xx < MAX_L2CAP_LINKS) {
+    p = &btm_cb.acl_db[xx];
+    btm_acl_index_remove(xx);
     p->in_use = false;
 
     /* if the disconnected channel has a pending role switch, clear it now */
@@ -579,7 +559,7 @@ tBTM_STATUS BTM_GetRole(const RawAddress& remote_bd_addr, uint8_t* p_role) {
   /* Get the current role */
   *p_role = p->link_role;
   BTM_TRACE_WARNING ("BTM: Local device role : 0x%02x", *p_role );
-  BTM_TRACE_WARNING ("BTM: RemBdAddr: %s", remote_bd_addr.ToString().c_str());
+  BTM_TRACE_WARNING ("BTM: RemBdAddr: %s", remote_bd_addr);
   return (BTM_SUCCESS);
 }
 
@@ -595,7 +575,7 @@ tBTM_STATUS BTM_GetRole(const RawAddress& remote_bd_addr, uint8_t* p_role) {
  *
  ******************************************************************************/
 bool IsHighQualityCodecSelected(const RawAddress& remote_bd_addr) {
-  BTM_TRACE_DEBUG("%s: RemBdAddr: %s", __func__, remote_bd_addr.ToString().c_str());
+  BTM_TRACE_DEBUG("%s: RemBdAddr: %s", __func__, remote_bd_addr);
 
   if (btif_av_is_device_connected(remote_bd_addr)) {
     A2dpCodecConfig* current_codec = bta_av_get_a2dp_current_codec();
@@ -1500,7 +1480,7 @@ bool BTM_IsAclConnectionUp(const RawAddress& remote_bda,
                            tBT_TRANSPORT transport) {
   tACL_CONN* p;
 
-  BTM_TRACE_DEBUG("%s: RemBdAddr: %s", __func__, remote_bda.ToString().c_str());
+  BTM_TRACE_DEBUG("%s: RemBdAddr: %s", __func__, remote_bda);
   p = btm_bda_to_acl(remote_bda, transport);
   if (p != (tACL_CONN*)NULL) {
     return (true);
@@ -2940,7 +2920,7 @@ void btm_acl_resubmit_page(const RawAddress& target_bda, bool skip_connect_page)
 
     if (skip_connect_page && bda == target_bda &&
         HCI_GET_CMD_HDR_OPCODE(p_buf) == HCI_CREATE_CONNECTION) {
-      BTM_TRACE_WARNING("%s: remove bda= %s", __func__, bda.ToString().c_str());
+      BTM_TRACE_WARNING("%s: remove bda= %s", __func__, bda);
       osi_free(p_buf);
       p_buf = NULL;
       continue;
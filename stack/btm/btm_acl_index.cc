@@ -0,0 +1,240 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/*****************************************************************************
+ *
+ *  This file contains the indexes of the ACL connection table, which map an
+ *  HCI handle or a remote address to the acl_db entry of the link. They are
+ *  maintained by btm_acl_created() and btm_acl_removed(), the only places
+ *  where links are added to or removed from the table.
+ *
+ *****************************************************************************/
+
+#include <string.h>
+
+#include <base/logging.h>
+
+#include "bt_target.h"
+#include "bt_types.h"
+#include "btm_int.h"
+#include "hcimsgs.h"
+
+namespace {
+
+/* acl_db index + 1 of the FIRST link using each handle, zero if none. Handles
+ * above HCI_DATA_HANDLE_MASK are not valid, and are looked up by scanning */
+uint8_t acl_index_by_handle[HCI_DATA_HANDLE_MASK + 1];
+
+/* The address and the transport of each link, packed together, are kept in
+ * an open addressed table with linear probing, at most a quarter full */
+constexpr size_t kBdaSlotBits = (MAX_L2CAP_LINKS <= 16) ? 6 : 10;
+constexpr size_t kBdaSlots = 1 << kBdaSlotBits;
+static_assert(kBdaSlots >= 4 * MAX_L2CAP_LINKS, "ACL address index too small");
+
+typedef struct {
+  uint64_t key;
+  uint8_t index; /* acl_db index + 1, zero if the slot is free */
+} tACL_BDA_SLOT;
+
+tACL_BDA_SLOT acl_index_by_bda[kBdaSlots];
+
+uint64_t acl_bda_key(const RawAddress& bda, tBT_TRANSPORT transport) {
+  uint32_t lo;
+  uint16_t hi;
+  memcpy(&lo, bda.address, sizeof(lo));
+  memcpy(&hi, bda.address + sizeof(lo), sizeof(hi));
+  return lo | ((uint64_t)hi << 32) | ((uint64_t)transport << 48);
+}
+
+size_t acl_bda_slot(uint64_t key) {
+  return (key * 0x9e3779b97f4a7c15ull) >> (64 - kBdaSlotBits);
+}
+
+/* Slot holding |key|, or the free slot ending its probe sequence */
+size_t acl_bda_find(uint64_t key) {
+  size_t slot = acl_bda_slot(key);
+  while (acl_index_by_bda[slot].index != 0 &&
+         acl_index_by_bda[slot].key != key)
+    slot = (slot + 1) & (kBdaSlots - 1);
+  return slot;
+}
+
+void acl_bda_erase(size_t slot) {
+  /* Move back the following entries of the cluster which could no longer
+   * be reached from their home slot */
+  size_t next = slot;
+  while (true) {
+    next = (next + 1) & (kBdaSlots - 1);
+    if (acl_index_by_bda[next].index == 0) break;
+    size_t home = acl_bda_slot(acl_index_by_bda[next].key);
+    size_t distance = (next - home) & (kBdaSlots - 1);
+    if (distance >= ((next - slot) & (kBdaSlots - 1))) {
+      acl_index_by_bda[slot] = acl_index_by_bda[next];
+      slot = next;
+    }
+  }
+  acl_index_by_bda[slot].index = 0;
+}
+
+uint8_t btm_bda_to_acl_index_scan(const RawAddress& bda,
+                                  tBT_TRANSPORT transport) {
+  tACL_CONN* p = &btm_cb.acl_db[0];
+  uint8_t xx;
+  for (xx = 0; xx < MAX_L2CAP_LINKS; xx++, p++) {
+    if ((p->in_use) && p->remote_addr == bda && p->transport == transport)
+      break;
+  }
+  return xx;
+}
+
+/* FIRST link in use with |hci_handle|, other than |skip| */
+uint8_t btm_handle_to_acl_index_scan(uint16_t hci_handle,
+                                     uint8_t skip = MAX_L2CAP_LINKS) {
+  tACL_CONN* p = &btm_cb.acl_db[0];
+  uint8_t xx;
+  for (xx = 0; xx < MAX_L2CAP_LINKS; xx++, p++) {
+    if ((p->in_use) && (p->hci_handle == hci_handle) && xx != skip) break;
+  }
+  return xx;
+}
+
+void btm_acl_index_add_handle(uint8_t xx) {
+  uint16_t hci_handle = btm_cb.acl_db[xx].hci_handle;
+  if (hci_handle > HCI_DATA_HANDLE_MASK) return;
+
+  uint8_t first = acl_index_by_handle[hci_handle];
+  if (first == 0 || first > xx + 1) acl_index_by_handle[hci_handle] = xx + 1;
+}
+
+void btm_acl_index_remove_handle(uint8_t xx) {
+  uint16_t hci_handle = btm_cb.acl_db[xx].hci_handle;
+  if (hci_handle > HCI_DATA_HANDLE_MASK) return;
+  if (acl_index_by_handle[hci_handle] != xx + 1) return;
+
+  /* Another link may be using the same handle */
+  uint8_t next = btm_handle_to_acl_index_scan(hci_handle, xx);
+  acl_index_by_handle[hci_handle] = (next < MAX_L2CAP_LINKS) ? next + 1 : 0;
+}
+
+}  // namespace
+
+/*******************************************************************************
+ *
+ * Function         btm_acl_index_init
+ *
+ * Description      This function clears the indexes, along with the acl_db.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+void btm_acl_index_init(void) {
+  memset(acl_index_by_handle, 0, sizeof(acl_index_by_handle));
+  memset(acl_index_by_bda, 0, sizeof(acl_index_by_bda));
+}
+
+/*******************************************************************************
+ *
+ * Function         btm_acl_index_add
+ *
+ * Description      This function adds the acl_db entry |xx| to the indexes,
+ *                  once its address, transport and handle are set.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+void btm_acl_index_add(uint8_t xx) {
+  tACL_CONN* p = &btm_cb.acl_db[xx];
+  uint64_t key = acl_bda_key(p->remote_addr, p->transport);
+  size_t slot = acl_bda_find(key);
+  acl_index_by_bda[slot].key = key;
+  acl_index_by_bda[slot].index = xx + 1;
+  btm_acl_index_add_handle(xx);
+}
+
+/*******************************************************************************
+ *
+ * Function         btm_acl_index_remove
+ *
+ * Description      This function removes the acl_db entry |xx| from the
+ *                  indexes, before it is released.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+void btm_acl_index_remove(uint8_t xx) {
+  tACL_CONN* p = &btm_cb.acl_db[xx];
+  size_t slot = acl_bda_find(acl_bda_key(p->remote_addr, p->transport));
+  if (acl_index_by_bda[slot].index == xx + 1) acl_bda_erase(slot);
+  btm_acl_index_remove_handle(xx);
+}
+
+/*******************************************************************************
+ *
+ * Function         btm_acl_index_set_handle
+ *
+ * Description      This function changes the handle of the acl_db entry |xx|.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+void btm_acl_index_set_handle(uint8_t xx, uint16_t hci_handle) {
+  btm_acl_index_remove_handle(xx);
+  btm_cb.acl_db[xx].hci_handle = hci_handle;
+  btm_acl_index_add_handle(xx);
+}
+
+/*******************************************************************************
+ *
+ * Function        btm_bda_to_acl_index
+ *
+ * Description     This function returns the index of the acl_db entry for the
+ *                 passed BDA.
+ *
+ * Parameters      bda : BD address of the remote device
+ *                 transport : Physical transport used for ACL connection
+ *                 (BR/EDR or LE)
+ *
+ * Returns         index to the acl_db or MAX_L2CAP_LINKS.
+ *
+ ******************************************************************************/
+uint8_t btm_bda_to_acl_index(const RawAddress& bda, tBT_TRANSPORT transport) {
+  uint8_t xx = acl_index_by_bda[acl_bda_find(acl_bda_key(bda, transport))].index;
+  xx = xx ? xx - 1 : MAX_L2CAP_LINKS;
+  DCHECK_EQ(btm_bda_to_acl_index_scan(bda, transport), xx);
+  return xx;
+}
+
+/*******************************************************************************
+ *
+ * Function         btm_handle_to_acl_index
+ *
+ * Description      This function returns the FIRST acl_db entry for the passed
+ *                  hci_handle.
+ *
+ * Returns          index to the acl_db or MAX_L2CAP_LINKS.
+ *
+ ******************************************************************************/
+uint8_t btm_handle_to_acl_index(uint16_t hci_handle) {
+  if (hci_handle > HCI_DATA_HANDLE_MASK)
+    return btm_handle_to_acl_index_scan(hci_handle);
+
+  uint8_t xx = acl_index_by_handle[hci_handle];
+  xx = xx ? xx - 1 : MAX_L2CAP_LINKS;
+  DCHECK_EQ(btm_handle_to_acl_index_scan(hci_handle), xx);
+  return xx;
+}
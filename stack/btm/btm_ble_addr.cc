@@ -77,8 +77,9 @@ void btm_gen_resolve_paddr_low(const RawAddress& address) {
 #if (BTM_BLE_CONFORMANCE_TESTING == TRUE)
     interval_ms = btm_cb.ble_ctr_cb.rpa_tout * 1000;
 #endif
-    alarm_set_on_mloop(p_cb->refresh_raddr_timer, interval_ms,
-                     btm_ble_refresh_raddr_timer_timeout, NULL);
+    alarm_set_on_mloop_with_slack(p_cb->refresh_raddr_timer, interval_ms,
+                                  BTM_BLE_PRIVATE_ADDR_SLACK_MS,
+                                  btm_ble_refresh_raddr_timer_timeout, NULL);
   }
   else {
     p_cb->own_addr_type = BLE_ADDR_RANDOM_ID;
@@ -23,11 +23,13 @@
 #include "bt_types.h"
 #include "bt_utils.h"
 #include "btm_ble_api.h"
+#include "btm_ble_soft_filter.h"
 #include "btm_int.h"
 #include "btu.h"
 #include "device/include/controller.h"
 #include "hcidefs.h"
 #include "hcimsgs.h"
+#include "osi/include/properties.h"
 
 #include <string.h>
 #include <algorithm>
@@ -58,6 +60,11 @@ using bluetooth::Uuid;
 tBTM_BLE_ADV_FILTER_CB btm_ble_adv_filt_cb;
 tBTM_BLE_VSC_CB cmn_ble_vsc_cb;
 
+/* Filters the advertising reports on the host when the controller has no
+ * APCF, see btm_ble_soft_filter.h */
+#define BTM_BLE_SOFT_FILTER_PROPERTY "persist.bluetooth.soft_apcf"
+static BleSoftFilter* soft_filter = NULL;
+
 static uint8_t btm_ble_cs_update_pf_counter(tBTM_BLE_SCAN_COND_OP action,
                                             uint8_t cond_type,
                                             tBLE_BD_ADDR* p_bd_addr,
@@ -82,6 +89,34 @@ bool is_filtering_supported() {
   return cmn_ble_vsc_cb.filter_support != 0 && cmn_ble_vsc_cb.max_filter != 0;
 }
 
+/*******************************************************************************
+ *
+ * Function         btm_ble_soft_filtering
+ *
+ * Description      Tells whether the advertising reports are filtered on the
+ *                  host rather than by the controller.
+ *
+ * Returns          true if the host filters are in use
+ *
+ ******************************************************************************/
+bool btm_ble_soft_filtering(void) { return soft_filter != NULL; }
+
+/*******************************************************************************
+ *
+ * Function         btm_ble_soft_filter_match
+ *
+ * Description      Checks an advertising report against the host filters, as
+ *                  the controller would before reporting it.
+ *
+ * Returns          true if the report is to be delivered
+ *
+ ******************************************************************************/
+bool btm_ble_soft_filter_match(const RawAddress& bda, int8_t rssi,
+                               std::vector<uint8_t> const& adv_data) {
+  if (soft_filter == NULL) return true;
+  return soft_filter->Matches(bda, rssi, adv_data.data(), adv_data.size());
+}
+
 /*******************************************************************************
  *
  * Function         btm_ble_condtype_to_ocf
@@ -648,6 +683,12 @@ void BTM_LE_PF_tds_data(tBTM_BLE_SCAN_COND_OP action,
 void BTM_LE_PF_set(tBTM_BLE_PF_FILT_INDEX filt_index,
                    std::vector<ApcfCommand> commands,
                    tBTM_BLE_PF_CFG_CBACK cb) {
+  if (soft_filter != NULL) {
+    soft_filter->AddConditions(filt_index, commands);
+    cb.Run(0, 0, 0);
+    return;
+  }
+
   if (!is_filtering_supported()) {
     cb.Run(0, BTM_BLE_PF_ENABLE, 1 /* BTA_FAILURE */);
     return;
@@ -739,6 +780,12 @@ void BTM_LE_PF_set(tBTM_BLE_PF_FILT_INDEX filt_index,
  */
 void BTM_LE_PF_clear(tBTM_BLE_PF_FILT_INDEX filt_index,
                      tBTM_BLE_PF_CFG_CBACK cb) {
+  if (soft_filter != NULL) {
+    soft_filter->ClearConditions(filt_index);
+    cb.Run(0, BTM_BLE_PF_CONFIG, 0);
+    return;
+  }
+
   if (!is_filtering_supported()) {
     cb.Run(0, BTM_BLE_PF_ENABLE, 1 /* BTA_FAILURE */);
     return;
@@ -820,6 +867,12 @@ void BTM_BleAdvFilterParamSetup(
                 BTM_BLE_ADV_FILT_FEAT_SELN_LEN + BTM_BLE_ADV_FILT_TRACK_NUM;
   uint8_t param[len], *p;
 
+  if (soft_filter != NULL) {
+    bool ok = soft_filter->SetParams(action, filt_index, p_filt_params.get());
+    cb.Run(0, action, ok ? 0 : 1 /* BTA_FAILURE */);
+    return;
+  }
+
   if (!is_filtering_supported()) {
     cb.Run(0, BTM_BLE_PF_ENABLE, 1 /* BTA_FAILURE */);
     return;
@@ -938,6 +991,12 @@ void enable_cmpl_cback(tBTM_BLE_PF_STATUS_CBACK p_stat_cback, uint8_t* p,
  ******************************************************************************/
 void BTM_BleEnableDisableFilterFeature(uint8_t enable,
                                        tBTM_BLE_PF_STATUS_CBACK p_stat_cback) {
+  if (soft_filter != NULL) {
+    soft_filter->Enable(enable != 0);
+    if (p_stat_cback) p_stat_cback.Run(enable, 0);
+    return;
+  }
+
   if (!is_filtering_supported()) {
     if (p_stat_cback) p_stat_cback.Run(BTM_BLE_PF_ENABLE, 1 /* BTA_FAILURE */);
     return;
@@ -969,9 +1028,20 @@ void BTM_BleEnableDisableFilterFeature(uint8_t enable,
 void btm_ble_adv_filter_init(void) {
   memset(&btm_ble_adv_filt_cb, 0, sizeof(tBTM_BLE_ADV_FILTER_CB));
 
-  BTM_BleGetVendorCapabilities(&cmn_ble_vsc_cb);
+  /* The capabilities of the controller itself, not the ones reported by
+   * BTM_BleGetVendorCapabilities() once the host filters are in use */
+  cmn_ble_vsc_cb = btm_cb.cmn_ble_vsc_cb;
 
-  if (!is_filtering_supported()) return;
+  if (!is_filtering_supported()) {
+    char soft_apcf[PROPERTY_VALUE_MAX] = "false";
+    osi_property_get(BTM_BLE_SOFT_FILTER_PROPERTY, soft_apcf, "false");
+    if (!strcmp(soft_apcf, "true") && soft_filter == NULL) {
+      BTM_TRACE_DEBUG("%s: no controller APCF, filtering on the host",
+                      __func__);
+      soft_filter = new BleSoftFilter();
+    }
+    return;
+  }
 
   if (cmn_ble_vsc_cb.max_filter > 0) {
     btm_ble_adv_filt_cb.p_addr_filter_count = (tBTM_BLE_PF_COUNT*)osi_malloc(
@@ -992,4 +1062,6 @@ void btm_ble_adv_filter_init(void) {
  ******************************************************************************/
 void btm_ble_adv_filter_cleanup(void) {
   osi_free_and_reset((void**)&btm_ble_adv_filt_cb.p_addr_filter_count);
+  delete soft_filter;
+  soft_filter = NULL;
 }
@@ -19,16 +19,20 @@
 #include <stddef.h>
 #include <stdio.h>
 #include <string.h>
+#include <algorithm>
 #include <vector>
 #include "bt_target.h"
 
 #include "bt_types.h"
 #include "bt_utils.h"
 #include "btm_ble_api.h"
+#include "btm_ble_batchscan_store.h"
 #include "btm_int.h"
 #include "btu.h"
 #include "device/include/controller.h"
 #include "hcimsgs.h"
+#include "osi/include/properties.h"
+#include "osi/include/time.h"
 
 using base::Bind;
 using base::Callback;
@@ -44,6 +48,11 @@ tBTM_BLE_ADV_TRACK_CB ble_advtrack_cb;
 #define BTM_BLE_BATCH_SCAN_ENB_DISB_LEN 2
 #define BTM_BLE_BATCH_SCAN_READ_RESULTS_LEN 2
 
+/* Stores the batch scan results on the host when the controller cannot, see
+ * btm_ble_batchscan_store.h */
+#define BTM_BLE_SOFT_BATCH_SCAN_PROPERTY "persist.bluetooth.soft_batchscan"
+static BleBatchScanStore* soft_batch_store = NULL;
+
 namespace {
 
 bool can_do_batch_scan() {
@@ -359,6 +368,25 @@ void btm_ble_enable_batchscan(hci_cmd_cb cb) {
   btu_hcif_send_cmd_with_cb(FROM_HERE, HCI_BLE_BATCH_SCAN_OCF, param, len, cb);
 }
 
+/* Starts the scan of the host for the results stored on the host. The
+ * parameters the controller would take in 32 bits are out of the LE range
+ * above 16 bits, the defaults are used instead. */
+void soft_batchscan_start(tBTM_BLE_BATCH_SCAN_MODE scan_mode,
+                          uint32_t scan_interval, uint32_t scan_window) {
+  if (!BTM_BLE_ISVALID_PARAM(scan_interval, BTM_BLE_SCAN_INT_MIN,
+                             BTM_BLE_SCAN_INT_MAX))
+    scan_interval = BTM_BLE_GAP_DISC_SCAN_INT;
+  if (!BTM_BLE_ISVALID_PARAM(scan_window, BTM_BLE_SCAN_WIN_MIN,
+                             BTM_BLE_SCAN_WIN_MAX))
+    scan_window = BTM_BLE_GAP_DISC_SCAN_WIN;
+  scan_window = std::min(scan_window, scan_interval);
+
+  btm_ble_start_batch_scan(scan_mode == BTM_BLE_BATCH_SCAN_MODE_PASS
+                               ? BTM_BLE_SCAN_MODE_PASS
+                               : BTM_BLE_SCAN_MODE_ACTI,
+                           scan_interval, scan_window);
+}
+
 }  // namespace
 
 /*******************************************************************************
@@ -402,6 +430,15 @@ void BTM_BleSetStorageConfig(uint8_t batch_scan_full_max,
     return;
   }
 
+  if (soft_batch_store != NULL) {
+    soft_batch_store->SetStorageConfig(batch_scan_full_max,
+                                       batch_scan_trunc_max,
+                                       batch_scan_notify_threshold);
+    ble_batchscan_cb.cur_state = BTM_BLE_SCAN_ENABLED_STATE;
+    cb.Run(BTM_SUCCESS);
+    return;
+  }
+
   if (BTM_BLE_SCAN_INVALID_STATE == ble_batchscan_cb.cur_state ||
       BTM_BLE_SCAN_DISABLED_STATE == ble_batchscan_cb.cur_state ||
       BTM_BLE_SCAN_DISABLE_CALLED == ble_batchscan_cb.cur_state) {
@@ -450,6 +487,21 @@ void BTM_BleEnableBatchScan(tBTM_BLE_BATCH_SCAN_MODE scan_mode,
     return;
   }
 
+  ble_batchscan_cb.scan_mode = scan_mode;
+  ble_batchscan_cb.scan_interval = scan_interval;
+  ble_batchscan_cb.scan_window = scan_window;
+  ble_batchscan_cb.addr_type = addr_type;
+  ble_batchscan_cb.discard_rule = discard_rule;
+
+  /* The results come from a scan of the host, held while batching */
+  if (soft_batch_store != NULL) {
+    soft_batch_store->Enable(scan_mode, discard_rule);
+    soft_batchscan_start(scan_mode, scan_interval, scan_window);
+    ble_batchscan_cb.cur_state = BTM_BLE_SCAN_ENABLED_STATE;
+    cb.Run(BTM_SUCCESS);
+    return;
+  }
+
   if (BTM_BLE_SCAN_INVALID_STATE == ble_batchscan_cb.cur_state ||
       BTM_BLE_SCAN_DISABLED_STATE == ble_batchscan_cb.cur_state ||
       BTM_BLE_SCAN_DISABLE_CALLED == ble_batchscan_cb.cur_state) {
@@ -457,11 +509,6 @@ void BTM_BleEnableBatchScan(tBTM_BLE_BATCH_SCAN_MODE scan_mode,
     ble_batchscan_cb.cur_state = BTM_BLE_SCAN_ENABLE_CALLED;
   }
 
-  ble_batchscan_cb.scan_mode = scan_mode;
-  ble_batchscan_cb.scan_interval = scan_interval;
-  ble_batchscan_cb.scan_window = scan_window;
-  ble_batchscan_cb.addr_type = addr_type;
-  ble_batchscan_cb.discard_rule = discard_rule;
   /* This command starts batch scanning, if enabled */
   btm_ble_set_batchscan_param(scan_mode, scan_interval, scan_window, addr_type,
                               discard_rule, Bind(&param_enable_cb, cb));
@@ -476,6 +523,15 @@ void BTM_BleDisableBatchScan(base::Callback<void(uint8_t /* status */)> cb) {
     return;
   }
 
+  if (soft_batch_store != NULL) {
+    soft_batch_store->Enable(BTM_BLE_BATCH_SCAN_MODE_DISABLE,
+                             ble_batchscan_cb.discard_rule);
+    btm_ble_stop_batch_scan();
+    ble_batchscan_cb.cur_state = BTM_BLE_SCAN_DISABLED_STATE;
+    cb.Run(BTM_SUCCESS);
+    return;
+  }
+
   btm_ble_set_batchscan_param(
       BTM_BLE_BATCH_SCAN_MODE_DISABLE, ble_batchscan_cb.scan_interval,
       ble_batchscan_cb.scan_window, ble_batchscan_cb.addr_type,
@@ -511,6 +567,14 @@ void BTM_BleReadScanReports(tBTM_BLE_BATCH_SCAN_MODE scan_mode,
     return;
   }
 
+  if (soft_batch_store != NULL) {
+    std::vector<uint8_t> data;
+    uint8_t num_records = soft_batch_store->Read(
+        scan_mode, time_get_os_boottime_us() / 1000, &data);
+    cb.Run(BTM_SUCCESS, scan_mode, num_records, data);
+    return;
+  }
+
   btm_ble_read_batchscan_reports(
       scan_mode, base::Bind(&read_reports_cb, std::vector<uint8_t>(), 0, cb));
   return;
@@ -545,7 +609,57 @@ void btm_ble_batchscan_init(void) {
   BTM_TRACE_EVENT(" btm_ble_batchscan_init");
   memset(&ble_batchscan_cb, 0, sizeof(tBTM_BLE_BATCH_SCAN_CB));
   memset(&ble_advtrack_cb, 0, sizeof(tBTM_BLE_ADV_TRACK_CB));
-  BTM_RegisterForVSEvents(btm_ble_batchscan_filter_track_adv_vse_cback, true);
+  /* The events only come from a controller storing the results */
+  BTM_RegisterForVSEvents(btm_ble_batchscan_filter_track_adv_vse_cback,
+                          btm_cb.cmn_ble_vsc_cb.tot_scan_results_strg != 0);
+
+  btm_ble_stop_batch_scan();
+  delete soft_batch_store;
+  soft_batch_store = NULL;
+  if (btm_cb.cmn_ble_vsc_cb.tot_scan_results_strg == 0) {
+    char soft_batchscan[PROPERTY_VALUE_MAX] = "false";
+    osi_property_get(BTM_BLE_SOFT_BATCH_SCAN_PROPERTY, soft_batchscan,
+                     "false");
+    if (!strcmp(soft_batchscan, "true")) {
+      BTM_TRACE_DEBUG("%s: no controller batch scan, storing on the host",
+                      __func__);
+      soft_batch_store = new BleBatchScanStore();
+    }
+  }
+}
+
+/*******************************************************************************
+ *
+ * Function         btm_ble_soft_batchscan
+ *
+ * Description      Tells whether the batch scan results are stored on the
+ *                  host rather than by the controller.
+ *
+ * Returns          true if the host storage is in use
+ *
+ ******************************************************************************/
+bool btm_ble_soft_batchscan(void) { return soft_batch_store != NULL; }
+
+/*******************************************************************************
+ *
+ * Function         btm_ble_batchscan_store_result
+ *
+ * Description      Stores an advertising report as a batch scan result, and
+ *                  tells the client to read the results once the storage
+ *                  reaches its threshold, as the controller would.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+void btm_ble_batchscan_store_result(uint8_t addr_type, const RawAddress& bda,
+                                    int8_t tx_power, int8_t rssi,
+                                    std::vector<uint8_t> const& adv_data) {
+  if (soft_batch_store == NULL) return;
+
+  if (soft_batch_store->Add(addr_type, bda, tx_power, rssi, adv_data.data(),
+                            adv_data.size(), time_get_os_boottime_us() / 1000) &&
+      ble_batchscan_cb.p_thres_cback != NULL)
+    ble_batchscan_cb.p_thres_cback(ble_batchscan_cb.ref_value);
 }
 
 /**
@@ -556,4 +670,6 @@ void btm_ble_batchscan_cleanup(void) {
 
   memset(&ble_batchscan_cb, 0, sizeof(tBTM_BLE_BATCH_SCAN_CB));
   memset(&ble_advtrack_cb, 0, sizeof(tBTM_BLE_ADV_TRACK_CB));
+  delete soft_batch_store;
+  soft_batch_store = NULL;
 }
@@ -0,0 +1,270 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  This file contains the host side storage of batch scan results, see
+ *  btm_ble_batchscan_store.h.
+ *
+ ******************************************************************************/
+
+#include "btm_ble_batchscan_store.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "btm_api_types.h"
+#include "btm_ble_api_types.h"
+
+namespace {
+
+/* Report formats, as read from the controller */
+constexpr uint8_t kFormatTruncated = BTM_BLE_BATCH_SCAN_MODE_PASS;
+constexpr uint8_t kFormatFull = BTM_BLE_BATCH_SCAN_MODE_ACTI;
+
+/* Resolution of the report timestamps */
+constexpr uint64_t kTimeUnitMs = 50;
+
+/* Offset of the timestamp in both report formats */
+constexpr size_t kTimestampOffset = 9;
+
+uint64_t address_key(uint8_t addr_type, const uint8_t* bda) {
+  uint64_t key = addr_type;
+  for (size_t i = 0; i < RawAddress::kLength; i++) key = (key << 8) | bda[i];
+  return key;
+}
+
+/* The address as sent by the controller, least significant byte first */
+void put_address(uint8_t* p, const uint8_t* bda) {
+  for (size_t i = 0; i < RawAddress::kLength; i++)
+    p[i] = bda[RawAddress::kLength - 1 - i];
+}
+
+/* How long ago a result was seen, in 50 ms units */
+void put_timestamp(uint8_t* p, uint32_t time, uint32_t now) {
+  uint32_t age = std::min(now - std::min(time, now), (uint32_t)0xffff);
+  p[0] = age & 0xff;
+  p[1] = age >> 8;
+}
+
+}  // namespace
+
+BleBatchScanStore::BleBatchScanStore(size_t storage_bytes)
+    : storage_bytes_(storage_bytes),
+      trunc_max_bytes_(storage_bytes / 2),
+      full_max_bytes_(storage_bytes / 2) {}
+
+void BleBatchScanStore::SetStorageConfig(uint8_t full_max, uint8_t trunc_max,
+                                         uint8_t notify_threshold) {
+  full_max_bytes_ = storage_bytes_ * std::min(full_max, (uint8_t)100) / 100;
+  trunc_max_bytes_ = storage_bytes_ * std::min(trunc_max, (uint8_t)100) / 100;
+  notify_threshold_ = std::min(notify_threshold, (uint8_t)100);
+}
+
+void BleBatchScanStore::Enable(uint8_t scan_mode, uint8_t discard_rule) {
+  scan_mode_ = scan_mode;
+  discard_rule_ = discard_rule;
+}
+
+bool BleBatchScanStore::Add(uint8_t addr_type, const RawAddress& bda,
+                            int8_t tx_power, int8_t rssi, const uint8_t* data,
+                            size_t len, uint64_t now_ms) {
+  if (scan_mode_ == BTM_BLE_BATCH_SCAN_MODE_DISABLE) return false;
+
+  uint32_t time = now_ms / kTimeUnitMs;
+  if (scan_mode_ & BTM_BLE_BATCH_SCAN_MODE_PASS)
+    AddTruncated(addr_type, bda, tx_power, rssi, time);
+  if (scan_mode_ & BTM_BLE_BATCH_SCAN_MODE_ACTI)
+    AddFull(addr_type, bda, tx_power, rssi, data, len, time);
+
+  if (notified_ || !NeedsRead(time)) return false;
+  notified_ = true;
+  return true;
+}
+
+void BleBatchScanStore::AddTruncated(uint8_t addr_type, const RawAddress& bda,
+                                     int8_t tx_power, int8_t rssi,
+                                     uint32_t time) {
+  uint64_t key = address_key(addr_type, bda.address);
+  auto it = trunc_index_.find(key);
+  if (it != trunc_index_.end()) {
+    TruncRecord& record = trunc_[it->second];
+    record.time = time;
+    record.tx_power = tx_power;
+    record.rssi = rssi;
+    return;
+  }
+
+  if (trunc_max_bytes_ < BTM_BLE_BATCH_SCAN_TRUNC_REC_LEN) return;
+  while ((trunc_.size() + 1) * BTM_BLE_BATCH_SCAN_TRUNC_REC_LEN >
+             trunc_max_bytes_ ||
+         trunc_.size() >= BTM_BLE_SOFT_BATCH_SCAN_MAX_RECORDS) {
+    /* The oldest record, or the oldest of the ones with the lowest RSSI */
+    size_t victim = 0;
+    for (size_t i = 1; i < trunc_.size(); i++) {
+      const TruncRecord& record = trunc_[i];
+      if (discard_rule_ == BTM_BLE_DISCARD_LOWER_RSSI_ITEMS &&
+          record.rssi != trunc_[victim].rssi) {
+        if (record.rssi < trunc_[victim].rssi) victim = i;
+      } else if (record.time < trunc_[victim].time) {
+        victim = i;
+      }
+    }
+    if (discard_rule_ == BTM_BLE_DISCARD_LOWER_RSSI_ITEMS &&
+        rssi < trunc_[victim].rssi)
+      return;
+    EraseTruncated(victim);
+  }
+
+  TruncRecord record;
+  record.time = time;
+  memcpy(record.bda, bda.address, sizeof(record.bda));
+  record.addr_type = addr_type;
+  record.tx_power = tx_power;
+  record.rssi = rssi;
+  trunc_index_[key] = trunc_.size();
+  trunc_.push_back(record);
+}
+
+void BleBatchScanStore::AddFull(uint8_t addr_type, const RawAddress& bda,
+                                int8_t tx_power, int8_t rssi,
+                                const uint8_t* data, size_t len,
+                                uint32_t time) {
+  /* The report format has room for the legacy advertising data only */
+  if (len > 0xff) return;
+  size_t record_len = BTM_BLE_BATCH_SCAN_FULL_HDR_LEN + len;
+  if (record_len > full_max_bytes_) return;
+
+  while (full_bytes_ + record_len > full_max_bytes_ ||
+         full_index_.size() >= BTM_BLE_SOFT_BATCH_SCAN_MAX_RECORDS) {
+    size_t victim = 0;
+    if (discard_rule_ == BTM_BLE_DISCARD_LOWER_RSSI_ITEMS) {
+      for (size_t i = 1; i < full_index_.size(); i++) {
+        if (full_index_[i].rssi < full_index_[victim].rssi) victim = i;
+      }
+      if (rssi < full_index_[victim].rssi) return;
+    }
+    EraseFull(victim);
+  }
+
+  /* Drop the space of the records erased, once it is as big as the storage */
+  if (full_.size() >= 2 * full_max_bytes_) {
+    std::vector<uint8_t> compacted;
+    compacted.reserve(full_max_bytes_);
+    for (FullRecord& record : full_index_) {
+      compacted.insert(compacted.end(), full_.begin() + record.offset,
+                       full_.begin() + record.offset + record.len);
+      record.offset = compacted.size() - record.len;
+    }
+    full_.swap(compacted);
+  }
+
+  FullRecord record;
+  record.time = time;
+  record.offset = full_.size();
+  record.len = record_len;
+  record.rssi = rssi;
+  full_index_.push_back(record);
+  full_bytes_ += record_len;
+
+  full_.resize(full_.size() + record_len);
+  uint8_t* p = &full_[record.offset];
+  put_address(p, bda.address);
+  p[6] = addr_type;
+  p[7] = tx_power;
+  p[8] = rssi;
+  p[9] = p[10] = 0; /* timestamp, when read */
+  p[11] = len;
+  if (len != 0) memcpy(p + 12, data, len);
+  p[12 + len] = 0; /* no separate scan response */
+}
+
+void BleBatchScanStore::EraseTruncated(size_t i) {
+  trunc_index_.erase(address_key(trunc_[i].addr_type, trunc_[i].bda));
+  if (i + 1 != trunc_.size()) {
+    trunc_[i] = trunc_.back();
+    trunc_index_[address_key(trunc_[i].addr_type, trunc_[i].bda)] = i;
+  }
+  trunc_.pop_back();
+}
+
+void BleBatchScanStore::EraseFull(size_t i) {
+  full_bytes_ -= full_index_[i].len;
+  full_index_.erase(full_index_.begin() + i);
+  if (full_index_.empty()) full_.clear();
+}
+
+/* Whether the client is to read the results stored so far */
+bool BleBatchScanStore::NeedsRead(uint32_t time) const {
+  size_t trunc_bytes = trunc_.size() * BTM_BLE_BATCH_SCAN_TRUNC_REC_LEN;
+  if (notify_threshold_ != 0) {
+    if (trunc_max_bytes_ != 0 &&
+        (trunc_bytes * 100 >= trunc_max_bytes_ * notify_threshold_ ||
+         trunc_.size() >= BTM_BLE_SOFT_BATCH_SCAN_MAX_RECORDS))
+      return true;
+    if (full_max_bytes_ != 0 &&
+        (full_bytes_ * 100 >= full_max_bytes_ * notify_threshold_ ||
+         full_index_.size() >= BTM_BLE_SOFT_BATCH_SCAN_MAX_RECORDS))
+      return true;
+  }
+
+  uint32_t oldest = time;
+  for (const TruncRecord& record : trunc_) oldest = std::min(oldest, record.time);
+  if (!full_index_.empty()) oldest = std::min(oldest, full_index_[0].time);
+  return (uint64_t)(time - oldest) * kTimeUnitMs >= timeout_ms_;
+}
+
+uint8_t BleBatchScanStore::Read(uint8_t scan_mode, uint64_t now_ms,
+                                std::vector<uint8_t>* p_data) {
+  uint32_t now = now_ms / kTimeUnitMs;
+  uint8_t num_records = 0;
+  p_data->clear();
+
+  if (scan_mode == kFormatTruncated) {
+    p_data->resize(trunc_.size() * BTM_BLE_BATCH_SCAN_TRUNC_REC_LEN);
+    uint8_t* p = p_data->data();
+    for (const TruncRecord& record : trunc_) {
+      put_address(p, record.bda);
+      p[6] = record.addr_type;
+      p[7] = record.tx_power;
+      p[8] = record.rssi;
+      put_timestamp(p + kTimestampOffset, record.time, now);
+      p += BTM_BLE_BATCH_SCAN_TRUNC_REC_LEN;
+    }
+    num_records = trunc_.size();
+    trunc_.clear();
+    trunc_index_.clear();
+  } else if (scan_mode == kFormatFull) {
+    p_data->reserve(full_bytes_);
+    for (const FullRecord& record : full_index_) {
+      size_t offset = p_data->size();
+      p_data->insert(p_data->end(), full_.begin() + record.offset,
+                     full_.begin() + record.offset + record.len);
+      put_timestamp(p_data->data() + offset + kTimestampOffset, record.time,
+                    now);
+    }
+    num_records = full_index_.size();
+    full_index_.clear();
+    full_.clear();
+    full_bytes_ = 0;
+  }
+
+  notified_ = false;
+  return num_records;
+}
@@ -0,0 +1,140 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  Host side storage of batch scan results, for controllers which cannot
+ *  batch them. It keeps the results as the controller would and hands them
+ *  out in the same report formats:
+ *
+ *  - truncated results (passive batch scan): one record per address, with
+ *    the latest RSSI and time seen;
+ *  - full results (active batch scan): a record per report, with its
+ *    advertising data;
+ *  - when the storage of a kind of results is full, the oldest record, or
+ *    the one with the lowest RSSI, is discarded;
+ *  - the client is told to read the results once the storage reaches the
+ *    notification threshold, or the oldest result gets too old.
+ *
+ ******************************************************************************/
+#ifndef BTM_BLE_BATCHSCAN_STORE_H
+#define BTM_BLE_BATCHSCAN_STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <unordered_map>
+#include <vector>
+
+#include "types/raw_address.h"
+
+/* Storage for the results, in bytes of the report formats */
+#ifndef BTM_BLE_SOFT_BATCH_SCAN_STORAGE
+#define BTM_BLE_SOFT_BATCH_SCAN_STORAGE 8192
+#endif
+
+/* Results of each kind, as many as a read can report */
+#define BTM_BLE_SOFT_BATCH_SCAN_MAX_RECORDS 255
+
+/* Size of a truncated result, and of a full result without its data */
+#define BTM_BLE_BATCH_SCAN_TRUNC_REC_LEN 11
+#define BTM_BLE_BATCH_SCAN_FULL_HDR_LEN 13
+
+/* Oldest result kept without telling the client: the timestamps of the
+ * reports, in 50 ms units, go up to 0xffff */
+#ifndef BTM_BLE_SOFT_BATCH_SCAN_TIMEOUT_MS
+#define BTM_BLE_SOFT_BATCH_SCAN_TIMEOUT_MS (30 * 60 * 1000)
+#endif
+
+class BleBatchScanStore {
+ public:
+  explicit BleBatchScanStore(
+      size_t storage_bytes = BTM_BLE_SOFT_BATCH_SCAN_STORAGE);
+
+  /* As BTM_BleSetStorageConfig(): the share of the storage, in %, for the
+   * full and truncated results, and the notification threshold in % of
+   * each share. A threshold of 0 disables the notifications. */
+  void SetStorageConfig(uint8_t full_max, uint8_t trunc_max,
+                        uint8_t notify_threshold);
+
+  /* As BTM_BleEnableBatchScan(): |scan_mode| is a BTM_BLE_BATCH_SCAN_MODE_*
+   * value and |discard_rule| a BTM_BLE_DISCARD_* one. The stored results are
+   * kept when disabling. */
+  void Enable(uint8_t scan_mode, uint8_t discard_rule);
+
+  void set_timeout_ms(uint64_t timeout_ms) { timeout_ms_ = timeout_ms; }
+
+  /* Stores an advertising report, received at |now_ms|. Returns true if the
+   * client is to be told to read the results, which happens once until they
+   * are read. */
+  bool Add(uint8_t addr_type, const RawAddress& bda, int8_t tx_power,
+           int8_t rssi, const uint8_t* data, size_t len, uint64_t now_ms);
+
+  /* As BTM_BleReadScanReports(): moves the results of |scan_mode|, in its
+   * report format, to |p_data|. Returns the number of results. */
+  uint8_t Read(uint8_t scan_mode, uint64_t now_ms, std::vector<uint8_t>* p_data);
+
+  bool enabled() const { return scan_mode_ != 0; }
+  size_t num_truncated() const { return trunc_.size(); }
+  size_t num_full() const { return full_index_.size(); }
+
+ private:
+  /* A truncated result */
+  struct TruncRecord {
+    uint32_t time; /* in 50 ms units */
+    uint8_t bda[RawAddress::kLength];
+    uint8_t addr_type;
+    int8_t tx_power;
+    int8_t rssi;
+  };
+
+  /* Where a full result is in |full_| */
+  struct FullRecord {
+    uint32_t time;
+    uint32_t offset;
+    uint16_t len;
+    int8_t rssi;
+  };
+
+  void AddTruncated(uint8_t addr_type, const RawAddress& bda, int8_t tx_power,
+                    int8_t rssi, uint32_t time);
+  void AddFull(uint8_t addr_type, const RawAddress& bda, int8_t tx_power,
+               int8_t rssi, const uint8_t* data, size_t len, uint32_t time);
+  void EraseTruncated(size_t i);
+  void EraseFull(size_t i);
+  bool NeedsRead(uint32_t time) const;
+
+  size_t storage_bytes_;
+  size_t trunc_max_bytes_;
+  size_t full_max_bytes_;
+  uint8_t notify_threshold_ = 0;
+  uint8_t scan_mode_ = 0;
+  uint8_t discard_rule_ = 0;
+  uint64_t timeout_ms_ = BTM_BLE_SOFT_BATCH_SCAN_TIMEOUT_MS;
+  bool notified_ = false;
+
+  std::vector<TruncRecord> trunc_;
+  std::unordered_map<uint64_t, uint8_t> trunc_index_; /* by address */
+
+  /* The full results, in the report format, back to back */
+  std::vector<uint8_t> full_;
+  std::vector<FullRecord> full_index_; /* oldest first */
+  size_t full_bytes_ = 0;
+};
+
+#endif /* BTM_BLE_BATCHSCAN_STORE_H */
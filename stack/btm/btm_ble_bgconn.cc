@@ -199,6 +199,28 @@ void btm_ble_bgconn_cancel_if_disconnected(const RawAddress& bd_addr) {
   }
 }
 
+/*******************************************************************************
+ *
+ * Function         btm_ble_bgconn_find
+ *
+ * Description      Looks a device up in the background connection list.
+ *
+ * Parameters       bd_addr: device address
+ *                  p_pending: set to whether a connection to it is pending
+ *
+ * Returns          true if the device is in the list
+ *
+ ******************************************************************************/
+bool btm_ble_bgconn_find(const RawAddress& bd_addr, bool* p_pending) {
+  auto map_it = background_connections.find(bd_addr);
+  if (map_it == background_connections.end() ||
+      map_it->second.pending_removal)
+    return false;
+
+  *p_pending = !BTM_IsAclConnectionUp(bd_addr, BT_TRANSPORT_LE);
+  return true;
+}
+
 bool BTM_BackgroundConnectAddressKnown(const RawAddress& address) {
   tBTM_SEC_DEV_REC* p_dev_rec = btm_find_dev(address);
   VLOG(2) << __func__ << ": address " << address;
@@ -514,6 +536,11 @@ bool BTM_WhiteListAdd(const RawAddress& address) {
     btm_ble_stop_auto_conn();
   }
   btm_add_dev_to_controller(true, address);
+#if (BLE_PRIVACY_SPT == TRUE)
+  /* The controller connects to devices using RPAs only if it can resolve
+   * them */
+  btm_ble_resolving_list_sync();
+#endif
   btm_ble_resume_bg_conn();
   return true;
 }
@@ -141,12 +141,22 @@ void btm_ble_conn_complete(uint8_t* p, UNUSED_ATTR uint16_t evt_len,
       match = btm_identity_addr_to_random_pseudo(&bda, &bda_type, true);
     }
 
+    /* resolved by the controller; the last connection time of the device
+     * keeps it in the resolving list */
+    if (match && peer_addr_type & BLE_ADDR_TYPE_ID_BIT) {
+      tBTM_SEC_DEV_REC* match_rec = btm_find_dev(bda);
+      if (match_rec) match_rec->timestamp = btm_cb.dev_rec_count++;
+      btm_ble_resolving_list_resolved(true);
+    }
+
     /* possiblly receive connection complete with resolvable random while
        the device has been paired */
     if (!match && addr_is_rpa) {
       tBTM_SEC_DEV_REC* match_rec = btm_ble_resolve_random_addr(bda);
       if (match_rec) {
         LOG(INFO) << __func__ << ": matched and resolved random address";
+        match_rec->timestamp = btm_cb.dev_rec_count++;
+        btm_ble_resolving_list_resolved(false);
         match = true;
         match_rec->ble.active_addr_type = BTM_BLE_ADDR_RRA;
         match_rec->ble.cur_rand_addr = bda;
@@ -46,7 +46,9 @@
 #include "osi/include/time.h"
 
 #include "advertise_data_parser.h"
+#include "btm_ble_batchscan_store.h"
 #include "btm_ble_int.h"
+#include "btm_ble_soft_filter.h"
 #include "gatt_int.h"
 #include "gattdefs.h"
 #include "l2c_int.h"
@@ -137,6 +139,24 @@ class AdvertisingCache {
  * on secondary channel */
 AdvertisingCache cache;
 
+/* Parameters of each user of the shared LE scan: an inquiry, an observe or
+ * the batch scan on the host. The scan runs with those of whoever started or
+ * restarted it, and goes back to those of a remaining user when it stops. */
+typedef struct {
+  uint8_t scan_phy;
+  uint8_t scan_type;
+  uint8_t scan_filter_policy;
+  std::vector<uint16_t> scan_interval;
+  std::vector<uint16_t> scan_window;
+} tBLE_SHARED_SCAN_PARAMS;
+
+tBLE_SHARED_SCAN_PARAMS inquiry_scan_params;
+tBLE_SHARED_SCAN_PARAMS observe_scan_params;
+tBLE_SHARED_SCAN_PARAMS batch_scan_params;
+
+/* Scan activity bits of whoever the LE scan runs with the parameters of */
+uint8_t scan_params_owner;
+
 }  // namespace
 
 #if (BLE_VND_INCLUDED == TRUE)
@@ -157,6 +177,7 @@ static uint8_t btm_set_conn_mode_adv_init_addr(tBTM_BLE_INQ_CB* p_cb,
                                                tBLE_ADDR_TYPE* p_peer_addr_type,
                                                tBLE_ADDR_TYPE* p_own_addr_type);
 static void btm_ble_stop_observe(void);
+static void btm_ble_restore_scan_params(void);
 static void btm_ble_fast_adv_timer_timeout(void* data);
 static void btm_ble_start_slow_adv(void);
 static void btm_ble_inquiry_timer_gap_limited_discovery_timeout(void* data);
@@ -442,12 +463,16 @@ tBTM_STATUS BTM_BleObserve(bool start, uint8_t duration,
     btm_cb.ble_ctr_cb.p_obs_cmpl_cb = p_cmpl_cb;
     status = BTM_CMD_STARTED;
 
+    observe_scan_params = {scan_phy,
+                           (p_inq->scan_type == BTM_BLE_SCAN_MODE_NONE)
+                               ? (uint8_t)BTM_BLE_SCAN_MODE_ACTI
+                               : p_inq->scan_type,
+                           BTM_BLE_DEFAULT_SFP, scan_interval, scan_window};
+
     /* scan is not started */
     if (!BTM_BLE_IS_SCAN_ACTIVE(btm_cb.ble_ctr_cb.scan_activity)) {
       /* allow config of scan type */
-      p_inq->scan_type = (p_inq->scan_type == BTM_BLE_SCAN_MODE_NONE)
-                             ? BTM_BLE_SCAN_MODE_ACTI
-                             : p_inq->scan_type;
+      p_inq->scan_type = observe_scan_params.scan_type;
 /* assume observe always not using white list */
 #if (defined BLE_PRIVACY_SPT && BLE_PRIVACY_SPT == TRUE)
       /* enable resolving list */
@@ -460,6 +485,7 @@ tBTM_STATUS BTM_BleObserve(bool start, uint8_t duration,
 
       p_inq->scan_duplicate_filter = BTM_BLE_DUPLICATE_DISABLE;
       status = btm_ble_start_scan();
+      scan_params_owner = BTM_LE_OBSERVE_ACTIVE;
     }
 
     if (status == BTM_CMD_STARTED) {
@@ -507,6 +533,9 @@ static void btm_ble_vendor_capability_vsc_cmpl_cback(
 
   if (status != HCI_SUCCESS) {
     BTM_TRACE_DEBUG("%s: Status = 0x%02x (0 is success)", __func__, status);
+    /* No controller filters or storage, the host ones may still be used */
+    btm_ble_adv_filter_init();
+    btm_ble_batchscan_init();
     return;
   }
   STREAM_TO_UINT8(btm_cb.cmn_ble_vsc_cb.adv_inst_max, p);
@@ -541,7 +570,8 @@ static void btm_ble_vendor_capability_vsc_cmpl_cback(
 
   btm_ble_adv_init();
 
-  if (btm_cb.cmn_ble_vsc_cb.max_filter > 0) btm_ble_adv_filter_init();
+  /* Also sets up the host filters when the controller has none */
+  btm_ble_adv_filter_init();
 
 #if (BLE_PRIVACY_SPT == TRUE)
   /* VS capability included and non-4.2 device */
@@ -550,7 +580,8 @@ static void btm_ble_vendor_capability_vsc_cmpl_cback(
     btm_ble_resolving_list_init(btm_cb.cmn_ble_vsc_cb.max_irk_list_sz);
 #endif /* (BLE_PRIVACY_SPT == TRUE) */
 
-  if (btm_cb.cmn_ble_vsc_cb.tot_scan_results_strg > 0) btm_ble_batchscan_init();
+  /* Also sets up the host storage when the controller has none */
+  btm_ble_batchscan_init();
 
   if (p_ctrl_le_feature_rd_cmpl_cback != NULL)
     p_ctrl_le_feature_rd_cmpl_cback(status);
@@ -561,7 +592,11 @@ static void btm_ble_vendor_capability_vsc_cmpl_cback(
  *
  * Function         BTM_BleGetVendorCapabilities
  *
- * Description      This function reads local LE features
+ * Description      This function reads local LE features. When the advertising
+ *                  reports are filtered on the host, filter_support and
+ *                  max_filter describe the host filters rather than the
+ *                  controller, so that the clients use the filter API as
+ *                  usual; btm_cb.cmn_ble_vsc_cb keeps the controller values.
  *
  * Parameters       p_cmn_vsc_cb : Locala LE capability structure
  *
@@ -573,6 +608,12 @@ extern void BTM_BleGetVendorCapabilities(tBTM_BLE_VSC_CB* p_cmn_vsc_cb) {
 
   if (NULL != p_cmn_vsc_cb) {
     *p_cmn_vsc_cb = btm_cb.cmn_ble_vsc_cb;
+    if (btm_ble_soft_filtering()) {
+      p_cmn_vsc_cb->filter_support = 1;
+      p_cmn_vsc_cb->max_filter = BTM_BLE_SOFT_FILTER_MAX;
+    }
+    if (btm_ble_soft_batchscan())
+      p_cmn_vsc_cb->tot_scan_results_strg = BTM_BLE_SOFT_BATCH_SCAN_STORAGE;
   }
 }
 
@@ -1385,6 +1426,9 @@ tBTM_STATUS btm_ble_start_inquiry(uint8_t mode, uint8_t duration) {
     scan_window[i] = BTM_BLE_LOW_LATENCY_SCAN_WIN;
   }
 
+  inquiry_scan_params = {scan_phy, BTM_BLE_SCAN_MODE_ACTI, SP_ADV_ALL,
+                         scan_interval, scan_window};
+
   if (!BTM_BLE_IS_SCAN_ACTIVE(p_ble_cb->scan_activity)) {
     btm_send_hci_set_scan_params(
         scan_phy, BTM_BLE_SCAN_MODE_ACTI, scan_interval,
@@ -1395,7 +1439,9 @@ tBTM_STATUS btm_ble_start_inquiry(uint8_t mode, uint8_t duration) {
 #endif
     p_ble_cb->inq_var.scan_duplicate_filter = BTM_BLE_DUPLICATE_DISABLE;
     status = btm_ble_start_scan();
-  } else if (!btm_ble_is_scan_params_low_latency()) {
+    scan_params_owner = mode;
+  } else if (scan_params_owner == BTM_LE_BATCH_SCAN_ACTIVE ||
+             !btm_ble_is_scan_params_low_latency()) {
     BTM_TRACE_DEBUG("%s, restart LE scan with low latency scan params",
                     __func__);
     btm_send_hci_scan_enable(BTM_BLE_SCAN_DISABLE, BTM_BLE_DUPLICATE_ENABLE);
@@ -1403,6 +1449,7 @@ tBTM_STATUS btm_ble_start_inquiry(uint8_t mode, uint8_t duration) {
         scan_phy, BTM_BLE_SCAN_MODE_ACTI, scan_interval,
         scan_window, btm_cb.ble_ctr_cb.addr_mgnt_cb.own_addr_type, SP_ADV_ALL);
     btm_send_hci_scan_enable(BTM_BLE_SCAN_ENABLE, BTM_BLE_DUPLICATE_DISABLE);
+    scan_params_owner = mode;
   }
 
   if (status == BTM_CMD_STARTED) {
@@ -1563,7 +1610,7 @@ static void btm_ble_update_adv_flag(uint8_t flag) {
  * condition
  */
 uint8_t btm_ble_is_discoverable(const RawAddress& bda,
-                                std::vector<uint8_t> const& adv_data) {
+                                const AdvertiseDataIndex& adv_data) {
   uint8_t flag = 0, rt = 0;
   uint8_t data_len;
   tBTM_INQ_PARMS* p_cond = &btm_cb.btm_inq_vars.inqparms;
@@ -1580,8 +1627,8 @@ uint8_t btm_ble_is_discoverable(const RawAddress& bda,
   }
 
   if (!adv_data.empty()) {
-    const uint8_t* p_flag = AdvertiseDataParser::GetFieldByType(
-        adv_data, BTM_BLE_AD_TYPE_FLAG, &data_len);
+    const uint8_t* p_flag =
+        adv_data.GetFieldByType(BTM_BLE_AD_TYPE_FLAG, &data_len);
     if (p_flag != NULL && data_len != 0) {
       flag = *p_flag;
 
@@ -1734,7 +1781,7 @@ void btm_ble_update_inq_result(tINQ_DB_ENT* p_i, uint8_t addr_type,
                                uint8_t primary_phy, uint8_t secondary_phy,
                                uint8_t advertising_sid, int8_t tx_power,
                                int8_t rssi, uint16_t periodic_adv_int,
-                               std::vector<uint8_t> const& data) {
+                               const AdvertiseDataIndex& data) {
   tBTM_INQ_RESULTS* p_cur = &p_i->inq_info.results;
   uint8_t len;
   tBTM_INQUIRY_VAR_ST* p_inq = &btm_cb.btm_inq_vars;
@@ -1766,8 +1813,7 @@ void btm_ble_update_inq_result(tINQ_DB_ENT* p_i, uint8_t addr_type,
   p_i->inq_count = p_inq->inq_counter; /* Mark entry for current inquiry */
 
   if (!data.empty()) {
-    const uint8_t* p_flag =
-        AdvertiseDataParser::GetFieldByType(data, BTM_BLE_AD_TYPE_FLAG, &len);
+    const uint8_t* p_flag = data.GetFieldByType(BTM_BLE_AD_TYPE_FLAG, &len);
     if (p_flag != NULL && len != 0) p_cur->flag = *p_flag;
   }
 
@@ -1779,14 +1825,13 @@ void btm_ble_update_inq_result(tINQ_DB_ENT* p_i, uint8_t addr_type,
      * Otherwise fall back to trying to infer if it is a HID device based on the
      * service class.
      */
-    const uint8_t* p_uuid16 = AdvertiseDataParser::GetFieldByType(
-        data, BTM_BLE_AD_TYPE_APPEARANCE, &len);
+    const uint8_t* p_uuid16 =
+        data.GetFieldByType(BTM_BLE_AD_TYPE_APPEARANCE, &len);
     if (p_uuid16 && len == 2) {
       btm_ble_appearance_to_cod((uint16_t)p_uuid16[0] | (p_uuid16[1] << 8),
                                 p_cur->dev_class);
     } else {
-      p_uuid16 = AdvertiseDataParser::GetFieldByType(
-          data, BTM_BLE_AD_TYPE_16SRV_CMPL, &len);
+      p_uuid16 = data.GetFieldByType(BTM_BLE_AD_TYPE_16SRV_CMPL, &len);
       if (p_uuid16 != NULL) {
         uint8_t i;
         for (i = 0; i + 2 <= len; i = i + 2) {
@@ -1843,14 +1888,19 @@ void btm_clear_all_pending_le_entry(void) {
 
 void btm_ble_process_adv_addr(RawAddress& bda, uint8_t* addr_type) {
 #if (BLE_PRIVACY_SPT == TRUE)
+  /* resolved by the controller, with the identity address reported */
+  bool resolved = (*addr_type & BLE_ADDR_TYPE_ID_BIT) != 0;
+
   /* map address to security record */
   bool match = btm_identity_addr_to_random_pseudo(&bda, addr_type, false);
+  if (match && resolved) btm_ble_resolving_list_resolved(true);
 
   VLOG(1) << __func__ << ": bda=" << bda;
   /* always do RRA resolution on host */
   if (!match && BTM_BLE_IS_RESOLVE_BDA(bda)) {
     tBTM_SEC_DEV_REC* match_rec = btm_ble_resolve_random_addr(bda);
     if (match_rec) {
+      btm_ble_resolving_list_resolved(false);
       match_rec->ble.active_addr_type = BTM_BLE_ADDR_RRA;
       match_rec->ble.cur_rand_addr = bda;
 
@@ -2063,6 +2113,14 @@ static void btm_ble_process_adv_pkt_cont(
     return;
   }
 
+  /* Dropped here, as the controller would, when filtering on the host */
+  if (!btm_ble_soft_filter_match(bda, rssi, adv_data)) {
+    cache.Clear(addr_type, bda);
+    return;
+  }
+
+  btm_ble_batchscan_store_result(addr_type, bda, tx_power, rssi, adv_data);
+
   tINQ_DB_ENT* p_i = btm_inq_db_find(bda);
 
   /* Check if this address has already been processed for this inquiry */
@@ -2095,12 +2153,15 @@ static void btm_ble_process_adv_pkt_cont(
 
   p_i->time_of_resp = time_get_os_boottime_ms();
 
+  /* Parsed once for the fields needed below */
+  AdvertiseDataIndex adv_index(adv_data);
+
   /* update the LE device information in inquiry database */
   btm_ble_update_inq_result(p_i, addr_type, bda, evt_type, primary_phy,
                             secondary_phy, advertising_sid, tx_power, rssi,
-                            periodic_adv_int, adv_data);
+                            periodic_adv_int, adv_index);
 
-  uint8_t result = btm_ble_is_discoverable(bda, adv_data);
+  uint8_t result = btm_ble_is_discoverable(bda, adv_index);
   if (result == 0) {
     cache.Clear(addr_type, bda);
     LOG_WARN(LOG_TAG,
@@ -2231,10 +2292,10 @@ void btm_ble_stop_inquiry(void) {
   /* If no more scan activity, stop LE scan now */
   if (!BTM_BLE_IS_SCAN_ACTIVE(p_ble_cb->scan_activity))
     btm_ble_stop_scan();
-  else if (!btm_ble_is_scan_params_low_latency()) {
-    BTM_TRACE_DEBUG("%s: setting default params for ongoing observe", __func__);
-    btm_ble_stop_scan();
-    btm_ble_start_scan();
+  else if (scan_params_owner & BTM_BLE_INQUIRY_MASK) {
+    BTM_TRACE_DEBUG("%s: setting back the params of the ongoing scan",
+                    __func__);
+    btm_ble_restore_scan_params();
   }
 
   /* If we have a callback registered for inquiry complete, call it */
@@ -2265,10 +2326,120 @@ static void btm_ble_stop_observe(void) {
   p_ble_cb->p_obs_results_cb = NULL;
   p_ble_cb->p_obs_cmpl_cb = NULL;
 
-  if (!BTM_BLE_IS_SCAN_ACTIVE(p_ble_cb->scan_activity)) btm_ble_stop_scan();
+  if (!BTM_BLE_IS_SCAN_ACTIVE(p_ble_cb->scan_activity))
+    btm_ble_stop_scan();
+  else if (scan_params_owner == BTM_LE_OBSERVE_ACTIVE)
+    btm_ble_restore_scan_params();
 
   if (p_obs_cb) (p_obs_cb)(&btm_cb.btm_inq_vars.inq_cmpl_info);
 }
+
+/*******************************************************************************
+ *
+ * Function         btm_ble_restore_scan_params
+ *
+ * Description      Restarts the LE scan with the parameters of the inquiry,
+ *                  the observe or the batch scan still using it, once the one
+ *                  it was started for has stopped.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+static void btm_ble_restore_scan_params(void) {
+  tBTM_BLE_CB* p_ble_cb = &btm_cb.ble_ctr_cb;
+  const tBLE_SHARED_SCAN_PARAMS* p_params;
+
+  if (BTM_BLE_IS_INQ_ACTIVE(p_ble_cb->scan_activity)) {
+    p_params = &inquiry_scan_params;
+    scan_params_owner = p_ble_cb->scan_activity & BTM_BLE_INQUIRY_MASK;
+  } else if (BTM_BLE_IS_OBS_ACTIVE(p_ble_cb->scan_activity)) {
+    p_params = &observe_scan_params;
+    scan_params_owner = BTM_LE_OBSERVE_ACTIVE;
+  } else if (p_ble_cb->scan_activity & BTM_LE_BATCH_SCAN_ACTIVE) {
+    p_params = &batch_scan_params;
+    scan_params_owner = BTM_LE_BATCH_SCAN_ACTIVE;
+  } else {
+    return;
+  }
+
+  btm_ble_stop_scan();
+  p_ble_cb->inq_var.scan_type = p_params->scan_type;
+  btm_send_hci_set_scan_params(p_params->scan_phy, p_params->scan_type,
+                               p_params->scan_interval, p_params->scan_window,
+                               p_ble_cb->addr_mgnt_cb.own_addr_type,
+                               p_params->scan_filter_policy);
+  p_ble_cb->inq_var.scan_duplicate_filter = BTM_BLE_DUPLICATE_DISABLE;
+  btm_ble_start_scan();
+}
+
+/*******************************************************************************
+ *
+ * Function         btm_ble_start_batch_scan
+ *
+ * Description      Holds an LE scan for the batch scan results stored on the
+ *                  host. The scan uses the given parameters, unless an inquiry
+ *                  or an observe is scanning already.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+void btm_ble_start_batch_scan(uint8_t scan_type, uint16_t scan_interval,
+                              uint16_t scan_window) {
+  tBTM_BLE_CB* p_ble_cb = &btm_cb.ble_ctr_cb;
+  tBTM_BLE_INQ_CB* p_inq = &p_ble_cb->inq_var;
+
+  /* Restored when an inquiry or an observe already scanning stops */
+  batch_scan_params = {SCAN_PHY_LE_1M, scan_type, BTM_BLE_DEFAULT_SFP,
+                       {scan_interval}, {scan_window}};
+
+  if (BTM_BLE_IS_SCAN_ACTIVE(p_ble_cb->scan_activity &
+                             ~BTM_LE_BATCH_SCAN_ACTIVE)) {
+    p_ble_cb->scan_activity |= BTM_LE_BATCH_SCAN_ACTIVE;
+    return;
+  }
+
+  /* Restart the scan with the new parameters */
+  if (p_ble_cb->scan_activity & BTM_LE_BATCH_SCAN_ACTIVE) btm_ble_stop_scan();
+
+  p_inq->scan_type = scan_type;
+#if (BLE_PRIVACY_SPT == TRUE)
+  /* enable resolving list */
+  btm_ble_enable_resolving_list_for_platform(BTM_BLE_RL_SCAN);
+#endif
+
+  btm_send_hci_set_scan_params(SCAN_PHY_LE_1M, scan_type, {scan_interval},
+                               {scan_window},
+                               p_ble_cb->addr_mgnt_cb.own_addr_type,
+                               BTM_BLE_DEFAULT_SFP);
+
+  p_inq->scan_duplicate_filter = BTM_BLE_DUPLICATE_DISABLE;
+  btm_ble_start_scan();
+  p_ble_cb->scan_activity |= BTM_LE_BATCH_SCAN_ACTIVE;
+  scan_params_owner = BTM_LE_BATCH_SCAN_ACTIVE;
+}
+
+/*******************************************************************************
+ *
+ * Function         btm_ble_stop_batch_scan
+ *
+ * Description      Releases the LE scan held for the batch scan results, and
+ *                  stops it unless an inquiry or an observe is using it.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+void btm_ble_stop_batch_scan(void) {
+  tBTM_BLE_CB* p_ble_cb = &btm_cb.ble_ctr_cb;
+
+  if (!(p_ble_cb->scan_activity & BTM_LE_BATCH_SCAN_ACTIVE)) return;
+
+  p_ble_cb->scan_activity &= ~BTM_LE_BATCH_SCAN_ACTIVE;
+
+  if (!BTM_BLE_IS_SCAN_ACTIVE(p_ble_cb->scan_activity))
+    btm_ble_stop_scan();
+  else if (scan_params_owner == BTM_LE_BATCH_SCAN_ACTIVE)
+    btm_ble_restore_scan_params();
+}
 /*******************************************************************************
  *
  * Function         btm_ble_adv_states_operation
@@ -2654,6 +2825,7 @@ void btm_ble_init(void) {
 
 #if (BLE_VND_INCLUDED == FALSE)
   btm_ble_adv_filter_init();
+  btm_ble_batchscan_init();
 #endif
 }
 
@@ -73,6 +73,9 @@ extern tBTM_STATUS btm_ble_start_adv(void);
 extern tBTM_STATUS btm_ble_stop_adv(void);
 extern void btm_le_on_advertising_set_terminated(uint8_t* p, uint16_t length);
 extern tBTM_STATUS btm_ble_start_scan(void);
+extern void btm_ble_start_batch_scan(uint8_t scan_type, uint16_t scan_interval,
+                                     uint16_t scan_window);
+extern void btm_ble_stop_batch_scan(void);
 extern void btm_ble_create_ll_conn_complete(uint8_t status);
 
 /* LE security function from btm_sec.cc */
@@ -131,6 +134,7 @@ extern void btm_ble_update_mode_operation(uint8_t link_role,
 extern bool btm_execute_wl_dev_operation(void);
 extern void btm_ble_update_link_topology_mask(uint8_t role, bool increase);
 extern void btm_ble_bgconn_cancel_if_disconnected(const RawAddress& bd_addr);
+extern bool btm_ble_bgconn_find(const RawAddress& bd_addr, bool* p_pending);
 
 /* BLE address management */
 extern void btm_gen_resolvable_private_addr(
@@ -142,6 +146,10 @@ extern tBTM_SEC_DEV_REC* btm_ble_resolve_random_addr(
 extern void btm_gen_resolve_paddr_low(const RawAddress& address);
 extern uint64_t btm_get_next_private_addrress_interval_ms();
 
+/* The private address refresh is not time critical, so it may run this much
+ * late to share a wakeup with other timers */
+#define BTM_BLE_PRIVATE_ADDR_SLACK_MS (30 * 1000)
+
 /*  privacy function */
 #if (BLE_PRIVACY_SPT == TRUE)
 /* BLE address mapping with CS feature */
@@ -176,8 +184,15 @@ extern void btm_ble_multi_adv_cleanup(void);
 extern uint8_t btm_ble_get_max_adv_instances(void);
 extern void btm_ble_batchscan_init(void);
 extern void btm_ble_batchscan_cleanup(void);
+extern bool btm_ble_soft_batchscan(void);
+extern void btm_ble_batchscan_store_result(
+    uint8_t addr_type, const RawAddress& bda, int8_t tx_power, int8_t rssi,
+    std::vector<uint8_t> const& adv_data);
 extern void btm_ble_adv_filter_init(void);
 extern void btm_ble_adv_filter_cleanup(void);
+extern bool btm_ble_soft_filtering(void);
+extern bool btm_ble_soft_filter_match(const RawAddress& bda, int8_t rssi,
+                                      std::vector<uint8_t> const& adv_data);
 extern bool btm_ble_topology_check(tBTM_BLE_STATE_MASK request);
 extern bool btm_ble_clear_topology_mask(tBTM_BLE_STATE_MASK request_state);
 extern bool btm_ble_set_topology_mask(tBTM_BLE_STATE_MASK request_state);
@@ -94,6 +94,8 @@ inline bool BTM_BLE_IS_RANDOM_STATIC_BDA(const RawAddress& x) {
 /* LE scan activity bit mask, continue with LE inquiry bits */
 /* observe is in progress */
 #define BTM_LE_OBSERVE_ACTIVE 0x80
+/* batch scan results are stored on the host */
+#define BTM_LE_BATCH_SCAN_ACTIVE 0x40
 
 /* BLE scan activity mask checking */
 #define BTM_BLE_IS_SCAN_ACTIVE(x) ((x)&BTM_BLE_SCAN_ACTIVE_MASK)
@@ -250,6 +252,7 @@ typedef uint16_t tBTM_BLE_STATE_MASK;
 typedef struct {
   RawAddress* resolve_q_random_pseudo;
   uint8_t* resolve_q_action;
+  uint8_t q_size; /* entries allocated, zero without a resolving list */
   uint8_t q_next;
   uint8_t q_pending;
 } tBTM_BLE_RESOLVE_Q;
@@ -26,10 +26,15 @@
 #include "ble_advertiser_hci_interface.h"
 #include "btm_int.h"
 #include "btm_int_types.h"
+#include "btu.h"
 #include "stack/btm/btm_ble_int.h"
 
+#include <stdio.h>
 #include <string.h>
+#include <future>
+#include <memory>
 #include <queue>
+#include <utility>
 #include <vector>
 
 #include <base/bind.h>
@@ -61,11 +66,20 @@ bool is_connectable(uint16_t advertising_event_properties) {
   return advertising_event_properties & 0x01;
 }
 
+/* FNV-1a, used to detect advertising payloads that did not change */
+uint64_t adv_data_hash(const std::vector<uint8_t>& data) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (uint8_t byte : data) {
+    hash ^= byte;
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
 struct AdvertisingInstance {
   uint8_t inst_id;
   bool in_use;
   uint8_t advertising_event_properties;
-  alarm_t* adv_raddr_timer;
   int8_t tx_power;
   uint16_t duration;  // 1 unit is 10ms
   uint8_t maxExtAdvEvents;
@@ -89,6 +103,19 @@ struct AdvertisingInstance {
   bool enable_status;
   TimeTicks enable_time;
 
+  /* Hash of the advertising and scan response data last accepted by the
+   * controller. Writing the same payload again is skipped. */
+  bool adv_data_hash_valid;
+  uint64_t adv_data_hash;
+  bool scan_rsp_hash_valid;
+  uint64_t scan_rsp_hash;
+  uint32_t data_writes_skipped;
+
+  /* HCI command latency, from submission to command complete */
+  uint32_t cmd_count;
+  TimeDelta cmd_latency_total;
+  TimeDelta cmd_latency_max;
+
   bool IsEnabled() { return enable_status; }
 
   bool IsConnectable() { return is_connectable(advertising_event_properties); }
@@ -104,14 +131,16 @@ struct AdvertisingInstance {
         own_address(RawAddress::kEmpty),
         address_update_required(false),
         periodic_enabled(false),
-        enable_status(false) {
-    adv_raddr_timer = alarm_new_periodic("btm_ble.adv_raddr_timer");
-  }
+        enable_status(false),
+        adv_data_hash_valid(false),
+        adv_data_hash(0),
+        scan_rsp_hash_valid(false),
+        scan_rsp_hash(0),
+        data_writes_skipped(0),
+        cmd_count(0) {}
 
   ~AdvertisingInstance() {
     in_use = false;
-    alarm_free(adv_raddr_timer);
-    adv_raddr_timer = nullptr;
     if (timeout_timer) {
       alarm_free(timeout_timer);
       timeout_timer = nullptr;
@@ -170,13 +199,20 @@ class BleAdvertisingManagerImpl
       public BleAdvertiserHciInterface::AdvertisingEventObserver {
  public:
   BleAdvertisingManagerImpl(BleAdvertiserHciInterface* interface)
-      : hci_interface(interface), weak_factory_(this) {
+      : hci_interface(interface),
+        rpa_rotation_timer(alarm_new_periodic("btm_ble.adv_raddr_timer")),
+        rpa_rotation_scheduled(false),
+        weak_factory_(this) {
     hci_interface->ReadInstanceCount(
         base::Bind(&BleAdvertisingManagerImpl::ReadInstanceCountCb,
                    weak_factory_.GetWeakPtr()));
   }
 
-  ~BleAdvertisingManagerImpl() { adv_inst.clear(); }
+  ~BleAdvertisingManagerImpl() {
+    adv_inst.clear();
+    alarm_free(rpa_rotation_timer);
+    rpa_rotation_timer = nullptr;
+  }
 
   void GetOwnAddress(uint8_t inst_id, GetAddressCallback cb) override {
     cb.Run(adv_inst[inst_id].own_address_type, adv_inst[inst_id].own_address);
@@ -227,12 +263,14 @@ class BleAdvertisingManagerImpl
           /* set it to controller */
           hci_interface->SetRandomAddress(
               p_inst->inst_id, bda,
-              Bind(
-                   [](AdvertisingInstance* p_inst,
-                     MultiAdvCb configuredCb, uint8_t status) {
-                    configuredCb.Run(0x00);
-                  },
-                  p_inst, configuredCb));
+              instance_weakptr.get()->TrackCommand(
+                  p_inst->inst_id,
+                  Bind(
+                      [](AdvertisingInstance* p_inst,
+                         MultiAdvCb configuredCb, uint8_t status) {
+                        configuredCb.Run(0x00);
+                      },
+                      p_inst, configuredCb)));
 
           if (restart) {
             p_inst->enable_status = true;
@@ -243,6 +281,201 @@ class BleAdvertisingManagerImpl
         p_inst, std::move(configuredCb)));
   }
 
+  /* Rotates the RPA of all advertising sets using a random address at once,
+   * so that connectable sets are stopped and restarted with one multi-set
+   * enable command each, instead of once per set at unrelated times. */
+  void RotateRpas() {
+    std::vector<uint8_t> to_rotate;
+
+    for (AdvertisingInstance& inst : adv_inst) {
+      if (!inst.in_use || inst.own_address_type != BLE_ADDR_RANDOM) continue;
+
+      // If there is any form of timeout on the set, schedule address update
+      // when the set stops, see ConfigureRpa.
+      if (inst.IsEnabled() && inst.IsConnectable() &&
+          (inst.duration || inst.maxExtAdvEvents)) {
+        inst.address_update_required = true;
+        continue;
+      }
+
+      to_rotate.push_back(inst.inst_id);
+    }
+
+    if (to_rotate.empty()) return;
+
+    auto rotation = std::make_shared<RpaRotation>();
+    rotation->expected = to_rotate.size();
+    for (uint8_t inst_id : to_rotate) {
+      GenerateRpa(Bind(&BleAdvertisingManagerImpl::OnRotationRpaGenerated,
+                       weak_factory_.GetWeakPtr(), rotation, inst_id));
+    }
+  }
+
+  struct RpaRotation {
+    size_t expected;
+    std::vector<std::pair<uint8_t, RawAddress>> addresses;
+  };
+
+  void OnRotationRpaGenerated(std::shared_ptr<RpaRotation> rotation,
+                              uint8_t inst_id, const RawAddress& bda) {
+    rotation->addresses.emplace_back(inst_id, bda);
+    if (rotation->addresses.size() < rotation->expected) return;
+
+    /* Connectable advertising sets must be disabled when updating RPA */
+    std::vector<SetEnableData> restart;
+    for (const auto& entry : rotation->addresses) {
+      AdvertisingInstance* p_inst = &adv_inst[entry.first];
+      if (p_inst->in_use && p_inst->IsEnabled() && p_inst->IsConnectable()) {
+        restart.emplace_back(SetEnableData{
+            .handle = p_inst->inst_id,
+            .duration = p_inst->duration,
+            .max_extended_advertising_events = p_inst->maxExtAdvEvents});
+      }
+    }
+
+    if (!restart.empty())
+      EnableSets(false, restart,
+                 Bind(&BleAdvertisingManagerImpl::OnEnableSetsComplete,
+                      "RPA rotation", false));
+
+    for (const auto& entry : rotation->addresses) {
+      AdvertisingInstance* p_inst = &adv_inst[entry.first];
+      if (!p_inst->in_use) continue;
+
+      p_inst->own_address = entry.second;
+      GetHciInterface()->SetRandomAddress(
+          p_inst->inst_id, entry.second,
+          TrackCommand(p_inst->inst_id, base::DoNothing()));
+    }
+
+    if (!restart.empty())
+      EnableSets(true, restart,
+                 Bind(&BleAdvertisingManagerImpl::OnEnableSetsComplete,
+                      "RPA rotation", true));
+  }
+
+  static void OnEnableSetsComplete(const char* what, bool enable,
+                                   uint8_t status) {
+    if (status != HCI_SUCCESS) {
+      LOG(ERROR) << what << ": " << (enable ? "enabling" : "disabling")
+                 << " sets failed, status=" << +status;
+    }
+  }
+
+  struct EnableSetsBatch {
+    size_t pending;
+    uint8_t status;
+    MultiAdvCb cb;
+  };
+
+  /* Enables or disables |sets| with one command on controllers supporting LE
+   * extended advertising. The VSC and legacy interfaces take a single set per
+   * command, so there each set gets its own and |cb| the first failure. */
+  void EnableSets(bool enable, std::vector<SetEnableData> sets,
+                  MultiAdvCb cb) {
+    if (sets.size() == 1 ||
+        controller_get_interface()->supports_ble_extended_advertising()) {
+      // account the shared command to the first set of the batch
+      uint8_t handle = sets[0].handle;
+      GetHciInterface()->Enable(enable, std::move(sets),
+                                TrackCommand(handle, std::move(cb)));
+      return;
+    }
+
+    auto batch = std::make_shared<EnableSetsBatch>();
+    batch->pending = sets.size();
+    batch->status = HCI_SUCCESS;
+    batch->cb = std::move(cb);
+    for (const SetEnableData& set : sets) {
+      GetHciInterface()->Enable(
+          enable, set.handle, set.duration,
+          set.max_extended_advertising_events,
+          TrackCommand(set.handle,
+                       Bind(&BleAdvertisingManagerImpl::OnEnableSetComplete,
+                            batch)));
+    }
+  }
+
+  static void OnEnableSetComplete(std::shared_ptr<EnableSetsBatch> batch,
+                                  uint8_t status) {
+    if (status != HCI_SUCCESS && batch->status == HCI_SUCCESS)
+      batch->status = status;
+    if (--batch->pending == 0) batch->cb.Run(batch->status);
+  }
+
+  void ScheduleRpaRotation() {
+    if (rpa_rotation_scheduled) return;
+
+    rpa_rotation_scheduled = true;
+    alarm_set_on_mloop_with_slack(rpa_rotation_timer,
+                                  btm_get_next_private_addrress_interval_ms(),
+                                  BTM_BLE_PRIVATE_ADDR_SLACK_MS,
+                                  btm_ble_adv_raddr_timer_timeout, nullptr);
+  }
+
+  void CancelRpaRotationIfIdle() {
+    for (const AdvertisingInstance& inst : adv_inst) {
+      if (inst.in_use && inst.own_address_type == BLE_ADDR_RANDOM) return;
+    }
+
+    alarm_cancel(rpa_rotation_timer);
+    rpa_rotation_scheduled = false;
+  }
+
+  /* Wraps |cb| so that the time until the controller completes the command is
+   * accounted to advertising set |inst_id|. |cb| runs even if the manager is
+   * gone, so the callers can detect the shutdown themselves. */
+  MultiAdvCb TrackCommand(uint8_t inst_id, MultiAdvCb cb) {
+    return Bind(&BleAdvertisingManagerImpl::OnTrackedCommandComplete,
+                weak_factory_.GetWeakPtr(), inst_id, TimeTicks::Now(),
+                std::move(cb));
+  }
+
+  static void OnTrackedCommandComplete(
+      base::WeakPtr<BleAdvertisingManagerImpl> self, uint8_t inst_id,
+      TimeTicks start, MultiAdvCb cb, uint8_t status) {
+    if (self) self->RecordCommandLatency(inst_id, TimeTicks::Now() - start);
+    cb.Run(status);
+  }
+
+  static void OnTrackedParametersComplete(
+      base::WeakPtr<BleAdvertisingManagerImpl> self, uint8_t inst_id,
+      TimeTicks start, ParametersCb cb, uint8_t status, int8_t tx_power) {
+    if (self) self->RecordCommandLatency(inst_id, TimeTicks::Now() - start);
+    cb.Run(status, tx_power);
+  }
+
+  void RecordCommandLatency(uint8_t inst_id, TimeDelta latency) {
+    if (inst_id >= adv_inst.size()) return;
+
+    AdvertisingInstance* p_inst = &adv_inst[inst_id];
+    p_inst->cmd_count++;
+    p_inst->cmd_latency_total += latency;
+    if (latency > p_inst->cmd_latency_max) p_inst->cmd_latency_max = latency;
+  }
+
+  void Dump(int fd) {
+    dprintf(fd, "\nLE Advertising Manager:\n");
+    dprintf(fd, "  instances: %d, rpa rotation scheduled: %s\n", inst_count,
+            rpa_rotation_scheduled ? "true" : "false");
+
+    for (const AdvertisingInstance& inst : adv_inst) {
+      if (!inst.in_use && inst.cmd_count == 0) continue;
+
+      int64_t avg_us =
+          inst.cmd_count ? inst.cmd_latency_total.InMicroseconds() /
+                               inst.cmd_count
+                         : 0;
+      dprintf(fd,
+              "  inst_id: %d, in_use: %d, enabled: %d, hci commands: %u, "
+              "latency avg/max: %lld/%lld us, data writes skipped: %u\n",
+              inst.inst_id, inst.in_use, inst.enable_status, inst.cmd_count,
+              (long long)avg_us,
+              (long long)inst.cmd_latency_max.InMicroseconds(),
+              inst.data_writes_skipped);
+    }
+  }
+
   void RegisterAdvertiser(
       base::Callback<void(uint8_t /* inst_id */, uint8_t /* status */)> cb)
       override {
@@ -251,6 +484,8 @@ class BleAdvertisingManagerImpl
       if (p_inst->in_use) continue;
 
       p_inst->in_use = true;
+      p_inst->adv_data_hash_valid = false;
+      p_inst->scan_rsp_hash_valid = false;
 
       // set up periodic timer to update address.
       if (BTM_BleLocalPrivacyEnabled()) {
@@ -267,9 +502,9 @@ class BleAdvertisingManagerImpl
               }
               p_inst->own_address = bda;
 
-              alarm_set_on_mloop(p_inst->adv_raddr_timer,
-                                 btm_get_next_private_addrress_interval_ms(),
-                                 btm_ble_adv_raddr_timer_timeout, p_inst);
+              // all sets rotate together on the shared timer
+              if (instance_weakptr.get())
+                instance_weakptr.get()->ScheduleRpaRotation();
               cb.Run(p_inst->inst_id, BTM_BLE_MULTI_ADV_SUCCESS);
             }, p_inst, cb));
         }
@@ -693,7 +928,8 @@ class BleAdvertisingManagerImpl
     if (enable) p_inst->enable_time = TimeTicks::Now();
     p_inst->enable_status = enable;
     GetHciInterface()->Enable(enable, p_inst->inst_id, p_inst->duration,
-                              p_inst->maxExtAdvEvents, std::move(myCb));
+                              p_inst->maxExtAdvEvents,
+                              TrackCommand(p_inst->inst_id, std::move(myCb)));
   }
 
   void SetParameters(uint8_t inst_id, tBTM_BLE_ADV_PARAMS* p_params,
@@ -744,7 +980,10 @@ class BleAdvertisingManagerImpl
         p_params->adv_filter_policy, p_inst->tx_power,
         p_params->primary_advertising_phy, 0x00,
         p_params->secondary_advertising_phy, sid,
-        p_params->scan_request_notification_enable, cb);
+        p_params->scan_request_notification_enable,
+        Bind(&BleAdvertisingManagerImpl::OnTrackedParametersComplete,
+             weak_factory_.GetWeakPtr(), inst_id, TimeTicks::Now(),
+             std::move(cb)));
 
     // TODO: re-enable only if it was enabled, properly call
     // SetParamsCallback
@@ -795,8 +1034,39 @@ class BleAdvertisingManagerImpl
     }
 
     VLOG(1) << "data is: " << base::HexEncode(data.data(), data.size());
+
+    uint64_t hash = adv_data_hash(data);
+    bool& hash_valid =
+        is_scan_rsp ? p_inst->scan_rsp_hash_valid : p_inst->adv_data_hash_valid;
+    uint64_t& last_hash =
+        is_scan_rsp ? p_inst->scan_rsp_hash : p_inst->adv_data_hash;
+    if (hash_valid && last_hash == hash) {
+      VLOG(1) << __func__ << " data unchanged, skipping write";
+      p_inst->data_writes_skipped++;
+      cb.Run(BTM_BLE_MULTI_ADV_SUCCESS);
+      return;
+    }
+
+    // the controller content is unknown until the write completes
+    hash_valid = false;
+    MultiAdvCb done_cb = Bind(
+        [](AdvertisingInstance* p_inst, bool is_scan_rsp, uint64_t hash,
+           MultiAdvCb cb, uint8_t status) {
+          if (status == 0 && instance_weakptr.get()) {
+            if (is_scan_rsp) {
+              p_inst->scan_rsp_hash = hash;
+              p_inst->scan_rsp_hash_valid = true;
+            } else {
+              p_inst->adv_data_hash = hash;
+              p_inst->adv_data_hash_valid = true;
+            }
+          }
+          cb.Run(status);
+        },
+        p_inst, is_scan_rsp, hash, std::move(cb));
+
     DivideAndSendData(
-        inst_id, data, false, cb,
+        inst_id, data, false, std::move(done_cb),
         base::Bind(&BleAdvertisingManagerImpl::SetDataAdvDataSender,
                    weak_factory_.GetWeakPtr(), is_scan_rsp));
   }
@@ -806,10 +1076,10 @@ class BleAdvertisingManagerImpl
                             MultiAdvCb cb) {
     if (is_scan_rsp)
       GetHciInterface()->SetScanResponseData(inst_id, operation, 0x01, length,
-                                             data, cb);
+                                             data, TrackCommand(inst_id, cb));
     else
       GetHciInterface()->SetAdvertisingData(inst_id, operation, 0x01, length,
-                                            data, cb);
+                                            data, TrackCommand(inst_id, cb));
   }
 
   using DataSender = base::Callback<void(
@@ -938,8 +1208,10 @@ class BleAdvertisingManagerImpl
       p_inst->timeout_timer = nullptr;
     }
 
-    alarm_cancel(p_inst->adv_raddr_timer);
     p_inst->in_use = false;
+    p_inst->adv_data_hash_valid = false;
+    p_inst->scan_rsp_hash_valid = false;
+    CancelRpaRotationIfIdle();
     GetHciInterface()->RemoveAdvertisingSet(inst_id, base::DoNothing());
     p_inst->address_update_required = false;
   }
@@ -984,7 +1256,9 @@ class BleAdvertisingManagerImpl
     }
 
     if (!sets.empty())
-      GetHciInterface()->Enable(false, sets, base::DoNothing());
+      EnableSets(false, std::move(sets),
+                 Bind(&BleAdvertisingManagerImpl::OnEnableSetsComplete,
+                      "Suspend", false));
   }
 
   void Resume() override {
@@ -999,7 +1273,10 @@ class BleAdvertisingManagerImpl
       }
     }
 
-    if (!sets.empty()) GetHciInterface()->Enable(true, sets, base::DoNothing());
+    if (!sets.empty())
+      EnableSets(true, std::move(sets),
+                 Bind(&BleAdvertisingManagerImpl::OnEnableSetsComplete,
+                      "Resume", true));
   }
 
   void OnAdvertisingSetTerminated(
@@ -1061,10 +1338,9 @@ class BleAdvertisingManagerImpl
       if (p_inst->timeout_timer) {
         alarm_cancel(p_inst->timeout_timer);
       }
-      if (p_inst->adv_raddr_timer) {
-        alarm_cancel(p_inst->adv_raddr_timer);
-      }
     }
+    alarm_cancel(rpa_rotation_timer);
+    rpa_rotation_scheduled = false;
   }
 
  private:
@@ -1075,6 +1351,10 @@ class BleAdvertisingManagerImpl
   uint8_t inst_count;
   bool rpa_gen_offload_enabled;
 
+  /* single timer rotating the RPA of all sets together */
+  alarm_t* rpa_rotation_timer;
+  bool rpa_rotation_scheduled;
+
   // Member variables should appear before the WeakPtrFactory, to ensure
   // that any WeakPtrs are invalidated before its members
   // variable's destructors are executed, rendering them invalid.
@@ -1083,7 +1363,7 @@ class BleAdvertisingManagerImpl
 
 void btm_ble_adv_raddr_timer_timeout(void* data) {
   BleAdvertisingManagerImpl* ptr = instance_weakptr.get();
-  if (ptr) ptr->ConfigureRpa((AdvertisingInstance*)data, base::DoNothing());
+  if (ptr) ptr->RotateRpas();
 }
 }  // namespace
 
@@ -1098,6 +1378,30 @@ base::WeakPtr<BleAdvertisingManager> BleAdvertisingManager::Get() {
   return instance_weakptr;
 };
 
+static void btm_ble_adv_dump(int fd, std::promise<void> dumped) {
+  BleAdvertisingManagerImpl* ptr = instance_weakptr.get();
+  if (ptr) ptr->Dump(fd);
+  dumped.set_value();
+}
+
+void BleAdvertisingManager::DebugDump(int fd) {
+  base::MessageLoop* message_loop = get_message_loop();
+  if (message_loop == nullptr || !message_loop->task_runner().get()) return;
+
+  // The instances belong to the stack thread, dump them there
+  std::promise<void> dumped;
+  std::future<void> dump_done = dumped.get_future();
+  if (message_loop->task_runner()->BelongsToCurrentThread()) {
+    btm_ble_adv_dump(fd, std::move(dumped));
+    return;
+  }
+
+  message_loop->task_runner()->PostTask(
+      FROM_HERE, base::Bind(&btm_ble_adv_dump, fd,
+                            base::Passed(std::move(dumped))));
+  dump_done.wait();
+}
+
 void BleAdvertisingManager::CleanUp() {
   if (instance_weakptr.get()) instance_weakptr.get()->CancelAdvAlarms();
 
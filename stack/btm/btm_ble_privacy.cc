@@ -22,11 +22,13 @@
  *
  ******************************************************************************/
 #include <string.h>
+#include <algorithm>
 #include "bt_target.h"
 
 #if (BLE_PRIVACY_SPT == TRUE)
 #include "ble_advertiser.h"
 #include "bt_types.h"
+#include "btm_ble_resolving_list.h"
 #include "btm_int.h"
 #include "btu.h"
 #include "device/include/controller.h"
@@ -48,6 +50,10 @@
 #define BTM_BLE_META_READ_IRK_LEN 2
 #define BTM_BLE_META_ADD_WL_ATTR_LEN 9
 
+/* Devices kept in the resolving list when it cannot hold all of them */
+static BleResolvingList resolving_list;
+static bool resolving_list_sync_pending = false;
+
 /*******************************************************************************
  *         Functions implemented controller based privacy using Resolving List
  ******************************************************************************/
@@ -67,10 +73,12 @@ void btm_ble_enq_resolving_list_pending(const RawAddress& pseudo_bda,
                                         uint8_t op_code) {
   tBTM_BLE_RESOLVE_Q* p_q = &btm_cb.ble_ctr_cb.resolving_list_pend_q;
 
+  if (p_q->q_size == 0) return;
+
   p_q->resolve_q_random_pseudo[p_q->q_next] = pseudo_bda;
   p_q->resolve_q_action[p_q->q_next] = op_code;
   p_q->q_next++;
-  p_q->q_next %= controller_get_interface()->get_ble_resolving_list_max_size();
+  p_q->q_next %= p_q->q_size;
 }
 
 /*******************************************************************************
@@ -95,7 +103,7 @@ bool btm_ble_brcm_find_resolving_pending_entry(const RawAddress& pseudo_addr,
       return true;
 
     i++;
-    i %= controller_get_interface()->get_ble_resolving_list_max_size();
+    i %= p_q->q_size;
   }
   return false;
 }
@@ -119,8 +127,7 @@ bool btm_ble_deq_resolving_pending(RawAddress& pseudo_addr) {
     pseudo_addr = p_q->resolve_q_random_pseudo[p_q->q_pending];
     p_q->resolve_q_random_pseudo[p_q->q_pending] = RawAddress::kEmpty;
     p_q->q_pending++;
-    p_q->q_pending %=
-        controller_get_interface()->get_ble_resolving_list_max_size();
+    p_q->q_pending %= p_q->q_size;
     return true;
   }
 
@@ -289,6 +296,8 @@ void btm_ble_add_resolving_list_entry_complete(uint8_t* p, uint16_t evt_len) {
     btm_cb.ble_ctr_cb.resolving_list_avail_size = 0;
     BTM_TRACE_DEBUG("%s Resolving list Full ", __func__);
   }
+
+  if (resolving_list_sync_pending) btm_ble_resolving_list_sync();
 }
 
 /*******************************************************************************
@@ -323,6 +332,8 @@ void btm_ble_remove_resolving_list_entry_complete(uint8_t* p,
     } else
       btm_cb.ble_ctr_cb.resolving_list_avail_size++;
   }
+
+  if (resolving_list_sync_pending) btm_ble_resolving_list_sync();
 }
 
 /*******************************************************************************
@@ -662,12 +673,76 @@ bool btm_ble_disable_resolving_list(uint8_t rl_mask, bool to_resume) {
   return true;
 }
 
+/*******************************************************************************
+ *
+ * Function         btm_ble_rpa_enabled_dev
+ *
+ * Description      Tells whether a device uses RPAs, and so goes into the
+ *                  resolving list.
+ *
+ ******************************************************************************/
+static bool btm_ble_rpa_enabled_dev(tBTM_SEC_DEV_REC* p_dev_rec) {
+  return (p_dev_rec->ble.key_type & (BTM_LE_KEY_PID | BTM_LE_KEY_LID)) != 0;
+}
+
+/*******************************************************************************
+ *
+ * Function         btm_ble_add_resolving_list_entry
+ *
+ * Description      This function adds a device to the controller resolving
+ *                  list, while address resolution is disabled.
+ *
+ * Parameters       pointer to device security record
+ *
+ ******************************************************************************/
+static void btm_ble_add_resolving_list_entry(tBTM_SEC_DEV_REC* p_dev_rec) {
+  btm_ble_update_resolving_list(p_dev_rec->bd_addr, true);
+  if (controller_get_interface()->supports_ble_privacy()) {
+    const Octet16& peer_irk = p_dev_rec->ble.keys.irk;
+    const Octet16& local_irk = btm_cb.devcb.id_keys.irk;
+
+    if (p_dev_rec->ble.identity_addr.IsEmpty()) {
+      p_dev_rec->ble.identity_addr = p_dev_rec->bd_addr;
+      p_dev_rec->ble.identity_addr_type = p_dev_rec->ble.ble_addr_type;
+    }
+
+    BTM_TRACE_DEBUG("%s: adding device %s to controller resolving list",
+                    __func__, p_dev_rec->ble.identity_addr.ToString().c_str());
+
+    // use identical IRK for now
+    btsnd_hcic_ble_add_device_resolving_list(p_dev_rec->ble.identity_addr_type,
+                                             p_dev_rec->ble.identity_addr,
+                                             peer_irk, local_irk);
+
+    if (controller_get_interface()->supports_ble_set_privacy_mode()) {
+      BTM_TRACE_DEBUG("%s: adding device privacy mode", __func__);
+      btsnd_hcic_ble_set_privacy_mode(p_dev_rec->ble.identity_addr_type,
+                                      p_dev_rec->ble.identity_addr, 0x01);
+    }
+  } else {
+    uint8_t param[40] = {0};
+    uint8_t* p = param;
+
+    UINT8_TO_STREAM(p, BTM_BLE_META_ADD_IRK_ENTRY);
+    ARRAY_TO_STREAM(p, p_dev_rec->ble.keys.irk, OCTET16_LEN);
+    UINT8_TO_STREAM(p, p_dev_rec->ble.identity_addr_type);
+    BDADDR_TO_STREAM(p, p_dev_rec->ble.identity_addr);
+
+    BTM_VendorSpecificCommand(HCI_VENDOR_BLE_RPA_VSC, BTM_BLE_META_ADD_IRK_LEN,
+                              param, btm_ble_resolving_list_vsc_op_cmpl);
+  }
+
+  btm_ble_enq_resolving_list_pending(p_dev_rec->bd_addr,
+                                     BTM_BLE_META_ADD_IRK_ENTRY);
+}
+
 /*******************************************************************************
  *
  * Function         btm_ble_resolving_list_load_dev
  *
  * Description      This function adds a device which is using RPA into the
- *                  white list.
+ *                  white list. When the list is full, it takes the place of
+ *                  a less important device, if any.
  *
  * Parameters       pointer to device security record
  *
@@ -693,7 +768,7 @@ bool btm_ble_resolving_list_load_dev(tBTM_SEC_DEV_REC* p_dev_rec) {
   }
 
   /* only add RPA enabled device into resolving list */
-  if ((p_dev_rec->ble.key_type & (BTM_LE_KEY_PID | BTM_LE_KEY_LID)) == 0) {
+  if (!btm_ble_rpa_enabled_dev(p_dev_rec)) {
     BTM_TRACE_DEBUG("%s: Device not a RPA enabled device", __func__);
     return false;
   }
@@ -706,59 +781,122 @@ bool btm_ble_resolving_list_load_dev(tBTM_SEC_DEV_REC* p_dev_rec) {
   }
 
   if (btm_cb.ble_ctr_cb.resolving_list_avail_size == 0) {
-    return false;
+    btm_ble_resolving_list_sync();
+    return (p_dev_rec->ble.in_controller_list & BTM_RESOLVING_LIST_BIT) != 0;
   }
 
   if (rl_state && !btm_ble_disable_resolving_list(rl_state, false)) {
     return false;
   }
 
-  btm_ble_update_resolving_list(p_dev_rec->bd_addr, true);
-  if (controller_get_interface()->supports_ble_privacy()) {
-    const Octet16& peer_irk = p_dev_rec->ble.keys.irk;
-    const Octet16& local_irk = btm_cb.devcb.id_keys.irk;
+  btm_ble_add_resolving_list_entry(p_dev_rec);
 
-    if (p_dev_rec->ble.identity_addr.IsEmpty()) {
-      p_dev_rec->ble.identity_addr = p_dev_rec->bd_addr;
-      p_dev_rec->ble.identity_addr_type = p_dev_rec->ble.ble_addr_type;
-    }
+  /* if resolving list has been turned on, re-enable it */
+  if (rl_state)
+    btm_ble_enable_resolving_list(rl_state);
+  else
+    btm_ble_enable_resolving_list(BTM_BLE_RL_INIT);
 
-    BTM_TRACE_DEBUG("%s: adding device %s to controller resolving list",
-                    __func__, p_dev_rec->ble.identity_addr.ToString().c_str());
+  return true;
+}
 
-    // use identical IRK for now
-    btsnd_hcic_ble_add_device_resolving_list(p_dev_rec->ble.identity_addr_type,
-                                             p_dev_rec->ble.identity_addr,
-                                             peer_irk, local_irk);
+/*******************************************************************************
+ *
+ * Function         btm_ble_resolving_list_sync
+ *
+ * Description      This function brings the most important devices using RPAs
+ *                  into the resolving list, when it cannot hold all of them:
+ *                  the ones being connected to, then the ones in the
+ *                  background connection list, then the most recently used.
+ *                  The changes are made at once, with address resolution
+ *                  disabled once.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+void btm_ble_resolving_list_sync(void) {
+  const uint8_t rl_state = btm_cb.ble_ctr_cb.rl_state;
+  tBTM_BLE_RESOLVE_Q* p_q = &btm_cb.ble_ctr_cb.resolving_list_pend_q;
 
-    if (controller_get_interface()->supports_ble_set_privacy_mode()) {
-      BTM_TRACE_DEBUG("%s: adding device privacy mode", __func__);
-      btsnd_hcic_ble_set_privacy_mode(p_dev_rec->ble.identity_addr_type,
-                                      p_dev_rec->ble.identity_addr, 0x01);
-    }
-  } else {
-    uint8_t param[40] = {0};
-    uint8_t* p = param;
+  if (controller_get_interface()->get_ble_resolving_list_max_size() == 0)
+    return;
 
-    UINT8_TO_STREAM(p, BTM_BLE_META_ADD_IRK_ENTRY);
-    ARRAY_TO_STREAM(p, p_dev_rec->ble.keys.irk, OCTET16_LEN);
-    UINT8_TO_STREAM(p, p_dev_rec->ble.identity_addr_type);
-    BDADDR_TO_STREAM(p, p_dev_rec->ble.identity_addr);
+  /* The room left is only known once the pending operations complete */
+  if (p_q->q_next != p_q->q_pending) {
+    resolving_list_sync_pending = true;
+    return;
+  }
+  resolving_list_sync_pending = false;
+
+  std::vector<BleResolvingList::Device> devices;
+  size_t capacity = btm_cb.ble_ctr_cb.resolving_list_avail_size;
+  list_node_t* end = list_end(btm_cb.sec_dev_rec);
+  for (list_node_t* node = list_begin(btm_cb.sec_dev_rec); node != end;
+       node = list_next(node)) {
+    tBTM_SEC_DEV_REC* p_dev_rec =
+        static_cast<tBTM_SEC_DEV_REC*>(list_node(node));
+    if (!btm_ble_rpa_enabled_dev(p_dev_rec)) continue;
+
+    BleResolvingList::Device device;
+    device.address = p_dev_rec->bd_addr;
+    device.last_used = p_dev_rec->timestamp;
+    device.in_list =
+        (p_dev_rec->ble.in_controller_list & BTM_RESOLVING_LIST_BIT) != 0;
+
+    bool pending;
+    if (!btm_ble_bgconn_find(p_dev_rec->bd_addr, &pending))
+      device.priority = BTM_BLE_RL_PRIO_RECENT;
+    else if (pending)
+      device.priority = BTM_BLE_RL_PRIO_CONNECTING;
+    else
+      device.priority = BTM_BLE_RL_PRIO_BG_CONN;
 
-    BTM_VendorSpecificCommand(HCI_VENDOR_BLE_RPA_VSC, BTM_BLE_META_ADD_IRK_LEN,
-                              param, btm_ble_resolving_list_vsc_op_cmpl);
+    if (device.in_list) capacity++;
+    devices.push_back(device);
   }
 
-  btm_ble_enq_resolving_list_pending(p_dev_rec->bd_addr,
-                                     BTM_BLE_META_ADD_IRK_ENTRY);
+  BleResolvingList::Changes changes =
+      BleResolvingList::Plan(std::move(devices), capacity);
+  BTM_TRACE_DEBUG("%s: remove %zu, add %zu; hits %u, misses %u (%u%%)",
+                  __func__, changes.remove.size(), changes.add.size(),
+                  resolving_list.hits(), resolving_list.misses(),
+                  resolving_list.hit_rate());
+  if (changes.empty()) return;
+
+  if (rl_state && !btm_ble_disable_resolving_list(rl_state, false)) return;
+
+  for (const RawAddress& address : changes.remove) {
+    tBTM_SEC_DEV_REC* p_dev_rec = btm_find_dev(address);
+    btm_ble_update_resolving_list(address, false);
+    btm_ble_remove_resolving_list_entry(p_dev_rec);
+  }
+
+  for (const RawAddress& address : changes.add)
+    btm_ble_add_resolving_list_entry(btm_find_dev(address));
 
   /* if resolving list has been turned on, re-enable it */
   if (rl_state)
     btm_ble_enable_resolving_list(rl_state);
-  else
+  else if (!changes.add.empty())
     btm_ble_enable_resolving_list(BTM_BLE_RL_INIT);
+}
 
-  return true;
+/*******************************************************************************
+ *
+ * Function         btm_ble_resolving_list_resolved
+ *
+ * Description      This function accounts for an RPA of a bonded device
+ *                  resolved by the controller, or on the host when the device
+ *                  was not in the resolving list.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+void btm_ble_resolving_list_resolved(bool by_controller) {
+  if (controller_get_interface()->get_ble_resolving_list_max_size() == 0)
+    return;
+
+  resolving_list.OnResolved(by_controller);
 }
 
 /*******************************************************************************
@@ -886,9 +1024,13 @@ void btm_ble_resolving_list_init(uint8_t max_irk_list_sz) {
       (max_irk_list_sz % 8) ? (max_irk_list_sz / 8 + 1) : (max_irk_list_sz / 8);
 
   if (max_irk_list_sz > 0) {
+    /* Pending operations: a sync may remove and add up to the list size
+     * each */
+    p_q->q_size = std::min(2 * max_irk_list_sz, 0xff);
+    p_q->q_next = p_q->q_pending = 0;
     p_q->resolve_q_random_pseudo =
-        (RawAddress*)osi_malloc(sizeof(RawAddress) * max_irk_list_sz);
-    p_q->resolve_q_action = (uint8_t*)osi_malloc(max_irk_list_sz);
+        (RawAddress*)osi_malloc(sizeof(RawAddress) * p_q->q_size);
+    p_q->resolve_q_action = (uint8_t*)osi_malloc(p_q->q_size);
 
     /* RPA offloading feature */
     if (btm_cb.ble_ctr_cb.irk_list_mask == NULL)
@@ -918,6 +1060,8 @@ void btm_ble_resolving_list_cleanup(void) {
 
   osi_free_and_reset((void**)&p_q->resolve_q_random_pseudo);
   osi_free_and_reset((void**)&p_q->resolve_q_action);
+  p_q->q_size = 0;
+  p_q->q_next = p_q->q_pending = 0;
 
   controller_get_interface()->set_ble_resolving_list_max_size(0);
 
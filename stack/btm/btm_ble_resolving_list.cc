@@ -0,0 +1,50 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  This file contains the choice of the devices kept in the controller
+ *  resolving list, see btm_ble_resolving_list.h.
+ *
+ ******************************************************************************/
+
+#include "btm_ble_resolving_list.h"
+
+#include <algorithm>
+
+BleResolvingList::Changes BleResolvingList::Plan(std::vector<Device> devices,
+                                                 size_t capacity) {
+  std::stable_sort(devices.begin(), devices.end(),
+                   [](const Device& a, const Device& b) {
+                     if (a.priority != b.priority)
+                       return a.priority > b.priority;
+                     if (a.last_used != b.last_used)
+                       return a.last_used > b.last_used;
+                     return a.in_list && !b.in_list;
+                   });
+
+  Changes changes;
+  for (size_t i = 0; i < devices.size(); i++) {
+    bool keep = i < capacity;
+    if (devices[i].in_list && !keep)
+      changes.remove.push_back(devices[i].address);
+    else if (!devices[i].in_list && keep)
+      changes.add.push_back(devices[i].address);
+  }
+  return changes;
+}
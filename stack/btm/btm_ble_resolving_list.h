@@ -0,0 +1,98 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  Choice of the devices kept in the controller resolving list, when there
+ *  are more bonded devices using RPAs than the list has room for. The ones
+ *  left out have their addresses resolved on the host, which is slower and
+ *  keeps them out of white list based connections.
+ *
+ *  The devices go in the list in this order:
+ *  - the ones a connection is pending to, which the controller cannot
+ *    connect to otherwise;
+ *  - the other ones in the background connection list, which reconnect
+ *    when the link goes down;
+ *  - the others, the most recently used first.
+ *  Among equals, the ones already in the list stay there, so that the list
+ *  only changes for a device more important than one in it.
+ *
+ ******************************************************************************/
+#ifndef BTM_BLE_RESOLVING_LIST_H
+#define BTM_BLE_RESOLVING_LIST_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "types/raw_address.h"
+
+/* Why a device is to be in the resolving list, most important last */
+typedef enum : uint8_t {
+  BTM_BLE_RL_PRIO_RECENT = 0,
+  BTM_BLE_RL_PRIO_BG_CONN,
+  BTM_BLE_RL_PRIO_CONNECTING,
+} tBTM_BLE_RL_PRIO;
+
+class BleResolvingList {
+ public:
+  /* A bonded device using RPAs */
+  struct Device {
+    RawAddress address;
+    tBTM_BLE_RL_PRIO priority;
+    uint32_t last_used; /* the higher, the more recent */
+    bool in_list;       /* in the controller list now */
+  };
+
+  /* What to remove from the list, then add to it */
+  struct Changes {
+    std::vector<RawAddress> remove;
+    std::vector<RawAddress> add;
+
+    bool empty() const { return remove.empty() && add.empty(); }
+  };
+
+  /* The changes to the list, which has room for |capacity| of |devices|,
+   * for it to hold the most important of them. */
+  static Changes Plan(std::vector<Device> devices, size_t capacity);
+
+  /* Accounts for an RPA of a bonded device resolved by the controller, or
+   * on the host when the device was not in the list. */
+  void OnResolved(bool by_controller) {
+    if (by_controller)
+      hits_++;
+    else
+      misses_++;
+  }
+
+  uint32_t hits() const { return hits_; }
+  uint32_t misses() const { return misses_; }
+
+  /* Share of the RPAs resolved by the controller, in % */
+  uint8_t hit_rate() const {
+    uint64_t total = (uint64_t)hits_ + misses_;
+    return total == 0 ? 100 : hits_ * 100 / total;
+  }
+
+ private:
+  uint32_t hits_ = 0;
+  uint32_t misses_ = 0;
+};
+
+#endif /* BTM_BLE_RESOLVING_LIST_H */
@@ -0,0 +1,494 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  This file contains the host side advertising packet content filters, see
+ *  btm_ble_soft_filter.h.
+ *
+ ******************************************************************************/
+
+#include "btm_ble_soft_filter.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "bt_types.h"
+#include "btm_api_types.h"
+#include "btm_ble_api_types.h"
+
+using bluetooth::Uuid;
+
+/* AD types not in bt_types.h */
+#define BTM_BLE_AD_TYPE_SOL_SRV_UUID 0x14
+#define BTM_BLE_AD_TYPE_128SOL_SRV_UUID 0x15
+#define BTM_BLE_AD_TYPE_32SOL_SRV_UUID 0x1F
+#define BTM_BLE_AD_TYPE_TDS 0x26
+
+namespace {
+
+/* Features ORed with each other unless the filter logic is AND */
+constexpr uint16_t kPatternFeatures = (1 << BTM_BLE_PF_LOCAL_NAME) |
+                                      (1 << BTM_BLE_PF_MANU_DATA) |
+                                      (1 << BTM_BLE_PF_SRVC_DATA_PATTERN);
+
+constexpr size_t kNumFeatures = BTM_BLE_PF_TYPE_ALL;
+
+/* The Bluetooth base UUID, little endian */
+constexpr Uuid::UUID128Bit kBaseUuidLe = {0xfb, 0x34, 0x9b, 0x5f, 0x80, 0x00,
+                                          0x00, 0x80, 0x00, 0x10, 0x00, 0x00,
+                                          0x00, 0x00, 0x00, 0x00};
+
+uint64_t key_hash(uint8_t type, const uint8_t* p, size_t len) {
+  uint64_t hash = 0xcbf29ce484222325ull ^ type;
+  for (size_t i = 0; i < len; i++) hash = (hash ^ p[i]) * 0x100000001b3ull;
+  return hash;
+}
+
+/* The 128 bit form, little endian, of a UUID of |len| bytes from a report */
+Uuid::UUID128Bit uuid_from_report(const uint8_t* p, size_t len) {
+  Uuid::UUID128Bit uuid;
+  if (len == Uuid::kNumBytes128) {
+    memcpy(uuid.data(), p, len);
+  } else {
+    uuid = kBaseUuidLe;
+    memcpy(uuid.data() + 12, p, len);
+  }
+  return uuid;
+}
+
+/* The size of the UUIDs in a field of |type|, and the filter type they are
+ * matched by in |p_filter_type|, or 0 if the field has no UUIDs */
+size_t uuid_field_len(uint8_t type, uint8_t* p_filter_type) {
+  *p_filter_type = BTM_BLE_PF_SRVC_UUID;
+  switch (type) {
+    case BT_EIR_MORE_16BITS_UUID_TYPE:
+    case BT_EIR_COMPLETE_16BITS_UUID_TYPE:
+      return Uuid::kNumBytes16;
+    case BT_EIR_MORE_32BITS_UUID_TYPE:
+    case BT_EIR_COMPLETE_32BITS_UUID_TYPE:
+      return Uuid::kNumBytes32;
+    case BT_EIR_MORE_128BITS_UUID_TYPE:
+    case BT_EIR_COMPLETE_128BITS_UUID_TYPE:
+      return Uuid::kNumBytes128;
+  }
+
+  *p_filter_type = BTM_BLE_PF_SRVC_SOL_UUID;
+  switch (type) {
+    case BTM_BLE_AD_TYPE_SOL_SRV_UUID:
+      return Uuid::kNumBytes16;
+    case BTM_BLE_AD_TYPE_32SOL_SRV_UUID:
+      return Uuid::kNumBytes32;
+    case BTM_BLE_AD_TYPE_128SOL_SRV_UUID:
+      return Uuid::kNumBytes128;
+  }
+  return 0;
+}
+
+bool is_service_data(uint8_t type) {
+  return type == BT_EIR_SERVICE_DATA_16BITS_UUID_TYPE ||
+         type == BT_EIR_SERVICE_DATA_32BITS_UUID_TYPE ||
+         type == BT_EIR_SERVICE_DATA_128BITS_UUID_TYPE;
+}
+
+/* Whether |data| starts with |pattern|, under |mask| */
+bool pattern_matches(const uint8_t* data, size_t len,
+                     const std::vector<uint8_t>& pattern,
+                     const std::vector<uint8_t>& mask) {
+  if (len < pattern.size()) return false;
+  for (size_t i = 0; i < pattern.size(); i++) {
+    if ((data[i] & mask[i]) != (pattern[i] & mask[i])) return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+BleSoftFilter::BleSoftFilter() {
+  memset(params_.data(), 0, sizeof(params_));
+  Compile();
+}
+
+bool BleSoftFilter::SetParams(int action, uint8_t filt_index,
+                              const btgatt_filt_param_setup_t* p_params) {
+  if (action == BTM_BLE_SCAN_COND_CLEAR) {
+    active_.reset();
+    matchers_.clear();
+    Compile();
+    return true;
+  }
+
+  if (filt_index >= BTM_BLE_SOFT_FILTER_MAX) return false;
+
+  if (action == BTM_BLE_SCAN_COND_ADD) {
+    if (p_params == NULL) return false;
+    Params& params = params_[filt_index];
+    params.feat_seln = p_params->feat_seln;
+    params.list_logic_type = p_params->list_logic_type;
+    params.filt_logic_type = p_params->filt_logic_type;
+    params.rssi_high_thres = (int8_t)p_params->rssi_high_thres;
+    active_.set(filt_index);
+  } else {
+    active_.reset(filt_index);
+  }
+  Compile();
+  return true;
+}
+
+bool BleSoftFilter::AddConditions(uint8_t filt_index,
+                                  const std::vector<ApcfCommand>& commands) {
+  if (filt_index >= BTM_BLE_SOFT_FILTER_MAX) return false;
+
+  for (const ApcfCommand& cmd : commands) {
+    /* If data is passed, both mask and data have to be the same length */
+    if (cmd.data.size() != cmd.data_mask.size() && cmd.data.size() != 0 &&
+        cmd.data_mask.size() != 0)
+      continue;
+
+    Matcher matcher;
+    matcher.filt_index = filt_index;
+    matcher.type = cmd.type;
+    matcher.keyed = true;
+
+    switch (cmd.type) {
+      case BTM_BLE_PF_ADDR_FILTER:
+        matcher.key.assign(cmd.address.address,
+                           cmd.address.address + RawAddress::kLength);
+        break;
+
+      case BTM_BLE_PF_SRVC_DATA:
+        matcher.keyed = false;
+        break;
+
+      case BTM_BLE_PF_SRVC_UUID:
+      case BTM_BLE_PF_SRVC_SOL_UUID: {
+        const Uuid::UUID128Bit uuid = cmd.uuid.To128BitLE();
+        matcher.key.assign(uuid.begin(), uuid.end());
+        if (cmd.uuid_mask.IsEmpty()) break;
+
+        /* As sent to the controller: a mask of the size of the UUID */
+        Uuid::UUID128Bit mask;
+        mask.fill(0xff);
+        size_t uuid_len = cmd.uuid.GetShortestRepresentationSize();
+        if (uuid_len == Uuid::kNumBytes16) {
+          uint16_t mask16 = cmd.uuid_mask.As16Bit();
+          mask[12] = mask16 & 0xff;
+          mask[13] = mask16 >> 8;
+        } else if (uuid_len == Uuid::kNumBytes32) {
+          uint32_t mask32 = cmd.uuid_mask.As32Bit();
+          for (int i = 0; i < 4; i++) mask[12 + i] = mask32 >> (8 * i);
+        } else {
+          mask = cmd.uuid_mask.To128BitLE();
+        }
+        if (std::all_of(mask.begin(), mask.end(),
+                        [](uint8_t b) { return b == 0xff; }))
+          break;
+        matcher.keyed = false;
+        matcher.key_mask.assign(mask.begin(), mask.end());
+        break;
+      }
+
+      case BTM_BLE_PF_LOCAL_NAME:
+        matcher.key.assign(
+            cmd.name.begin(),
+            cmd.name.begin() +
+                std::min(cmd.name.size(), (size_t)BTM_BLE_PF_STR_LEN_MAX));
+        break;
+
+      case BTM_BLE_PF_MANU_DATA: {
+        matcher.key = {(uint8_t)cmd.company, (uint8_t)(cmd.company >> 8)};
+        if (cmd.company_mask != 0 && cmd.company_mask != 0xffff) {
+          matcher.keyed = false;
+          matcher.key_mask = {(uint8_t)cmd.company_mask,
+                              (uint8_t)(cmd.company_mask >> 8)};
+        }
+        if (cmd.data_mask.size() != 0) {
+          size_t size =
+              std::min(cmd.data.size(), (size_t)(BTM_BLE_PF_STR_LEN_MAX - 2));
+          matcher.data.assign(cmd.data.begin(), cmd.data.begin() + size);
+          matcher.mask.assign(cmd.data_mask.begin(),
+                              cmd.data_mask.begin() + size);
+        }
+        break;
+      }
+
+      case BTM_BLE_PF_SRVC_DATA_PATTERN: {
+        size_t size =
+            std::min(cmd.data.size(), (size_t)(BTM_BLE_PF_STR_LEN_MAX - 2));
+        matcher.data.assign(cmd.data.begin(), cmd.data.begin() + size);
+        if (cmd.data_mask.size() != 0)
+          matcher.mask.assign(cmd.data_mask.begin(),
+                              cmd.data_mask.begin() + size);
+        else
+          matcher.mask.assign(size, 0xff);
+        /* Keyed by the 16 bit UUID the data starts with, when unmasked */
+        if (size >= 2 && matcher.mask[0] == 0xff && matcher.mask[1] == 0xff)
+          matcher.key.assign(matcher.data.begin(), matcher.data.begin() + 2);
+        else
+          matcher.keyed = false;
+        break;
+      }
+
+      case BTM_BLE_PF_TDS_DATA:
+        matcher.keyed = false;
+        matcher.key = {cmd.org_id, cmd.tds_flags};
+        matcher.key_mask = {0xff, cmd.tds_flags_mask};
+        break;
+
+      default:
+        continue;
+    }
+    matchers_.push_back(std::move(matcher));
+  }
+
+  Compile();
+  return true;
+}
+
+void BleSoftFilter::ClearConditions(uint8_t filt_index) {
+  matchers_.erase(std::remove_if(matchers_.begin(), matchers_.end(),
+                                 [filt_index](const Matcher& matcher) {
+                                   return matcher.filt_index == filt_index;
+                                 }),
+                  matchers_.end());
+  Compile();
+}
+
+/* Works out the lookup tables and the bit sets of the filters, when the
+ * filters change */
+void BleSoftFilter::Compile() {
+  keyed_.clear();
+  unkeyed_.clear();
+  for (FilterSet& need : need_) need.reset();
+  num_needed_.assign(BTM_BLE_SOFT_FILTER_MAX, {});
+
+  for (size_t i = 0; i < matchers_.size(); i++) {
+    const Matcher& matcher = matchers_[i];
+    if (!active_[matcher.filt_index] ||
+        !(params_[matcher.filt_index].feat_seln & (1 << matcher.type)))
+      continue;
+
+    if (matcher.keyed) {
+      keyed_[key_hash(matcher.type, matcher.key.data(), matcher.key.size())]
+          .push_back(i);
+    } else {
+      unkeyed_.push_back(i);
+    }
+    need_[matcher.type].set(matcher.filt_index);
+    num_needed_[matcher.filt_index][matcher.type]++;
+  }
+
+  need_pattern_.reset();
+  pattern_or_.reset();
+  for (size_t type = 0; type < kNumFeatures; type++) {
+    need_[type] &= active_;
+    if (kPatternFeatures & (1 << type)) need_pattern_ |= need_[type];
+  }
+  for (size_t f = 0; f < BTM_BLE_SOFT_FILTER_MAX; f++) {
+    if (active_[f] && params_[f].filt_logic_type != BTM_BLE_PF_LOGIC_AND)
+      pattern_or_.set(f);
+  }
+
+  for (int rssi = -128; rssi < 128; rssi++) {
+    FilterSet& pass = rssi_pass_[(uint8_t)rssi];
+    pass.reset();
+    for (size_t f = 0; f < BTM_BLE_SOFT_FILTER_MAX; f++) {
+      if (active_[f] && rssi >= params_[f].rssi_high_thres) pass.set(f);
+    }
+  }
+
+  matcher_stamp_.assign(matchers_.size(), stamp_);
+  hits_.assign(BTM_BLE_SOFT_FILTER_MAX, {});
+  touched_.clear();
+}
+
+/* Counts a condition matched by the report, once */
+void BleSoftFilter::Hit(size_t matcher_index) {
+  if (matcher_stamp_[matcher_index] == stamp_) return;
+  matcher_stamp_[matcher_index] = stamp_;
+
+  const Matcher& matcher = matchers_[matcher_index];
+  if (hits_[matcher.filt_index][matcher.type]++ == 0)
+    touched_.push_back(matcher.filt_index * kNumFeatures + matcher.type);
+}
+
+/* Looks up the conditions of |type| keyed by a field of the report */
+void BleSoftFilter::Lookup(uint8_t type, const uint8_t* p_key, size_t key_len,
+                           const uint8_t* p_data, size_t data_len) {
+  auto it = keyed_.find(key_hash(type, p_key, key_len));
+  if (it == keyed_.end()) return;
+
+  for (uint16_t i : it->second) {
+    const Matcher& matcher = matchers_[i];
+    if (matcher.type != type || matcher.key.size() != key_len ||
+        memcmp(matcher.key.data(), p_key, key_len) != 0)
+      continue;
+    if (!pattern_matches(p_data, data_len, matcher.data, matcher.mask))
+      continue;
+    Hit(i);
+  }
+}
+
+/* Checks a condition with a mask on its key against the report */
+bool BleSoftFilter::MatchesUnkeyed(const Matcher& matcher) const {
+  for (const Field& field : fields_) {
+    switch (matcher.type) {
+      case BTM_BLE_PF_SRVC_UUID:
+      case BTM_BLE_PF_SRVC_SOL_UUID: {
+        uint8_t filter_type;
+        size_t uuid_len = uuid_field_len(field.type, &filter_type);
+        if (uuid_len == 0 || filter_type != matcher.type) break;
+        for (size_t i = 0; i + uuid_len <= field.len; i += uuid_len) {
+          Uuid::UUID128Bit uuid = uuid_from_report(field.p + i, uuid_len);
+          if (pattern_matches(uuid.data(), uuid.size(), matcher.key,
+                              matcher.key_mask))
+            return true;
+        }
+        break;
+      }
+
+      case BTM_BLE_PF_SRVC_DATA:
+        if (is_service_data(field.type)) return true;
+        break;
+
+      case BTM_BLE_PF_MANU_DATA:
+        if (field.type == BT_EIR_MANUFACTURER_SPECIFIC_TYPE &&
+            pattern_matches(field.p, field.len, matcher.key,
+                            matcher.key_mask) &&
+            pattern_matches(field.p + 2, field.len - 2, matcher.data,
+                            matcher.mask))
+          return true;
+        break;
+
+      case BTM_BLE_PF_SRVC_DATA_PATTERN:
+        if (is_service_data(field.type) &&
+            pattern_matches(field.p, field.len, matcher.data, matcher.mask))
+          return true;
+        break;
+
+      case BTM_BLE_PF_TDS_DATA:
+        if (field.type == BTM_BLE_AD_TYPE_TDS &&
+            pattern_matches(field.p, field.len, matcher.key, matcher.key_mask))
+          return true;
+        break;
+    }
+  }
+  return false;
+}
+
+bool BleSoftFilter::Matches(const RawAddress& bda, int8_t rssi,
+                            const uint8_t* data, size_t len) {
+  if (!enabled_) return true;
+
+  FilterSet pass = rssi_pass_[(uint8_t)rssi];
+  if (pass.none()) return false;
+
+  /* Stamps matchers as hit by this report */
+  if (++stamp_ == 0) {
+    std::fill(matcher_stamp_.begin(), matcher_stamp_.end(), 0);
+    stamp_ = 1;
+  }
+
+  /* Look up the keyed conditions with the fields of the report, walked as
+   * AdvertiseDataParser::GetFieldByType() does */
+  fields_.clear();
+  const uint8_t* p_name = NULL;
+  uint8_t name_len = 0;
+  bool complete_name = false;
+  size_t position = 0;
+  while (data != NULL && position < len) {
+    uint8_t field_len = data[position];
+    if (field_len == 0 || position + field_len >= len) break;
+
+    uint8_t type = data[position + 1];
+    const uint8_t* p = data + position + 2;
+    uint8_t value_len = field_len - 1;
+    if (!unkeyed_.empty()) fields_.push_back({type, value_len, p});
+
+    uint8_t uuid_filter;
+    size_t uuid_len = uuid_field_len(type, &uuid_filter);
+    switch (type) {
+      case BT_EIR_SHORTENED_LOCAL_NAME_TYPE:
+        if (!complete_name && p_name == NULL) {
+          p_name = p;
+          name_len = value_len;
+        }
+        break;
+      case BT_EIR_COMPLETE_LOCAL_NAME_TYPE:
+        if (!complete_name) {
+          p_name = p;
+          name_len = value_len;
+          complete_name = true;
+        }
+        break;
+
+      case BT_EIR_MANUFACTURER_SPECIFIC_TYPE:
+        if (value_len >= 2)
+          Lookup(BTM_BLE_PF_MANU_DATA, p, 2, p + 2, value_len - 2);
+        break;
+    }
+    if (is_service_data(type) && value_len >= 2)
+      Lookup(BTM_BLE_PF_SRVC_DATA_PATTERN, p, 2, p, value_len);
+
+    if (uuid_len != 0) {
+      for (size_t i = 0; i + uuid_len <= value_len; i += uuid_len) {
+        Uuid::UUID128Bit uuid = uuid_from_report(p + i, uuid_len);
+        Lookup(uuid_filter, uuid.data(), uuid.size(), NULL, 0);
+      }
+    }
+
+    position += field_len + 1;
+  }
+
+  Lookup(BTM_BLE_PF_ADDR_FILTER, bda.address, RawAddress::kLength, NULL, 0);
+  if (p_name != NULL)
+    Lookup(BTM_BLE_PF_LOCAL_NAME, p_name,
+           std::min(name_len, (uint8_t)BTM_BLE_PF_STR_LEN_MAX), NULL, 0);
+
+  for (uint16_t i : unkeyed_) {
+    if (MatchesUnkeyed(matchers_[i])) Hit(i);
+  }
+
+  /* The conditions of each feature matched by the report */
+  std::array<FilterSet, kNumFeatures> matched;
+  for (uint16_t hit : touched_) {
+    size_t f = hit / kNumFeatures;
+    size_t type = hit % kNumFeatures;
+    uint8_t num_hits = hits_[f][type];
+    hits_[f][type] = 0;
+    if ((params_[f].list_logic_type & (1 << type)) ? num_hits ==
+                                                         num_needed_[f][type]
+                                                   : num_hits > 0)
+      matched[type].set(f);
+  }
+  touched_.clear();
+
+  FilterSet pattern_matched;
+  for (size_t type = 0; type < kNumFeatures; type++) {
+    if (kPatternFeatures & (1 << type)) {
+      pass &= matched[type] | ~need_[type] | pattern_or_;
+      pattern_matched |= matched[type];
+    } else {
+      pass &= matched[type] | ~need_[type];
+    }
+  }
+  pass &= pattern_matched | ~(need_pattern_ & pattern_or_);
+
+  return pass.any();
+}
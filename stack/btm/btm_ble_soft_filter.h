@@ -0,0 +1,149 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  Host side Advertising Packet Content Filter (APCF), for controllers which
+ *  do not filter the advertising reports themselves. It is configured with
+ *  the same commands as the controller filters, and follows their semantics:
+ *
+ *  - a filter index has parameters (the features selected, the list and
+ *    filter logic, the RSSI threshold) and conditions of each feature;
+ *  - the conditions of a feature are ORed, or ANDed if its bit is set in the
+ *    list logic;
+ *  - the features selected must all match, except the local name,
+ *    manufacturer data and service data patterns which are ORed unless the
+ *    filter logic is AND;
+ *  - a report is delivered if any filter matches it, or if filtering is
+ *    disabled.
+ *
+ *  The conditions are compiled when they change: the ones matching exact
+ *  addresses, UUIDs, names, company IDs or service data UUIDs are kept in a
+ *  hash table, looked up with the fields of each report, and the result of
+ *  each filter is worked out with bit sets, so that the cost of a report
+ *  depends on its fields rather than on the number of filters.
+ *
+ ******************************************************************************/
+#ifndef BTM_BLE_SOFT_FILTER_H
+#define BTM_BLE_SOFT_FILTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <array>
+#include <bitset>
+#include <unordered_map>
+#include <vector>
+
+#include <hardware/bt_common_types.h>
+
+#include "types/raw_address.h"
+
+/* Filter indexes handled by the host filters */
+#ifndef BTM_BLE_SOFT_FILTER_MAX
+#define BTM_BLE_SOFT_FILTER_MAX 128
+#endif
+
+class BleSoftFilter {
+ public:
+  BleSoftFilter();
+
+  /* As BTM_BleAdvFilterParamSetup(): adds or deletes the parameters of
+   * |filt_index|, or clears all the filters. Returns false if the filter
+   * index is not valid. */
+  bool SetParams(int action, uint8_t filt_index,
+                 const btgatt_filt_param_setup_t* p_params);
+
+  /* As BTM_LE_PF_set(): adds conditions to |filt_index|. */
+  bool AddConditions(uint8_t filt_index,
+                     const std::vector<ApcfCommand>& commands);
+
+  /* As BTM_LE_PF_clear(): removes the conditions of |filt_index|. */
+  void ClearConditions(uint8_t filt_index);
+
+  void Enable(bool enable) { enabled_ = enable; }
+  bool enabled() const { return enabled_; }
+
+  /* Returns true if the report of |bda| with advertising |data| passes the
+   * filters. */
+  bool Matches(const RawAddress& bda, int8_t rssi, const uint8_t* data,
+               size_t len);
+
+  size_t num_filters() const { return active_.count(); }
+  size_t num_conditions() const { return matchers_.size(); }
+
+ private:
+  typedef std::bitset<BTM_BLE_SOFT_FILTER_MAX> FilterSet;
+
+  /* One condition of a filter */
+  struct Matcher {
+    uint8_t filt_index;
+    uint8_t type;             /* BTM_BLE_PF_* */
+    bool keyed;               /* looked up by |key| in |keyed_| */
+    std::vector<uint8_t> key; /* address, UUID (128 bits LE), name, company
+                                 ID or service data UUID */
+    std::vector<uint8_t> key_mask; /* of a UUID or a company ID not keyed */
+    std::vector<uint8_t> data;     /* pattern following the key */
+    std::vector<uint8_t> mask;
+  };
+
+  struct Params {
+    uint16_t feat_seln;
+    uint16_t list_logic_type;
+    uint8_t filt_logic_type;
+    int8_t rssi_high_thres;
+  };
+
+  /* A field of the report being filtered */
+  struct Field {
+    uint8_t type;
+    uint8_t len;
+    const uint8_t* p;
+  };
+
+  void Compile();
+  void Lookup(uint8_t type, const uint8_t* p_key, size_t key_len,
+              const uint8_t* p_data, size_t data_len);
+  void Hit(size_t matcher_index);
+  bool MatchesUnkeyed(const Matcher& matcher) const;
+
+  bool enabled_ = false;
+  FilterSet active_; /* filters with parameters */
+  std::array<Params, BTM_BLE_SOFT_FILTER_MAX> params_;
+  std::vector<Matcher> matchers_;
+
+  /* Compiled from the above */
+  std::unordered_map<uint64_t, std::vector<uint16_t>> keyed_;
+  std::vector<uint16_t> unkeyed_;
+  std::array<FilterSet, 8> need_;     /* filters with conditions to match,
+                                         for each feature */
+  FilterSet need_pattern_;            /* ... for any pattern feature */
+  FilterSet pattern_or_;              /* filters ORing the pattern features */
+  std::array<FilterSet, 256> rssi_pass_; /* for each RSSI */
+  std::vector<std::array<uint8_t, 8>> num_needed_; /* conditions to match of
+                                                      each feature */
+
+  /* State of the report being filtered */
+  std::vector<Field> fields_;
+  std::vector<uint32_t> matcher_stamp_;
+  uint32_t stamp_ = 0;
+  std::vector<std::array<uint8_t, 8>> hits_;
+  std::vector<uint16_t> touched_;
+};
+
+#endif /* BTM_BLE_SOFT_FILTER_H */
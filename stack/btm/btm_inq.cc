@@ -120,7 +120,7 @@ static void btm_clr_inq_result_flt(void);
 
 static uint8_t btm_convert_uuid_to_eir_service(uint16_t uuid16);
 static void btm_set_eir_uuid(uint8_t* p_eir, tBTM_INQ_RESULTS* p_results);
-static const uint8_t* btm_eir_get_uuid_list(uint8_t* p_eir, size_t eir_len,
+static const uint8_t* btm_eir_get_uuid_list(const AdvertiseDataIndex& eir,
                                             uint8_t uuid_size,
                                             uint8_t* p_num_uuid,
                                             uint8_t* p_uuid_list_type);
@@ -2493,8 +2493,8 @@ uint8_t BTM_GetEirUuidList(uint8_t* p_eir, size_t eir_len, uint8_t uuid_size,
   uint32_t* p_uuid32 = (uint32_t*)p_uuid_list;
   char buff[Uuid::kNumBytes128 * 2 + 1];
 
-  p_uuid_data =
-      btm_eir_get_uuid_list(p_eir, eir_len, uuid_size, p_num_uuid, &type);
+  AdvertiseDataIndex eir(p_eir, eir_len);
+  p_uuid_data = btm_eir_get_uuid_list(eir, uuid_size, p_num_uuid, &type);
   if (p_uuid_data == NULL) {
     return 0x00;
   }
@@ -2537,8 +2537,7 @@ uint8_t BTM_GetEirUuidList(uint8_t* p_eir, size_t eir_len, uint8_t uuid_size,
  *
  * Description      This function searches UUID list in EIR.
  *
- * Parameters       p_eir - address of EIR
- *                  eir_len - EIR length
+ * Parameters       eir - index of the EIR fields
  *                  uuid_size - size of UUID to find
  *                  p_num_uuid - number of UUIDs found
  *                  p_uuid_list_type - EIR data type
@@ -2547,7 +2546,7 @@ uint8_t BTM_GetEirUuidList(uint8_t* p_eir, size_t eir_len, uint8_t uuid_size,
  *                  beginning of UUID list in EIR - otherwise
  *
  ******************************************************************************/
-static const uint8_t* btm_eir_get_uuid_list(uint8_t* p_eir, size_t eir_len,
+static const uint8_t* btm_eir_get_uuid_list(const AdvertiseDataIndex& eir,
                                             uint8_t uuid_size,
                                             uint8_t* p_num_uuid,
                                             uint8_t* p_uuid_list_type) {
@@ -2574,15 +2573,8 @@ static const uint8_t* btm_eir_get_uuid_list(uint8_t* p_eir, size_t eir_len,
       break;
   }
 
-  p_uuid_data = AdvertiseDataParser::GetFieldByType(p_eir, eir_len,
-                                                    complete_type, &uuid_len);
-  if (p_uuid_data == NULL) {
-    p_uuid_data = AdvertiseDataParser::GetFieldByType(p_eir, eir_len, more_type,
-                                                      &uuid_len);
-    *p_uuid_list_type = more_type;
-  } else {
-    *p_uuid_list_type = complete_type;
-  }
+  p_uuid_data = eir.GetFieldByType(complete_type, more_type, &uuid_len,
+                                   p_uuid_list_type);
 
   *p_num_uuid = uuid_len / uuid_size;
   return p_uuid_data;
@@ -2663,9 +2655,10 @@ void btm_set_eir_uuid(uint8_t* p_eir, tBTM_INQ_RESULTS* p_results) {
   uint16_t uuid16;
   uint8_t yy;
   uint8_t type = BTM_EIR_MORE_16BITS_UUID_TYPE;
+  AdvertiseDataIndex eir(p_eir, HCI_EXT_INQ_RESPONSE_LEN);
 
-  p_uuid_data = btm_eir_get_uuid_list(p_eir, HCI_EXT_INQ_RESPONSE_LEN,
-                                      Uuid::kNumBytes16, &num_uuid, &type);
+  p_uuid_data =
+      btm_eir_get_uuid_list(eir, Uuid::kNumBytes16, &num_uuid, &type);
 
   if (type == BTM_EIR_COMPLETE_16BITS_UUID_TYPE) {
     p_results->eir_complete_list = true;
@@ -2683,8 +2676,8 @@ void btm_set_eir_uuid(uint8_t* p_eir, tBTM_INQ_RESULTS* p_results) {
     }
   }
 
-  p_uuid_data = btm_eir_get_uuid_list(p_eir, HCI_EXT_INQ_RESPONSE_LEN,
-                                      Uuid::kNumBytes32, &num_uuid, &type);
+  p_uuid_data =
+      btm_eir_get_uuid_list(eir, Uuid::kNumBytes32, &num_uuid, &type);
   if (p_uuid_data) {
     for (yy = 0; yy < num_uuid; yy++) {
       uuid16 = btm_convert_uuid_to_uuid16(p_uuid_data, Uuid::kNumBytes32);
@@ -2693,8 +2686,8 @@ void btm_set_eir_uuid(uint8_t* p_eir, tBTM_INQ_RESULTS* p_results) {
     }
   }
 
-  p_uuid_data = btm_eir_get_uuid_list(p_eir, HCI_EXT_INQ_RESPONSE_LEN,
-                                      Uuid::kNumBytes128, &num_uuid, &type);
+  p_uuid_data =
+      btm_eir_get_uuid_list(eir, Uuid::kNumBytes128, &num_uuid, &type);
   if (p_uuid_data) {
     for (yy = 0; yy < num_uuid; yy++) {
       uuid16 = btm_convert_uuid_to_uuid16(p_uuid_data, Uuid::kNumBytes128);
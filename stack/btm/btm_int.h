@@ -91,6 +91,10 @@ extern void btm_cont_rswitch(tACL_CONN* p, tBTM_SEC_DEV_REC* p_dev_rec,
                              uint8_t hci_status);
 
 extern uint8_t btm_handle_to_acl_index(uint16_t hci_handle);
+extern void btm_acl_index_init(void);
+extern void btm_acl_index_add(uint8_t xx);
+extern void btm_acl_index_remove(uint8_t xx);
+extern void btm_acl_index_set_handle(uint8_t xx, uint16_t hci_handle);
 extern void btm_read_link_policy_complete(uint8_t* p);
 
 extern void btm_read_rssi_timeout(void* data);
@@ -136,6 +140,8 @@ extern void btm_acl_chk_peer_pkt_type_support(tACL_CONN* p,
 extern uint16_t btm_get_max_packet_size(const RawAddress& addr);
 extern tACL_CONN* btm_bda_to_acl(const RawAddress& bda,
                                  tBT_TRANSPORT transport);
+extern uint8_t btm_bda_to_acl_index(const RawAddress& bda,
+                                    tBT_TRANSPORT transport);
 extern bool btm_acl_notif_conn_collision(const RawAddress& bda);
 extern void btm_acl_update_conn_addr(uint16_t conn_handle,
                                      const RawAddress& address);
@@ -146,6 +152,8 @@ extern void btm_pm_proc_cmd_status(uint8_t status);
 extern void btm_pm_proc_mode_change(uint8_t hci_status, uint16_t hci_handle,
                                     uint8_t mode, uint16_t interval);
 extern void btm_pm_proc_ssr_evt(uint8_t* p, uint16_t evt_len);
+extern void btm_pm_proc_acl_traffic(uint16_t hci_handle, bool is_tx,
+                                    uint16_t len);
 extern bool btm_pm_is_mode_pend_link(uint16_t hci_handle);
 extern tBTM_STATUS btm_read_power_mode_state(const RawAddress& remote_bda,
                                              tBTM_PM_STATE* pmState);
@@ -198,6 +206,8 @@ extern tBTM_STATUS btm_ble_read_resolving_list_entry(
     tBTM_SEC_DEV_REC* p_dev_rec);
 extern bool btm_ble_resolving_list_load_dev(tBTM_SEC_DEV_REC* p_dev_rec);
 extern void btm_ble_resolving_list_remove_dev(tBTM_SEC_DEV_REC* p_dev_rec);
+extern void btm_ble_resolving_list_sync(void);
+extern void btm_ble_resolving_list_resolved(bool by_controller);
 extern bool btm_ble_resolving_list_load_devices_rpa_offload(void);
 
 /* Vendor Specific Command complete evt handler */
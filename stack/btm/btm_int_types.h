@@ -703,6 +703,7 @@ typedef struct {
 #endif
   tBTM_PM_STATE state; /* contains the current mode of the connection */
   bool chg_ind;        /* a request change indication */
+  tBTM_PM_TRAFFIC traffic; /* ACL traffic of the connection */
 } tBTM_PM_MCB;
 
 #define BTM_PM_REC_NOT_USED 0
@@ -40,12 +40,14 @@
 #include "bt_utils.h"
 #include "btm_api.h"
 #include "btm_int.h"
+#include "btm_pm_policy.h"
 #include "btu.h"
 #include "hcidefs.h"
 #include "hcimsgs.h"
 #include "l2c_int.h"
 #include "osi/include/log.h"
 #include "osi/include/osi.h"
+#include "osi/include/time.h"
 
 /*****************************************************************************/
 /*      to handle different modes                                            */
@@ -300,6 +302,32 @@ tBTM_STATUS btm_read_power_mode_state(const RawAddress& remote_bda,
   return BTM_SUCCESS;
 }
 
+/*******************************************************************************
+ *
+ * Function         BTM_ReadAclTraffic
+ *
+ * Description      This returns the ACL traffic seen so far on the BR/EDR
+ *                  connection to a device.
+ *
+ * Input Param      remote_bda - device address of desired ACL connection
+ *
+ * Output Param     p_traffic - address where the traffic is copied into.
+ *                          (valid only if return code is BTM_SUCCESS)
+ *
+ * Returns          BTM_SUCCESS if successful,
+ *                  BTM_UNKNOWN_ADDR if bd addr is not active or bad
+ *
+ ******************************************************************************/
+tBTM_STATUS BTM_ReadAclTraffic(const RawAddress& remote_bda,
+                               tBTM_PM_TRAFFIC* p_traffic) {
+  int acl_ind = btm_pm_find_acl_ind(remote_bda);
+
+  if (acl_ind == MAX_L2CAP_LINKS) return (BTM_UNKNOWN_ADDR);
+
+  *p_traffic = btm_cb.pm_mode_db[acl_ind].traffic;
+  return BTM_SUCCESS;
+}
+
 /*******************************************************************************
  *
  * Function         BTM_SetSsrParams
@@ -405,19 +433,13 @@ void btm_pm_sm_alloc(uint8_t ind) {
  *
  ******************************************************************************/
 static int btm_pm_find_acl_ind(const RawAddress& remote_bda) {
-  tACL_CONN* p = &btm_cb.acl_db[0];
-  uint8_t xx;
+  uint8_t xx = btm_bda_to_acl_index(remote_bda, BT_TRANSPORT_BR_EDR);
 
-  for (xx = 0; xx < MAX_L2CAP_LINKS; xx++, p++) {
-    if (p->in_use && p->remote_addr == remote_bda &&
-        p->transport == BT_TRANSPORT_BR_EDR) {
 #if (BTM_PM_DEBUG == TRUE)
-      BTM_TRACE_DEBUG("btm_pm_find_acl_ind ind:%d, st:%d", xx,
-                      btm_cb.pm_mode_db[xx].state);
+  if (xx < MAX_L2CAP_LINKS)
+    BTM_TRACE_DEBUG("btm_pm_find_acl_ind ind:%d, st:%d", xx,
+                    btm_cb.pm_mode_db[xx].state);
 #endif  // BTM_PM_DEBUG
-      break;
-    }
-  }
   return xx;
 }
 
@@ -887,6 +909,25 @@ void btm_pm_proc_ssr_evt(uint8_t* p, UNUSED_ATTR uint16_t evt_len) {
 }
 #endif  // BTM_SSR_INCLUDED
 
+/*******************************************************************************
+ *
+ * Function         btm_pm_proc_acl_traffic
+ *
+ * Description      This function is called for each ACL packet sent or
+ *                  received on a BR/EDR link, to feed the traffic estimator
+ *                  of the power mode policy.
+ *
+ * Returns          none.
+ *
+ ******************************************************************************/
+void btm_pm_proc_acl_traffic(uint16_t hci_handle, bool is_tx, uint16_t len) {
+  uint8_t xx = btm_handle_to_acl_index(hci_handle);
+  if (xx >= MAX_L2CAP_LINKS) return;
+
+  btm_pm_traffic_update(&btm_cb.pm_mode_db[xx].traffic, is_tx, len,
+                        time_get_os_boottime_ms());
+}
+
 /*******************************************************************************
  *
  * Function         btm_pm_is_mode_pend_link
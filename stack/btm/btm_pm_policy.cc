@@ -0,0 +1,246 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/*****************************************************************************
+ *
+ *  This file contains the traffic-aware power mode policy: the traffic
+ *  estimator fed by the ACL data path, and the adjustments of the idle
+ *  timeout and sniff parameters the profiles ask for.
+ *
+ *  The adjustments stay within the profile limits: sniff intervals stay
+ *  within the interval range of the profile, subrating latency never exceeds
+ *  the profile one, and idle timeouts only move within
+ *  [BTM_PM_POLICY_MIN_TIMEOUT_MS, BTM_PM_POLICY_MAX_TIMEOUT_MS].
+ *
+ *****************************************************************************/
+
+#include "btm_pm_policy.h"
+
+/* Weight of a new sample in the averages, as a shift */
+#define BTM_PM_TRAFFIC_AVG_SHIFT 3
+
+/* Milliseconds to baseband slots of 0.625 ms */
+#define BTM_PM_MS_TO_SLOTS(ms) ((uint32_t)(ms)*8 / 5)
+
+static uint32_t btm_pm_traffic_avg(uint32_t avg, uint32_t sample) {
+  if (avg == 0) return sample;
+  return (((uint64_t)avg << BTM_PM_TRAFFIC_AVG_SHIFT) - avg + sample) >>
+         BTM_PM_TRAFFIC_AVG_SHIFT;
+}
+
+/*******************************************************************************
+ *
+ * Function         btm_pm_traffic_update
+ *
+ * Description      Accounts for a packet of |len| bytes sent or received on a
+ *                  link at |now_ms|.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+void btm_pm_traffic_update(tBTM_PM_TRAFFIC* p_traffic, bool is_tx,
+                           uint16_t len, uint32_t now_ms) {
+  uint32_t pkts = p_traffic->tx_pkts + p_traffic->rx_pkts;
+
+  if (is_tx) {
+    p_traffic->tx_pkts++;
+    p_traffic->tx_bytes += len;
+  } else {
+    p_traffic->rx_pkts++;
+    p_traffic->rx_bytes += len;
+  }
+
+  p_traffic->pkt_len = btm_pm_traffic_avg(p_traffic->pkt_len, len);
+
+  if (pkts == 0) {
+    p_traffic->bursts = 1;
+  } else {
+    uint32_t gap_ms = now_ms - p_traffic->last_pkt_ms;
+    if (gap_ms >= BTM_PM_TRAFFIC_BURST_GAP_MS) {
+      p_traffic->bursts++;
+      p_traffic->burst_gap_ms =
+          btm_pm_traffic_avg(p_traffic->burst_gap_ms, gap_ms);
+    } else {
+      /* 0 ms gaps still count, as 1 ms */
+      p_traffic->gap_ms =
+          btm_pm_traffic_avg(p_traffic->gap_ms, gap_ms ? gap_ms : 1);
+    }
+  }
+  p_traffic->last_pkt_ms = now_ms;
+}
+
+/*******************************************************************************
+ *
+ * Function         btm_pm_policy_classify
+ *
+ * Description      Tells the kind of traffic of a link at |now_ms|.
+ *
+ * Returns          the class of traffic
+ *
+ ******************************************************************************/
+tBTM_PM_TRAFFIC_CLASS btm_pm_policy_classify(const tBTM_PM_TRAFFIC* p_traffic,
+                                             uint32_t now_ms) {
+  if (p_traffic->tx_pkts + p_traffic->rx_pkts == 0 ||
+      now_ms - p_traffic->last_pkt_ms >= BTM_PM_POLICY_IDLE_MS)
+    return BTM_PM_TRAFFIC_IDLE;
+
+  if (p_traffic->pkt_len >= BTM_PM_POLICY_BULK_LEN) return BTM_PM_TRAFFIC_BULK;
+
+  /* A single burst so far has no gap between bursts yet */
+  if (p_traffic->pkt_len <= BTM_PM_POLICY_INTERACTIVE_LEN &&
+      p_traffic->bursts > 1 &&
+      p_traffic->burst_gap_ms < BTM_PM_POLICY_INTERACTIVE_BURST_GAP_MS)
+    return BTM_PM_TRAFFIC_INTERACTIVE;
+
+  return BTM_PM_TRAFFIC_BURSTY;
+}
+
+/*******************************************************************************
+ *
+ * Function         btm_pm_policy_timeout
+ *
+ * Description      Adjusts the idle timeout a profile asked for before
+ *                  entering sniff mode.
+ *                  Interactive traffic keeps the link active for longer, up to
+ *                  twice the timeout. A link entering sniff mode too soon
+ *                  would add the sniff interval to the latency of the next
+ *                  interaction.
+ *                  An ended bulk transfer, an idle link, or bursts rarer than
+ *                  the timeout enter sniff mode sooner: staying active after
+ *                  the last packet does not help there.
+ *
+ * Returns          the timeout to use, in milliseconds
+ *
+ ******************************************************************************/
+uint32_t btm_pm_policy_timeout(tBTM_PM_TRAFFIC_CLASS traffic_class,
+                               const tBTM_PM_TRAFFIC* p_traffic,
+                               uint32_t now_ms, uint32_t timeout_ms) {
+  uint32_t adjusted_ms = timeout_ms;
+
+  switch (traffic_class) {
+    case BTM_PM_TRAFFIC_INTERACTIVE:
+      adjusted_ms = timeout_ms * 2;
+      if (adjusted_ms > BTM_PM_POLICY_MAX_TIMEOUT_MS)
+        adjusted_ms = BTM_PM_POLICY_MAX_TIMEOUT_MS;
+      if (adjusted_ms < timeout_ms) adjusted_ms = timeout_ms;
+      return adjusted_ms;
+
+    case BTM_PM_TRAFFIC_BULK:
+      /* Still transferring */
+      if (now_ms - p_traffic->last_pkt_ms < BTM_PM_TRAFFIC_BURST_GAP_MS)
+        return timeout_ms;
+      adjusted_ms = timeout_ms / 4;
+      break;
+
+    case BTM_PM_TRAFFIC_IDLE:
+      adjusted_ms = timeout_ms / 4;
+      break;
+
+    case BTM_PM_TRAFFIC_BURSTY:
+      if (p_traffic->burst_gap_ms < timeout_ms) return timeout_ms;
+      adjusted_ms = timeout_ms / 2;
+      break;
+  }
+
+  if (adjusted_ms < BTM_PM_POLICY_MIN_TIMEOUT_MS)
+    adjusted_ms = BTM_PM_POLICY_MIN_TIMEOUT_MS;
+  if (adjusted_ms > timeout_ms) adjusted_ms = timeout_ms;
+  return adjusted_ms;
+}
+
+/*******************************************************************************
+ *
+ * Function         btm_pm_policy_sniff
+ *
+ * Description      Narrows the sniff intervals a profile asked for.
+ *                  Interactive traffic gets an interval close to
+ *                  BTM_PM_POLICY_INTERACTIVE_LATENCY_MS, bursty traffic one
+ *                  of a quarter of the gap between its bursts, so that the
+ *                  first packet of a burst waits little compared to the
+ *                  bursts. Idle links and ended bulk transfers get the
+ *                  longest intervals of the range.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+void btm_pm_policy_sniff(tBTM_PM_TRAFFIC_CLASS traffic_class,
+                         const tBTM_PM_TRAFFIC* p_traffic,
+                         tBTM_PM_PWR_MD* p_md) {
+  uint32_t max_interval;
+
+  if (p_md->max < p_md->min) return;
+
+  switch (traffic_class) {
+    case BTM_PM_TRAFFIC_INTERACTIVE:
+      max_interval = BTM_PM_MS_TO_SLOTS(BTM_PM_POLICY_INTERACTIVE_LATENCY_MS);
+      break;
+
+    case BTM_PM_TRAFFIC_BURSTY:
+      max_interval = BTM_PM_MS_TO_SLOTS(p_traffic->burst_gap_ms / 4);
+      break;
+
+    case BTM_PM_TRAFFIC_IDLE:
+    case BTM_PM_TRAFFIC_BULK:
+    default:
+      /* Raise the lower bound, the controller may pick any interval */
+      p_md->min = (p_md->min + p_md->max) / 2 & ~1;
+      return;
+  }
+
+  /* Sniff intervals are even */
+  max_interval &= ~1;
+  if (max_interval < p_md->min) max_interval = p_md->min;
+  if (max_interval > p_md->max) max_interval = p_md->max;
+  p_md->max = max_interval;
+}
+
+/*******************************************************************************
+ *
+ * Function         btm_pm_policy_ssr_max_lat
+ *
+ * Description      Adjusts the sniff subrating maximum latency a profile asked
+ *                  for. Interactive traffic is limited to twice
+ *                  BTM_PM_POLICY_INTERACTIVE_LATENCY_MS.
+ *
+ * Returns          the maximum latency to use, in slots
+ *
+ ******************************************************************************/
+uint16_t btm_pm_policy_ssr_max_lat(tBTM_PM_TRAFFIC_CLASS traffic_class,
+                                   const tBTM_PM_TRAFFIC* p_traffic,
+                                   uint16_t max_lat) {
+  uint32_t interactive_lat =
+      BTM_PM_MS_TO_SLOTS(2 * BTM_PM_POLICY_INTERACTIVE_LATENCY_MS);
+
+  if (traffic_class == BTM_PM_TRAFFIC_INTERACTIVE && max_lat > interactive_lat)
+    return interactive_lat;
+  return max_lat;
+}
+
+const char* btm_pm_traffic_class_text(tBTM_PM_TRAFFIC_CLASS traffic_class) {
+  switch (traffic_class) {
+    case BTM_PM_TRAFFIC_IDLE:
+      return "idle";
+    case BTM_PM_TRAFFIC_INTERACTIVE:
+      return "interactive";
+    case BTM_PM_TRAFFIC_BURSTY:
+      return "bursty";
+    case BTM_PM_TRAFFIC_BULK:
+      return "bulk";
+  }
+  return "unknown";
+}
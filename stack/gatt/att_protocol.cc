@@ -315,6 +315,64 @@ BT_HDR* attp_build_value_cmd(uint16_t payload_size, uint8_t op_code,
   return p_buf;
 }
 
+/*******************************************************************************
+ *
+ * Function         attp_encode_notif
+ *
+ * Description      Encode a handle value notification once so that it can be
+ *                  sent to several links. The value is referenced, not copied,
+ *                  and must stay valid until the last per-link PDU is built.
+ *
+ * Returns          None.
+ *
+ ******************************************************************************/
+void attp_encode_notif(tGATT_NOTIF_PDU* p_pdu, uint16_t handle, uint16_t len,
+                       const uint8_t* p_value) {
+  uint8_t* p = p_pdu->hdr;
+
+  UINT8_TO_STREAM(p, GATT_HANDLE_VALUE_NOTIF);
+  UINT16_TO_STREAM(p, handle);
+  p_pdu->len = len;
+  p_pdu->p_value = p_value;
+}
+
+/*******************************************************************************
+ *
+ * Function         attp_build_notif_for_link
+ *
+ * Description      Build the L2CAP buffer of a pre-encoded notification for
+ *                  one link. The value is truncated to the link MTU by
+ *                  length only, and copied exactly once into the outgoing
+ *                  buffer, which is sized to the truncated PDU.
+ *
+ * Returns          pointer to the buffer, owned by the caller.
+ *
+ ******************************************************************************/
+BT_HDR* attp_build_notif_for_link(const tGATT_TCB& tcb,
+                                  const tGATT_NOTIF_PDU& pdu) {
+  uint16_t len = pdu.len;
+
+  if (tcb.payload_size < GATT_HDR_SIZE) return NULL;
+
+  if (len > tcb.payload_size - GATT_HDR_SIZE) {
+    len = tcb.payload_size - GATT_HDR_SIZE;
+    VLOG(1) << StringPrintf("notification truncated to %d for mtu %d", len,
+                            tcb.payload_size);
+  }
+
+  BT_HDR* p_buf = (BT_HDR*)osi_malloc(sizeof(BT_HDR) + L2CAP_MIN_OFFSET +
+                                      GATT_HDR_SIZE + len);
+  uint8_t* p = (uint8_t*)(p_buf + 1) + L2CAP_MIN_OFFSET;
+
+  p_buf->offset = L2CAP_MIN_OFFSET;
+  p_buf->len = GATT_HDR_SIZE + len;
+
+  ARRAY_TO_STREAM(p, pdu.hdr, GATT_HDR_SIZE);
+  if (len > 0 && pdu.p_value != NULL) memcpy(p, pdu.p_value, len);
+
+  return p_buf;
+}
+
 /*******************************************************************************
  *
  * Function         attp_send_msg_to_l2cap
@@ -472,7 +472,7 @@ tGATT_STATUS GATTS_HandleValueIndication(uint16_t conn_id, uint16_t attr_handle,
 tGATT_STATUS GATTS_HandleValueNotification(uint16_t conn_id,
                                            uint16_t attr_handle,
                                            uint16_t val_len, uint8_t* p_val) {
-  tGATT_VALUE notif;
+  tGATT_NOTIF_PDU notif;
   tGATT_IF gatt_if = GATT_GET_GATT_IF(conn_id);
   uint8_t tcb_idx = GATT_GET_TCB_IDX(conn_id);
   tGATT_REG* p_reg = gatt_get_regcb(gatt_if);
@@ -489,21 +489,73 @@ tGATT_STATUS GATTS_HandleValueNotification(uint16_t conn_id,
     return GATT_ILLEGAL_PARAMETER;
   }
 
-  notif.handle = attr_handle;
-  notif.len = val_len;
-  memcpy(notif.value, p_val, val_len);
-  notif.auth_req = GATT_AUTH_REQ_NONE;
+  attp_encode_notif(&notif, attr_handle, val_len, p_val);
 
-  tGATT_STATUS cmd_sent;
-  tGATT_SR_MSG gatt_sr_msg;
-  gatt_sr_msg.attr_value = notif;
-  BT_HDR* p_buf =
-      attp_build_sr_msg(*p_tcb, GATT_HANDLE_VALUE_NOTIF, &gatt_sr_msg);
-  if (p_buf != NULL) {
-    cmd_sent = attp_send_sr_msg(*p_tcb, p_buf);
-  } else
-    cmd_sent = GATT_NO_RESOURCES;
-  return cmd_sent;
+  BT_HDR* p_buf = attp_build_notif_for_link(*p_tcb, notif);
+  if (p_buf == NULL) return GATT_NO_RESOURCES;
+
+  return attp_send_sr_msg(*p_tcb, p_buf);
+}
+
+/*******************************************************************************
+ *
+ * Function         GATTS_HandleValueNotificationMulti
+ *
+ * Description      This function sends the same handle value notification to
+ *                  several clients. The notification is encoded once and
+ *                  truncated per link according to the negotiated MTU.
+ *
+ * Parameter        gatt_if: application interface the connections belong to.
+ *                  conn_ids: connection identifiers of the subscribed clients.
+ *                  attr_handle: Attribute handle of this handle value
+ *                               notification.
+ *                  val_len: Length of the notified attribute value.
+ *                  p_val: Pointer to the notified attribute value data.
+ *                  p_status: optional, filled with the status of each link in
+ *                            the order of conn_ids.
+ *
+ * Returns          Number of links the notification was sent on, including
+ *                  congested links.
+ *
+ ******************************************************************************/
+uint16_t GATTS_HandleValueNotificationMulti(
+    tGATT_IF gatt_if, const std::vector<uint16_t>& conn_ids,
+    uint16_t attr_handle, uint16_t val_len, uint8_t* p_val,
+    std::vector<tGATT_STATUS>* p_status) {
+  tGATT_NOTIF_PDU notif;
+  uint16_t num_sent = 0;
+
+  VLOG(1) << __func__ << ": gatt_if=" << +gatt_if
+          << ", num_conn=" << conn_ids.size();
+
+  if (p_status) p_status->assign(conn_ids.size(), GATT_ILLEGAL_PARAMETER);
+
+  if (gatt_get_regcb(gatt_if) == NULL) {
+    LOG(ERROR) << __func__ << ": Unknown gatt_if: " << +gatt_if;
+    return 0;
+  }
+
+  if (!GATT_HANDLE_IS_VALID(attr_handle)) return 0;
+
+  attp_encode_notif(&notif, attr_handle, val_len, p_val);
+
+  for (size_t i = 0; i < conn_ids.size(); i++) {
+    tGATT_STATUS status = GATT_INVALID_CONN_ID;
+    tGATT_TCB* p_tcb = gatt_get_tcb_by_idx(GATT_GET_TCB_IDX(conn_ids[i]));
+
+    if (GATT_GET_GATT_IF(conn_ids[i]) != gatt_if || p_tcb == NULL) {
+      LOG(ERROR) << __func__ << ": Unknown conn_id: " << conn_ids[i];
+    } else {
+      BT_HDR* p_buf = attp_build_notif_for_link(*p_tcb, notif);
+      status = (p_buf != NULL) ? attp_send_sr_msg(*p_tcb, p_buf)
+                               : GATT_NO_RESOURCES;
+      if (status == GATT_SUCCESS || status == GATT_CONGESTED) num_sent++;
+    }
+
+    if (p_status) (*p_status)[i] = status;
+  }
+
+  return num_sent;
 }
 
 /*******************************************************************************
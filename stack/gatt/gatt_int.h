@@ -142,6 +142,15 @@ typedef union {
   uint16_t mtu;           /* exchange MTU request */
 } tGATT_SR_MSG;
 
+/* handle value notification encoded once and shared by several links; the
+ * per-link ATT header is fixed, only the truncation depends on the link MTU
+*/
+typedef struct {
+  uint8_t hdr[GATT_HDR_SIZE]; /* opcode + attribute handle */
+  uint16_t len;               /* untruncated value length */
+  const uint8_t* p_value;     /* caller owned value, not copied */
+} tGATT_NOTIF_PDU;
+
 /* Characteristic declaration attribute value
 */
 typedef struct {
@@ -426,6 +435,10 @@ extern BT_HDR* attp_build_sr_msg(tGATT_TCB& tcb, uint8_t op_code,
                                  tGATT_SR_MSG* p_msg);
 extern tGATT_STATUS attp_send_sr_msg(tGATT_TCB& tcb, BT_HDR* p_msg);
 extern tGATT_STATUS attp_send_msg_to_l2cap(tGATT_TCB& tcb, BT_HDR* p_toL2CAP);
+extern void attp_encode_notif(tGATT_NOTIF_PDU* p_pdu, uint16_t handle,
+                              uint16_t len, const uint8_t* p_value);
+extern BT_HDR* attp_build_notif_for_link(const tGATT_TCB& tcb,
+                                         const tGATT_NOTIF_PDU& pdu);
 
 /* utility functions */
 extern uint8_t* gatt_dbg_op_name(uint8_t op_code);
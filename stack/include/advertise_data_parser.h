@@ -18,6 +18,9 @@
 
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
+
 #include <array>
 #include <vector>
 
@@ -142,3 +145,119 @@ class AdvertiseDataParser {
     return GetFieldByType(ad.data(), ad.size(), type, p_length);
   }
 };
+
+/**
+ * Offset table of the fields of advertising or EIR data, built in a single
+ * pass, so that looking up several fields of the same report does not walk it
+ * again each time. Lookups give the same results as
+ * AdvertiseDataParser::GetFieldByType(). The data must outlive the index.
+ */
+class AdvertiseDataIndex {
+  struct Field {
+    uint16_t offset; /* of the field data */
+    uint8_t type;
+    uint8_t len; /* of the field data */
+  };
+
+  // Fields indexed, the lookups walk the rest of the data if there are more.
+  static constexpr size_t kMaxFields = 32;
+
+ public:
+  AdvertiseDataIndex(const uint8_t* ad, size_t ad_len)
+      : ad_(ad), ad_len_(ad ? ad_len : 0) {
+    types_.fill(0);
+
+    size_t position = 0;
+    while (position < ad_len_) {
+      uint8_t len = ad_[position];
+
+      if (len == 0) break;
+      if (position + len >= ad_len_) break;
+
+      if (num_fields_ == kMaxFields || position + 2 > UINT16_MAX) {
+        overflow_ = position;
+        break;
+      }
+
+      uint8_t type = ad_[position + 1];
+      fields_[num_fields_++] = {static_cast<uint16_t>(position + 2), type,
+                                static_cast<uint8_t>(len - 1)};
+      types_[type >> 5] |= 1u << (type & 0x1f);
+
+      position += len + 1;
+    }
+    end_ = position;
+  }
+
+  explicit AdvertiseDataIndex(std::vector<uint8_t> const& ad)
+      : AdvertiseDataIndex(ad.data(), ad.size()) {}
+
+  AdvertiseDataIndex(const AdvertiseDataIndex&) = delete;
+  AdvertiseDataIndex& operator=(const AdvertiseDataIndex&) = delete;
+
+  bool empty() const { return ad_len_ == 0; }
+
+  /**
+   * Returns the length of the well formed fields at the start of the data,
+   * the rest being padding or garbage.
+   */
+  size_t significant_len() const {
+    if (overflow_ == 0) return end_;
+    size_t position = overflow_;
+    while (position < ad_len_) {
+      uint8_t len = ad_[position];
+      if (len == 0 || position + len >= ad_len_) break;
+      position += len + 1;
+    }
+    return position;
+  }
+
+  /**
+   * Returns a pointer to the data of the first field of |type|, and its
+   * length in |p_length|, or NULL if there is none.
+   */
+  const uint8_t* GetFieldByType(uint8_t type, uint8_t* p_length) const {
+    if (types_[type >> 5] & (1u << (type & 0x1f))) {
+      for (size_t i = 0; i < num_fields_; i++) {
+        if (fields_[i].type == type) {
+          *p_length = fields_[i].len;
+          return ad_ + fields_[i].offset;
+        }
+      }
+    }
+
+    if (overflow_ != 0) {
+      const uint8_t* p = AdvertiseDataParser::GetFieldByType(
+          ad_ + overflow_, ad_len_ - overflow_, type, p_length);
+      if (p != NULL) return p;
+    }
+
+    *p_length = 0;
+    return NULL;
+  }
+
+  /**
+   * Returns the first field of |first_type|, or else of |second_type|, such
+   * as a complete and a shortened name or UUID list. |p_type| is set to the
+   * type found.
+   */
+  const uint8_t* GetFieldByType(uint8_t first_type, uint8_t second_type,
+                                uint8_t* p_length, uint8_t* p_type) const {
+    const uint8_t* p = GetFieldByType(first_type, p_length);
+    *p_type = first_type;
+    if (p == NULL) {
+      p = GetFieldByType(second_type, p_length);
+      *p_type = second_type;
+    }
+    return p;
+  }
+
+ private:
+  const uint8_t* ad_;
+  size_t ad_len_;
+  std::array<uint32_t, 8> types_; /* bitmap of the types indexed */
+  Field fields_[kMaxFields];
+  size_t num_fields_ = 0;
+  size_t end_ = 0;      /* where the walk stopped */
+  size_t overflow_ = 0; /* where the fields not indexed start, if any */
+};
@@ -74,6 +74,7 @@ class BleAdvertisingManager {
   static void CleanUp();
   static bool IsInitialized();
   static base::WeakPtr<BleAdvertisingManager> Get();
+  static void DebugDump(int fd);
 
   /* Register an advertising instance, status will be returned in |cb|
    * callback, with assigned id, if operation succeeds. Instance is freed when
@@ -282,11 +282,27 @@ extern tBNEP_RESULT BNEP_ConnectResp(uint16_t handle, tBNEP_RESULT resp);
  ******************************************************************************/
 extern tBNEP_RESULT BNEP_Disconnect(uint16_t handle);
 
+/*******************************************************************************
+ *
+ * Function         BNEP_AllocBuf
+ *
+ * Description      This function allocates a buffer for BNEP_WriteBuf, with
+ *                  room for |len| octets of data, and the headroom for the
+ *                  BNEP and L2CAP headers in front of it.
+ *
+ * Returns          the buffer, its len set to |len|
+ *
+ ******************************************************************************/
+extern BT_HDR* BNEP_AllocBuf(uint16_t len);
+
 /*******************************************************************************
  *
  * Function         BNEP_WriteBuf
  *
- * Description      This function sends data in a GKI buffer on BNEP connection
+ * Description      This function sends data in a GKI buffer on BNEP connection.
+ *                  The headers are added in place when the buffer has at least
+ *                  BNEP_MINIMUM_OFFSET octets of headroom, as the ones from
+ *                  BNEP_AllocBuf do, without copying the data.
  *
  * Parameters:      handle       - handle of the connection to write
  *                  p_dest_addr  - BD_ADDR/Ethernet addr of the destination
@@ -1884,6 +1884,25 @@ extern tBTM_STATUS BTM_SetPowerMode(uint8_t pm_id, const RawAddress& remote_bda,
 extern tBTM_STATUS BTM_ReadPowerMode(const RawAddress& remote_bda,
                                      tBTM_PM_MODE* p_mode);
 
+/*******************************************************************************
+ *
+ * Function         BTM_ReadAclTraffic
+ *
+ * Description      This returns the ACL traffic seen so far on the BR/EDR
+ *                  connection to a device.
+ *
+ * Input Param      remote_bda - device address of desired ACL connection
+ *
+ * Output Param     p_traffic - address where the traffic is copied into.
+ *                          (valid only if return code is BTM_SUCCESS)
+ *
+ * Returns          BTM_SUCCESS if successful,
+ *                  BTM_UNKNOWN_ADDR if bd addr is not active or bad
+ *
+ ******************************************************************************/
+extern tBTM_STATUS BTM_ReadAclTraffic(const RawAddress& remote_bda,
+                                      tBTM_PM_TRAFFIC* p_traffic);
+
 /*******************************************************************************
  *
  * Function         BTM_SetSsrParams
@@ -1851,6 +1851,20 @@ typedef struct {
   tBTM_PM_MODE mode;
 } tBTM_PM_PWR_MD;
 
+/* ACL traffic of a BR/EDR link, as seen by the power manager. Packets less
+ * than BTM_PM_TRAFFIC_BURST_GAP_MS apart belong to the same burst. */
+typedef struct {
+  uint32_t tx_pkts;
+  uint32_t rx_pkts;
+  uint64_t tx_bytes;
+  uint64_t rx_bytes;
+  uint32_t bursts;
+  uint32_t last_pkt_ms;  /* boot time of the last packet */
+  uint32_t gap_ms;       /* average gap between the packets of a burst */
+  uint32_t burst_gap_ms; /* average gap between bursts */
+  uint16_t pkt_len;      /* average packet length */
+} tBTM_PM_TRAFFIC;
+
 /*************************************
  *  Power Manager Callback Functions
  *************************************/
@@ -102,7 +102,9 @@ extern void BTM_BleSetScanParams(uint8_t scan_phy, std::vector<uint32_t> scan_in
  *
  * Function         BTM_BleGetVendorCapabilities
  *
- * Description      This function reads local LE features
+ * Description      This function reads local LE features. filter_support and
+ *                  max_filter report the host filters, if in use, in place of
+ *                  the controller ones.
  *
  * Parameters       p_cmn_vsc_cb : Locala LE capability structure
  *
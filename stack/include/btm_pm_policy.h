@@ -0,0 +1,103 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  Traffic-aware power mode policy. Given the ACL traffic of a link, it
+ *  adjusts the idle timeout, sniff and sniff subrating parameters a profile
+ *  asked for, staying within the limits of the profile.
+ *
+ ******************************************************************************/
+#ifndef BTM_PM_POLICY_H
+#define BTM_PM_POLICY_H
+
+#include "btm_api_types.h"
+
+/* Packets further apart than this start a new burst */
+#ifndef BTM_PM_TRAFFIC_BURST_GAP_MS
+#define BTM_PM_TRAFFIC_BURST_GAP_MS 100
+#endif
+
+/* A link without traffic for this long is idle */
+#ifndef BTM_PM_POLICY_IDLE_MS
+#define BTM_PM_POLICY_IDLE_MS 5000
+#endif
+
+/* Interactive traffic (HID reports, RFCOMM keystrokes, AT commands): small
+ * packets, in bursts at least this often */
+#ifndef BTM_PM_POLICY_INTERACTIVE_LEN
+#define BTM_PM_POLICY_INTERACTIVE_LEN 64
+#endif
+#ifndef BTM_PM_POLICY_INTERACTIVE_BURST_GAP_MS
+#define BTM_PM_POLICY_INTERACTIVE_BURST_GAP_MS 2000
+#endif
+/* Latency aimed at for interactive traffic in sniff mode */
+#ifndef BTM_PM_POLICY_INTERACTIVE_LATENCY_MS
+#define BTM_PM_POLICY_INTERACTIVE_LATENCY_MS 30
+#endif
+
+/* Bulk traffic (file transfer, streaming): large packets */
+#ifndef BTM_PM_POLICY_BULK_LEN
+#define BTM_PM_POLICY_BULK_LEN 256
+#endif
+
+/* Bounds of the adjusted idle timeouts, unless the profile asked for a
+ * timeout beyond them */
+#ifndef BTM_PM_POLICY_MIN_TIMEOUT_MS
+#define BTM_PM_POLICY_MIN_TIMEOUT_MS 500
+#endif
+#ifndef BTM_PM_POLICY_MAX_TIMEOUT_MS
+#define BTM_PM_POLICY_MAX_TIMEOUT_MS 10000
+#endif
+
+typedef enum {
+  BTM_PM_TRAFFIC_IDLE,
+  BTM_PM_TRAFFIC_INTERACTIVE,
+  BTM_PM_TRAFFIC_BURSTY,
+  BTM_PM_TRAFFIC_BULK,
+} tBTM_PM_TRAFFIC_CLASS;
+
+/* Accounts for a packet of |len| bytes sent or received at |now_ms|. */
+void btm_pm_traffic_update(tBTM_PM_TRAFFIC* p_traffic, bool is_tx,
+                           uint16_t len, uint32_t now_ms);
+
+/* Returns the kind of traffic of a link at |now_ms|. */
+tBTM_PM_TRAFFIC_CLASS btm_pm_policy_classify(const tBTM_PM_TRAFFIC* p_traffic,
+                                             uint32_t now_ms);
+
+/* Returns the idle timeout to use instead of the |timeout_ms| a profile asked
+ * for before entering sniff mode. */
+uint32_t btm_pm_policy_timeout(tBTM_PM_TRAFFIC_CLASS traffic_class,
+                               const tBTM_PM_TRAFFIC* p_traffic,
+                               uint32_t now_ms, uint32_t timeout_ms);
+
+/* Narrows the sniff intervals of |p_md|, as a profile asked for them, to the
+ * ones matching the traffic. */
+void btm_pm_policy_sniff(tBTM_PM_TRAFFIC_CLASS traffic_class,
+                         const tBTM_PM_TRAFFIC* p_traffic,
+                         tBTM_PM_PWR_MD* p_md);
+
+/* Returns the sniff subrating maximum latency to use instead of the |max_lat|
+ * a profile asked for, 0 meaning no subrating. */
+uint16_t btm_pm_policy_ssr_max_lat(tBTM_PM_TRAFFIC_CLASS traffic_class,
+                                   const tBTM_PM_TRAFFIC* p_traffic,
+                                   uint16_t max_lat);
+
+const char* btm_pm_traffic_class_text(tBTM_PM_TRAFFIC_CLASS traffic_class);
+
+#endif /* BTM_PM_POLICY_H */
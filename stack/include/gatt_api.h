@@ -22,6 +22,8 @@
 #include "btm_ble_api.h"
 #include "gattdefs.h"
 
+#include <vector>
+
 /*****************************************************************************
  *  Constants
  ****************************************************************************/
@@ -772,6 +774,29 @@ extern tGATT_STATUS GATTS_HandleValueNotification(uint16_t conn_id,
                                                   uint16_t val_len,
                                                   uint8_t* p_val);
 
+/*******************************************************************************
+ *
+ * Function         GATTS_HandleValueNotificationMulti
+ *
+ * Description      This function sends the same handle value notification to
+ *                  several clients, encoding it only once.
+ *
+ * Parameter        gatt_if: application interface the connections belong to.
+ *                  conn_ids: connection identifiers of the subscribed clients.
+ *                  attr_handle: Attribute handle of this handle value
+ *                               notification.
+ *                  val_len: Length of the notified attribute value.
+ *                  p_val: Pointer to the notified attribute value data.
+ *                  p_status: optional, per connection send status.
+ *
+ * Returns          Number of links the notification was sent on.
+ *
+ ******************************************************************************/
+extern uint16_t GATTS_HandleValueNotificationMulti(
+    tGATT_IF gatt_if, const std::vector<uint16_t>& conn_ids,
+    uint16_t attr_handle, uint16_t val_len, uint8_t* p_val,
+    std::vector<tGATT_STATUS>* p_status = nullptr);
+
 /*******************************************************************************
  *
  * Function         GATTS_SendRsp
@@ -1331,4 +1331,17 @@ extern bool L2CA_isMediaChannel(uint16_t handle, uint16_t channel_id, bool is_lo
 extern void L2CA_AdjustConnectionIntervals(uint16_t* min_interval,
                                            uint16_t* max_interval,
                                            uint16_t floor_interval);
+
+/*******************************************************************************
+**
+** Function         L2CA_Dumpsys
+**
+** Description      This function dumps the allocation of the controller ACL
+**                      buffers among the links to |fd|.
+**
+** Returns          void
+**
+*******************************************************************************/
+extern void L2CA_Dumpsys(int fd);
+
 #endif /* L2C_API_H */
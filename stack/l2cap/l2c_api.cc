@@ -24,11 +24,15 @@
 
 #define LOG_TAG "bt_l2cap"
 
+#include <base/bind.h>
 #include <base/logging.h>
 #include <base/strings/stringprintf.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+
+#include <future>
 
 #include "bt_common.h"
 #include "bt_types.h"
@@ -569,6 +573,7 @@ uint16_t L2CA_ConnectLECocReq(uint16_t psm, const RawAddress& p_bd_addr,
   if (p_cfg) {
     memcpy(&p_ccb->local_conn_cfg, p_cfg, sizeof(tL2CAP_LE_CFG_INFO));
     p_ccb->remote_credit_count = p_cfg->credits;
+    l2cble_init_credit_batch(p_ccb, p_cfg->credits);
   }
 
   /* If link is up, start the L2CAP connection */
@@ -642,6 +647,7 @@ bool L2CA_ConnectLECocRsp(const RawAddress& p_bd_addr, uint8_t id,
   if (p_cfg) {
     memcpy(&p_ccb->local_conn_cfg, p_cfg, sizeof(tL2CAP_LE_CFG_INFO));
     p_ccb->remote_credit_count = p_cfg->credits;
+    l2cble_init_credit_batch(p_ccb, p_cfg->credits);
   }
 
   if (result == L2CAP_CONN_OK)
@@ -2372,3 +2378,73 @@ bool L2CA_isMediaChannel(uint16_t handle, uint16_t channel_id, bool is_local_cid
 
     return ret;
 }
+
+static void l2c_dump_quota(int fd, const char* name,
+                           const tL2C_LINK_QUOTA* p_quota, uint16_t num_bufs,
+                           uint16_t xmit_window, uint16_t round_robin_quota,
+                           uint16_t round_robin_unacked) {
+  dprintf(fd, "  %s buffers: %u  free: %u\n", name, num_bufs, xmit_window);
+  dprintf(fd,
+          "    links high/low: %u/%u  quota high: %u  low: %u (+1 for %u)\n",
+          p_quota->num_hipri_links, p_quota->num_lowpri_links,
+          p_quota->high_pri_link_quota, p_quota->low_link_quota,
+          p_quota->num_low_extra);
+  dprintf(fd, "    round-robin quota: %u  unacked: %u\n", round_robin_quota,
+          round_robin_unacked);
+  dprintf(fd, "    adjustments: %u  link quotas changed: %u\n",
+          p_quota->num_adjusts, p_quota->num_links_changed);
+}
+
+static void l2c_dump(int fd, std::promise<void> dumped) {
+  int xx;
+  tL2C_LCB* p_lcb;
+
+  dprintf(fd, "\nL2CAP link buffer quotas:\n");
+  l2c_dump_quota(fd, "BR/EDR", &l2cb.link_quota, l2cb.num_lm_acl_bufs,
+                 l2cb.controller_xmit_window, l2cb.round_robin_quota,
+                 l2cb.round_robin_unacked);
+  l2c_dump_quota(fd, "LE", &l2cb.ble_link_quota, l2cb.num_lm_ble_bufs,
+                 l2cb.controller_le_xmit_window, l2cb.ble_round_robin_quota,
+                 l2cb.ble_round_robin_unacked);
+
+  for (xx = 0, p_lcb = &l2cb.lcb_pool[0]; xx < MAX_L2CAP_LINKS; xx++, p_lcb++) {
+    if (!p_lcb->in_use) continue;
+    dprintf(fd,
+            "  link %d %s handle: 0x%04x %s priority: %s quota: %u "
+            "unacked: %u queued: %zu\n",
+            xx, p_lcb->remote_bd_addr.ToString().c_str(), p_lcb->handle,
+            p_lcb->transport == BT_TRANSPORT_LE ? "LE" : "BR/EDR",
+            p_lcb->acl_priority == L2CAP_PRIORITY_HIGH ? "high" : "normal",
+            p_lcb->link_xmit_quota, p_lcb->sent_not_acked,
+            p_lcb->link_xmit_data_q ? list_length(p_lcb->link_xmit_data_q)
+                                    : 0);
+  }
+  dumped.set_value();
+}
+
+/*******************************************************************************
+**
+** Function         L2CA_Dumpsys
+**
+** Description      This function dumps the allocation of the controller ACL
+**                      buffers among the links to |fd|. The control block
+**                      belongs to the stack thread, so the dump is done there.
+**
+** Returns          void
+**
+*******************************************************************************/
+void L2CA_Dumpsys(int fd) {
+  base::MessageLoop* message_loop = get_message_loop();
+  if (message_loop == nullptr || !message_loop->task_runner().get()) return;
+
+  std::promise<void> dumped;
+  std::future<void> dump_done = dumped.get_future();
+  if (message_loop->task_runner()->BelongsToCurrentThread()) {
+    l2c_dump(fd, std::move(dumped));
+    return;
+  }
+
+  message_loop->task_runner()->PostTask(
+      FROM_HERE, base::Bind(&l2c_dump, fd, base::Passed(std::move(dumped))));
+  dump_done.wait();
+}
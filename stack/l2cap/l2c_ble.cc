@@ -636,6 +636,7 @@ void l2cble_process_sig_cmd(tL2C_LCB* p_lcb, uint8_t* p, uint16_t pkt_len) {
       p_ccb->ble_sdu_length = 0;
       p_ccb->is_first_seg = true;
       p_ccb->peer_cfg.fcr.mode = L2CAP_FCR_LE_COC_MODE;
+      l2cble_update_data_length(p_lcb);
 
       l2c_csm_execute(p_ccb, L2CEVT_L2CAP_CONNECT_REQ, &con_info);
       break;
@@ -691,10 +692,12 @@ void l2cble_process_sig_cmd(tL2C_LCB* p_lcb, uint8_t* p, uint16_t pkt_len) {
         p_ccb->is_first_seg = true;
         p_ccb->peer_cfg.fcr.mode = L2CAP_FCR_LE_COC_MODE;
 
-        if (con_info.l2cap_result == L2CAP_LE_RESULT_CONN_OK)
+        if (con_info.l2cap_result == L2CAP_LE_RESULT_CONN_OK) {
+          l2cble_update_data_length(p_lcb);
           l2c_csm_execute(p_ccb, L2CEVT_L2CAP_CONNECT_RSP, &con_info);
-        else
+        } else {
           l2c_csm_execute(p_ccb, L2CEVT_L2CAP_CONNECT_RSP_NEG, &con_info);
+        }
       } else {
         L2CAP_TRACE_DEBUG("I DO NOT remember the connection req");
         con_info.l2cap_result = L2CAP_LE_RESULT_INVALID_SOURCE_CID;
@@ -816,13 +819,7 @@ void l2c_link_processs_ble_num_bufs(uint16_t num_lm_ble_bufs) {
  *
  ******************************************************************************/
 void l2c_ble_link_adjust_allocation(void) {
-  uint16_t qq, yy, qq_remainder;
-  tL2C_LCB* p_lcb;
-  uint16_t hi_quota, low_quota;
-  uint16_t num_lowpri_links = 0;
-  uint16_t num_hipri_links = 0;
-  uint16_t controller_xmit_quota = l2cb.num_lm_ble_bufs;
-  uint16_t high_pri_link_quota = L2CAP_HIGH_PRI_MIN_XMIT_QUOTA_A;
+  tL2C_LINK_QUOTA* p_quota = &l2cb.ble_link_quota;
 
   /* If no links active, reset buffer quotas and controller buffers */
   if (l2cb.num_ble_links_active == 0) {
@@ -831,93 +828,16 @@ void l2c_ble_link_adjust_allocation(void) {
     return;
   }
 
-  /* First, count the links */
-  for (yy = 0, p_lcb = &l2cb.lcb_pool[0]; yy < MAX_L2CAP_LINKS; yy++, p_lcb++) {
-    if (p_lcb->in_use && p_lcb->transport == BT_TRANSPORT_LE) {
-      if (p_lcb->acl_priority == L2CAP_PRIORITY_HIGH)
-        num_hipri_links++;
-      else
-        num_lowpri_links++;
-    }
-  }
-
-  /* now adjust high priority link quota */
-  low_quota = num_lowpri_links ? 1 : 0;
-  while ((num_hipri_links * high_pri_link_quota + low_quota) >
-         controller_xmit_quota)
-    high_pri_link_quota--;
-
-  /* Work out the xmit quota and buffer quota high and low priorities */
-  hi_quota = num_hipri_links * high_pri_link_quota;
-  low_quota =
-      (hi_quota < controller_xmit_quota) ? controller_xmit_quota - hi_quota : 1;
-
-  /* Work out and save the HCI xmit quota for each low priority link */
-
-  /* If each low priority link cannot have at least one buffer */
-  if (num_lowpri_links > low_quota) {
-    l2cb.ble_round_robin_quota = low_quota;
-    qq = qq_remainder = 0;
-  }
-  /* If each low priority link can have at least one buffer */
-  else if (num_lowpri_links > 0) {
-    l2cb.ble_round_robin_quota = 0;
-    l2cb.ble_round_robin_unacked = 0;
-    qq = low_quota / num_lowpri_links;
-    qq_remainder = low_quota % num_lowpri_links;
-  }
-  /* If no low priority link */
-  else {
-    l2cb.ble_round_robin_quota = 0;
-    l2cb.ble_round_robin_unacked = 0;
-    qq = qq_remainder = 0;
-  }
-  L2CAP_TRACE_EVENT(
-      "l2c_ble_link_adjust_allocation  num_hipri: %u  num_lowpri: %u  "
-      "low_quota: %u  round_robin_quota: %u  qq: %u",
-      num_hipri_links, num_lowpri_links, low_quota, l2cb.ble_round_robin_quota,
-      qq);
-
-  /* Now, assign the quotas to each link */
-  for (yy = 0, p_lcb = &l2cb.lcb_pool[0]; yy < MAX_L2CAP_LINKS; yy++, p_lcb++) {
-    if (p_lcb->in_use && p_lcb->transport == BT_TRANSPORT_LE) {
-      if (p_lcb->acl_priority == L2CAP_PRIORITY_HIGH) {
-        p_lcb->link_xmit_quota = high_pri_link_quota;
-      } else {
-        /* Safety check in case we switched to round-robin with something
-         * outstanding */
-        /* if sent_not_acked is added into round_robin_unacked then don't add it
-         * again */
-        /* l2cap keeps updating sent_not_acked for exiting from round robin */
-        if ((p_lcb->link_xmit_quota > 0) && (qq == 0))
-          l2cb.ble_round_robin_unacked += p_lcb->sent_not_acked;
-
-        p_lcb->link_xmit_quota = qq;
-        if (qq_remainder > 0) {
-          p_lcb->link_xmit_quota++;
-          qq_remainder--;
-        }
-      }
+  p_quota->num_bufs = l2cb.num_lm_ble_bufs;
+  p_quota->hi_pri_quota = L2CAP_HIGH_PRI_MIN_XMIT_QUOTA_A;
+  p_quota->hi_pri_min_quota = 0;
+  p_quota->low_min_quota = 0;
+  p_quota->num_hipri_links = l2cb.num_ble_hipri_links;
+  p_quota->num_lowpri_links =
+      l2cb.num_ble_links_active - l2cb.num_ble_hipri_links;
 
-      L2CAP_TRACE_EVENT(
-          "l2c_ble_link_adjust_allocation LCB %d   Priority: %d  XmitQuota: %d",
-          yy, p_lcb->acl_priority, p_lcb->link_xmit_quota);
-
-      L2CAP_TRACE_EVENT("        SentNotAcked: %d  RRUnacked: %d",
-                        p_lcb->sent_not_acked, l2cb.round_robin_unacked);
-
-      /* There is a special case where we have readjusted the link quotas and */
-      /* this link may have sent anything but some other link sent packets so */
-      /* so we may need a timer to kick off this link's transmissions. */
-      if ((p_lcb->link_state == LST_CONNECTED) &&
-          (!list_is_empty(p_lcb->link_xmit_data_q)) &&
-          (p_lcb->sent_not_acked < p_lcb->link_xmit_quota)) {
-        alarm_set_on_mloop(p_lcb->l2c_lcb_timer,
-                           L2CAP_LINK_FLOW_CONTROL_TIMEOUT_MS,
-                           l2c_lcb_timer_timeout, p_lcb);
-      }
-    }
-  }
+  l2c_link_apply_quota(p_quota, true, false, &l2cb.ble_round_robin_quota,
+                       &l2cb.ble_round_robin_unacked);
 }
 
 #if (BLE_LLT_INCLUDED == TRUE)
@@ -984,6 +904,14 @@ void l2cble_update_data_length(tL2C_LCB* p_lcb) {
     }
   }
 
+  /* fit a whole K-frame of each LE CoC channel in one link layer PDU */
+  for (tL2C_CCB* p_ccb = p_lcb->ccb_queue.p_first_ccb; p_ccb;
+       p_ccb = p_ccb->p_next_ccb) {
+    if (p_ccb->peer_cfg.fcr.mode == L2CAP_FCR_LE_COC_MODE &&
+        tx_mtu < (p_ccb->peer_conn_cfg.mps + L2CAP_PKT_OVERHEAD))
+      tx_mtu = p_ccb->peer_conn_cfg.mps + L2CAP_PKT_OVERHEAD;
+  }
+
   if (tx_mtu > BTM_BLE_DATA_SIZE_MAX) tx_mtu = BTM_BLE_DATA_SIZE_MAX;
 
   /* update TX data length if changed */
@@ -809,107 +809,6 @@ void l2c_fcr_proc_pdu(tL2C_CCB* p_ccb, BT_HDR* p_buf) {
   }
 }
 
-/*******************************************************************************
- *
- * Function         l2c_lcc_proc_pdu
- *
- * Description      This function is the entry point for processing of a
- *                  received PDU when in LE Coc flow control modes.
- *
- * Returns          -
- *
- ******************************************************************************/
-void l2c_lcc_proc_pdu(tL2C_CCB* p_ccb, BT_HDR* p_buf) {
-  CHECK(p_ccb != NULL);
-  CHECK(p_buf != NULL);
-  uint8_t* p = (uint8_t*)(p_buf + 1) + p_buf->offset;
-  uint16_t sdu_length;
-  BT_HDR* p_data = NULL;
-
-  /* Buffer length should not exceed local mps */
-  if (p_buf->len > p_ccb->local_conn_cfg.mps) {
-    /* Discard the buffer */
-    osi_free(p_buf);
-    return;
-  }
-
-  if (p_ccb->is_first_seg) {
-    if (p_buf->len < sizeof(sdu_length)) {
-      L2CAP_TRACE_ERROR("%s: buffer length=%d too small. Need at least 2.",
-                        __func__, p_buf->len);
-      android_errorWriteWithInfoLog(0x534e4554, "120665616", -1, NULL, 0);
-      /* Discard the buffer */
-      osi_free(p_buf);
-      return;
-    }
-    STREAM_TO_UINT16(sdu_length, p);
-
-    /* Check the SDU Length with local MTU size */
-    if (sdu_length > p_ccb->local_conn_cfg.mtu) {
-      /* Discard the buffer */
-      osi_free(p_buf);
-      return;
-    }
-
-    p_buf->len -= sizeof(sdu_length);
-    p_buf->offset += sizeof(sdu_length);
-
-    if (sdu_length < p_buf->len) {
-      L2CAP_TRACE_ERROR("%s: Invalid sdu_length: %d", __func__, sdu_length);
-      android_errorWriteWithInfoLog(0x534e4554, "112321180", -1, NULL, 0);
-      /* Discard the buffer */
-      osi_free(p_buf);
-      return;
-    }
-
-    p_data = (BT_HDR*)osi_malloc(L2CAP_MAX_BUF_SIZE);
-    if (p_data == NULL) {
-      osi_free(p_buf);
-      return;
-    }
-
-    p_ccb->ble_sdu = p_data;
-    p_data->len = 0;
-    p_ccb->ble_sdu_length = sdu_length;
-    L2CAP_TRACE_DEBUG("%s SDU Length = %d", __func__, sdu_length);
-    p_data->offset = 0;
-
-  } else {
-    p_data = p_ccb->ble_sdu;
-    if (p_buf->len > (p_ccb->ble_sdu_length - p_data->len)) {
-      L2CAP_TRACE_ERROR("%s: buffer length=%d too big. max=%d. Dropped",
-                        __func__, p_data->len,
-                        (p_ccb->ble_sdu_length - p_data->len));
-      android_errorWriteWithInfoLog(0x534e4554, "75298652", -1, NULL, 0);
-      osi_free(p_buf);
-
-      /* Throw away all pending fragments and disconnects */
-      p_ccb->is_first_seg = true;
-      osi_free(p_ccb->ble_sdu);
-      p_ccb->ble_sdu = NULL;
-      p_ccb->ble_sdu_length = 0;
-      l2cu_disconnect_chnl(p_ccb);
-      return;
-    }
-  }
-
-  memcpy((uint8_t*)(p_data + 1) + p_data->offset + p_data->len,
-         (uint8_t*)(p_buf + 1) + p_buf->offset, p_buf->len);
-  p_data->len += p_buf->len;
-  p = (uint8_t*)(p_data + 1) + p_data->offset;
-  if (p_data->len == p_ccb->ble_sdu_length) {
-    l2c_csm_execute(p_ccb, L2CEVT_L2CAP_DATA, p_data);
-    p_ccb->is_first_seg = true;
-    p_ccb->ble_sdu = NULL;
-    p_ccb->ble_sdu_length = 0;
-  } else if (p_data->len < p_ccb->ble_sdu_length) {
-    p_ccb->is_first_seg = false;
-  }
-
-  osi_free(p_buf);
-  return;
-}
-
 /*******************************************************************************
  *
  * Function         l2c_fcr_proc_tout
@@ -1858,7 +1757,7 @@ BT_HDR* l2c_lcc_get_next_xmit_sdu_seg(tL2C_CCB* p_ccb,
   uint16_t sdu_len = 0;
   BT_HDR *p_buf, *p_xmit;
   uint8_t* p;
-  uint16_t max_pdu = p_ccb->peer_conn_cfg.mps;
+  uint16_t max_pdu = l2cble_get_coc_tx_pdu_size(p_ccb);
 
   p_buf = (BT_HDR*)fixed_queue_try_peek_first(p_ccb->xmit_hold_q);
   if (p_buf == NULL) {
@@ -30,6 +30,7 @@
 #include "btm_api.h"
 #include "btm_ble_api.h"
 #include "l2c_api.h"
+#include "l2c_link_quota.h"
 #include "l2cdefs.h"
 #include "osi/include/alarm.h"
 #include "osi/include/fixed_queue.h"
@@ -56,6 +57,10 @@ constexpr uint16_t L2CAP_LE_CREDIT_THRESHOLD = 0x0040;
 static_assert(L2CAP_LE_CREDIT_THRESHOLD < L2CAP_LE_CREDIT_DEFAULT,
               "Threshold must be smaller then default credits");
 
+// Window over which the LE CoC receive rate is measured to size the batches
+// in which credits are returned to the peer.
+constexpr uint32_t L2CAP_LE_CREDIT_RATE_WINDOW_MS = 100;
+
 /*
  * Timeout values (in milliseconds).
  */
@@ -284,6 +289,15 @@ typedef struct {
   void* p_ref_data;
 } tL2CAP_SEC_DATA;
 
+/* Receive credit batching state of an LE CoC channel */
+typedef struct {
+  uint16_t initial_credits; /* credits granted at channel setup */
+  uint16_t consumed;        /* credits used by the peer and not returned */
+  uint16_t batch_size;      /* return credits once this many are consumed */
+  uint16_t window_pdus;     /* PDUs received in the current rate window */
+  uint32_t window_start_ms; /* start of the current rate window */
+} tL2C_LE_CREDIT_BATCH;
+
 /* Define a channel control block (CCB). There may be many channel control
  * blocks between the same two Bluetooth devices (i.e. on the same link).
  * Each CCB has unique local and remote CIDs. All channel control blocks on
@@ -364,6 +378,7 @@ typedef struct t_l2c_ccb {
   /* Number of LE frames that the remote can send to us (credit count in
    * remote). Valid only for LE CoC */
   uint16_t remote_credit_count;
+  tL2C_LE_CREDIT_BATCH credit_batch;
 } tL2C_CCB;
 
 /***********************************************************************
@@ -516,6 +531,8 @@ typedef struct {
 
   tL2C_LCB* p_cur_hcit_lcb;  /* Current HCI Transport buffer */
   uint16_t num_links_active; /* Number of links active */
+  uint16_t num_hipri_links;  /* Number of high priority links active */
+  tL2C_LINK_QUOTA link_quota; /* Allocation of the ACL buffers */
 
 #if (L2CAP_NON_FLUSHABLE_PB_INCLUDED == TRUE)
   uint16_t non_flushable_pbf; /* L2CAP_PKT_START_NON_FLUSHABLE if controller
@@ -534,6 +551,8 @@ typedef struct {
 #endif
 
   uint16_t num_ble_links_active; /* Number of LE links active */
+  uint16_t num_ble_hipri_links;  /* Number of high priority LE links active */
+  tL2C_LINK_QUOTA ble_link_quota; /* Allocation of the LE ACL buffers */
   uint16_t controller_le_xmit_window; /* Total ACL window for all links */
   tL2C_BLE_FIXED_CHNLS_MASK l2c_ble_fixed_chnls_mask;  // LE fixed channels mask
   uint16_t num_lm_ble_bufs;         /* # of ACL buffers on controller */
@@ -765,6 +784,10 @@ extern void l2c_info_resp_timer_timeout(void* data);
 extern void l2c_link_check_send_pkts(tL2C_LCB* p_lcb, tL2C_CCB* p_ccb,
                                      BT_HDR* p_buf);
 extern void l2c_link_adjust_allocation(void);
+extern void l2c_link_apply_quota(tL2C_LINK_QUOTA* p_quota, bool is_ble,
+                                 bool is_share_buffer,
+                                 uint16_t* p_round_robin_quota,
+                                 uint16_t* p_round_robin_unacked);
 extern void l2c_link_process_num_completed_pkts(uint8_t* p, uint8_t evt_len);
 extern void l2c_link_process_num_completed_blocks(uint8_t controller_id,
                                                   uint8_t* p, uint16_t evt_len);
@@ -853,6 +876,10 @@ extern void l2cble_credit_based_conn_res(tL2C_CCB* p_ccb, uint16_t result);
 extern void l2cble_send_peer_disc_req(tL2C_CCB* p_ccb);
 extern void l2cble_send_flow_control_credit(tL2C_CCB* p_ccb,
                                             uint16_t credit_value);
+extern void l2cble_init_credit_batch(tL2C_CCB* p_ccb,
+                                     uint16_t initial_credits);
+extern void l2cble_credit_consumed(tL2C_CCB* p_ccb);
+extern uint16_t l2cble_get_coc_tx_pdu_size(tL2C_CCB* p_ccb);
 extern tL2CAP_LE_RESULT_CODE l2ble_sec_access_req(const RawAddress& bd_addr,
                                                   uint16_t psm,
                                                   bool is_originator,
@@ -0,0 +1,234 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  This file contains the LE connection oriented channel data path: the
+ *  reassembly of received K-frames, the return of receive credits and the
+ *  segmentation size of transmitted SDUs.
+ *
+ ******************************************************************************/
+
+#include <base/logging.h>
+#include <log/log.h>
+#include <string.h>
+#include <algorithm>
+#include "bt_common.h"
+#include "bt_types.h"
+#include "l2c_int.h"
+#include "l2cdefs.h"
+#include "osi/include/time.h"
+
+/*******************************************************************************
+ *
+ * Function         l2cble_init_credit_batch
+ *
+ * Description      This function initializes the receive credit batching of
+ *                  an LE connection oriented channel.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+void l2cble_init_credit_batch(tL2C_CCB* p_ccb, uint16_t initial_credits) {
+  tL2C_LE_CREDIT_BATCH* p_batch = &p_ccb->credit_batch;
+
+  p_batch->initial_credits = initial_credits;
+  p_batch->consumed = 0;
+  p_batch->batch_size = std::max<uint16_t>(1, initial_credits / 4);
+  p_batch->window_pdus = 0;
+  p_batch->window_start_ms = time_get_os_boottime_ms();
+}
+
+/*******************************************************************************
+ *
+ * Function         l2cble_credit_consumed
+ *
+ * Description      This function accounts for a PDU received on an LE
+ *                  connection oriented channel. Credits are returned to the
+ *                  peer in batches sized to the number of PDUs drained per
+ *                  rate window, or as soon as the peer runs low on credits.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+void l2cble_credit_consumed(tL2C_CCB* p_ccb) {
+  tL2C_LE_CREDIT_BATCH* p_batch = &p_ccb->credit_batch;
+  uint16_t initial = p_batch->initial_credits;
+
+  if (initial == 0) {
+    initial = L2CAP_LE_CREDIT_DEFAULT;
+    l2cble_init_credit_batch(p_ccb, initial);
+  }
+
+  --p_ccb->remote_credit_count;
+  p_batch->consumed++;
+  p_batch->window_pdus++;
+
+  uint32_t now_ms = time_get_os_boottime_ms();
+  if (now_ms - p_batch->window_start_ms >= L2CAP_LE_CREDIT_RATE_WINDOW_MS) {
+    uint16_t min_batch = std::max<uint16_t>(1, initial / 8);
+    uint16_t max_batch = std::max<uint16_t>(1, initial / 2);
+
+    p_batch->batch_size =
+        std::min(std::max(p_batch->window_pdus, min_batch), max_batch);
+    p_batch->window_pdus = 0;
+    p_batch->window_start_ms = now_ms;
+  }
+
+  uint16_t low_watermark =
+      std::min<uint16_t>(L2CAP_LE_CREDIT_THRESHOLD, initial / 4);
+  if (p_batch->consumed < p_batch->batch_size &&
+      p_ccb->remote_credit_count > low_watermark)
+    return;
+
+  uint16_t credits = p_batch->consumed;
+  p_ccb->remote_credit_count += credits;
+  p_batch->consumed = 0;
+
+  /* Return back credits */
+  l2c_csm_execute(p_ccb, L2CEVT_L2CA_SEND_FLOW_CONTROL_CREDIT, &credits);
+}
+
+/*******************************************************************************
+ *
+ * Function         l2cble_get_coc_tx_pdu_size
+ *
+ * Description      This function returns the K-frame size used to segment
+ *                  SDUs of an LE connection oriented channel. When the
+ *                  peer MPS spans several link layer PDUs, K-frames are cut
+ *                  so that they fill whole link layer PDUs of the negotiated
+ *                  data length and leave no short trailing fragment.
+ *
+ * Returns          K-frame payload size
+ *
+ ******************************************************************************/
+uint16_t l2cble_get_coc_tx_pdu_size(tL2C_CCB* p_ccb) {
+  uint16_t mps = p_ccb->peer_conn_cfg.mps;
+  uint16_t ll_len = p_ccb->p_lcb ? p_ccb->p_lcb->tx_data_len : 0;
+
+  if (ll_len == 0 || (mps + L2CAP_PKT_OVERHEAD) <= ll_len) return mps;
+
+  uint16_t pdu_size =
+      ((mps + L2CAP_PKT_OVERHEAD) / ll_len) * ll_len - L2CAP_PKT_OVERHEAD;
+
+  return (pdu_size >= L2CAP_LE_MIN_MPS) ? pdu_size : mps;
+}
+
+/*******************************************************************************
+ *
+ * Function         l2c_lcc_proc_pdu
+ *
+ * Description      This function is the entry point for processing of a
+ *                  received PDU when in LE Coc flow control modes.
+ *
+ * Returns          -
+ *
+ ******************************************************************************/
+void l2c_lcc_proc_pdu(tL2C_CCB* p_ccb, BT_HDR* p_buf) {
+  CHECK(p_ccb != NULL);
+  CHECK(p_buf != NULL);
+  uint8_t* p = (uint8_t*)(p_buf + 1) + p_buf->offset;
+  uint16_t sdu_length;
+  BT_HDR* p_data = NULL;
+
+  /* Buffer length should not exceed local mps */
+  if (p_buf->len > p_ccb->local_conn_cfg.mps) {
+    /* Discard the buffer */
+    osi_free(p_buf);
+    return;
+  }
+
+  if (p_ccb->is_first_seg) {
+    if (p_buf->len < sizeof(sdu_length)) {
+      L2CAP_TRACE_ERROR("%s: buffer length=%d too small. Need at least 2.",
+                        __func__, p_buf->len);
+      android_errorWriteWithInfoLog(0x534e4554, "120665616", -1, NULL, 0);
+      /* Discard the buffer */
+      osi_free(p_buf);
+      return;
+    }
+    STREAM_TO_UINT16(sdu_length, p);
+
+    /* Check the SDU Length with local MTU size */
+    if (sdu_length > p_ccb->local_conn_cfg.mtu) {
+      /* Discard the buffer */
+      osi_free(p_buf);
+      return;
+    }
+
+    p_buf->len -= sizeof(sdu_length);
+    p_buf->offset += sizeof(sdu_length);
+
+    if (sdu_length < p_buf->len) {
+      L2CAP_TRACE_ERROR("%s: Invalid sdu_length: %d", __func__, sdu_length);
+      android_errorWriteWithInfoLog(0x534e4554, "112321180", -1, NULL, 0);
+      /* Discard the buffer */
+      osi_free(p_buf);
+      return;
+    }
+
+    if (sdu_length == p_buf->len) {
+      /* Whole SDU in a single K-frame, pass the received buffer up as is */
+      l2c_csm_execute(p_ccb, L2CEVT_L2CAP_DATA, p_buf);
+      return;
+    }
+
+    /* Reassembly buffer sized to the announced SDU, not the max buffer */
+    p_data = (BT_HDR*)osi_malloc(sizeof(BT_HDR) + sdu_length);
+
+    p_ccb->ble_sdu = p_data;
+    p_data->len = 0;
+    p_ccb->ble_sdu_length = sdu_length;
+    L2CAP_TRACE_DEBUG("%s SDU Length = %d", __func__, sdu_length);
+    p_data->offset = 0;
+
+  } else {
+    p_data = p_ccb->ble_sdu;
+    if (p_buf->len > (p_ccb->ble_sdu_length - p_data->len)) {
+      L2CAP_TRACE_ERROR("%s: buffer length=%d too big. max=%d. Dropped",
+                        __func__, p_data->len,
+                        (p_ccb->ble_sdu_length - p_data->len));
+      android_errorWriteWithInfoLog(0x534e4554, "75298652", -1, NULL, 0);
+      osi_free(p_buf);
+
+      /* Throw away all pending fragments and disconnects */
+      p_ccb->is_first_seg = true;
+      osi_free(p_ccb->ble_sdu);
+      p_ccb->ble_sdu = NULL;
+      p_ccb->ble_sdu_length = 0;
+      l2cu_disconnect_chnl(p_ccb);
+      return;
+    }
+  }
+
+  memcpy((uint8_t*)(p_data + 1) + p_data->offset + p_data->len,
+         (uint8_t*)(p_buf + 1) + p_buf->offset, p_buf->len);
+  p_data->len += p_buf->len;
+  p = (uint8_t*)(p_data + 1) + p_data->offset;
+  if (p_data->len == p_ccb->ble_sdu_length) {
+    l2c_csm_execute(p_ccb, L2CEVT_L2CAP_DATA, p_data);
+    p_ccb->is_first_seg = true;
+    p_ccb->ble_sdu = NULL;
+    p_ccb->ble_sdu_length = 0;
+  } else if (p_data->len < p_ccb->ble_sdu_length) {
+    p_ccb->is_first_seg = false;
+  }
+
+  osi_free(p_buf);
+  return;
+}
@@ -744,15 +744,11 @@ void l2c_info_resp_timer_timeout(void* data) {
  *
  ******************************************************************************/
 void l2c_link_adjust_allocation(void) {
-  uint16_t qq, yy, qq_remainder;
-  tL2C_LCB* p_lcb;
-  uint16_t hi_quota, low_quota;
-  uint16_t num_lowpri_links = 0;
-  uint16_t num_hipri_links = 0;
-  uint16_t controller_xmit_quota;
-  uint16_t high_pri_link_quota = controller_xmit_quota = l2cb.num_lm_acl_bufs;
+  tL2C_LINK_QUOTA* p_quota = &l2cb.link_quota;
   bool is_share_buffer =
       (l2cb.num_lm_ble_bufs == L2C_DEF_NUM_BLE_BUF_SHARED) ? true : false;
+  uint16_t num_links = l2cb.num_links_active;
+  uint16_t num_hipri_links = l2cb.num_hipri_links;
 
   /* If no links active, reset buffer quotas and controller buffers */
   if (l2cb.num_links_active == 0) {
@@ -761,105 +757,121 @@ void l2c_link_adjust_allocation(void) {
     return;
   }
 
-  /* First, count the links */
-  for (yy = 0, p_lcb = &l2cb.lcb_pool[0]; yy < MAX_L2CAP_LINKS; yy++, p_lcb++) {
-    if (p_lcb->in_use &&
-        (is_share_buffer || p_lcb->transport != BT_TRANSPORT_LE)) {
-      if (p_lcb->acl_priority == L2CAP_PRIORITY_HIGH)
-        num_hipri_links++;
-      else
-        num_lowpri_links++;
-    }
-  }
-
-  if ((l2cb.num_links_active > 1) ||(btif_av_is_split_a2dp_enabled())) {
-    high_pri_link_quota = L2CAP_HIGH_PRI_MIN_XMIT_QUOTA_A;
+  if (is_share_buffer) {
+    num_links += l2cb.num_ble_links_active;
+    num_hipri_links += l2cb.num_ble_hipri_links;
   }
 
-  /* now adjust high priority link quota */
-  low_quota = num_lowpri_links ? 1 : 0;
-  while ((num_hipri_links * high_pri_link_quota + low_quota) >
-         controller_xmit_quota)
-    high_pri_link_quota--;
+  p_quota->num_bufs = l2cb.num_lm_acl_bufs;
+  p_quota->hi_pri_quota = l2cb.num_lm_acl_bufs;
+  if ((l2cb.num_links_active > 1) || (btif_av_is_split_a2dp_enabled()))
+    p_quota->hi_pri_quota = L2CAP_HIGH_PRI_MIN_XMIT_QUOTA_A;
+  /*Adjust high pri link with min 3 buffers*/
+  p_quota->hi_pri_min_quota = HI_PRI_LINK_QUOTA;
+  p_quota->low_min_quota = 1;
+  p_quota->num_hipri_links = num_hipri_links;
+  p_quota->num_lowpri_links = num_links - num_hipri_links;
+
+  l2c_link_apply_quota(p_quota, false, is_share_buffer, &l2cb.round_robin_quota,
+                       &l2cb.round_robin_unacked);
+}
 
-    /*Adjust high pri link with min 3 buffers*/
-  if (num_hipri_links > 0) {
-    if (high_pri_link_quota < HI_PRI_LINK_QUOTA) {
-      high_pri_link_quota  = HI_PRI_LINK_QUOTA;
-    }
-  }
-  /* Work out the xmit quota and buffer quota high and low priorities */
-  hi_quota = num_hipri_links * high_pri_link_quota;
-  low_quota =
-      (hi_quota < controller_xmit_quota) ? controller_xmit_quota - hi_quota : 1;
+/*******************************************************************************
+ *
+ * Function         l2c_link_apply_quota
+ *
+ * Description      Works out the quotas of the links sharing the LE buffers
+ *                  if |is_ble|, or the BR/EDR ones (and the LE ones if
+ *                  |is_share_buffer|), and updates the links whose quota
+ *                  changed. The round-robin state is only reset when the
+ *                  links stop going round-robin.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+void l2c_link_apply_quota(tL2C_LINK_QUOTA* p_quota, bool is_ble,
+                          bool is_share_buffer, uint16_t* p_round_robin_quota,
+                          uint16_t* p_round_robin_unacked) {
+  uint16_t yy, num_with_extra = 0;
+  int last_granted = -1;
+  tL2C_LCB* p_lcb;
 
-  /* Work out and save the HCI xmit quota for each low priority link */
+  l2c_link_quota_compute(p_quota);
 
-  /* If each low priority link cannot have at least one buffer */
-  if (num_lowpri_links > low_quota) {
-    l2cb.round_robin_quota = low_quota;
-    qq = qq_remainder = 1;
-  }
-  /* If each low priority link can have at least one buffer */
-  else if (num_lowpri_links > 0) {
-    l2cb.round_robin_quota = 0;
-    l2cb.round_robin_unacked = 0;
-    qq = low_quota / num_lowpri_links;
-    qq_remainder = low_quota % num_lowpri_links;
-  }
-  /* If no low priority link */
-  else {
-    l2cb.round_robin_quota = 0;
-    l2cb.round_robin_unacked = 0;
-    qq = qq_remainder = 1;
+  if (p_quota->round_robin_quota != 0) {
+    *p_round_robin_quota = p_quota->round_robin_quota;
+  } else if (*p_round_robin_quota != 0) {
+    *p_round_robin_quota = 0;
+    *p_round_robin_unacked = 0;
   }
 
   L2CAP_TRACE_EVENT(
-      "l2c_link_adjust_allocation  num_hipri: %u  num_lowpri: %u  low_quota: "
-      "%u  round_robin_quota: %u  qq: %u",
-      num_hipri_links, num_lowpri_links, low_quota, l2cb.round_robin_quota, qq);
+      "%s: %s num_hipri: %u  num_lowpri: %u  low_quota: %u  "
+      "round_robin_quota: %u  qq: %u  extra: %u",
+      __func__, is_ble ? "LE" : "BR/EDR", p_quota->num_hipri_links,
+      p_quota->num_lowpri_links, p_quota->low_quota, *p_round_robin_quota,
+      p_quota->low_link_quota, p_quota->num_low_extra);
 
-  /* Now, assign the quotas to each link */
+  /* Count the low priority links keeping their extra buffer */
   for (yy = 0, p_lcb = &l2cb.lcb_pool[0]; yy < MAX_L2CAP_LINKS; yy++, p_lcb++) {
-    if (p_lcb->in_use &&
-        (is_share_buffer || p_lcb->transport != BT_TRANSPORT_LE)) {
-      if (p_lcb->acl_priority == L2CAP_PRIORITY_HIGH) {
-        p_lcb->link_xmit_quota = high_pri_link_quota;
-      } else {
-        /* Safety check in case we switched to round-robin with something
-         * outstanding */
-        /* if sent_not_acked is added into round_robin_unacked then don't add it
-         * again */
-        /* l2cap keeps updating sent_not_acked for exiting from round robin */
-        if ((p_lcb->link_xmit_quota > 0) && (qq == 0))
-          l2cb.round_robin_unacked += p_lcb->sent_not_acked;
-
-        p_lcb->link_xmit_quota = qq;
-        if (qq_remainder > 0) {
-          p_lcb->link_xmit_quota++;
-          qq_remainder--;
-        }
-      }
+    if (!p_lcb->in_use ||
+        (is_ble ? p_lcb->transport != BT_TRANSPORT_LE
+                : !is_share_buffer && p_lcb->transport == BT_TRANSPORT_LE))
+      continue;
+    if (p_lcb->acl_priority != L2CAP_PRIORITY_HIGH &&
+        l2c_link_quota_has_extra(p_quota, p_lcb->link_xmit_quota))
+      num_with_extra++;
+  }
 
-      L2CAP_TRACE_EVENT(
-          "l2c_link_adjust_allocation LCB %d   Priority: %d  XmitQuota: %d", yy,
-          p_lcb->acl_priority, p_lcb->link_xmit_quota);
-
-      L2CAP_TRACE_EVENT("        SentNotAcked: %d  RRUnacked: %d",
-                        p_lcb->sent_not_acked, l2cb.round_robin_unacked);
-
-      /* There is a special case where we have readjusted the link quotas and */
-      /* this link may have sent anything but some other link sent packets so */
-      /* so we may need a timer to kick off this link's transmissions. */
-      if ((p_lcb->link_state == LST_CONNECTED) &&
-          (!list_is_empty(p_lcb->link_xmit_data_q)) &&
-          (p_lcb->sent_not_acked < p_lcb->link_xmit_quota)) {
-        alarm_set_on_mloop(p_lcb->l2c_lcb_timer,
-                           L2CAP_LINK_FLOW_CONTROL_TIMEOUT_MS,
-                           l2c_lcb_timer_timeout, p_lcb);
-      }
+  /* Now, assign the quotas to each link, starting after the last one which
+   * got an extra buffer */
+  l2c_link_quota_start(p_quota, num_with_extra);
+  for (yy = 0; yy < MAX_L2CAP_LINKS; yy++) {
+    uint16_t idx = (p_quota->extra_start + yy) % MAX_L2CAP_LINKS;
+    uint16_t quota;
+
+    p_lcb = &l2cb.lcb_pool[idx];
+    if (!p_lcb->in_use ||
+        (is_ble ? p_lcb->transport != BT_TRANSPORT_LE
+                : !is_share_buffer && p_lcb->transport == BT_TRANSPORT_LE))
+      continue;
+
+    quota = l2c_link_quota_assign(p_quota,
+                                  p_lcb->acl_priority == L2CAP_PRIORITY_HIGH,
+                                  p_lcb->link_xmit_quota);
+    if (quota == p_lcb->link_xmit_quota) continue;
+
+    if (p_lcb->acl_priority != L2CAP_PRIORITY_HIGH &&
+        l2c_link_quota_has_extra(p_quota, quota))
+      last_granted = idx;
+
+    /* Safety check in case we switched to round-robin with something
+     * outstanding */
+    /* l2cap keeps updating sent_not_acked for exiting from round robin */
+    if ((p_lcb->link_xmit_quota > 0) && (quota == 0))
+      *p_round_robin_unacked += p_lcb->sent_not_acked;
+
+    p_lcb->link_xmit_quota = quota;
+
+    L2CAP_TRACE_EVENT("%s: LCB %d   Priority: %d  XmitQuota: %d", __func__,
+                      idx, p_lcb->acl_priority, p_lcb->link_xmit_quota);
+    L2CAP_TRACE_EVENT("        SentNotAcked: %d  RRUnacked: %d",
+                      p_lcb->sent_not_acked, *p_round_robin_unacked);
+
+    /* There is a special case where we have readjusted the link quotas and */
+    /* this link may have sent anything but some other link sent packets so */
+    /* so we may need a timer to kick off this link's transmissions. */
+    if ((p_lcb->link_state == LST_CONNECTED) &&
+        (!list_is_empty(p_lcb->link_xmit_data_q)) &&
+        (p_lcb->sent_not_acked < p_lcb->link_xmit_quota)) {
+      alarm_set_on_mloop(p_lcb->l2c_lcb_timer,
+                         L2CAP_LINK_FLOW_CONTROL_TIMEOUT_MS,
+                         l2c_lcb_timer_timeout, p_lcb);
     }
   }
+
+  if (last_granted >= 0)
+    p_quota->extra_start = (last_granted + 1) % MAX_L2CAP_LINKS;
 }
 
 /*******************************************************************************
@@ -1203,6 +1215,9 @@ static bool l2c_link_send_to_lower(tL2C_LCB* p_lcb, BT_HDR* p_buf,
   uint16_t xmit_window, acl_data_size;
   const controller_t* controller = controller_get_interface();
 
+  if (p_lcb->transport == BT_TRANSPORT_BR_EDR)
+    btm_pm_proc_acl_traffic(p_lcb->handle, true, p_buf->len);
+
   if ((p_buf->len <= controller->get_acl_packet_size_classic() &&
        (p_lcb->transport == BT_TRANSPORT_BR_EDR)) ||
       ((p_lcb->transport == BT_TRANSPORT_LE) &&
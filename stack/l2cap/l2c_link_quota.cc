@@ -0,0 +1,148 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  This file contains the allocation of the controller ACL buffers among the
+ *  links sharing them.
+ *
+ ******************************************************************************/
+
+#include "l2c_link_quota.h"
+
+/*******************************************************************************
+ *
+ * Function         l2c_link_quota_compute
+ *
+ * Description      Works out the quota of the high and low priority links.
+ *                  The high priority links get |hi_pri_quota| buffers each,
+ *                  less if there are not enough buffers for one more low
+ *                  priority link, but no less than |hi_pri_min_quota|. The
+ *                  low priority links share the rest, or go round-robin if
+ *                  they cannot have one buffer each.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+void l2c_link_quota_compute(tL2C_LINK_QUOTA* p_quota) {
+  uint16_t num_hipri_links = p_quota->num_hipri_links;
+  uint16_t num_lowpri_links = p_quota->num_lowpri_links;
+  uint16_t high_pri_link_quota = p_quota->hi_pri_quota;
+  uint16_t low_quota = num_lowpri_links ? 1 : 0;
+  uint16_t hi_quota;
+
+  while (high_pri_link_quota > 0 &&
+         (num_hipri_links * high_pri_link_quota + low_quota) >
+             p_quota->num_bufs)
+    high_pri_link_quota--;
+
+  if (num_hipri_links > 0 && high_pri_link_quota < p_quota->hi_pri_min_quota)
+    high_pri_link_quota = p_quota->hi_pri_min_quota;
+
+  hi_quota = num_hipri_links * high_pri_link_quota;
+  low_quota = (hi_quota < p_quota->num_bufs) ? p_quota->num_bufs - hi_quota : 1;
+
+  p_quota->high_pri_link_quota = high_pri_link_quota;
+  p_quota->low_quota = low_quota;
+
+  if (num_lowpri_links > low_quota) {
+    /* Not enough buffers for each low priority link */
+    p_quota->round_robin_quota = low_quota;
+    p_quota->low_link_quota = p_quota->num_low_extra = p_quota->low_min_quota;
+  } else if (num_lowpri_links > 0) {
+    p_quota->round_robin_quota = 0;
+    p_quota->low_link_quota = low_quota / num_lowpri_links;
+    p_quota->num_low_extra = low_quota % num_lowpri_links;
+  } else {
+    p_quota->round_robin_quota = 0;
+    p_quota->low_link_quota = p_quota->num_low_extra = p_quota->low_min_quota;
+  }
+}
+
+/*******************************************************************************
+ *
+ * Function         l2c_link_quota_has_extra
+ *
+ * Description      Tells whether a low priority link with |link_quota| has an
+ *                  extra buffer.
+ *
+ * Returns          true if it has one
+ *
+ ******************************************************************************/
+bool l2c_link_quota_has_extra(const tL2C_LINK_QUOTA* p_quota,
+                              uint16_t link_quota) {
+  return link_quota == p_quota->low_link_quota + 1;
+}
+
+/*******************************************************************************
+ *
+ * Function         l2c_link_quota_start
+ *
+ * Description      Starts assigning the quotas worked out by
+ *                  l2c_link_quota_compute(), |num_with_extra| of the low
+ *                  priority links having an extra buffer already.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+void l2c_link_quota_start(tL2C_LINK_QUOTA* p_quota, uint16_t num_with_extra) {
+  p_quota->extra_to_revoke = 0;
+  p_quota->extra_to_grant = 0;
+  if (num_with_extra > p_quota->num_low_extra)
+    p_quota->extra_to_revoke = num_with_extra - p_quota->num_low_extra;
+  else
+    p_quota->extra_to_grant = p_quota->num_low_extra - num_with_extra;
+  p_quota->num_adjusts++;
+}
+
+/*******************************************************************************
+ *
+ * Function         l2c_link_quota_assign
+ *
+ * Description      Assigns its quota to the next link. A low priority link
+ *                  keeps its extra buffer unless there are fewer of them now,
+ *                  in which case the first links passed lose theirs. The
+ *                  first links passed without an extra buffer get the new
+ *                  ones.
+ *
+ * Returns          the new quota of the link
+ *
+ ******************************************************************************/
+uint16_t l2c_link_quota_assign(tL2C_LINK_QUOTA* p_quota, bool high_pri,
+                               uint16_t link_quota) {
+  uint16_t new_quota;
+
+  if (high_pri) {
+    new_quota = p_quota->high_pri_link_quota;
+  } else if (l2c_link_quota_has_extra(p_quota, link_quota)) {
+    new_quota = p_quota->low_link_quota + 1;
+    if (p_quota->extra_to_revoke > 0) {
+      p_quota->extra_to_revoke--;
+      new_quota--;
+    }
+  } else {
+    new_quota = p_quota->low_link_quota;
+    if (p_quota->extra_to_grant > 0) {
+      p_quota->extra_to_grant--;
+      new_quota++;
+    }
+  }
+
+  if (new_quota != link_quota) p_quota->num_links_changed++;
+  return new_quota;
+}
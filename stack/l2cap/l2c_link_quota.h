@@ -0,0 +1,82 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  Allocation of the controller ACL buffers among the links sharing them.
+ *
+ *  The high and low priority link counts are kept up to date as links come
+ *  and go, so that the quotas are worked out without walking the links.
+ *  Applying them then only changes the links whose quota actually changes:
+ *  the low priority links which got one more buffer keep it as long as
+ *  there are buffers to spare, and the spare buffers go round the links
+ *  rather than always to the first ones.
+ *
+ ******************************************************************************/
+#ifndef L2C_LINK_QUOTA_H
+#define L2C_LINK_QUOTA_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct {
+  /* Set by the owner of the buffers */
+  uint16_t num_bufs;         /* Controller buffers shared by the links */
+  uint16_t hi_pri_quota;     /* Quota wanted for a high priority link */
+  uint16_t hi_pri_min_quota; /* Least quota of a high priority link */
+  uint16_t low_min_quota;    /* Quota of the low priority links when they
+                                cannot have one buffer each, 0 for
+                                round-robin */
+  uint16_t num_hipri_links;
+  uint16_t num_lowpri_links;
+
+  /* Worked out by l2c_link_quota_compute() */
+  uint16_t high_pri_link_quota; /* Quota of each high priority link */
+  uint16_t low_quota;           /* Buffers left to the low priority links */
+  uint16_t low_link_quota;      /* Quota of each low priority link */
+  uint16_t num_low_extra;       /* Low priority links with one more buffer */
+  uint16_t round_robin_quota;   /* Round-robin link quota */
+
+  /* Distribution of the extra buffers by l2c_link_quota_assign() */
+  uint16_t extra_to_revoke;
+  uint16_t extra_to_grant;
+  uint8_t extra_start; /* Link the distribution starts from */
+
+  /* Statistics */
+  uint32_t num_adjusts;       /* Quota adjustments */
+  uint32_t num_links_changed; /* Link quotas changed by them */
+} tL2C_LINK_QUOTA;
+
+/* Works out the quotas from the buffer and link counts. */
+extern void l2c_link_quota_compute(tL2C_LINK_QUOTA* p_quota);
+
+/* Tells whether a low priority link with |link_quota| has an extra buffer. */
+extern bool l2c_link_quota_has_extra(const tL2C_LINK_QUOTA* p_quota,
+                                     uint16_t link_quota);
+
+/* Starts assigning the quotas, |num_with_extra| low priority links having an
+ * extra buffer. The links are then passed to l2c_link_quota_assign() one
+ * after the other, starting from |extra_start|. */
+extern void l2c_link_quota_start(tL2C_LINK_QUOTA* p_quota,
+                                 uint16_t num_with_extra);
+
+/* Returns the quota of a link which had |link_quota|. */
+extern uint16_t l2c_link_quota_assign(tL2C_LINK_QUOTA* p_quota, bool high_pri,
+                                      uint16_t link_quota);
+
+#endif /* L2C_LINK_QUOTA_H */
@@ -138,6 +138,9 @@ void l2c_rcv_acl_data(BT_HDR* p_msg) {
   STREAM_TO_UINT16(hci_len, p);
   p_msg->offset += 4;
 
+  if (p_lcb && p_lcb->transport == BT_TRANSPORT_BR_EDR)
+    btm_pm_proc_acl_traffic(handle, false, hci_len);
+
   if (hci_len < L2CAP_PKT_OVERHEAD) {
     /* Must receive at least the L2CAP length and CID */
     L2CAP_TRACE_WARNING("L2CAP - got incorrect hci header");
@@ -228,18 +231,9 @@ void l2c_rcv_acl_data(BT_HDR* p_msg) {
       if (p_lcb->transport == BT_TRANSPORT_LE) {
         l2c_lcc_proc_pdu(p_ccb, p_msg);
 
-        /* The remote device has one less credit left */
-        --p_ccb->remote_credit_count;
-        // Got a pkt, valid send out credits to the peer device
-
-        /* If the credits left on the remote device are getting low, send some */
-        if (p_ccb->remote_credit_count <= L2CAP_LE_CREDIT_THRESHOLD) {
-          uint16_t credits = L2CAP_LE_CREDIT_DEFAULT - p_ccb->remote_credit_count;
-          p_ccb->remote_credit_count = L2CAP_LE_CREDIT_DEFAULT;
-
-          /* Return back credits */
-          l2c_csm_execute(p_ccb, L2CEVT_L2CA_SEND_FLOW_CONTROL_CREDIT, &credits);
-        }
+        /* The remote device has one less credit left, return them in
+         * batches sized to how fast we drain the channel */
+        l2cble_credit_consumed(p_ccb);
       } else {
         /* Basic mode packets go straight to the state machine */
         if (p_ccb->peer_cfg.fcr.mode == L2CAP_FCR_BASIC_MODE)
@@ -211,10 +211,15 @@ void l2cu_release_lcb(tL2C_LCB* p_lcb) {
   /* Re-adjust flow control windows make sure it does not go negative */
   if (p_lcb->transport == BT_TRANSPORT_LE) {
     if (l2cb.num_ble_links_active >= 1) l2cb.num_ble_links_active--;
+    if (p_lcb->acl_priority == L2CAP_PRIORITY_HIGH &&
+        l2cb.num_ble_hipri_links >= 1)
+      l2cb.num_ble_hipri_links--;
 
     l2c_ble_link_adjust_allocation();
   } else {
     if (l2cb.num_links_active >= 1) l2cb.num_links_active--;
+    if (p_lcb->acl_priority == L2CAP_PRIORITY_HIGH && l2cb.num_hipri_links >= 1)
+      l2cb.num_hipri_links--;
 
     l2c_link_adjust_allocation();
   }
@@ -1462,6 +1467,7 @@ tL2C_CCB* l2cu_allocate_ccb(tL2C_LCB* p_lcb, uint16_t cid) {
 
   p_ccb->bypass_fcs = 0;
   memset(&p_ccb->ertm_info, 0, sizeof(tL2CAP_ERTM_INFO));
+  memset(&p_ccb->credit_batch, 0, sizeof(tL2C_LE_CREDIT_BATCH));
   p_ccb->peer_cfg_already_rejected = false;
   p_ccb->fcr_cfg_tries = L2CAP_MAX_FCR_CFG_TRIES;
 
@@ -2240,16 +2246,7 @@ bool l2cu_create_conn(tL2C_LCB* p_lcb, tBT_TRANSPORT transport,
  *
  ******************************************************************************/
 uint8_t l2cu_get_num_hi_priority(void) {
-  uint8_t no_hi = 0;
-  int xx;
-  tL2C_LCB* p_lcb = &l2cb.lcb_pool[0];
-
-  for (xx = 0; xx < MAX_L2CAP_LINKS; xx++, p_lcb++) {
-    if ((p_lcb->in_use) && (p_lcb->acl_priority == L2CAP_PRIORITY_HIGH)) {
-      no_hi++;
-    }
-  }
-  return no_hi;
+  return l2cb.num_hipri_links + l2cb.num_ble_hipri_links;
 }
 
 /*******************************************************************************
@@ -2442,6 +2439,14 @@ bool l2cu_set_acl_priority(const RawAddress& bd_addr, uint8_t priority,
 
   /* Adjust lmp buffer allocation for this channel if priority changed */
   if (p_lcb->acl_priority != priority) {
+    uint16_t* p_num_hipri_links = (p_lcb->transport == BT_TRANSPORT_LE)
+                                      ? &l2cb.num_ble_hipri_links
+                                      : &l2cb.num_hipri_links;
+    if (priority == L2CAP_PRIORITY_HIGH)
+      (*p_num_hipri_links)++;
+    else if (*p_num_hipri_links >= 1)
+      (*p_num_hipri_links)--;
+
     p_lcb->acl_priority = priority;
     l2c_link_adjust_allocation();
   }
@@ -474,9 +474,7 @@ tPAN_RESULT PAN_Write(uint16_t handle, const RawAddress& dst,
     return PAN_SUCCESS;
   }
 
-  BT_HDR* buffer = (BT_HDR*)osi_malloc(PAN_BUF_SIZE);
-  buffer->len = len;
-  buffer->offset = PAN_MINIMUM_OFFSET;
+  BT_HDR* buffer = BNEP_AllocBuf(len);
   memcpy((uint8_t*)buffer + sizeof(BT_HDR) + buffer->offset, p_data,
          buffer->len);
 
@@ -519,15 +517,23 @@ tPAN_RESULT PAN_WriteBuf(uint16_t handle, const RawAddress& dst,
     return PAN_FAILURE;
   }
 
-  /* Check if it is broadcast or multicast packet */
+  /* Check if it is broadcast or multicast packet. The last connection
+   * gets the buffer itself, the others a copy: with a single connection,
+   * as on PANU side, nothing is copied. */
   if (dst.address[0] & 0x01) {
     uint8_t* data = (uint8_t*)p_buf + sizeof(BT_HDR) + p_buf->offset;
+    tPAN_CONN* last_pcb = NULL;
     for (i = 0; i < MAX_PAN_CONNS; ++i) {
-      if (pan_cb.pcb[i].con_state == PAN_STATE_CONNECTED)
-        BNEP_Write(pan_cb.pcb[i].handle, dst, data, p_buf->len, protocol, &src,
+      if (pan_cb.pcb[i].con_state != PAN_STATE_CONNECTED) continue;
+      if (last_pcb)
+        BNEP_Write(last_pcb->handle, dst, data, p_buf->len, protocol, &src,
                    ext);
+      last_pcb = &pan_cb.pcb[i];
     }
-    osi_free(p_buf);
+    if (last_pcb)
+      BNEP_WriteBuf(last_pcb->handle, dst, p_buf, protocol, &src, ext);
+    else
+      osi_free(p_buf);
     return PAN_SUCCESS;
   }
 
@@ -543,12 +543,12 @@ void pan_data_buf_ind_cb(uint16_t handle, const RawAddress& src,
           "%s - destination PANU found on handle %d and sending data, len: %d",
           __func__, dst_pcb->handle, len);
 
+      /* the buffer is forwarded as is, BNEP takes it */
       result =
-          BNEP_Write(dst_pcb->handle, dst, p_data, len, protocol, &src, ext);
+          BNEP_WriteBuf(dst_pcb->handle, dst, p_buf, protocol, &src, ext);
       if (result != BNEP_SUCCESS && result != BNEP_IGNORE_CMD)
         PAN_TRACE_ERROR("Failed to write data for PAN connection handle %d",
                         dst_pcb->handle);
-      osi_free(p_buf);
       return;
     }
   }
@@ -575,6 +575,8 @@ void smp_proc_pair_cmd(tSMP_CB* p_cb, tSMP_INT_DATA* p_data) {
       p_cb->local_i_key &= p_cb->peer_i_key;
       p_cb->local_r_key &= p_cb->peer_r_key;
       p_cb->selected_association_model = smp_select_association_model(p_cb);
+      /* the key pair is ready by the time the public keys are exchanged */
+      if (p_cb->le_secure_connections_mode_is_used) smp_precompute_key_pair();
 
       if (p_cb->secure_connections_only_mode_required &&
           (!(p_cb->le_secure_connections_mode_is_used) ||
@@ -598,6 +600,7 @@ void smp_proc_pair_cmd(tSMP_CB* p_cb, tSMP_INT_DATA* p_data) {
   } else /* Master receives pairing response */
   {
     p_cb->selected_association_model = smp_select_association_model(p_cb);
+    if (p_cb->le_secure_connections_mode_is_used) smp_precompute_key_pair();
 
     if (p_cb->secure_connections_only_mode_required &&
         (!(p_cb->le_secure_connections_mode_is_used) ||
@@ -1441,6 +1444,7 @@ void smp_process_io_response(tSMP_CB* p_cb, tSMP_INT_DATA* p_data) {
   {
     /* pairing started by peer (master) Pairing Request */
     p_cb->selected_association_model = smp_select_association_model(p_cb);
+    if (p_cb->le_secure_connections_mode_is_used) smp_precompute_key_pair();
 
     if (p_cb->secure_connections_only_mode_required &&
         (!(p_cb->le_secure_connections_mode_is_used) ||
@@ -1529,15 +1533,25 @@ void smp_idle_terminate(tSMP_CB* p_cb, tSMP_INT_DATA* p_data) {
  * Description  The function is called when both local and peer public keys are
  *              saved.
  *              Actions:
- *              - invokes DHKey computation;
- *              - on slave side invokes sending local public key to the peer.
- *              - invokes SC phase 1 process.
+ *              - invokes DHKey computation, which completes in
+ *                smp_dhkey_computed.
  ******************************************************************************/
 void smp_both_have_public_keys(tSMP_CB* p_cb, tSMP_INT_DATA* p_data) {
   SMP_TRACE_DEBUG("%s", __func__);
 
   /* invokes DHKey computation */
   smp_compute_dhkey(p_cb);
+}
+
+/*******************************************************************************
+ * Function     smp_dhkey_computed
+ * Description  The function is called when the DHKey is computed.
+ *              Actions:
+ *              - on slave side invokes sending local public key to the peer.
+ *              - invokes SC phase 1 process.
+ ******************************************************************************/
+void smp_dhkey_computed(tSMP_CB* p_cb) {
+  SMP_TRACE_DEBUG("%s", __func__);
 
   /* on slave side invokes sending local public key to the peer */
   if (p_cb->role == HCI_ROLE_SLAVE) smp_send_pair_public_key(p_cb, NULL);
@@ -100,6 +100,7 @@ void SMP_Init(void) {
   SMP_TRACE_EVENT("%s", __func__);
 
   smp_l2cap_if_init();
+  smp_crypto_init();
   /* initialization of P-256 parameters */
   p_256_init_curve(KEY_LENGTH_DWORDS_P256);
 
@@ -187,6 +188,7 @@ tSMP_STATUS SMP_Pair(const RawAddress& bd_addr) {
   } else {
     p_cb->flags = SMP_PAIR_FLAGS_WE_STARTED_DD;
     p_cb->pairing_bda = bd_addr;
+    smp_precompute_key_pair();
 
     if (!L2CA_ConnectFixedChnl(L2CAP_SMP_CID, bd_addr)) {
       tSMP_INT_DATA smp_int_data;
@@ -0,0 +1,95 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  This file contains the SMP crypto worker thread, see smp_crypto_worker.h.
+ *
+ ******************************************************************************/
+
+#include "smp_crypto_worker.h"
+
+#include <string.h>
+
+#include <memory>
+#include <utility>
+
+SmpCryptoWorker::SmpCryptoWorker(PostTask post)
+    : post_(std::move(post)), thread_(&SmpCryptoWorker::Run, this) {}
+
+SmpCryptoWorker::~SmpCryptoWorker() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+    jobs_.clear();
+  }
+  cv_.notify_one();
+  thread_.join();
+}
+
+void SmpCryptoWorker::Submit(Task job, Task done) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    jobs_.push_back({std::move(job), std::move(done)});
+  }
+  cv_.notify_one();
+}
+
+void SmpCryptoWorker::PointMult(const Point& point, const uint8_t* private_key,
+                                PointCallback done) {
+  struct PointMultJob {
+    Point point;
+    uint32_t private_key[KEY_LENGTH_DWORDS_P256];
+    Point product;
+  };
+
+  std::shared_ptr<PointMultJob> job = std::make_shared<PointMultJob>();
+  job->point = point;
+  memcpy(job->private_key, private_key, sizeof(job->private_key));
+
+  Submit(
+      [job]() {
+        ECC_PointMult(&job->product, &job->point, job->private_key,
+                      KEY_LENGTH_DWORDS_P256);
+      },
+      [job, done]() { done(job->product); });
+}
+
+size_t SmpCryptoWorker::pending() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return jobs_.size() + (running_ ? 1 : 0);
+}
+
+void SmpCryptoWorker::Run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    cv_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+    if (stopping_) return;
+
+    Job job = std::move(jobs_.front());
+    jobs_.pop_front();
+    running_ = true;
+    lock.unlock();
+
+    job.job();
+    post_(std::move(job.done));
+
+    lock.lock();
+    running_ = false;
+  }
+}
@@ -0,0 +1,87 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  Worker thread for the P-256 point multiplications of LE Secure
+ *  Connections pairing: the local public key and the DHKey. Each takes
+ *  milliseconds, and run on the stack thread they hold up every other
+ *  profile and the ACL data of all links for as long.
+ *
+ *  Jobs run one at a time, in the order submitted. Their completions are
+ *  handed back through the post function given at construction, so that
+ *  the SMP state machine is only ever driven from the stack thread.
+ *
+ ******************************************************************************/
+#ifndef SMP_CRYPTO_WORKER_H
+#define SMP_CRYPTO_WORKER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "p_256_ecc_pp.h"
+
+class SmpCryptoWorker {
+ public:
+  using Task = std::function<void()>;
+  using PostTask = std::function<void(Task)>;
+  using PointCallback = std::function<void(const Point&)>;
+
+  /* |post| is called on the worker thread with the completions, to run
+   * them on the thread the jobs are submitted from. */
+  explicit SmpCryptoWorker(PostTask post);
+
+  /* Waits for the job running, if any, whose completion is still posted.
+   * The jobs queued behind it are dropped. */
+  ~SmpCryptoWorker();
+
+  /* Runs |job| on the worker, then posts |done|. */
+  void Submit(Task job, Task done);
+
+  /* Multiplies |point| by |private_key|, a little endian 32 octet scalar,
+   * and posts |done| with the product. Both are copied. */
+  void PointMult(const Point& point, const uint8_t* private_key,
+                 PointCallback done);
+
+  /* Jobs queued or running */
+  size_t pending();
+
+ private:
+  struct Job {
+    Task job;
+    Task done;
+  };
+
+  void Run();
+
+  PostTask post_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<Job> jobs_;
+  bool running_ = false;
+  bool stopping_ = false;
+  std::thread thread_;
+};
+
+#endif /* SMP_CRYPTO_WORKER_H */
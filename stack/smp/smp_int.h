@@ -336,6 +336,7 @@ typedef struct {
   uint8_t cert_failure; /*failure case for certification */
   alarm_t* delayed_auth_timer_ent;
   uint8_t cert_disable_h7_support;
+  uint32_t crypto_job; /* key computation the pairing waits for, or 0 */
 } tSMP_CB;
 
 /* Server Action functions are of this type */
@@ -403,6 +404,7 @@ extern void smp_proc_srk_info(tSMP_CB* p_cb, tSMP_INT_DATA* p_data);
 extern void smp_generate_csrk(tSMP_CB* p_cb, tSMP_INT_DATA* p_data);
 extern void smp_key_pick_key(tSMP_CB* p_cb, tSMP_INT_DATA* p_data);
 extern void smp_both_have_public_keys(tSMP_CB* p_cb, tSMP_INT_DATA* p_data);
+extern void smp_dhkey_computed(tSMP_CB* p_cb);
 extern void smp_start_secure_connection_phase1(tSMP_CB* p_cb,
                                                tSMP_INT_DATA* p_data);
 extern void smp_process_local_nonce(tSMP_CB* p_cb, tSMP_INT_DATA* p_data);
@@ -483,6 +485,9 @@ extern void smp_generate_rand_cont(tSMP_CB* p_cb, tSMP_INT_DATA* p_data);
 extern void smp_create_private_key(tSMP_CB* p_cb, tSMP_INT_DATA* p_data);
 extern void smp_use_oob_private_key(tSMP_CB* p_cb, tSMP_INT_DATA* p_data);
 extern void smp_compute_dhkey(tSMP_CB* p_cb);
+extern void smp_crypto_init(void);
+extern void smp_precompute_key_pair(void);
+extern void smp_discard_used_key_pair(void);
 extern void smp_calculate_local_commitment(tSMP_CB* p_cb);
 extern Octet16 smp_calculate_peer_commitment(tSMP_CB* p_cb);
 extern void smp_calculate_numeric_comparison_display_number(
@@ -32,10 +32,12 @@
 #include "btm_ble_api.h"
 #include "btm_ble_int.h"
 #include "btm_int.h"
+#include "btu.h"
 #include "device/include/controller.h"
 #include "hcimsgs.h"
 #include "osi/include/osi.h"
 #include "p_256_ecc_pp.h"
+#include "smp_crypto_worker.h"
 #include "smp_int.h"
 #include "stack/crypto_toolbox/crypto_toolbox.h"
 #include "stack_config.h"
@@ -49,9 +51,35 @@ using crypto_toolbox::aes_128;
 #define SMP_MAX_ENC_REPEAT 3
 #endif
 
+/* Pairings a precomputed local key pair is used in before it is replaced.
+ * The specification recommends a new key pair for each pairing, which is
+ * the default: the gain is in computing it ahead of the pairing. */
+#ifndef SMP_KEY_PAIR_MAX_USES
+#define SMP_KEY_PAIR_MAX_USES 1
+#endif
+
 static void smp_process_stk(tSMP_CB* p_cb, Octet16* p);
 static Octet16 smp_calculate_legacy_short_term_key(tSMP_CB* p_cb);
 static void smp_process_private_key(tSMP_CB* p_cb);
+static void smp_process_public_key(tSMP_CB* p_cb);
+
+/* Worker running the P-256 point multiplications off the stack thread */
+static SmpCryptoWorker* smp_crypto_worker = NULL;
+
+/* Last key computation started, see tSMP_CB.crypto_job */
+static uint32_t smp_crypto_last_job = 0;
+
+/* Local key pair computed ahead of pairing */
+static struct {
+  bool ready;
+  bool pending;        /* being computed */
+  uint8_t uses;        /* pairings it was used in */
+  uint8_t rand_len;    /* private key octets received so far */
+  uint32_t job;        /* computation of the pairing waiting for it, or 0 */
+  uint32_t generation; /* changed to drop a computation in progress */
+  BT_OCTET32 private_key;
+  tSMP_PUBLIC_KEY public_key;
+} smp_key_pair;
 
 #define SMP_PASSKEY_MASK 0xfff00000
 
@@ -607,14 +635,205 @@ Octet16 smp_calculate_legacy_short_term_key(tSMP_CB* p_cb) {
   return aes_128(p_cb->tk, text);
 }
 
+/*******************************************************************************
+ *
+ * Function         smp_post_task
+ *
+ * Description      This function posts a completion of the crypto worker to
+ *                  the stack thread. It is called on the worker thread.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+static void smp_post_task(SmpCryptoWorker::Task task) {
+  base::MessageLoop* message_loop = get_message_loop();
+  if (message_loop == nullptr) {
+    SMP_TRACE_WARNING("%s: stack thread is gone, completion dropped",
+                      __func__);
+    return;
+  }
+
+  message_loop->task_runner()->PostTask(
+      FROM_HERE,
+      base::Bind([](SmpCryptoWorker::Task task) { task(); }, std::move(task)));
+}
+
+/*******************************************************************************
+ *
+ * Function         smp_crypto_init
+ *
+ * Description      This function starts the crypto worker, and drops the
+ *                  computations left over by a previous one.
+ *                  It is called before the P-256 parameters are set, for no
+ *                  previous worker to read them while they are.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+void smp_crypto_init(void) {
+  uint32_t generation = smp_key_pair.generation + 1;
+
+  delete smp_crypto_worker;
+  smp_crypto_worker = new SmpCryptoWorker(smp_post_task);
+
+  memset(&smp_key_pair, 0, sizeof(smp_key_pair));
+  smp_key_pair.generation = generation;
+}
+
+/*******************************************************************************
+ *
+ * Function         smp_crypto_job_start
+ *
+ * Description      This function marks a key computation as started for the
+ *                  pairing in progress.
+ *
+ * Returns          the job identifying the computation
+ *
+ ******************************************************************************/
+static uint32_t smp_crypto_job_start(tSMP_CB* p_cb) {
+  if (++smp_crypto_last_job == 0) smp_crypto_last_job++;
+  p_cb->crypto_job = smp_crypto_last_job;
+  return smp_crypto_last_job;
+}
+
+/*******************************************************************************
+ *
+ * Function         smp_crypto_job_done
+ *
+ * Description      This function checks that a completed key computation is
+ *                  the one the pairing waits for. It is not when the pairing
+ *                  ended in the meantime, the control block cleared.
+ *
+ * Returns          true if the pairing is to go on with the result
+ *
+ ******************************************************************************/
+static bool smp_crypto_job_done(tSMP_CB* p_cb, uint32_t job) {
+  if (p_cb->crypto_job != job) {
+    SMP_TRACE_DEBUG("%s: job %u dropped, pairing waits for %u", __func__, job,
+                    p_cb->crypto_job);
+    return false;
+  }
+
+  p_cb->crypto_job = 0;
+  return true;
+}
+
+/*******************************************************************************
+ *
+ * Function         smp_use_key_pair
+ *
+ * Description      This function gives the precomputed key pair to the
+ *                  pairing, and starts computing the next one once the pair
+ *                  was used in SMP_KEY_PAIR_MAX_USES pairings.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+static void smp_use_key_pair(tSMP_CB* p_cb) {
+  memcpy(p_cb->private_key, smp_key_pair.private_key, BT_OCTET32_LEN);
+  p_cb->loc_publ_key = smp_key_pair.public_key;
+
+  smp_key_pair.uses++;
+  SMP_TRACE_DEBUG("%s: use %d of %d", __func__, smp_key_pair.uses,
+                  SMP_KEY_PAIR_MAX_USES);
+  if (smp_key_pair.uses >= SMP_KEY_PAIR_MAX_USES) {
+    smp_key_pair.ready = false;
+    smp_key_pair.uses = 0;
+    smp_precompute_key_pair();
+  }
+}
+
+/*******************************************************************************
+ *
+ * Function         smp_key_pair_rand
+ *
+ * Description      This function collects the octets of the private key of
+ *                  the precomputed key pair, generated by the controller,
+ *                  then has its public key computed.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+static void smp_key_pair_rand(uint32_t generation, BT_OCTET8 rand) {
+  if (generation != smp_key_pair.generation) return;
+
+  memcpy(&smp_key_pair.private_key[smp_key_pair.rand_len], rand,
+         BT_OCTET8_LEN);
+  smp_key_pair.rand_len += BT_OCTET8_LEN;
+  if (smp_key_pair.rand_len < BT_OCTET32_LEN) {
+    btsnd_hcic_ble_rand(Bind(&smp_key_pair_rand, generation));
+    return;
+  }
+
+  smp_crypto_worker->PointMult(
+      curve_p256.G, smp_key_pair.private_key,
+      [generation](const Point& public_key) {
+        if (generation != smp_key_pair.generation) return;
+
+        memcpy(smp_key_pair.public_key.x, public_key.x, BT_OCTET32_LEN);
+        memcpy(smp_key_pair.public_key.y, public_key.y, BT_OCTET32_LEN);
+        smp_key_pair.pending = false;
+        smp_key_pair.ready = true;
+        SMP_TRACE_DEBUG("smp_key_pair_rand: key pair ready");
+
+        uint32_t job = smp_key_pair.job;
+        smp_key_pair.job = 0;
+        if (job != 0 && smp_crypto_job_done(&smp_cb, job)) {
+          smp_use_key_pair(&smp_cb);
+          smp_process_public_key(&smp_cb);
+        }
+      });
+}
+
+/*******************************************************************************
+ *
+ * Function         smp_precompute_key_pair
+ *
+ * Description      This function starts computing a local key pair ahead of
+ *                  the pairing using it, unless one is ready or on its way.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+void smp_precompute_key_pair(void) {
+  if (smp_key_pair.ready || smp_key_pair.pending) return;
+
+  SMP_TRACE_DEBUG("%s", __func__);
+  smp_key_pair.pending = true;
+  smp_key_pair.rand_len = 0;
+  btsnd_hcic_ble_rand(Bind(&smp_key_pair_rand, smp_key_pair.generation));
+}
+
+/*******************************************************************************
+ *
+ * Function         smp_discard_used_key_pair
+ *
+ * Description      This function discards the precomputed key pair when it
+ *                  was used in a pairing, which failed: the pair is not to
+ *                  be used again.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+void smp_discard_used_key_pair(void) {
+  if (!smp_key_pair.ready || smp_key_pair.uses == 0) return;
+
+  SMP_TRACE_DEBUG("%s", __func__);
+  smp_key_pair.ready = false;
+  smp_key_pair.uses = 0;
+  smp_precompute_key_pair();
+}
+
 /*******************************************************************************
  *
  * Function         smp_create_private_key
  *
  * Description      This function is called to create private key used to
  *                  calculate public key and DHKey.
- *                  The function starts private key creation requesting
- *                  for the controller to generate [0-7] octets of private key.
+ *                  The precomputed key pair is used when ready, and waited
+ *                  for when on its way. Otherwise the function starts
+ *                  private key creation requesting for the controller to
+ *                  generate [0-7] octets of private key.
  *
  * Returns          void
  *
@@ -622,6 +841,21 @@ Octet16 smp_calculate_legacy_short_term_key(tSMP_CB* p_cb) {
 void smp_create_private_key(tSMP_CB* p_cb, tSMP_INT_DATA* p_data) {
   SMP_TRACE_DEBUG("%s", __func__);
 
+  if (smp_key_pair.ready) {
+    /* the event is not raised from within the action */
+    uint32_t job = smp_crypto_job_start(p_cb);
+    smp_use_key_pair(p_cb);
+    smp_post_task([p_cb, job]() {
+      if (smp_crypto_job_done(p_cb, job)) smp_process_public_key(p_cb);
+    });
+    return;
+  }
+
+  if (smp_key_pair.pending) {
+    smp_key_pair.job = smp_crypto_job_start(p_cb);
+    return;
+  }
+
   btsnd_hcic_ble_rand(Bind(
       [](tSMP_CB* p_cb, BT_OCTET8 rand) {
         memcpy((void*)p_cb->private_key, rand, BT_OCTET8_LEN);
@@ -644,6 +878,9 @@ void smp_create_private_key(tSMP_CB* p_cb, tSMP_INT_DATA* p_data) {
             p_cb));
       },
       p_cb));
+
+  /* the next pairing will not wait for it */
+  smp_precompute_key_pair();
 }
 
 /*******************************************************************************
@@ -687,25 +924,43 @@ void smp_use_oob_private_key(tSMP_CB* p_cb, tSMP_INT_DATA* p_data) {
  * Function         smp_process_private_key
  *
  * Description      This function processes private key.
- *                  It calculates public key and notifies SM that private key /
- *                  public key pair is created.
+ *                  It has the public key calculated on the crypto worker,
+ *                  and continues in smp_process_public_key.
  *
  * Returns          void
  *
  ******************************************************************************/
 void smp_process_private_key(tSMP_CB* p_cb) {
-  Point public_key;
-  BT_OCTET32 private_key;
+  SMP_TRACE_DEBUG("%s", __func__);
+
+  uint32_t job = smp_crypto_job_start(p_cb);
+  smp_crypto_worker->PointMult(
+      curve_p256.G, p_cb->private_key,
+      [p_cb, job](const Point& public_key) {
+        if (!smp_crypto_job_done(p_cb, job)) return;
+
+        memcpy(p_cb->loc_publ_key.x, public_key.x, BT_OCTET32_LEN);
+        memcpy(p_cb->loc_publ_key.y, public_key.y, BT_OCTET32_LEN);
+        smp_process_public_key(p_cb);
+      });
+}
+
+/*******************************************************************************
+ *
+ * Function         smp_process_public_key
+ *
+ * Description      This function processes the local public key, and
+ *                  notifies SM that private key / public key pair is
+ *                  created.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+static void smp_process_public_key(tSMP_CB* p_cb) {
   int generate_invalid_public_key;
 
   SMP_TRACE_DEBUG("%s", __func__);
 
-  memcpy(private_key, p_cb->private_key, BT_OCTET32_LEN);
-  ECC_PointMult(&public_key, &(curve_p256.G), (uint32_t*)private_key,
-                KEY_LENGTH_DWORDS_P256);
-  memcpy(p_cb->loc_publ_key.x, public_key.x, BT_OCTET32_LEN);
-  memcpy(p_cb->loc_publ_key.y, public_key.y, BT_OCTET32_LEN);
-
   generate_invalid_public_key =
       stack_config_get_interface()->get_pts_smp_generate_invalid_public_key();
 
@@ -745,48 +1000,56 @@ void smp_process_private_key(tSMP_CB* p_cb) {
  *
  * Function         smp_compute_dhkey
  *
- * Description      The function:
- *                  - calculates a new public key using as input local private
+ * Description      The function has the crypto worker:
+ *                  - calculate a new public key using as input local private
  *                    key and peer public key;
- *                  - saves the new public key x-coordinate as DHKey.
+ *                  then saves the new public key x-coordinate as DHKey, and
+ *                  continues in smp_dhkey_computed.
  *
  * Returns          void
  *
  ******************************************************************************/
 void smp_compute_dhkey(tSMP_CB* p_cb) {
-  Point peer_publ_key, new_publ_key;
-  BT_OCTET32 private_key;
-  int generate_invalid_public_key;
+  Point peer_publ_key;
 
   SMP_TRACE_DEBUG("%s", __func__);
 
-  memcpy(private_key, p_cb->private_key, BT_OCTET32_LEN);
   memcpy(peer_publ_key.x, p_cb->peer_publ_key.x, BT_OCTET32_LEN);
   memcpy(peer_publ_key.y, p_cb->peer_publ_key.y, BT_OCTET32_LEN);
 
-  ECC_PointMult(&new_publ_key, &peer_publ_key, (uint32_t*)private_key,
-                KEY_LENGTH_DWORDS_P256);
-
-  memcpy(p_cb->dhkey, new_publ_key.x, BT_OCTET32_LEN);
-
-  generate_invalid_public_key =
-      stack_config_get_interface()->get_pts_smp_generate_invalid_public_key();
-  if (generate_invalid_public_key == SMP_INVALID_PUBLIC_KEY_TYPE_1 ||
-      generate_invalid_public_key == SMP_INVALID_PUBLIC_KEY_TYPE_4) {
-    SMP_TRACE_DEBUG("%s: use 0 as DHKey", __func__);
-    memset(p_cb->dhkey, 0, BT_OCTET32_LEN);
-  }
-
-  smp_debug_print_nbyte_little_endian(p_cb->dhkey, "Old DHKey", BT_OCTET32_LEN);
-
-  smp_debug_print_nbyte_little_endian(p_cb->private_key, "private",
-                                      BT_OCTET32_LEN);
-  smp_debug_print_nbyte_little_endian(p_cb->peer_publ_key.x, "rem public(x)",
-                                      BT_OCTET32_LEN);
-  smp_debug_print_nbyte_little_endian(p_cb->peer_publ_key.y, "rem public(y)",
-                                      BT_OCTET32_LEN);
-  smp_debug_print_nbyte_little_endian(p_cb->dhkey, "Reverted DHKey",
-                                      BT_OCTET32_LEN);
+  uint32_t job = smp_crypto_job_start(p_cb);
+  smp_crypto_worker->PointMult(
+      peer_publ_key, p_cb->private_key,
+      [p_cb, job](const Point& new_publ_key) {
+        int generate_invalid_public_key;
+
+        if (!smp_crypto_job_done(p_cb, job)) return;
+
+        memcpy(p_cb->dhkey, new_publ_key.x, BT_OCTET32_LEN);
+
+        generate_invalid_public_key =
+            stack_config_get_interface()
+                ->get_pts_smp_generate_invalid_public_key();
+        if (generate_invalid_public_key == SMP_INVALID_PUBLIC_KEY_TYPE_1 ||
+            generate_invalid_public_key == SMP_INVALID_PUBLIC_KEY_TYPE_4) {
+          SMP_TRACE_DEBUG("smp_compute_dhkey: use 0 as DHKey");
+          memset(p_cb->dhkey, 0, BT_OCTET32_LEN);
+        }
+
+        smp_debug_print_nbyte_little_endian(p_cb->dhkey, "Old DHKey",
+                                            BT_OCTET32_LEN);
+
+        smp_debug_print_nbyte_little_endian(p_cb->private_key, "private",
+                                            BT_OCTET32_LEN);
+        smp_debug_print_nbyte_little_endian(p_cb->peer_publ_key.x,
+                                            "rem public(x)", BT_OCTET32_LEN);
+        smp_debug_print_nbyte_little_endian(p_cb->peer_publ_key.y,
+                                            "rem public(y)", BT_OCTET32_LEN);
+        smp_debug_print_nbyte_little_endian(p_cb->dhkey, "Reverted DHKey",
+                                            BT_OCTET32_LEN);
+
+        smp_dhkey_computed(p_cb);
+      });
 }
 
 /** The function calculates and saves local commmitment in CB. */
@@ -916,6 +916,9 @@ void smp_proc_pairing_cmpl(tSMP_CB* p_cb) {
 
   RawAddress pairing_bda = p_cb->pairing_bda;
 
+  /* a key pair used in a failed pairing is not used again */
+  if (p_cb->status != SMP_SUCCESS) smp_discard_used_key_pair();
+
   smp_reset_control_value(p_cb);
 
   if (p_callback) (*p_callback)(SMP_COMPLT_EVT, pairing_bda, &evt_data);
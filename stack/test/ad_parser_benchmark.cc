@@ -0,0 +1,188 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <benchmark/benchmark.h>
+#include <string.h>
+
+#include <vector>
+
+#include "advertise_data_parser.h"
+#include "btm_api.h"
+#include "btm_ble_api.h"
+
+using ::benchmark::State;
+
+void LogMsg(uint32_t trace_set_mask, const char* fmt_str, ...) {}
+void vnd_LogMsg(uint32_t trace_set_mask, const char* fmt_str, ...) {}
+
+namespace {
+
+void AddField(std::vector<uint8_t>* data, uint8_t type,
+              std::vector<uint8_t> const& value) {
+  data->push_back(value.size() + 1);
+  data->push_back(type);
+  data->insert(data->end(), value.begin(), value.end());
+}
+
+std::vector<uint8_t> Bytes(size_t len, uint8_t seed) {
+  std::vector<uint8_t> bytes(len);
+  for (size_t i = 0; i < len; i++) bytes[i] = seed + i;
+  return bytes;
+}
+
+/* Advertising reports of a busy scan: beacons, phones and accessories */
+std::vector<std::vector<uint8_t>> MakeLeReports() {
+  std::vector<std::vector<uint8_t>> reports;
+  for (int d = 0; d < 64; d++) {
+    std::vector<uint8_t> data;
+    AddField(&data, BTM_BLE_AD_TYPE_FLAG, {0x06});
+    switch (d % 4) {
+      case 0: /* iBeacon */
+        AddField(&data, BTM_EIR_MANUFACTURER_SPECIFIC_TYPE, Bytes(25, d));
+        break;
+      case 1: /* Eddystone */
+        AddField(&data, BTM_BLE_AD_TYPE_16SRV_CMPL, {0xaa, 0xfe});
+        AddField(&data, HCI_EIR_SERVICE_DATA_16BITS_UUID_TYPE, Bytes(19, d));
+        break;
+      case 2: /* phone: services, appearance and name in the scan response */
+        AddField(&data, BTM_EIR_MORE_16BITS_UUID_TYPE, {0x0f, 0x18, 0x0a, 0x18});
+        AddField(&data, BTM_EIR_TX_POWER_LEVEL_TYPE, {0x04});
+        AddField(&data, BTM_EIR_MANUFACTURER_SPECIFIC_TYPE, Bytes(8, d));
+        AddField(&data, BTM_BLE_AD_TYPE_APPEARANCE, {0x40, 0x00});
+        AddField(&data, BTM_BLE_AD_TYPE_NAME_CMPL, Bytes(12, 'A'));
+        break;
+      case 3: /* HID accessory */
+        AddField(&data, BTM_BLE_AD_TYPE_APPEARANCE, {0xc1, 0x03});
+        AddField(&data, BTM_BLE_AD_TYPE_16SRV_CMPL, {0x12, 0x18});
+        AddField(&data, BTM_BLE_AD_TYPE_NAME_SHORT, Bytes(8, 'a'));
+        break;
+    }
+    reports.push_back(data);
+  }
+  return reports;
+}
+
+/* Extended inquiry responses of headsets and phones, zero padded */
+std::vector<std::vector<uint8_t>> MakeEirs() {
+  std::vector<std::vector<uint8_t>> eirs;
+  for (int d = 0; d < 64; d++) {
+    std::vector<uint8_t> eir;
+    AddField(&eir, BTM_EIR_FLAGS_TYPE, {0x1a});
+    AddField(&eir, BTM_EIR_COMPLETE_16BITS_UUID_TYPE,
+             {0x0b, 0x11, 0x0c, 0x11, 0x0e, 0x11, 0x1e, 0x11, 0x08, 0x11});
+    if (d % 2) AddField(&eir, BTM_EIR_MORE_128BITS_UUID_TYPE, Bytes(32, d));
+    AddField(&eir, BTM_EIR_TX_POWER_LEVEL_TYPE, {0x04});
+    AddField(&eir, BTM_EIR_MANUFACTURER_SPECIFIC_TYPE, Bytes(26, d));
+    AddField(&eir, BTM_EIR_COMPLETE_LOCAL_NAME_TYPE, Bytes(16, 'A'));
+    eir.resize(HCI_EXT_INQ_RESPONSE_LEN, 0);
+    eirs.push_back(eir);
+  }
+  return eirs;
+}
+
+/* The fields looked up for each advertising report, by the inquiry database
+ * and the scanner */
+template <typename Lookup>
+size_t LeLookups(const Lookup& lookup) {
+  uint8_t len;
+  size_t found = 0;
+  found += lookup(BTM_BLE_AD_TYPE_FLAG, &len) != NULL;
+  found += lookup(BTM_BLE_AD_TYPE_FLAG, &len) != NULL;
+  if (!lookup(BTM_BLE_AD_TYPE_APPEARANCE, &len))
+    found += lookup(BTM_BLE_AD_TYPE_16SRV_CMPL, &len) != NULL;
+  if (!lookup(BTM_BLE_AD_TYPE_NAME_CMPL, &len))
+    found += lookup(BTM_BLE_AD_TYPE_NAME_SHORT, &len) != NULL;
+  return found;
+}
+
+/* The fields looked up for each inquiry result, for the UUIDs and the name */
+template <typename Lookup>
+size_t EirLookups(const Lookup& lookup) {
+  uint8_t len;
+  size_t found = 0;
+  const uint8_t types[] = {
+      BTM_EIR_COMPLETE_16BITS_UUID_TYPE,  BTM_EIR_MORE_16BITS_UUID_TYPE,
+      BTM_EIR_COMPLETE_32BITS_UUID_TYPE,  BTM_EIR_MORE_32BITS_UUID_TYPE,
+      BTM_EIR_COMPLETE_128BITS_UUID_TYPE, BTM_EIR_MORE_128BITS_UUID_TYPE};
+  for (size_t i = 0; i < sizeof(types); i += 2) {
+    if (!lookup(types[i], &len)) found += lookup(types[i + 1], &len) != NULL;
+  }
+  if (!lookup(BTM_EIR_COMPLETE_LOCAL_NAME_TYPE, &len))
+    found += lookup(BTM_EIR_SHORTENED_LOCAL_NAME_TYPE, &len) != NULL;
+  found += lookup(BTM_EIR_SHORTENED_LOCAL_NAME_TYPE, &len) != NULL;
+  return found;
+}
+
+/* Each lookup walks the data from its start */
+struct WalkLookup {
+  explicit WalkLookup(std::vector<uint8_t> const& data) : data(data) {}
+  const uint8_t* operator()(uint8_t type, uint8_t* p_length) const {
+    return AdvertiseDataParser::GetFieldByType(data, type, p_length);
+  }
+  std::vector<uint8_t> const& data;
+};
+
+/* The data is walked once, the lookups use the index */
+struct IndexLookup {
+  explicit IndexLookup(std::vector<uint8_t> const& data) : index(data) {}
+  const uint8_t* operator()(uint8_t type, uint8_t* p_length) const {
+    return index.GetFieldByType(type, p_length);
+  }
+  AdvertiseDataIndex index;
+};
+
+template <typename Lookup>
+void Parse(State& state, std::vector<std::vector<uint8_t>> const& corpus,
+           size_t (*lookups)(const Lookup&)) {
+  size_t bytes = 0;
+  for (auto const& data : corpus) bytes += data.size();
+
+  while (state.KeepRunning()) {
+    for (auto const& data : corpus) {
+      Lookup lookup(data);
+      size_t found = lookups(lookup);
+      benchmark::DoNotOptimize(found);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * corpus.size());
+  state.SetBytesProcessed(state.iterations() * bytes);
+}
+
+}  // namespace
+
+static void BM_LeReports_walk(State& state) {
+  Parse(state, MakeLeReports(), LeLookups<WalkLookup>);
+}
+BENCHMARK(BM_LeReports_walk);
+
+static void BM_LeReports_index(State& state) {
+  Parse(state, MakeLeReports(), LeLookups<IndexLookup>);
+}
+BENCHMARK(BM_LeReports_index);
+
+static void BM_Eir_walk(State& state) {
+  Parse(state, MakeEirs(), EirLookups<WalkLookup>);
+}
+BENCHMARK(BM_Eir_walk);
+
+static void BM_Eir_index(State& state) {
+  Parse(state, MakeEirs(), EirLookups<IndexLookup>);
+}
+BENCHMARK(BM_Eir_index);
+
+BENCHMARK_MAIN();
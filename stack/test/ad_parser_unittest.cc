@@ -17,6 +17,7 @@
  ******************************************************************************/
 
 #include <gtest/gtest.h>
+#include <random>
 #include "advertise_data_parser.h"
 
 TEST(AdvertiseDataParserTest, IsValidEmpty) {
@@ -176,3 +177,132 @@ TEST(AdvertiseDataParserTest, RemoveTrailingZerosMalformed) {
 
   EXPECT_TRUE(AdvertiseDataParser::IsValid(glued));
 }
+
+TEST(AdvertiseDataIndexTest, GetFieldByType) {
+  // Flags, name, a second name and a truncated field.
+  const std::vector<uint8_t> data{0x02, 0x01, 0x06, 0x04, 0x09, 'a',
+                                  'b',  'c',  0x02, 0x09, 'd',  0x05,
+                                  0x16, 0x01};
+  AdvertiseDataIndex index(data);
+
+  uint8_t length;
+  EXPECT_EQ(data.data() + 2, index.GetFieldByType(0x01, &length));
+  EXPECT_EQ(1, length);
+
+  // The first field of a type is returned.
+  EXPECT_EQ(data.data() + 5, index.GetFieldByType(0x09, &length));
+  EXPECT_EQ(3, length);
+
+  // The truncated field is not.
+  EXPECT_EQ(nullptr, index.GetFieldByType(0x16, &length));
+  EXPECT_EQ(0, length);
+  EXPECT_EQ(11u, index.significant_len());
+
+  // Complete name, else shortened name.
+  uint8_t type;
+  EXPECT_EQ(data.data() + 5, index.GetFieldByType(0x08, 0x09, &length, &type));
+  EXPECT_EQ(0x09, type);
+  EXPECT_EQ(nullptr, index.GetFieldByType(0x02, 0x03, &length, &type));
+  EXPECT_EQ(0x03, type);
+
+  AdvertiseDataIndex empty(nullptr, 10);
+  EXPECT_TRUE(empty.empty());
+  EXPECT_EQ(nullptr, empty.GetFieldByType(0x01, &length));
+  EXPECT_EQ(0u, empty.significant_len());
+}
+
+TEST(AdvertiseDataIndexTest, ManyFields) {
+  // More fields than indexed: a lookup past them walks the rest.
+  std::vector<uint8_t> data;
+  for (int i = 0; i < 100; i++) {
+    data.push_back(0x02);
+    data.push_back(i);
+    data.push_back(i);
+  }
+  data.push_back(0x00);
+  data.push_back(0x00);
+  AdvertiseDataIndex index(data);
+
+  for (int i = 0; i < 100; i++) {
+    uint8_t length;
+    const uint8_t* p = index.GetFieldByType(i, &length);
+    ASSERT_EQ(data.data() + i * 3 + 2, p);
+    EXPECT_EQ(1, length);
+  }
+  uint8_t length;
+  EXPECT_EQ(nullptr, index.GetFieldByType(0xFF, &length));
+  EXPECT_EQ(300u, index.significant_len());
+}
+
+namespace {
+
+// Where AdvertiseDataParser::GetFieldByType() stops walking |data|.
+size_t WalkEnd(const std::vector<uint8_t>& data) {
+  size_t position = 0;
+  while (position < data.size()) {
+    uint8_t len = data[position];
+    if (len == 0 || position + len >= data.size()) break;
+    position += len + 1;
+  }
+  return position;
+}
+
+void ExpectSameAsParser(const std::vector<uint8_t>& data,
+                        const std::vector<uint8_t>& types) {
+  AdvertiseDataIndex index(data);
+  for (uint8_t type : types) {
+    uint8_t expected_length = 0xAA, length = 0x55;
+    const uint8_t* expected =
+        AdvertiseDataParser::GetFieldByType(data, type, &expected_length);
+    ASSERT_EQ(expected, index.GetFieldByType(type, &length));
+    ASSERT_EQ(expected_length, length);
+  }
+  ASSERT_EQ(WalkEnd(data), index.significant_len());
+}
+
+}  // namespace
+
+// Every string of up to 7 bytes over an alphabet of field lengths and types.
+TEST(AdvertiseDataIndexTest, ExhaustiveShortData) {
+  const std::vector<uint8_t> alphabet{0x00, 0x01, 0x02, 0x03, 0x05, 0xFF};
+
+  for (size_t size = 0; size <= 7; size++) {
+    std::vector<size_t> digits(size, 0);
+    std::vector<uint8_t> data(size);
+    while (true) {
+      for (size_t i = 0; i < size; i++) data[i] = alphabet[digits[i]];
+      ExpectSameAsParser(data, alphabet);
+
+      size_t i = 0;
+      while (i < size && ++digits[i] == alphabet.size()) digits[i++] = 0;
+      if (i == size) break;
+    }
+  }
+}
+
+// Random reports made of fields, some of them corrupted.
+TEST(AdvertiseDataIndexTest, RandomData) {
+  std::vector<uint8_t> all_types;
+  for (int type = 0; type < 256; type++) all_types.push_back(type);
+
+  std::mt19937 rng(1);
+  auto next = [&rng](uint32_t n) {
+    return std::uniform_int_distribution<uint32_t>(0, n - 1)(rng);
+  };
+
+  for (int round = 0; round < 20000; round++) {
+    std::vector<uint8_t> data;
+    size_t size = next(320);
+    bool tiny_fields = next(4) == 0;
+    while (data.size() < size) {
+      uint8_t len = tiny_fields ? 1 : next(40);
+      data.push_back(len);
+      data.push_back(next(4) ? next(12) : next(256));
+      for (int i = 1; i < len; i++) data.push_back(next(256));
+    }
+    data.resize(size);
+    if (!data.empty() && next(2)) data[next(data.size())] = next(256);
+
+    ExpectSameAsParser(data, all_types);
+  }
+}
@@ -23,6 +23,7 @@
 #include "device/include/controller.h"
 #include "stack/btm/ble_advertiser_hci_interface.h"
 #include "stack/include/ble_advertiser.h"
+#include "stack/include/btu.h"
 #include "stack_config.h"
 
 using ::testing::Args;
@@ -30,6 +31,7 @@ using ::testing::Contains;
 using ::testing::ElementsAreArray;
 using ::testing::Exactly;
 using ::testing::Field;
+using ::testing::Gt;
 using ::testing::IsEmpty;
 using ::testing::SaveArg;
 using ::testing::SizeIs;
@@ -67,14 +69,37 @@ void alarm_set_on_mloop(alarm_t* alarm, period_ms_t interval_ms,
   last_alarm_data = data;
 }
 
+void alarm_set_on_mloop_with_slack(alarm_t* alarm, period_ms_t interval_ms,
+                                   period_ms_t slack_ms, alarm_callback_t cb,
+                                   void* data) {
+  last_alarm_cb = cb;
+  last_alarm_data = data;
+}
+
 void* alarm_cancel(alarm_t* alarm) { return nullptr; }
 alarm_t* alarm_new_periodic(const char* name) { return nullptr; }
 alarm_t* alarm_new(const char* name) { return nullptr; }
 void* alarm_free(alarm_t* alarm) { return nullptr; }
-const controller_t* controller_get_interface() { return nullptr; }
+
+bool extended_advertising_supported = true;
+bool supports_ble_extended_advertising() {
+  return extended_advertising_supported;
+}
+
+controller_t CreateController() {
+  controller_t controller = {};
+  controller.supports_ble_extended_advertising =
+      supports_ble_extended_advertising;
+  return controller;
+}
+
+const controller_t controller = CreateController();
+const controller_t* controller_get_interface() { return &controller; }
 
 uint64_t btm_get_next_private_addrress_interval_ms() { return 15 * 60 * 1000; }
 
+base::MessageLoop* get_message_loop() { return nullptr; }
+
 namespace {
 void DoNothing(uint8_t) {}
 
@@ -161,6 +186,7 @@ class BleAdvertisingManagerTest : public testing::Test {
   std::unique_ptr<AdvertiserHciMock> hci_mock;
 
   virtual void SetUp() {
+    extended_advertising_supported = true;
     hci_mock.reset(new AdvertiserHciMock());
 
     base::Callback<void(uint8_t)> inst_cnt_Cb;
@@ -397,6 +423,187 @@ TEST_F(BleAdvertisingManagerTest, test_adv_data_not_filling) {
   EXPECT_EQ(BTM_BLE_MULTI_ADV_SUCCESS, set_data_status);
 }
 
+/* This test verifies that writing the same advertising data again does not
+ * reach the controller, while changed data does. */
+TEST_F(BleAdvertisingManagerTest, test_unchanged_adv_data_skipped) {
+  BleAdvertisingManager::Get()->RegisterAdvertiser(
+      Bind(&BleAdvertisingManagerTest::RegistrationCb, base::Unretained(this)));
+  EXPECT_EQ(BTM_BLE_MULTI_ADV_SUCCESS, reg_status);
+  int advertiser_id = reg_inst_id;
+
+  std::vector<uint8_t> data({0x02 /* len */, 0xFF, 0x01});
+  status_cb set_data_cb;
+  EXPECT_CALL(*hci_mock, SetAdvertisingData(advertiser_id, _, _, _, _, _))
+      .Times(1)
+      .WillOnce(SaveArg<5>(&set_data_cb));
+  BleAdvertisingManager::Get()->SetData(
+      advertiser_id, false, data,
+      Bind(&BleAdvertisingManagerTest::SetDataCb, base::Unretained(this)));
+  set_data_cb.Run(0);
+  ::testing::Mock::VerifyAndClearExpectations(hci_mock.get());
+  EXPECT_EQ(BTM_BLE_MULTI_ADV_SUCCESS, set_data_status);
+
+  // Same payload, controller already has it
+  set_data_status = -1;
+  EXPECT_CALL(*hci_mock, SetAdvertisingData(_, _, _, _, _, _)).Times(0);
+  BleAdvertisingManager::Get()->SetData(
+      advertiser_id, false, data,
+      Bind(&BleAdvertisingManagerTest::SetDataCb, base::Unretained(this)));
+  ::testing::Mock::VerifyAndClearExpectations(hci_mock.get());
+  EXPECT_EQ(BTM_BLE_MULTI_ADV_SUCCESS, set_data_status);
+
+  // Scan response is tracked separately
+  EXPECT_CALL(*hci_mock, SetScanResponseData(advertiser_id, _, _, _, _, _))
+      .Times(1)
+      .WillOnce(SaveArg<5>(&set_data_cb));
+  BleAdvertisingManager::Get()->SetData(
+      advertiser_id, true, data,
+      Bind(&BleAdvertisingManagerTest::SetDataCb, base::Unretained(this)));
+  set_data_cb.Run(0);
+  ::testing::Mock::VerifyAndClearExpectations(hci_mock.get());
+
+  // Changed payload, failing write must not be remembered
+  data[2] = 0x02;
+  EXPECT_CALL(*hci_mock, SetAdvertisingData(advertiser_id, _, _, _, _, _))
+      .Times(2)
+      .WillRepeatedly(SaveArg<5>(&set_data_cb));
+  BleAdvertisingManager::Get()->SetData(
+      advertiser_id, false, data,
+      Bind(&BleAdvertisingManagerTest::SetDataCb, base::Unretained(this)));
+  set_data_cb.Run(0x01);
+  BleAdvertisingManager::Get()->SetData(
+      advertiser_id, false, data,
+      Bind(&BleAdvertisingManagerTest::SetDataCb, base::Unretained(this)));
+  set_data_cb.Run(0);
+  ::testing::Mock::VerifyAndClearExpectations(hci_mock.get());
+  EXPECT_EQ(BTM_BLE_MULTI_ADV_SUCCESS, set_data_status);
+}
+
+/* This test verifies that the RPA of all advertising sets is rotated at once,
+ * and that enabled connectable sets are restarted with a single command. */
+TEST_F(BleAdvertisingManagerTest, test_aligned_rpa_rotation) {
+  uint8_t ids[3];
+  for (int i = 0; i < 3; i++) {
+    BleAdvertisingManager::Get()->RegisterAdvertiser(Bind(
+        &BleAdvertisingManagerTest::RegistrationCb, base::Unretained(this)));
+    EXPECT_EQ(BTM_BLE_MULTI_ADV_SUCCESS, reg_status);
+    ids[i] = reg_inst_id;
+  }
+
+  // first two sets are connectable and enabled, third one is idle
+  for (int i = 0; i < 2; i++) {
+    parameters_cb set_params_cb;
+    tBTM_BLE_ADV_PARAMS params;
+    params.advertising_event_properties =
+        BleAdvertisingManager::advertising_prop_legacy_connectable;
+    params.tx_power = -15;
+    EXPECT_CALL(*hci_mock, SetParameters1(ids[i], _, _, _, _, _, _, _, _))
+        .Times(1);
+    EXPECT_CALL(*hci_mock, SetParameters2(_, _, _, _, _, _, _, _))
+        .Times(1)
+        .WillOnce(SaveArg<7>(&set_params_cb));
+    BleAdvertisingManager::Get()->SetParameters(
+        ids[i], &params,
+        Bind(&BleAdvertisingManagerTest::SetParametersCb,
+             base::Unretained(this)));
+    set_params_cb.Run(0, -15);
+    ::testing::Mock::VerifyAndClearExpectations(hci_mock.get());
+  }
+
+  for (int i = 0; i < 2; i++) {
+    status_cb enable_cb;
+    EXPECT_CALL(*hci_mock, Enable(0x01 /* enable */, SizeIs(1), _))
+        .Times(1)
+        .WillOnce(SaveArg<2>(&enable_cb));
+    BleAdvertisingManager::Get()->Enable(
+        ids[i], true,
+        Bind(&BleAdvertisingManagerTest::EnableCb, base::Unretained(this)), 0,
+        0, base::Callback<void(uint8_t)>());
+    enable_cb.Run(0);
+    ::testing::Mock::VerifyAndClearExpectations(hci_mock.get());
+    EXPECT_EQ(BTM_BLE_MULTI_ADV_SUCCESS, enable_status);
+  }
+
+  {
+    ::testing::InSequence s;
+    EXPECT_CALL(*hci_mock, Enable(0x00 /* disable */, SizeIs(2), _)).Times(1);
+    EXPECT_CALL(*hci_mock, SetRandomAddress(_, _, _)).Times(3);
+    EXPECT_CALL(*hci_mock, Enable(0x01 /* enable */, SizeIs(2), _)).Times(1);
+  }
+  TriggerRandomAddressUpdate();
+  ::testing::Mock::VerifyAndClearExpectations(hci_mock.get());
+}
+
+/* This test verifies that without LE extended advertising, where the VSC and
+ * legacy interfaces reject enabling several sets in one command, the sets
+ * are enabled and rotated one command each. */
+TEST_F(BleAdvertisingManagerTest, test_rpa_rotation_single_set_commands) {
+  extended_advertising_supported = false;
+  uint8_t ids[2];
+  for (int i = 0; i < 2; i++) {
+    BleAdvertisingManager::Get()->RegisterAdvertiser(Bind(
+        &BleAdvertisingManagerTest::RegistrationCb, base::Unretained(this)));
+    EXPECT_EQ(BTM_BLE_MULTI_ADV_SUCCESS, reg_status);
+    ids[i] = reg_inst_id;
+
+    parameters_cb set_params_cb;
+    tBTM_BLE_ADV_PARAMS params;
+    params.advertising_event_properties =
+        BleAdvertisingManager::advertising_prop_legacy_connectable;
+    params.tx_power = -15;
+    EXPECT_CALL(*hci_mock, SetParameters1(ids[i], _, _, _, _, _, _, _, _))
+        .Times(1);
+    EXPECT_CALL(*hci_mock, SetParameters2(_, _, _, _, _, _, _, _))
+        .Times(1)
+        .WillOnce(SaveArg<7>(&set_params_cb));
+    BleAdvertisingManager::Get()->SetParameters(
+        ids[i], &params,
+        Bind(&BleAdvertisingManagerTest::SetParametersCb,
+             base::Unretained(this)));
+    set_params_cb.Run(0, -15);
+    ::testing::Mock::VerifyAndClearExpectations(hci_mock.get());
+  }
+
+  for (int i = 0; i < 2; i++) {
+    status_cb enable_cb;
+    EXPECT_CALL(*hci_mock, Enable(0x01 /* enable */, SizeIs(1), _))
+        .Times(1)
+        .WillOnce(SaveArg<2>(&enable_cb));
+    BleAdvertisingManager::Get()->Enable(
+        ids[i], true,
+        Bind(&BleAdvertisingManagerTest::EnableCb, base::Unretained(this)), 0,
+        0, base::Callback<void(uint8_t)>());
+    enable_cb.Run(0);
+    ::testing::Mock::VerifyAndClearExpectations(hci_mock.get());
+  }
+
+  // Suspend() and Resume() take one command per set as well
+  std::vector<status_cb> enable_cbs;
+  EXPECT_CALL(*hci_mock, Enable(_, SizeIs(Gt(1)), _)).Times(0);
+  EXPECT_CALL(*hci_mock, Enable(_, SizeIs(1), _))
+      .Times(4)
+      .WillRepeatedly(::testing::Invoke(
+          [&enable_cbs](uint8_t, std::vector<SetEnableData>, status_cb cb) {
+            enable_cbs.push_back(cb);
+          }));
+  BleAdvertisingManager::Get()->Suspend();
+  BleAdvertisingManager::Get()->Resume();
+  ::testing::Mock::VerifyAndClearExpectations(hci_mock.get());
+  ASSERT_EQ(4u, enable_cbs.size());
+  enable_cbs[0].Run(0x0C /* command disallowed */);
+  for (size_t i = 1; i < enable_cbs.size(); i++) enable_cbs[i].Run(0);
+
+  {
+    ::testing::InSequence s;
+    EXPECT_CALL(*hci_mock, Enable(0x00 /* disable */, SizeIs(1), _)).Times(2);
+    EXPECT_CALL(*hci_mock, SetRandomAddress(_, _, _)).Times(2);
+    EXPECT_CALL(*hci_mock, Enable(0x01 /* enable */, SizeIs(1), _)).Times(2);
+  }
+  EXPECT_CALL(*hci_mock, Enable(_, SizeIs(Gt(1)), _)).Times(0);
+  TriggerRandomAddressUpdate();
+  ::testing::Mock::VerifyAndClearExpectations(hci_mock.get());
+}
+
 TEST_F(BleAdvertisingManagerTest, test_reenabling) {
   BleAdvertisingManager::Get()->RegisterAdvertiser(
       Bind(&BleAdvertisingManagerTest::RegistrationCb, base::Unretained(this)));
@@ -0,0 +1,269 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <benchmark/benchmark.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include "bnep_filter.h"
+
+using ::benchmark::Counter;
+using ::benchmark::State;
+
+namespace {
+
+/* BNEP_BUF_SIZE, which BNEP_Write allocated for each frame */
+constexpr size_t kBnepBufSize = 4096 + 16 + 2;
+/* BNEP_MINIMUM_OFFSET, the headroom for the BNEP and L2CAP headers */
+constexpr size_t kHeadroom = 15 + 13;
+/* Compressed Ethernet BNEP header, L2CAP and ACL headers */
+constexpr size_t kHeadersLen = 3 + 4 + 4;
+constexpr int kNumFrames = 10000;
+
+struct Frame {
+  RawAddress dst;
+  uint16_t protocol;
+  std::vector<uint8_t> buf; /* headroom, then the payload */
+};
+
+RawAddress Address(uint64_t n) {
+  RawAddress addr;
+  for (int i = 5; i >= 0; i--, n >>= 8) addr.address[i] = n;
+  return addr;
+}
+
+Frame MakeFrame(uint64_t dst, uint16_t protocol, size_t len) {
+  Frame frame;
+  frame.dst = Address(dst);
+  frame.protocol = protocol;
+  frame.buf.resize(kHeadroom + len, 0x5a);
+  return frame;
+}
+
+/* Tethering traffic from the phone to a PANU: unicast IP, among the
+ * multicast chatter of the phone's network: mDNS, SSDP, IPv6 neighbour
+ * discovery, IGMP and broadcast ARP */
+std::vector<Frame> MakeTraffic() {
+  std::vector<Frame> frames;
+  for (int f = 0; f < kNumFrames; f++) {
+    switch (f % 10) {
+      case 0:
+      case 1:
+      case 2:
+      case 3:
+        frames.push_back(MakeFrame(0x001122334455, 0x0800, 1486));
+        break;
+      case 4:
+      case 5:
+        frames.push_back(MakeFrame(0x001122334455, 0x86dd, 1280));
+        break;
+      case 6:
+        frames.push_back(MakeFrame(f % 20 < 10 ? 0x01005e0000fb
+                                               : 0x3333000000fb,
+                                   f % 20 < 10 ? 0x0800 : 0x86dd, 420));
+        break;
+      case 7:
+        frames.push_back(MakeFrame(0x01005e7ffffa, 0x0800, 330));
+        break;
+      case 8:
+        frames.push_back(MakeFrame(f % 20 < 10 ? 0x3333ff000000 + f
+                                               : 0x333300000001,
+                                   0x86dd, 86));
+        break;
+      case 9:
+        frames.push_back(MakeFrame(f % 20 < 10 ? 0xffffffffffff
+                                               : 0x01005e000016,
+                                   0x0806, 46));
+        break;
+    }
+  }
+  return frames;
+}
+
+/* Filters of a PANU running IPv4 and IPv6 without mDNS or SSDP */
+struct PeerFilters {
+  PeerFilters() {
+    uint16_t prot[][2] = {{0x0800, 0x0800}, {0x0806, 0x0806},
+                          {0x86dd, 0x86dd}};
+    for (auto& range : prot) {
+      prot_start.push_back(range[0]);
+      prot_end.push_back(range[1]);
+    }
+    num_prot = bnep_compile_prot_filters(prot_start.data(), prot_end.data(),
+                                         prot_start.size());
+
+    uint64_t mcast[][2] = {{0x333300000001, 0x333300000001},
+                           {0x3333ff000000, 0x3333ffffffff},
+                           {0x01005e000001, 0x01005e000001}};
+    for (auto& range : mcast) {
+      mcast_start.push_back(Address(range[0]));
+      mcast_end.push_back(Address(range[1]));
+    }
+    num_mcast = bnep_compile_mcast_filters(
+        mcast_start.data(), mcast_end.data(), mcast_start.size());
+  }
+
+  std::vector<uint16_t> prot_start, prot_end;
+  uint16_t num_prot;
+  std::vector<RawAddress> mcast_start, mcast_end;
+  uint16_t num_mcast;
+};
+
+/* The protocol filters checked in turn, the multicast ones not at all, as
+ * before */
+bool AllowedBefore(const PeerFilters& filters, const Frame& frame) {
+  for (uint16_t i = 0; i < filters.num_prot; i++)
+    if (filters.prot_start[i] <= frame.protocol &&
+        frame.protocol <= filters.prot_end[i])
+      return true;
+  return false;
+}
+
+bool Allowed(const PeerFilters& filters, const Frame& frame) {
+  if (!bnep_prot_filters_match(filters.prot_start.data(),
+                               filters.prot_end.data(), filters.num_prot,
+                               frame.protocol))
+    return false;
+  if ((frame.dst.address[0] & 0x01) && frame.dst != RawAddress::kAny &&
+      !bnep_mcast_filters_match(filters.mcast_start.data(),
+                                filters.mcast_end.data(), filters.num_mcast,
+                                frame.dst))
+    return false;
+  return true;
+}
+
+/* What is sent on the air for a frame, with headers */
+size_t AirBytes(const Frame& frame) {
+  return frame.buf.size() - kHeadroom + kHeadersLen;
+}
+
+void ReportAirtime(State& state, size_t frames_sent, size_t air_bytes,
+                   size_t all_bytes) {
+  state.counters["frames_sent"] = frames_sent;
+  state.counters["air_bytes"] = air_bytes;
+  state.counters["airtime_saved_%"] =
+      100.0 * (all_bytes - air_bytes) / all_bytes;
+  state.counters["frames/s"] = Counter(
+      (double)kNumFrames * state.iterations(), Counter::kIsRate);
+}
+
+}  // namespace
+
+/* Each frame copied into a buffer of BNEP_BUF_SIZE, every multicast frame
+ * sent */
+static void BM_MixedTrafficCopyUnfiltered(State& state) {
+  std::vector<Frame> frames = MakeTraffic();
+  PeerFilters filters;
+  size_t frames_sent = 0, air_bytes = 0, all_bytes = 0;
+  for (const Frame& frame : frames) all_bytes += AirBytes(frame);
+
+  while (state.KeepRunning()) {
+    frames_sent = air_bytes = 0;
+    for (Frame& frame : frames) {
+      if (!AllowedBefore(filters, frame)) continue;
+      size_t len = frame.buf.size() - kHeadroom;
+      uint8_t* p_buf = (uint8_t*)malloc(kBnepBufSize);
+      memcpy(p_buf + kHeadroom, frame.buf.data() + kHeadroom, len);
+      p_buf[kHeadroom - 3] = 0x02;
+      benchmark::DoNotOptimize(p_buf);
+      free(p_buf);
+      frames_sent++;
+      air_bytes += AirBytes(frame);
+    }
+  }
+  ReportAirtime(state, frames_sent, air_bytes, all_bytes);
+}
+BENCHMARK(BM_MixedTrafficCopyUnfiltered);
+
+/* The BNEP header built in the headroom of each frame, the multicast
+ * frames the peer filters out not sent */
+static void BM_MixedTrafficHeadroomFiltered(State& state) {
+  std::vector<Frame> frames = MakeTraffic();
+  PeerFilters filters;
+  size_t frames_sent = 0, air_bytes = 0, all_bytes = 0;
+  for (const Frame& frame : frames) all_bytes += AirBytes(frame);
+
+  while (state.KeepRunning()) {
+    frames_sent = air_bytes = 0;
+    for (Frame& frame : frames) {
+      if (!Allowed(filters, frame)) continue;
+      uint8_t* p = frame.buf.data() + kHeadroom - 3;
+      p[0] = 0x02;
+      p[1] = frame.protocol >> 8;
+      p[2] = frame.protocol;
+      benchmark::DoNotOptimize(p);
+      frames_sent++;
+      air_bytes += AirBytes(frame);
+    }
+  }
+  ReportAirtime(state, frames_sent, air_bytes, all_bytes);
+}
+BENCHMARK(BM_MixedTrafficHeadroomFiltered);
+
+/* Protocol filter checks with |state.range(0)| ranges set by the peer,
+ * checked in turn as before, and compiled */
+static std::vector<uint16_t> MakeProtocols() {
+  std::vector<uint16_t> protocols;
+  for (int i = 0; i < kNumFrames; i++) protocols.push_back((i * 977) & 0xffff);
+  return protocols;
+}
+
+static void MakeRanges(int num, std::vector<uint16_t>* start,
+                       std::vector<uint16_t>* end) {
+  for (int i = 0; i < num; i++) {
+    start->push_back(i * (0x10000 / num));
+    end->push_back(i * (0x10000 / num) + 0x10);
+  }
+}
+
+static void BM_ProtocolFilterLinear(State& state) {
+  std::vector<uint16_t> protocols = MakeProtocols(), start, end;
+  MakeRanges(state.range(0), &start, &end);
+  while (state.KeepRunning()) {
+    int allowed = 0;
+    for (uint16_t protocol : protocols) {
+      for (size_t i = 0; i < start.size(); i++) {
+        if (start[i] <= protocol && protocol <= end[i]) {
+          allowed++;
+          break;
+        }
+      }
+    }
+    benchmark::DoNotOptimize(allowed);
+  }
+}
+BENCHMARK(BM_ProtocolFilterLinear)->Arg(5)->Arg(64);
+
+static void BM_ProtocolFilterCompiled(State& state) {
+  std::vector<uint16_t> protocols = MakeProtocols(), start, end;
+  MakeRanges(state.range(0), &start, &end);
+  uint16_t num =
+      bnep_compile_prot_filters(start.data(), end.data(), start.size());
+  while (state.KeepRunning()) {
+    int allowed = 0;
+    for (uint16_t protocol : protocols)
+      allowed +=
+          bnep_prot_filters_match(start.data(), end.data(), num, protocol);
+    benchmark::DoNotOptimize(allowed);
+  }
+}
+BENCHMARK(BM_ProtocolFilterCompiled)->Arg(5)->Arg(64);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,129 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <string.h>
+
+#include <random>
+#include <vector>
+
+#include "bnep_filter.h"
+
+namespace {
+
+RawAddress Address(uint64_t n) {
+  RawAddress addr;
+  for (int i = 5; i >= 0; i--, n >>= 8) addr.address[i] = n;
+  return addr;
+}
+
+// Uniform in [0, n).
+uint32_t Uniform(std::mt19937* rng, uint32_t n) {
+  return std::uniform_int_distribution<uint32_t>(0, n - 1)(*rng);
+}
+
+}  // namespace
+
+TEST(BnepFilterTest, test_protocol_ranges_merged) {
+  uint16_t start[] = {0x86dd, 0x0800, 0x0801, 0x0806, 0x0000};
+  uint16_t end[] = {0x86dd, 0x0800, 0x0805, 0x0806, 0x0100};
+
+  ASSERT_EQ(3, bnep_compile_prot_filters(start, end, 5));
+  EXPECT_EQ(0x0000, start[0]);
+  EXPECT_EQ(0x0100, end[0]);
+  EXPECT_EQ(0x0800, start[1]);
+  EXPECT_EQ(0x0806, end[1]);
+  EXPECT_EQ(0x86dd, start[2]);
+  EXPECT_EQ(0x86dd, end[2]);
+
+  EXPECT_TRUE(bnep_prot_filters_match(start, end, 3, 0x0000));
+  EXPECT_TRUE(bnep_prot_filters_match(start, end, 3, 0x0100));
+  EXPECT_FALSE(bnep_prot_filters_match(start, end, 3, 0x0101));
+  EXPECT_FALSE(bnep_prot_filters_match(start, end, 3, 0x07ff));
+  EXPECT_TRUE(bnep_prot_filters_match(start, end, 3, 0x0803));
+  EXPECT_FALSE(bnep_prot_filters_match(start, end, 3, 0x0807));
+  EXPECT_TRUE(bnep_prot_filters_match(start, end, 3, 0x86dd));
+  EXPECT_FALSE(bnep_prot_filters_match(start, end, 3, 0xffff));
+  EXPECT_FALSE(bnep_prot_filters_match(start, end, 0, 0x0800));
+}
+
+TEST(BnepFilterTest, test_protocol_range_to_the_end) {
+  uint16_t start[] = {0xff00, 0x0000};
+  uint16_t end[] = {0xffff, 0xfeff};
+
+  ASSERT_EQ(1, bnep_compile_prot_filters(start, end, 2));
+  EXPECT_TRUE(bnep_prot_filters_match(start, end, 1, 0xffff));
+  EXPECT_TRUE(bnep_prot_filters_match(start, end, 1, 0x0000));
+}
+
+TEST(BnepFilterTest, test_multicast_ranges) {
+  // IPv6 all nodes, IPv6 solicited node, IPv4 all hosts
+  RawAddress start[] = {Address(0x333300000001), Address(0x3333ff000000),
+                        Address(0x01005e000001)};
+  RawAddress end[] = {Address(0x333300000001), Address(0x3333ffffffff),
+                      Address(0x01005e000001)};
+
+  ASSERT_EQ(3, bnep_compile_mcast_filters(start, end, 3));
+  EXPECT_EQ(Address(0x01005e000001), start[0]);
+
+  EXPECT_TRUE(
+      bnep_mcast_filters_match(start, end, 3, Address(0x3333ff123456)));
+  EXPECT_TRUE(
+      bnep_mcast_filters_match(start, end, 3, Address(0x333300000001)));
+  EXPECT_TRUE(
+      bnep_mcast_filters_match(start, end, 3, Address(0x01005e000001)));
+  // mDNS and SSDP
+  EXPECT_FALSE(
+      bnep_mcast_filters_match(start, end, 3, Address(0x01005e0000fb)));
+  EXPECT_FALSE(
+      bnep_mcast_filters_match(start, end, 3, Address(0x3333000000fb)));
+  EXPECT_FALSE(
+      bnep_mcast_filters_match(start, end, 3, Address(0x01005e7ffffa)));
+}
+
+// Random ranges: the compiled ranges match the values the ranges received
+// match, no more, no less
+TEST(BnepFilterTest, test_random_against_linear) {
+  std::mt19937 rng(3);
+  for (int round = 0; round < 500; round++) {
+    uint16_t num = 1 + Uniform(&rng, 8);
+    std::vector<uint16_t> start(num), end(num);
+    for (uint16_t i = 0; i < num; i++) {
+      start[i] = Uniform(&rng, 0x400);
+      end[i] = start[i] + Uniform(&rng, 0x40);
+    }
+    std::vector<uint16_t> compiled_start = start, compiled_end = end;
+    uint16_t compiled = bnep_compile_prot_filters(
+        compiled_start.data(), compiled_end.data(), num);
+    ASSERT_LE(compiled, num);
+    for (uint16_t i = 1; i < compiled; i++)
+      ASSERT_GT(compiled_start[i], compiled_end[i - 1] + 1);
+
+    for (uint16_t protocol = 0; protocol < 0x500; protocol++) {
+      bool expected = false;
+      for (uint16_t i = 0; i < num; i++)
+        if (start[i] <= protocol && protocol <= end[i]) expected = true;
+      ASSERT_EQ(expected,
+                bnep_prot_filters_match(compiled_start.data(),
+                                        compiled_end.data(), compiled,
+                                        protocol))
+          << "protocol " << protocol;
+    }
+  }
+}
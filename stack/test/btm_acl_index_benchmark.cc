@@ -0,0 +1,142 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <base/logging.h>
+#include <benchmark/benchmark.h>
+#include <string.h>
+
+#include <random>
+
+#include "btm_int.h"
+
+using ::benchmark::State;
+
+tBTM_CB btm_cb;
+
+void LogMsg(uint32_t trace_set_mask, const char* fmt_str, ...) {}
+void vnd_LogMsg(uint32_t trace_set_mask, const char* fmt_str, ...) {}
+
+namespace {
+
+/* Original lookups, scanning the whole table */
+uint8_t legacy_handle_to_acl_index(uint16_t hci_handle) {
+  tACL_CONN* p = &btm_cb.acl_db[0];
+  uint8_t xx;
+  for (xx = 0; xx < MAX_L2CAP_LINKS; xx++, p++) {
+    if ((p->in_use) && (p->hci_handle == hci_handle)) break;
+  }
+  return xx;
+}
+
+uint8_t legacy_bda_to_acl_index(const RawAddress& bda,
+                                tBT_TRANSPORT transport) {
+  tACL_CONN* p = &btm_cb.acl_db[0];
+  uint8_t xx;
+  for (xx = 0; xx < MAX_L2CAP_LINKS; xx++, p++) {
+    if ((p->in_use) && p->remote_addr == bda && p->transport == transport)
+      break;
+  }
+  return xx;
+}
+
+/* Every link of the table is up, alternating BR/EDR and LE. The lookups go
+ * through the links and one unknown peer in a pseudo-random order, as the
+ * per-packet and per-event paths of several links interleave. */
+class BM_AclLookup : public ::benchmark::Fixture {
+ protected:
+  void SetUp(State& st) override {
+    ::benchmark::Fixture::SetUp(st);
+    btm_acl_index_init();
+    for (uint8_t xx = 0; xx < MAX_L2CAP_LINKS; xx++) {
+      tACL_CONN* p = &btm_cb.acl_db[xx];
+      p->in_use = true;
+      p->hci_handle = 0x0040 + 3 * xx;
+      p->transport = (xx % 2) ? BT_TRANSPORT_LE : BT_TRANSPORT_BR_EDR;
+      for (int i = 0; i < 6; i++) p->remote_addr.address[i] = 0x11 * i + xx;
+      btm_acl_index_add(xx);
+
+      handles_[xx] = p->hci_handle;
+      addrs_[xx] = p->remote_addr;
+      transports_[xx] = p->transport;
+    }
+    handles_[MAX_L2CAP_LINKS] = 0x0eff;
+    addrs_[MAX_L2CAP_LINKS] = addrs_[0];
+    addrs_[MAX_L2CAP_LINKS].address[0] ^= 0xff;
+    transports_[MAX_L2CAP_LINKS] = BT_TRANSPORT_BR_EDR;
+
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<int> link(0, MAX_L2CAP_LINKS);
+    for (int i = 0; i < kLookups; i++) order_[i] = link(rng);
+
+    for (uint8_t xx = 0; xx <= MAX_L2CAP_LINKS; xx++) {
+      CHECK(btm_handle_to_acl_index(handles_[xx]) ==
+            legacy_handle_to_acl_index(handles_[xx]));
+      CHECK(btm_bda_to_acl_index(addrs_[xx], transports_[xx]) ==
+            legacy_bda_to_acl_index(addrs_[xx], transports_[xx]));
+    }
+  }
+
+  static constexpr int kLookups = 1024;
+  uint16_t handles_[MAX_L2CAP_LINKS + 1];
+  RawAddress addrs_[MAX_L2CAP_LINKS + 1];
+  tBT_TRANSPORT transports_[MAX_L2CAP_LINKS + 1];
+  uint8_t order_[kLookups];
+};
+
+}  // namespace
+
+BENCHMARK_DEFINE_F(BM_AclLookup, legacy_handle_scan)(State& state) {
+  for (auto _ : state) {
+    for (int i = 0; i < kLookups; i++)
+      benchmark::DoNotOptimize(legacy_handle_to_acl_index(handles_[order_[i]]));
+  }
+  state.SetItemsProcessed(state.iterations() * kLookups);
+}
+
+BENCHMARK_DEFINE_F(BM_AclLookup, indexed_handle)(State& state) {
+  for (auto _ : state) {
+    for (int i = 0; i < kLookups; i++)
+      benchmark::DoNotOptimize(btm_handle_to_acl_index(handles_[order_[i]]));
+  }
+  state.SetItemsProcessed(state.iterations() * kLookups);
+}
+
+BENCHMARK_DEFINE_F(BM_AclLookup, legacy_bda_scan)(State& state) {
+  for (auto _ : state) {
+    for (int i = 0; i < kLookups; i++)
+      benchmark::DoNotOptimize(
+          legacy_bda_to_acl_index(addrs_[order_[i]], transports_[order_[i]]));
+  }
+  state.SetItemsProcessed(state.iterations() * kLookups);
+}
+
+BENCHMARK_DEFINE_F(BM_AclLookup, indexed_bda)(State& state) {
+  for (auto _ : state) {
+    for (int i = 0; i < kLookups; i++)
+      benchmark::DoNotOptimize(
+          btm_bda_to_acl_index(addrs_[order_[i]], transports_[order_[i]]));
+  }
+  state.SetItemsProcessed(state.iterations() * kLookups);
+}
+
+BENCHMARK_REGISTER_F(BM_AclLookup, legacy_handle_scan);
+BENCHMARK_REGISTER_F(BM_AclLookup, indexed_handle);
+BENCHMARK_REGISTER_F(BM_AclLookup, legacy_bda_scan);
+BENCHMARK_REGISTER_F(BM_AclLookup, indexed_bda);
+
+BENCHMARK_MAIN();
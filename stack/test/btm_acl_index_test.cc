@@ -0,0 +1,230 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <gtest/gtest.h>
+#include <string.h>
+
+#include <random>
+#include <vector>
+
+#include "btm_int.h"
+#include "hcimsgs.h"
+
+tBTM_CB btm_cb;
+
+void LogMsg(uint32_t trace_set_mask, const char* fmt_str, ...) {}
+void vnd_LogMsg(uint32_t trace_set_mask, const char* fmt_str, ...) {}
+
+namespace {
+
+/* Original lookups, scanning the whole table */
+uint8_t legacy_handle_to_acl_index(uint16_t hci_handle) {
+  tACL_CONN* p = &btm_cb.acl_db[0];
+  uint8_t xx;
+  for (xx = 0; xx < MAX_L2CAP_LINKS; xx++, p++) {
+    if ((p->in_use) && (p->hci_handle == hci_handle)) break;
+  }
+  return xx;
+}
+
+uint8_t legacy_bda_to_acl_index(const RawAddress& bda,
+                                tBT_TRANSPORT transport) {
+  tACL_CONN* p = &btm_cb.acl_db[0];
+  uint8_t xx;
+  for (xx = 0; xx < MAX_L2CAP_LINKS; xx++, p++) {
+    if ((p->in_use) && p->remote_addr == bda && p->transport == transport)
+      break;
+  }
+  return xx;
+}
+
+RawAddress Address(uint8_t seed) {
+  RawAddress bda;
+  for (int i = 0; i < 6; i++) bda.address[i] = 0x11 * i + seed;
+  return bda;
+}
+
+class BtmAclIndexTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    memset(btm_cb.acl_db, 0, sizeof(btm_cb.acl_db));
+    btm_acl_index_init();
+  }
+
+  /* As btm_acl_created(): the first free entry */
+  uint8_t Create(const RawAddress& bda, tBT_TRANSPORT transport,
+                 uint16_t hci_handle) {
+    for (uint8_t xx = 0; xx < MAX_L2CAP_LINKS; xx++) {
+      tACL_CONN* p = &btm_cb.acl_db[xx];
+      if (p->in_use) continue;
+      p->in_use = true;
+      p->hci_handle = hci_handle;
+      p->remote_addr = bda;
+      p->transport = transport;
+      btm_acl_index_add(xx);
+      return xx;
+    }
+    return MAX_L2CAP_LINKS;
+  }
+
+  /* As btm_acl_removed(): the entry keeps its address and handle */
+  void Remove(uint8_t xx) {
+    btm_acl_index_remove(xx);
+    btm_cb.acl_db[xx].in_use = false;
+  }
+
+  /* Every lookup of |bdas| and |handles| on both transports agrees with a
+   * scan of the table */
+  void ExpectSameAsScan(const std::vector<RawAddress>& bdas,
+                        const std::vector<uint16_t>& handles) {
+    for (const RawAddress& bda : bdas) {
+      for (tBT_TRANSPORT transport : {BT_TRANSPORT_BR_EDR, BT_TRANSPORT_LE}) {
+        EXPECT_EQ(legacy_bda_to_acl_index(bda, transport),
+                  btm_bda_to_acl_index(bda, transport))
+            << bda << " transport " << +transport;
+      }
+    }
+    for (uint16_t hci_handle : handles) {
+      EXPECT_EQ(legacy_handle_to_acl_index(hci_handle),
+                btm_handle_to_acl_index(hci_handle))
+          << "handle " << hci_handle;
+    }
+  }
+};
+
+}  // namespace
+
+TEST_F(BtmAclIndexTest, test_add_and_remove) {
+  std::vector<RawAddress> bdas;
+  std::vector<uint16_t> handles;
+  for (uint8_t i = 0; i < MAX_L2CAP_LINKS; i++) {
+    bdas.push_back(Address(i));
+    handles.push_back(0x0040 + i);
+    EXPECT_EQ(i, Create(bdas[i], BT_TRANSPORT_BR_EDR, handles[i]));
+  }
+  ExpectSameAsScan(bdas, handles);
+
+  for (uint8_t i = 0; i < MAX_L2CAP_LINKS; i++) {
+    EXPECT_EQ(i, btm_bda_to_acl_index(bdas[i], BT_TRANSPORT_BR_EDR));
+    EXPECT_EQ(i, btm_handle_to_acl_index(handles[i]));
+  }
+
+  // Stale entries of removed links must not be found by address or handle.
+  for (uint8_t i = 0; i < MAX_L2CAP_LINKS; i += 2) Remove(i);
+  for (uint8_t i = 0; i < MAX_L2CAP_LINKS; i++) {
+    uint8_t expected = (i % 2) ? i : MAX_L2CAP_LINKS;
+    EXPECT_EQ(expected, btm_bda_to_acl_index(bdas[i], BT_TRANSPORT_BR_EDR));
+    EXPECT_EQ(expected, btm_handle_to_acl_index(handles[i]));
+  }
+  ExpectSameAsScan(bdas, handles);
+}
+
+// Links are removed from the middle of the probe sequences, and the entries
+// after them must still be found.
+TEST_F(BtmAclIndexTest, test_erase_keeps_following_entries) {
+  std::mt19937 rng(1);
+  std::vector<RawAddress> bdas;
+  for (int i = 0; i < 64; i++) {
+    RawAddress bda;
+    for (int j = 0; j < 6; j++) bda.address[j] = rng();
+    bdas.push_back(bda);
+  }
+  std::vector<uint16_t> handles;
+  for (uint16_t h = 0; h < 64; h++) handles.push_back(h);
+
+  std::uniform_int_distribution<int> pick(0, bdas.size() - 1);
+  for (int round = 0; round < 5000; round++) {
+    uint8_t xx = rng() % MAX_L2CAP_LINKS;
+    if (btm_cb.acl_db[xx].in_use) {
+      Remove(xx);
+    } else {
+      int i = pick(rng);
+      tBT_TRANSPORT transport =
+          (rng() % 2) ? BT_TRANSPORT_LE : BT_TRANSPORT_BR_EDR;
+      if (btm_bda_to_acl_index(bdas[i], transport) < MAX_L2CAP_LINKS) continue;
+      Create(bdas[i], transport, handles[pick(rng)]);
+    }
+    ExpectSameAsScan(bdas, handles);
+    if (HasFailure()) return;
+  }
+}
+
+TEST_F(BtmAclIndexTest, test_handle_reused_after_disconnect) {
+  RawAddress first = Address(1);
+  RawAddress second = Address(2);
+  uint8_t filler = Create(Address(3), BT_TRANSPORT_BR_EDR, 0x0001);
+  uint8_t xx = Create(first, BT_TRANSPORT_BR_EDR, 0x0040);
+  Remove(filler);
+
+  // The controller gives the handle to the next link, in another entry.
+  Remove(xx);
+  EXPECT_EQ(MAX_L2CAP_LINKS, btm_handle_to_acl_index(0x0040));
+  uint8_t yy = Create(second, BT_TRANSPORT_LE, 0x0040);
+  EXPECT_NE(xx, yy);
+  EXPECT_EQ(yy, btm_handle_to_acl_index(0x0040));
+  EXPECT_EQ(MAX_L2CAP_LINKS, btm_bda_to_acl_index(first, BT_TRANSPORT_BR_EDR));
+  EXPECT_EQ(yy, btm_bda_to_acl_index(second, BT_TRANSPORT_LE));
+
+  // Then the first entry is reused for another handle.
+  uint8_t zz = Create(first, BT_TRANSPORT_BR_EDR, 0x0041);
+  EXPECT_EQ(xx, zz);
+  EXPECT_EQ(yy, btm_handle_to_acl_index(0x0040));
+  EXPECT_EQ(zz, btm_handle_to_acl_index(0x0041));
+  ExpectSameAsScan({first, second, Address(3)}, {0x0001, 0x0040, 0x0041});
+}
+
+TEST_F(BtmAclIndexTest, test_shared_and_changed_handle) {
+  uint8_t xx = Create(Address(1), BT_TRANSPORT_BR_EDR, 0x0040);
+  uint8_t yy = Create(Address(2), BT_TRANSPORT_BR_EDR, 0x0040);
+
+  // The first link using a handle is returned, then the next one.
+  EXPECT_EQ(xx, btm_handle_to_acl_index(0x0040));
+  Remove(xx);
+  EXPECT_EQ(yy, btm_handle_to_acl_index(0x0040));
+
+  // As a duplicate btm_acl_created() does.
+  btm_acl_index_set_handle(yy, 0x0050);
+  EXPECT_EQ(MAX_L2CAP_LINKS, btm_handle_to_acl_index(0x0040));
+  EXPECT_EQ(yy, btm_handle_to_acl_index(0x0050));
+
+  // Handles outside of the index are found by scanning.
+  btm_acl_index_set_handle(yy, HCI_DATA_HANDLE_MASK + 1);
+  EXPECT_EQ(yy, btm_handle_to_acl_index(HCI_DATA_HANDLE_MASK + 1));
+  EXPECT_EQ(MAX_L2CAP_LINKS, btm_handle_to_acl_index(0x0050));
+  ExpectSameAsScan({Address(1), Address(2)},
+                   {0x0040, 0x0050, (uint16_t)(HCI_DATA_HANDLE_MASK + 1)});
+}
+
+TEST_F(BtmAclIndexTest, test_transports_of_same_address) {
+  RawAddress bda = Address(1);
+  uint8_t br_edr = Create(bda, BT_TRANSPORT_BR_EDR, 0x0040);
+  uint8_t le = Create(bda, BT_TRANSPORT_LE, 0x0041);
+  EXPECT_NE(br_edr, le);
+  EXPECT_EQ(br_edr, btm_bda_to_acl_index(bda, BT_TRANSPORT_BR_EDR));
+  EXPECT_EQ(le, btm_bda_to_acl_index(bda, BT_TRANSPORT_LE));
+
+  Remove(le);
+  EXPECT_EQ(br_edr, btm_bda_to_acl_index(bda, BT_TRANSPORT_BR_EDR));
+  EXPECT_EQ(MAX_L2CAP_LINKS, btm_bda_to_acl_index(bda, BT_TRANSPORT_LE));
+
+  le = Create(bda, BT_TRANSPORT_LE, 0x0042);
+  Remove(br_edr);
+  EXPECT_EQ(MAX_L2CAP_LINKS, btm_bda_to_acl_index(bda, BT_TRANSPORT_BR_EDR));
+  EXPECT_EQ(le, btm_bda_to_acl_index(bda, BT_TRANSPORT_LE));
+  ExpectSameAsScan({bda}, {0x0040, 0x0041, 0x0042});
+}
@@ -0,0 +1,396 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <string.h>
+
+#include <algorithm>
+#include <list>
+#include <random>
+#include <vector>
+
+#include "btm_api_types.h"
+#include "btm_ble_api_types.h"
+#include "btm_ble_batchscan_store.h"
+
+namespace {
+
+RawAddress Address(uint8_t n) {
+  RawAddress bda;
+  memset(bda.address, 0x33, sizeof(bda.address));
+  bda.address[0] = 0xc0;
+  bda.address[5] = n;
+  return bda;
+}
+
+// A result as the framework parses the reports read from the controller
+struct Result {
+  RawAddress bda;
+  int rssi;
+  int age_ms;
+  std::vector<uint8_t> data;
+};
+
+std::vector<Result> ParseTruncated(std::vector<uint8_t> const& data,
+                                   uint8_t num_records) {
+  std::vector<Result> results;
+  EXPECT_EQ(num_records * BTM_BLE_BATCH_SCAN_TRUNC_REC_LEN, data.size());
+  for (size_t i = 0; i + BTM_BLE_BATCH_SCAN_TRUNC_REC_LEN <= data.size();
+       i += BTM_BLE_BATCH_SCAN_TRUNC_REC_LEN) {
+    Result result;
+    for (int j = 0; j < 6; j++) result.bda.address[j] = data[i + 5 - j];
+    result.rssi = (int8_t)data[i + 8];
+    result.age_ms = (data[i + 9] | (data[i + 10] << 8)) * 50;
+    results.push_back(result);
+  }
+  return results;
+}
+
+std::vector<Result> ParseFull(std::vector<uint8_t> const& data,
+                              uint8_t num_records) {
+  std::vector<Result> results;
+  size_t position = 0;
+  while (position < data.size()) {
+    Result result;
+    for (int j = 0; j < 6; j++) result.bda.address[j] = data[position + 5 - j];
+    result.rssi = (int8_t)data[position + 8];
+    result.age_ms = (data[position + 9] | (data[position + 10] << 8)) * 50;
+    position += 11;
+    uint8_t adv_len = data[position++];
+    result.data.assign(data.begin() + position,
+                       data.begin() + position + adv_len);
+    position += adv_len;
+    uint8_t scan_rsp_len = data[position++];
+    position += scan_rsp_len;
+    results.push_back(result);
+  }
+  EXPECT_EQ(data.size(), position);
+  EXPECT_EQ(num_records, results.size());
+  return results;
+}
+
+std::vector<uint8_t> AdvData(uint8_t n, size_t len) {
+  std::vector<uint8_t> data(len, n);
+  if (len != 0) data[0] = len - 1;
+  return data;
+}
+
+class BleBatchScanStoreTest : public ::testing::Test {
+ protected:
+  BleBatchScanStoreTest() : store_(1000) {}
+
+  bool Add(uint8_t n, int8_t rssi, uint64_t now_ms, size_t len = 20) {
+    std::vector<uint8_t> data = AdvData(n, len);
+    return store_.Add(BLE_ADDR_PUBLIC, Address(n), 0, rssi, data.data(),
+                      data.size(), now_ms);
+  }
+
+  std::vector<Result> Read(uint8_t scan_mode, uint64_t now_ms) {
+    std::vector<uint8_t> data;
+    uint8_t num_records = store_.Read(scan_mode, now_ms, &data);
+    return scan_mode == BTM_BLE_BATCH_SCAN_MODE_PASS
+               ? ParseTruncated(data, num_records)
+               : ParseFull(data, num_records);
+  }
+
+  BleBatchScanStore store_;
+};
+
+}  // namespace
+
+TEST_F(BleBatchScanStoreTest, test_disabled) {
+  store_.SetStorageConfig(50, 50, 0);
+  EXPECT_FALSE(Add(1, -40, 0));
+  EXPECT_EQ(0u, store_.num_truncated());
+  EXPECT_EQ(0u, store_.num_full());
+}
+
+TEST_F(BleBatchScanStoreTest, test_truncated_one_record_per_address) {
+  store_.SetStorageConfig(50, 50, 0);
+  store_.Enable(BTM_BLE_BATCH_SCAN_MODE_PASS, BTM_BLE_DISCARD_OLD_ITEMS);
+
+  Add(1, -40, 1000);
+  Add(2, -50, 1000);
+  Add(1, -45, 3000);
+  EXPECT_EQ(2u, store_.num_truncated());
+  EXPECT_EQ(0u, store_.num_full());
+
+  std::vector<Result> results = Read(BTM_BLE_BATCH_SCAN_MODE_PASS, 5000);
+  ASSERT_EQ(2u, results.size());
+  for (const Result& result : results) {
+    if (result.bda == Address(1)) {
+      EXPECT_EQ(-45, result.rssi);
+      EXPECT_EQ(2000, result.age_ms);
+    } else {
+      EXPECT_EQ(Address(2), result.bda);
+      EXPECT_EQ(4000, result.age_ms);
+    }
+  }
+
+  // Read results are gone
+  EXPECT_EQ(0u, Read(BTM_BLE_BATCH_SCAN_MODE_PASS, 5000).size());
+}
+
+TEST_F(BleBatchScanStoreTest, test_full_records) {
+  store_.SetStorageConfig(50, 50, 0);
+  store_.Enable(BTM_BLE_BATCH_SCAN_MODE_PASS_ACTI, BTM_BLE_DISCARD_OLD_ITEMS);
+
+  Add(1, -40, 0, 10);
+  Add(1, -41, 100, 31);
+  Add(2, -42, 200, 0);
+  EXPECT_EQ(2u, store_.num_truncated());
+
+  std::vector<Result> results = Read(BTM_BLE_BATCH_SCAN_MODE_ACTI, 1000);
+  ASSERT_EQ(3u, results.size());
+  EXPECT_EQ(AdvData(1, 10), results[0].data);
+  EXPECT_EQ(1000, results[0].age_ms);
+  EXPECT_EQ(-41, results[1].rssi);
+  EXPECT_EQ(AdvData(1, 31), results[1].data);
+  EXPECT_EQ(Address(2), results[2].bda);
+  EXPECT_TRUE(results[2].data.empty());
+
+  // The truncated results are read on their own
+  EXPECT_EQ(2u, store_.num_truncated());
+
+  // Too long for the report format
+  std::vector<uint8_t> data(300, 0);
+  store_.Add(BLE_ADDR_PUBLIC, Address(3), 0, -40, data.data(), data.size(),
+             0);
+  EXPECT_EQ(0u, store_.num_full());
+}
+
+TEST_F(BleBatchScanStoreTest, test_discard_old_items) {
+  // 500 bytes of full results: 15 of 33 bytes
+  store_.SetStorageConfig(50, 50, 0);
+  store_.Enable(BTM_BLE_BATCH_SCAN_MODE_ACTI, BTM_BLE_DISCARD_OLD_ITEMS);
+
+  for (int i = 0; i < 40; i++) Add(i, -40, i * 100);
+  std::vector<Result> results = Read(BTM_BLE_BATCH_SCAN_MODE_ACTI, 4000);
+  ASSERT_EQ(15u, results.size());
+  for (int i = 0; i < 15; i++) EXPECT_EQ(Address(25 + i), results[i].bda);
+}
+
+TEST_F(BleBatchScanStoreTest, test_discard_lower_rssi_items) {
+  // 500 bytes of truncated results: 45 of 11 bytes
+  store_.SetStorageConfig(50, 50, 0);
+  store_.Enable(BTM_BLE_BATCH_SCAN_MODE_PASS,
+                BTM_BLE_DISCARD_LOWER_RSSI_ITEMS);
+
+  for (int i = 0; i < 90; i++) Add(i, -100 + i, 0);
+  for (int i = 90; i < 100; i++) Add(i, -100, 0);
+  std::vector<Result> results = Read(BTM_BLE_BATCH_SCAN_MODE_PASS, 0);
+  ASSERT_EQ(45u, results.size());
+  for (const Result& result : results) EXPECT_GE(result.rssi, -100 + 45);
+}
+
+TEST_F(BleBatchScanStoreTest, test_record_limit) {
+  BleBatchScanStore store(100000);
+  store.SetStorageConfig(100, 100, 0);
+  store.Enable(BTM_BLE_BATCH_SCAN_MODE_PASS_ACTI, BTM_BLE_DISCARD_OLD_ITEMS);
+  for (int i = 0; i < 600; i++) {
+    RawAddress bda = Address(i);
+    bda.address[4] = i >> 8;
+    store.Add(BLE_ADDR_PUBLIC, bda, 0, -40, NULL, 0, i);
+  }
+  EXPECT_EQ((size_t)BTM_BLE_SOFT_BATCH_SCAN_MAX_RECORDS, store.num_truncated());
+  EXPECT_EQ((size_t)BTM_BLE_SOFT_BATCH_SCAN_MAX_RECORDS, store.num_full());
+}
+
+TEST_F(BleBatchScanStoreTest, test_threshold) {
+  // Told at 50% of the 500 bytes of truncated results: 23 records
+  store_.SetStorageConfig(50, 50, 50);
+  store_.Enable(BTM_BLE_BATCH_SCAN_MODE_PASS, BTM_BLE_DISCARD_OLD_ITEMS);
+
+  for (int i = 0; i < 22; i++) EXPECT_FALSE(Add(i, -40, 0));
+  EXPECT_TRUE(Add(22, -40, 0));
+  // Once until read
+  EXPECT_FALSE(Add(23, -40, 0));
+  Read(BTM_BLE_BATCH_SCAN_MODE_PASS, 0);
+  for (int i = 0; i < 22; i++) EXPECT_FALSE(Add(i, -40, 0));
+  EXPECT_TRUE(Add(22, -40, 0));
+}
+
+TEST_F(BleBatchScanStoreTest, test_timeout) {
+  store_.SetStorageConfig(50, 50, 0);
+  store_.set_timeout_ms(10000);
+  store_.Enable(BTM_BLE_BATCH_SCAN_MODE_ACTI, BTM_BLE_DISCARD_OLD_ITEMS);
+
+  EXPECT_FALSE(Add(1, -40, 0));
+  EXPECT_FALSE(Add(2, -40, 9950));
+  EXPECT_TRUE(Add(3, -40, 10000));
+  EXPECT_FALSE(Add(4, -40, 20000));
+  Read(BTM_BLE_BATCH_SCAN_MODE_ACTI, 20000);
+  EXPECT_FALSE(Add(5, -40, 20000));
+}
+
+namespace {
+
+// The controller storage, one result after the other
+class VendorModel {
+ public:
+  struct Record {
+    uint8_t n;
+    int8_t rssi;
+    uint64_t time_ms;
+    size_t len;
+  };
+
+  VendorModel(size_t trunc_bytes, size_t full_bytes, uint8_t discard_rule)
+      : trunc_bytes_(trunc_bytes),
+        full_bytes_(full_bytes),
+        discard_rule_(discard_rule) {}
+
+  void Add(uint8_t n, int8_t rssi, uint64_t time_ms, size_t len) {
+    bool found = false;
+    for (Record& record : trunc_) {
+      if (record.n != n) continue;
+      record.rssi = rssi;
+      record.time_ms = time_ms;
+      found = true;
+    }
+    if (!found) Add(&trunc_, trunc_bytes_, {n, rssi, time_ms, 0}, 11);
+    Add(&full_, full_bytes_, {n, rssi, time_ms, len}, 13 + len);
+  }
+
+  std::list<Record> trunc_, full_;
+
+ private:
+  void Add(std::list<Record>* records, size_t max_bytes, Record record,
+           size_t record_len) {
+    while (Bytes(*records, record_len == 11) + record_len > max_bytes ||
+           records->size() >= BTM_BLE_SOFT_BATCH_SCAN_MAX_RECORDS) {
+      auto victim = records->begin();
+      for (auto it = records->begin(); it != records->end(); it++) {
+        if (discard_rule_ == BTM_BLE_DISCARD_LOWER_RSSI_ITEMS &&
+            it->rssi != victim->rssi) {
+          if (it->rssi < victim->rssi) victim = it;
+        } else if (it->time_ms < victim->time_ms) {
+          victim = it;
+        }
+      }
+      if (discard_rule_ == BTM_BLE_DISCARD_LOWER_RSSI_ITEMS &&
+          record.rssi < victim->rssi)
+        return;
+      records->erase(victim);
+    }
+    records->push_back(record);
+  }
+
+  static size_t Bytes(std::list<Record> const& records, bool truncated) {
+    size_t bytes = 0;
+    for (const Record& record : records)
+      bytes += truncated ? 11 : 13 + record.len;
+    return bytes;
+  }
+
+  size_t trunc_bytes_, full_bytes_;
+  uint8_t discard_rule_;
+};
+
+// Uniform in [0, n).
+uint32_t Uniform(std::mt19937* rng, uint32_t n) {
+  return std::uniform_int_distribution<uint32_t>(0, n - 1)(*rng);
+}
+
+}  // namespace
+
+// Random reports give the results the controller would keep
+TEST(BleBatchScanStoreRandomTest, test_matches_vendor_model) {
+  std::mt19937 rng(1);
+  for (int round = 0; round < 50; round++) {
+    uint8_t discard_rule = Uniform(&rng, 2);
+    uint8_t full_max = 10 + Uniform(&rng, 40);
+    uint8_t trunc_max = 10 + Uniform(&rng, 40);
+    BleBatchScanStore store(2000);
+    store.SetStorageConfig(full_max, trunc_max, 0);
+    store.Enable(BTM_BLE_BATCH_SCAN_MODE_PASS_ACTI, discard_rule);
+    VendorModel model(2000 * trunc_max / 100, 2000 * full_max / 100,
+                      discard_rule);
+
+    uint64_t now_ms = 0;
+    int num_reports = Uniform(&rng, 500);
+    for (int i = 0; i < num_reports; i++) {
+      uint8_t n = Uniform(&rng, 60);
+      int8_t rssi = -30 - Uniform(&rng, 70);
+      size_t len = Uniform(&rng, 63);
+      now_ms += 50 * (1 + Uniform(&rng, 10));
+      std::vector<uint8_t> data = AdvData(n, len);
+      store.Add(BLE_ADDR_PUBLIC, Address(n), 0, rssi, data.data(), len,
+                now_ms);
+      model.Add(n, rssi, now_ms, len);
+    }
+
+    std::vector<uint8_t> data;
+    uint8_t num = store.Read(BTM_BLE_BATCH_SCAN_MODE_ACTI, now_ms, &data);
+    std::vector<Result> full = ParseFull(data, num);
+    ASSERT_EQ(model.full_.size(), full.size()) << "round " << round;
+    auto it = model.full_.begin();
+    for (size_t i = 0; i < full.size(); i++, it++) {
+      EXPECT_EQ(Address(it->n), full[i].bda);
+      EXPECT_EQ(it->rssi, full[i].rssi);
+      EXPECT_EQ((int)(now_ms - it->time_ms), full[i].age_ms);
+      EXPECT_EQ(AdvData(it->n, it->len), full[i].data);
+    }
+
+    num = store.Read(BTM_BLE_BATCH_SCAN_MODE_PASS, now_ms, &data);
+    std::vector<Result> truncated = ParseTruncated(data, num);
+    ASSERT_EQ(model.trunc_.size(), truncated.size()) << "round " << round;
+    for (const VendorModel::Record& record : model.trunc_) {
+      auto found = std::find_if(
+          truncated.begin(), truncated.end(),
+          [&record](const Result& result) {
+            return result.bda == Address(record.n);
+          });
+      ASSERT_TRUE(found != truncated.end());
+      EXPECT_EQ(record.rssi, found->rssi);
+      EXPECT_EQ((int)(now_ms - record.time_ms), found->age_ms);
+    }
+  }
+}
+
+// A scan of 40 devices advertising every 100 ms, read every 10 seconds by the
+// client or when the storage is nearly full, wakes the client up about once
+// per batch rather than on every report.
+TEST(BleBatchScanStoreRandomTest, test_wakeups) {
+  BleBatchScanStore store;
+  store.SetStorageConfig(50, 50, 90);
+  store.Enable(BTM_BLE_BATCH_SCAN_MODE_PASS, BTM_BLE_DISCARD_OLD_ITEMS);
+
+  const uint64_t kDurationMs = 10 * 60 * 1000, kBatchMs = 10 * 1000;
+  int num_reports = 0, num_wakeups = 0, num_results = 0;
+  uint64_t next_read_ms = kBatchMs;
+  for (uint64_t now_ms = 0; now_ms < kDurationMs; now_ms += 100) {
+    for (int n = 0; n < 40; n++) {
+      num_reports++;
+      bool notify = store.Add(BLE_ADDR_PUBLIC, Address(n), 0, -60, NULL, 0,
+                              now_ms);
+      if (notify || now_ms >= next_read_ms) {
+        std::vector<uint8_t> data;
+        num_results += store.Read(BTM_BLE_BATCH_SCAN_MODE_PASS, now_ms, &data);
+        num_wakeups++;
+        next_read_ms = now_ms + kBatchMs;
+      }
+    }
+  }
+  RecordProperty("reports", num_reports);
+  RecordProperty("results", num_results);
+  RecordProperty("wakeups", num_wakeups);
+  EXPECT_LE(num_wakeups, (int)(kDurationMs / kBatchMs) + 1);
+  EXPECT_EQ(40 * num_wakeups, num_results);
+}
@@ -0,0 +1,248 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <string.h>
+
+#include <algorithm>
+#include <random>
+#include <set>
+#include <vector>
+
+#include "btm_ble_resolving_list.h"
+
+namespace {
+
+using Device = BleResolvingList::Device;
+
+RawAddress Address(int n) {
+  RawAddress bda;
+  memset(bda.address, 0x44, sizeof(bda.address));
+  bda.address[4] = n >> 8;
+  bda.address[5] = n;
+  return bda;
+}
+
+// |num| bonded devices, the last bonded the most recently used
+std::vector<Device> Bonds(int num) {
+  std::vector<Device> devices;
+  for (int n = 0; n < num; n++)
+    devices.push_back(
+        {Address(n), BTM_BLE_RL_PRIO_RECENT, (uint32_t)n, false});
+  return devices;
+}
+
+// Applies |changes| to the devices, as the controller list would
+void Apply(std::vector<Device>* devices,
+           BleResolvingList::Changes const& changes) {
+  for (Device& device : *devices) {
+    if (std::count(changes.remove.begin(), changes.remove.end(),
+                   device.address)) {
+      ASSERT_TRUE(device.in_list);
+      device.in_list = false;
+    }
+    if (std::count(changes.add.begin(), changes.add.end(), device.address)) {
+      ASSERT_FALSE(device.in_list);
+      device.in_list = true;
+    }
+  }
+}
+
+std::set<RawAddress> InList(std::vector<Device> const& devices) {
+  std::set<RawAddress> in_list;
+  for (const Device& device : devices)
+    if (device.in_list) in_list.insert(device.address);
+  return in_list;
+}
+
+// Uniform in [0, n).
+uint32_t Uniform(std::mt19937* rng, uint32_t n) {
+  return std::uniform_int_distribution<uint32_t>(0, n - 1)(*rng);
+}
+
+}  // namespace
+
+TEST(BleResolvingListTest, test_all_fit) {
+  std::vector<Device> devices = Bonds(5);
+  BleResolvingList::Changes changes = BleResolvingList::Plan(devices, 8);
+  EXPECT_TRUE(changes.remove.empty());
+  EXPECT_EQ(5u, changes.add.size());
+
+  Apply(&devices, changes);
+  EXPECT_TRUE(BleResolvingList::Plan(devices, 8).empty());
+}
+
+TEST(BleResolvingListTest, test_more_bonds_than_capacity) {
+  std::vector<Device> devices = Bonds(20);
+  Apply(&devices, BleResolvingList::Plan(devices, 8));
+
+  std::set<RawAddress> expected;
+  for (int n = 12; n < 20; n++) expected.insert(Address(n));
+  EXPECT_EQ(expected, InList(devices));
+  EXPECT_TRUE(BleResolvingList::Plan(devices, 8).empty());
+}
+
+TEST(BleResolvingListTest, test_connecting_device_takes_a_place) {
+  std::vector<Device> devices = Bonds(20);
+  Apply(&devices, BleResolvingList::Plan(devices, 8));
+
+  // The oldest bond is being connected to: it replaces the least recently
+  // used device in the list, and nothing else changes
+  devices[0].priority = BTM_BLE_RL_PRIO_CONNECTING;
+  BleResolvingList::Changes changes = BleResolvingList::Plan(devices, 8);
+  ASSERT_EQ(1u, changes.remove.size());
+  ASSERT_EQ(1u, changes.add.size());
+  EXPECT_EQ(Address(12), changes.remove[0]);
+  EXPECT_EQ(Address(0), changes.add[0]);
+}
+
+TEST(BleResolvingListTest, test_background_connections_kept) {
+  std::vector<Device> devices = Bonds(20);
+  for (int n = 0; n < 3; n++) devices[n].priority = BTM_BLE_RL_PRIO_BG_CONN;
+  Apply(&devices, BleResolvingList::Plan(devices, 8));
+  for (int n = 0; n < 3; n++) EXPECT_TRUE(devices[n].in_list);
+
+  // Devices used since do not push them out
+  for (int n = 20; n < 40; n++)
+    devices.push_back(
+        {Address(n), BTM_BLE_RL_PRIO_RECENT, (uint32_t)n, false});
+  Apply(&devices, BleResolvingList::Plan(devices, 8));
+  for (int n = 0; n < 3; n++) EXPECT_TRUE(devices[n].in_list);
+  EXPECT_EQ(8u, InList(devices).size());
+
+  // Unless a connection is pending to more devices than the list holds
+  for (int n = 20; n < 28; n++)
+    devices[n].priority = BTM_BLE_RL_PRIO_CONNECTING;
+  Apply(&devices, BleResolvingList::Plan(devices, 8));
+  for (int n = 20; n < 28; n++) EXPECT_TRUE(devices[n].in_list);
+}
+
+TEST(BleResolvingListTest, test_ties_keep_the_list) {
+  std::vector<Device> devices = Bonds(20);
+  for (Device& device : devices) device.last_used = 0;
+  for (int n = 10; n < 18; n++) devices[n].in_list = true;
+
+  // No device is more important than the ones in the list
+  EXPECT_TRUE(BleResolvingList::Plan(devices, 8).empty());
+}
+
+TEST(BleResolvingListTest, test_capacity_shrinks) {
+  std::vector<Device> devices = Bonds(10);
+  Apply(&devices, BleResolvingList::Plan(devices, 10));
+
+  // Entries taken for something else: the least important devices go
+  BleResolvingList::Changes changes = BleResolvingList::Plan(devices, 6);
+  EXPECT_TRUE(changes.add.empty());
+  std::set<RawAddress> removed(changes.remove.begin(), changes.remove.end());
+  std::set<RawAddress> expected;
+  for (int n = 0; n < 4; n++) expected.insert(Address(n));
+  EXPECT_EQ(expected, removed);
+}
+
+TEST(BleResolvingListTest, test_hit_rate) {
+  BleResolvingList resolving_list;
+  EXPECT_EQ(100, (int)resolving_list.hit_rate());
+
+  for (int i = 0; i < 3; i++) resolving_list.OnResolved(true);
+  resolving_list.OnResolved(false);
+  EXPECT_EQ(3u, resolving_list.hits());
+  EXPECT_EQ(1u, resolving_list.misses());
+  EXPECT_EQ(75, (int)resolving_list.hit_rate());
+}
+
+// Random priorities and uses: the list always holds the most important
+// devices, and the changes are the fewest to get there
+TEST(BleResolvingListRandomTest, test_minimal_changes) {
+  std::mt19937 rng(42);
+  std::vector<Device> devices = Bonds(40);
+  uint32_t clock = 40;
+
+  for (int round = 0; round < 2000; round++) {
+    size_t capacity = 4 + Uniform(&rng, 12);
+    for (int i = 0; i < 3; i++) {
+      Device& device = devices[Uniform(&rng, devices.size())];
+      device.last_used = clock++;
+      device.priority = (tBTM_BLE_RL_PRIO)Uniform(&rng, 3);
+    }
+
+    std::set<RawAddress> before = InList(devices);
+    BleResolvingList::Changes changes =
+        BleResolvingList::Plan(devices, capacity);
+    Apply(&devices, changes);
+    std::set<RawAddress> after = InList(devices);
+    ASSERT_EQ(std::min(capacity, devices.size()), after.size());
+
+    // Nothing out of the list is more important than anything in it
+    for (const Device& in : devices) {
+      if (!in.in_list) continue;
+      for (const Device& out : devices) {
+        if (out.in_list) continue;
+        ASSERT_TRUE(in.priority > out.priority ||
+                    (in.priority == out.priority &&
+                     in.last_used >= out.last_used));
+      }
+    }
+
+    // Each change is needed
+    size_t changed = 0;
+    for (const RawAddress& address : before)
+      if (!after.count(address)) changed++;
+    for (const RawAddress& address : after)
+      if (!before.count(address)) changed++;
+    ASSERT_EQ(changed, changes.remove.size() + changes.add.size());
+  }
+}
+
+// A day of use of 30 bonded devices, a few of them used most of the time,
+// with a list of 8: the share of RPAs resolved by the controller, against
+// the list holding the first devices bonded, as before
+TEST(BleResolvingListRandomTest, test_hit_rate_against_first_bonded) {
+  const int kNumBonds = 30;
+  const size_t kCapacity = 8;
+  std::mt19937 rng(7);
+
+  std::vector<Device> devices;
+  for (int n = 0; n < kNumBonds; n++)
+    devices.push_back({Address(n), BTM_BLE_RL_PRIO_RECENT, 0, false});
+  // The first bonded hold the list, until they are unpaired
+  std::vector<Device> first_bonded = devices;
+  for (size_t n = 0; n < kCapacity; n++) first_bonded[n].in_list = true;
+
+  BleResolvingList managed, fixed;
+  uint32_t clock = 0;
+  for (int i = 0; i < 20000; i++) {
+    // Most uses go to a few devices, bonded after the list filled up
+    int n = Uniform(&rng, 4) != 0 ? kCapacity + Uniform(&rng, 6)
+                                  : Uniform(&rng, kNumBonds);
+    managed.OnResolved(devices[n].in_list);
+    fixed.OnResolved(first_bonded[n].in_list);
+
+    // Resolved on the host: it connects, and the list is updated
+    devices[n].last_used = ++clock;
+    if (!devices[n].in_list)
+      Apply(&devices, BleResolvingList::Plan(devices, kCapacity));
+  }
+
+  RecordProperty("hit_rate", managed.hit_rate());
+  RecordProperty("misses", managed.misses());
+  RecordProperty("first_bonded_hit_rate", fixed.hit_rate());
+  RecordProperty("first_bonded_misses", fixed.misses());
+  EXPECT_GT((int)managed.hit_rate(), 60);
+  EXPECT_LT((int)fixed.hit_rate(), 20);
+}
@@ -0,0 +1,232 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <benchmark/benchmark.h>
+#include <string.h>
+
+#include <vector>
+
+#include "advertise_data_parser.h"
+#include "btm_api.h"
+#include "btm_ble_api.h"
+#include "btm_ble_soft_filter.h"
+
+using ::benchmark::State;
+using bluetooth::Uuid;
+
+void LogMsg(uint32_t trace_set_mask, const char* fmt_str, ...) {}
+void vnd_LogMsg(uint32_t trace_set_mask, const char* fmt_str, ...) {}
+
+namespace {
+
+constexpr int kNumFilters = 128;
+constexpr int kNumReports = 10000;
+
+void AddField(std::vector<uint8_t>* data, uint8_t type,
+              std::vector<uint8_t> const& value) {
+  data->push_back(value.size() + 1);
+  data->push_back(type);
+  data->insert(data->end(), value.begin(), value.end());
+}
+
+RawAddress Address(int n) {
+  RawAddress bda;
+  memset(bda.address, 0x22, sizeof(bda.address));
+  bda.address[4] = n >> 8;
+  bda.address[5] = n;
+  return bda;
+}
+
+std::vector<uint8_t> Name(int n) {
+  char name[16];
+  snprintf(name, sizeof(name), "Device %d", n);
+  return std::vector<uint8_t>(name, name + strlen(name));
+}
+
+/* One condition per filter: devices by address, services, names, beacons of
+ * a company and service data frames, as set by the apps scanning */
+std::vector<ApcfCommand> MakeFilters() {
+  std::vector<ApcfCommand> filters;
+  for (int f = 0; f < kNumFilters; f++) {
+    ApcfCommand cmd;
+    cmd.uuid = cmd.uuid_mask = Uuid::kEmpty;
+    cmd.company = cmd.company_mask = 0;
+    cmd.org_id = cmd.tds_flags = cmd.tds_flags_mask = 0;
+    switch (f % 5) {
+      case 0:
+        cmd.type = BTM_BLE_PF_ADDR_FILTER;
+        cmd.address = Address(f);
+        break;
+      case 1:
+        cmd.type = BTM_BLE_PF_SRVC_UUID;
+        cmd.uuid = Uuid::From16Bit(0x1800 + f);
+        break;
+      case 2:
+        cmd.type = BTM_BLE_PF_LOCAL_NAME;
+        cmd.name = Name(f);
+        break;
+      case 3:
+        cmd.type = BTM_BLE_PF_MANU_DATA;
+        cmd.company = f;
+        cmd.data = {0x02, 0x15};
+        cmd.data_mask = {0xff, 0xff};
+        break;
+      case 4:
+        cmd.type = BTM_BLE_PF_SRVC_DATA_PATTERN;
+        cmd.data = {0xaa, 0xfe, (uint8_t)f};
+        cmd.data_mask = {0xff, 0xff, 0xff};
+        break;
+    }
+    filters.push_back(cmd);
+  }
+  return filters;
+}
+
+/* Reports of a busy scan, a few of them matching a filter */
+std::vector<std::vector<uint8_t>> MakeReports() {
+  std::vector<std::vector<uint8_t>> reports;
+  for (int r = 0; r < kNumReports; r++) {
+    std::vector<uint8_t> data;
+    int n = r % 7 == 0 ? r % kNumFilters : kNumFilters + r % 100;
+    AddField(&data, BTM_BLE_AD_TYPE_FLAG, {0x06});
+    switch (r % 3) {
+      case 0:
+        AddField(&data, BTM_EIR_MANUFACTURER_SPECIFIC_TYPE,
+                 {(uint8_t)n, (uint8_t)(n >> 8), 0x02, 0x15, 0x01, 0x02, 0x03,
+                  0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c});
+        break;
+      case 1:
+        AddField(&data, BTM_BLE_AD_TYPE_16SRV_CMPL, {0xaa, 0xfe});
+        AddField(&data, HCI_EIR_SERVICE_DATA_16BITS_UUID_TYPE,
+                 {0xaa, 0xfe, (uint8_t)n, 0x00, 0x01, 0x02, 0x03, 0x04});
+        break;
+      case 2:
+        AddField(&data, BTM_EIR_MORE_16BITS_UUID_TYPE,
+                 {(uint8_t)n, 0x18, 0x0a, 0x18});
+        AddField(&data, BTM_EIR_TX_POWER_LEVEL_TYPE, {0x04});
+        AddField(&data, BTM_BLE_AD_TYPE_NAME_CMPL, Name(n));
+        break;
+    }
+    reports.push_back(data);
+  }
+  return reports;
+}
+
+bool FieldStartsWith(std::vector<uint8_t> const& data, uint8_t type,
+                     std::vector<uint8_t> const& prefix,
+                     std::vector<uint8_t> const& pattern) {
+  uint8_t len;
+  const uint8_t* p = AdvertiseDataParser::GetFieldByType(data, type, &len);
+  if (p == NULL || len < prefix.size() + pattern.size()) return false;
+  return memcmp(p, prefix.data(), prefix.size()) == 0 &&
+         memcmp(p + prefix.size(), pattern.data(), pattern.size()) == 0;
+}
+
+/* Each filter checked in turn, as the framework scan filters do */
+bool LinearMatches(std::vector<ApcfCommand> const& filters,
+                   const RawAddress& bda, std::vector<uint8_t> const& data) {
+  uint8_t len;
+  for (const ApcfCommand& cmd : filters) {
+    switch (cmd.type) {
+      case BTM_BLE_PF_ADDR_FILTER:
+        if (bda == cmd.address) return true;
+        break;
+      case BTM_BLE_PF_SRVC_UUID: {
+        const uint8_t types[] = {BTM_EIR_MORE_16BITS_UUID_TYPE,
+                                 BTM_BLE_AD_TYPE_16SRV_CMPL};
+        for (uint8_t type : types) {
+          const uint8_t* p =
+              AdvertiseDataParser::GetFieldByType(data, type, &len);
+          for (int i = 0; p != NULL && i + 2 <= len; i += 2) {
+            if (Uuid::From16Bit(p[i] | (p[i + 1] << 8)) == cmd.uuid)
+              return true;
+          }
+        }
+        break;
+      }
+      case BTM_BLE_PF_LOCAL_NAME: {
+        const uint8_t* p = AdvertiseDataParser::GetFieldByType(
+            data, BTM_BLE_AD_TYPE_NAME_CMPL, &len);
+        if (p == NULL)
+          p = AdvertiseDataParser::GetFieldByType(
+              data, BTM_BLE_AD_TYPE_NAME_SHORT, &len);
+        if (p != NULL && len == cmd.name.size() &&
+            memcmp(p, cmd.name.data(), len) == 0)
+          return true;
+        break;
+      }
+      case BTM_BLE_PF_MANU_DATA:
+        if (FieldStartsWith(
+                data, BTM_EIR_MANUFACTURER_SPECIFIC_TYPE,
+                {(uint8_t)cmd.company, (uint8_t)(cmd.company >> 8)}, cmd.data))
+          return true;
+        break;
+      case BTM_BLE_PF_SRVC_DATA_PATTERN:
+        if (FieldStartsWith(data, HCI_EIR_SERVICE_DATA_16BITS_UUID_TYPE, {},
+                            cmd.data))
+          return true;
+        break;
+    }
+  }
+  return false;
+}
+
+}  // namespace
+
+static void BM_Filter_linear(State& state) {
+  std::vector<ApcfCommand> filters = MakeFilters();
+  std::vector<std::vector<uint8_t>> reports = MakeReports();
+
+  while (state.KeepRunning()) {
+    size_t matched = 0;
+    for (size_t r = 0; r < reports.size(); r++)
+      matched += LinearMatches(filters, Address(r), reports[r]);
+    benchmark::DoNotOptimize(matched);
+  }
+  state.SetItemsProcessed(state.iterations() * reports.size());
+}
+BENCHMARK(BM_Filter_linear);
+
+static void BM_Filter_compiled(State& state) {
+  std::vector<ApcfCommand> filters = MakeFilters();
+  std::vector<std::vector<uint8_t>> reports = MakeReports();
+
+  BleSoftFilter soft_filter;
+  for (int f = 0; f < kNumFilters; f++) {
+    btgatt_filt_param_setup_t params;
+    memset(&params, 0, sizeof(params));
+    params.feat_seln = 1 << filters[f].type;
+    params.filt_logic_type = BTM_BLE_PF_LOGIC_AND;
+    params.rssi_high_thres = (uint8_t)-128;
+    soft_filter.SetParams(BTM_BLE_SCAN_COND_ADD, f, &params);
+    soft_filter.AddConditions(f, {filters[f]});
+  }
+  soft_filter.Enable(true);
+
+  while (state.KeepRunning()) {
+    size_t matched = 0;
+    for (size_t r = 0; r < reports.size(); r++)
+      matched += soft_filter.Matches(Address(r), -60, reports[r].data(),
+                                     reports[r].size());
+    benchmark::DoNotOptimize(matched);
+  }
+  state.SetItemsProcessed(state.iterations() * reports.size());
+}
+BENCHMARK(BM_Filter_compiled);
+
+BENCHMARK_MAIN();
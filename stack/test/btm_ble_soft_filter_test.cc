@@ -0,0 +1,720 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <string.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "btm_api_types.h"
+#include "btm_ble_api_types.h"
+#include "btm_ble_soft_filter.h"
+
+using bluetooth::Uuid;
+
+namespace {
+
+constexpr uint16_t kAllFeatures = 0xff;
+
+RawAddress Address(uint8_t last) {
+  RawAddress bda;
+  memset(bda.address, 0x11, sizeof(bda.address));
+  bda.address[5] = last;
+  return bda;
+}
+
+btgatt_filt_param_setup_t Params(uint16_t feat_seln, int8_t rssi = -128,
+                                 uint8_t filt_logic = BTM_BLE_PF_LOGIC_AND,
+                                 uint16_t list_logic = 0) {
+  btgatt_filt_param_setup_t params;
+  memset(&params, 0, sizeof(params));
+  params.feat_seln = feat_seln;
+  params.list_logic_type = list_logic;
+  params.filt_logic_type = filt_logic;
+  params.rssi_high_thres = (uint8_t)rssi;
+  return params;
+}
+
+ApcfCommand Command(uint8_t type) {
+  ApcfCommand cmd;
+  cmd.type = type;
+  cmd.addr_type = 0;
+  cmd.uuid = cmd.uuid_mask = Uuid::kEmpty;
+  cmd.company = 0;
+  cmd.company_mask = 0;
+  cmd.org_id = 0;
+  cmd.tds_flags = 0;
+  cmd.tds_flags_mask = 0;
+  return cmd;
+}
+
+ApcfCommand UuidCommand(uint8_t type, const Uuid& uuid,
+                        const Uuid& mask = Uuid::kEmpty) {
+  ApcfCommand cmd = Command(type);
+  cmd.uuid = uuid;
+  cmd.uuid_mask = mask;
+  return cmd;
+}
+
+ApcfCommand NameCommand(const std::string& name) {
+  ApcfCommand cmd = Command(BTM_BLE_PF_LOCAL_NAME);
+  cmd.name.assign(name.begin(), name.end());
+  return cmd;
+}
+
+ApcfCommand ManuCommand(uint16_t company, std::vector<uint8_t> data = {},
+                        std::vector<uint8_t> mask = {},
+                        uint16_t company_mask = 0) {
+  ApcfCommand cmd = Command(BTM_BLE_PF_MANU_DATA);
+  cmd.company = company;
+  cmd.company_mask = company_mask;
+  cmd.data = data;
+  cmd.data_mask = mask;
+  return cmd;
+}
+
+void AddField(std::vector<uint8_t>* data, uint8_t type,
+              std::vector<uint8_t> const& value) {
+  data->push_back(value.size() + 1);
+  data->push_back(type);
+  data->insert(data->end(), value.begin(), value.end());
+}
+
+std::vector<uint8_t> NameField(const std::string& name, uint8_t type = 0x09) {
+  std::vector<uint8_t> data;
+  AddField(&data, type, std::vector<uint8_t>(name.begin(), name.end()));
+  return data;
+}
+
+class BleSoftFilterTest : public ::testing::Test {
+ protected:
+  void SetUp() override { filter_.Enable(true); }
+
+  void Add(uint8_t filt_index, const btgatt_filt_param_setup_t& params,
+           const std::vector<ApcfCommand>& commands) {
+    ASSERT_TRUE(filter_.SetParams(BTM_BLE_SCAN_COND_ADD, filt_index, &params));
+    ASSERT_TRUE(filter_.AddConditions(filt_index, commands));
+  }
+
+  bool Matches(const std::vector<uint8_t>& data, int8_t rssi = -50,
+               const RawAddress& bda = Address(0)) {
+    return filter_.Matches(bda, rssi, data.data(), data.size());
+  }
+
+  BleSoftFilter filter_;
+};
+
+}  // namespace
+
+TEST_F(BleSoftFilterTest, test_disabled_and_allow_all) {
+  filter_.Enable(false);
+  EXPECT_TRUE(Matches({}));
+
+  // Enabled without filters, nothing is delivered
+  filter_.Enable(true);
+  EXPECT_FALSE(Matches({}));
+
+  // No feature selected: everything above the RSSI threshold
+  Add(0, Params(0, -70), {});
+  EXPECT_TRUE(Matches({}, -70));
+  EXPECT_FALSE(Matches({}, -71));
+}
+
+TEST_F(BleSoftFilterTest, test_address) {
+  ApcfCommand cmd = Command(BTM_BLE_PF_ADDR_FILTER);
+  cmd.address = Address(1);
+  Add(3, Params(1 << BTM_BLE_PF_ADDR_FILTER), {cmd});
+
+  EXPECT_TRUE(Matches({}, -50, Address(1)));
+  EXPECT_FALSE(Matches({}, -50, Address(2)));
+}
+
+TEST_F(BleSoftFilterTest, test_service_uuids) {
+  Add(0, Params(1 << BTM_BLE_PF_SRVC_UUID),
+      {UuidCommand(BTM_BLE_PF_SRVC_UUID, Uuid::From16Bit(0x180f))});
+  Add(1, Params(1 << BTM_BLE_PF_SRVC_SOL_UUID),
+      {UuidCommand(BTM_BLE_PF_SRVC_SOL_UUID, Uuid::From16Bit(0x1812))});
+  Uuid uuid128 = Uuid::FromString("0000fe2c-1234-5678-9abc-def012345678");
+  Add(2, Params(1 << BTM_BLE_PF_SRVC_UUID),
+      {UuidCommand(BTM_BLE_PF_SRVC_UUID, uuid128)});
+
+  std::vector<uint8_t> data;
+  AddField(&data, 0x03, {0x0a, 0x18, 0x0f, 0x18});
+  EXPECT_TRUE(Matches(data));
+
+  // A 16 bit UUID in its 32 bit form
+  data.clear();
+  AddField(&data, 0x05, {0x0f, 0x18, 0x00, 0x00});
+  EXPECT_TRUE(Matches(data));
+
+  // Solicited, not offered
+  data.clear();
+  AddField(&data, 0x03, {0x12, 0x18});
+  EXPECT_FALSE(Matches(data));
+  data.clear();
+  AddField(&data, 0x14, {0x12, 0x18});
+  EXPECT_TRUE(Matches(data));
+
+  data.clear();
+  Uuid::UUID128Bit le = uuid128.To128BitLE();
+  AddField(&data, 0x07, std::vector<uint8_t>(le.begin(), le.end()));
+  EXPECT_TRUE(Matches(data));
+  le[0] ^= 1;
+  data.clear();
+  AddField(&data, 0x07, std::vector<uint8_t>(le.begin(), le.end()));
+  EXPECT_FALSE(Matches(data));
+}
+
+TEST_F(BleSoftFilterTest, test_service_uuid_mask) {
+  Add(0, Params(1 << BTM_BLE_PF_SRVC_UUID),
+      {UuidCommand(BTM_BLE_PF_SRVC_UUID, Uuid::From16Bit(0x1800),
+                   Uuid::From16Bit(0xff00))});
+
+  std::vector<uint8_t> data;
+  AddField(&data, 0x02, {0x0f, 0x18});
+  EXPECT_TRUE(Matches(data));
+  data.clear();
+  AddField(&data, 0x02, {0x0f, 0x19});
+  EXPECT_FALSE(Matches(data));
+}
+
+TEST_F(BleSoftFilterTest, test_local_name) {
+  Add(0, Params(1 << BTM_BLE_PF_LOCAL_NAME), {NameCommand("Keyboard")});
+
+  EXPECT_TRUE(Matches(NameField("Keyboard")));
+  EXPECT_TRUE(Matches(NameField("Keyboard", 0x08)));
+  EXPECT_FALSE(Matches(NameField("Keyboard 2")));
+  EXPECT_FALSE(Matches(NameField("Keyb")));
+
+  // The complete name wins over the shortened one
+  std::vector<uint8_t> data = NameField("Keyboard", 0x08);
+  std::vector<uint8_t> complete = NameField("Keyboard 2");
+  data.insert(data.end(), complete.begin(), complete.end());
+  EXPECT_FALSE(Matches(data));
+
+  // Only the first BTM_BLE_PF_STR_LEN_MAX bytes are compared
+  std::string long_name(BTM_BLE_PF_STR_LEN_MAX, 'x');
+  Add(1, Params(1 << BTM_BLE_PF_LOCAL_NAME), {NameCommand(long_name + "a")});
+  EXPECT_TRUE(Matches(NameField(long_name + "b")));
+}
+
+TEST_F(BleSoftFilterTest, test_manufacturer_data) {
+  Add(0, Params(1 << BTM_BLE_PF_MANU_DATA),
+      {ManuCommand(0x004c, {0x02, 0x15, 0x00}, {0xff, 0xff, 0x00})});
+
+  std::vector<uint8_t> data;
+  AddField(&data, 0xff, {0x4c, 0x00, 0x02, 0x15, 0x77, 0x01});
+  EXPECT_TRUE(Matches(data));
+
+  // Too short for the pattern
+  data.clear();
+  AddField(&data, 0xff, {0x4c, 0x00, 0x02, 0x15});
+  EXPECT_FALSE(Matches(data));
+
+  // Another company, then the one filtered
+  data.clear();
+  AddField(&data, 0xff, {0x06, 0x00, 0x02, 0x15, 0x00});
+  EXPECT_FALSE(Matches(data));
+  AddField(&data, 0xff, {0x4c, 0x00, 0x02, 0x15, 0x00});
+  EXPECT_TRUE(Matches(data));
+
+  // Any company of a masked range
+  Add(1, Params(1 << BTM_BLE_PF_MANU_DATA),
+      {ManuCommand(0x0100, {}, {}, 0xff00)});
+  data.clear();
+  AddField(&data, 0xff, {0x42, 0x01});
+  EXPECT_TRUE(Matches(data));
+}
+
+TEST_F(BleSoftFilterTest, test_service_data) {
+  ApcfCommand pattern = Command(BTM_BLE_PF_SRVC_DATA_PATTERN);
+  pattern.data = {0xaa, 0xfe, 0x10};
+  pattern.data_mask = {0xff, 0xff, 0xff};
+  Add(0, Params(1 << BTM_BLE_PF_SRVC_DATA_PATTERN), {pattern});
+
+  std::vector<uint8_t> data;
+  AddField(&data, 0x16, {0xaa, 0xfe, 0x10, 0x00});
+  EXPECT_TRUE(Matches(data));
+  data.clear();
+  AddField(&data, 0x16, {0xaa, 0xfe, 0x20, 0x00});
+  EXPECT_FALSE(Matches(data));
+
+  // Any service data
+  Add(1, Params(1 << BTM_BLE_PF_SRVC_DATA), {Command(BTM_BLE_PF_SRVC_DATA)});
+  EXPECT_TRUE(Matches(data));
+}
+
+TEST_F(BleSoftFilterTest, test_feature_logic) {
+  ApcfCommand addr = Command(BTM_BLE_PF_ADDR_FILTER);
+  addr.address = Address(1);
+  uint16_t features = (1 << BTM_BLE_PF_ADDR_FILTER) |
+                      (1 << BTM_BLE_PF_LOCAL_NAME) |
+                      (1 << BTM_BLE_PF_MANU_DATA);
+
+  // The address and the name, or the manufacturer data
+  Add(0, Params(features, -128, BTM_BLE_PF_LOGIC_OR),
+      {addr, NameCommand("Watch"), ManuCommand(0x00e0)});
+
+  std::vector<uint8_t> manu;
+  AddField(&manu, 0xff, {0xe0, 0x00});
+  EXPECT_TRUE(Matches(NameField("Watch"), -50, Address(1)));
+  EXPECT_TRUE(Matches(manu, -50, Address(1)));
+  EXPECT_FALSE(Matches(manu, -50, Address(2)));
+  EXPECT_FALSE(Matches(NameField("Phone"), -50, Address(1)));
+
+  // The address, the name and the manufacturer data
+  filter_.SetParams(BTM_BLE_SCAN_COND_DELETE, 0, NULL);
+  btgatt_filt_param_setup_t params = Params(features);
+  filter_.SetParams(BTM_BLE_SCAN_COND_ADD, 0, &params);
+  std::vector<uint8_t> both = NameField("Watch");
+  both.insert(both.end(), manu.begin(), manu.end());
+  EXPECT_FALSE(Matches(manu, -50, Address(1)));
+  EXPECT_TRUE(Matches(both, -50, Address(1)));
+
+  // Conditions of features not selected are ignored
+  params = Params(1 << BTM_BLE_PF_ADDR_FILTER);
+  filter_.SetParams(BTM_BLE_SCAN_COND_ADD, 0, &params);
+  EXPECT_TRUE(Matches({}, -50, Address(1)));
+}
+
+TEST_F(BleSoftFilterTest, test_list_logic) {
+  std::vector<ApcfCommand> uuids = {
+      UuidCommand(BTM_BLE_PF_SRVC_UUID, Uuid::From16Bit(0x180f)),
+      UuidCommand(BTM_BLE_PF_SRVC_UUID, Uuid::From16Bit(0x1812))};
+  std::vector<uint8_t> one, both;
+  AddField(&one, 0x03, {0x0f, 0x18});
+  AddField(&both, 0x03, {0x0f, 0x18, 0x12, 0x18});
+
+  Add(0, Params(1 << BTM_BLE_PF_SRVC_UUID), uuids);
+  EXPECT_TRUE(Matches(one));
+
+  btgatt_filt_param_setup_t params =
+      Params(1 << BTM_BLE_PF_SRVC_UUID, -128, BTM_BLE_PF_LOGIC_AND,
+             1 << BTM_BLE_PF_SRVC_UUID);
+  filter_.SetParams(BTM_BLE_SCAN_COND_ADD, 0, &params);
+  EXPECT_FALSE(Matches(one));
+  EXPECT_TRUE(Matches(both));
+
+  // A UUID listed twice still counts once
+  std::vector<uint8_t> twice;
+  AddField(&twice, 0x03, {0x0f, 0x18, 0x0f, 0x18});
+  EXPECT_FALSE(Matches(twice));
+}
+
+TEST_F(BleSoftFilterTest, test_clear) {
+  Add(0, Params(1 << BTM_BLE_PF_LOCAL_NAME), {NameCommand("A")});
+  Add(1, Params(1 << BTM_BLE_PF_LOCAL_NAME), {NameCommand("B")});
+  EXPECT_EQ(2u, filter_.num_filters());
+  EXPECT_EQ(2u, filter_.num_conditions());
+
+  filter_.ClearConditions(0);
+  EXPECT_EQ(1u, filter_.num_conditions());
+  // Filter 0 has no conditions left: it matches everything
+  EXPECT_TRUE(Matches(NameField("C")));
+
+  filter_.SetParams(BTM_BLE_SCAN_COND_DELETE, 0, NULL);
+  EXPECT_FALSE(Matches(NameField("C")));
+  EXPECT_TRUE(Matches(NameField("B")));
+
+  filter_.SetParams(BTM_BLE_SCAN_COND_CLEAR, 0, NULL);
+  EXPECT_EQ(0u, filter_.num_filters());
+  EXPECT_EQ(0u, filter_.num_conditions());
+  EXPECT_FALSE(Matches(NameField("B")));
+
+  btgatt_filt_param_setup_t params = Params(0);
+  EXPECT_FALSE(filter_.SetParams(BTM_BLE_SCAN_COND_ADD,
+                                 BTM_BLE_SOFT_FILTER_MAX, &params));
+}
+
+namespace {
+
+// Each filter checked in turn, condition by condition
+class ReferenceFilter {
+ public:
+  struct Filter {
+    btgatt_filt_param_setup_t params;
+    std::vector<ApcfCommand> commands;
+  };
+
+  std::vector<Filter> filters;
+
+  bool Matches(const RawAddress& bda, int8_t rssi,
+               const std::vector<uint8_t>& data) const {
+    std::vector<std::pair<uint8_t, std::vector<uint8_t>>> fields;
+    size_t position = 0;
+    while (position < data.size()) {
+      uint8_t len = data[position];
+      if (len == 0 || position + len >= data.size()) break;
+      fields.push_back({data[position + 1],
+                        std::vector<uint8_t>(data.begin() + position + 2,
+                                             data.begin() + position + 1 +
+                                                 len)});
+      position += len + 1;
+    }
+
+    for (const Filter& filter : filters) {
+      if (rssi < (int8_t)filter.params.rssi_high_thres) continue;
+
+      bool match = true, pattern_needed = false, pattern_match = false;
+      for (uint8_t type = 0; type < BTM_BLE_PF_TYPE_ALL; type++) {
+        if (!(filter.params.feat_seln & (1 << type))) continue;
+        int num = 0, num_matched = 0;
+        for (const ApcfCommand& cmd : filter.commands) {
+          if (cmd.type != type) continue;
+          num++;
+          if (CommandMatches(cmd, bda, fields)) num_matched++;
+        }
+        if (num == 0) continue;
+
+        bool feature_match = (filter.params.list_logic_type & (1 << type))
+                                 ? num_matched == num
+                                 : num_matched > 0;
+        bool pattern = type == BTM_BLE_PF_LOCAL_NAME ||
+                       type == BTM_BLE_PF_MANU_DATA ||
+                       type == BTM_BLE_PF_SRVC_DATA_PATTERN;
+        if (pattern && filter.params.filt_logic_type != BTM_BLE_PF_LOGIC_AND) {
+          pattern_needed = true;
+          pattern_match |= feature_match;
+        } else {
+          match &= feature_match;
+        }
+      }
+      if (pattern_needed && !pattern_match) match = false;
+      if (match) return true;
+    }
+    return false;
+  }
+
+ private:
+  static bool MaskedEquals(const std::vector<uint8_t>& value,
+                           const std::vector<uint8_t>& pattern,
+                           const std::vector<uint8_t>& mask) {
+    if (value.size() < pattern.size()) return false;
+    for (size_t i = 0; i < pattern.size(); i++) {
+      uint8_t m = mask.empty() ? 0xff : mask[i];
+      if ((value[i] & m) != (pattern[i] & m)) return false;
+    }
+    return true;
+  }
+
+  static bool UuidMatches(const ApcfCommand& cmd, const Uuid& uuid) {
+    if (cmd.uuid_mask.IsEmpty()) return uuid == cmd.uuid;
+    switch (cmd.uuid.GetShortestRepresentationSize()) {
+      case Uuid::kNumBytes16:
+        return uuid.GetShortestRepresentationSize() == Uuid::kNumBytes16 &&
+               ((uuid.As16Bit() ^ cmd.uuid.As16Bit()) &
+                cmd.uuid_mask.As16Bit()) == 0;
+      case Uuid::kNumBytes32:
+        return uuid.GetShortestRepresentationSize() <= Uuid::kNumBytes32 &&
+               ((uuid.As32Bit() ^ cmd.uuid.As32Bit()) &
+                cmd.uuid_mask.As32Bit()) == 0;
+      default: {
+        Uuid::UUID128Bit a = uuid.To128BitLE(), b = cmd.uuid.To128BitLE(),
+                         m = cmd.uuid_mask.To128BitLE();
+        for (size_t i = 0; i < a.size(); i++) {
+          if ((a[i] ^ b[i]) & m[i]) return false;
+        }
+        return true;
+      }
+    }
+  }
+
+  static bool CommandMatches(
+      const ApcfCommand& cmd, const RawAddress& bda,
+      const std::vector<std::pair<uint8_t, std::vector<uint8_t>>>& fields) {
+    const size_t max_data = BTM_BLE_PF_STR_LEN_MAX - 2;
+
+    if (cmd.type == BTM_BLE_PF_ADDR_FILTER) return bda == cmd.address;
+
+    if (cmd.type == BTM_BLE_PF_LOCAL_NAME) {
+      const std::vector<uint8_t>* name = NULL;
+      for (const auto& field : fields) {
+        if (field.first == 0x09) {
+          name = &field.second;
+          break;
+        }
+        if (field.first == 0x08 && name == NULL) name = &field.second;
+      }
+      if (name == NULL) return false;
+      size_t len = std::min(name->size(), (size_t)BTM_BLE_PF_STR_LEN_MAX);
+      size_t cmd_len = std::min(cmd.name.size(), (size_t)BTM_BLE_PF_STR_LEN_MAX);
+      return len == cmd_len && std::equal(name->begin(), name->begin() + len,
+                                          cmd.name.begin());
+    }
+
+    for (const auto& field : fields) {
+      uint8_t t = field.first;
+      const std::vector<uint8_t>& v = field.second;
+      bool service_data = t == 0x16 || t == 0x20 || t == 0x21;
+
+      switch (cmd.type) {
+        case BTM_BLE_PF_SRVC_UUID:
+        case BTM_BLE_PF_SRVC_SOL_UUID: {
+          bool sol = cmd.type == BTM_BLE_PF_SRVC_SOL_UUID;
+          size_t size = 0;
+          if (t == (sol ? 0x14 : 0x02) || (!sol && t == 0x03)) size = 2;
+          if (t == (sol ? 0x1f : 0x04) || (!sol && t == 0x05)) size = 4;
+          if (t == (sol ? 0x15 : 0x06) || (!sol && t == 0x07)) size = 16;
+          for (size_t i = 0; size && i + size <= v.size(); i += size) {
+            Uuid uuid = size == 2 ? Uuid::From16Bit(v[i] | (v[i + 1] << 8))
+                        : size == 4
+                            ? Uuid::From32Bit(v[i] | (v[i + 1] << 8) |
+                                              (v[i + 2] << 16) |
+                                              ((uint32_t)v[i + 3] << 24))
+                            : Uuid::From128BitLE(&v[i]);
+            if (UuidMatches(cmd, uuid)) return true;
+          }
+          break;
+        }
+
+        case BTM_BLE_PF_SRVC_DATA:
+          if (service_data) return true;
+          break;
+
+        case BTM_BLE_PF_MANU_DATA: {
+          if (t != 0xff || v.size() < 2) break;
+          uint16_t company = v[0] | (v[1] << 8);
+          uint16_t mask = cmd.company_mask ? cmd.company_mask : 0xffff;
+          if ((company ^ cmd.company) & mask) break;
+          if (cmd.data_mask.empty()) return true;
+          size_t size = std::min(cmd.data.size(), max_data);
+          if (MaskedEquals(
+                  std::vector<uint8_t>(v.begin() + 2, v.end()),
+                  std::vector<uint8_t>(cmd.data.begin(),
+                                       cmd.data.begin() + size),
+                  std::vector<uint8_t>(cmd.data_mask.begin(),
+                                       cmd.data_mask.begin() + size)))
+            return true;
+          break;
+        }
+
+        case BTM_BLE_PF_SRVC_DATA_PATTERN: {
+          if (!service_data) break;
+          size_t size = std::min(cmd.data.size(), max_data);
+          std::vector<uint8_t> mask;
+          if (!cmd.data_mask.empty())
+            mask.assign(cmd.data_mask.begin(), cmd.data_mask.begin() + size);
+          if (MaskedEquals(v,
+                           std::vector<uint8_t>(cmd.data.begin(),
+                                                cmd.data.begin() + size),
+                           mask))
+            return true;
+          break;
+        }
+
+        case BTM_BLE_PF_TDS_DATA:
+          if (t == 0x26 && v.size() >= 2 && v[0] == cmd.org_id &&
+              ((v[1] ^ cmd.tds_flags) & cmd.tds_flags_mask) == 0)
+            return true;
+          break;
+      }
+    }
+    return false;
+  }
+};
+
+// Uniform in [0, n).
+uint32_t Uniform(std::mt19937* rng, uint32_t n) {
+  return std::uniform_int_distribution<uint32_t>(0, n - 1)(*rng);
+}
+
+// Small pools of values, so that reports often match
+const std::vector<Uuid> kUuids = {
+    Uuid::From16Bit(0x180f), Uuid::From16Bit(0x1812), Uuid::From16Bit(0xfeaa),
+    Uuid::From32Bit(0x1234180f),
+    Uuid::FromString("0000fe2c-1234-5678-9abc-def012345678")};
+const std::vector<std::string> kNames = {"A", "Band", "Band 2",
+                                         std::string(31, 'n')};
+const std::vector<uint16_t> kCompanies = {0x004c, 0x0006, 0x00e0, 0x014c};
+
+ApcfCommand RandomCommand(std::mt19937* rng) {
+  ApcfCommand cmd = Command(Uniform(rng, BTM_BLE_PF_TYPE_ALL));
+  switch (cmd.type) {
+    case BTM_BLE_PF_ADDR_FILTER:
+      cmd.address = Address(Uniform(rng, 3));
+      break;
+    case BTM_BLE_PF_SRVC_UUID:
+    case BTM_BLE_PF_SRVC_SOL_UUID:
+      cmd.uuid = kUuids[Uniform(rng, kUuids.size())];
+      if (Uniform(rng, 3) == 0) {
+        if (cmd.uuid.GetShortestRepresentationSize() == Uuid::kNumBytes16)
+          cmd.uuid_mask = Uuid::From16Bit(0xff00);
+        else if (cmd.uuid.GetShortestRepresentationSize() == Uuid::kNumBytes32)
+          cmd.uuid_mask = Uuid::From32Bit(0xffff00ff);
+        else
+          cmd.uuid_mask =
+              Uuid::FromString("ffffffff-ffff-ffff-ffff-ffffffff0000");
+      }
+      break;
+    case BTM_BLE_PF_LOCAL_NAME: {
+      const std::string& name = kNames[Uniform(rng, kNames.size())];
+      cmd.name.assign(name.begin(), name.end());
+      break;
+    }
+    case BTM_BLE_PF_MANU_DATA:
+      cmd.company = kCompanies[Uniform(rng, kCompanies.size())];
+      if (Uniform(rng, 4) == 0) cmd.company_mask = 0x00ff;
+      if (Uniform(rng, 2)) {
+        cmd.data = {0x02, (uint8_t)Uniform(rng, 2)};
+        cmd.data_mask = {0xff, (uint8_t)(Uniform(rng, 2) ? 0xff : 0x00)};
+      }
+      break;
+    case BTM_BLE_PF_SRVC_DATA_PATTERN:
+      cmd.data = {0xaa, (uint8_t)(Uniform(rng, 2) ? 0xfe : 0xff),
+                  (uint8_t)Uniform(rng, 2)};
+      if (Uniform(rng, 2)) cmd.data_mask = {0xff, Uniform(rng, 2) ? 0xff : 0,
+                                            0xff};
+      break;
+    case BTM_BLE_PF_TDS_DATA:
+      cmd.org_id = Uniform(rng, 2);
+      cmd.tds_flags = Uniform(rng, 4);
+      cmd.tds_flags_mask = Uniform(rng, 4);
+      break;
+  }
+  return cmd;
+}
+
+std::vector<uint8_t> RandomReport(std::mt19937* rng) {
+  std::vector<uint8_t> data;
+  int num_fields = Uniform(rng, 6);
+  for (int i = 0; i < num_fields; i++) {
+    switch (Uniform(rng, 7)) {
+      case 0: {
+        const Uuid& uuid = kUuids[Uniform(rng, kUuids.size())];
+        size_t size = uuid.GetShortestRepresentationSize();
+        Uuid::UUID128Bit le = uuid.To128BitLE();
+        std::vector<uint8_t> value;
+        if (size == Uuid::kNumBytes128)
+          value.assign(le.begin(), le.end());
+        else
+          value.assign(le.begin() + 12, le.begin() + 12 + size);
+        uint8_t types16[] = {0x02, 0x03, 0x14};
+        uint8_t types32[] = {0x04, 0x05, 0x1f};
+        uint8_t types128[] = {0x06, 0x07, 0x15};
+        uint8_t* types = size == 2 ? types16 : size == 4 ? types32 : types128;
+        AddField(&data, types[Uniform(rng, 3)], value);
+        break;
+      }
+      case 1: {
+        const std::string& name = kNames[Uniform(rng, kNames.size())];
+        AddField(&data, Uniform(rng, 2) ? 0x08 : 0x09,
+                 std::vector<uint8_t>(name.begin(), name.end()));
+        break;
+      }
+      case 2: {
+        uint16_t company = kCompanies[Uniform(rng, kCompanies.size())];
+        std::vector<uint8_t> value = {(uint8_t)company,
+                                      (uint8_t)(company >> 8)};
+        int len = Uniform(rng, 4);
+        for (int j = 0; j < len; j++) value.push_back(Uniform(rng, 3));
+        AddField(&data, 0xff, value);
+        break;
+      }
+      case 3: {
+        uint8_t types[] = {0x16, 0x20, 0x21};
+        std::vector<uint8_t> value = {0xaa,
+                                      (uint8_t)(Uniform(rng, 2) ? 0xfe : 0xff)};
+        int len = Uniform(rng, 3);
+        for (int j = 0; j < len; j++) value.push_back(Uniform(rng, 2));
+        AddField(&data, types[Uniform(rng, 3)], value);
+        break;
+      }
+      case 4:
+        AddField(&data, 0x26,
+                 {(uint8_t)Uniform(rng, 2), (uint8_t)Uniform(rng, 4)});
+        break;
+      case 5:
+        AddField(&data, 0x01, {0x06});
+        break;
+      case 6:
+        // Garbage, cutting the report short
+        data.push_back(Uniform(rng, 256));
+        break;
+    }
+  }
+  return data;
+}
+
+}  // namespace
+
+// Random filters and reports give the same results as checking each filter
+// in turn
+TEST(BleSoftFilterRandomTest, test_matches_reference) {
+  std::mt19937 rng(1);
+  int num_matched = 0, num_reports = 0;
+
+  for (int round = 0; round < 300; round++) {
+    BleSoftFilter filter;
+    ReferenceFilter reference;
+    filter.Enable(true);
+
+    int num_filters = 1 + Uniform(&rng, 8);
+    for (int i = 0; i < num_filters; i++) {
+      ReferenceFilter::Filter ref;
+      uint8_t filt_index = Uniform(&rng, BTM_BLE_SOFT_FILTER_MAX);
+      ref.params = Params(Uniform(&rng, kAllFeatures + 1),
+                          Uniform(&rng, 4) ? -128 : -60 - Uniform(&rng, 20),
+                          Uniform(&rng, 2) ? BTM_BLE_PF_LOGIC_AND
+                                           : BTM_BLE_PF_LOGIC_OR,
+                          Uniform(&rng, kAllFeatures + 1));
+      int num_commands = Uniform(&rng, 5);
+      for (int j = 0; j < num_commands; j++)
+        ref.commands.push_back(RandomCommand(&rng));
+
+      // A filter index used twice gets the new parameters, and both sets of
+      // conditions
+      bool replaced = false;
+      for (size_t j = 0; j < reference.filters.size(); j++) {
+        if (filt_index != reference.filters[j].params.num_of_tracking_entries)
+          continue;
+        reference.filters[j].params = ref.params;
+        reference.filters[j].params.num_of_tracking_entries = filt_index;
+        reference.filters[j].commands.insert(
+            reference.filters[j].commands.end(), ref.commands.begin(),
+            ref.commands.end());
+        replaced = true;
+      }
+      ASSERT_TRUE(filter.SetParams(BTM_BLE_SCAN_COND_ADD, filt_index,
+                                   &ref.params));
+      ASSERT_TRUE(filter.AddConditions(filt_index, ref.commands));
+      if (!replaced) {
+        // Only used by the test, to find the filter index again
+        ref.params.num_of_tracking_entries = filt_index;
+        reference.filters.push_back(ref);
+      }
+    }
+
+    for (int i = 0; i < 100; i++) {
+      std::vector<uint8_t> data = RandomReport(&rng);
+      RawAddress bda = Address(Uniform(&rng, 3));
+      int8_t rssi = -50 - Uniform(&rng, 40);
+      bool expected = reference.Matches(bda, rssi, data);
+      ASSERT_EQ(expected, filter.Matches(bda, rssi, data.data(), data.size()))
+          << "round " << round << " report " << i;
+      num_matched += expected;
+      num_reports++;
+    }
+  }
+
+  // Both outcomes are well covered
+  EXPECT_GT(num_matched, num_reports / 10);
+  EXPECT_LT(num_matched, num_reports * 9 / 10);
+}
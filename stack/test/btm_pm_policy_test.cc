@@ -0,0 +1,422 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <string.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "btm_pm_policy.h"
+
+namespace {
+
+tBTM_PM_TRAFFIC Traffic() {
+  tBTM_PM_TRAFFIC traffic;
+  memset(&traffic, 0, sizeof(traffic));
+  return traffic;
+}
+
+tBTM_PM_PWR_MD SniffMode(uint16_t max, uint16_t min) {
+  tBTM_PM_PWR_MD md;
+  memset(&md, 0, sizeof(md));
+  md.max = max;
+  md.min = min;
+  md.attempt = 4;
+  md.timeout = 1;
+  md.mode = BTM_PM_MD_SNIFF;
+  return md;
+}
+
+// Packets of |len| bytes, |count| bursts of |per_burst| packets |gap_ms|
+// apart, the bursts |burst_gap_ms| apart. Returns the time of the last one.
+uint32_t Feed(tBTM_PM_TRAFFIC* traffic, uint32_t now_ms, uint16_t len,
+              int count, int per_burst, uint32_t gap_ms,
+              uint32_t burst_gap_ms) {
+  for (int i = 0; i < count; i++) {
+    for (int j = 0; j < per_burst; j++) {
+      btm_pm_traffic_update(traffic, j % 2 == 0, len, now_ms);
+      if (j + 1 < per_burst) now_ms += gap_ms;
+    }
+    if (i + 1 < count) now_ms += burst_gap_ms;
+  }
+  return now_ms;
+}
+
+}  // namespace
+
+TEST(BtmPmPolicyTest, test_traffic_estimator) {
+  tBTM_PM_TRAFFIC traffic = Traffic();
+
+  btm_pm_traffic_update(&traffic, true, 100, 1000);
+  EXPECT_EQ(1u, traffic.tx_pkts);
+  EXPECT_EQ(100u, traffic.tx_bytes);
+  EXPECT_EQ(100u, traffic.pkt_len);
+  EXPECT_EQ(1u, traffic.bursts);
+
+  btm_pm_traffic_update(&traffic, false, 20, 1010);
+  EXPECT_EQ(1u, traffic.rx_pkts);
+  EXPECT_EQ(20u, traffic.rx_bytes);
+  EXPECT_EQ(10u, traffic.gap_ms);
+  EXPECT_EQ(1u, traffic.bursts);
+  // Moving average, 1/8 weight for the new sample
+  EXPECT_EQ(90u, traffic.pkt_len);
+
+  btm_pm_traffic_update(&traffic, false, 90, 1010);
+  EXPECT_EQ(8u, traffic.gap_ms);
+
+  btm_pm_traffic_update(&traffic, true, 90, 1510);
+  EXPECT_EQ(2u, traffic.bursts);
+  EXPECT_EQ(500u, traffic.burst_gap_ms);
+  EXPECT_EQ(1510u, traffic.last_pkt_ms);
+}
+
+TEST(BtmPmPolicyTest, test_classify) {
+  tBTM_PM_TRAFFIC traffic = Traffic();
+  EXPECT_EQ(BTM_PM_TRAFFIC_IDLE, btm_pm_policy_classify(&traffic, 0));
+
+  // Keystrokes
+  uint32_t now = Feed(&traffic, 0, 12, 10, 2, 20, 300);
+  EXPECT_EQ(BTM_PM_TRAFFIC_INTERACTIVE, btm_pm_policy_classify(&traffic, now));
+  EXPECT_EQ(BTM_PM_TRAFFIC_IDLE,
+            btm_pm_policy_classify(&traffic, now + BTM_PM_POLICY_IDLE_MS));
+
+  // A single burst of small packets is not interactive yet
+  traffic = Traffic();
+  now = Feed(&traffic, 0, 12, 1, 4, 20, 0);
+  EXPECT_EQ(BTM_PM_TRAFFIC_BURSTY, btm_pm_policy_classify(&traffic, now));
+
+  // Small packets, rare bursts
+  traffic = Traffic();
+  now = Feed(&traffic, 0, 30, 5, 4, 20, 8000);
+  EXPECT_EQ(BTM_PM_TRAFFIC_BURSTY, btm_pm_policy_classify(&traffic, now));
+
+  // File transfer
+  traffic = Traffic();
+  now = Feed(&traffic, 0, 1000, 1, 200, 3, 0);
+  EXPECT_EQ(BTM_PM_TRAFFIC_BULK, btm_pm_policy_classify(&traffic, now));
+}
+
+TEST(BtmPmPolicyTest, test_timeout) {
+  tBTM_PM_TRAFFIC traffic = Traffic();
+  uint32_t now = Feed(&traffic, 0, 1000, 1, 200, 3, 0);
+
+  EXPECT_EQ(4000u, btm_pm_policy_timeout(BTM_PM_TRAFFIC_INTERACTIVE, &traffic,
+                                         now, 2000));
+  EXPECT_EQ((uint32_t)BTM_PM_POLICY_MAX_TIMEOUT_MS,
+            btm_pm_policy_timeout(BTM_PM_TRAFFIC_INTERACTIVE, &traffic, now,
+                                  7000));
+  // Never shorter than asked for when interactive
+  EXPECT_EQ(30000u, btm_pm_policy_timeout(BTM_PM_TRAFFIC_INTERACTIVE, &traffic,
+                                          now, 30000));
+
+  // Bulk transfer still going on, then ended
+  EXPECT_EQ(7000u,
+            btm_pm_policy_timeout(BTM_PM_TRAFFIC_BULK, &traffic, now, 7000));
+  EXPECT_EQ(1750u, btm_pm_policy_timeout(BTM_PM_TRAFFIC_BULK, &traffic,
+                                         now + 200, 7000));
+
+  EXPECT_EQ(1250u,
+            btm_pm_policy_timeout(BTM_PM_TRAFFIC_IDLE, &traffic, now, 5000));
+  EXPECT_EQ((uint32_t)BTM_PM_POLICY_MIN_TIMEOUT_MS,
+            btm_pm_policy_timeout(BTM_PM_TRAFFIC_IDLE, &traffic, now, 1000));
+  // Never longer than asked for otherwise
+  EXPECT_EQ(100u,
+            btm_pm_policy_timeout(BTM_PM_TRAFFIC_IDLE, &traffic, now, 100));
+
+  traffic.burst_gap_ms = 8000;
+  EXPECT_EQ(2500u,
+            btm_pm_policy_timeout(BTM_PM_TRAFFIC_BURSTY, &traffic, now, 5000));
+  traffic.burst_gap_ms = 3000;
+  EXPECT_EQ(5000u,
+            btm_pm_policy_timeout(BTM_PM_TRAFFIC_BURSTY, &traffic, now, 5000));
+}
+
+TEST(BtmPmPolicyTest, test_sniff) {
+  tBTM_PM_TRAFFIC traffic = Traffic();
+
+  // 30 ms
+  tBTM_PM_PWR_MD md = SniffMode(400, 20);
+  btm_pm_policy_sniff(BTM_PM_TRAFFIC_INTERACTIVE, &traffic, &md);
+  EXPECT_EQ(48, md.max);
+  EXPECT_EQ(20, md.min);
+
+  // Stays within the range of the profile
+  md = SniffMode(800, 400);
+  btm_pm_policy_sniff(BTM_PM_TRAFFIC_INTERACTIVE, &traffic, &md);
+  EXPECT_EQ(400, md.max);
+  EXPECT_EQ(400, md.min);
+  md = SniffMode(36, 30);
+  btm_pm_policy_sniff(BTM_PM_TRAFFIC_INTERACTIVE, &traffic, &md);
+  EXPECT_EQ(36, md.max);
+
+  // A quarter of the gap between bursts
+  traffic.burst_gap_ms = 1000;
+  md = SniffMode(800, 100);
+  btm_pm_policy_sniff(BTM_PM_TRAFFIC_BURSTY, &traffic, &md);
+  EXPECT_EQ(400, md.max);
+  EXPECT_EQ(100, md.min);
+
+  md = SniffMode(800, 400);
+  btm_pm_policy_sniff(BTM_PM_TRAFFIC_IDLE, &traffic, &md);
+  EXPECT_EQ(800, md.max);
+  EXPECT_EQ(600, md.min);
+  md = SniffMode(54, 30);
+  btm_pm_policy_sniff(BTM_PM_TRAFFIC_BULK, &traffic, &md);
+  EXPECT_EQ(54, md.max);
+  EXPECT_EQ(42, md.min);
+
+  // Left alone when the range makes no sense
+  md = SniffMode(10, 20);
+  btm_pm_policy_sniff(BTM_PM_TRAFFIC_IDLE, &traffic, &md);
+  EXPECT_EQ(10, md.max);
+  EXPECT_EQ(20, md.min);
+}
+
+TEST(BtmPmPolicyTest, test_ssr_max_lat) {
+  tBTM_PM_TRAFFIC traffic = Traffic();
+  EXPECT_EQ(96, btm_pm_policy_ssr_max_lat(BTM_PM_TRAFFIC_INTERACTIVE, &traffic,
+                                          1200));
+  EXPECT_EQ(
+      60, btm_pm_policy_ssr_max_lat(BTM_PM_TRAFFIC_INTERACTIVE, &traffic, 60));
+  EXPECT_EQ(1200,
+            btm_pm_policy_ssr_max_lat(BTM_PM_TRAFFIC_BULK, &traffic, 1200));
+  EXPECT_EQ(0, btm_pm_policy_ssr_max_lat(BTM_PM_TRAFFIC_IDLE, &traffic, 0));
+}
+
+namespace {
+
+// Replays the packets of a link against a model of the power mode state
+// machine, with or without the policy.
+//
+// The profile reports the link idle once no packet went through for
+// BTM_PM_TRAFFIC_BURST_GAP_MS, which arms the idle timer, and the link enters
+// sniff mode when it expires. A packet in sniff mode waits for the next sniff
+// anchor, where the link goes back to active mode. The radio is counted on
+// all the time in active mode, and for the sniff attempt at each anchor in
+// sniff mode.
+struct Packet {
+  uint32_t time_ms;
+  uint16_t len;
+};
+
+struct Profile {
+  uint32_t timeout_ms;
+  uint16_t sniff_max;
+  uint16_t sniff_min;
+  uint16_t attempt;
+};
+
+struct SimResult {
+  double radio_on_pct;
+  double mean_latency_ms;
+  double p99_latency_ms;
+};
+
+SimResult Simulate(const std::vector<Packet>& packets, const Profile& profile,
+                   bool adaptive, uint32_t end_ms) {
+  tBTM_PM_TRAFFIC traffic = Traffic();
+  std::vector<double> latencies;
+  double radio_ms = 0;
+  bool sniff = false;
+  double active_since = 0;
+  double sniff_since = 0;
+  double interval_ms = 0;
+  double idle_at = 0;
+  double sniff_at = profile.timeout_ms;
+  double attempt_ms = profile.attempt * 1.25;
+
+  auto enter_sniff = [&](double now) {
+    tBTM_PM_PWR_MD md = SniffMode(profile.sniff_max, profile.sniff_min);
+    if (adaptive)
+      btm_pm_policy_sniff(btm_pm_policy_classify(&traffic, now), &traffic,
+                          &md);
+    radio_ms += now - active_since;
+    sniff = true;
+    sniff_since = now;
+    interval_ms = md.max * 0.625;
+  };
+
+  auto advance = [&](double now) {
+    // Idle timer armed once the link went quiet
+    if (traffic.tx_pkts + traffic.rx_pkts > 0 && idle_at <= now &&
+        sniff_at < idle_at) {
+      uint32_t timeout_ms = profile.timeout_ms;
+      if (adaptive)
+        timeout_ms = btm_pm_policy_timeout(
+            btm_pm_policy_classify(&traffic, idle_at), &traffic, idle_at,
+            timeout_ms);
+      sniff_at = idle_at + timeout_ms;
+    }
+    if (!sniff && sniff_at >= idle_at && sniff_at <= now) enter_sniff(sniff_at);
+  };
+
+  for (const Packet& packet : packets) {
+    double now = packet.time_ms;
+    advance(now);
+
+    double delivered = now;
+    if (sniff) {
+      double anchors =
+          (uint64_t)((now - sniff_since) / interval_ms + 0.999999);
+      delivered = sniff_since + anchors * interval_ms;
+      radio_ms += anchors * attempt_ms;
+      sniff = false;
+      active_since = delivered;
+    } else if (now < active_since) {
+      delivered = active_since;
+    }
+    latencies.push_back(delivered - now);
+
+    btm_pm_traffic_update(&traffic, latencies.size() % 2, packet.len,
+                          (uint32_t)delivered);
+    idle_at = delivered + BTM_PM_TRAFFIC_BURST_GAP_MS;
+    sniff_at = 0;
+  }
+
+  advance(end_ms);
+  if (sniff)
+    radio_ms += (uint64_t)((end_ms - sniff_since) / interval_ms) * attempt_ms;
+  else
+    radio_ms += end_ms - active_since;
+
+  std::sort(latencies.begin(), latencies.end());
+  double total = 0;
+  for (double latency : latencies) total += latency;
+
+  SimResult result;
+  result.radio_on_pct = 100.0 * radio_ms / end_ms;
+  result.mean_latency_ms = total / latencies.size();
+  result.p99_latency_ms = latencies[latencies.size() * 99 / 100];
+  return result;
+}
+
+// Uniform in [lo, hi].
+uint32_t Uniform(std::mt19937* rng, uint32_t lo, uint32_t hi) {
+  return std::uniform_int_distribution<uint32_t>(lo, hi)(*rng);
+}
+
+// Keyboard typing: keystrokes (press and release reports) a few hundred
+// milliseconds apart, with pauses of a few seconds between sentences.
+std::vector<Packet> HidTyping(uint32_t end_ms) {
+  std::vector<Packet> packets;
+  std::mt19937 rng(1);
+  uint32_t now = 1000;
+  while (now < end_ms) {
+    int keystrokes = Uniform(&rng, 10, 40);
+    for (int i = 0; i < keystrokes && now < end_ms; i++) {
+      packets.push_back({now, 12});
+      packets.push_back({now + Uniform(&rng, 40, 90), 12});
+      now += Uniform(&rng, 150, 400);
+    }
+    now += Uniform(&rng, 4000, 9000);
+  }
+  return packets;
+}
+
+// RFCOMM AT exchanges: a command, its response and an unsolicited result,
+// every few seconds.
+std::vector<Packet> RfcommBursts(uint32_t end_ms) {
+  std::vector<Packet> packets;
+  std::mt19937 rng(1);
+  for (uint32_t now = 1000; now < end_ms; now += Uniform(&rng, 3000, 8000)) {
+    for (uint32_t i = 0; i < 4; i++) packets.push_back({now + i * 20, 30});
+  }
+  return packets;
+}
+
+// A file transfer, then nothing.
+std::vector<Packet> BulkThenIdle(uint32_t end_ms) {
+  std::vector<Packet> packets;
+  for (uint32_t round = 0; round < 2; round++) {
+    uint32_t start = 1000 + round * end_ms / 2;
+    for (uint32_t now = start; now < start + 10000; now += 3)
+      packets.push_back({now, 1000});
+  }
+  return packets;
+}
+
+// Periodic synchronization, every 8 seconds.
+std::vector<Packet> PeriodicSync(uint32_t end_ms) {
+  std::vector<Packet> packets;
+  for (uint32_t now = 1000; now < end_ms; now += 8000) {
+    packets.push_back({now, 40});
+    packets.push_back({now + 15, 40});
+  }
+  return packets;
+}
+
+void RecordResult(const std::string& prefix, const SimResult& result) {
+  ::testing::Test::RecordProperty(prefix + "_radio_on_pct",
+                                  std::to_string(result.radio_on_pct));
+  ::testing::Test::RecordProperty(prefix + "_mean_latency_ms",
+                                  std::to_string(result.mean_latency_ms));
+  ::testing::Test::RecordProperty(prefix + "_p99_latency_ms",
+                                  std::to_string(result.p99_latency_ms));
+}
+
+struct Comparison {
+  SimResult fixed;
+  SimResult adaptive;
+};
+
+Comparison Compare(const char* name, const std::vector<Packet>& packets,
+                   const Profile& profile, uint32_t end_ms) {
+  Comparison comparison = {Simulate(packets, profile, false, end_ms),
+                           Simulate(packets, profile, true, end_ms)};
+  RecordResult(std::string(name) + "_fixed", comparison.fixed);
+  RecordResult(std::string(name) + "_adaptive", comparison.adaptive);
+  return comparison;
+}
+
+const uint32_t kSimulationMs = 10 * 60 * 1000;
+
+}  // namespace
+
+TEST(BtmPmPolicySimulationTest, test_hid_typing) {
+  // 5 s idle timeout, 250 ms sniff interval
+  Comparison result = Compare("hid_typing", HidTyping(kSimulationMs),
+                              {5000, 400, 200, 4}, kSimulationMs);
+  EXPECT_LT(result.adaptive.mean_latency_ms, result.fixed.mean_latency_ms);
+  EXPECT_LT(result.adaptive.p99_latency_ms, result.fixed.p99_latency_ms);
+}
+
+TEST(BtmPmPolicySimulationTest, test_rfcomm_bursts) {
+  Comparison result = Compare("rfcomm_bursts", RfcommBursts(kSimulationMs),
+                              {1000, 800, 400, 4}, kSimulationMs);
+  EXPECT_LE(result.adaptive.radio_on_pct, result.fixed.radio_on_pct);
+  EXPECT_LE(result.adaptive.mean_latency_ms, result.fixed.mean_latency_ms);
+}
+
+TEST(BtmPmPolicySimulationTest, test_bulk_then_idle) {
+  Comparison result = Compare("bulk_then_idle", BulkThenIdle(kSimulationMs),
+                              {7000, 800, 400, 4}, kSimulationMs);
+  // The first packets of the second transfer wait for a sniff anchor either
+  // way, only the phase of the anchors differs.
+  EXPECT_LT(result.adaptive.radio_on_pct, result.fixed.radio_on_pct);
+}
+
+TEST(BtmPmPolicySimulationTest, test_periodic_sync) {
+  Comparison result = Compare("periodic_sync", PeriodicSync(kSimulationMs),
+                              {5000, 800, 400, 4}, kSimulationMs);
+  EXPECT_LT(result.adaptive.radio_on_pct, result.fixed.radio_on_pct);
+  EXPECT_LE(result.adaptive.mean_latency_ms, result.fixed.mean_latency_ms);
+}
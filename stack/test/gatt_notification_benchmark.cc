@@ -0,0 +1,119 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <benchmark/benchmark.h>
+#include <string.h>
+
+#include "gatt_int.h"
+#include "l2c_api.h"
+#include "osi/include/allocator.h"
+
+using ::benchmark::State;
+
+/* L2CAP consumes the buffer of every notification, like the real stack */
+uint16_t L2CA_SendFixedChnlData(uint16_t fixed_cid, const RawAddress& rem_bda,
+                                BT_HDR* p_buf) {
+  benchmark::DoNotOptimize(p_buf->len);
+  osi_free(p_buf);
+  return L2CAP_DW_SUCCESS;
+}
+
+uint8_t L2CA_DataWrite(uint16_t cid, BT_HDR* p_data) {
+  osi_free(p_data);
+  return L2CAP_DW_SUCCESS;
+}
+
+void gatt_start_rsp_timer(tGATT_CLCB* p_clcb) {}
+void gatt_cmd_enq(tGATT_TCB& tcb, tGATT_CLCB* p_clcb, bool to_send,
+                  uint8_t op_code, BT_HDR* p_buf) {}
+uint8_t gatt_build_uuid_to_stream(uint8_t** p_dst,
+                                  const bluetooth::Uuid& uuid) {
+  return 0;
+}
+
+namespace {
+
+constexpr uint16_t kAttrHandle = 0x002a;
+constexpr int kMaxSubscribers = 64;
+
+class BM_GattNotificationFanOut : public ::benchmark::Fixture {
+ protected:
+  void SetUp(State& st) override {
+    ::benchmark::Fixture::SetUp(st);
+    for (int i = 0; i < kMaxSubscribers; i++) {
+      tcbs_[i].att_lcid = L2CAP_ATT_CID;
+      /* mix of default and negotiated MTUs */
+      tcbs_[i].payload_size = (i % 4 == 0) ? GATT_DEF_BLE_MTU_SIZE : 247;
+      tcbs_[i].peer_bda = RawAddress({0x00, 0x11, 0x22, 0x33, 0x44,
+                                      static_cast<uint8_t>(i)});
+    }
+    memset(value_, 0x5a, sizeof(value_));
+  }
+
+  tGATT_TCB tcbs_[kMaxSubscribers];
+  uint8_t value_[GATT_MAX_ATTR_LEN];
+};
+
+}  // namespace
+
+/* Original path: tGATT_VALUE copy per link, then attp_build_sr_msg copy */
+BENCHMARK_DEFINE_F(BM_GattNotificationFanOut, legacy_per_link_copy)
+(State& state) {
+  const int subscribers = state.range(0);
+  const uint16_t len = state.range(1);
+  for (auto _ : state) {
+    for (int i = 0; i < subscribers; i++) {
+      tGATT_VALUE notif;
+      notif.handle = kAttrHandle;
+      notif.len = len;
+      memcpy(notif.value, value_, len);
+      notif.auth_req = GATT_AUTH_REQ_NONE;
+
+      tGATT_SR_MSG gatt_sr_msg;
+      gatt_sr_msg.attr_value = notif;
+      BT_HDR* p_buf =
+          attp_build_sr_msg(tcbs_[i], GATT_HANDLE_VALUE_NOTIF, &gatt_sr_msg);
+      attp_send_sr_msg(tcbs_[i], p_buf);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * subscribers);
+  state.SetBytesProcessed(state.iterations() * subscribers * len);
+}
+
+/* Encode once, one copy into the per-link buffer */
+BENCHMARK_DEFINE_F(BM_GattNotificationFanOut, shared_encode_once)
+(State& state) {
+  const int subscribers = state.range(0);
+  const uint16_t len = state.range(1);
+  for (auto _ : state) {
+    tGATT_NOTIF_PDU notif;
+    attp_encode_notif(&notif, kAttrHandle, len, value_);
+    for (int i = 0; i < subscribers; i++) {
+      attp_send_sr_msg(tcbs_[i], attp_build_notif_for_link(tcbs_[i], notif));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * subscribers);
+  state.SetBytesProcessed(state.iterations() * subscribers * len);
+}
+
+BENCHMARK_REGISTER_F(BM_GattNotificationFanOut, legacy_per_link_copy)
+    ->Ranges({{1, kMaxSubscribers}, {20, 244}});
+BENCHMARK_REGISTER_F(BM_GattNotificationFanOut, shared_encode_once)
+    ->Ranges({{1, kMaxSubscribers}, {20, 244}});
+
+BENCHMARK_MAIN();
@@ -0,0 +1,192 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <gtest/gtest.h>
+#include <string.h>
+
+#include <vector>
+
+#include "gatt_int.h"
+#include "l2c_api.h"
+#include "osi/include/allocator.h"
+
+namespace {
+
+// A PDU L2CAP was given
+struct SentPdu {
+  RawAddress bda;
+  std::vector<uint8_t> data;
+};
+
+std::vector<SentPdu> sent_pdus;
+uint16_t l2cap_result = L2CAP_DW_SUCCESS;
+
+std::vector<uint8_t> PduOf(const BT_HDR* p_buf) {
+  const uint8_t* p = (const uint8_t*)(p_buf + 1) + p_buf->offset;
+  return std::vector<uint8_t>(p, p + p_buf->len);
+}
+
+}  // namespace
+
+uint16_t L2CA_SendFixedChnlData(uint16_t fixed_cid, const RawAddress& rem_bda,
+                                BT_HDR* p_buf) {
+  sent_pdus.push_back({rem_bda, PduOf(p_buf)});
+  osi_free(p_buf);
+  return l2cap_result;
+}
+
+uint8_t L2CA_DataWrite(uint16_t cid, BT_HDR* p_data) {
+  sent_pdus.push_back({RawAddress::kEmpty, PduOf(p_data)});
+  osi_free(p_data);
+  return l2cap_result;
+}
+
+void gatt_start_rsp_timer(tGATT_CLCB* p_clcb) {}
+void gatt_cmd_enq(tGATT_TCB& tcb, tGATT_CLCB* p_clcb, bool to_send,
+                  uint8_t op_code, BT_HDR* p_buf) {}
+uint8_t gatt_build_uuid_to_stream(uint8_t** p_dst,
+                                  const bluetooth::Uuid& uuid) {
+  return 0;
+}
+
+namespace {
+
+constexpr uint16_t kAttrHandle = 0x002a;
+
+class GattNotificationTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    sent_pdus.clear();
+    l2cap_result = L2CAP_DW_SUCCESS;
+    for (int i = 0; i < GATT_MAX_ATTR_LEN; i++) value_[i] = (uint8_t)i;
+  }
+
+  void TearDown() override { sent_pdus.clear(); }
+
+  tGATT_TCB Link(uint16_t payload_size, uint8_t addr) {
+    tGATT_TCB tcb;
+    tcb.att_lcid = L2CAP_ATT_CID;
+    tcb.payload_size = payload_size;
+    tcb.peer_bda = RawAddress({0x00, 0x11, 0x22, 0x33, 0x44, addr});
+    return tcb;
+  }
+
+  // The notification the original per-link path builds
+  std::vector<uint8_t> LegacyPdu(tGATT_TCB& tcb, uint16_t len) {
+    tGATT_SR_MSG gatt_sr_msg;
+    memset(&gatt_sr_msg, 0, sizeof(gatt_sr_msg));
+    gatt_sr_msg.attr_value.handle = kAttrHandle;
+    gatt_sr_msg.attr_value.len = len;
+    memcpy(gatt_sr_msg.attr_value.value, value_, len);
+    BT_HDR* p_buf =
+        attp_build_sr_msg(tcb, GATT_HANDLE_VALUE_NOTIF, &gatt_sr_msg);
+    std::vector<uint8_t> pdu = PduOf(p_buf);
+    osi_free(p_buf);
+    return pdu;
+  }
+
+  uint8_t value_[GATT_MAX_ATTR_LEN];
+};
+
+}  // namespace
+
+TEST_F(GattNotificationTest, test_header_and_value) {
+  tGATT_TCB tcb = Link(247, 0);
+  tGATT_NOTIF_PDU notif;
+  attp_encode_notif(&notif, kAttrHandle, 20, value_);
+
+  BT_HDR* p_buf = attp_build_notif_for_link(tcb, notif);
+  ASSERT_NE(nullptr, p_buf);
+  EXPECT_EQ(L2CAP_MIN_OFFSET, p_buf->offset);
+  std::vector<uint8_t> pdu = PduOf(p_buf);
+  osi_free(p_buf);
+
+  ASSERT_EQ(GATT_HDR_SIZE + 20u, pdu.size());
+  EXPECT_EQ(GATT_HANDLE_VALUE_NOTIF, pdu[0]);
+  EXPECT_EQ(kAttrHandle & 0xff, pdu[1]);
+  EXPECT_EQ(kAttrHandle >> 8, pdu[2]);
+  EXPECT_EQ(0, memcmp(value_, pdu.data() + GATT_HDR_SIZE, 20));
+}
+
+// A value longer than a link MTU allows is truncated for that link only
+TEST_F(GattNotificationTest, test_truncated_per_link) {
+  const uint16_t kLen = 200;
+  tGATT_TCB links[] = {Link(GATT_DEF_BLE_MTU_SIZE, 0), Link(185, 1),
+                       Link(247, 2), Link(kLen + GATT_HDR_SIZE, 3)};
+  tGATT_NOTIF_PDU notif;
+  attp_encode_notif(&notif, kAttrHandle, kLen, value_);
+
+  for (tGATT_TCB& tcb : links)
+    EXPECT_EQ(GATT_SUCCESS,
+              attp_send_sr_msg(tcb, attp_build_notif_for_link(tcb, notif)));
+
+  ASSERT_EQ(4u, sent_pdus.size());
+  EXPECT_EQ(GATT_DEF_BLE_MTU_SIZE, sent_pdus[0].data.size());
+  EXPECT_EQ(185u, sent_pdus[1].data.size());
+  EXPECT_EQ(GATT_HDR_SIZE + kLen, sent_pdus[2].data.size());
+  EXPECT_EQ(GATT_HDR_SIZE + kLen, sent_pdus[3].data.size());
+  for (int i = 0; i < 4; i++) {
+    EXPECT_EQ(links[i].peer_bda, sent_pdus[i].bda);
+    // The same bytes as the original path, which truncates the same way
+    EXPECT_EQ(LegacyPdu(links[i], kLen), sent_pdus[i].data);
+  }
+}
+
+// A link without room for the header gets no notification, the others
+// still do
+TEST_F(GattNotificationTest, test_link_without_room) {
+  tGATT_TCB small = Link(GATT_HDR_SIZE - 1, 0);
+  tGATT_TCB header_only = Link(GATT_HDR_SIZE, 1);
+  tGATT_NOTIF_PDU notif;
+  attp_encode_notif(&notif, kAttrHandle, 20, value_);
+
+  EXPECT_EQ(nullptr, attp_build_notif_for_link(small, notif));
+  EXPECT_EQ(GATT_NO_RESOURCES,
+            attp_send_sr_msg(small, attp_build_notif_for_link(small, notif)));
+
+  EXPECT_EQ(GATT_SUCCESS,
+            attp_send_sr_msg(header_only,
+                             attp_build_notif_for_link(header_only, notif)));
+  ASSERT_EQ(1u, sent_pdus.size());
+  EXPECT_EQ(GATT_HDR_SIZE, sent_pdus[0].data.size());
+}
+
+TEST_F(GattNotificationTest, test_empty_value) {
+  tGATT_TCB tcb = Link(247, 0);
+  tGATT_NOTIF_PDU notif;
+  attp_encode_notif(&notif, kAttrHandle, 0, nullptr);
+
+  EXPECT_EQ(GATT_SUCCESS,
+            attp_send_sr_msg(tcb, attp_build_notif_for_link(tcb, notif)));
+  ASSERT_EQ(1u, sent_pdus.size());
+  EXPECT_EQ(LegacyPdu(tcb, 0), sent_pdus[0].data);
+}
+
+TEST_F(GattNotificationTest, test_congested_link) {
+  tGATT_TCB tcb = Link(247, 0);
+  tGATT_NOTIF_PDU notif;
+  attp_encode_notif(&notif, kAttrHandle, 20, value_);
+
+  l2cap_result = L2CAP_DW_CONGESTED;
+  EXPECT_EQ(GATT_CONGESTED,
+            attp_send_sr_msg(tcb, attp_build_notif_for_link(tcb, notif)));
+  l2cap_result = L2CAP_DW_FAILED;
+  EXPECT_EQ(GATT_INTERNAL_ERROR,
+            attp_send_sr_msg(tcb, attp_build_notif_for_link(tcb, notif)));
+  EXPECT_EQ(2u, sent_pdus.size());
+}
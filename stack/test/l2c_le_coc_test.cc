@@ -0,0 +1,268 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <string.h>
+
+#include <vector>
+
+#include "l2c_int.h"
+#include "osi/include/allocator.h"
+
+tL2C_CB l2cb;
+
+void LogMsg(uint32_t trace_set_mask, const char* fmt_str, ...) {}
+void vnd_LogMsg(uint32_t trace_set_mask, const char* fmt_str, ...) {}
+
+namespace {
+
+// An event the channel state machine was given
+struct CsmEvent {
+  uint16_t event;
+  uint16_t credits;  // L2CEVT_L2CA_SEND_FLOW_CONTROL_CREDIT
+  BT_HDR* p_buf;     // L2CEVT_L2CAP_DATA
+};
+
+std::vector<CsmEvent> csm_events;
+int disconnects;
+
+}  // namespace
+
+void l2c_csm_execute(tL2C_CCB* p_ccb, uint16_t event, void* p_data) {
+  CsmEvent csm_event = {event, 0, nullptr};
+  if (event == L2CEVT_L2CA_SEND_FLOW_CONTROL_CREDIT)
+    csm_event.credits = *(uint16_t*)p_data;
+  else if (event == L2CEVT_L2CAP_DATA)
+    csm_event.p_buf = (BT_HDR*)p_data;
+  csm_events.push_back(csm_event);
+}
+
+void l2cu_disconnect_chnl(tL2C_CCB* p_ccb) { disconnects++; }
+
+namespace {
+
+constexpr uint16_t kMtu = 512;
+constexpr uint16_t kMps = 230;
+
+class L2cLeCocTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    csm_events.clear();
+    disconnects = 0;
+    memset(&lcb_, 0, sizeof(lcb_));
+    memset(&ccb_, 0, sizeof(ccb_));
+    ccb_.p_lcb = &lcb_;
+    ccb_.local_conn_cfg.mtu = kMtu;
+    ccb_.local_conn_cfg.mps = kMps;
+    ccb_.is_first_seg = true;
+  }
+
+  void TearDown() override {
+    for (const CsmEvent& csm_event : csm_events) osi_free(csm_event.p_buf);
+    osi_free(ccb_.ble_sdu);
+  }
+
+  void GrantCredits(uint16_t credits) {
+    ccb_.remote_credit_count = credits;
+    l2cble_init_credit_batch(&ccb_, credits);
+  }
+
+  // Receive |n| PDUs, returns the credits given back to the peer
+  int Receive(int n) {
+    int credits = 0;
+    for (int i = 0; i < n; i++) {
+      csm_events.clear();
+      l2cble_credit_consumed(&ccb_);
+      for (const CsmEvent& csm_event : csm_events) {
+        EXPECT_EQ(L2CEVT_L2CA_SEND_FLOW_CONTROL_CREDIT, csm_event.event);
+        credits += csm_event.credits;
+      }
+    }
+    csm_events.clear();
+    return credits;
+  }
+
+  // End the credit rate window now
+  void EndRateWindow() {
+    ccb_.credit_batch.window_start_ms -= L2CAP_LE_CREDIT_RATE_WINDOW_MS;
+  }
+
+  // A K-frame of |len| bytes of payload starting at stream byte |from|,
+  // the first of an SDU carrying the |sdu_length| header
+  BT_HDR* KFrame(uint16_t len, uint16_t from, bool first,
+                 uint16_t sdu_length) {
+    uint16_t hdr_len = first ? 2 : 0;
+    BT_HDR* p_buf = (BT_HDR*)osi_malloc(sizeof(BT_HDR) + 8 + hdr_len + len);
+    p_buf->offset = 8;
+    p_buf->len = hdr_len + len;
+    uint8_t* p = (uint8_t*)(p_buf + 1) + p_buf->offset;
+    if (first) UINT16_TO_STREAM(p, sdu_length);
+    for (uint16_t i = 0; i < len; i++) *p++ = (uint8_t)(from + i);
+    return p_buf;
+  }
+
+  void CheckSdu(const BT_HDR* p_buf, uint16_t len) {
+    ASSERT_EQ(len, p_buf->len);
+    const uint8_t* p = (const uint8_t*)(p_buf + 1) + p_buf->offset;
+    for (uint16_t i = 0; i < len; i++) ASSERT_EQ((uint8_t)i, p[i]);
+  }
+
+  tL2C_LCB lcb_;
+  tL2C_CCB ccb_;
+};
+
+}  // namespace
+
+TEST_F(L2cLeCocTest, test_credits_returned_in_batches) {
+  GrantCredits(100);
+  EXPECT_EQ(25, ccb_.credit_batch.batch_size);
+
+  EXPECT_EQ(0, Receive(24));
+  EXPECT_EQ(76, ccb_.remote_credit_count);
+  EXPECT_EQ(25, Receive(1));
+  EXPECT_EQ(100, ccb_.remote_credit_count);
+  EXPECT_EQ(0, ccb_.credit_batch.consumed);
+}
+
+TEST_F(L2cLeCocTest, test_credits_returned_at_low_watermark) {
+  GrantCredits(100);
+  Receive(5);
+  // The peer ran low some other way, the credits consumed are returned
+  // at once rather than at the end of the batch
+  ccb_.remote_credit_count = 26;
+  EXPECT_EQ(6, Receive(1));
+  EXPECT_EQ(31, ccb_.remote_credit_count);
+}
+
+TEST_F(L2cLeCocTest, test_batch_sized_to_rate) {
+  GrantCredits(100);
+
+  // A slow channel: the batch shrinks, but no lower than 1/8 of the grant
+  Receive(3);
+  EndRateWindow();
+  EXPECT_EQ(0, Receive(1));
+  EXPECT_EQ(12, ccb_.credit_batch.batch_size);
+  EXPECT_EQ(12, Receive(8));
+
+  // A fast one: the batch grows, but no higher than 1/2 of the grant
+  Receive(79);
+  EndRateWindow();
+  Receive(1);
+  EXPECT_EQ(50, ccb_.credit_batch.batch_size);
+  EXPECT_GE(ccb_.remote_credit_count, 50);
+}
+
+TEST_F(L2cLeCocTest, test_no_initial_credits) {
+  ccb_.remote_credit_count = L2CAP_LE_CREDIT_DEFAULT;
+  Receive(1);
+  EXPECT_EQ(L2CAP_LE_CREDIT_DEFAULT, ccb_.credit_batch.initial_credits);
+  EXPECT_EQ(L2CAP_LE_CREDIT_DEFAULT / 4, ccb_.credit_batch.batch_size);
+}
+
+TEST_F(L2cLeCocTest, test_tx_pdu_size) {
+  ccb_.peer_conn_cfg.mps = 512;
+
+  // No data length known: the peer MPS
+  lcb_.tx_data_len = 0;
+  EXPECT_EQ(512, l2cble_get_coc_tx_pdu_size(&ccb_));
+  ccb_.p_lcb = nullptr;
+  EXPECT_EQ(512, l2cble_get_coc_tx_pdu_size(&ccb_));
+  ccb_.p_lcb = &lcb_;
+
+  // K-frames filling two and nineteen whole link layer PDUs
+  lcb_.tx_data_len = 251;
+  EXPECT_EQ(2 * 251 - L2CAP_PKT_OVERHEAD, l2cble_get_coc_tx_pdu_size(&ccb_));
+  lcb_.tx_data_len = 27;
+  EXPECT_EQ(19 * 27 - L2CAP_PKT_OVERHEAD, l2cble_get_coc_tx_pdu_size(&ccb_));
+
+  // A K-frame fitting one link layer PDU
+  ccb_.peer_conn_cfg.mps = 247;
+  lcb_.tx_data_len = 251;
+  EXPECT_EQ(247, l2cble_get_coc_tx_pdu_size(&ccb_));
+
+  // Never below the minimum MPS
+  ccb_.peer_conn_cfg.mps = 30;
+  lcb_.tx_data_len = 20;
+  EXPECT_EQ(30, l2cble_get_coc_tx_pdu_size(&ccb_));
+  lcb_.tx_data_len = 27;
+  EXPECT_EQ(L2CAP_LE_MIN_MPS, l2cble_get_coc_tx_pdu_size(&ccb_));
+}
+
+// An SDU in a single K-frame is passed up in the received buffer
+TEST_F(L2cLeCocTest, test_single_frame_sdu) {
+  BT_HDR* p_buf = KFrame(100, 0, true, 100);
+  l2c_lcc_proc_pdu(&ccb_, p_buf);
+
+  ASSERT_EQ(1u, csm_events.size());
+  EXPECT_EQ(L2CEVT_L2CAP_DATA, csm_events[0].event);
+  EXPECT_EQ(p_buf, csm_events[0].p_buf);
+  EXPECT_EQ(10, p_buf->offset);
+  CheckSdu(p_buf, 100);
+  EXPECT_TRUE(ccb_.is_first_seg);
+  EXPECT_EQ(nullptr, ccb_.ble_sdu);
+}
+
+TEST_F(L2cLeCocTest, test_multi_frame_sdu) {
+  l2c_lcc_proc_pdu(&ccb_, KFrame(200, 0, true, 450));
+  EXPECT_FALSE(ccb_.is_first_seg);
+  l2c_lcc_proc_pdu(&ccb_, KFrame(200, 200, false, 0));
+  EXPECT_TRUE(csm_events.empty());
+  l2c_lcc_proc_pdu(&ccb_, KFrame(50, 400, false, 0));
+
+  ASSERT_EQ(1u, csm_events.size());
+  EXPECT_EQ(L2CEVT_L2CAP_DATA, csm_events[0].event);
+  CheckSdu(csm_events[0].p_buf, 450);
+  EXPECT_TRUE(ccb_.is_first_seg);
+  EXPECT_EQ(nullptr, ccb_.ble_sdu);
+}
+
+TEST_F(L2cLeCocTest, test_truncated_frame_dropped) {
+  BT_HDR* p_buf = KFrame(0, 0, true, 0);
+  p_buf->len = 1;
+  l2c_lcc_proc_pdu(&ccb_, p_buf);
+
+  EXPECT_TRUE(csm_events.empty());
+  EXPECT_TRUE(ccb_.is_first_seg);
+}
+
+TEST_F(L2cLeCocTest, test_oversized_sdu_dropped) {
+  // SDU longer than the MTU
+  l2c_lcc_proc_pdu(&ccb_, KFrame(100, 0, true, kMtu + 1));
+  // SDU shorter than the K-frame carrying it
+  l2c_lcc_proc_pdu(&ccb_, KFrame(100, 0, true, 99));
+  // K-frame longer than the MPS
+  l2c_lcc_proc_pdu(&ccb_, KFrame(kMps, 0, true, kMps));
+
+  EXPECT_TRUE(csm_events.empty());
+  EXPECT_TRUE(ccb_.is_first_seg);
+  EXPECT_EQ(nullptr, ccb_.ble_sdu);
+}
+
+// A K-frame overflowing the SDU being reassembled drops the SDU and the
+// channel
+TEST_F(L2cLeCocTest, test_frame_overflowing_sdu) {
+  l2c_lcc_proc_pdu(&ccb_, KFrame(100, 0, true, 150));
+  l2c_lcc_proc_pdu(&ccb_, KFrame(100, 100, false, 0));
+
+  EXPECT_TRUE(csm_events.empty());
+  EXPECT_EQ(1, disconnects);
+  EXPECT_TRUE(ccb_.is_first_seg);
+  EXPECT_EQ(nullptr, ccb_.ble_sdu);
+  EXPECT_EQ(0, ccb_.ble_sdu_length);
+}
@@ -0,0 +1,303 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <string.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "l2c_link_quota.h"
+
+namespace {
+
+constexpr int kLinks = 16;
+
+struct Link {
+  bool in_use;
+  bool high_pri;
+  uint16_t quota;
+};
+
+class LinkPool {
+ public:
+  explicit LinkPool(uint16_t num_bufs) : links_(kLinks) {
+    memset(&quota_, 0, sizeof(quota_));
+    quota_.num_bufs = num_bufs;
+    quota_.hi_pri_quota = 5;
+    quota_.hi_pri_min_quota = 2;
+    quota_.low_min_quota = 1;
+  }
+
+  void Connect(int idx) {
+    links_[idx] = {true, false, 0};
+    Adjust();
+  }
+  void Disconnect(int idx) {
+    links_[idx].in_use = false;
+    Adjust();
+  }
+  void SetHighPriority(int idx, bool high_pri) {
+    links_[idx].high_pri = high_pri;
+    Adjust();
+  }
+
+  const std::vector<Link>& links() const { return links_; }
+  const tL2C_LINK_QUOTA& quota() const { return quota_; }
+  int changes() const { return changes_; }
+  void set_legacy(bool legacy) { legacy_ = legacy; }
+
+ private:
+  // As l2c_link_apply_quota(), or as the allocation used to be: the first
+  // low priority links of the pool getting the extra buffers.
+  void Adjust() {
+    quota_.num_hipri_links = quota_.num_lowpri_links = 0;
+    for (const Link& link : links_) {
+      if (!link.in_use) continue;
+      if (link.high_pri)
+        quota_.num_hipri_links++;
+      else
+        quota_.num_lowpri_links++;
+    }
+    l2c_link_quota_compute(&quota_);
+
+    if (legacy_) {
+      uint16_t remainder = quota_.num_low_extra;
+      for (Link& link : links_) {
+        if (!link.in_use) continue;
+        uint16_t quota = quota_.high_pri_link_quota;
+        if (!link.high_pri) {
+          quota = quota_.low_link_quota;
+          if (remainder > 0) {
+            quota++;
+            remainder--;
+          }
+        }
+        if (quota != link.quota) changes_++;
+        link.quota = quota;
+      }
+      return;
+    }
+
+    uint16_t num_with_extra = 0;
+    for (const Link& link : links_) {
+      if (link.in_use && !link.high_pri &&
+          l2c_link_quota_has_extra(&quota_, link.quota))
+        num_with_extra++;
+    }
+    l2c_link_quota_start(&quota_, num_with_extra);
+    int last_granted = -1;
+    for (int i = 0; i < kLinks; i++) {
+      int idx = (quota_.extra_start + i) % kLinks;
+      Link& link = links_[idx];
+      if (!link.in_use) continue;
+      uint16_t quota =
+          l2c_link_quota_assign(&quota_, link.high_pri, link.quota);
+      if (quota == link.quota) continue;
+      if (!link.high_pri && l2c_link_quota_has_extra(&quota_, quota))
+        last_granted = idx;
+      link.quota = quota;
+      changes_++;
+    }
+    if (last_granted >= 0) quota_.extra_start = (last_granted + 1) % kLinks;
+  }
+
+  std::vector<Link> links_;
+  tL2C_LINK_QUOTA quota_;
+  int changes_ = 0;
+  bool legacy_ = false;
+};
+
+// Checks the quotas add up, and the extra buffers are all handed out.
+void CheckQuotas(const LinkPool& pool) {
+  const tL2C_LINK_QUOTA& quota = pool.quota();
+  uint16_t num_extra = 0;
+  for (const Link& link : pool.links()) {
+    if (!link.in_use) continue;
+    if (link.high_pri) {
+      EXPECT_EQ(quota.high_pri_link_quota, link.quota);
+    } else if (link.quota == quota.low_link_quota + 1) {
+      num_extra++;
+    } else {
+      EXPECT_EQ(quota.low_link_quota, link.quota);
+    }
+  }
+  EXPECT_EQ(quota.num_lowpri_links ? quota.num_low_extra : 0, num_extra);
+}
+
+struct ChurnResult {
+  int changes;
+  double min_share;
+  double max_share;
+};
+
+// Connects and disconnects links and flips their priority, and returns how
+// often each slot of the pool had an extra buffer while it was a low priority
+// link, relative to the average.
+ChurnResult Churn(bool legacy) {
+  LinkPool pool(17);
+  pool.set_legacy(legacy);
+  std::mt19937 rng(1);
+  std::vector<uint32_t> low_steps(kLinks), extra_steps(kLinks);
+
+  for (int i = 0; i < 6; i++) pool.Connect(i * 2);
+
+  for (int step = 0; step < 20000; step++) {
+    int idx = std::uniform_int_distribution<int>(0, kLinks - 1)(rng);
+    const Link& link = pool.links()[idx];
+    switch (std::uniform_int_distribution<int>(0, 2)(rng)) {
+      case 0:
+        if (link.in_use)
+          pool.Disconnect(idx);
+        else
+          pool.Connect(idx);
+        break;
+      default:
+        if (link.in_use) pool.SetHighPriority(idx, !link.high_pri);
+        break;
+    }
+    CheckQuotas(pool);
+
+    const tL2C_LINK_QUOTA& quota = pool.quota();
+    if (quota.num_low_extra == 0) continue;
+    for (int i = 0; i < kLinks; i++) {
+      const Link& slot = pool.links()[i];
+      if (!slot.in_use || slot.high_pri) continue;
+      low_steps[i]++;
+      if (l2c_link_quota_has_extra(&quota, slot.quota)) extra_steps[i]++;
+    }
+  }
+
+  ChurnResult result = {pool.changes(), 1e9, 0};
+  std::vector<double> shares;
+  for (int i = 0; i < kLinks; i++) {
+    if (low_steps[i] < 1000) continue;
+    shares.push_back((double)extra_steps[i] / low_steps[i]);
+  }
+  double mean = 0;
+  for (double share : shares) mean += share / shares.size();
+  for (double share : shares) {
+    result.min_share = std::min(result.min_share, share / mean);
+    result.max_share = std::max(result.max_share, share / mean);
+  }
+  std::string prefix = legacy ? "from_scratch_" : "incremental_";
+  ::testing::Test::RecordProperty(prefix + "changes", result.changes);
+  ::testing::Test::RecordProperty(prefix + "min_share",
+                                  std::to_string(result.min_share));
+  ::testing::Test::RecordProperty(prefix + "max_share",
+                                  std::to_string(result.max_share));
+  return result;
+}
+
+}  // namespace
+
+TEST(L2cLinkQuotaTest, test_compute) {
+  tL2C_LINK_QUOTA quota;
+  memset(&quota, 0, sizeof(quota));
+  quota.num_bufs = 8;
+  quota.hi_pri_quota = 5;
+  quota.hi_pri_min_quota = 2;
+  quota.low_min_quota = 1;
+
+  // 8 buffers: 5 for the high priority link, 3 for 2 low priority links
+  quota.num_hipri_links = 1;
+  quota.num_lowpri_links = 2;
+  l2c_link_quota_compute(&quota);
+  EXPECT_EQ(5, quota.high_pri_link_quota);
+  EXPECT_EQ(3, quota.low_quota);
+  EXPECT_EQ(1, quota.low_link_quota);
+  EXPECT_EQ(1, quota.num_low_extra);
+  EXPECT_EQ(0, quota.round_robin_quota);
+
+  // High priority links get less, down to their minimum
+  quota.num_hipri_links = 3;
+  quota.num_lowpri_links = 1;
+  l2c_link_quota_compute(&quota);
+  EXPECT_EQ(2, quota.high_pri_link_quota);
+  EXPECT_EQ(2, quota.low_quota);
+  EXPECT_EQ(2, quota.low_link_quota);
+
+  // Not enough for each low priority link
+  quota.num_hipri_links = 1;
+  quota.num_lowpri_links = 5;
+  l2c_link_quota_compute(&quota);
+  EXPECT_EQ(3, quota.low_quota);
+  EXPECT_EQ(3, quota.round_robin_quota);
+  EXPECT_EQ(1, quota.low_link_quota);
+
+  // Round-robin for the LE links
+  quota.low_min_quota = 0;
+  l2c_link_quota_compute(&quota);
+  EXPECT_EQ(0, quota.low_link_quota);
+  EXPECT_EQ(0, quota.num_low_extra);
+
+  // No buffers at all
+  quota.num_bufs = 0;
+  quota.hi_pri_min_quota = 0;
+  l2c_link_quota_compute(&quota);
+  EXPECT_EQ(0, quota.high_pri_link_quota);
+}
+
+TEST(L2cLinkQuotaTest, test_only_affected_links_change) {
+  LinkPool pool(10);
+  for (int i = 0; i < 3; i++) pool.Connect(i);
+  // 10 buffers, 3 links: 4, 3, 3
+  CheckQuotas(pool);
+
+  // A fourth link: 10 = 3 + 3 + 2 + 2, the links with 3 buffers keep them
+  int changes = pool.changes();
+  pool.Connect(3);
+  CheckQuotas(pool);
+  EXPECT_EQ(2, pool.quota().num_low_extra);
+  EXPECT_EQ(2, pool.changes() - changes);
+  EXPECT_EQ(2, pool.links()[0].quota);
+  EXPECT_EQ(3, pool.links()[1].quota);
+  EXPECT_EQ(3, pool.links()[2].quota);
+  EXPECT_EQ(2, pool.links()[3].quota);
+
+  // Five links, 2 buffers each
+  changes = pool.changes();
+  pool.Connect(4);
+  CheckQuotas(pool);
+  EXPECT_EQ(3, pool.changes() - changes);
+
+  // A high priority link gets 5 buffers, the low priority links share 5:
+  // one of them keeps 2 buffers
+  changes = pool.changes();
+  pool.SetHighPriority(2, true);
+  CheckQuotas(pool);
+  EXPECT_EQ(5, pool.links()[2].quota);
+  EXPECT_EQ(1, pool.quota().num_low_extra);
+  EXPECT_EQ(4, pool.changes() - changes);
+}
+
+TEST(L2cLinkQuotaTest, test_fairness_under_churn) {
+  ChurnResult legacy = Churn(true);
+  ChurnResult incremental = Churn(false);
+
+  // Fewer links updated
+  EXPECT_LT(incremental.changes, legacy.changes);
+  // The extra buffers are shared evenly between the slots of the pool,
+  // rather than going to the first ones
+  EXPECT_GT(incremental.min_share, 0.8);
+  EXPECT_LT(incremental.max_share, 1.2);
+  EXPECT_LT(legacy.min_share, incremental.min_share);
+}
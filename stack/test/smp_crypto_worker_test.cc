@@ -0,0 +1,278 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "smp_crypto_worker.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Stands for the stack thread: runs the tasks posted to it, in order
+class StackThread {
+ public:
+  StackThread() : thread_(&StackThread::Run, this) {}
+
+  ~StackThread() {
+    Post(nullptr);
+    thread_.join();
+  }
+
+  void Post(SmpCryptoWorker::Task task) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      tasks_.push_back(std::move(task));
+    }
+    cv_.notify_one();
+  }
+
+  SmpCryptoWorker::PostTask poster() {
+    return [this](SmpCryptoWorker::Task task) { Post(std::move(task)); };
+  }
+
+  // Waits for the tasks posted so far to run
+  void Flush() {
+    std::promise<void> done;
+    Post([&done]() { done.set_value(); });
+    done.get_future().wait();
+  }
+
+ private:
+  void Run() {
+    while (true) {
+      SmpCryptoWorker::Task task;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this] { return !tasks_.empty(); });
+        task = std::move(tasks_.front());
+        tasks_.pop_front();
+      }
+      if (!task) return;
+      task();
+    }
+  }
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<SmpCryptoWorker::Task> tasks_;
+  std::thread thread_;
+};
+
+// Deterministic private keys, so that failures can be reproduced
+void PrivateKey(uint32_t seed, uint8_t* private_key) {
+  std::mt19937 rng(seed);
+  std::uniform_int_distribution<int> byte(0, 0xff);
+  for (int i = 0; i < 32; i++) private_key[i] = byte(rng);
+}
+
+Point Mult(const Point& point, const uint8_t* private_key) {
+  Point p = point, product;
+  uint32_t k[KEY_LENGTH_DWORDS_P256];
+  memcpy(k, private_key, sizeof(k));
+  ECC_PointMult(&product, &p, k, KEY_LENGTH_DWORDS_P256);
+  return product;
+}
+
+bool SamePoint(const Point& a, const Point& b) {
+  return !memcmp(a.x, b.x, sizeof(a.x)) && !memcmp(a.y, b.y, sizeof(a.y));
+}
+
+class SmpCryptoWorkerTest : public ::testing::Test {
+ protected:
+  void SetUp() override { p_256_init_curve(KEY_LENGTH_DWORDS_P256); }
+};
+
+}  // namespace
+
+TEST_F(SmpCryptoWorkerTest, test_public_key) {
+  StackThread stack_thread;
+  SmpCryptoWorker worker(stack_thread.poster());
+
+  uint8_t private_key[32];
+  PrivateKey(1, private_key);
+  std::promise<Point> public_key;
+  worker.PointMult(curve_p256.G, private_key,
+                   [&public_key](const Point& p) { public_key.set_value(p); });
+
+  Point expected = Mult(curve_p256.G, private_key);
+  Point result = public_key.get_future().get();
+  EXPECT_TRUE(SamePoint(expected, result));
+  EXPECT_TRUE(ECC_ValidatePoint(result));
+}
+
+TEST_F(SmpCryptoWorkerTest, test_dhkey_agreement) {
+  StackThread stack_thread;
+  SmpCryptoWorker worker(stack_thread.poster());
+
+  uint8_t a[32], b[32];
+  PrivateKey(2, a);
+  PrivateKey(3, b);
+  Point public_a = Mult(curve_p256.G, a);
+  Point public_b = Mult(curve_p256.G, b);
+
+  std::promise<Point> dhkey_a, dhkey_b;
+  worker.PointMult(public_b, a,
+                   [&dhkey_a](const Point& p) { dhkey_a.set_value(p); });
+  worker.PointMult(public_a, b,
+                   [&dhkey_b](const Point& p) { dhkey_b.set_value(p); });
+
+  Point result_a = dhkey_a.get_future().get();
+  Point result_b = dhkey_b.get_future().get();
+  EXPECT_EQ(0, memcmp(result_a.x, result_b.x, sizeof(result_a.x)));
+}
+
+TEST_F(SmpCryptoWorkerTest, test_completions_in_order_on_stack_thread) {
+  StackThread stack_thread;
+  SmpCryptoWorker worker(stack_thread.poster());
+
+  std::thread::id stack_thread_id;
+  stack_thread.Post(
+      [&stack_thread_id]() { stack_thread_id = std::this_thread::get_id(); });
+  stack_thread.Flush();
+
+  std::vector<int> jobs, completions;
+  std::atomic<bool> on_stack_thread(true);
+  for (int i = 0; i < 10; i++) {
+    worker.Submit([&jobs, i]() { jobs.push_back(i); },
+                  [&, i]() {
+                    if (std::this_thread::get_id() != stack_thread_id)
+                      on_stack_thread = false;
+                    completions.push_back(i);
+                  });
+  }
+  while (worker.pending() != 0) std::this_thread::yield();
+  stack_thread.Flush();
+
+  std::vector<int> expected = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+  EXPECT_EQ(expected, jobs);
+  EXPECT_EQ(expected, completions);
+  EXPECT_TRUE(on_stack_thread);
+}
+
+TEST_F(SmpCryptoWorkerTest, test_destruction_drops_queued_jobs) {
+  StackThread stack_thread;
+  std::atomic<int> jobs(0), completions(0);
+  {
+    SmpCryptoWorker worker(stack_thread.poster());
+    std::promise<void> started;
+    worker.Submit(
+        [&]() {
+          started.set_value();
+          std::this_thread::sleep_for(std::chrono::milliseconds(100));
+          jobs++;
+        },
+        [&completions]() { completions++; });
+    for (int i = 0; i < 5; i++)
+      worker.Submit([&jobs]() { jobs++; },
+                    [&completions]() { completions++; });
+    started.get_future().wait();
+  }
+  stack_thread.Flush();
+
+  // The job running completed, the others never ran
+  EXPECT_EQ(1, jobs);
+  EXPECT_EQ(1, completions);
+}
+
+// Concurrent pairings, each computing a public key then a DHKey, while the
+// stack thread handles a task every millisecond: the longest any of those
+// tasks waits, with the point multiplications run on the stack thread as
+// before, and on the worker
+TEST_F(SmpCryptoWorkerTest, test_stack_thread_latency) {
+  const int kNumPairings = 4;
+  const int kTickMs = 1;
+
+  auto run = [&](bool offload) {
+    StackThread stack_thread;
+    SmpCryptoWorker worker(stack_thread.poster());
+    std::atomic<int> computed(0);
+    std::atomic<int64_t> max_latency_us(0);
+
+    for (int n = 0; n < kNumPairings; n++) {
+      uint8_t private_key[32], peer_private_key[32];
+      PrivateKey(10 + n, private_key);
+      PrivateKey(20 + n, peer_private_key);
+      Point peer_public_key = Mult(curve_p256.G, peer_private_key);
+
+      std::vector<uint8_t> key(private_key, private_key + 32);
+      stack_thread.Post([&, key, peer_public_key, offload]() {
+        auto dhkey = [&, key, peer_public_key, offload](const Point&) {
+          if (!offload) {
+            Mult(peer_public_key, key.data());
+            computed++;
+            return;
+          }
+          worker.PointMult(peer_public_key, key.data(),
+                           [&computed](const Point&) { computed++; });
+        };
+        if (!offload) {
+          dhkey(Mult(curve_p256.G, key.data()));
+          return;
+        }
+        worker.PointMult(curve_p256.G, key.data(), dhkey);
+      });
+    }
+
+    while (computed < kNumPairings) {
+      Clock::time_point posted = Clock::now();
+      stack_thread.Post([&max_latency_us, posted]() {
+        int64_t latency_us =
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                Clock::now() - posted)
+                .count();
+        if (latency_us > max_latency_us) max_latency_us = latency_us;
+      });
+      std::this_thread::sleep_for(std::chrono::milliseconds(kTickMs));
+    }
+    stack_thread.Flush();
+    return max_latency_us.load();
+  };
+
+  Clock::time_point start = Clock::now();
+  uint8_t private_key[32];
+  PrivateKey(30, private_key);
+  Mult(curve_p256.G, private_key);
+  int64_t mult_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                        Clock::now() - start)
+                        .count();
+
+  int64_t inline_us = run(false);
+  int64_t offload_us = run(true);
+  RecordProperty("mult_us", std::to_string(mult_us));
+  RecordProperty("inline_latency_us", std::to_string(inline_us));
+  RecordProperty("offloaded_latency_us", std::to_string(offload_us));
+
+  // Inline, the tasks wait for point multiplications
+  EXPECT_GE(inline_us, mult_us / 2);
+  // Offloaded, they wait for none of them
+  EXPECT_LT(offload_us, inline_us / 2);
+}
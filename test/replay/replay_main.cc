@@ -0,0 +1,169 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+// Replays a btsnoop log into the host stack, linked against the replay HCI
+// HAL (hci/src/hci_layer_replay.cc), and prints how the stack kept up.
+//
+// Example:
+//   $ bt_hci_replay_qti --trace=/data/local/tmp/scan_storm.btsnoop \
+//       --speed=4 --discovery
+
+#include <hardware/bluetooth.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+#include "hci/include/hci_replay.h"
+
+extern bt_interface_t bluetoothInterface;
+
+static std::mutex state_mutex;
+static std::condition_variable state_cv;
+static bt_state_t adapter_state = BT_STATE_OFF;
+
+static void adapter_state_changed(bt_state_t state) {
+  std::lock_guard<std::mutex> lock(state_mutex);
+  adapter_state = state;
+  state_cv.notify_all();
+}
+
+static void discovery_state_changed(bt_discovery_state_t state) {
+  fprintf(stdout, "Discovery %s\n",
+          state == BT_DISCOVERY_STARTED ? "started" : "stopped");
+}
+
+static bt_callbacks_t callbacks = {
+    sizeof(bt_callbacks_t),
+    adapter_state_changed,
+    NULL, /* adapter_properties_cb */
+    NULL, /* remote_device_properties_cb */
+    NULL, /* device_found_cb */
+    discovery_state_changed,
+    NULL, /* pin_request_cb */
+    NULL, /* ssp_request_cb */
+    NULL, /* bond_state_changed_cb */
+    NULL, /* acl_state_changed_cb */
+    NULL, /* thread_evt_cb */
+    NULL, /* dut_mode_recv_cb */
+    NULL, /* le_test_mode_cb */
+    NULL  /* energy_info_cb */
+};
+
+// The replay does not need to keep the device awake.
+static bool set_wake_alarm(uint64_t delay_millis, bool should_wake,
+                           alarm_cb cb, void* data) {
+  return false;
+}
+
+static int acquire_wake_lock(const char* lock_name) {
+  return BT_STATUS_SUCCESS;
+}
+
+static int release_wake_lock(const char* lock_name) {
+  return BT_STATUS_SUCCESS;
+}
+
+static bt_os_callouts_t callouts = {
+    sizeof(bt_os_callouts_t), set_wake_alarm, acquire_wake_lock,
+    release_wake_lock,
+};
+
+static bool wait_for_state(bt_state_t state, int timeout_s) {
+  std::unique_lock<std::mutex> lock(state_mutex);
+  return state_cv.wait_for(lock, std::chrono::seconds(timeout_s),
+                           [state] { return adapter_state == state; });
+}
+
+static void usage(const char* name) {
+  fprintf(stderr,
+          "Usage: %s --trace=<btsnoop log> [--speed=<factor>] "
+          "[--sync_timeout_ms=<ms>] [--match_window=<n>] "
+          "[--no_auto_respond] [--discovery] [--timeout_s=<s>]\n"
+          "  --speed=0 replays as fast as the stack keeps up.\n"
+          "  --discovery starts a discovery once the stack is up, for traces\n"
+          "    captured while scanning.\n",
+          name);
+}
+
+int main(int argc, char** argv) {
+  hci_replay_config_t config = {NULL, 1.0f, 2000, 8, true};
+  bool discovery = false;
+  int timeout_s = 600;
+
+  for (int i = 1; i < argc; i++) {
+    const char* arg = argv[i];
+    if (!strncmp(arg, "--trace=", 8)) {
+      config.trace_path = arg + 8;
+    } else if (!strncmp(arg, "--speed=", 8)) {
+      config.speed = atof(arg + 8);
+    } else if (!strncmp(arg, "--sync_timeout_ms=", 18)) {
+      config.sync_timeout_ms = atoi(arg + 18);
+    } else if (!strncmp(arg, "--match_window=", 15)) {
+      config.match_window = atoi(arg + 15);
+    } else if (!strcmp(arg, "--no_auto_respond")) {
+      config.auto_respond = false;
+    } else if (!strcmp(arg, "--discovery")) {
+      discovery = true;
+    } else if (!strncmp(arg, "--timeout_s=", 12)) {
+      timeout_s = atoi(arg + 12);
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (config.trace_path == NULL || config.speed < 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  hci_replay_set_config(&config);
+
+  const bt_interface_t* bt = &bluetoothInterface;
+  if (bt->init(&callbacks, false, false, 0, false) != BT_STATUS_SUCCESS) {
+    fprintf(stderr, "Unable to initialize the stack\n");
+    return 1;
+  }
+  bt->set_os_callouts(&callouts);
+
+  auto start = std::chrono::steady_clock::now();
+  bt->enable();
+  if (!wait_for_state(BT_STATE_ON, timeout_s)) {
+    fprintf(stderr, "The stack did not come up, see the report below\n");
+  } else if (discovery) {
+    bt->start_discovery();
+  }
+
+  bool completed = hci_replay_wait_for_completion(timeout_s * 1000);
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  fprintf(stdout, "Replay %s in %lld ms\n",
+          completed ? "completed" : "timed out",
+          (long long)std::chrono::duration_cast<std::chrono::milliseconds>(
+              elapsed)
+              .count());
+  hci_replay_dump(STDOUT_FILENO);
+
+  bt->disable();
+  wait_for_state(BT_STATE_OFF, 10);
+  bt->cleanup();
+  return completed ? 0 : 1;
+}
@@ -0,0 +1,209 @@
+#!/usr/bin/env python3
+"""
+Generates the sample btsnoop logs replayed by bt_hci_replay_qti.
+
+Each log starts with the controller bring up the stack runs in
+device/src/controller.cc, followed by a scenario:
+
+  scan_storm.btsnoop      LE scan of a crowded place, bursts of
+                          advertising reports from 500 devices.
+  a2dp_streaming.btsnoop  Incoming ACL connection then 5 seconds of
+                          A2DP media, with the media packets truncated
+                          the way filtered snoop logs store them.
+
+The logs are deterministic, run the script again after changing it:
+
+  $ ./generate_traces.py
+"""
+
+import os
+import random
+import struct
+
+BTSNOOP_EPOCH_DELTA = 0x00dcddb30f2f8000
+
+TYPE_COMMAND = 1
+TYPE_ACL = 2
+TYPE_EVENT = 4
+
+# Start time of the logs, 2019-06-01 in microseconds since the unix epoch.
+START_US = 1559347200 * 1000000
+
+LOCAL_ADDRESS = bytes([0x22, 0x11, 0x00, 0xda, 0x98, 0x00])
+REMOTE_ADDRESS = bytes([0x5e, 0x4d, 0x3c, 0x2b, 0x1a, 0x00])
+CONNECTION_HANDLE = 0x0003
+
+
+class Trace(object):
+  """btsnoop log writer, datalink H4 like hci/src/btsnoop.cc."""
+
+  def __init__(self, path):
+    self.file = open(path, 'wb')
+    self.file.write(b'btsnoop\0' + struct.pack('>II', 1, 1002))
+    self.now_us = START_US
+
+  def close(self):
+    self.file.close()
+
+  def advance(self, us):
+    self.now_us += int(us)
+
+  def add(self, packet_type, is_received, packet, captured=None):
+    if captured is None:
+      captured = len(packet)
+    flags = 1 if is_received else 0
+    if packet_type in (TYPE_COMMAND, TYPE_EVENT):
+      flags |= 2
+    self.file.write(
+        struct.pack('>IIIIQ', len(packet) + 1, captured + 1, flags, 0,
+                    self.now_us + BTSNOOP_EPOCH_DELTA))
+    self.file.write(bytes([packet_type]) + packet[:captured])
+
+  def command(self, opcode, params=b''):
+    self.add(TYPE_COMMAND, False,
+             struct.pack('<HB', opcode, len(params)) + params)
+
+  def event(self, code, params):
+    self.add(TYPE_EVENT, True, struct.pack('<BB', code, len(params)) + params)
+
+  def command_complete(self, opcode, params=b'\x00'):
+    self.event(0x0e, struct.pack('<BH', 1, opcode) + params)
+
+  def command_status(self, opcode, status=0):
+    self.event(0x0f, struct.pack('<BBH', status, 1, opcode))
+
+  def exchange(self, opcode, params=b'', response=b'\x00', delay_us=150):
+    """Command from the host answered by a Command Complete."""
+    self.command(opcode, params)
+    self.advance(delay_us)
+    self.command_complete(opcode, response)
+    self.advance(50)
+
+
+def add_startup(trace):
+  """Controller bring up, in the order of controller.cc."""
+  trace.exchange(0x0c03, delay_us=3000)  # Reset
+  trace.exchange(0x1005, response=struct.pack('<BHBHH', 0, 1021, 64, 8, 8))
+  trace.exchange(0x0c33, struct.pack('<HBHH', 1021, 64, 8, 10))
+  trace.exchange(0x1001,
+                 response=struct.pack('<BBHBHH', 0, 9, 0x0001, 9, 0x001d,
+                                      0x0001))
+  trace.exchange(0x1009, response=b'\x00' + LOCAL_ADDRESS)
+  trace.exchange(0x1002, response=b'\x00' + b'\xff' * 64)
+  # Page 0: simple pairing and LE supported, 2 extended pages
+  trace.exchange(0x1004, b'\x00',
+                 b'\x00\x00\x02' + bytes([0xff, 0xfe, 0x8f, 0xfe, 0xd8,
+                                          0x3f, 0x5b, 0x87]))
+  trace.exchange(0x0c56, b'\x01')
+  trace.exchange(0x0c6d, b'\x01\x00')
+  trace.exchange(0x1004, b'\x01', b'\x00\x01\x02' + bytes([0x0f]) + b'\0' * 7)
+  trace.exchange(0x1004, b'\x02', b'\x00\x02\x02' + bytes([0x45, 0x03]) +
+                 b'\0' * 6)
+  # Vendor capabilities, then secure connections host support
+  trace.exchange(0xfd53, response=b'\x00\x05\x01\x00\x04\x20\x00\x01\x00'
+                 b'\x00\x00\x00\x98\x00\x01\x01\x00\x00\x00\x00')
+  trace.exchange(0x0c7a, b'\x01')
+  trace.exchange(0x200f, response=b'\x00\x10')
+  trace.exchange(0x2002, response=struct.pack('<BHB', 0, 251, 8))
+  trace.exchange(0x201c, response=b'\x00' + b'\xff' * 8)
+  # LE features: encryption, DLE and privacy, no extended advertising
+  trace.exchange(0x2003, response=b'\x00\x7f' + b'\0' * 7)
+  trace.exchange(0x202a, response=b'\x00\x20')
+  trace.exchange(0x2023, response=struct.pack('<BHH', 0, 251, 2120))
+  trace.exchange(0x2001, bytes([0x7f, 0x1a, 0, 0, 0, 0, 0, 0]))
+  trace.exchange(0x0c01, bytes([0xff, 0xff, 0xfb, 0xff, 0x07, 0xf8, 0xbf,
+                                0x3d]))
+  trace.exchange(0x100b, response=b'\x00\x02\x00\x02\x00')
+  trace.exchange(0x100c, response=b'\x00\x01\x10')
+  trace.exchange(0x204d, struct.pack('<hh', 0, 0))
+  trace.advance(20000)
+
+
+def advertising_data(rng, index):
+  name = ('Beacon-%03d' % index).encode()
+  manufacturer = bytes([rng.randrange(256) for _ in range(8)])
+  return (bytes([2, 0x01, 0x06, len(name) + 1, 0x09]) + name +
+          bytes([len(manufacturer) + 3, 0xff, 0x4c, 0x00]) + manufacturer)
+
+
+def generate_scan_storm(path):
+  rng = random.Random(20190601)
+  trace = Trace(path)
+  add_startup(trace)
+
+  trace.exchange(0x200b, struct.pack('<BHHBB', 1, 0x0060, 0x0030, 0, 0))
+  trace.exchange(0x200c, b'\x01\x00')
+
+  devices = []
+  for i in range(500):
+    address = bytes([rng.randrange(256) for _ in range(5)] + [0xc0 | i % 64])
+    devices.append((address, advertising_data(rng, i)))
+
+  # 3 seconds of bursts: dense during the scan window, quiet outside
+  start_us = trace.now_us
+  for window in range(3000 // 60):
+    for _ in range(rng.randrange(40, 90)):
+      address, data = rng.choice(devices)
+      event_type = rng.choice([0x00, 0x00, 0x02, 0x03, 0x04])
+      report = (struct.pack('<BBB', 0x02, 1, event_type) + b'\x01' + address +
+                bytes([len(data)]) + data +
+                struct.pack('<b', rng.randrange(-95, -40)))
+      trace.event(0x3e, report)
+      trace.advance(rng.randrange(100, 600))
+    trace.now_us = start_us + (window + 1) * 60000
+
+  trace.exchange(0x200c, b'\x00\x00')
+  trace.close()
+
+
+def generate_a2dp_streaming(path):
+  rng = random.Random(20190602)
+  trace = Trace(path)
+  add_startup(trace)
+
+  # The headset connects
+  trace.event(0x04, REMOTE_ADDRESS + b'\x04\x04\x24\x01')
+  trace.advance(2000)
+  trace.command(0x0409, REMOTE_ADDRESS + b'\x01')
+  trace.advance(200)
+  trace.command_status(0x0409)
+  trace.advance(30000)
+  trace.event(0x03, struct.pack('<BH', 0, CONNECTION_HANDLE) +
+              REMOTE_ADDRESS + b'\x01\x00')
+  trace.advance(1000)
+  trace.command(0x041b, struct.pack('<H', CONNECTION_HANDLE))
+  trace.advance(200)
+  trace.command_status(0x041b)
+  trace.advance(20000)
+  trace.event(0x0b, struct.pack('<BH', 0, CONNECTION_HANDLE) +
+              bytes([0xbf, 0xfe, 0x8f, 0xfe, 0xdb, 0xff, 0x7b, 0x87]))
+  trace.advance(500000)
+
+  # 5 seconds of media on L2CAP channel 0x0041, acknowledged by Number Of
+  # Completed Packets, and AVRCP traffic from the headset
+  media_size = 595
+  for i in range(5 * 60):
+    media = (struct.pack('<HH', media_size, 0x0041) +
+             bytes([0x80, 0x60]) + struct.pack('>H', i) +
+             b'\0' * (media_size - 4))
+    acl = struct.pack('<HH', CONNECTION_HANDLE | 0x2000, len(media)) + media
+    # Filtered snoop logs only keep the headers of media packets
+    trace.add(TYPE_ACL, False, acl, captured=14)
+    trace.advance(rng.randrange(3000, 6000))
+    trace.event(0x13, struct.pack('<BHH', 1, CONNECTION_HANDLE, 1))
+    trace.advance(rng.randrange(9000, 13000))
+    if i % 6 == 0:
+      avrcp = struct.pack('<HH', 8, 0x0042) + bytes(
+          [0x10, 0x11, 0x0e, 0x01, 0x48, 0x00, 0x00, 0x19])
+      trace.add(TYPE_ACL, True,
+                struct.pack('<HH', CONNECTION_HANDLE | 0x2000, len(avrcp)) +
+                avrcp)
+
+  trace.event(0x05, struct.pack('<BHB', 0, CONNECTION_HANDLE, 0x13))
+  trace.close()
+
+
+if __name__ == '__main__':
+  directory = os.path.dirname(os.path.abspath(__file__))
+  generate_scan_storm(os.path.join(directory, 'scan_storm.btsnoop'))
+  generate_a2dp_streaming(os.path.join(directory, 'a2dp_streaming.btsnoop'))
@@ -9,6 +9,14 @@
 
 known_benchmarks=(
   bluetooth_benchmark_thread_performance
+  net_bench_stack_gatt_notif_qti
+  net_bench_osi_trace_qti
+  net_bench_stack_acl_index_qti
+  net_bench_btif_dm_inquiry_qti
+  net_bench_stack_ad_parser_qti
+  net_bench_stack_ble_soft_filter_qti
+  net_bench_stack_bnep_filter_qti
+  net_bench_bta_ag_res_qti
 )
 
 usage() {
@@ -11,10 +11,14 @@ known_tests=(
   net_test_btif_profile_queue_qti
   net_test_device_qti
   net_test_hci_qti
+  net_test_hci_replay_qti
   net_test_stack_qti
   net_test_stack_multi_adv_qti
   net_test_stack_ad_parser_qti
   net_test_stack_smp_qti
+  net_test_stack_gatt_notif_qti
+  net_test_stack_acl_index_qti
+  net_test_stack_l2cap_le_coc_qti
   net_test_types_qti
   net_test_btu_message_loop_qti
   net_test_osi_qti
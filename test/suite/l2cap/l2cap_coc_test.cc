@@ -0,0 +1,87 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include "l2cap/l2cap_coc_test.h"
+#include "adapter/bluetooth_test.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+namespace {
+// PSM of the LE CoC sink on the emulated peer, overridable through the
+// environment for controllers exposing it elsewhere
+const int kDefaultCocPsm = 0x0080;
+}  // namespace
+
+namespace bttest {
+
+void L2capCocTest::SetUp() {
+  BluetoothTest::SetUp();
+
+  ASSERT_EQ(bt_interface()->enable(), BT_STATUS_SUCCESS);
+  semaphore_wait(adapter_state_changed_callback_sem_);
+  ASSERT_TRUE(GetState() == BT_STATE_ON);
+  socket_interface_ =
+      (const btsock_interface_t*)bt_interface()->get_profile_interface(
+          BT_PROFILE_SOCKETS_ID);
+  ASSERT_NE(socket_interface_, nullptr);
+
+  const char* psm = getenv("BT_TEST_COC_PSM");
+  psm_ = psm ? strtol(psm, nullptr, 0) : kDefaultCocPsm;
+
+  // Use the first bonded device, the emulated controller exposes one peer
+  bt_remote_bdaddr_ = RawAddress::kEmpty;
+  bt_property_t* bonded_devices_prop =
+      GetProperty(BT_PROPERTY_ADAPTER_BONDED_DEVICES);
+  ASSERT_NE(bonded_devices_prop, nullptr);
+  if (bonded_devices_prop->len >= (int)sizeof(RawAddress))
+    bt_remote_bdaddr_ = *(RawAddress*)bonded_devices_prop->val;
+
+  ASSERT_FALSE(bt_remote_bdaddr_.IsEmpty())
+      << "Could not find a paired device to open an LE CoC to";
+}
+
+void L2capCocTest::TearDown() {
+  socket_interface_ = NULL;
+
+  ASSERT_EQ(bt_interface()->disable(), BT_STATUS_SUCCESS);
+  semaphore_wait(adapter_state_changed_callback_sem_);
+
+  BluetoothTest::TearDown();
+}
+
+int L2capCocTest::ConnectCoc(size_t* max_tx_sdu) {
+  int fd = -1;
+  int error = socket_interface()->connect(&bt_remote_bdaddr_, BTSOCK_L2CAP_LE,
+                                          nullptr, psm_, &fd, 0, getuid());
+  if (error != BT_STATUS_SUCCESS || fd == -1) return -1;
+
+  int channel;
+  sock_connect_signal_t signal;
+  if (read(fd, &channel, sizeof(channel)) != sizeof(channel) ||
+      read(fd, &signal, sizeof(signal)) != sizeof(signal) ||
+      signal.status != 0) {
+    close(fd);
+    return -1;
+  }
+
+  *max_tx_sdu = signal.max_tx_packet_size;
+  return fd;
+}
+
+}  // bttest
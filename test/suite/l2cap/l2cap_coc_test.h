@@ -0,0 +1,51 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include "adapter/bluetooth_test.h"
+
+namespace bttest {
+
+class L2capCocTest : public BluetoothTest {
+ protected:
+  L2capCocTest() = default;
+  virtual ~L2capCocTest() = default;
+
+  // Getter for the socket interface
+  const btsock_interface_t* socket_interface() const {
+    return socket_interface_;
+  }
+
+  // SetUp initializes the Bluetooth interfaces and the socket interface
+  virtual void SetUp();
+
+  // TearDown cleans up the Bluetooth and socket interfaces
+  virtual void TearDown();
+
+  // Connects an LE CoC socket to |bt_remote_bdaddr_| on |psm_| and returns
+  // its fd, or -1 on failure. |max_tx_sdu| is set to the largest SDU the
+  // socket accepts in one write.
+  int ConnectCoc(size_t* max_tx_sdu);
+
+  RawAddress bt_remote_bdaddr_;
+  int psm_;
+
+ private:
+  const btsock_interface_t* socket_interface_;
+};
+
+}  // bttest
@@ -0,0 +1,83 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include "adapter/bluetooth_test.h"
+#include "l2cap/l2cap_coc_test.h"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+namespace {
+// Total amount of data streamed per SDU size
+static const size_t kBytesPerRun = 1024 * 1024;
+}  // namespace
+
+namespace bttest {
+
+// Streams SDUs of increasing size over an LE CoC and reports throughput and
+// the write latency seen by the sender, which grows when the peer stalls on
+// credits or segmentation cannot keep the link busy.
+TEST_F(L2capCocTest, CocThroughputAndLatency) {
+  static const size_t sdu_sizes[] = {23, 100, 247, 512, 1024};
+
+  for (size_t sdu_size : sdu_sizes) {
+    size_t max_tx_sdu = 0;
+    int fd = ConnectCoc(&max_tx_sdu);
+    ASSERT_NE(fd, -1) << "Error connecting LE CoC on psm " << psm_;
+    if (max_tx_sdu > 0) sdu_size = std::min(sdu_size, max_tx_sdu);
+
+    std::vector<uint8_t> sdu(sdu_size, 0xa5);
+    std::vector<int64_t> write_us;
+    size_t sent = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    while (sent < kBytesPerRun) {
+      auto before = std::chrono::steady_clock::now();
+      ssize_t len = write(fd, sdu.data(), sdu.size());
+      auto after = std::chrono::steady_clock::now();
+      ASSERT_EQ(len, (ssize_t)sdu.size()) << "Short write after " << sent;
+
+      write_us.push_back(
+          std::chrono::duration_cast<std::chrono::microseconds>(after - before)
+              .count());
+      sent += len;
+    }
+    shutdown(fd, SHUT_WR);
+    auto elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                          std::chrono::steady_clock::now() - start)
+                          .count();
+    close(fd);
+
+    std::sort(write_us.begin(), write_us.end());
+    int64_t p50 = write_us[write_us.size() / 2];
+    int64_t p99 = write_us[write_us.size() * 99 / 100];
+    double kbps = elapsed_ms ? (sent * 8.0) / elapsed_ms : 0;
+
+    printf("sdu=%zu bytes=%zu time=%lldms throughput=%.1fkbps "
+           "write_p50=%lldus write_p99=%lldus\n",
+           sdu_size, sent, (long long)elapsed_ms, kbps, (long long)p50,
+           (long long)p99);
+    EXPECT_GT(kbps, 0);
+  }
+}
+
+}  // bttest
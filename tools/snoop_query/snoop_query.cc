@@ -0,0 +1,248 @@
+/******************************************************************************
+ *
+ *  Copyright 2019 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+// Extracts slices of a btsnoop log, using the sidecar index written when
+// persist.bluetooth.btsnoopindexinterval is set (see hci/include/
+// btsnoop_index.h) to only read the parts of the log which matter. Logs
+// without an index are scanned.
+//
+// Examples:
+//   Packets of the L2CAP channel 0x0041 of handle 0x0003, 10s into the log:
+//   $ bt_snoop_query_qti --start=10 --end=20 --handle=0x3 --cid=0x41
+//       btsnoop_hci.log
+//   Same, as a btsnoop log for other tools:
+//   $ bt_snoop_query_qti --start=10 --end=20 --out=slice.log btsnoop_hci.log
+//   ACL throughput of each connection, per second:
+//   $ bt_snoop_query_qti --histogram btsnoop_hci.log
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "hci/include/btsnoop_index.h"
+#include "hci/include/btsnoop_reader.h"
+
+// Same values as in btsnoop.cc
+static const uint64_t BTSNOOP_EPOCH_DELTA = 0x00dcddb30f2f8000ULL;
+
+static const size_t HISTOGRAM_WIDTH = 40;
+
+typedef struct {
+  uint64_t received;
+  uint64_t sent;
+} throughput_t;
+
+static const char* type_name(btsnoop_packet_type_t type) {
+  switch (type) {
+    case BTSNOOP_PACKET_COMMAND:
+      return "CMD";
+    case BTSNOOP_PACKET_ACL:
+      return "ACL";
+    case BTSNOOP_PACKET_SCO:
+      return "SCO";
+    case BTSNOOP_PACKET_EVENT:
+      return "EVT";
+  }
+  return "???";
+}
+
+static void write_be32(FILE* file, uint32_t value) {
+  uint8_t bytes[] = {(uint8_t)(value >> 24), (uint8_t)(value >> 16),
+                     (uint8_t)(value >> 8), (uint8_t)value};
+  fwrite(bytes, 1, sizeof(bytes), file);
+}
+
+// Writes |record| back in the format of btsnoop.cc.
+static void write_record(FILE* file, const btsnoop_record_t& record) {
+  uint32_t flags = record.is_received ? 1 : 0;
+  if (record.type == BTSNOOP_PACKET_COMMAND ||
+      record.type == BTSNOOP_PACKET_EVENT)
+    flags |= 2;
+  uint64_t timestamp = record.timestamp_us + BTSNOOP_EPOCH_DELTA;
+
+  write_be32(file, record.length + 1);
+  write_be32(file, record.captured_length + 1);
+  write_be32(file, flags);
+  write_be32(file, 0);
+  write_be32(file, timestamp >> 32);
+  write_be32(file, timestamp & 0xffffffff);
+  fputc(record.type, file);
+  fwrite(record.data, 1, record.captured_length, file);
+}
+
+static void print_record(uint64_t log_start_us, const btsnoop_record_t& record,
+                         const btsnoop_index_key_t& key) {
+  uint64_t time_us = record.timestamp_us - log_start_us;
+  printf("%6" PRIu64 ".%06" PRIu64 " %s %s", time_us / 1000000,
+         time_us % 1000000, record.is_received ? "RX" : "TX",
+         type_name(record.type));
+  switch (record.type) {
+    case BTSNOOP_PACKET_COMMAND:
+      printf(" opcode 0x%04x", key.opcode);
+      break;
+    case BTSNOOP_PACKET_EVENT:
+      printf(" event 0x%02x", key.opcode);
+      break;
+    case BTSNOOP_PACKET_ACL:
+      printf(" handle 0x%03x cid 0x%04x%s", key.handle, key.cid,
+             key.is_pdu_start ? "" : " (continuation)");
+      break;
+    case BTSNOOP_PACKET_SCO:
+      printf(" handle 0x%03x", key.handle);
+      break;
+  }
+  printf(" length %u\n", record.length);
+}
+
+static void print_histograms(
+    const std::map<uint16_t, std::map<uint64_t, throughput_t>>& histograms) {
+  for (const auto& histogram : histograms) {
+    uint64_t max = 1;
+    for (const auto& second : histogram.second)
+      max = std::max(max, second.second.received + second.second.sent);
+
+    printf("\nhandle 0x%03x\n", histogram.first);
+    printf("%8s %12s %12s\n", "second", "rx B/s", "tx B/s");
+    for (const auto& second : histogram.second) {
+      const throughput_t& bytes = second.second;
+      size_t width = (bytes.received + bytes.sent) * HISTOGRAM_WIDTH / max;
+      printf("%8" PRIu64 " %12" PRIu64 " %12" PRIu64 " %s\n", second.first,
+             bytes.received, bytes.sent, std::string(width, '#').c_str());
+    }
+  }
+}
+
+static void usage(const char* name) {
+  fprintf(stderr,
+          "Usage: %s [--index=<path>] [--start=<s>] [--end=<s>] "
+          "[--handle=<handle>] [--cid=<cid>] [--out=<btsnoop log>] "
+          "[--histogram] <btsnoop log>\n"
+          "  Times are in seconds from the first packet of the log.\n"
+          "  --index defaults to <btsnoop log>.idx.\n"
+          "  --out writes the matching packets to a btsnoop log instead of\n"
+          "    listing them.\n"
+          "  --histogram prints the ACL throughput of each handle per second\n"
+          "    instead of listing the packets.\n",
+          name);
+}
+
+int main(int argc, char** argv) {
+  const char* log_path = NULL;
+  std::string index_path;
+  const char* out_path = NULL;
+  bool histogram = false;
+  double start_s = 0;
+  double end_s = -1;
+  btsnoop_index_query_t query = {0, UINT64_MAX, -1, -1};
+
+  for (int i = 1; i < argc; i++) {
+    const char* arg = argv[i];
+    if (!strncmp(arg, "--index=", 8)) {
+      index_path = arg + 8;
+    } else if (!strncmp(arg, "--start=", 8)) {
+      start_s = atof(arg + 8);
+    } else if (!strncmp(arg, "--end=", 6)) {
+      end_s = atof(arg + 6);
+    } else if (!strncmp(arg, "--handle=", 9)) {
+      query.handle = strtol(arg + 9, NULL, 0);
+    } else if (!strncmp(arg, "--cid=", 6)) {
+      query.cid = strtol(arg + 6, NULL, 0);
+    } else if (!strncmp(arg, "--out=", 6)) {
+      out_path = arg + 6;
+    } else if (!strcmp(arg, "--histogram")) {
+      histogram = true;
+    } else if (arg[0] != '-' && log_path == NULL) {
+      log_path = arg;
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (log_path == NULL || start_s < 0) {
+    usage(argv[0]);
+    return 1;
+  }
+  if (index_path.empty()) index_path = std::string(log_path) + ".idx";
+
+  btsnoop_reader_t* reader = btsnoop_reader_open(log_path);
+  if (reader == NULL) {
+    fprintf(stderr, "Unable to read '%s'\n", log_path);
+    return 1;
+  }
+
+  btsnoop_record_t first;
+  if (!btsnoop_reader_next(reader, &first)) {
+    fprintf(stderr, "'%s' is empty\n", log_path);
+    btsnoop_reader_close(reader);
+    return 1;
+  }
+  uint64_t log_start_us = first.timestamp_us;
+  query.start_us = log_start_us + (uint64_t)(start_s * 1000000);
+  if (end_s >= 0) query.end_us = log_start_us + (uint64_t)(end_s * 1000000);
+
+  std::vector<btsnoop_index_entry_t> entries;
+  if (!btsnoop_index_load(index_path.c_str(), NULL, &entries))
+    fprintf(stderr, "No index at '%s', scanning the whole log\n",
+            index_path.c_str());
+
+  FILE* out = NULL;
+  if (out_path != NULL) {
+    out = fopen(out_path, "wb");
+    if (out == NULL) {
+      fprintf(stderr, "Unable to write '%s'\n", out_path);
+      btsnoop_reader_close(reader);
+      return 1;
+    }
+    fwrite("btsnoop\0\0\0\0\1\0\0\x3\xea", 1, 16, out);
+  }
+
+  size_t matched = 0;
+  std::map<uint16_t, std::map<uint64_t, throughput_t>> histograms;
+  size_t read = btsnoop_index_query(
+      reader, entries, query,
+      [&](const btsnoop_record_t& record, const btsnoop_index_key_t& key) {
+        matched++;
+        if (histogram) {
+          if (record.type != BTSNOOP_PACKET_ACL || record.length < 4) return;
+          uint64_t second = (record.timestamp_us - log_start_us) / 1000000;
+          throughput_t& bytes = histograms[key.handle][second];
+          // ACL payload, without the HCI header.
+          (record.is_received ? bytes.received : bytes.sent) +=
+              record.length - 4;
+        } else if (out != NULL) {
+          write_record(out, record);
+        } else {
+          print_record(log_start_us, record, key);
+        }
+      });
+
+  if (histogram) print_histograms(histograms);
+  if (out != NULL) fclose(out);
+
+  bool error = btsnoop_reader_has_error(reader);
+  btsnoop_reader_close(reader);
+  fprintf(stderr, "%zu packets matched, %zu read, %zu index entries%s\n",
+          matched, read, entries.size(), error ? ", log is corrupted" : "");
+  return 0;
+}
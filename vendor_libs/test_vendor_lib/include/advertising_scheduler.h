@@ -0,0 +1,87 @@
+//
+// Copyright 2019 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "device.h"
+
+namespace test_vendor_lib {
+
+// Keeps the advertising devices ordered by the time of their next advertising
+// event, so that a scan only visits the devices that are due instead of every
+// device the controller knows about. Devices are held weakly: removing a
+// device from the controller drops it from the schedule the next time it would
+// have been due.
+//
+// Devices whose signal is weaker than the scanner sensitivity are never
+// scheduled, they are out of range.
+class AdvertisingScheduler {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  struct Advertiser {
+    std::shared_ptr<Device> device;
+    uint8_t rssi;
+  };
+
+  AdvertisingScheduler() = default;
+  ~AdvertisingScheduler() = default;
+
+  // Schedule |device| with its first advertising event at |first_event|.
+  // Returns false if the device does not advertise or is out of range.
+  bool Add(const std::shared_ptr<Device>& device, uint8_t rssi,
+           Clock::time_point first_event);
+
+  // Append to |due| the advertisers with an event before |now| + |window|,
+  // at most |max_due| of them, and schedule their next event. Advertisers
+  // left over stay due and are returned first by the next call.
+  void CollectDue(Clock::time_point now, std::chrono::milliseconds window,
+                  size_t max_due, std::vector<Advertiser>* due);
+
+  // Set the weakest signal, as a signed dBm value, that is still received.
+  void SetSensitivity(int8_t min_rssi) { min_rssi_ = min_rssi; }
+
+  // Number of scheduled advertisers, including removed devices that were
+  // not collected yet.
+  size_t Size() const { return heap_.size(); }
+
+  void Clear() { heap_.clear(); }
+
+ private:
+  struct Entry {
+    Clock::time_point next_event;
+    std::weak_ptr<Device> device;
+    uint8_t rssi;
+  };
+
+  // Orders the heap so that the earliest event is at the front.
+  static bool Later(const Entry& a, const Entry& b) {
+    return a.next_event > b.next_event;
+  }
+
+  std::vector<Entry> heap_;
+  int8_t min_rssi_ = -127;
+
+  AdvertisingScheduler(const AdvertisingScheduler&) = delete;
+  AdvertisingScheduler& operator=(const AdvertisingScheduler&) = delete;
+};
+
+}  // namespace test_vendor_lib
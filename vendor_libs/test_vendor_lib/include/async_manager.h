@@ -77,6 +77,14 @@ class AsyncManager {
   // cancelation.
   bool CancelAsyncTask(AsyncTaskId async_task_id);
 
+  // Makes the scheduled tasks follow the osi virtual clock (see
+  // osi/include/virtual_clock.h) instead of the steady clock. The tasks then
+  // run in time order on the thread advancing the virtual clock, as fast as
+  // that thread goes, which makes long scenarios deterministic and quick to
+  // simulate. Must be called before any task is scheduled, while the virtual
+  // clock is enabled. File descriptors are still watched in real time.
+  void UseVirtualClock();
+
   // Execs the given code in a synchronized manner. It is guaranteed that code
   // given on (possibly)concurrent calls to this member function on the same
   // AsyncManager object will never be executed simultaneously. It is the
@@ -70,6 +70,11 @@ class Device {
     advertising_interval_ms_ = ms;
   }
 
+  // Return the advertisement interval, zero if the device does not advertise.
+  std::chrono::milliseconds GetAdvertisementInterval() const {
+    return advertising_interval_ms_;
+  }
+
   // Return true if there is a scan response (allows for empty responses).
   bool HasScanResponse() const { return scan_response_present_; }
 
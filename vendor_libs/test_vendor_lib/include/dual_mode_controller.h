@@ -23,6 +23,7 @@
 #include <vector>
 
 #include "acl_packet.h"
+#include "advertising_scheduler.h"
 #include "async_manager.h"
 #include "base/json/json_value_converter.h"
 #include "base/time/time.h"
@@ -475,6 +476,9 @@ class DualModeController {
   // List the devices that the controller knows about
   void TestChannelList(const std::vector<std::string>& args) const;
 
+  // Add the advertisers described by the swarm scenario file args[0]
+  void TestChannelAddSwarm(const std::vector<std::string>& args);
+
   void Connections();
 
   void LeScan();
@@ -583,6 +587,9 @@ class DualModeController {
 
   std::vector<std::shared_ptr<Device>> devices_;
 
+  // Advertising devices, ordered by their next advertising event
+  AdvertisingScheduler adv_scheduler_;
+
   std::vector<AsyncTaskId> controller_events_;
 
   std::vector<std::shared_ptr<Connection>> connections_;
@@ -31,7 +31,8 @@ const size_t kReservedZero = 0;
 // operations.
 class Packet {
  public:
-  virtual ~Packet() = default;
+  // Returns the payload buffer to the shared pool.
+  virtual ~Packet();
 
   // Returns the size in octets of the entire packet, which consists of the type
   // octet, the header, and the payload.
@@ -0,0 +1,111 @@
+//
+// Copyright 2019 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bt_address.h"
+#include "device.h"
+
+namespace test_vendor_lib {
+
+// A non-connectable advertiser whose payloads are given by a swarm scenario.
+class SwarmBeacon : public Device {
+ public:
+  SwarmBeacon(const BtAddress& address, uint8_t advertising_type,
+              std::chrono::milliseconds interval,
+              const std::vector<uint8_t>& adv_data,
+              const std::vector<uint8_t>& scan_data);
+  virtual ~SwarmBeacon() = default;
+
+  // Swarm beacons are fully described by the scenario.
+  virtual void Initialize(const std::vector<std::string>& args) override {}
+
+  virtual std::string GetTypeString() const override { return "swarm_beacon"; }
+
+  // LE only, never answers an inquiry.
+  virtual bool IsPageScanAvailable() const override { return false; }
+};
+
+// A large population of advertisers, described by a JSON file:
+//
+// {
+//   "Groups": [
+//     {
+//       "Count": 5000,                       // number of advertisers
+//       "BaseAddress": "c0:00:00:00:00:00",  // incremented per advertiser
+//       "AdvertisingIntervalMs": 100,
+//       "AdvertisingType": 3,                // ADV_NONCONN_IND by default
+//       "AdvertisingData": "020106...",      // hex
+//       "ScanResponse": "",                  // hex, none when empty
+//       "Rssi": -40,                         // signal of the closest member
+//       "RssiSpread": 50                     // members spread down to -90
+//     }
+//   ]
+// }
+//
+// The advertising events of the members of a group are spread evenly over the
+// advertising interval, like a crowd of unsynchronized devices would be.
+class SwarmScenario {
+ public:
+  struct Group {
+    size_t count;
+    BtAddress base_address;
+    std::chrono::milliseconds interval;
+    uint8_t advertising_type;
+    std::vector<uint8_t> adv_data;
+    std::vector<uint8_t> scan_data;
+    int8_t rssi;
+    uint8_t rssi_spread;
+  };
+
+  struct Member {
+    std::shared_ptr<Device> device;
+    uint8_t rssi;
+    // Time of the first advertising event, relative to the scenario start.
+    std::chrono::milliseconds phase;
+  };
+
+  SwarmScenario() = default;
+  ~SwarmScenario() = default;
+
+  // Read the groups from |file_name|. Returns false if the file can not be
+  // read or is not a valid scenario.
+  bool LoadFromFile(const std::string& file_name);
+
+  // Parse the groups from the JSON text |json|.
+  bool LoadFromString(const std::string& json);
+
+  void AddGroup(const Group& group) { groups_.push_back(group); }
+
+  const std::vector<Group>& GetGroups() const { return groups_; }
+
+  // Total number of advertisers in the scenario.
+  size_t GetMemberCount() const;
+
+  // Create the devices of every group.
+  std::vector<Member> CreateMembers() const;
+
+ private:
+  std::vector<Group> groups_;
+};
+
+}  // namespace test_vendor_lib
@@ -175,6 +175,13 @@ class TestChannelShell(cmd.Cmd):
     """
     self._test_channel.send_command('add', args.split())
 
+  def do_add_swarm(self, args):
+    """
+    Arguments: scenario_file
+    Add the advertisers described by the JSON swarm scenario scenario_file.
+    """
+    self._test_channel.send_command('add_swarm', args.split())
+
   def do_del(self, args):
     """
     Arguments: device index
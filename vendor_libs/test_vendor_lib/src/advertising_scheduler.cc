@@ -0,0 +1,75 @@
+//
+// Copyright 2019 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#define LOG_TAG "advertising_scheduler"
+
+#include "advertising_scheduler.h"
+
+#include <algorithm>
+
+using std::vector;
+
+namespace test_vendor_lib {
+
+bool AdvertisingScheduler::Add(const std::shared_ptr<Device>& device,
+                               uint8_t rssi, Clock::time_point first_event) {
+  if (device->GetAdvertisementInterval() == std::chrono::milliseconds(0))
+    return false;
+
+  if (static_cast<int8_t>(rssi) < min_rssi_) return false;
+
+  heap_.push_back(Entry{first_event, device, rssi});
+  std::push_heap(heap_.begin(), heap_.end(), Later);
+  return true;
+}
+
+void AdvertisingScheduler::CollectDue(Clock::time_point now,
+                                      std::chrono::milliseconds window,
+                                      size_t max_due, vector<Advertiser>* due) {
+  const Clock::time_point horizon = now + window;
+  size_t collected = 0;
+
+  while (!heap_.empty() && collected < max_due &&
+         heap_.front().next_event <= horizon) {
+    std::pop_heap(heap_.begin(), heap_.end(), Later);
+    Entry& entry = heap_.back();
+
+    std::shared_ptr<Device> device = entry.device.lock();
+    std::chrono::milliseconds interval =
+        device ? device->GetAdvertisementInterval()
+               : std::chrono::milliseconds(0);
+    if (interval == std::chrono::milliseconds(0)) {
+      // removed, or stopped advertising
+      heap_.pop_back();
+      continue;
+    }
+
+    due->push_back(Advertiser{device, entry.rssi});
+    collected++;
+
+    // A device is reported at most once per scan window. Events missed while
+    // the scanner was not looking are skipped, a real scanner would not have
+    // seen them either.
+    entry.next_event += interval;
+    if (entry.next_event <= horizon) {
+      entry.next_event +=
+          ((horizon - entry.next_event) / interval + 1) * interval;
+    }
+    std::push_heap(heap_.begin(), heap_.end(), Later);
+  }
+}
+
+}  // namespace test_vendor_lib
@@ -19,6 +19,7 @@
 #include "async_manager.h"
 
 #include "osi/include/log.h"
+#include "osi/include/virtual_clock.h"
 
 #include <algorithm>
 #include <atomic>
@@ -26,8 +27,9 @@
 #include <mutex>
 #include <thread>
 #include <vector>
+#include <string.h>
 #include "fcntl.h"
-#include "sys/select.h"
+#include "sys/epoll.h"
 #include "unistd.h"
 
 namespace test_vendor_lib {
@@ -41,9 +43,11 @@ namespace test_vendor_lib {
 // After construction of this objects nothing happens beyond some very simple
 // member initialization. When the first FD is set up for watching the object
 // starts a new thread which watches the given (and later provided) FDs using
-// select() inside a loop. A special FD (a pipe) is also watched which is
-// used to notify the thread of internal changes on the object state (like
-// the addition of new FDs to watch on). Every access to internal state is
+// epoll_wait() inside a loop. FDs are added to and removed from the epoll set
+// as they are (un)watched, so the cost of a wakeup only depends on the number
+// of ready FDs and not on the number of watched ones. A special FD (a pipe) is
+// also watched which is used to wake the thread up when it has to stop. Every
+// access to internal state is
 // synchronized using a single internal mutex. The thread is only stopped on
 // destruction of the object, by modifying a flag, which is the only member
 // variable accessed without acquiring the lock (because the notification to
@@ -93,33 +97,48 @@ static inline AsyncTaskId NextAsyncTaskId(const AsyncTaskId id) {
 // no need to treat that case.
 static const int kNotificationBufferSize = 10;
 
+// Maximum number of ready FDs handled per epoll_wait() call, the remaining
+// ones are reported by the next call.
+static const int kMaxEpollEvents = 64;
+
 // Async File Descriptor Watcher Implementation:
 class AsyncManager::AsyncFdWatcher {
  public:
   int WatchFdForNonBlockingReads(
       int file_descriptor, const ReadCallback& on_read_fd_ready_callback) {
-    // add file descriptor and callback
-    {
-      std::unique_lock<std::mutex> guard(internal_mutex_);
-      watched_shared_fds_[file_descriptor] = on_read_fd_ready_callback;
-    }
+    std::unique_lock<std::mutex> guard(internal_mutex_);
 
-    // start the thread if not started yet
+    // start the thread if not started yet, this also creates the epoll set
     int started = tryStartThread();
     if (started != 0) {
       LOG_ERROR(LOG_TAG, "%s: Unable to start thread", __func__);
       return started;
     }
 
-    // notify the thread so that it knows of the new FD
-    notifyThread();
+    // add file descriptor and callback, epoll picks it up even if the thread
+    // is already waiting so there is no need to notify it
+    bool already_watched = watched_shared_fds_.count(file_descriptor) != 0;
+    watched_shared_fds_[file_descriptor] = on_read_fd_ready_callback;
+    if (already_watched) return 0;
+
+    struct epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = file_descriptor;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, file_descriptor, &event) != 0) {
+      LOG_ERROR(LOG_TAG, "%s: Unable to watch fd %d: %s", __func__,
+                file_descriptor, strerror(errno));
+      watched_shared_fds_.erase(file_descriptor);
+      return -1;
+    }
 
     return 0;
   }
 
   void StopWatchingFileDescriptor(int file_descriptor) {
     std::unique_lock<std::mutex> guard(internal_mutex_);
-    watched_shared_fds_.erase(file_descriptor);
+    if (watched_shared_fds_.erase(file_descriptor) == 0) return;
+    // the fd may already be closed, in which case the kernel dropped it
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, file_descriptor, nullptr);
   }
 
   AsyncFdWatcher() = default;
@@ -144,6 +163,8 @@ class AsyncManager::AsyncFdWatcher {
     {
       std::unique_lock<std::mutex> guard(internal_mutex_);
       watched_shared_fds_.clear();
+      close(epoll_fd_);
+      epoll_fd_ = -1;
     }
 
     return 0;
@@ -153,8 +174,8 @@ class AsyncManager::AsyncFdWatcher {
   AsyncFdWatcher(const AsyncFdWatcher&) = delete;
   AsyncFdWatcher& operator=(const AsyncFdWatcher&) = delete;
 
-  // Make sure to call this with at least one file descriptor ready to be
-  // watched upon or the thread routine will return immediately
+  // Must be called with |internal_mutex_| held, so that no FD can be added
+  // before the epoll set exists
   int tryStartThread() {
     if (std::atomic_exchange(&running_, true)) {
       return 0;  // if already running
@@ -171,6 +192,22 @@ class AsyncManager::AsyncFdWatcher {
     notification_listen_fd_ = pipe_fds[0];
     notification_write_fd_ = pipe_fds[1];
 
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd_ < 0) {
+      LOG_ERROR(LOG_TAG, "%s: Unable to create epoll set: %s", __func__,
+                strerror(errno));
+      return -1;
+    }
+    struct epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = notification_listen_fd_;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, notification_listen_fd_, &event) !=
+        0) {
+      LOG_ERROR(LOG_TAG, "%s: Unable to watch the notification channel",
+                __func__);
+      return -1;
+    }
+
     thread_ = std::thread([this]() { ThreadRoutine(); });
     if (!thread_.joinable()) {
       LOG_ERROR(LOG_TAG, "%s: Unable to start reading thread", __func__);
@@ -189,46 +226,25 @@ class AsyncManager::AsyncFdWatcher {
     return 0;
   }
 
-  int setUpFileDescriptorSet(fd_set& read_fds) {
-    // add comm channel to the set
-    FD_SET(notification_listen_fd_, &read_fds);
-    int nfds = notification_listen_fd_;
-
-    // add watched FDs to the set
-    {
-      std::unique_lock<std::mutex> guard(internal_mutex_);
-      for (auto& fdp : watched_shared_fds_) {
-        FD_SET(fdp.first, &read_fds);
-        nfds = std::max(fdp.first, nfds);
-      }
-    }
-    return nfds;
-  }
-
-  // check the comm channel and read everything there
-  bool consumeThreadNotifications(fd_set& read_fds) {
-    if (FD_ISSET(notification_listen_fd_, &read_fds)) {
-      char buffer[kNotificationBufferSize];
-      while (TEMP_FAILURE_RETRY(read(notification_listen_fd_, buffer,
-                                     kNotificationBufferSize)) ==
-             kNotificationBufferSize) {
-      }
-      return true;
+  // read everything there is in the comm channel
+  void consumeThreadNotifications() {
+    char buffer[kNotificationBufferSize];
+    while (TEMP_FAILURE_RETRY(read(notification_listen_fd_, buffer,
+                                   kNotificationBufferSize)) ==
+           kNotificationBufferSize) {
     }
-    return false;
   }
 
-  // check all file descriptors and call callbacks if necesary
-  void runAppropriateCallbacks(fd_set& read_fds) {
-    // not a good idea to call a callback while holding the FD lock,
-    // nor to release the lock while traversing the map
+  // call the callbacks of the ready file descriptors
+  void runAppropriateCallbacks(const struct epoll_event* events, int count) {
+    // not a good idea to call a callback while holding the FD lock, and the
+    // fd may have been unwatched since epoll_wait() returned
     std::vector<decltype(watched_shared_fds_)::value_type> fds;
     {
       std::unique_lock<std::mutex> guard(internal_mutex_);
-      for (auto& fdc : watched_shared_fds_) {
-        if (FD_ISSET(fdc.first, &read_fds)) {
-          fds.push_back(fdc);
-        }
+      for (int i = 0; i < count; i++) {
+        auto it = watched_shared_fds_.find(events[i].data.fd);
+        if (it != watched_shared_fds_.end()) fds.push_back(*it);
       }
     }
     for (auto& p : fds) {
@@ -237,14 +253,12 @@ class AsyncManager::AsyncFdWatcher {
   }
 
   void ThreadRoutine() {
+    struct epoll_event events[kMaxEpollEvents];
     while (running_) {
-      fd_set read_fds;
-      FD_ZERO(&read_fds);
-      int nfds = setUpFileDescriptorSet(read_fds);
-
       // wait until there is data available to read on some FD
-      int retval = select(nfds + 1, &read_fds, NULL, NULL, NULL);
-      if (retval <= 0) {  // there was some error or a timeout
+      int count = TEMP_FAILURE_RETRY(
+          epoll_wait(epoll_fd_, events, kMaxEpollEvents, -1));
+      if (count <= 0) {  // there was some error
         LOG_ERROR(LOG_TAG,
                   "%s: There was an error while waiting for data on the file "
                   "descriptors",
@@ -252,14 +266,21 @@ class AsyncManager::AsyncFdWatcher {
         continue;
       }
 
-      consumeThreadNotifications(read_fds);
-
       // Do not read if there was a call to stop running
       if (!running_) {
         break;
       }
 
-      runAppropriateCallbacks(read_fds);
+      int ready = 0;
+      for (int i = 0; i < count; i++) {
+        if (events[i].data.fd == notification_listen_fd_) {
+          consumeThreadNotifications();
+        } else {
+          events[ready++] = events[i];
+        }
+      }
+
+      runAppropriateCallbacks(events, ready);
     }
   }
 
@@ -269,6 +290,9 @@ class AsyncManager::AsyncFdWatcher {
 
   std::map<int, ReadCallback> watched_shared_fds_;
 
+  // The epoll set holding the watched FDs and the notification channel
+  int epoll_fd_ = -1;
+
   // A pair of FD to send information to the reading thread
   int notification_listen_fd_;
   int notification_write_fd_;
@@ -279,15 +303,13 @@ class AsyncManager::AsyncTaskManager {
  public:
   AsyncTaskId ExecAsync(std::chrono::milliseconds delay,
                         const TaskCallback& callback) {
-    return scheduleTask(std::make_shared<Task>(
-        std::chrono::steady_clock::now() + delay, callback));
+    return scheduleTask(std::make_shared<Task>(now() + delay, callback));
   }
 
   AsyncTaskId ExecAsyncPeriodically(std::chrono::milliseconds delay,
                                     std::chrono::milliseconds period,
                                     const TaskCallback& callback) {
-    return scheduleTask(std::make_shared<Task>(
-        std::chrono::steady_clock::now() + delay, period, callback));
+    return scheduleTask(std::make_shared<Task>(now() + delay, period, callback));
   }
 
   bool CancelAsyncTask(AsyncTaskId async_task_id) {
@@ -301,11 +323,20 @@ class AsyncManager::AsyncTaskManager {
     return true;
   }
 
+  void UseVirtualClock() {
+    std::unique_lock<std::mutex> guard(internal_mutex_);
+    if (virtual_) return;
+    virtual_ = true;
+    virtual_clock_source_ = {VirtualNextDeadline, VirtualRunDue, this};
+    virtual_clock_register_source(&virtual_clock_source_);
+  }
+
   AsyncTaskManager() = default;
 
   ~AsyncTaskManager() = default;
 
   int stopThread() {
+    if (virtual_) virtual_clock_unregister_source(&virtual_clock_source_);
     {
       std::unique_lock<std::mutex> guard(internal_mutex_);
       tasks_by_id.clear();
@@ -389,6 +420,8 @@ class AsyncManager::AsyncTaskManager {
       task_queue_.insert(task);
       task_id = lastTaskId_;
     }
+    // in virtual time the tasks run on the thread advancing the clock
+    if (virtual_) return task_id;
     // start thread if necessary
     int started = tryStartThread();
     if (started != 0) {
@@ -422,6 +455,49 @@ class AsyncManager::AsyncTaskManager {
     return 0;
   }
 
+  std::chrono::steady_clock::time_point now() const {
+    if (virtual_) {
+      return std::chrono::steady_clock::time_point(
+          std::chrono::microseconds(virtual_clock_now_us()));
+    }
+    return std::chrono::steady_clock::now();
+  }
+
+  // Virtual clock source callbacks, |context| is the AsyncTaskManager.
+  static bool VirtualNextDeadline(void* context, period_ms_t* deadline_ms) {
+    AsyncTaskManager* manager = static_cast<AsyncTaskManager*>(context);
+    std::unique_lock<std::mutex> guard(manager->internal_mutex_);
+    if (manager->task_queue_.empty()) return false;
+    auto deadline = std::chrono::duration_cast<std::chrono::microseconds>(
+        (*manager->task_queue_.begin())->time.time_since_epoch());
+    // round up, the task is not due before its time
+    *deadline_ms = (deadline.count() + 999) / 1000;
+    return true;
+  }
+
+  static void VirtualRunDue(void* context) {
+    AsyncTaskManager* manager = static_cast<AsyncTaskManager*>(context);
+    while (1) {
+      TaskCallback callback;
+      {
+        std::unique_lock<std::mutex> guard(manager->internal_mutex_);
+        if (manager->task_queue_.empty()) return;
+        std::shared_ptr<Task> task_p = *(manager->task_queue_.begin());
+        if (task_p->time > manager->now()) return;
+        callback = task_p->callback;
+        manager->task_queue_.erase(task_p);
+        if (task_p->isPeriodic()) {
+          task_p->time += task_p->period;
+          manager->task_queue_.insert(task_p);
+        } else {
+          manager->tasks_by_id.erase(task_p->task_id);
+        }
+      }
+      // the callback may schedule or cancel tasks
+      callback();
+    }
+  }
+
   void ThreadRoutine() {
     while (1) {
       TaskCallback callback;
@@ -463,6 +539,9 @@ class AsyncManager::AsyncTaskManager {
   }
 
   bool running_ = false;
+  // Set once, before any task is scheduled
+  bool virtual_ = false;
+  virtual_clock_source_t virtual_clock_source_;
   std::thread thread_;
   std::mutex internal_mutex_;
   std::condition_variable internal_cond_var_;
@@ -509,6 +588,8 @@ AsyncTaskId AsyncManager::ExecAsyncPeriodically(
   return taskManager_p_->ExecAsyncPeriodically(delay, period, callback);
 }
 
+void AsyncManager::UseVirtualClock() { taskManager_p_->UseVirtualClock(); }
+
 bool AsyncManager::CancelAsyncTask(AsyncTaskId async_task_id) {
   return taskManager_p_->CancelAsyncTask(async_task_id);
 }
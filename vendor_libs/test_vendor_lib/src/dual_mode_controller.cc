@@ -18,6 +18,7 @@
 
 #include "dual_mode_controller.h"
 #include "device_factory.h"
+#include "swarm_scenario.h"
 
 #include <memory>
 
@@ -44,6 +45,10 @@ const uint8_t kUnknownHciCommand = 1;
 const std::string kControllerPropertiesFile =
     "/etc/bluetooth/controller_properties.json";
 
+// Upper bound of advertising reports generated per timer tick. Advertisers
+// that do not fit are reported by the next tick.
+const size_t kMaxAdvertisingReportsPerTick = 8192;
+
 void LogCommand(const char* command) {
   LOG_INFO(LOG_TAG, "Controller performing command: %s", command);
 }
@@ -187,6 +192,7 @@ DualModeController::DualModeController()
   SET_TEST_HANDLER("add", TestChannelAdd);
   SET_TEST_HANDLER("del", TestChannelDel);
   SET_TEST_HANDLER("list", TestChannelList);
+  SET_TEST_HANDLER("add_swarm", TestChannelAddSwarm);
 #undef SET_TEST_HANDLER
 }
 
@@ -315,61 +321,59 @@ void DualModeController::Connections() {
 void DualModeController::LeScan() {
   std::unique_ptr<EventPacket> le_adverts =
       EventPacket::CreateLeAdvertisingReportEvent();
-  vector<uint8_t> ad;
-  for (size_t dev = 0; dev < devices_.size(); dev++) {
-    uint8_t adv_type;
-    const BtAddress addr = devices_[dev]->GetBtAddress();
-    uint8_t addr_type = devices_[dev]->GetAddressType();
-    ad.clear();
+  std::vector<AdvertisingScheduler::Advertiser> due;
+  adv_scheduler_.CollectDue(std::chrono::steady_clock::now(),
+                            std::chrono::milliseconds(le_scan_window_),
+                            kMaxAdvertisingReportsPerTick, &due);
 
-    // Listen for Advertisements
-    if (devices_[dev]->IsAdvertisementAvailable(
-            std::chrono::milliseconds(le_scan_window_))) {
-      ad = devices_[dev]->GetAdvertisement();
-      adv_type = devices_[dev]->GetAdvertisementType();
-      if (le_scan_enable_ && !le_adverts->AddLeAdvertisingReport(
-                                 adv_type, addr_type, addr, ad, GetRssi(dev))) {
-        send_event_(std::move(le_adverts));
-        le_adverts = EventPacket::CreateLeAdvertisingReportEvent();
-        CHECK(le_adverts->AddLeAdvertisingReport(adv_type, addr_type, addr, ad,
-                                                 GetRssi(dev)));
-      }
+  for (const AdvertisingScheduler::Advertiser& advertiser : due) {
+    const std::shared_ptr<Device>& device = advertiser.device;
+    const BtAddress& addr = device->GetBtAddress();
+    uint8_t addr_type = device->GetAddressType();
+    uint8_t rssi = advertiser.rssi;
 
-      // Connect
-      if (le_connect_ && (adv_type == BTM_BLE_CONNECT_EVT ||
-                          adv_type == BTM_BLE_CONNECT_DIR_EVT)) {
-        LOG_INFO(LOG_TAG, "Connecting to device %d", static_cast<int>(dev));
-        if (peer_address_ == addr && peer_address_type_ == addr_type &&
-            devices_[dev]->LeConnect()) {
-          uint16_t handle = LeGetHandle();
-          std::unique_ptr<EventPacket> event =
-              EventPacket::CreateLeConnectionCompleteEvent(
-                  kSuccessStatus, handle, HCI_ROLE_MASTER, addr_type, addr,
-                  LeGetConnInterval(), LeGetConnLatency(),
-                  LeGetSupervisionTimeout());
-          send_event_(std::move(event));
-          le_connect_ = false;
-
-          connections_.push_back(
-              std::make_shared<Connection>(devices_[dev], handle));
-        }
+    // Listen for Advertisements
+    const vector<uint8_t>& ad = device->GetAdvertisement();
+    uint8_t adv_type = device->GetAdvertisementType();
+    if (le_scan_enable_ &&
+        !le_adverts->AddLeAdvertisingReport(adv_type, addr_type, addr, ad,
+                                            rssi)) {
+      send_event_(std::move(le_adverts));
+      le_adverts = EventPacket::CreateLeAdvertisingReportEvent();
+      CHECK(le_adverts->AddLeAdvertisingReport(adv_type, addr_type, addr, ad,
+                                               rssi));
+    }
 
-        // TODO: Handle the white list (if (InWhiteList(dev)))
+    // Connect
+    if (le_connect_ && (adv_type == BTM_BLE_CONNECT_EVT ||
+                        adv_type == BTM_BLE_CONNECT_DIR_EVT)) {
+      LOG_INFO(LOG_TAG, "Connecting to device %s", device->ToString().c_str());
+      if (peer_address_ == addr && peer_address_type_ == addr_type &&
+          device->LeConnect()) {
+        uint16_t handle = LeGetHandle();
+        std::unique_ptr<EventPacket> event =
+            EventPacket::CreateLeConnectionCompleteEvent(
+                kSuccessStatus, handle, HCI_ROLE_MASTER, addr_type, addr,
+                LeGetConnInterval(), LeGetConnLatency(),
+                LeGetSupervisionTimeout());
+        send_event_(std::move(event));
+        le_connect_ = false;
+
+        connections_.push_back(std::make_shared<Connection>(device, handle));
       }
 
-      // Active scanning
-      if (le_scan_enable_ && le_scan_type_ == 1) {
-        ad.clear();
-        if (devices_[dev]->HasScanResponse()) {
-          ad = devices_[dev]->GetScanResponse();
-          if (!le_adverts->AddLeAdvertisingReport(
-                  BTM_BLE_SCAN_RSP_EVT, addr_type, addr, ad, GetRssi(dev))) {
-            send_event_(std::move(le_adverts));
-            le_adverts = EventPacket::CreateLeAdvertisingReportEvent();
-            CHECK(le_adverts->AddLeAdvertisingReport(
-                BTM_BLE_SCAN_RSP_EVT, addr_type, addr, ad, GetRssi(dev)));
-          }
-        }
+      // TODO: Handle the white list (if (InWhiteList(dev)))
+    }
+
+    // Active scanning
+    if (le_scan_enable_ && le_scan_type_ == 1 && device->HasScanResponse()) {
+      const vector<uint8_t>& scan_rsp = device->GetScanResponse();
+      if (!le_adverts->AddLeAdvertisingReport(BTM_BLE_SCAN_RSP_EVT, addr_type,
+                                              addr, scan_rsp, rssi)) {
+        send_event_(std::move(le_adverts));
+        le_adverts = EventPacket::CreateLeAdvertisingReportEvent();
+        CHECK(le_adverts->AddLeAdvertisingReport(
+            BTM_BLE_SCAN_RSP_EVT, addr_type, addr, scan_rsp, rssi));
       }
     }
   }
@@ -452,6 +456,35 @@ void DualModeController::TestChannelAdd(const vector<std::string>& args) {
   }
 
   devices_.push_back(new_dev);
+  adv_scheduler_.Add(new_dev, GetRssi(devices_.size() - 1),
+                     std::chrono::steady_clock::now() +
+                         new_dev->GetAdvertisementInterval());
+}
+
+void DualModeController::TestChannelAddSwarm(const vector<std::string>& args) {
+  LogCommand("TestChannel 'add_swarm'");
+
+  if (args.empty()) {
+    LOG_ERROR(LOG_TAG, "TestChannel 'add_swarm' needs a scenario file!");
+    return;
+  }
+
+  SwarmScenario scenario;
+  if (!scenario.LoadFromFile(args[0])) {
+    LOG_ERROR(LOG_TAG, "TestChannel 'add_swarm' failed!");
+    return;
+  }
+
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  size_t in_range = 0;
+  for (const SwarmScenario::Member& member : scenario.CreateMembers()) {
+    devices_.push_back(member.device);
+    if (adv_scheduler_.Add(member.device, member.rssi, now + member.phase))
+      in_range++;
+  }
+
+  LOG_INFO(LOG_TAG, "TestChannel 'add_swarm': %zu advertisers, %zu in range",
+           scenario.GetMemberCount(), in_range);
 }
 
 void DualModeController::TestChannelDel(const vector<std::string>& args) {
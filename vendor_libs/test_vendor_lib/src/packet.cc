@@ -19,6 +19,7 @@
 #include "packet.h"
 
 #include <algorithm>
+#include <mutex>
 
 #include <base/logging.h>
 #include "osi/include/log.h"
@@ -27,11 +28,55 @@ using std::vector;
 
 namespace test_vendor_lib {
 
+namespace {
+
+// Payload buffers are recycled between packets, so that the controller does
+// not allocate and grow a vector for every event it builds. Packets are
+// destroyed on the transport thread, hence the lock.
+class PayloadPool {
+ public:
+  vector<uint8_t> Acquire(size_t capacity) {
+    vector<uint8_t> buffer;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!free_.empty()) {
+        buffer = std::move(free_.back());
+        free_.pop_back();
+      }
+    }
+    buffer.clear();
+    buffer.reserve(capacity);
+    return buffer;
+  }
+
+  void Release(vector<uint8_t> buffer) {
+    if (buffer.capacity() == 0) return;
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (free_.size() < kMaxPooledBuffers) free_.push_back(std::move(buffer));
+  }
+
+ private:
+  static const size_t kMaxPooledBuffers = 256;
+
+  std::mutex mutex_;
+  vector<vector<uint8_t>> free_;
+};
+
+PayloadPool& GetPayloadPool() {
+  static PayloadPool* pool = new PayloadPool();
+  return *pool;
+}
+
+}  // namespace
+
 Packet::Packet(serial_data_type_t type, vector<uint8_t> header)
     : type_(type), header_(std::move(header)) {
-  payload_ = {0};
+  payload_ = GetPayloadPool().Acquire(kMaxPayloadOctets);
+  payload_.push_back(0);
 }
 
+Packet::~Packet() { GetPayloadPool().Release(std::move(payload_)); }
+
 bool Packet::AddPayloadOctets(size_t octets, const vector<uint8_t>& bytes) {
   if (GetPayloadSize() + octets > kMaxPayloadOctets) return false;
 
@@ -44,20 +89,25 @@ bool Packet::AddPayloadOctets(size_t octets, const vector<uint8_t>& bytes) {
 }
 
 bool Packet::AddPayloadOctets(size_t octets, uint64_t value) {
-  vector<uint8_t> val_vector;
+  uint8_t val_octets[sizeof(uint64_t)];
 
   uint64_t v = value;
 
   if (octets > sizeof(uint64_t)) return false;
 
   for (size_t i = 0; i < octets; i++) {
-    val_vector.push_back(v & 0xff);
+    val_octets[i] = v & 0xff;
     v = v >> 8;
   }
 
   if (v != 0) return false;
 
-  return AddPayloadOctets(octets, val_vector);
+  if (GetPayloadSize() + octets > kMaxPayloadOctets) return false;
+
+  payload_.insert(payload_.end(), val_octets, val_octets + octets);
+  payload_[0] = payload_.size() - 1;
+
+  return true;
 }
 
 bool Packet::AddPayloadBtAddress(const BtAddress& address) {
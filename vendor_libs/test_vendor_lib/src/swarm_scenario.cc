@@ -0,0 +1,185 @@
+//
+// Copyright 2019 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#define LOG_TAG "swarm_scenario"
+
+#include "swarm_scenario.h"
+
+#include <algorithm>
+
+#include <base/logging.h>
+#include "base/files/file_util.h"
+#include "base/json/json_reader.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/values.h"
+
+#include "osi/include/log.h"
+#include "stack/include/btm_ble_api.h"
+
+using std::vector;
+
+namespace test_vendor_lib {
+
+namespace {
+
+// Maximum number of advertisers, keeps a typo in a scenario from exhausting
+// the memory of the host.
+const size_t kMaxMembers = 1 << 20;
+
+// Derive the address of member |index| from the group base address.
+BtAddress MemberAddress(const BtAddress& base, size_t index) {
+  vector<uint8_t> octets;
+  base.ToVector(octets);
+
+  size_t carry = index;
+  for (size_t i = 0; i < octets.size() && carry != 0; i++) {
+    carry += octets[i];
+    octets[i] = carry & 0xff;
+    carry >>= 8;
+  }
+
+  BtAddress address;
+  address.FromVector(octets);
+  return address;
+}
+
+bool GetHexField(const base::DictionaryValue* dict, const std::string& key,
+                 vector<uint8_t>* out) {
+  std::string hex;
+  if (!dict->GetString(key, &hex)) return true;  // optional
+  out->clear();
+  return hex.empty() || base::HexStringToBytes(hex, out);
+}
+
+}  // namespace
+
+SwarmBeacon::SwarmBeacon(const BtAddress& address, uint8_t advertising_type,
+                         std::chrono::milliseconds interval,
+                         const vector<uint8_t>& adv_data,
+                         const vector<uint8_t>& scan_data) {
+  address_ = address;
+  address_type_ = kBtAddressTypeRandom;
+  advertising_type_ = advertising_type;
+  advertising_interval_ms_ = interval;
+  adv_data_ = adv_data;
+  scan_response_present_ = !scan_data.empty();
+  scan_data_ = scan_data;
+}
+
+bool SwarmScenario::LoadFromFile(const std::string& file_name) {
+  std::string json;
+  if (!base::ReadFileToString(base::FilePath(file_name), &json)) {
+    LOG_ERROR(LOG_TAG, "Error reading swarm scenario %s", file_name.c_str());
+    return false;
+  }
+  return LoadFromString(json);
+}
+
+bool SwarmScenario::LoadFromString(const std::string& json) {
+  std::unique_ptr<base::Value> value = base::JSONReader::Read(json);
+  const base::DictionaryValue* root = nullptr;
+  if (value.get() == nullptr || !value->GetAsDictionary(&root)) {
+    LOG_ERROR(LOG_TAG, "Swarm scenario is ill-formed JSON");
+    return false;
+  }
+
+  const base::ListValue* groups = nullptr;
+  if (!root->GetList("Groups", &groups)) {
+    LOG_ERROR(LOG_TAG, "Swarm scenario has no Groups");
+    return false;
+  }
+
+  vector<Group> parsed;
+  size_t total = 0;
+  for (size_t i = 0; i < groups->GetSize(); i++) {
+    const base::DictionaryValue* dict = nullptr;
+    if (!groups->GetDictionary(i, &dict)) return false;
+
+    Group group;
+    int count = 0;
+    std::string address;
+    int interval_ms = 0;
+    int advertising_type = BTM_BLE_NON_CONNECT_EVT;
+    int rssi = -60;
+    int rssi_spread = 0;
+
+    if (!dict->GetInteger("Count", &count) || count <= 0 ||
+        !dict->GetString("BaseAddress", &address) ||
+        !group.base_address.FromString(address) ||
+        !dict->GetInteger("AdvertisingIntervalMs", &interval_ms) ||
+        interval_ms <= 0) {
+      LOG_ERROR(LOG_TAG, "Swarm group %zu is missing mandatory fields", i);
+      return false;
+    }
+    dict->GetInteger("AdvertisingType", &advertising_type);
+    dict->GetInteger("Rssi", &rssi);
+    dict->GetInteger("RssiSpread", &rssi_spread);
+
+    if (!GetHexField(dict, "AdvertisingData", &group.adv_data) ||
+        !GetHexField(dict, "ScanResponse", &group.scan_data) ||
+        group.adv_data.size() > 31 || group.scan_data.size() > 31) {
+      LOG_ERROR(LOG_TAG, "Swarm group %zu has invalid payloads", i);
+      return false;
+    }
+
+    total += count;
+    if (total > kMaxMembers) {
+      LOG_ERROR(LOG_TAG, "Swarm scenario has more than %zu members",
+                kMaxMembers);
+      return false;
+    }
+
+    group.count = count;
+    group.interval = std::chrono::milliseconds(interval_ms);
+    group.advertising_type = advertising_type;
+    group.rssi = std::max(-127, std::min(20, rssi));
+    group.rssi_spread = std::max(0, std::min(127 + group.rssi, rssi_spread));
+    parsed.push_back(group);
+  }
+
+  groups_.insert(groups_.end(), parsed.begin(), parsed.end());
+  return true;
+}
+
+size_t SwarmScenario::GetMemberCount() const {
+  size_t count = 0;
+  for (const Group& group : groups_) count += group.count;
+  return count;
+}
+
+vector<SwarmScenario::Member> SwarmScenario::CreateMembers() const {
+  vector<Member> members;
+  members.reserve(GetMemberCount());
+
+  for (const Group& group : groups_) {
+    for (size_t i = 0; i < group.count; i++) {
+      Member member;
+      member.device = std::make_shared<SwarmBeacon>(
+          MemberAddress(group.base_address, i), group.advertising_type,
+          group.interval, group.adv_data, group.scan_data);
+      // Scatter the signal strengths so that consecutive members differ.
+      int8_t rssi = group.rssi;
+      if (group.rssi_spread) rssi -= (i * 7919) % (group.rssi_spread + 1);
+      member.rssi = static_cast<uint8_t>(rssi);
+      member.phase = group.interval * i / group.count;
+      members.push_back(member);
+    }
+  }
+
+  return members;
+}
+
+}  // namespace test_vendor_lib
@@ -0,0 +1,229 @@
+//
+// Copyright 2019 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "advertising_scheduler.h"
+#include "event_packet.h"
+#include "swarm_scenario.h"
+
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <set>
+#include <vector>
+
+#include "stack/include/btm_ble_api.h"
+
+using std::vector;
+using std::chrono::milliseconds;
+
+namespace test_vendor_lib {
+
+namespace {
+
+using Clock = AdvertisingScheduler::Clock;
+
+const milliseconds kTick(100);
+
+std::shared_ptr<Device> MakeBeacon(uint8_t last_octet, milliseconds interval) {
+  BtAddress address;
+  address.FromString("c0:00:00:00:00:00");
+  vector<uint8_t> octets;
+  address.ToVector(octets);
+  octets[0] = last_octet;
+  address.FromVector(octets);
+  return std::make_shared<SwarmBeacon>(address, BTM_BLE_NON_CONNECT_EVT,
+                                       interval, vector<uint8_t>{0x02, 0x01,
+                                                                 0x04},
+                                       vector<uint8_t>());
+}
+
+}  // namespace
+
+TEST(AdvertisingSchedulerTest, OnlyDueAdvertisersAreReported) {
+  AdvertisingScheduler scheduler;
+  Clock::time_point start = Clock::now();
+
+  auto fast = MakeBeacon(1, milliseconds(100));
+  auto slow = MakeBeacon(2, milliseconds(1000));
+  EXPECT_TRUE(scheduler.Add(fast, 0xc4, start + milliseconds(100)));
+  EXPECT_TRUE(scheduler.Add(slow, 0xc4, start + milliseconds(1000)));
+
+  size_t fast_reports = 0;
+  size_t slow_reports = 0;
+  for (Clock::time_point now = start; now < start + milliseconds(2000);
+       now += kTick) {
+    vector<AdvertisingScheduler::Advertiser> due;
+    scheduler.CollectDue(now, milliseconds(0), 100, &due);
+    for (auto& advertiser : due) {
+      if (advertiser.device == fast) fast_reports++;
+      if (advertiser.device == slow) slow_reports++;
+    }
+  }
+
+  EXPECT_EQ(19u, fast_reports);
+  EXPECT_EQ(1u, slow_reports);
+}
+
+TEST(AdvertisingSchedulerTest, RemovedAndSilentDevicesAreDropped) {
+  AdvertisingScheduler scheduler;
+  Clock::time_point start = Clock::now();
+
+  auto removed = MakeBeacon(1, milliseconds(100));
+  auto stopped = MakeBeacon(2, milliseconds(100));
+  auto silent = MakeBeacon(3, milliseconds(0));
+  EXPECT_TRUE(scheduler.Add(removed, 0xc4, start));
+  EXPECT_TRUE(scheduler.Add(stopped, 0xc4, start));
+  EXPECT_FALSE(scheduler.Add(silent, 0xc4, start));
+  EXPECT_EQ(2u, scheduler.Size());
+
+  removed.reset();
+  stopped->SetAdvertisementInterval(milliseconds(0));
+
+  vector<AdvertisingScheduler::Advertiser> due;
+  scheduler.CollectDue(start, milliseconds(0), 100, &due);
+  EXPECT_TRUE(due.empty());
+  EXPECT_EQ(0u, scheduler.Size());
+}
+
+TEST(AdvertisingSchedulerTest, OutOfRangeAdvertisersAreNotScheduled) {
+  AdvertisingScheduler scheduler;
+  scheduler.SetSensitivity(-90);
+
+  EXPECT_TRUE(scheduler.Add(MakeBeacon(1, milliseconds(100)),
+                            static_cast<uint8_t>(-60), Clock::now()));
+  EXPECT_FALSE(scheduler.Add(MakeBeacon(2, milliseconds(100)),
+                             static_cast<uint8_t>(-95), Clock::now()));
+  EXPECT_EQ(1u, scheduler.Size());
+}
+
+TEST(AdvertisingSchedulerTest, BacklogIsSpreadOverTicks) {
+  AdvertisingScheduler scheduler;
+  Clock::time_point start = Clock::now();
+  vector<std::shared_ptr<Device>> devices;
+  for (int i = 0; i < 250; i++) {
+    devices.push_back(MakeBeacon(i, milliseconds(1000)));
+    scheduler.Add(devices.back(), 0xc4, start);
+  }
+
+  std::set<Device*> reported;
+  for (int tick = 0; tick < 3; tick++) {
+    vector<AdvertisingScheduler::Advertiser> due;
+    scheduler.CollectDue(start + kTick * tick, milliseconds(0), 100, &due);
+    EXPECT_EQ(tick < 2 ? 100u : 50u, due.size());
+    for (auto& advertiser : due) reported.insert(advertiser.device.get());
+  }
+
+  // every advertiser reported exactly once
+  EXPECT_EQ(250u, reported.size());
+}
+
+TEST(SwarmScenarioTest, LoadFromString) {
+  SwarmScenario scenario;
+  EXPECT_TRUE(scenario.LoadFromString(R"({
+    "Groups": [
+      { "Count": 300, "BaseAddress": "c0:00:00:00:00:f0",
+        "AdvertisingIntervalMs": 100, "AdvertisingData": "020104",
+        "ScanResponse": "03087377", "Rssi": -50, "RssiSpread": 20 },
+      { "Count": 5, "BaseAddress": "c1:00:00:00:00:00",
+        "AdvertisingIntervalMs": 1000 }
+    ]
+  })"));
+  EXPECT_EQ(305u, scenario.GetMemberCount());
+
+  vector<SwarmScenario::Member> members = scenario.CreateMembers();
+  ASSERT_EQ(305u, members.size());
+
+  std::set<std::string> addresses;
+  for (auto& member : members) {
+    addresses.insert(member.device->GetBtAddress().ToString());
+    int8_t rssi = static_cast<int8_t>(member.rssi);
+    EXPECT_LE(rssi, -50);
+    EXPECT_GE(rssi, -70);
+  }
+  EXPECT_EQ(305u, addresses.size());
+  EXPECT_TRUE(members[0].device->HasScanResponse());
+  EXPECT_FALSE(members[300].device->HasScanResponse());
+  EXPECT_EQ(milliseconds(50), members[150].phase);
+
+  EXPECT_FALSE(scenario.LoadFromString("{}"));
+  EXPECT_FALSE(scenario.LoadFromString(
+      R"({"Groups": [{"Count": 1, "BaseAddress": "nope",
+                      "AdvertisingIntervalMs": 100}]})"));
+}
+
+// Generates the advertising reports of a stadium sized swarm the way the
+// controller does on every tick, and checks that the fabric sustains well over
+// 10k reports per second of simulated time, faster than real time.
+TEST(SwarmStressTest, StadiumSwarmReportRate) {
+  const size_t kMembers = 20000;
+  const milliseconds kDuration(10000);
+
+  SwarmScenario scenario;
+  BtAddress base;
+  base.FromString("c0:00:00:00:00:00");
+  scenario.AddGroup(SwarmScenario::Group{
+      kMembers, base, milliseconds(1000), BTM_BLE_NON_CONNECT_EVT,
+      vector<uint8_t>(30, 0xa5), vector<uint8_t>(), -40, 60});
+
+  AdvertisingScheduler scheduler;
+  scheduler.SetSensitivity(-95);
+  Clock::time_point start = Clock::now();
+  vector<SwarmScenario::Member> members = scenario.CreateMembers();
+  for (auto& member : members)
+    scheduler.Add(member.device, member.rssi, start + member.phase);
+
+  size_t reports = 0;
+  size_t events = 0;
+  Clock::time_point wall_start = Clock::now();
+  vector<AdvertisingScheduler::Advertiser> due;
+  for (Clock::time_point now = start; now < start + kDuration; now += kTick) {
+    due.clear();
+    scheduler.CollectDue(now, milliseconds(0), 8192, &due);
+
+    std::unique_ptr<EventPacket> adverts =
+        EventPacket::CreateLeAdvertisingReportEvent();
+    for (auto& advertiser : due) {
+      const Device& device = *advertiser.device;
+      if (!adverts->AddLeAdvertisingReport(
+              device.GetAdvertisementType(), device.GetAddressType(),
+              device.GetBtAddress(), device.GetAdvertisement(),
+              advertiser.rssi)) {
+        events++;
+        adverts = EventPacket::CreateLeAdvertisingReportEvent();
+        ASSERT_TRUE(adverts->AddLeAdvertisingReport(
+            device.GetAdvertisementType(), device.GetAddressType(),
+            device.GetBtAddress(), device.GetAdvertisement(),
+            advertiser.rssi));
+      }
+      reports++;
+    }
+    events++;
+  }
+  milliseconds wall = std::chrono::duration_cast<milliseconds>(
+      Clock::now() - wall_start);
+
+  size_t reports_per_second = reports * 1000 / kDuration.count();
+  EXPECT_GE(reports_per_second, 10000u);
+  // one event per report would be too many for the transport
+  EXPECT_LT(events, reports);
+  EXPECT_LT(wall, kDuration);
+  printf("%zu reports in %zu events, %zu reports/s simulated, %lld ms wall\n",
+         reports, events, reports_per_second,
+         static_cast<long long>(wall.count()));
+}
+
+}  // namespace test_vendor_lib
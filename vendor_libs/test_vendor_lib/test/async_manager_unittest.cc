@@ -15,6 +15,7 @@
 //
 
 #include "async_manager.h"
+#include "osi/include/virtual_clock.h"
 #include <gtest/gtest.h>
 #include <cstdint>
 #include <cstring>
@@ -171,4 +172,91 @@ TEST_F(AsyncManagerSocketTest, TestMultipleConnections) {
   }
 }
 
+class AsyncManagerVirtualTimeTest : public ::testing::Test {
+ protected:
+  static const period_ms_t kStartMs = 1000;
+
+  void SetUp() override {
+    virtual_clock_enable(kStartMs);
+    async_manager_.reset(new AsyncManager());
+    async_manager_->UseVirtualClock();
+  }
+
+  void TearDown() override {
+    async_manager_.reset();
+    virtual_clock_disable();
+  }
+
+  // Records the virtual time of each run of the task |id|
+  TaskCallback Record(int id) {
+    return [this, id]() {
+      runs_.push_back(std::make_pair(virtual_clock_now_ms(), id));
+    };
+  }
+
+  std::unique_ptr<AsyncManager> async_manager_;
+  std::vector<std::pair<period_ms_t, int>> runs_;
+};
+
+TEST_F(AsyncManagerVirtualTimeTest, TasksRunInTimeOrder) {
+  async_manager_->ExecAsync(std::chrono::milliseconds(300), Record(3));
+  async_manager_->ExecAsync(std::chrono::milliseconds(100), Record(1));
+  async_manager_->ExecAsync(std::chrono::milliseconds(200), Record(2));
+  AsyncTaskId cancelled =
+      async_manager_->ExecAsync(std::chrono::milliseconds(150), Record(4));
+  EXPECT_TRUE(async_manager_->CancelAsyncTask(cancelled));
+
+  // Nothing runs until the clock moves
+  EXPECT_TRUE(runs_.empty());
+
+  virtual_clock_advance(1000);
+  std::vector<std::pair<period_ms_t, int>> expected = {
+      {kStartMs + 100, 1}, {kStartMs + 200, 2}, {kStartMs + 300, 3}};
+  EXPECT_EQ(expected, runs_);
+}
+
+TEST_F(AsyncManagerVirtualTimeTest, PeriodicTasksOverHours) {
+  static const period_ms_t kHourMs = 60 * 60 * 1000;
+  // An advertiser every 1.28 s and a scanner every 10 s, both starting now
+  async_manager_->ExecAsyncPeriodically(std::chrono::milliseconds(1280),
+                                        std::chrono::milliseconds(1280),
+                                        Record(0));
+  async_manager_->ExecAsyncPeriodically(std::chrono::milliseconds(10000),
+                                        std::chrono::milliseconds(10000),
+                                        Record(1));
+
+  virtual_clock_advance(6 * kHourMs);
+
+  size_t advertiser_runs = 0;
+  size_t scanner_runs = 0;
+  period_ms_t last_ms = 0;
+  for (const auto& run : runs_) {
+    EXPECT_LE(last_ms, run.first);
+    last_ms = run.first;
+    if (run.second == 0) {
+      advertiser_runs++;
+      EXPECT_EQ(kStartMs + advertiser_runs * 1280, run.first);
+    } else {
+      scanner_runs++;
+      EXPECT_EQ(kStartMs + scanner_runs * 10000, run.first);
+    }
+  }
+  EXPECT_EQ(6 * kHourMs / 1280, advertiser_runs);
+  EXPECT_EQ(6 * kHourMs / 10000, scanner_runs);
+}
+
+TEST_F(AsyncManagerVirtualTimeTest, TasksScheduledFromTasks) {
+  int remaining = 5;
+  TaskCallback chained = [this, &remaining, &chained]() {
+    runs_.push_back(std::make_pair(virtual_clock_now_ms(), remaining));
+    if (--remaining > 0)
+      async_manager_->ExecAsync(std::chrono::milliseconds(60000), chained);
+  };
+  async_manager_->ExecAsync(std::chrono::milliseconds(60000), chained);
+
+  EXPECT_EQ(kStartMs + 5 * 60000, virtual_clock_run_until_idle(24 * 60 * 60000));
+  ASSERT_EQ(5u, runs_.size());
+  EXPECT_EQ(kStartMs + 5 * 60000, runs_.back().first);
+}
+
 }  // namespace test_vendor_lib